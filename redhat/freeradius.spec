@@ -965,9 +965,11 @@ fi
 %{_libdir}/freeradius/proto_load_step.so
 %{_libdir}/freeradius/proto_radius.so
 %{_libdir}/freeradius/proto_radius_tcp.so
+%{_libdir}/freeradius/proto_radius_tls.so
 %{_libdir}/freeradius/proto_radius_udp.so
 %{_libdir}/freeradius/proto_tacacs.so
 %{_libdir}/freeradius/proto_tacacs_tcp.so
+%{_libdir}/freeradius/proto_tacacs_tls.so
 %{_libdir}/freeradius/proto_vmps.so
 %{_libdir}/freeradius/proto_vmps_udp.so
 
@@ -1062,6 +1064,7 @@ fi
 # Utility libraries
 %{_libdir}/freeradius/libfreeradius-bio.so
 %{_libdir}/freeradius/libfreeradius-bio-config.so
+%{_libdir}/freeradius/libfreeradius-bio-tls.so
 %{_libdir}/freeradius/libfreeradius-util.so
 
 # dictionaries
@@ -1190,6 +1193,7 @@ fi
 /usr/bin/radsqlrelay
 /usr/bin/radtest
 /usr/bin/raduat
+/usr/bin/radusers
 /usr/bin/smbencrypt
 # man-pages
 %doc %{_mandir}/man1/dhcpclient.1.gz
@@ -1197,6 +1201,7 @@ fi
 %doc %{_mandir}/man1/radtest.1.gz
 %doc %{_mandir}/man8/radsniff.8.gz
 %doc %{_mandir}/man8/radsqlrelay.8.gz
+%doc %{_mandir}/man8/radusers.8.gz
 
 %files snmp
 %defattr(-,root,root)
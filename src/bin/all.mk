@@ -8,6 +8,7 @@ SUBMAKEFILES := \
     radsnmp.mk \
     radsizes.mk \
     radtest.mk \
+    radusers.mk \
     dhcpclient.mk \
     unit_test_attribute.mk \
     unit_test_map.mk \
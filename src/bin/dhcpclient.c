@@ -63,6 +63,7 @@ static int iface_ind = -1;
 
 #ifdef HAVE_LINUX_IF_PACKET_H
 static struct sockaddr_ll ll;	/* Socket address structure */
+static fr_dhcpv4_raw_ring_t *ring;
 #endif
 
 static bool raw_mode = false;
@@ -260,7 +261,11 @@ static fr_packet_t *fr_dhcpv4_recv_raw_loop(int lsockfd,
 			/* There is something to read on our socket */
 
 #ifdef HAVE_LINUX_IF_PACKET_H
-			reply = fr_dhcpv4_raw_packet_recv(lsockfd, p_ll, request, request_list);
+			if (ring) {
+				reply = fr_dhcpv4_raw_ring_recv(ring, request, request_list);
+			} else {
+				reply = fr_dhcpv4_raw_packet_recv(lsockfd, p_ll, request, request_list);
+			}
 #else
 #  ifdef HAVE_LIBPCAP
 			reply = fr_dhcpv4_pcap_recv(pcap);
@@ -283,7 +288,23 @@ static fr_packet_t *fr_dhcpv4_recv_raw_loop(int lsockfd,
 				return NULL;
 			}
 
-			if (!found) found = reply;
+			if (!found) {
+				found = reply;
+
+#ifdef HAVE_LINUX_IF_PACKET_H
+				/*
+				 *	Ring packets point into the ring, and are
+				 *	only valid until the next read.
+				 */
+				if (ring) {
+					found->data = talloc_memdup(found, reply->data, reply->data_len);
+					if (!found->data) {
+						ERROR("Out of memory");
+						return NULL;
+					}
+				}
+#endif
+			}
 
 			if (reply->code == FR_DHCP_OFFER) {
 				fr_pair_t *vp1 = fr_pair_find_by_da(&reply_vps, NULL, attr_dhcp_dhcp_server_identifier);
@@ -296,6 +317,8 @@ static fr_packet_t *fr_dhcpv4_recv_raw_loop(int lsockfd,
 					offer_list[nb_offer - 1].offered_addr = vp2->vp_ipv4addr;
 				}
 			}
+
+			if (reply != found) fr_packet_free(&reply);
 		}
 	}
 
@@ -336,10 +359,14 @@ static int send_with_socket(fr_packet_t **reply, fr_packet_t *request,
 
 #ifdef HAVE_LINUX_IF_PACKET_H
 	if (raw_mode) {
-		sockfd = fr_dhcpv4_raw_socket_open(&ll, iface_ind);
-		if (sockfd < 0) {
-			ERROR("Error opening socket");
-			return -1;
+		if (ring) {
+			sockfd = fr_dhcpv4_raw_ring_fd(ring);
+		} else {
+			sockfd = fr_dhcpv4_raw_socket_open(&ll, iface_ind);
+			if (sockfd < 0) {
+				ERROR("Error opening socket");
+				return -1;
+			}
 		}
 	} else
 #endif
@@ -375,7 +402,12 @@ static int send_with_socket(fr_packet_t **reply, fr_packet_t *request,
 
 #ifdef HAVE_LINUX_IF_PACKET_H
 	if (raw_mode) {
-		if (fr_dhcpv4_raw_packet_send(sockfd, &ll, request, request_list) < 0) {
+		if (ring) {
+			if (fr_dhcpv4_raw_ring_send(ring, request, request_list) < 0) {
+				ERROR("Failed sending (fr_dhcpv4_raw_ring_send)");
+				return -1;
+			}
+		} else if (fr_dhcpv4_raw_packet_send(sockfd, &ll, request, request_list) < 0) {
 			ERROR("Failed sending (fr_dhcpv4_raw_packet_send): %s", fr_syserror(errno));
 			return -1;
 		}
@@ -722,8 +754,25 @@ int main(int argc, char **argv)
 		fr_pair_list_free(&reply_vps);
 	}
 
-#ifdef HAVE_LIBPCAP
+#ifdef HAVE_LINUX_IF_PACKET_H
+	/*
+	 *	Prefer a memory mapped ring, which filters out
+	 *	non-DHCP traffic in the kernel.  If we can't
+	 *	create one, fall back to libpcap, or a plain
+	 *	raw socket.
+	 */
 	if (raw_mode) {
+		ring = fr_dhcpv4_raw_ring_alloc(NULL, &ll, iface_ind);
+		if (!ring) DEBUG("Not using packet ring: %s", fr_strerror());
+	}
+#endif
+
+#ifdef HAVE_LIBPCAP
+	if (raw_mode
+#  ifdef HAVE_LINUX_IF_PACKET_H
+	    && !ring
+#  endif
+	    ) {
 		ret = send_with_pcap(&reply, packet, &packet_vps);
 	} else
 #endif
@@ -739,6 +788,14 @@ int main(int argc, char **argv)
 		dhcp_packet_debug(reply, &reply_vps, true);
 	}
 
+#ifdef HAVE_LINUX_IF_PACKET_H
+	/*
+	 *	The reply's data was copied out of the ring, so
+	 *	the ring can go before the reply is freed.
+	 */
+	TALLOC_FREE(ring);
+#endif
+
 	fr_dhcpv4_global_free();
 
 	if (fr_dict_autofree(dhcpclient_dict) < 0) {
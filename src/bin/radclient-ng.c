@@ -38,6 +38,12 @@ RCSID("$Id$")
 #include <freeradius-devel/radius/radius.h>
 #include <freeradius-devel/util/chap.h>
 #include <freeradius-devel/radius/client.h>
+#include <freeradius-devel/util/histogram.h>
+#include <freeradius-devel/util/net.h>
+
+#ifdef HAVE_LIBPCAP
+#  include <freeradius-devel/util/pcap.h>
+#endif
 
 #ifdef HAVE_OPENSSL_SSL_H
 #include <openssl/ssl.h>
@@ -49,6 +55,8 @@ RCSID("$Id$")
 #endif
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 typedef struct request_s request_t;	/* to shut up warnings about mschap.h */
 
@@ -172,10 +180,18 @@ static NEVER_RETURNS void usage(void)
 	fprintf(stderr, "  -F                                Print the file name, packet number and reply code.\n");
 	fprintf(stderr, "  -h                                Print usage help information.\n");
 	fprintf(stderr, "  -i <id>                           Set request id to 'id'.  Values may be 0..255\n");
+	fprintf(stderr, "  -I <file>                         Read request packets from a pcap file.\n");
+	fprintf(stderr, "  -j <threads>                      Number of threads to send packets from in load mode (defaults to 1).\n");
+	fprintf(stderr, "  -l <seconds>                      How long to send packets for in load mode (defaults to 10).\n");
+	fprintf(stderr, "  -L <pps>                          Load mode.  Send 'pps' packets per second, whether or not replies arrive.\n");
+	fprintf(stderr, "  -N <sockets>                      Number of sockets per thread in load mode (defaults to 1).\n");
 	fprintf(stderr, "  -o <port>                         Set CoA listening port (defaults to 3799)\n");
+	fprintf(stderr, "  -O <file>                         Write per-second load statistics to 'file', as JSON if it ends in .json, else CSV.\n");
 	fprintf(stderr, "  -p <num>                          Send 'num' packets from a file in parallel.\n");
 	fprintf(stderr, "  -P <proto>                        Use proto (tcp or udp) for transport.\n");
 	fprintf(stderr, "  -r <retries>                      If timeout, retry sending the packet 'retries' times.\n");
+	fprintf(stderr, "  -R <attribute>                    Randomise 'attribute' in each packet sent in load mode.  May be given\n");
+	fprintf(stderr, "                                    multiple times.  Each '#' in a string value is replaced by a digit.\n");
 	fprintf(stderr, "  -s                                Print out summary information of auth results.\n");
 	fprintf(stderr, "  -S <file>                         read secret from file, not command line.\n");
 	fprintf(stderr, "  -t <timeout>                      Wait 'timeout' seconds before retrying (may be a floating point number).\n");
@@ -264,7 +280,7 @@ static int _loop_status(UNUSED fr_time_t now, fr_time_delta_t wake, UNUSED void
 	return 0;
 }
 
-static int mschapv1_encode(fr_packet_t *packet, fr_pair_list_t *list,
+static int mschapv1_encode(TALLOC_CTX *ctx, fr_pair_list_t *list,
 			   char const *password)
 {
 	unsigned int		i;
@@ -275,7 +291,7 @@ static int mschapv1_encode(fr_packet_t *packet, fr_pair_list_t *list,
 	fr_pair_delete_by_da(list, attr_ms_chap_challenge);
 	fr_pair_delete_by_da(list, attr_ms_chap_response);
 
-	MEM(challenge = fr_pair_afrom_da(packet, attr_ms_chap_challenge));
+	MEM(challenge = fr_pair_afrom_da(ctx, attr_ms_chap_challenge));
 
 	fr_pair_append(list, challenge);
 
@@ -286,7 +302,7 @@ static int mschapv1_encode(fr_packet_t *packet, fr_pair_list_t *list,
 		p[i] = fr_rand();
 	}
 
-	MEM(reply = fr_pair_afrom_da(packet, attr_ms_chap_response));
+	MEM(reply = fr_pair_afrom_da(ctx, attr_ms_chap_response));
 	fr_pair_append(list, reply);
 	p = talloc_zero_array(reply, uint8_t, 50); /* really reply->da->flags.length */
 	fr_pair_value_memdup_buffer_shallow(reply, p, false);
@@ -978,6 +994,48 @@ static void client_packet_release(fr_bio_packet_t *client, fr_packet_t *packet)
 }
 
 
+/*
+ *	Update the password, so it can be encrypted with the
+ *	new authentication vector.  Any new pairs are allocated
+ *	in ctx.
+ */
+static void password_update(TALLOC_CTX *ctx, fr_packet_t *packet, fr_pair_list_t *list, fr_pair_t const *password)
+{
+	fr_pair_t *vp;
+
+	if ((vp = fr_pair_find_by_da(list, NULL, attr_user_password)) != NULL) {
+		fr_pair_value_strdup(vp, password->vp_strvalue, false);
+
+	} else if ((vp = fr_pair_find_by_da(list, NULL, attr_chap_password)) != NULL) {
+		uint8_t		buffer[17];
+		fr_pair_t	*challenge;
+		uint8_t	const	*vector;
+
+		/*
+		 *	Use Chap-Challenge pair if present,
+		 *	Request Authenticator otherwise.
+		 */
+		challenge = fr_pair_find_by_da(list, NULL, attr_chap_challenge);
+		if (challenge && (challenge->vp_length == RADIUS_AUTH_VECTOR_LENGTH)) {
+			vector = challenge->vp_octets;
+		} else {
+			vector = packet->vector;
+		}
+
+		fr_chap_encode(buffer,
+			       fr_rand() & 0xff, vector, RADIUS_AUTH_VECTOR_LENGTH,
+			       password->vp_strvalue,
+			       password->vp_length);
+		fr_pair_value_memdup(vp, buffer, sizeof(buffer), false);
+
+	} else if (fr_pair_find_by_da_nested(list, NULL, attr_ms_chap_password) != NULL) {
+		mschapv1_encode(ctx, list, password->vp_strvalue);
+
+	} else {
+		DEBUG("WARNING: No password in the request");
+	}
+}
+
 /*
  *	Send one packet.
  */
@@ -995,44 +1053,8 @@ static int send_one_packet(fr_bio_packet_t *client, rc_request_t *request)
 	fr_assert(request->packet->id < 0);
 	fr_assert(request->packet->data == NULL);
 
-	/*
-	 *	Update the password, so it can be encrypted with the
-	 *	new authentication vector.
-	 */
 	if (request->password) {
-		fr_pair_t *vp;
-
-		if ((vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_password)) != NULL) {
-			fr_pair_value_strdup(vp, request->password->vp_strvalue, false);
-
-		} else if ((vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_chap_password)) != NULL) {
-			uint8_t		buffer[17];
-			fr_pair_t	*challenge;
-			uint8_t	const	*vector;
-
-			/*
-			 *	Use Chap-Challenge pair if present,
-			 *	Request Authenticator otherwise.
-			 */
-			challenge = fr_pair_find_by_da(&request->request_pairs, NULL, attr_chap_challenge);
-			if (challenge && (challenge->vp_length == RADIUS_AUTH_VECTOR_LENGTH)) {
-				vector = challenge->vp_octets;
-			} else {
-				vector = request->packet->vector;
-			}
-
-			fr_chap_encode(buffer,
-				       fr_rand() & 0xff, vector, RADIUS_AUTH_VECTOR_LENGTH,
-				       request->password->vp_strvalue,
-				       request->password->vp_length);
-			fr_pair_value_memdup(vp, buffer, sizeof(buffer), false);
-
-		} else if (fr_pair_find_by_da_nested(&request->request_pairs, NULL, attr_ms_chap_password) != NULL) {
-			mschapv1_encode(request->packet, &request->request_pairs, request->password->vp_strvalue);
-
-		} else {
-			DEBUG("WARNING: No password in the request");
-		}
+		password_update(request->packet, request->packet, &request->request_pairs, request->password);
 	}
 
 	request->timestamp = fr_time();
@@ -1301,6 +1323,849 @@ static void  client_bio_connected(fr_bio_packet_t *client)
 }
 
 
+/*
+ *	Open loop load generation.
+ *
+ *	Each thread has its own event list, its own sockets, and its
+ *	own copy of every packet.  Packets are sent at a fixed rate, no
+ *	matter how quickly the server replies.  A slow server therefore
+ *	sees a growing backlog, instead of a client which slows down to
+ *	match it.
+ */
+#define RC_LOAD_TICK		fr_time_delta_from_msec(1)
+#define RC_LOAD_MAX_THREADS	(64)
+#define RC_LOAD_MAX_SOCKETS	(1024)	//!< Per thread.
+#define RC_LOAD_MAX_RANDOM	(16)
+#define RC_LOAD_MAX_OUTSTANDING	(255)	//!< Per socket.  Any more, and the oldest packet would be cancelled.
+#define RC_LOAD_READ_MAX	(64)	//!< Replies to read from a socket before returning to the event loop.
+
+typedef struct {
+	uint64_t		sent;		//!< Packets written to a socket.
+	uint64_t		received;	//!< Replies.
+	uint64_t		accepted;	//!< Access-Accept, or a response to any other request.
+	uint64_t		rejected;	//!< Access-Reject, CoA-NAK, Disconnect-NAK.
+	uint64_t		timeouts;	//!< Packets which had no reply.
+	uint64_t		skipped;	//!< Packets which were due, but every socket was busy.
+} rc_load_counters_t;
+
+typedef struct {
+	fr_pair_t		*vp;		//!< To change before each packet is sent.
+	char const		*pattern;	//!< Original string value.  Each '#' is replaced by a digit.
+} rc_load_random_t;
+
+typedef struct {
+	fr_radius_packet_code_t	code;
+	fr_pair_list_t		pairs;		//!< Updated in place before each packet is sent.
+	fr_pair_t const		*password;	//!< Password.Cleartext
+	rc_load_random_t	*random;	//!< Pairs to randomise.
+} rc_load_template_t;
+
+typedef struct {
+	unsigned int		id;
+	pthread_t		pthread_id;
+
+	TALLOC_CTX		*ctx;		//!< Only used by this thread once it's started.
+	fr_event_list_t		*el;
+	fr_timer_t		*ev;		//!< Send timer.
+
+	fr_radius_client_config_t config;	//!< Client configuration, using our event list.
+
+	fr_bio_packet_t		**bios;
+	unsigned int		num_bios;
+	unsigned int		next_bio;
+
+	rc_load_template_t	*templates;
+	unsigned int		num_templates;
+	unsigned int		next_template;
+
+	fr_time_t		start;		//!< When we started sending.
+	double			interval;	//!< Nanoseconds between packets.
+	uint64_t		scheduled;	//!< Packets which have been due so far.
+
+	fr_time_delta_t		drain;		//!< How long to wait for replies after we stop sending.
+	fr_time_t		drain_end;
+	bool			draining;
+	atomic_bool		exit;		//!< Set by the main thread to stop sending.
+
+	pthread_mutex_t		mutex;		//!< Protects the counters and the histogram.
+	rc_load_counters_t	counters;	//!< Since the main thread last collected them.
+	fr_histogram_t		*latency;	//!< Since the main thread last collected it.
+} rc_load_thread_t;
+
+static uint32_t			load_pps = 0;		//!< Target packets/s.  0 means "not a load test".
+static fr_time_delta_t		load_duration;
+static unsigned int		load_num_threads = 1;
+static unsigned int		load_num_sockets = 1;
+static char const		*load_output = NULL;	//!< CSV or JSON time series.
+static char const		*load_pcap = NULL;	//!< Read requests from this capture.
+static char const		*load_random_names[RC_LOAD_MAX_RANDOM];
+static fr_dict_attr_t const	*load_random[RC_LOAD_MAX_RANDOM];
+static unsigned int		load_num_random = 0;
+
+static void rc_load_counters_add(rc_load_counters_t *out, rc_load_counters_t const *in)
+{
+	out->sent += in->sent;
+	out->received += in->received;
+	out->accepted += in->accepted;
+	out->rejected += in->rejected;
+	out->timeouts += in->timeouts;
+	out->skipped += in->skipped;
+}
+
+/** Change the randomised pairs before a packet is sent
+ *
+ *  Strings have each '#' replaced with a random digit, octets are
+ *  filled with random data, integers get a random value, and IPv4
+ *  addresses get random low 16 bits.
+ */
+static void rc_load_randomise(rc_load_template_t *tmpl)
+{
+	size_t i;
+
+	for (i = 0; i < talloc_array_length(tmpl->random); i++) {
+		rc_load_random_t	*r = &tmpl->random[i];
+		fr_pair_t		*vp = r->vp;
+
+		switch (vp->vp_type) {
+		case FR_TYPE_STRING:
+		{
+			char	*p;
+			size_t	j, len = talloc_array_length(r->pattern) - 1;
+
+			if (fr_pair_value_bstr_realloc(vp, &p, len) < 0) break;
+
+			for (j = 0; j < len; j++) {
+				p[j] = (r->pattern[j] == '#') ? (char) ('0' + (fr_rand() % 10)) : r->pattern[j];
+			}
+		}
+			break;
+
+		case FR_TYPE_OCTETS:
+		{
+			uint8_t	*p;
+			size_t	len = vp->vp_length;
+
+			if (fr_pair_value_mem_realloc(vp, &p, len) < 0) break;
+
+			fr_rand_buffer(p, len);
+		}
+			break;
+
+		case FR_TYPE_UINT8:
+			vp->vp_uint8 = fr_rand();
+			break;
+
+		case FR_TYPE_UINT16:
+			vp->vp_uint16 = fr_rand();
+			break;
+
+		case FR_TYPE_UINT32:
+			vp->vp_uint32 = fr_rand();
+			break;
+
+		case FR_TYPE_UINT64:
+			vp->vp_uint64 = (((uint64_t) fr_rand()) << 32) | fr_rand();
+			break;
+
+		case FR_TYPE_IPV4_ADDR:
+			vp->vp_ipv4addr = htonl((ntohl(vp->vp_ipv4addr) & 0xffff0000) | (fr_rand() & 0xffff));
+			break;
+
+		default:
+			fr_assert(0);
+			break;
+		}
+	}
+}
+
+/** Find a socket which can take another packet
+ *
+ */
+static fr_bio_packet_t *rc_load_bio_next(rc_load_thread_t *t)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->num_bios; i++) {
+		fr_bio_packet_t *bio = t->bios[t->next_bio];
+
+		t->next_bio = (t->next_bio + 1) % t->num_bios;
+
+		if (!bio->connected) continue;
+
+		if (bio->write_blocked && ((fr_bio_packet_write_flush(bio) < 0) || bio->write_blocked)) continue;
+
+		if (fr_radius_client_bio_outstanding(bio) >= RC_LOAD_MAX_OUTSTANDING) continue;
+
+		return bio;
+	}
+
+	return NULL;
+}
+
+/** Send all of the packets which are due
+ *
+ *  Each packet is timestamped with when it should have been sent,
+ *  not when it was sent.  If this thread falls behind, the delay is
+ *  counted as latency, instead of being hidden.
+ */
+static void rc_load_send(rc_load_thread_t *t, fr_time_t now)
+{
+	uint64_t		due;
+	rc_load_counters_t	counters = {};
+
+	due = (uint64_t) (fr_time_delta_unwrap(fr_time_sub(now, t->start)) / t->interval) + 1;
+
+	while (t->scheduled < due) {
+		rc_load_template_t	*tmpl;
+		fr_bio_packet_t		*bio;
+		fr_packet_t		*packet;
+		fr_time_t		when;
+
+		when = fr_time_add(t->start, fr_time_delta_wrap((int64_t) (t->scheduled * t->interval)));
+		t->scheduled++;
+
+		bio = rc_load_bio_next(t);
+		if (!bio) {
+			counters.skipped++;
+			continue;
+		}
+
+		tmpl = &t->templates[t->next_template];
+		t->next_template = (t->next_template + 1) % t->num_templates;
+
+		packet = fr_packet_alloc(t->ctx, true);
+		if (!packet) {
+			counters.skipped++;
+			continue;
+		}
+		packet->code = tmpl->code;
+		packet->timestamp = when;
+		packet->uctx = packet;
+
+		if (tmpl->random) rc_load_randomise(tmpl);
+
+		if (tmpl->password) password_update(t->ctx, packet, &tmpl->pairs, tmpl->password);
+
+		if (fr_bio_packet_write(bio, packet, packet, &tmpl->pairs) < 0) {
+			talloc_free(packet);
+			counters.skipped++;
+			continue;
+		}
+
+		counters.sent++;
+	}
+
+	pthread_mutex_lock(&t->mutex);
+	rc_load_counters_add(&t->counters, &counters);
+	pthread_mutex_unlock(&t->mutex);
+}
+
+static void rc_load_tick(fr_timer_list_t *tl, fr_time_t now, void *uctx)
+{
+	rc_load_thread_t	*t = uctx;
+	size_t			outstanding = 0;
+	unsigned int		i;
+
+	if (!t->draining) {
+		if (!atomic_load(&t->exit)) {
+			rc_load_send(t, now);
+			goto next;
+		}
+
+		t->draining = true;
+		t->drain_end = fr_time_add(now, t->drain);
+	}
+
+	/*
+	 *	Wait for the outstanding packets to either get a
+	 *	reply, or to time out.
+	 */
+	for (i = 0; i < t->num_bios; i++) outstanding += fr_radius_client_bio_outstanding(t->bios[i]);
+
+	if (!outstanding || fr_time_gt(now, t->drain_end)) {
+		fr_event_loop_exit(t->el, 1);
+		return;
+	}
+
+next:
+	if (fr_timer_in(t->ctx, tl, &t->ev, RC_LOAD_TICK, false, rc_load_tick, t) < 0) {
+		ERROR("Failed inserting send timer");
+		fr_exit_now(EXIT_FAILURE);
+	}
+}
+
+static void rc_load_read(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	fr_bio_packet_t		*bio = uctx;
+	rc_load_thread_t	*t = bio->uctx;
+	int			i;
+
+	for (i = 0; i < RC_LOAD_READ_MAX; i++) {
+		fr_packet_t	*packet, *reply;
+		fr_pair_list_t	reply_pairs;
+		fr_time_delta_t	rtt;
+		int		rcode;
+
+		fr_pair_list_init(&reply_pairs);
+
+		rcode = fr_bio_packet_read(bio, (void **) &packet, &reply, t->ctx, &reply_pairs);
+		if (rcode < 0) {
+			ERROR("Failed reading packet - %s", fr_bio_strerror(rcode));
+			fr_exit_now(EXIT_FAILURE);
+		}
+
+		if (!rcode) break;
+
+		rtt = fr_time_sub(reply->timestamp, packet->timestamp);
+
+		pthread_mutex_lock(&t->mutex);
+		t->counters.received++;
+
+		switch (reply->code) {
+		case FR_RADIUS_CODE_ACCESS_REJECT:
+		case FR_RADIUS_CODE_COA_NAK:
+		case FR_RADIUS_CODE_DISCONNECT_NAK:
+			t->counters.rejected++;
+			break;
+
+		case FR_RADIUS_CODE_ACCESS_CHALLENGE:
+			break;
+
+		default:
+			t->counters.accepted++;
+			break;
+		}
+
+		fr_histogram_add(t->latency, fr_time_delta_ispos(rtt) ? fr_time_delta_unwrap(rtt) : 0);
+		pthread_mutex_unlock(&t->mutex);
+
+		/*
+		 *	The reply, and the reply pairs were allocated
+		 *	in the original packet.
+		 */
+		talloc_free(packet);
+	}
+}
+
+static void rc_load_release(fr_bio_packet_t *bio, fr_packet_t *packet)
+{
+	rc_load_thread_t *t = bio->uctx;
+
+	pthread_mutex_lock(&t->mutex);
+	t->counters.timeouts++;
+	pthread_mutex_unlock(&t->mutex);
+
+	talloc_free(packet);
+}
+
+static NEVER_RETURNS void rc_load_bio_failed(UNUSED fr_bio_packet_t *bio)
+{
+	ERROR("Failed connecting to server");
+	fr_exit_now(EXIT_FAILURE);
+}
+
+static NEVER_RETURNS void rc_load_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags,
+					int fd_errno, UNUSED void *uctx)
+{
+	ERROR("Failed in connection - %s", fr_syserror(fd_errno));
+	fr_exit_now(EXIT_FAILURE);
+}
+
+static void rc_load_bio_connected(fr_bio_packet_t *bio)
+{
+	rc_load_thread_t			*t = bio->uctx;
+	fr_radius_client_bio_info_t const	*info = fr_radius_client_bio_info(bio);
+
+	if (fr_event_fd_insert(t->ctx, NULL, t->el, info->fd_info->socket.fd,
+			       rc_load_read, NULL, rc_load_error, bio) < 0) {
+		fr_perror("radclient");
+		fr_exit_now(EXIT_FAILURE);
+	}
+}
+
+static void *rc_load_thread(void *arg)
+{
+	rc_load_thread_t *t = arg;
+
+	t->start = fr_time();
+
+	if (fr_timer_in(t->ctx, t->el->tl, &t->ev, RC_LOAD_TICK, false, rc_load_tick, t) < 0) {
+		ERROR("Failed inserting send timer");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	(void) fr_event_loop(t->el);
+
+	return NULL;
+}
+
+/** Set up a thread's sockets, and its copy of the packets
+ *
+ *  This is run in the main thread, before the thread is started.
+ */
+static int rc_load_thread_init(rc_load_thread_t *t, unsigned int id, fr_time_delta_t timeout)
+{
+	unsigned int i = 0, j;
+
+	t->id = id;
+	t->ctx = talloc_init_const("radclient_load");
+	if (!t->ctx) return -1;
+
+	pthread_mutex_init(&t->mutex, NULL);
+
+	t->interval = ((double) NSEC * load_num_threads) / load_pps;
+	t->drain = fr_time_delta_add(timeout, fr_time_delta_from_sec(1));
+
+	t->latency = fr_histogram_alloc(t->ctx, FR_HISTOGRAM_PRECISION_DEFAULT);
+	if (!t->latency) {
+		fr_perror("radclient");
+		return -1;
+	}
+
+	t->el = fr_event_list_alloc(t->ctx, NULL, NULL);
+	if (!t->el) {
+		ERROR("Failed opening event list: %s", fr_strerror());
+		return -1;
+	}
+
+	t->config = client_config;
+	t->config.el = t->el;
+	t->config.retry_cfg.el = t->el;
+	t->config.packet_cb_cfg = (fr_bio_packet_cb_funcs_t) {
+		.connected	= rc_load_bio_connected,
+		.failed		= rc_load_bio_failed,
+		.release	= rc_load_release,
+	};
+
+	/*
+	 *	Each thread updates the pairs in place, so it needs
+	 *	its own copy of them.
+	 */
+	t->num_templates = fr_dlist_num_elements(&rc_request_list);
+	MEM(t->templates = talloc_zero_array(t->ctx, rc_load_template_t, t->num_templates));
+
+	fr_dlist_foreach(&rc_request_list, rc_request_t, request) {
+		rc_load_template_t	*tmpl = &t->templates[i++];
+		unsigned int		num_random = 0;
+		fr_pair_t		*vp;
+
+		tmpl->code = request->packet->code;
+		fr_pair_list_init(&tmpl->pairs);
+
+		if (fr_pair_list_copy(t->ctx, &tmpl->pairs, &request->request_pairs) < 0) {
+			fr_perror("radclient");
+			return -1;
+		}
+
+		if (request->password) tmpl->password = fr_pair_find_by_da(&tmpl->pairs, NULL, attr_cleartext_password);
+
+		for (j = 0; j < load_num_random; j++) {
+			if (fr_pair_find_by_da(&tmpl->pairs, NULL, load_random[j])) num_random++;
+		}
+		if (!num_random) continue;
+
+		MEM(tmpl->random = talloc_zero_array(t->ctx, rc_load_random_t, num_random));
+
+		for (j = 0, num_random = 0; j < load_num_random; j++) {
+			rc_load_random_t *r;
+
+			vp = fr_pair_find_by_da(&tmpl->pairs, NULL, load_random[j]);
+			if (!vp) continue;
+
+			r = &tmpl->random[num_random++];
+			r->vp = vp;
+			if (vp->vp_type == FR_TYPE_STRING) {
+				MEM(r->pattern = talloc_bstrndup(t->ctx, vp->vp_strvalue, vp->vp_length));
+			}
+		}
+	}
+
+	/*
+	 *	Open the sockets, and bounce them through connect().
+	 *	Once they're connected, we start reading from them.
+	 */
+	MEM(t->bios = talloc_zero_array(t->ctx, fr_bio_packet_t *, load_num_sockets));
+
+	for (i = 0; i < load_num_sockets; i++) {
+		fr_bio_packet_t				*bio;
+		fr_radius_client_bio_info_t const	*info;
+
+		bio = fr_radius_client_bio_alloc(t->ctx, &t->config, &fd_config);
+		if (!bio) {
+			ERROR("Failed opening socket: %s", fr_strerror());
+			return -1;
+		}
+		bio->uctx = t;
+		t->bios[t->num_bios++] = bio;
+
+		info = fr_radius_client_bio_info(bio);
+
+		if (fr_event_fd_insert(t->ctx, NULL, t->el, info->fd_info->socket.fd, NULL,
+				       fr_radius_client_bio_connect, rc_load_error, bio) < 0) {
+			fr_perror("radclient");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/** Move the counters and latencies from each thread into the interval totals
+ *
+ */
+static void rc_load_collect(rc_load_thread_t *threads, rc_load_counters_t *counters, fr_histogram_t *latency)
+{
+	unsigned int i;
+
+	for (i = 0; i < load_num_threads; i++) {
+		rc_load_thread_t *t = &threads[i];
+
+		pthread_mutex_lock(&t->mutex);
+		rc_load_counters_add(counters, &t->counters);
+		memset(&t->counters, 0, sizeof(t->counters));
+
+		(void) fr_histogram_merge(latency, t->latency);
+		fr_histogram_clear(t->latency);
+		pthread_mutex_unlock(&t->mutex);
+	}
+}
+
+#define RC_LOAD_USEC(_h, _pct) (fr_histogram_percentile(_h, _pct) / 1000)
+
+static void rc_load_output_row(FILE *fp, bool json, bool first, double elapsed,
+			       rc_load_counters_t const *c, fr_histogram_t const *latency)
+{
+	if (json) {
+		fprintf(fp, "%s\n\t\t{ \"time\": %.3f, \"target_pps\": %u, \"sent\": %" PRIu64 ", "
+			"\"received\": %" PRIu64 ", \"accepted\": %" PRIu64 ", \"rejected\": %" PRIu64 ", "
+			"\"timeouts\": %" PRIu64 ", \"skipped\": %" PRIu64 ", "
+			"\"p50_usec\": %" PRIu64 ", \"p90_usec\": %" PRIu64 ", \"p99_usec\": %" PRIu64 ", "
+			"\"p999_usec\": %" PRIu64 ", \"max_usec\": %" PRIu64 " }",
+			first ? "" : ",", elapsed, load_pps, c->sent,
+			c->received, c->accepted, c->rejected,
+			c->timeouts, c->skipped,
+			RC_LOAD_USEC(latency, 50), RC_LOAD_USEC(latency, 90), RC_LOAD_USEC(latency, 99),
+			RC_LOAD_USEC(latency, 99.9), fr_histogram_max(latency) / 1000);
+		return;
+	}
+
+	fprintf(fp, "%.3f,%u,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+		",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+		elapsed, load_pps, c->sent, c->received, c->accepted, c->rejected, c->timeouts, c->skipped,
+		RC_LOAD_USEC(latency, 50), RC_LOAD_USEC(latency, 90), RC_LOAD_USEC(latency, 99),
+		RC_LOAD_USEC(latency, 99.9), fr_histogram_max(latency) / 1000);
+}
+
+/** Run an open loop load test, and print the results
+ *
+ */
+static int rc_load_run(fr_time_delta_t timeout)
+{
+	rc_load_thread_t	*threads;
+	rc_load_counters_t	total = {};
+	fr_histogram_t		*interval_latency, *total_latency;
+	FILE			*fp = NULL;
+	bool			json = false;
+	fr_time_t		start, next, now;
+	double			elapsed = 0;
+	unsigned int		i, started = 0, rows = 0;
+	int			ret = -1;
+
+	/*
+	 *	Every packet is sent exactly once.  If there's no
+	 *	reply, it's a timeout, and not a retransmission.
+	 */
+	fr_dlist_foreach(&rc_request_list, rc_request_t, request) {
+		fr_radius_packet_code_t code = request->packet->code;
+
+		if (!code) {
+			ERROR("Request was \"auto\", and request %" PRIu64 " in file %s did not contain Packet-Type",
+			      request->num, request->files->packets);
+			return -1;
+		}
+
+		client_config.outgoing[code] = true;
+		(void) fr_radius_allow_reply(code, client_config.verify.allowed);
+
+		client_config.retry[code] = (fr_retry_config_t) {
+			.irt = timeout,
+			.mrt = timeout,
+			.mrd = timeout,
+			.mrc = 1,
+		};
+		client_config.retry_cfg.retry_config = client_config.retry[code];
+	}
+
+	MEM(interval_latency = fr_histogram_alloc(autofree, FR_HISTOGRAM_PRECISION_DEFAULT));
+	MEM(total_latency = fr_histogram_alloc(autofree, FR_HISTOGRAM_PRECISION_DEFAULT));
+	MEM(threads = talloc_zero_array(autofree, rc_load_thread_t, load_num_threads));
+
+	for (i = 0; i < load_num_threads; i++) {
+		if (rc_load_thread_init(&threads[i], i, timeout) < 0) goto done;
+	}
+
+	if (load_output) {
+		size_t len = strlen(load_output);
+
+		json = (len > 5) && (strcmp(load_output + len - 5, ".json") == 0);
+
+		fp = fopen(load_output, "w");
+		if (!fp) {
+			ERROR("Failed opening %s: %s", load_output, fr_syserror(errno));
+			goto done;
+		}
+
+		if (json) {
+			fprintf(fp, "{\n\t\"target_pps\": %u,\n\t\"threads\": %u,\n\t\"sockets\": %u,\n\t\"series\": [",
+				load_pps, load_num_threads, load_num_sockets);
+		} else {
+			fprintf(fp, "time,target_pps,sent,received,accepted,rejected,timeouts,skipped,"
+				"p50_usec,p90_usec,p99_usec,p999_usec,max_usec\n");
+		}
+	}
+
+	for (i = 0; i < load_num_threads; i++) {
+		if (pthread_create(&threads[i].pthread_id, NULL, rc_load_thread, &threads[i]) != 0) {
+			ERROR("Failed creating thread: %s", fr_syserror(errno));
+			goto done;
+		}
+		started++;
+	}
+
+	/*
+	 *	Once a second, collect the statistics from each thread.
+	 */
+	start = next = fr_time();
+	do {
+		rc_load_counters_t counters = {};
+
+		next = fr_time_add(next, fr_time_delta_from_sec(1));
+		while (fr_time_lt(now = fr_time(), next)) {
+			struct timespec ts = fr_time_delta_to_timespec(fr_time_sub(next, now));
+
+			(void) nanosleep(&ts, NULL);
+		}
+
+		fr_histogram_clear(interval_latency);
+		rc_load_collect(threads, &counters, interval_latency);
+
+		elapsed = fr_time_delta_unwrap(fr_time_sub(next, start)) / (double) NSEC;
+
+		printf("%8.1fs  sent %-8" PRIu64 " received %-8" PRIu64 " timeouts %-6" PRIu64 " skipped %-6" PRIu64
+		       " p50 %" PRIu64 "us p99 %" PRIu64 "us\n",
+		       elapsed, counters.sent, counters.received, counters.timeouts, counters.skipped,
+		       RC_LOAD_USEC(interval_latency, 50), RC_LOAD_USEC(interval_latency, 99));
+
+		if (fp) rc_load_output_row(fp, json, (rows++ == 0), elapsed, &counters, interval_latency);
+
+		rc_load_counters_add(&total, &counters);
+		(void) fr_histogram_merge(total_latency, interval_latency);
+	} while (fr_time_delta_lt(fr_time_sub(next, start), load_duration));
+
+	ret = 0;
+
+done:
+	/*
+	 *	Stop sending, and wait for the replies to any
+	 *	outstanding packets.  These are added to the summary,
+	 *	but not to the time series.
+	 */
+	for (i = 0; i < started; i++) atomic_store(&threads[i].exit, true);
+	for (i = 0; i < started; i++) pthread_join(threads[i].pthread_id, NULL);
+
+	if (ret == 0) {
+		rc_load_collect(threads, &total, total_latency);
+
+		if (fp && json) {
+			fprintf(fp, "\n\t],\n\t\"summary\": { \"duration\": %.3f, \"sent\": %" PRIu64 ", "
+				"\"received\": %" PRIu64 ", \"accepted\": %" PRIu64 ", \"rejected\": %" PRIu64 ", "
+				"\"timeouts\": %" PRIu64 ", \"skipped\": %" PRIu64 ", "
+				"\"min_usec\": %" PRIu64 ", \"mean_usec\": %.1f, "
+				"\"p50_usec\": %" PRIu64 ", \"p90_usec\": %" PRIu64 ", \"p99_usec\": %" PRIu64 ", "
+				"\"p999_usec\": %" PRIu64 ", \"max_usec\": %" PRIu64 " }\n}\n",
+				elapsed, total.sent,
+				total.received, total.accepted, total.rejected,
+				total.timeouts, total.skipped,
+				fr_histogram_min(total_latency) / 1000, fr_histogram_mean(total_latency) / 1000,
+				RC_LOAD_USEC(total_latency, 50), RC_LOAD_USEC(total_latency, 90), RC_LOAD_USEC(total_latency, 99),
+				RC_LOAD_USEC(total_latency, 99.9), fr_histogram_max(total_latency) / 1000);
+		}
+
+		printf("Load summary:\n"
+		       "\tDuration      : %.3f s\n"
+		       "\tTarget rate   : %u packets/s\n"
+		       "\tReply rate    : %.1f packets/s\n"
+		       "\tSent          : %" PRIu64 "\n"
+		       "\tReceived      : %" PRIu64 "\n"
+		       "\tAccepted      : %" PRIu64 "\n"
+		       "\tRejected      : %" PRIu64 "\n"
+		       "\tTimeouts      : %" PRIu64 "\n"
+		       "\tSkipped       : %" PRIu64 "\n"
+		       "\tLatency (us)  : min %" PRIu64 " mean %.1f p50 %" PRIu64 " p90 %" PRIu64
+		       " p99 %" PRIu64 " p99.9 %" PRIu64 " max %" PRIu64 "\n",
+		       elapsed, load_pps, total.received / elapsed,
+		       total.sent, total.received, total.accepted, total.rejected, total.timeouts, total.skipped,
+		       fr_histogram_min(total_latency) / 1000, fr_histogram_mean(total_latency) / 1000,
+		       RC_LOAD_USEC(total_latency, 50), RC_LOAD_USEC(total_latency, 90), RC_LOAD_USEC(total_latency, 99),
+		       RC_LOAD_USEC(total_latency, 99.9), fr_histogram_max(total_latency) / 1000);
+	}
+
+	if (fp) fclose(fp);
+
+	for (i = 0; i < load_num_threads; i++) {
+		if (!threads[i].ctx) continue;
+
+		pthread_mutex_destroy(&threads[i].mutex);
+		talloc_free(threads[i].ctx);
+	}
+	talloc_free(threads);
+
+	return ret;
+}
+
+#ifdef HAVE_LIBPCAP
+/** Read request packets from a pcap file
+ *
+ *  Each RADIUS request in the capture is decoded with the shared
+ *  secret, and added to the list of packets to send.  Replies, and
+ *  anything which isn't RADIUS over UDP are skipped.
+ */
+static int radclient_pcap_init(TALLOC_CTX *ctx, char const *filename)
+{
+	fr_pcap_t		*in;
+	rc_file_pair_t		*files;
+	struct pcap_pkthdr	*header;
+	uint8_t const		*data;
+	uint64_t		num = 0;
+	int			rcode;
+
+	MEM(files = talloc_zero(ctx, rc_file_pair_t));
+	files->packets = filename;
+
+	in = fr_pcap_init(ctx, filename, PCAP_FILE_IN);
+	if (!in || (fr_pcap_open(in) < 0)) {
+		ERROR("Failed opening pcap file \"%s\"", filename);
+		return -1;
+	}
+
+	if (!fr_pcap_link_layer_supported(in->link_layer)) {
+		ERROR("Unsupported link layer in pcap file \"%s\"", filename);
+		return -1;
+	}
+
+	while ((rcode = pcap_next_ex(in->handle, &header, &data)) == 1) {
+		uint8_t const		*p = data, *end = data + header->caplen;
+		udp_header_t const	*udp;
+		ssize_t			len;
+		size_t			packet_len;
+		uint8_t			*packet;
+		rc_request_t		*request;
+		fr_pair_t		*vp;
+		fr_radius_decode_fail_t	reason;
+
+		len = fr_pcap_link_layer_offset(data, header->caplen, in->link_layer);
+		if ((len < 0) || (len >= (end - p))) continue;
+		p += len;
+
+		switch ((p[0] & 0xf0) >> 4) {
+		case 4:
+			if ((size_t) (end - p) < sizeof(ip_header_t)) continue;
+			if (((ip_header_t const *) p)->ip_p != IPPROTO_UDP) continue;
+			p += (0x0f & ((ip_header_t const *) p)->ip_vhl) * 4;
+			break;
+
+		case 6:
+			if ((size_t) (end - p) < sizeof(ip_header6_t)) continue;
+			if (((ip_header6_t const *) p)->ip_next != IPPROTO_UDP) continue;
+			p += sizeof(ip_header6_t);
+			break;
+
+		default:
+			continue;
+		}
+
+		if ((p >= end) || ((size_t) (end - p) < (sizeof(udp_header_t) + RADIUS_HEADER_LENGTH))) continue;
+
+		udp = (udp_header_t const *) p;
+		p += sizeof(udp_header_t);
+
+		/*
+		 *	Ignore any trailing garbage after the UDP payload.
+		 */
+		packet_len = end - p;
+		if ((ntohs(udp->len) >= sizeof(udp_header_t)) && ((ntohs(udp->len) - sizeof(udp_header_t)) < packet_len)) {
+			packet_len = ntohs(udp->len) - sizeof(udp_header_t);
+		}
+
+		if (!fr_radius_ok(p, &packet_len, client_config.verify.max_attributes, false, &reason)) continue;
+
+		switch (p[0]) {
+		case FR_RADIUS_CODE_ACCESS_REQUEST:
+		case FR_RADIUS_CODE_ACCOUNTING_REQUEST:
+		case FR_RADIUS_CODE_COA_REQUEST:
+		case FR_RADIUS_CODE_DISCONNECT_REQUEST:
+		case FR_RADIUS_CODE_STATUS_SERVER:
+			break;
+
+		default:
+			continue;
+		}
+
+		MEM(request = talloc_zero(ctx, rc_request_t));
+		MEM(request->packet = fr_packet_alloc(request, true));
+		request->packet->uctx = request;
+		request->packet->id = -1;
+		request->packet->code = p[0];
+
+		request->files = files;
+		request->name = filename;
+		request->num = num++;
+
+		fr_pair_list_init(&request->filter);
+		fr_pair_list_init(&request->request_pairs);
+		fr_pair_list_init(&request->reply_pairs);
+
+		/*
+		 *	The decoder needs a writable copy of the packet.
+		 */
+		MEM(packet = talloc_memdup(request, p, packet_len));
+		if (fr_radius_decode_simple(request, &request->request_pairs, packet, packet_len, NULL, secret) < 0) {
+			WARN("Skipping packet %" PRIu64 " in \"%s\": %s", request->num, filename, fr_strerror());
+			talloc_free(request);
+			continue;
+		}
+
+		/*
+		 *	User-Password is re-encrypted each time the packet
+		 *	is sent.  CHAP-Password can't be, but the response
+		 *	is still valid if the original authenticator is
+		 *	sent as the challenge.
+		 */
+		vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_password);
+		if (vp) {
+			pair_update_request(request->password, attr_cleartext_password);
+			fr_pair_value_bstrndup(request->password, vp->vp_strvalue, vp->vp_length, true);
+
+		} else if (fr_pair_find_by_da(&request->request_pairs, NULL, attr_chap_password) &&
+			   !fr_pair_find_by_da(&request->request_pairs, NULL, attr_chap_challenge)) {
+			MEM(vp = fr_pair_afrom_da(request, attr_chap_challenge));
+			fr_pair_value_memdup(vp, p + 4, RADIUS_AUTH_VECTOR_LENGTH, true);
+			fr_pair_append(&request->request_pairs, vp);
+		}
+
+		fr_dlist_insert_tail(&rc_request_list, request);
+		talloc_set_destructor(request, _rc_request_free);
+	}
+
+	if (rcode == -1) {
+		ERROR("Failed reading pcap file \"%s\": %s", filename, pcap_geterr(in->handle));
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
 /**
  *
  * @hidecallgraph
@@ -1320,6 +2185,8 @@ int main(int argc, char **argv)
 	int		retries = 5;
 	fr_time_delta_t timeout = fr_time_delta_from_sec(2);
 
+	load_duration = fr_time_delta_from_sec(10);
+
 	/*
 	 *	It's easier having two sets of flags to set the
 	 *	verbosity of library calls and the verbosity of
@@ -1406,7 +2273,7 @@ int main(int argc, char **argv)
 	 *
 	 ***********************************************************************/
 
-	while ((c = getopt(argc, argv, "46A:c:C:d:D:f:Fi:ho:p:P:r:sS:t:vx")) != -1) switch (c) {
+	while ((c = getopt(argc, argv, "46A:c:C:d:D:f:Fi:I:hj:l:L:N:o:O:p:P:r:R:sS:t:vx")) != -1) switch (c) {
 		case '4':
 			fd_config.dst_ipaddr.af = AF_INET;
 			break;
@@ -1499,11 +2366,47 @@ int main(int argc, char **argv)
 			}
 			break;
 
+		case 'I':
+#ifdef HAVE_LIBPCAP
+			load_pcap = optarg;
+#else
+			ERROR("Reading packets from pcap files requires libpcap");
+			fr_exit_now(EXIT_FAILURE);
+#endif
+			break;
+
+		case 'j':
+			load_num_threads = strtoul(optarg, &end, 10);
+			if (*end || !load_num_threads || (load_num_threads > RC_LOAD_MAX_THREADS)) usage();
+			break;
+
+		case 'l':
+			if (fr_time_delta_from_str(&load_duration, optarg, strlen(optarg), FR_TIME_RES_SEC) < 0) {
+				fr_perror("Failed parsing load duration");
+				fr_exit_now(EXIT_FAILURE);
+			}
+			if (!fr_time_delta_ispos(load_duration)) usage();
+			break;
+
+		case 'L':
+			load_pps = strtoul(optarg, &end, 10);
+			if (*end || !load_pps) usage();
+			break;
+
+		case 'N':
+			load_num_sockets = strtoul(optarg, &end, 10);
+			if (*end || !load_num_sockets || (load_num_sockets > RC_LOAD_MAX_SOCKETS)) usage();
+			break;
+
 		case 'o':
 			coa_port = atoi(optarg);
 			if (!coa_port || (coa_port > 65535)) usage();
 			break;
 
+		case 'O':
+			load_output = optarg;
+			break;
+
 			/*
 			 *	Note that sending MANY requests in
 			 *	parallel can over-run the kernel
@@ -1535,6 +2438,14 @@ int main(int argc, char **argv)
 			if ((retries == 0) || (retries > 1000)) usage();
 			break;
 
+		case 'R':
+			if (load_num_random >= RC_LOAD_MAX_RANDOM) {
+				ERROR("Too many attributes to randomise, the maximum is %u", RC_LOAD_MAX_RANDOM);
+				fr_exit_now(EXIT_FAILURE);
+			}
+			load_random_names[load_num_random++] = optarg;
+			break;
+
 		case 's':
 			do_summary = true;
 			break;
@@ -1706,6 +2617,48 @@ int main(int argc, char **argv)
 
 		MEM(coa_tree = fr_rb_talloc_alloc(autofree, rc_request_t, request_cmp, NULL));
 	}
+
+	if (load_pps) {
+		unsigned int i;
+
+		if (fd_config.dst_ipaddr.af == AF_UNSPEC) {
+			ERROR("Load mode needs a server address");
+			fr_exit_now(EXIT_FAILURE);
+		}
+
+		if (fd_config.src_port && ((load_num_threads * load_num_sockets) > 1)) {
+			ERROR("Can't set a source port when there is more than one socket");
+			fr_exit_now(EXIT_FAILURE);
+		}
+
+		for (i = 0; i < load_num_random; i++) {
+			load_random[i] = fr_dict_attr_by_name(NULL, fr_dict_root(dict_radius), load_random_names[i]);
+			if (!load_random[i]) {
+				ERROR("Unknown attribute %s", load_random_names[i]);
+				fr_exit_now(EXIT_FAILURE);
+			}
+
+			switch (load_random[i]->type) {
+			case FR_TYPE_STRING:
+			case FR_TYPE_OCTETS:
+			case FR_TYPE_UINT8:
+			case FR_TYPE_UINT16:
+			case FR_TYPE_UINT32:
+			case FR_TYPE_UINT64:
+			case FR_TYPE_IPV4_ADDR:
+				break;
+
+			default:
+				ERROR("Can't randomise %s, which is of type %s",
+				      load_random_names[i], fr_type_to_str(load_random[i]->type));
+				fr_exit_now(EXIT_FAILURE);
+			}
+		}
+
+	} else if (load_output || load_num_random || (load_num_threads > 1) || (load_num_sockets > 1)) {
+		ERROR("Options -j, -N, -O and -R can only be used with -L");
+		usage();
+	}
 	packet_global_init();
 
 	openssl3_init();
@@ -1719,9 +2672,9 @@ int main(int argc, char **argv)
 	 ***********************************************************************/
 
 	/*
-	 *	If no '-f' is specified, then we are reading from stdin.
+	 *	If no '-f' or '-I' is specified, then we are reading from stdin.
 	 */
-	if (fr_dlist_num_elements(&filenames) == 0) {
+	if ((fr_dlist_num_elements(&filenames) == 0) && !load_pcap) {
 		rc_file_pair_t *files;
 
 		files = talloc_zero(talloc_autofree_context(), rc_file_pair_t);
@@ -1743,6 +2696,10 @@ int main(int argc, char **argv)
 		}
 	}
 
+#ifdef HAVE_LIBPCAP
+	if (load_pcap && (radclient_pcap_init(autofree, load_pcap) < 0)) fr_exit_now(EXIT_FAILURE);
+#endif
+
 	/*
 	 *	No packets were read.  Die.
 	 */
@@ -1751,6 +2708,17 @@ int main(int argc, char **argv)
 		fr_exit_now(EXIT_FAILURE);
 	}
 
+	/*
+	 *	Open loop load test.  The threads open their own
+	 *	sockets, and the packets are only used as templates.
+	 */
+	if (load_pps) {
+		if (rc_load_run(timeout) < 0) ret = EXIT_FAILURE;
+
+		fr_dlist_talloc_free(&rc_request_list);
+		goto done;
+	}
+
 	/***********************************************************************
 	 *
 	 *	We're done reading files, open the socket, event loop, and start sending packets.
@@ -1844,6 +2812,7 @@ int main(int argc, char **argv)
 
 	(void) fr_event_fd_delete(client_config.retry_cfg.el, client_info->fd_info->socket.fd, FR_EVENT_FILTER_IO);
 
+done:
 	fr_radius_global_free();
 
 	if (fr_dict_autofree(radclient_dict) < 0) {
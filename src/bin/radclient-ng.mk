@@ -6,6 +6,7 @@ SOURCES		:= radclient-ng.c ${top_srcdir}/src/modules/rlm_mschap/smbdes.c \
 TGT_PREREQS	:= libfreeradius-radius$(L) libfreeradius-radius-bio$(L) libfreeradius-bio$(L)
 
 SRC_CFLAGS	:= -I${top_srcdir}/src/modules/rlm_mschap
-TGT_LDLIBS	:= $(LIBS)
+TGT_LDLIBS	:= $(LIBS) $(PCAP_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(PCAP_LDFLAGS)
 
 TGT_INSTALLDIR	:= $(BUILD_DIR)/bin/ignore
@@ -844,10 +844,17 @@ int main(int argc, char *argv[])
 		schedule->stats_interval = config->stats_interval;
 
 		schedule->network.max_outstanding = config->max_requests;
+		schedule->network.reserve_high_priority = fr_time_delta_ispos(config->max_queue_time) ||
+							  fr_time_delta_ispos(config->queue_delay_target);
 
 #define COPY(_x) schedule->worker._x = config->_x
 		COPY(max_requests);
 		COPY(max_request_time);
+		COPY(talloc_pool_size);
+		COPY(talloc_pool_adaptive);
+		COPY(max_queue_time);
+		COPY(queue_delay_target);
+		COPY(queue_delay_interval);
 
 		/*
 		 *	Single server mode: use the global event list.
@@ -52,14 +52,21 @@ RCSID("$Id$")
 
 static rs_t *conf;
 static struct timeval start_pcap = {0, 0};
-static char timestr[50];
+static _Thread_local char timestr[50];
 
-static fr_rb_tree_t *request_tree = NULL;
-static fr_rb_tree_t *link_tree = NULL;
+/*
+ *	Each analysis thread has its own trees.  In single threaded
+ *	mode these belong to the main thread.
+ */
+static _Thread_local fr_rb_tree_t *request_tree = NULL;
+static _Thread_local fr_rb_tree_t *link_tree = NULL;
 static fr_event_list_t *events;
 static bool cleanup;
 static int packets_count = 1; // Used in '$PATH/${packet}.txt.${count}'
 
+static rs_worker_t *workers;				//!< Analysis threads.
+static pthread_mutex_t out_mutex = PTHREAD_MUTEX_INITIALIZER;	//!< Serialises writes to the output pcap.
+
 static int self_pipe[2] = {-1, -1};		//!< Signals from sig handlers
 
 static char const *radsniff_version = RADIUSD_VERSION_BUILD("radsniff");
@@ -838,6 +845,60 @@ static void rs_stats_print_csv(rs_update_t *this, rs_stats_t *stats, UNUSED stru
 	fprintf(stdout , "%s\n", buffer);
 }
 
+/** Add the interval stats from the analysis threads to the global stats
+ *
+ * When reading from files, the capture thread runs ahead of the analysis
+ * threads.  We wait for the analysis threads to process all the packets
+ * captured so far, so that stats are attributed to the correct interval.
+ *
+ * @param[in] stats	to add the stats from each thread to.
+ * @param[in] sync	Wait for the analysis threads to drain their queues.
+ */
+static void rs_stats_merge(rs_stats_t *stats, bool sync)
+{
+	unsigned int	i;
+	size_t		j;
+	int		k;
+	size_t		rs_codes_len = (NUM_ELEMENTS(rs_useful_codes));
+
+	for (i = 0; i < conf->num_workers; i++) {
+		rs_worker_t *worker = &workers[i];
+
+		if (sync) while (atomic_load(&worker->processed) < worker->queued) sched_yield();
+
+		pthread_mutex_lock(&worker->mutex);
+		for (j = 0; j < rs_codes_len; j++) {
+			rs_latency_t *in = &worker->stats.exchange[rs_useful_codes[j]];
+			rs_latency_t *out = &stats->exchange[rs_useful_codes[j]];
+
+			out->interval.received_total += in->interval.received_total;
+			out->interval.linked_total += in->interval.linked_total;
+			out->interval.unlinked_total += in->interval.unlinked_total;
+			out->interval.reused_total += in->interval.reused_total;
+			out->interval.lost_total += in->interval.lost_total;
+			for (k = 0; k <= RS_RETRANSMIT_MAX; k++) out->interval.rt_total[k] += in->interval.rt_total[k];
+
+			out->interval.latency_total += in->interval.latency_total;
+			if (in->interval.latency_high > out->interval.latency_high) {
+				out->interval.latency_high = in->interval.latency_high;
+			}
+			if (in->interval.latency_low &&
+			    (!out->interval.latency_low || (in->interval.latency_low < out->interval.latency_low))) {
+				out->interval.latency_low = in->interval.latency_low;
+			}
+
+			memset(&in->interval, 0, sizeof(in->interval));
+		}
+
+		/*
+		 *	If any thread had to mute stats, they're muted
+		 *	for everyone.
+		 */
+		if (timercmp(&worker->stats.quiet, &stats->quiet, >)) stats->quiet = worker->stats.quiet;
+		pthread_mutex_unlock(&worker->mutex);
+	}
+}
+
 /** Process stats for a single interval
  *
  */
@@ -859,6 +920,8 @@ static void rs_stats_process(fr_timer_list_t *tl, fr_time_t now_t, void *ctx)
 
 	stats->intervals++;
 
+	if (workers) rs_stats_merge(stats, !conf->from_dev);
+
 	for (in_p = this->in;
 	     in_p;
 	     in_p = in_p->next) {
@@ -1177,8 +1240,10 @@ static inline int rs_response_to_pcap(rs_event_t *event, rs_request_t *request,
 		 *	hit our start point.
 		 */
 		if (request->capture_p->header) do {
+			pthread_mutex_lock(&out_mutex);
 			pcap_dump((void *)event->out->dumper, request->capture_p->header,
 				  request->capture_p->data);
+			pthread_mutex_unlock(&out_mutex);
 			TALLOC_FREE(request->capture_p->header);
 			TALLOC_FREE(request->capture_p->data);
 
@@ -1194,7 +1259,9 @@ static inline int rs_response_to_pcap(rs_event_t *event, rs_request_t *request,
 	/*
 	 *	Now log the response
 	 */
+	pthread_mutex_lock(&out_mutex);
 	pcap_dump((void *)event->out->dumper, header, data);
+	pthread_mutex_unlock(&out_mutex);
 
 	return 0;
 }
@@ -1231,7 +1298,9 @@ static inline int rs_request_to_pcap(rs_event_t *event, rs_request_t *request, s
 		return 0;
 	}
 
+	pthread_mutex_lock(&out_mutex);
 	pcap_dump((void *)event->out->dumper, header, data);
+	pthread_mutex_unlock(&out_mutex);
 
 	return 0;
 }
@@ -1391,7 +1460,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 	 *	recover once some requests timeout, so make an effort to deal
 	 *	with allocation failures gracefully.
 	 */
-	packet = fr_packet_alloc(conf, false);
+	packet = fr_packet_alloc(event->ctx, false);
 	if (!packet) {
 		REDEBUG("Failed allocating memory to hold decoded packet");
 		rs_tv_add_ms(&header->ts, conf->stats.timeout, &stats->quiet);
@@ -1400,7 +1469,18 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 
 	packet->timestamp = fr_time_from_timeval(&header->ts);
 	packet->data_len = header->caplen - (p - data);
-	memcpy(&packet->data, &p, sizeof(packet->data));
+
+	/*
+	 *	Requests outlive the capture buffer, so the packet
+	 *	needs its own copy of the data.
+	 */
+	packet->data = talloc_memdup(packet, p, packet->data_len);
+	if (!packet->data) {
+		REDEBUG("Failed allocating memory to hold packet data");
+		rs_tv_add_ms(&header->ts, conf->stats.timeout, &stats->quiet);
+		fr_packet_free(&packet);
+		return;
+	}
 
 	packet->socket.type = SOCK_DGRAM;
 
@@ -1759,7 +1839,7 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		 *	...nope it's a new request.
 		 */
 		} else {
-			original = rs_request_alloc(conf);
+			original = rs_request_alloc(event->ctx);
 			original->id = count;
 			original->in = event->in;
 			original->stats_req = &stats->exchange[packet->code];
@@ -1916,6 +1996,12 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 		fr_packet_free(&packet);	/* Also frees decoded */
 	}
 
+	/*
+	 *	With analysis threads, the capture thread enforces
+	 *	the limit.
+	 */
+	if (workers) return;
+
 	captured++;
 	/*
 	 *	We've hit our capture limit, break out of the event loop
@@ -1926,15 +2012,217 @@ static void rs_packet_process(uint64_t count, rs_event_t *event, struct pcap_pkt
 	}
 }
 
+/** Calculate a hash which is the same for all packets in an exchange
+ *
+ * The source and destination are hashed separately, and combined with xor,
+ * so that requests and responses get the same hash.  If we're linking
+ * retransmissions using attributes, the retransmissions may have different
+ * ports and IDs, so only the IP addresses are used.
+ *
+ * Packets which can't be parsed get a hash of 0, and errors are reported by
+ * whichever thread they're sent to.
+ */
+static uint32_t rs_flow_hash(fr_pcap_t *in, struct pcap_pkthdr const *header, uint8_t const *data)
+{
+	uint8_t const		*p = data, *end = data + header->caplen;
+	udp_header_t const	*udp;
+	ssize_t			len;
+	uint32_t		src, dst;
+
+	len = fr_pcap_link_layer_offset(data, header->caplen, in->link_layer);
+	if ((len < 0) || (len >= (end - p))) return 0;
+	p += len;
+
+	switch ((p[0] & 0xf0) >> 4) {
+	case 4:
+	{
+		ip_header_t const *ip = (ip_header_t const *)p;
+
+		if ((size_t)(end - p) < sizeof(*ip)) return 0;
+
+		src = fr_hash(&ip->ip_src, sizeof(ip->ip_src));
+		dst = fr_hash(&ip->ip_dst, sizeof(ip->ip_dst));
+		p += (0x0f & ip->ip_vhl) * 4;
+	}
+		break;
+
+	case 6:
+	{
+		ip_header6_t const *ip6 = (ip_header6_t const *)p;
+
+		if ((size_t)(end - p) < sizeof(*ip6)) return 0;
+
+		src = fr_hash(&ip6->ip_src, sizeof(ip6->ip_src));
+		dst = fr_hash(&ip6->ip_dst, sizeof(ip6->ip_dst));
+		p += sizeof(*ip6);
+	}
+		break;
+
+	default:
+		return 0;
+	}
+
+	if (conf->link_da_num > 0) return src ^ dst;
+
+	/*
+	 *	UDP header, plus the RADIUS code and ID
+	 */
+	if ((p >= end) || ((size_t)(end - p) < (sizeof(udp_header_t) + 2))) return 0;
+	udp = (udp_header_t const *)p;
+
+	src = fr_hash_update(&udp->src, sizeof(udp->src), src);
+	dst = fr_hash_update(&udp->dst, sizeof(udp->dst), dst);
+
+	return fr_hash_update(p + sizeof(udp_header_t) + 1, 1, src ^ dst);
+}
+
+/** Process a packet, or queue it for the analysis thread responsible for its flow
+ *
+ */
+static void rs_packet_dispatch(uint64_t count, rs_event_t *event, struct pcap_pkthdr const *header,
+			       uint8_t const *data)
+{
+	rs_worker_t	*worker;
+	rs_packet_t	*packet;
+
+	if (!workers) {
+		rs_packet_process(count, event, header, data);
+		return;
+	}
+
+	if (!start_pcap.tv_sec) start_pcap = header->ts;
+
+	worker = &workers[rs_flow_hash(event->in, header, data) % conf->num_workers];
+
+	/*
+	 *	talloc isn't thread safe, and this is freed
+	 *	by the analysis thread.
+	 */
+	packet = malloc(sizeof(*packet) + header->caplen);
+	if (!packet) {
+		ERROR("Failed allocating memory to queue packet");
+		return;
+	}
+	packet->count = count;
+	packet->in = event->in;
+	packet->header = *header;
+	memcpy(packet->data, data, header->caplen);
+
+	/*
+	 *	Never discard packets we've captured.  If the analysis
+	 *	thread is behind, wait for it.  For live captures, the
+	 *	kernel buffers packets in the meantime, and any drops
+	 *	are reported by pcap_stats().
+	 */
+	while (!fr_atomic_queue_push(worker->queue, packet)) sched_yield();
+	worker->queued++;
+
+	if ((conf->limit > 0) && (count >= conf->limit)) {
+		INFO("Captured %" PRIu64 " packets, exiting...", count);
+		fr_event_loop_exit(events, 1);
+	}
+}
+
+/** Process packets queued by the capture thread
+ *
+ */
+static void *rs_worker_thread(void *arg)
+{
+	rs_worker_t	*worker = arg;
+	fr_timer_list_t	*tl = worker->event.list->tl;
+	sigset_t	sigset;
+
+	/*
+	 *	Signals are handled by the main thread.
+	 */
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+	request_tree = worker->request_tree;
+	link_tree = worker->link_tree;
+
+	for (;;) {
+		bool		exiting = atomic_load(&worker->exit);
+		rs_packet_t	*packet;
+		fr_time_t	now;
+		int		i;
+
+		pthread_mutex_lock(&worker->mutex);
+		for (i = 0; i < RS_WORKER_BATCH; i++) {
+			if (!fr_atomic_queue_pop(worker->queue, (void **)&packet)) break;
+
+			/*
+			 *	Files are processed in pcap time, so run any
+			 *	timers which would have fired before this
+			 *	packet was captured.
+			 */
+			if ((packet->in->type == PCAP_FILE_IN) || (packet->in->type == PCAP_STDIO_IN)) {
+				do {
+					now = fr_time_from_timeval(&packet->header.ts);
+				} while (fr_timer_list_run(tl, &now) == 1);
+			}
+
+			worker->event.in = packet->in;
+			rs_packet_process(packet->count, &worker->event, &packet->header, packet->data);
+			free(packet);
+
+			atomic_fetch_add(&worker->processed, 1);
+		}
+
+		if (conf->from_dev) {
+			do {
+				now = fr_time();
+			} while (fr_timer_list_run(tl, &now) == 1);
+		}
+		pthread_mutex_unlock(&worker->mutex);
+
+		if (i > 0) continue;
+
+		/*
+		 *	The exit flag was set before we found the queue
+		 *	empty, so there's nothing more to process.
+		 */
+		if (exiting) break;
+
+		{
+			struct timespec ts = { .tv_sec = 0, .tv_nsec = 1000000 };
+
+			nanosleep(&ts, NULL);
+		}
+	}
+
+	/*
+	 *	Free any outstanding requests.  This must be done
+	 *	by this thread, as the request destructors remove
+	 *	the requests from this thread's trees.
+	 */
+	TALLOC_FREE(worker->event.ctx);
+
+	return NULL;
+}
+
+static uint64_t		packets_seen = 0;	/* Packets seen */
+
+/** Called by pcap_dispatch() for each packet in the capture buffer
+ *
+ */
+static void rs_got_packet_live(u_char *ctx, struct pcap_pkthdr const *header, u_char const *data)
+{
+	rs_event_t *event = (rs_event_t *)ctx;
+
+	packets_seen++;
+	rs_packet_dispatch(packets_seen, event, header, data);
+
+	if (fr_event_loop_exiting(events)) pcap_breakloop(event->in->handle);
+}
+
 static void rs_got_packet(fr_event_list_t *el, int fd, UNUSED int flags, void *ctx)
 {
-	static uint64_t		count = 0;	/* Packets seen */
 	static fr_time_t	last_sync = fr_time_wrap(0);
 	fr_time_t		now_real;
 	rs_event_t		*event = talloc_get_type(ctx, rs_event_t);
 	pcap_t			*handle = event->in->handle;
 
-	int			i;
 	int			ret;
 	const			uint8_t *data;
 	struct			pcap_pkthdr *header;
@@ -1992,30 +2280,22 @@ static void rs_got_packet(fr_event_list_t *el, int fd, UNUSED int flags, void *c
 			do {
 				now = fr_time_from_timeval(&header->ts);
 			} while (fr_timer_list_run(el->tl, &now) == 1);
-			count++;
+			packets_seen++;
 
-			rs_packet_process(count, event, header, data);
+			rs_packet_dispatch(packets_seen, event, header, data);
 		}
 		return;
 	}
 
 	/*
 	 *	Consume multiple packets from the capture buffer.
+	 *	On Linux libpcap captures using a TPACKET_V3 ring,
+	 *	and pcap_dispatch() walks the ring blocks in place.
 	 *	We occasionally need to yield to allow events to run.
 	 */
-	for (i = 0; i < RS_FORCE_YIELD; i++) {
-		ret = pcap_next_ex(handle, &header, &data);
-		if (ret == 0) {
-			/* No more packets available at this time */
-			return;
-		}
-		if (ret < 0) {
-			ERROR("Error requesting next packet, got (%i): %s", ret, pcap_geterr(handle));
-			return;
-		}
-
-		count++;
-		rs_packet_process(count, event, header, data);
+	ret = pcap_dispatch(handle, RS_FORCE_YIELD, rs_got_packet_live, (u_char *)event);
+	if ((ret < 0) && (ret != PCAP_ERROR_BREAK)) {
+		ERROR("Error requesting next packet, got (%i): %s", ret, pcap_geterr(handle));
 	}
 }
 
@@ -2172,6 +2452,98 @@ static void _unmark_link(void *request)
 	this->in_link_tree = false;
 }
 
+/** Allocate the analysis threads and start them
+ *
+ */
+static int rs_workers_start(TALLOC_CTX *ctx, fr_pcap_t *out)
+{
+	unsigned int i;
+
+	workers = talloc_zero_array(ctx, rs_worker_t, conf->num_workers);
+	if (!workers) {
+		ERROR("Failed allocating analysis threads");
+		return -1;
+	}
+
+	for (i = 0; i < conf->num_workers; i++) {
+		rs_worker_t	*worker = &workers[i];
+		int		ret;
+
+		worker->id = i;
+		pthread_mutex_init(&worker->mutex, NULL);
+
+		worker->queue = fr_atomic_queue_alloc(workers, RS_WORKER_QUEUE_SIZE);
+		if (!worker->queue) {
+			ERROR("Failed allocating queue for analysis thread %u", i);
+			return -1;
+		}
+
+		/*
+		 *	Each thread gets its own talloc hierarchy,
+		 *	which is only used by that thread.
+		 */
+		worker->event.ctx = talloc_init_const("radsniff_worker");
+		worker->event.out = out;
+		worker->event.stats = &worker->stats;
+		worker->event.list = fr_event_list_alloc(worker->event.ctx, NULL, NULL);
+		if (!worker->event.list) {
+			ERROR("Failed allocating event list for analysis thread %u", i);
+			return -1;
+		}
+
+		worker->request_tree = fr_rb_inline_talloc_alloc(worker->event.ctx, rs_request_t, request_node,
+								 rs_packet_cmp, _unmark_request);
+		if (!worker->request_tree) {
+			ERROR("Failed creating request tree for analysis thread %u", i);
+			return -1;
+		}
+
+		if (conf->link_da_num > 0) {
+			worker->link_tree = fr_rb_inline_talloc_alloc(worker->event.ctx, rs_request_t, link_node,
+								      rs_rtx_cmp, _unmark_link);
+			if (!worker->link_tree) {
+				ERROR("Failed creating RTX tree for analysis thread %u", i);
+				return -1;
+			}
+		}
+
+		ret = pthread_create(&worker->pthread_id, NULL, rs_worker_thread, worker);
+		if (ret != 0) {
+			fr_strerror_printf("%s", fr_syserror(ret));
+			ERROR("Failed creating analysis thread %u", i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/** Wait for the analysis threads to process everything they've been given, and exit
+ *
+ */
+static void rs_workers_stop(void)
+{
+	unsigned int i;
+
+	if (!workers) return;
+
+	for (i = 0; i < conf->num_workers; i++) atomic_store(&workers[i].exit, true);
+
+	for (i = 0; i < conf->num_workers; i++) {
+		rs_worker_t *worker = &workers[i];
+
+		if (worker->pthread_id) {
+			pthread_join(worker->pthread_id, NULL);
+		} else {
+			/* Never started */
+			talloc_free(worker->event.ctx);
+		}
+		pthread_mutex_destroy(&worker->mutex);
+	}
+
+	TALLOC_FREE(workers);
+}
+
 /** Exit the event loop after a given timeout.
  *
  */
@@ -2287,6 +2659,7 @@ static NEVER_RETURNS void usage(int status)
 	fprintf(output, "  -h                    This help message.\n");
 	fprintf(output, "  -i <interface>        Capture packets from interface (defaults to all if supported).\n");
 	fprintf(output, "  -I <file>             Read packets from <file>\n");
+	fprintf(output, "  -j <threads>          Process packets using this many analysis threads.\n");
 	fprintf(output, "  -l <attr>[,<attr>]    Output packet sig and a list of attributes.\n");
 	fprintf(output, "  -L <attr>[,<attr>]    Detect retransmissions using these attributes to link requests.\n");
 	fprintf(output, "  -m                    Don't put interface(s) into promiscuous mode.\n");
@@ -2386,7 +2759,7 @@ int main(int argc, char *argv[])
 	/*
 	 *  Get options
 	 */
-	while ((c = getopt(argc, argv, "ab:c:C:d:D:e:Ef:hi:I:l:L:mp:P:qr:R:s:St:vw:xXW:T:P:N:O:Z:")) != -1) {
+	while ((c = getopt(argc, argv, "ab:c:C:d:D:e:Ef:hi:I:j:l:L:mp:P:qr:R:s:St:vw:xXW:T:P:N:O:Z:")) != -1) {
 		switch (c) {
 		case 'a':
 		{
@@ -2489,6 +2862,18 @@ int main(int argc, char *argv[])
 			conf->link_attributes = optarg;
 			break;
 
+		case 'j':
+		{
+			int num = atoi(optarg);
+
+			if ((num <= 0) || (num > RS_MAX_WORKERS)) {
+				ERROR("Number of threads must be between 1 and %i", RS_MAX_WORKERS);
+				usage(64);
+			}
+			conf->num_workers = num;
+		}
+			break;
+
 		case 'm':
 			conf->promiscuous = false;
 			break;
@@ -2638,6 +3023,12 @@ int main(int argc, char *argv[])
 		usage(64);
 	}
 
+	/* Output file names are numbered in the order packets are processed */
+	if (conf->to_output_dir && conf->num_workers) {
+		ERROR("Can't dump packets to an output directory (-Z) when using analysis threads (-j)");
+		usage(64);
+	}
+
 	/* Can't set stats export mode if we're not writing stats */
 	if ((conf->stats.out == RS_STATS_OUT_STDIO_CSV) && !conf->stats.interval) {
 		ERROR("CSV output requires a statistics interval (-W)");
@@ -3077,6 +3468,12 @@ int main(int argc, char *argv[])
 			rs_install_stats_processor(stats, events, in, &now, false);
 		}
 
+		/*
+		 *  Start the analysis threads before we read any
+		 *  packets, as files are processed immediately.
+		 */
+		if (conf->num_workers && (rs_workers_start(conf, out) < 0)) goto finish;
+
 		/*
 		 *  Now add fd's for each of the pcap sessions we opened
 		 */
@@ -3086,6 +3483,7 @@ int main(int argc, char *argv[])
 			rs_event_t *event;
 
 			event = talloc_zero(events, rs_event_t);
+			event->ctx = conf;
 			event->list = events;
 			event->in = in_p;
 			event->out = out;
@@ -3151,6 +3549,12 @@ int main(int argc, char *argv[])
 	DEBUG2("Done sniffing");
 
 finish:
+	/*
+	 *	Let the analysis threads process any packets
+	 *	they've been given before we start freeing things.
+	 */
+	rs_workers_stop();
+
 	cleanup = true;
 
 	if (conf->daemonize) unlink(conf->pidfile);
@@ -28,7 +28,9 @@
 RCSIDH(radsniff_h, "$Id$")
 
 #include <sys/types.h>
+#include <pthread.h>
 
+#include <freeradius-devel/io/atomic_queue.h>
 #include <freeradius-devel/util/pcap.h>
 #include <freeradius-devel/util/event.h>
 #include <freeradius-devel/radius/radius.h>
@@ -44,6 +46,9 @@ RCSIDH(radsniff_h, "$Id$")
 #define RS_RETRANSMIT_MAX	5		//!< Maximum number of times we expect to see a packet retransmitted
 #define RS_MAX_ATTRS		50		//!< Maximum number of attributes we can filter on.
 #define RS_SOCKET_REOPEN_DELAY  5000		//!< How long we delay re-opening a collectd socket.
+#define RS_MAX_WORKERS		64		//!< Maximum number of analysis threads.
+#define RS_WORKER_QUEUE_SIZE	8192		//!< Packets which can be queued for each analysis thread.
+#define RS_WORKER_BATCH		256		//!< Packets an analysis thread processes before running timers.
 
 /*
  *	Logging macros
@@ -223,6 +228,7 @@ typedef struct {
  */
 typedef struct {
 	fr_event_list_t		*list;			//!< The event list.
+	TALLOC_CTX		*ctx;			//!< Where to allocate packets and requests.
 
 	fr_pcap_t		*in;			//!< PCAP handle event occurred on.
 	fr_pcap_t		*out;			//!< Where to write output.
@@ -230,6 +236,43 @@ typedef struct {
 	rs_stats_t		*stats;			//!< Where to write stats.
 } rs_event_t;
 
+/** A copy of a captured packet, queued for an analysis thread
+ *
+ */
+typedef struct {
+	uint64_t		count;			//!< Packet number.
+	fr_pcap_t		*in;			//!< PCAP handle the packet was received on.
+	struct pcap_pkthdr	header;			//!< PCAP packet header.
+	uint8_t			data[];			//!< PCAP packet data.
+} rs_packet_t;
+
+/** An analysis thread
+ *
+ * Packets are sharded between analysis threads by flow, so that requests,
+ * retransmissions, and responses for the same exchange are always processed
+ * by the same thread.  Each thread has its own request/link trees, timers,
+ * and statistics.  The statistics are merged by the main thread at the end of
+ * each stats interval.
+ */
+typedef struct {
+	unsigned int		id;			//!< Thread number.
+	pthread_t		pthread_id;		//!< Thread handle.
+
+	fr_atomic_queue_t	*queue;			//!< Packets waiting to be processed.
+	uint64_t		queued;			//!< Packets queued by the capture thread.
+	atomic_uint64_t		processed;		//!< Packets processed by this thread.
+	atomic_bool		exit;			//!< Drain the queue and exit.
+
+	pthread_mutex_t		mutex;			//!< Held while processing packets and
+							///< running timers.  Protects stats.
+	rs_stats_t		stats;			//!< Stats for this thread.
+	rs_event_t		event;			//!< Passed to rs_packet_process.
+
+	fr_rb_tree_t		*request_tree;		//!< Requests seen by this thread.
+	fr_rb_tree_t		*link_tree;		//!< Requests seen by this thread, indexed by
+							///< linking attributes.
+} rs_worker_t;
+
 typedef struct rs_update rs_update_t;
 
 /** Callback for printing stats header.
@@ -305,6 +348,9 @@ struct rs {
 	int			buffer_pkts;		//!< Size of the ring buffer to setup for live capture.
 	uint64_t		limit;			//!< Maximum number of packets to capture
 
+	unsigned int		num_workers;		//!< Number of analysis threads.  0 means
+							///< packets are processed by the capture thread.
+
 	struct {
 		int			interval;		//!< Time between stats updates in seconds.
 		stats_out_t		out;			//!< Where to write stats.
@@ -6,6 +6,6 @@ endif
 
 SOURCES		:= radsniff.c collectd.c
 
-TGT_PREREQS	:= libfreeradius-radius$(L)
+TGT_PREREQS	:= libfreeradius-radius$(L) libfreeradius-io$(L)
 TGT_LDLIBS	:= $(LIBS) $(PCAP_LIBS) $(COLLECTDC_LIBS)
 TGT_LDFLAGS     := $(LDFLAGS) $(PCAP_LDFLAGS) $(COLLECTDC_LDFLAGS)
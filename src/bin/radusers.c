@@ -0,0 +1,231 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file radusers.c
+ * @brief Compile a users file into an indexed image for rlm_files.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/log.h>
+#include <freeradius-devel/server/main_config.h>
+#include <freeradius-devel/server/request.h>
+#include <freeradius-devel/server/users_image.h>
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/conf.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#define EXIT_WITH_FAILURE \
+do { \
+	ret = EXIT_FAILURE; \
+	goto cleanup; \
+} while (0)
+
+static fr_dict_t const *dict_freeradius;
+
+extern fr_dict_autoload_t radusers_dict[];
+fr_dict_autoload_t radusers_dict[] = {
+	{ .out = &dict_freeradius, .proto = "freeradius" },
+	{ NULL }
+};
+
+static NEVER_RETURNS void usage(char *argv[])
+{
+	fprintf(stderr, "usage: %s [OPTS] -o <image> <users_file>\n", argv[0]);
+	fprintf(stderr, "  -3                 Allow v3 style enumeration names (same as 'v3_compat' in rlm_files).\n");
+	fprintf(stderr, "  -d <raddb>         Set user dictionary directory (defaults to " RADDBDIR ").\n");
+	fprintf(stderr, "  -D <dictdir>       Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -h                 Print help text.\n");
+	fprintf(stderr, "  -o <image>         Write the compiled image to this file.\n");
+	fprintf(stderr, "  -p <protocol>      Protocol dictionary used to parse the file (defaults to radius).\n");
+	fprintf(stderr, "  -x                 Debugging mode.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Compiles a users file into an indexed image, which the files module can load\n");
+	fprintf(stderr, "without parsing every entry at startup.\n");
+
+	fr_exit_now(EXIT_SUCCESS);
+}
+
+/**
+ *
+ * @hidecallgraph
+ */
+int main(int argc, char *argv[])
+{
+	int			c, ret = EXIT_SUCCESS;
+	char const		*raddb_dir = RADDBDIR;
+	char const		*dict_dir = DICTDIR;
+	char const		*protocol = "radius";
+	char const		*out = NULL;
+	bool			v3_compat = false;
+	fr_dict_t		*dict = NULL;
+	fr_dict_t		*proto_dict = NULL;
+	PAIR_LIST_LIST		list;
+
+	TALLOC_CTX		*autofree;
+
+	/*
+	 *	Must be called first, so the handler is called last
+	 */
+	fr_atexit_global_setup();
+
+	autofree = talloc_autofree_context();
+
+#ifndef NDEBUG
+	if (fr_fault_setup(autofree, getenv("PANIC_ACTION"), argv[0]) < 0) {
+		fr_perror("radusers");
+		fr_exit(EXIT_FAILURE);
+	}
+#else
+	fr_disable_null_tracking_on_free(autofree);
+#endif
+
+	fr_time_start();
+
+	while ((c = getopt(argc, argv, "3d:D:ho:p:x")) != -1) switch (c) {
+		case '3':
+			v3_compat = true;
+			break;
+
+		case 'd':
+			raddb_dir = optarg;
+			break;
+
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'o':
+			out = optarg;
+			break;
+
+		case 'p':
+			protocol = optarg;
+			break;
+
+		case 'x':
+			fr_debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage(argv);
+	}
+	if (!out || ((argc - optind) != 1)) usage(argv);
+	argc -= optind;
+	argv += optind;
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("radusers");
+		EXIT_WITH_FAILURE;
+	}
+
+	if (!fr_dict_global_ctx_init(NULL, true, dict_dir)) {
+		fr_perror("radusers");
+		EXIT_WITH_FAILURE;
+	}
+
+	if (fr_dict_internal_afrom_file(&dict, FR_DICTIONARY_INTERNAL_DIR, __FILE__) < 0) {
+		fr_perror("radusers");
+		EXIT_WITH_FAILURE;
+	}
+
+	if (fr_dict_protocol_afrom_file(&proto_dict, protocol, NULL, __FILE__) < 0) {
+		fr_perror("radusers");
+		EXIT_WITH_FAILURE;
+	}
+
+	/*
+	 *	Load the custom dictionary
+	 */
+	if (fr_dict_read(dict, raddb_dir, FR_DICTIONARY_FILE) == -1) {
+		fr_strerror_const_push("Failed to initialize the dictionaries");
+		fr_perror("radusers");
+		EXIT_WITH_FAILURE;
+	}
+
+	if (fr_dict_autoload(radusers_dict) < 0) {
+		fr_perror("radusers");
+		EXIT_WITH_FAILURE;
+	}
+
+	if (request_global_init() < 0) {
+		fr_perror("radusers");
+		EXIT_WITH_FAILURE;
+	}
+
+	/*
+	 *	Parse the whole file first, so that errors are
+	 *	reported now, and not when an entry is first used.
+	 */
+	pairlist_list_init(&list);
+	if (pairlist_read(autofree, proto_dict, argv[0], &list, v3_compat) < 0) {
+		fr_perror("radusers");
+		EXIT_WITH_FAILURE;
+	}
+
+	if (users_image_write(out, &list) < 0) {
+		fr_perror("radusers");
+		EXIT_WITH_FAILURE;
+	}
+
+	INFO("Compiled %u entries from %s into %s", fr_dlist_num_elements(&list.head), argv[0], out);
+
+cleanup:
+	/*
+	 *	Ensure all thread local memory is cleaned up
+	 *	at the appropriate time.  This emulates what's
+	 *	done with worker/network threads in the
+	 *	scheduler.
+	 */
+	fr_atexit_thread_trigger_all();
+
+	/*
+	 *	Free any autoload dictionaries
+	 */
+	if (fr_dict_autofree(radusers_dict) < 0) {
+		fr_perror("radusers");
+		ret = EXIT_FAILURE;
+	}
+
+	if (proto_dict && (fr_dict_free(&proto_dict, __FILE__) < 0)) {
+		fr_perror("radusers");
+		ret = EXIT_FAILURE;
+	}
+
+	if (dict && (fr_dict_free(&dict, __FILE__) < 0)) {
+		fr_perror("radusers");
+		ret = EXIT_FAILURE;
+	}
+
+	/*
+	 *	Ensure our atexit handlers run before any other
+	 *	atexit handlers registered by third party libraries.
+	 */
+	fr_atexit_global_trigger_all();
+
+	return ret;
+}
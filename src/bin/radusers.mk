@@ -0,0 +1,5 @@
+TARGET		:= radusers$(E)
+SOURCES		:= radusers.c
+
+TGT_PREREQS	:= $(LIBFREERADIUS_SERVER)
+TGT_LDLIBS	:= $(LIBS)
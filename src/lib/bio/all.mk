@@ -1,3 +1,4 @@
 SUBMAKEFILES := libfreeradius-bio.mk \
-		libfreeradius-bio-config.mk
-
+		libfreeradius-bio-config.mk \
+		libfreeradius-bio-tls.mk \
+		tls_tests.mk
@@ -0,0 +1,13 @@
+TARGETNAME	:= libfreeradius-bio-tls
+
+ifneq ($(OPENSSL_LIBS),)
+TARGET		:= $(TARGETNAME)$(L)
+endif
+
+SOURCES	:=		\
+	tls.c
+
+TGT_PREREQS	:= libfreeradius-bio$(L) libfreeradius-tls$(L)
+
+TGT_LDLIBS	:= $(LIBS) $(OPENSSL_LIBS)
+TGT_LDFLAGS	:= $(OPENSSL_FLAGS)
@@ -0,0 +1,401 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file lib/bio/tls.c
+ * @brief BIO abstractions for TLS over connected sockets.
+ *
+ * @copyright 2024 Network RADIUS SAS (legal@networkradius.com)
+ */
+#include <freeradius-devel/bio/bio_priv.h>
+#include <freeradius-devel/bio/null.h>
+#include <freeradius-devel/tls/strerror.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <freeradius-devel/bio/tls.h>
+
+/** The TLS bio
+ *
+ */
+typedef struct {
+	FR_BIO_COMMON;
+
+	fr_bio_tls_info_t info;
+
+	SSL		*ssl;		//!< the TLS session, which reads and writes the socket.
+} fr_bio_tls_t;
+
+static ssize_t fr_bio_tls_read(fr_bio_t *bio, void *packet_ctx, void *buffer, size_t size);
+static ssize_t fr_bio_tls_write(fr_bio_t *bio, void *packet_ctx, void const *buffer, size_t size);
+
+/** Map an OpenSSL error to a bio error.
+ *
+ *  Blocking updates the info, and calls the application callbacks.
+ */
+static ssize_t fr_bio_tls_error(fr_bio_tls_t *my, int ret, char const *msg)
+{
+	int rcode;
+
+	switch (SSL_get_error(my->ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+		if (!my->info.read_blocked) {
+			my->info.read_blocked = true;
+
+			if (my->cb.read_blocked) {
+				rcode = my->cb.read_blocked(&my->bio);
+				if (rcode < 0) return rcode;
+			}
+		}
+		return fr_bio_error(IO_WOULD_BLOCK);
+
+	case SSL_ERROR_WANT_WRITE:
+		if (!my->info.write_blocked) {
+			my->info.write_blocked = true;
+
+			if (my->cb.write_blocked) {
+				rcode = my->cb.write_blocked(&my->bio);
+				if (rcode < 0) return rcode;
+			}
+		}
+		return fr_bio_error(IO_WOULD_BLOCK);
+
+	case SSL_ERROR_ZERO_RETURN:
+		/*
+		 *	The other end sent a close_notify.
+		 */
+	eof:
+		my->info.eof = true;
+		my->info.state = FR_BIO_TLS_STATE_CLOSED;
+		fr_bio_eof(&my->bio);
+		return 0;
+
+	case SSL_ERROR_SYSCALL:
+		/*
+		 *	The other end closed the TCP connection
+		 *	without sending a close_notify.  That's
+		 *	common enough to not be worth complaining
+		 *	about.
+		 */
+		if ((ret == 0) || (errno == ECONNRESET) || (errno == EPIPE)) {
+			ERR_clear_error();
+			goto eof;
+		}
+
+		fr_strerror_printf("%s: %s", msg, fr_syserror(errno));
+		ERR_clear_error();
+		break;
+
+	default:
+		fr_tls_strerror_printf("%s", msg);
+		break;
+	}
+
+	/*
+	 *	Shut down the BIO.  It's no longer useable.
+	 */
+	my->info.state = FR_BIO_TLS_STATE_CLOSED;
+	fr_bio_shutdown(&my->bio);
+
+	return fr_bio_error(GENERIC);
+}
+
+/** Call the resume callback when we transition from blocked to unblocked.
+ *
+ */
+static inline int fr_bio_tls_unblock(fr_bio_tls_t *my, bool *blocked, fr_bio_io_t resume)
+{
+	if (!*blocked) return 0;
+
+	*blocked = false;
+
+	if (!resume) return 0;
+
+	return resume(&my->bio);
+}
+
+/** Continue the handshake.
+ *
+ *  Once the handshake is done, we check whether the kernel has taken
+ *  over the record layer, and switch to reading and writing
+ *  application data.
+ *
+ * @return
+ *	- <0 on error.
+ *	- 0 for "handshake is still in progress".
+ *	- 1 for "handshake is done".
+ */
+static int fr_bio_tls_handshake(fr_bio_tls_t *my)
+{
+	int ret;
+	ssize_t rcode;
+
+	ret = SSL_do_handshake(my->ssl);
+	if (ret <= 0) {
+		rcode = fr_bio_tls_error(my, ret, "TLS handshake failed");
+		if (rcode == fr_bio_error(IO_WOULD_BLOCK)) return 0;
+
+		/*
+		 *	EOF in the middle of a handshake is an error.
+		 */
+		if (rcode == 0) {
+			fr_strerror_const("Connection closed during TLS handshake");
+			return fr_bio_error(GENERIC);
+		}
+
+		return rcode;
+	}
+
+	my->info.version = SSL_get_version(my->ssl);
+	my->info.cipher = SSL_get_cipher_name(my->ssl);
+
+#ifdef SSL_OP_ENABLE_KTLS
+	/*
+	 *	OpenSSL sets TCP_ULP "tls" on the socket, and pushes the
+	 *	keys into the kernel when the session keys change.  Whether
+	 *	or not that worked depends on the kernel, and on the cipher
+	 *	which was negotiated.  If it didn't work, OpenSSL quietly
+	 *	does the record encryption itself.
+	 */
+	if ((SSL_get_options(my->ssl) & SSL_OP_ENABLE_KTLS) != 0) {
+		my->info.ktls_send = (BIO_get_ktls_send(SSL_get_wbio(my->ssl)) > 0);
+		my->info.ktls_recv = (BIO_get_ktls_recv(SSL_get_rbio(my->ssl)) > 0);
+	}
+#endif
+
+	my->info.state = FR_BIO_TLS_STATE_OPEN;
+	my->info.read_blocked = false;
+	my->info.write_blocked = false;
+
+	my->bio.read = fr_bio_tls_read;
+	my->bio.write = fr_bio_tls_write;
+
+	if (my->cb.connected) my->cb.connected(&my->bio);
+
+	return 1;
+}
+
+/** Read during the handshake.
+ *
+ *  There is no application data until the handshake is done.
+ */
+static ssize_t fr_bio_tls_read_handshake(fr_bio_t *bio, void *packet_ctx, void *buffer, size_t size)
+{
+	int rcode;
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	rcode = fr_bio_tls_handshake(my);
+	if (rcode <= 0) return rcode;
+
+	return fr_bio_tls_read(bio, packet_ctx, buffer, size);
+}
+
+/** Write during the handshake.
+ *
+ *  The application can't write data until the handshake is done.
+ */
+static ssize_t fr_bio_tls_write_handshake(fr_bio_t *bio, void *packet_ctx, void const *buffer, size_t size)
+{
+	int rcode;
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	rcode = fr_bio_tls_handshake(my);
+	if (rcode < 0) return rcode;
+
+	if (rcode == 0) return fr_bio_error(IO_WOULD_BLOCK);
+
+	return fr_bio_tls_write(bio, packet_ctx, buffer, size);
+}
+
+/** Read application data.
+ *
+ *  OpenSSL may have decrypted more data than it returned to us.  The
+ *  socket won't be readable for that data, so we drain it here.
+ */
+static ssize_t fr_bio_tls_read(fr_bio_t *bio, UNUSED void *packet_ctx, void *buffer, size_t size)
+{
+	int ret;
+	ssize_t rcode;
+	size_t used = 0;
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	do {
+		ret = SSL_read(my->ssl, ((uint8_t *) buffer) + used, (int) (size - used));
+		if (ret <= 0) {
+			/*
+			 *	Return the data we have.  Any error
+			 *	will be returned on the next read.
+			 */
+			if (used > 0) break;
+
+			return fr_bio_tls_error(my, ret, "TLS read failed");
+		}
+
+		used += ret;
+	} while ((used < size) && (SSL_pending(my->ssl) > 0));
+
+	rcode = fr_bio_tls_unblock(my, &my->info.read_blocked, my->cb.read_resume);
+	if (rcode < 0) return rcode;
+
+	return used;
+}
+
+/** Write application data.
+ *
+ *  Partial writes are enabled, so we may write less than we were
+ *  given.  If we block, the caller MUST retry with the same data.
+ */
+static ssize_t fr_bio_tls_write(fr_bio_t *bio, UNUSED void *packet_ctx, void const *buffer, size_t size)
+{
+	int ret;
+	ssize_t rcode;
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	/*
+	 *	A NULL buffer is a flush.  OpenSSL keeps any partially
+	 *	written record itself, so we have nothing to flush.
+	 */
+	if (!buffer) return 0;
+
+	ret = SSL_write(my->ssl, buffer, (int) size);
+	if (ret <= 0) return fr_bio_tls_error(my, ret, "TLS write failed");
+
+	rcode = fr_bio_tls_unblock(my, &my->info.write_blocked, my->cb.write_resume);
+	if (rcode < 0) return rcode;
+
+	return ret;
+}
+
+/** Send a close_notify, if we can.
+ *
+ *  The socket is non-blocking, so this is best effort.
+ */
+static void fr_bio_tls_shutdown(fr_bio_t *bio)
+{
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	if ((my->info.state == FR_BIO_TLS_STATE_OPEN) && !my->info.eof) {
+		(void) SSL_shutdown(my->ssl);
+		ERR_clear_error();
+	}
+
+	my->info.state = FR_BIO_TLS_STATE_CLOSED;
+
+	my->bio.read = fr_bio_fail_read;
+	my->bio.write = fr_bio_fail_write;
+}
+
+static int fr_bio_tls_destructor(fr_bio_tls_t *my)
+{
+	fr_assert(!fr_bio_prev(&my->bio));
+	fr_assert(!fr_bio_next(&my->bio));
+
+	if (my->ssl) {
+		SSL_free(my->ssl);
+		my->ssl = NULL;
+	}
+
+	return 0;
+}
+
+/** Allocate a server-side TLS bio for a connected socket.
+ *
+ *  The handshake is driven by the first read from the bio.  The
+ *  "connected" callback is called once the handshake is done.
+ *
+ * @param ctx		the talloc ctx.
+ * @param ssl_ctx	the TLS configuration.
+ * @param fd		a connected, non-blocking, stream socket.
+ * @param ktls		try to enable kernel TLS once the handshake is done.
+ * @param cb		application callbacks, or NULL.
+ * @return
+ *	- NULL on error.
+ *	- the new TLS bio.
+ */
+fr_bio_t *fr_bio_tls_alloc(TALLOC_CTX *ctx, SSL_CTX *ssl_ctx, int fd, bool ktls, fr_bio_cb_funcs_t *cb)
+{
+	fr_bio_tls_t *my;
+
+	if (fd < 0) {
+		fr_strerror_const("Invalid file descriptor");
+		return NULL;
+	}
+
+	my = talloc_zero(ctx, fr_bio_tls_t);
+	if (!my) return NULL;
+
+	my->ssl = SSL_new(ssl_ctx);
+	if (!my->ssl) {
+		fr_tls_strerror_printf("Failed allocating TLS session");
+		talloc_free(my);
+		return NULL;
+	}
+	talloc_set_destructor(my, fr_bio_tls_destructor);
+
+	/*
+	 *	OpenSSL reads from and writes to the socket.  It needs
+	 *	a socket BIO to be able to use kTLS.
+	 */
+	if (SSL_set_fd(my->ssl, fd) != 1) {
+		fr_tls_strerror_printf("Failed setting TLS file descriptor");
+		talloc_free(my);
+		return NULL;
+	}
+
+	/*
+	 *	The caller may retry a blocked write from a different
+	 *	buffer, and may write less than a full record.
+	 */
+	SSL_set_mode(my->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+#ifdef SSL_OP_ENABLE_KTLS
+	if (ktls) SSL_set_options(my->ssl, SSL_OP_ENABLE_KTLS);
+#else
+	(void) ktls;
+#endif
+
+	SSL_set_accept_state(my->ssl);
+
+	my->info.state = FR_BIO_TLS_STATE_HANDSHAKE;
+
+	my->bio.read = fr_bio_tls_read_handshake;
+	my->bio.write = fr_bio_tls_write_handshake;
+	if (cb) my->cb = *cb;
+
+	my->priv_cb.shutdown = fr_bio_tls_shutdown;
+
+	return (fr_bio_t *) my;
+}
+
+/** Get information about the TLS session.
+ *
+ */
+fr_bio_tls_info_t const *fr_bio_tls_info(fr_bio_t *bio)
+{
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	return &my->info;
+}
+
+/** Get the underlying TLS session, e.g. to examine the peer certificate.
+ *
+ */
+SSL *fr_bio_tls_ssl(fr_bio_t *bio)
+{
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	return my->ssl;
+}
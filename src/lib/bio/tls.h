@@ -0,0 +1,71 @@
+#pragma once
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifdef WITH_TLS
+/**
+ * $Id$
+ * @file lib/bio/tls.h
+ * @brief Binary IO abstractions for TLS over connected sockets.
+ *
+ *  The TLS bio runs the server side of a TLS session over a connected
+ *  stream socket.  Reads and writes to the bio are of application data.
+ *
+ *  The bio talks to the socket directly, instead of via an FD bio.
+ *  That lets OpenSSL hand the record layer to the kernel (kTLS) once
+ *  the handshake is complete.  If kTLS is unavailable, records are
+ *  encrypted and decrypted by OpenSSL, as usual.
+ *
+ *  The caller retains ownership of the file descriptor.
+ *
+ * @copyright 2024 Network RADIUS SAS (legal@networkradius.com)
+ */
+RCSIDH(lib_bio_tls_h, "$Id$")
+
+#include <freeradius-devel/bio/base.h>
+#include <freeradius-devel/tls/openssl_user_macros.h>
+
+#include <openssl/ssl.h>
+
+typedef enum {
+	FR_BIO_TLS_STATE_INVALID = 0,
+	FR_BIO_TLS_STATE_HANDSHAKE,	//!< waiting for the handshake to complete
+	FR_BIO_TLS_STATE_OPEN,		//!< reading and writing application data
+	FR_BIO_TLS_STATE_CLOSED,	//!< error, EOF, or shut down
+} fr_bio_tls_state_t;
+
+/** Run-time status of the TLS session.
+ *
+ */
+typedef struct {
+	fr_bio_tls_state_t state;	//!< handshake, open, closed, etc.
+
+	char const	*version;	//!< negotiated TLS version, once the handshake is done.
+	char const	*cipher;	//!< negotiated cipher, once the handshake is done.
+
+	bool		ktls_send;	//!< the kernel encrypts records we send.
+	bool		ktls_recv;	//!< the kernel decrypts records we receive.
+
+	bool		read_blocked;	//!< did we block on read?
+	bool		write_blocked;	//!< did we block on write?
+	bool		eof;		//!< are we at EOF?
+} fr_bio_tls_info_t;
+
+fr_bio_t	*fr_bio_tls_alloc(TALLOC_CTX *ctx, SSL_CTX *ssl_ctx, int fd, bool ktls, fr_bio_cb_funcs_t *cb) CC_HINT(nonnull(1,2));
+
+fr_bio_tls_info_t const *fr_bio_tls_info(fr_bio_t *bio) CC_HINT(nonnull);
+
+SSL		*fr_bio_tls_ssl(fr_bio_t *bio) CC_HINT(nonnull);
+#endif /* WITH_TLS */
@@ -0,0 +1,346 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the TLS bio
+ *
+ * A client thread connects over loopback TCP with plain OpenSSL, and
+ * sends an Access-Request.  The server side is driven through the TLS
+ * bio, the same way the TLS listeners drive it.
+ *
+ * The certificates are the test certificates in raddb/certs, so the
+ * tests must be run from the top of the source tree, after the
+ * certificates have been created.
+ *
+ * @file src/lib/bio/tls_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/bio/tls.h>
+#include <freeradius-devel/util/misc.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <openssl/err.h>
+
+#define TEST_CERT_DIR		"raddb/certs/rsa"
+#define TEST_KEY_PASSWORD	"whatever"
+
+/*
+ *	Access-Request, ID 1, User-Name = "bob"
+ */
+static uint8_t const test_request[] = {
+	0x01, 0x01, 0x00, 0x19,
+	0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+	0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10,
+	0x01, 0x05, 'b', 'o', 'b'
+};
+
+/*
+ *	Access-Accept, ID 1
+ */
+static uint8_t const test_reply[] = {
+	0x02, 0x01, 0x00, 0x14,
+	0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+	0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20
+};
+
+static TALLOC_CTX	*autofree;
+static SSL_CTX		*server_ctx;
+static SSL_CTX		*client_ctx;		//!< Presents the client certificate.
+static SSL_CTX		*anon_client_ctx;	//!< Doesn't present a certificate.
+
+/** The client side of a connection
+ *
+ */
+typedef struct {
+	int		fd;
+	SSL_CTX		*ssl_ctx;
+	pthread_t	thread;
+
+	bool		connected;		//!< The handshake succeeded.
+	uint8_t		reply[64];		//!< What the server sent back.
+	size_t		reply_len;
+} test_client_t;
+
+static int test_key_password(char *buf, int size, UNUSED int rwflag, UNUSED void *u)
+{
+	return strlcpy(buf, TEST_KEY_PASSWORD, size);
+}
+
+static SSL_CTX *test_ssl_ctx_alloc(SSL_METHOD const *method, char const *cert, char const *key)
+{
+	SSL_CTX *ctx;
+
+	ctx = SSL_CTX_new(method);
+	if (!ctx) return NULL;
+
+	SSL_CTX_set_default_passwd_cb(ctx, test_key_password);
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+
+	if (!SSL_CTX_load_verify_locations(ctx, TEST_CERT_DIR "/ca.pem", NULL)) goto error;
+	if (!cert) return ctx;
+
+	if (!SSL_CTX_use_certificate_chain_file(ctx, cert) ||
+	    !SSL_CTX_use_PrivateKey_file(ctx, key, SSL_FILETYPE_PEM) ||
+	    !SSL_CTX_check_private_key(ctx)) {
+	error:
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+/** Connect a pair of sockets over loopback TCP
+ *
+ * kTLS only works on TCP sockets, so we can't use socketpair().
+ */
+static void test_connect(int *server_fd, int *client_fd)
+{
+	struct sockaddr_in	sin = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+	socklen_t		len = sizeof(sin);
+	int			listen_fd;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	TEST_ASSERT(listen_fd >= 0);
+	TEST_ASSERT(bind(listen_fd, (struct sockaddr *) &sin, sizeof(sin)) == 0);
+	TEST_ASSERT(listen(listen_fd, 1) == 0);
+	TEST_ASSERT(getsockname(listen_fd, (struct sockaddr *) &sin, &len) == 0);
+
+	*client_fd = socket(AF_INET, SOCK_STREAM, 0);
+	TEST_ASSERT(*client_fd >= 0);
+	TEST_ASSERT(connect(*client_fd, (struct sockaddr *) &sin, sizeof(sin)) == 0);
+
+	*server_fd = accept(listen_fd, NULL, NULL);
+	TEST_ASSERT(*server_fd >= 0);
+	TEST_ASSERT(fr_nonblock(*server_fd) >= 0);
+
+	close(listen_fd);
+}
+
+/** Do the handshake, send the request, and read the reply
+ *
+ */
+static void *test_client_thread(void *arg)
+{
+	test_client_t	*client = arg;
+	SSL		*ssl;
+	int		ret;
+
+	ssl = SSL_new(client->ssl_ctx);
+	if (!ssl) return NULL;
+
+	SSL_set_fd(ssl, client->fd);
+	if (SSL_connect(ssl) != 1) goto done;
+	client->connected = true;
+
+	if (SSL_write(ssl, test_request, sizeof(test_request)) != sizeof(test_request)) goto done;
+
+	while (client->reply_len < sizeof(test_reply)) {
+		ret = SSL_read(ssl, client->reply + client->reply_len, sizeof(client->reply) - client->reply_len);
+		if (ret <= 0) break;
+
+		client->reply_len += ret;
+	}
+
+	(void) SSL_shutdown(ssl);
+
+done:
+	ERR_clear_error();
+	SSL_free(ssl);
+	shutdown(client->fd, SHUT_RDWR);
+
+	return NULL;
+}
+
+/** Wait until the socket is readable or writable
+ *
+ */
+static bool test_poll(int fd, short events)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+
+	return (poll(&pfd, 1, 5000) == 1);
+}
+
+/** Read from the bio until we have a whole packet, or it fails
+ *
+ * @return
+ *	- The number of bytes read.
+ *	- <0 on error.
+ */
+static ssize_t test_read(fr_bio_t *bio, int fd, uint8_t *buffer, size_t size, size_t want)
+{
+	size_t used = 0;
+
+	while (used < want) {
+		ssize_t slen;
+
+		slen = fr_bio_read(bio, NULL, buffer + used, size - used);
+		if (slen < 0) {
+			if (slen != fr_bio_error(IO_WOULD_BLOCK)) return slen;
+
+			if (!test_poll(fd, POLLIN)) return fr_bio_error(GENERIC);
+			continue;
+		}
+
+		/*
+		 *	Handshake data, or EOF.
+		 */
+		if (slen == 0) {
+			if (fr_bio_tls_info(bio)->eof) break;
+
+			if (!test_poll(fd, POLLIN)) return fr_bio_error(GENERIC);
+			continue;
+		}
+
+		used += slen;
+	}
+
+	return used;
+}
+
+static void test_round_trip(bool ktls)
+{
+	test_client_t			client = { .ssl_ctx = client_ctx };
+	fr_bio_t			*bio;
+	fr_bio_tls_info_t const		*info;
+	uint8_t				buffer[4096];
+	int				fd;
+	size_t				written = 0;
+
+	test_connect(&fd, &client.fd);
+	TEST_ASSERT(pthread_create(&client.thread, NULL, test_client_thread, &client) == 0);
+
+	bio = fr_bio_tls_alloc(autofree, server_ctx, fd, ktls, NULL);
+	TEST_ASSERT(bio != NULL);
+	info = fr_bio_tls_info(bio);
+	TEST_CHECK(info->state == FR_BIO_TLS_STATE_HANDSHAKE);
+
+	TEST_CASE("The first reads do the handshake, then return the request");
+	TEST_CHECK(test_read(bio, fd, buffer, sizeof(buffer), sizeof(test_request)) == sizeof(test_request));
+	TEST_MSG("Read failed: %s", fr_strerror());
+	TEST_CHECK(memcmp(buffer, test_request, sizeof(test_request)) == 0);
+
+	TEST_CHECK(info->state == FR_BIO_TLS_STATE_OPEN);
+	TEST_CHECK(info->version != NULL);
+	TEST_CHECK(info->cipher != NULL);
+	TEST_CHECK(SSL_get0_peer_certificate(fr_bio_tls_ssl(bio)) != NULL);
+	TEST_MSG("%s %s, kTLS send %s, receive %s", info->version, info->cipher,
+		 info->ktls_send ? "yes" : "no", info->ktls_recv ? "yes" : "no");
+	if (!ktls) TEST_CHECK(!info->ktls_send && !info->ktls_recv);
+
+	TEST_CASE("The reply reaches the client");
+	while (written < sizeof(test_reply)) {
+		ssize_t slen;
+
+		slen = fr_bio_write(bio, NULL, test_reply + written, sizeof(test_reply) - written);
+		if (slen == fr_bio_error(IO_WOULD_BLOCK)) {
+			TEST_ASSERT(test_poll(fd, POLLOUT));
+			continue;
+		}
+		TEST_ASSERT(slen > 0);
+
+		written += slen;
+	}
+
+	TEST_CASE("The client closing the connection is EOF");
+	TEST_CHECK(test_read(bio, fd, buffer, sizeof(buffer), 1) == 0);
+	TEST_CHECK(info->eof);
+	TEST_CHECK(info->state == FR_BIO_TLS_STATE_CLOSED);
+
+	pthread_join(client.thread, NULL);
+	TEST_CHECK(client.connected);
+	TEST_CHECK(client.reply_len == sizeof(test_reply));
+	TEST_CHECK(memcmp(client.reply, test_reply, sizeof(test_reply)) == 0);
+
+	talloc_free(bio);
+	close(fd);
+	close(client.fd);
+}
+
+static void test_round_trip_openssl(void)
+{
+	test_round_trip(false);
+}
+
+static void test_round_trip_ktls(void)
+{
+	test_round_trip(true);
+}
+
+static void test_no_client_cert(void)
+{
+	test_client_t	client = { .ssl_ctx = anon_client_ctx };
+	fr_bio_t	*bio;
+	uint8_t		buffer[4096];
+	int		fd;
+
+	test_connect(&fd, &client.fd);
+	TEST_ASSERT(pthread_create(&client.thread, NULL, test_client_thread, &client) == 0);
+
+	bio = fr_bio_tls_alloc(autofree, server_ctx, fd, false, NULL);
+	TEST_ASSERT(bio != NULL);
+
+	TEST_CASE("The handshake fails if the client has no certificate");
+	TEST_CHECK(test_read(bio, fd, buffer, sizeof(buffer), sizeof(test_request)) < 0);
+	TEST_CHECK(fr_bio_tls_info(bio)->state == FR_BIO_TLS_STATE_CLOSED);
+
+	pthread_join(client.thread, NULL);
+	TEST_CHECK(client.reply_len == 0);
+
+	talloc_free(bio);
+	close(fd);
+	close(client.fd);
+}
+
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("tls_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	server_ctx = test_ssl_ctx_alloc(TLS_server_method(), TEST_CERT_DIR "/server.crt", TEST_CERT_DIR "/server.key");
+	client_ctx = test_ssl_ctx_alloc(TLS_client_method(), TEST_CERT_DIR "/client.crt", TEST_CERT_DIR "/client.key");
+	anon_client_ctx = test_ssl_ctx_alloc(TLS_client_method(), NULL, NULL);
+	if (!server_ctx || !client_ctx || !anon_client_ctx) {
+		fr_strerror_printf("Failed loading certificates from %s: %s", TEST_CERT_DIR,
+				   ERR_error_string(ERR_get_error(), NULL));
+		goto error;
+	}
+}
+
+TEST_LIST = {
+	{ "round_trip_openssl",	test_round_trip_openssl },
+	{ "round_trip_ktls",	test_round_trip_ktls },
+	{ "no_client_cert",	test_no_client_cert },
+
+	{ NULL }
+};
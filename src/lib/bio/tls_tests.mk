@@ -0,0 +1,10 @@
+ifneq ($(OPENSSL_LIBS),)
+TARGET		:= tls_tests$(E)
+endif
+
+SOURCES		:= tls_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(OPENSSL_LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(OPENSSL_FLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-bio-tls$(L) libfreeradius-bio$(L) libfreeradius-tls$(L) libfreeradius-server$(L) libfreeradius-unlang$(L) libfreeradius-util$(L)
+TGT_INSTALLDIR	:=
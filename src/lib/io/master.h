@@ -45,6 +45,7 @@ typedef struct fr_io_track_s {
 	int				packets;     	//!< number of packets using this entry
 	uint8_t				*reply;		//!< reply packet (if any)
 	size_t				reply_len;	//!< length of reply, or 1 for "do not reply"
+	unsigned int			reply_code;	//!< set by encoders whose transports can't read it from the reply.
 
 	bool				discard;	//!< whether or not we discard the packet
 	bool				do_not_respond;	//!< don't respond
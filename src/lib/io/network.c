@@ -130,6 +130,8 @@ struct fr_network_s {
 	fr_heap_t		*replies;		//!< replies from the worker, ordered by priority / origin time
 
 	fr_io_stats_t		stats;
+	uint64_t		num_shed;		//!< low priority packets dropped to leave room
+							///< for high priority ones.
 
 	fr_rb_tree_t		*sockets;		//!< list of sockets we're managing, ordered by the listener
 	fr_rb_tree_t		*sockets_by_num;       	//!< ordered by number;
@@ -721,10 +723,27 @@ retry:
 	 *	In both cases, we should just drop the new packet.
 	 */
 	fr_assert(worker->stats.in >= worker->stats.out);
-	if (nr->config.max_outstanding &&
-	    (OUTSTANDING(worker) >= nr->config.max_outstanding)) {
-		RATE_LIMIT_GLOBAL(PERROR, "max_outstanding reached - dropping packet");
-		goto drop;
+	if (nr->config.max_outstanding) {
+		uint64_t limit = nr->config.max_outstanding;
+
+		/*
+		 *	Keep the last quarter of the worker's queue
+		 *	for high priority packets, so that when we're
+		 *	overloaded, e.g. Accounting-Request doesn't
+		 *	crowd out Access-Request.  This is only done
+		 *	when request shedding is enabled.
+		 */
+		if (nr->config.reserve_high_priority && (cd->priority < PRIORITY_HIGH)) limit -= (limit >> 2);
+
+		if (OUTSTANDING(worker) >= limit) {
+			if (limit < nr->config.max_outstanding) {
+				nr->num_shed++;
+				RATE_LIMIT_GLOBAL(PERROR, "max_outstanding reached for low priority packets - dropping packet");
+			} else {
+				RATE_LIMIT_GLOBAL(PERROR, "max_outstanding reached - dropping packet");
+			}
+			goto drop;
+		}
 	}
 
 	/*
@@ -2035,10 +2054,11 @@ int fr_network_stats(fr_network_t const *nr, int num, uint64_t *stats)
 	if (num >= 3) stats[2] = nr->stats.dup;
 	if (num >= 4) stats[3] = nr->stats.dropped;
 	if (num >= 5) stats[4] = nr->num_workers;
+	if (num >= 6) stats[5] = nr->num_shed;
 
-	if (num <= 5) return num;
+	if (num <= 6) return num;
 
-	return 5;
+	return 6;
 }
 
 void fr_network_stats_log(fr_network_t const *nr, fr_log_t const *log)
@@ -2063,6 +2083,7 @@ static int cmd_stats_self(FILE *fp, UNUSED FILE *fp_err, void *ctx, UNUSED fr_cm
 	fprintf(fp, "count.out\t%" PRIu64 "\n", nr->stats.out);
 	fprintf(fp, "count.dup\t%" PRIu64 "\n", nr->stats.dup);
 	fprintf(fp, "count.dropped\t%" PRIu64 "\n", nr->stats.dropped);
+	fprintf(fp, "count.shed\t%" PRIu64 "\n", nr->num_shed);
 	fprintf(fp, "count.sockets\t%u\n", fr_rb_num_elements(nr->sockets));
 
 	return 0;
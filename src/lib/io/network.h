@@ -44,6 +44,8 @@ extern "C" {
 
 typedef struct {
 	uint32_t	max_outstanding;
+	bool		reserve_high_priority;	//!< Keep the last quarter of max_outstanding
+						///< for high priority packets.
 } fr_network_config_t;
 
 int		fr_network_listen_add(fr_network_t *nr, fr_listen_t *li) CC_HINT(nonnull) CC_HINT(warn_unused_result);
@@ -63,6 +63,7 @@ RCSID("$Id$")
 #include <freeradius-devel/server/time_tracking.h>
 #include <freeradius-devel/util/dlist.h>
 #include <freeradius-devel/util/minmax_heap.h>
+#include <freeradius-devel/util/regex.h>
 
 #include <stdalign.h>
 
@@ -74,6 +75,13 @@ static void worker_verify(fr_worker_t *worker);
 #endif
 
 #define CACHE_LINE_SIZE	64
+
+/*
+ *	When sizing request pools adaptively, sample the memory
+ *	used by one in this many requests.  Must be a power of 2.
+ */
+#define WORKER_POOL_SAMPLE_RATE	16
+
 static alignas(CACHE_LINE_SIZE) atomic_uint64_t request_number = 0;
 
 static _Thread_local fr_ring_buffer_t *fr_worker_rb;
@@ -88,6 +96,21 @@ typedef struct {
 	fr_dlist_head_t		dlist;
 } fr_worker_channel_t;
 
+/** CoDel state, used to shed low priority requests when a standing queue builds up
+ *
+ * See RFC 8289.  Instead of measuring the sojourn time of packets as they're
+ * dequeued, we estimate how long a new request will wait before it runs, and
+ * decide whether to shed it before doing any work on it.
+ */
+typedef struct {
+	fr_time_t		first_above;	//!< When the queue delay will have been above the
+						///< target for a whole interval.
+	fr_time_t		shed_next;	//!< When we next shed a request.
+	uint32_t		count;		//!< Requests shed since we started shedding.
+	uint32_t		last_count;	//!< Value of count when we last started shedding.
+	bool			shedding;	//!< Whether we're currently shedding requests.
+} fr_worker_codel_t;
+
 /**
  *  A worker which takes packets from a master, and processes them.
  */
@@ -122,10 +145,17 @@ struct fr_worker_s {
 
 	uint64_t    		num_naks;	//!< number of messages which were nak'd
 	uint64_t    		num_active;	//!< number of active requests
+	uint64_t		num_shed_deadline; //!< requests shed because they exceeded max_queue_time.
+	uint64_t		num_shed_delay;	//!< low priority requests shed because of a standing queue.
+	fr_worker_codel_t	codel;		//!< for shedding low priority requests.
 
 	fr_time_delta_t		predicted;	//!< How long we predict a request will take to execute.
 	fr_time_tracking_t	tracking;	//!< how much time the worker has spent doing things.
 
+#ifdef HAVE_REGEX
+	fr_regex_cache_stats_t const *regex_stats; //!< for this thread's cache of runtime compiled regexes.
+#endif
+
 	bool			was_sleeping;	//!< used to suppress multiple sleep signals in a row
 	bool			exiting;	//!< are we exiting?
 
@@ -146,6 +176,10 @@ typedef struct {
 	 *	need to cache or lookup the fr_worker_listen_t when we free a request.
 	 */
 	fr_dlist_head_t		dlist;		//!< of requests associated with this listener.
+
+	size_t			pool_size;	//!< EWMA of the memory used by pairs and packets of
+						///< requests from this listener.  Used to size the pools
+						///< of new requests.
 } fr_worker_listen_t;
 
 
@@ -193,11 +227,158 @@ static inline bool is_worker_thread(fr_worker_t const *worker)
 	return (pthread_equal(pthread_self(), worker->thread_id) != 0);
 }
 
+static void worker_nak(fr_worker_t *worker, fr_channel_data_t *cd, fr_time_t now);
 static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd, fr_time_t now);
 static void worker_send_reply(fr_worker_t *worker, request_t *request, bool do_not_respond, fr_time_t now);
 static void worker_max_request_time(UNUSED fr_timer_list_t *tl, UNUSED fr_time_t when, void *uctx);
 static void worker_max_request_timer(fr_worker_t *worker);
 
+/*
+ *	Integer square root, for the CoDel control law.
+ */
+static inline uint32_t worker_isqrt(uint32_t n)
+{
+	uint32_t root = 0, bit = 1U << 30;
+
+	while (bit > n) bit >>= 2;
+
+	while (bit) {
+		if (n >= root + bit) {
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+/** When we should next shed a request, the interval shrinks with the square root of the shed count
+ *
+ */
+static inline fr_time_t worker_codel_next(fr_worker_t *worker, fr_time_t t)
+{
+	return fr_time_add(t, fr_time_delta_wrap(fr_time_delta_unwrap(worker->config.queue_delay_interval) /
+						 worker_isqrt(worker->codel.count)));
+}
+
+/** Decide whether a request should be shed because of a standing queue
+ *
+ * @param[in] worker	the worker.
+ * @param[in] delay	how long we expect the request to wait before it runs.
+ * @param[in] sheddable	whether this request can be shed.  Requests which
+ *			can't be shed still update the queue delay state.
+ * @param[in] now	the current time.
+ * @return
+ *	- true if the request should be shed.
+ *	- false if it should be processed.
+ */
+static bool worker_codel_shed(fr_worker_t *worker, fr_time_delta_t delay, bool sheddable, fr_time_t now)
+{
+	fr_worker_codel_t	*c = &worker->codel;
+	bool			above;
+
+	if (fr_time_delta_lt(delay, worker->config.queue_delay_target)) {
+		c->first_above = fr_time_wrap(0);
+		above = false;
+
+	} else if (fr_time_eq(c->first_above, fr_time_wrap(0))) {
+		c->first_above = fr_time_add(now, worker->config.queue_delay_interval);
+		above = false;
+
+	} else {
+		above = fr_time_gteq(now, c->first_above);
+	}
+
+	if (c->shedding) {
+		if (!above) {
+			c->shedding = false;
+			return false;
+		}
+
+		if (!sheddable || fr_time_lt(now, c->shed_next)) return false;
+
+		c->count++;
+		c->shed_next = worker_codel_next(worker, c->shed_next);
+		return true;
+	}
+
+	if (!above || !sheddable) return false;
+
+	/*
+	 *	If we were shedding recently, start at a similar
+	 *	rate to the one we left off at.
+	 */
+	{
+		uint32_t delta = c->count - c->last_count;
+
+		if ((delta > 1) &&
+		    fr_time_delta_lt(fr_time_sub(now, c->shed_next),
+				     fr_time_delta_wrap(fr_time_delta_unwrap(worker->config.queue_delay_interval) * 16))) {
+			c->count = delta;
+		} else {
+			c->count = 1;
+		}
+	}
+	c->last_count = c->count;
+	c->shedding = true;
+	c->shed_next = worker_codel_next(worker, now);
+
+	return true;
+}
+
+/** Decide whether a new request should be shed before we do any work on it
+ *
+ * The expected wait is the time the message has spent in the channel,
+ * plus the time it will take to run the requests which are already
+ * runnable.
+ *
+ * Requests which will be older than max_queue_time by the time they
+ * run are always shed, as the client has likely given up on them.
+ * Otherwise, if a standing queue has built up, low priority requests
+ * (e.g. Accounting-Request) are shed, so that high priority ones
+ * (e.g. Access-Request) continue to be processed.
+ *
+ * @param[in] worker	the worker.
+ * @param[in] cd	the new request.
+ * @param[in] now	the current time.
+ * @return
+ *	- true if the request should be shed.
+ *	- false if it should be processed.
+ */
+static bool worker_shed(fr_worker_t *worker, fr_channel_data_t *cd, fr_time_t now)
+{
+	fr_time_delta_t backlog;
+
+	if (!fr_time_delta_ispos(worker->config.max_queue_time) &&
+	    !fr_time_delta_ispos(worker->config.queue_delay_target)) return false;
+
+	/*
+	 *	Never shed things like Status-Server.
+	 */
+	if (cd->priority >= PRIORITY_NOW) return false;
+
+	backlog = fr_time_delta_wrap(fr_time_delta_unwrap(worker->predicted) * fr_heap_num_elements(worker->runnable));
+
+	if (fr_time_delta_ispos(worker->config.max_queue_time) &&
+	    fr_time_delta_gt(fr_time_delta_add(fr_time_sub(now, cd->request.recv_time), backlog),
+			     worker->config.max_queue_time)) {
+		worker->num_shed_deadline++;
+		return true;
+	}
+
+	if (fr_time_delta_ispos(worker->config.queue_delay_target) &&
+	    worker_codel_shed(worker, fr_time_delta_add(fr_time_sub(now, cd->m.when), backlog),
+			      (cd->priority < PRIORITY_HIGH), now)) {
+		worker->num_shed_delay++;
+		return true;
+	}
+
+	return false;
+}
+
 /** Callback which handles a message being received on the worker side.
  *
  * @param[in] ctx the worker
@@ -208,10 +389,20 @@ static void worker_recv_request(void *ctx, fr_channel_t *ch, fr_channel_data_t *
 {
 	fr_worker_t *worker = ctx;
 
+	fr_time_t now = fr_time();
+
 	worker->stats.in++;
 	DEBUG3("Received request %" PRIu64 "", worker->stats.in);
 	cd->channel.ch = ch;
-	worker_request_bootstrap(worker, cd, fr_time());
+
+	if (worker_shed(worker, cd, now)) {
+		DEBUG3("Shedding request %" PRIu64 "", worker->stats.in);
+		worker->stats.dropped++;
+		worker_nak(worker, cd, now);
+		return;
+	}
+
+	worker_request_bootstrap(worker, cd, now);
 }
 
 static void worker_requests_cancel(fr_worker_channel_t *ch)
@@ -619,6 +810,49 @@ static void worker_request_time_tracking_end(fr_worker_t *worker, request_t *req
 	if (fr_minmax_heap_entry_inserted(request->time_order_id)) (void) fr_minmax_heap_extract(worker->time_order, request);
 }
 
+/** Find or create the tracking structure for a listener
+ *
+ */
+static fr_worker_listen_t *worker_listen_find(fr_worker_t *worker, fr_listen_t const *listen)
+{
+	fr_worker_listen_t *wl;
+
+	wl = fr_rb_find(worker->listeners, &(fr_worker_listen_t) { .listener = listen });
+	if (!wl) {
+		MEM(wl = talloc_zero(worker, fr_worker_listen_t));
+		fr_dlist_init(&wl->dlist, request_t, listen_entry);
+		wl->listener = listen;
+		wl->pool_size = worker->config.talloc_pool_size;
+
+		(void) fr_rb_insert(worker->listeners, wl);
+	}
+
+	return wl;
+}
+
+/** Update the estimate of how much memory requests from a listener need
+ *
+ * Only pairs and packets are counted, the rest of the request's
+ * pool is sized statically.
+ */
+static void worker_listen_pool_sample(fr_worker_t *worker, request_t *request)
+{
+	fr_worker_listen_t	*wl;
+	size_t			used;
+
+	wl = fr_rb_find(worker->listeners, &(fr_worker_listen_t) { .listener = request->async->listen });
+	if (!wl) return;
+
+	used = talloc_total_size(request->pair_root);
+	if (request->packet) used += talloc_total_size(request->packet);
+	if (request->reply) used += talloc_total_size(request->reply);
+
+	/*
+	 *	alpha = 1/8, the same weighting TCP uses for its RTT estimate.
+	 */
+	wl->pool_size = wl->pool_size - (wl->pool_size >> 3) + (used >> 3);
+}
+
 /** Send a response packet to the network side
  *
  * @param[in] worker		This worker.
@@ -737,6 +971,15 @@ static void worker_send_reply(fr_worker_t *worker, request_t *request, bool send
 	fr_assert(!fr_minmax_heap_entry_inserted(request->time_order_id));
 	fr_assert(!fr_heap_entry_inserted(request->runnable_id));
 
+	/*
+	 *	Sample how much memory the request used, so that
+	 *	future requests from the same listener get a pool
+	 *	large enough that decoded pairs and value buffers
+	 *	don't fall through to malloc.
+	 */
+	if (worker->config.talloc_pool_adaptive &&
+	    ((request->number & (WORKER_POOL_SAMPLE_RATE - 1)) == 0)) worker_listen_pool_sample(worker, request);
+
 	fr_dlist_entry_unlink(&request->listen_entry);
 
 #ifndef NDEBUG
@@ -804,6 +1047,7 @@ static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd,
 	request_t		*request;
 	TALLOC_CTX		*ctx;
 	fr_listen_t		*listen = cd->listen;
+	fr_worker_listen_t	*wl;
 
 	if (fr_minmax_heap_num_elements(worker->time_order) >= (uint32_t) worker->config.max_requests) goto nak;
 
@@ -813,7 +1057,12 @@ static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd,
 	 */
 	fr_assert(listen != NULL);
 
-	ctx = request = request_alloc_external(NULL, (&(request_init_args_t){ .namespace = listen->dict }));
+	wl = worker_listen_find(worker, listen);
+
+	ctx = request = request_alloc_external(NULL, (&(request_init_args_t){
+							.namespace = listen->dict,
+							.pool_size = worker->config.talloc_pool_adaptive ? wl->pool_size : 0
+						}));
 	if (!request) goto nak;
 
 	worker_request_init(worker, request, now);
@@ -938,20 +1187,7 @@ nak:
 
 	worker_request_time_tracking_start(worker, request, now);
 
-	{
-		fr_worker_listen_t *wl;
-
-		wl = fr_rb_find(worker->listeners, &(fr_worker_listen_t) { .listener = listen });
-		if (!wl) {
-			MEM(wl = talloc_zero(worker, fr_worker_listen_t));
-			fr_dlist_init(&wl->dlist, request_t, listen_entry);
-			wl->listener = listen;
-
-			(void) fr_rb_insert(worker->listeners, wl);
-		}
-
-		fr_dlist_insert_tail(&wl->dlist, request);
-	}
+	fr_dlist_insert_tail(&wl->dlist, request);
 }
 
 /**
@@ -1366,6 +1602,14 @@ nomem:
 
 	worker->name = talloc_strdup(worker, name); /* thread locality */
 
+#ifdef HAVE_REGEX
+	/*
+	 *	We're running in the worker thread, so these are
+	 *	the counters for the worker's regex cache.
+	 */
+	worker->regex_stats = regex_cache_stats();
+#endif
+
 	unlang_thread_instantiate(worker);
 
 	if (config) worker->config = *config;
@@ -1388,6 +1632,15 @@ nomem:
 	CHECK_CONFIG(ring_buffer_size, (1 << 17), (1 << 20));
 	CHECK_CONFIG_TIME_DELTA(max_request_time, fr_time_delta_from_sec(5), fr_time_delta_from_sec(120));
 
+	if (fr_time_delta_ispos(worker->config.max_queue_time)) {
+		CHECK_CONFIG_TIME_DELTA(max_queue_time, fr_time_delta_from_msec(10), worker->config.max_request_time);
+	}
+
+	if (fr_time_delta_ispos(worker->config.queue_delay_target)) {
+		CHECK_CONFIG_TIME_DELTA(queue_delay_target, fr_time_delta_from_msec(1), fr_time_delta_from_sec(1));
+		CHECK_CONFIG_TIME_DELTA(queue_delay_interval, fr_time_delta_from_msec(10), fr_time_delta_from_sec(10));
+	}
+
 	worker->channel = talloc_zero_array(worker, fr_worker_channel_t, worker->config.max_channels);
 	if (!worker->channel) {
 		talloc_free(worker);
@@ -1594,6 +1847,13 @@ void fr_worker_debug(fr_worker_t *worker, FILE *fp)
 
 	fr_time_tracking_debug(&worker->tracking, fp);
 
+#ifdef HAVE_REGEX
+	if (worker->regex_stats) {
+		fprintf(fp, "\tregex cache hits = %" PRIu64 " misses = %" PRIu64 " evictions = %" PRIu64 " entries = %u\n",
+			worker->regex_stats->hits, worker->regex_stats->misses,
+			worker->regex_stats->evictions, worker->regex_stats->entries);
+	}
+#endif
 }
 
 /** Create a channel to the worker
@@ -1692,10 +1952,12 @@ int fr_worker_stats(fr_worker_t const *worker, int num, uint64_t *stats)
 	if (num >= 4) stats[3] = worker->stats.dropped;
 	if (num >= 5) stats[4] = worker->num_naks;
 	if (num >= 6) stats[5] = worker->num_active;
+	if (num >= 7) stats[6] = worker->num_shed_deadline;
+	if (num >= 8) stats[7] = worker->num_shed_delay;
 
-	if (num <= 6) return num;
+	if (num <= 8) return num;
 
-	return 6;
+	return 8;
 }
 
 static int cmd_stats_worker(FILE *fp, UNUSED FILE *fp_err, void *ctx, fr_cmd_info_t const *info)
@@ -1710,6 +1972,8 @@ static int cmd_stats_worker(FILE *fp, UNUSED FILE *fp_err, void *ctx, fr_cmd_inf
 		fprintf(fp, "count.dropped\t\t\t%" PRIu64 "\n", worker->stats.dropped);
 		fprintf(fp, "count.naks\t\t\t%" PRIu64 "\n", worker->num_naks);
 		fprintf(fp, "count.active\t\t\t%" PRIu64 "\n", worker->num_active);
+		fprintf(fp, "count.shed_deadline\t\t%" PRIu64 "\n", worker->num_shed_deadline);
+		fprintf(fp, "count.shed_delay\t\t%" PRIu64 "\n", worker->num_shed_delay);
 		fprintf(fp, "count.runnable\t\t\t%u\n", fr_heap_num_elements(worker->runnable));
 	}
 
@@ -1731,6 +1995,16 @@ static int cmd_stats_worker(FILE *fp, UNUSED FILE *fp_err, void *ctx, fr_cmd_inf
 		fr_time_elapsed_fprint(fp, &worker->wall_clock, "time.requests", 4);
 	}
 
+#ifdef HAVE_REGEX
+	if (worker->regex_stats && ((info->argc == 0) || (strcmp(info->argv[0], "regex") == 0))) {
+		fprintf(fp, "regex.cache_hits		%" PRIu64 "\n", worker->regex_stats->hits);
+		fprintf(fp, "regex.cache_misses		%" PRIu64 "\n", worker->regex_stats->misses);
+		fprintf(fp, "regex.cache_evictions		%" PRIu64 "\n", worker->regex_stats->evictions);
+		fprintf(fp, "regex.cache_jit_failures	%" PRIu64 "\n", worker->regex_stats->jit_failures);
+		fprintf(fp, "regex.cache_entries		%u\n", worker->regex_stats->entries);
+	}
+#endif
+
 	return 0;
 }
 
@@ -1746,7 +2020,7 @@ fr_cmd_table_t cmd_worker_table[] = {
 		.parent = "stats worker",
 		.add_name = true,
 		.name = "self",
-		.syntax = "[(count|cpu)]",
+		.syntax = "[(count|cpu|regex)]",
 		.func = cmd_stats_worker,
 		.help = "Show statistics for a specific worker thread.",
 		.read_only = true
@@ -66,6 +66,15 @@ typedef struct {
 	fr_time_delta_t	max_request_time;	//!< maximum time a request can be processed
 
 	size_t		talloc_pool_size;	//!< for each request
+
+	bool		talloc_pool_adaptive;	//!< Size each request's pool from an EWMA of the
+						///< memory used by recent requests from the same listener.
+
+	fr_time_delta_t	max_queue_time;		//!< Shed requests which will have been waiting longer than
+						///< this by the time they're processed.  0 to disable.
+
+	fr_time_delta_t	queue_delay_target;	//!< CoDel target for the queue delay.  0 to disable.
+	fr_time_delta_t	queue_delay_interval;	//!< CoDel interval.
 } fr_worker_config_t;
 
 fr_worker_t	*fr_worker_create(TALLOC_CTX *ctx, fr_event_list_t *el, char const *name,
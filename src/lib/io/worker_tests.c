@@ -0,0 +1,197 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for worker admission control
+ *
+ * @file src/lib/io/worker_tests.c
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "worker.c"
+
+static fr_worker_t *worker_alloc(fr_time_delta_t max_queue_time, fr_time_delta_t target)
+{
+	fr_worker_t *worker;
+
+	worker = talloc_zero(NULL, fr_worker_t);
+	worker->config.max_queue_time = max_queue_time;
+	worker->config.queue_delay_target = target;
+	worker->config.queue_delay_interval = fr_time_delta_from_msec(100);
+	worker->predicted = fr_time_delta_from_msec(1);
+	worker->runnable = fr_heap_talloc_alloc(worker, worker_runnable_cmp, request_t, runnable_id, 0);
+
+	return worker;
+}
+
+static void test_isqrt(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < 100000; i++) {
+		uint32_t root = worker_isqrt(i);
+
+		TEST_CHECK((root * root) <= i);
+		TEST_CHECK(((root + 1) * (root + 1)) > i);
+		TEST_MSG("isqrt(%u) = %u", i, root);
+	}
+	TEST_CHECK(worker_isqrt(UINT32_MAX) == 65535);
+}
+
+/** Nothing is shed while the delay is below the target, or for the first interval above it
+ *
+ */
+static void test_codel_below_target(void)
+{
+	fr_worker_t	*worker = worker_alloc(fr_time_delta_wrap(0), fr_time_delta_from_msec(5));
+	fr_time_t	now = fr_time_wrap(NSEC);
+	unsigned int	i;
+
+	for (i = 0; i < 1000; i++) {
+		now = fr_time_add(now, fr_time_delta_from_msec(1));
+		TEST_CHECK(!worker_codel_shed(worker, fr_time_delta_from_msec(4), true, now));
+	}
+
+	/*
+	 *	Above target, but not for a whole interval
+	 */
+	for (i = 0; i < 99; i++) {
+		now = fr_time_add(now, fr_time_delta_from_msec(1));
+		TEST_CHECK(!worker_codel_shed(worker, fr_time_delta_from_msec(6), true, now));
+	}
+	TEST_CHECK(!worker->codel.shedding);
+
+	/*
+	 *	Dropping below the target resets the interval
+	 */
+	now = fr_time_add(now, fr_time_delta_from_msec(1));
+	TEST_CHECK(!worker_codel_shed(worker, fr_time_delta_from_msec(1), true, now));
+	for (i = 0; i < 99; i++) {
+		now = fr_time_add(now, fr_time_delta_from_msec(1));
+		TEST_CHECK(!worker_codel_shed(worker, fr_time_delta_from_msec(6), true, now));
+	}
+	TEST_CHECK(!worker->codel.shedding);
+
+	talloc_free(worker);
+}
+
+/** Once the delay has been above target for an interval, shed at an increasing rate
+ *
+ */
+static void test_codel_shed(void)
+{
+	fr_worker_t	*worker = worker_alloc(fr_time_delta_wrap(0), fr_time_delta_from_msec(5));
+	fr_time_t	now = fr_time_wrap(NSEC);
+	unsigned int	i, shed_first = 0, shed_last = 0;
+
+	TEST_CHECK(!worker_codel_shed(worker, fr_time_delta_from_msec(10), true, now));
+
+	/*
+	 *	High priority requests keep the state up to
+	 *	date, but are never shed.
+	 */
+	now = fr_time_add(now, fr_time_delta_from_msec(100));
+	TEST_CHECK(!worker_codel_shed(worker, fr_time_delta_from_msec(10), false, now));
+	TEST_CHECK(worker_codel_shed(worker, fr_time_delta_from_msec(10), true, now));
+	TEST_CHECK(worker->codel.shedding);
+
+	/*
+	 *	A request every millisecond for two seconds, the
+	 *	shedding rate in the second should be higher than
+	 *	in the first.
+	 */
+	for (i = 0; i < 2000; i++) {
+		now = fr_time_add(now, fr_time_delta_from_msec(1));
+		TEST_CHECK(!worker_codel_shed(worker, fr_time_delta_from_msec(10), false, now));
+		if (!worker_codel_shed(worker, fr_time_delta_from_msec(10), true, now)) continue;
+
+		if (i < 1000) {
+			shed_first++;
+		} else {
+			shed_last++;
+		}
+	}
+	TEST_CHECK(shed_first > 0);
+	TEST_CHECK(shed_last > shed_first);
+	TEST_MSG("shed %u in the first second, %u in the second", shed_first, shed_last);
+
+	/*
+	 *	Delay below target stops shedding immediately
+	 */
+	now = fr_time_add(now, fr_time_delta_from_msec(1));
+	TEST_CHECK(!worker_codel_shed(worker, fr_time_delta_from_msec(1), true, now));
+	TEST_CHECK(!worker->codel.shedding);
+
+	talloc_free(worker);
+}
+
+/** Requests which will be older than max_queue_time when they run are shed, unless they're "now" priority
+ *
+ */
+static void test_shed_deadline(void)
+{
+	fr_worker_t		*worker = worker_alloc(fr_time_delta_from_msec(500), fr_time_delta_wrap(0));
+	fr_time_t		now = fr_time_from_sec(10);
+	fr_channel_data_t	cd = {
+					.priority = PRIORITY_NORMAL,
+				};
+
+	cd.m.when = cd.request.recv_time = fr_time_sub(now, fr_time_delta_from_msec(100));
+	TEST_CHECK(!worker_shed(worker, &cd, now));
+
+	cd.m.when = cd.request.recv_time = fr_time_sub(now, fr_time_delta_from_msec(600));
+	TEST_CHECK(worker_shed(worker, &cd, now));
+	TEST_CHECK(worker->num_shed_deadline == 1);
+
+	cd.priority = PRIORITY_HIGH;
+	TEST_CHECK(worker_shed(worker, &cd, now));
+	TEST_CHECK(worker->num_shed_deadline == 2);
+
+	cd.priority = PRIORITY_NOW;
+	TEST_CHECK(!worker_shed(worker, &cd, now));
+
+	talloc_free(worker);
+}
+
+/** With no shedding configured, nothing is shed
+ *
+ */
+static void test_shed_disabled(void)
+{
+	fr_worker_t		*worker = worker_alloc(fr_time_delta_wrap(0), fr_time_delta_wrap(0));
+	fr_time_t		now = fr_time_from_sec(100);
+	fr_channel_data_t	cd = {
+					.priority = PRIORITY_LOW,
+				};
+
+	cd.m.when = cd.request.recv_time = fr_time_wrap(NSEC);
+	TEST_CHECK(!worker_shed(worker, &cd, now));
+	TEST_CHECK(worker->num_shed_deadline == 0);
+	TEST_CHECK(worker->num_shed_delay == 0);
+
+	talloc_free(worker);
+}
+
+TEST_LIST = {
+	{ "isqrt",			test_isqrt },
+	{ "codel_below_target",		test_codel_below_target },
+	{ "codel_shed",			test_codel_shed },
+	{ "shed_deadline",		test_shed_deadline },
+	{ "shed_disabled",		test_shed_disabled },
+	{ NULL }
+};
@@ -260,5 +260,51 @@ void		fr_json_version_print(void);
 char		*fr_json_afrom_pair_list(TALLOC_CTX *ctx, fr_pair_list_t *vps,
 					 fr_json_format_t const *format);
 
+fr_slen_t	fr_json_str_from_pair_list(fr_sbuff_t *out, fr_pair_list_t *vps,
+					   fr_json_format_t const *format);
+
 bool		fr_json_format_verify(fr_json_format_t const *format, bool verbose);
+
+/* stream.c */
+
+/** Tokens produced by the streaming JSON parser
+ */
+typedef enum {
+	FR_JSON_STREAM_OBJECT_START = 0,	//!< '{'
+	FR_JSON_STREAM_OBJECT_END,		//!< '}'
+	FR_JSON_STREAM_ARRAY_START,		//!< '['
+	FR_JSON_STREAM_ARRAY_END,		//!< ']'
+	FR_JSON_STREAM_KEY,			//!< Name of an object member.
+	FR_JSON_STREAM_STRING,			//!< String value.
+	FR_JSON_STREAM_INT,			//!< Number without a fraction or exponent.
+	FR_JSON_STREAM_DOUBLE,			//!< Number with a fraction or exponent.
+	FR_JSON_STREAM_BOOL,			//!< true or false.
+	FR_JSON_STREAM_NULL			//!< null.
+} fr_json_stream_event_t;
+
+typedef struct fr_json_stream_s fr_json_stream_t;
+
+/** Called by the streaming JSON parser for each token
+ *
+ * @param[in] event	Type of token.
+ * @param[in] depth	Number of containers the token is in.  The start and
+ *			end of a container are at the same depth as the
+ *			container itself, so the top level value is at depth 0.
+ * @param[in] value	\0 terminated text of the token, with any escape sequences
+ *			in strings and keys decoded.  NULL for the start and end
+ *			of containers.  Only valid for the duration of the call.
+ * @param[in] len	Length of value.
+ * @param[in] uctx	passed to fr_json_stream_alloc.
+ * @return
+ *	- 0 to continue parsing.
+ *	- -1 to stop parsing, fr_json_stream_parse will return an error.
+ */
+typedef int (*fr_json_stream_func_t)(fr_json_stream_event_t event, unsigned int depth,
+				     char const *value, size_t len, void *uctx);
+
+fr_json_stream_t *fr_json_stream_alloc(TALLOC_CTX *ctx, fr_json_stream_func_t func, void *uctx);
+
+int		fr_json_stream_parse(fr_json_stream_t *js, char const *in, size_t inlen);
+
+int		fr_json_stream_finish(fr_json_stream_t *js);
 #endif
@@ -266,6 +266,81 @@ json_object *json_object_from_value_box(fr_value_box_t const *data)
 	}
 }
 
+/** Escape a string exactly as json-c does when printing string values
+ *
+ * @param[out] out	Where to write the escaped string.
+ * @param[in] in	String to escape.
+ * @param[in] inlen	Length of in.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 the number of additional bytes we'd need.
+ */
+static fr_slen_t json_str_escape(fr_sbuff_t *out, char const *in, size_t inlen)
+{
+	fr_sbuff_t	our_out = FR_SBUFF(out);
+	uint8_t const	*p = (uint8_t const *)in, *end = p + inlen, *last_app = p;
+
+	while (p < end) {
+		char const *esc;
+
+		switch (*p) {
+		case '\b':
+			esc = "\\b";
+			break;
+
+		case '\n':
+			esc = "\\n";
+			break;
+
+		case '\r':
+			esc = "\\r";
+			break;
+
+		case '\t':
+			esc = "\\t";
+			break;
+
+		case '\f':
+			esc = "\\f";
+			break;
+
+		case '"':
+			esc = "\\\"";
+			break;
+
+		case '\\':
+			esc = "\\\\";
+			break;
+
+		case '/':
+			esc = "\\/";
+			break;
+
+		default:
+			if (*p >= ' ') {
+				p++;
+				continue;
+			}
+			esc = NULL;
+			break;
+		}
+
+		if (p > last_app) FR_SBUFF_IN_BSTRNCPY_RETURN(&our_out, (char const *)last_app, p - last_app);
+
+		if (esc) {
+			FR_SBUFF_IN_STRCPY_RETURN(&our_out, esc);
+		} else {
+			FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\\u00");
+			FR_SBUFF_RETURN(fr_base16_encode, &our_out, &FR_DBUFF_TMP(p, 1));
+		}
+
+		last_app = ++p;
+	}
+	if (end > last_app) FR_SBUFF_IN_BSTRNCPY_RETURN(&our_out, (char const *)last_app, end - last_app);
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
 /** Print a value box as its equivalent JSON format without going via a struct json_object (in most cases)
  *
  * @param[out] out		buffer to write to.
@@ -296,63 +371,9 @@ fr_slen_t fr_json_str_from_value(fr_sbuff_t *out, fr_value_box_t *vb, bool inclu
 	 */
 	case FR_TYPE_STRING:
 	case FR_TYPE_OCTETS:
-	{
-		char const *last_app, *p, *end;
-
 		if (include_quotes) FR_SBUFF_IN_CHAR_RETURN(&our_out, '"');
-
-		last_app = p = vb->vb_strvalue;
-		end = p + vb->vb_length;
-
-		while (p < end) {
-			if (*p < ' ') {
-				if (p > last_app) FR_SBUFF_IN_BSTRNCPY_RETURN(&our_out, last_app, p - last_app);
-
-				switch (*p) {
-				case '\b':
-					FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\\b");
-					break;
-
-				case '\n':
-					FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\\n");
-					break;
-
-				case '\r':
-					FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\\r");
-					break;
-
-				case '\t':
-					FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\\t");
-					break;
-
-				case '\f':
-					FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\\f");
-					break;
-
-				case '"':
-					FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\\\"");
-					break;
-
-				case '\\':
-					FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\\\\");
-					break;
-
-				case '/':
-					FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\\/");
-					break;
-
-				default:
-					FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\\u00");
-					fr_base16_encode(&our_out, &FR_DBUFF_TMP((uint8_t const *)p, 1));
-				}
-
-				last_app = p + 1;
-			}
-			p++;
-		}
-		if (end > last_app) FR_SBUFF_IN_BSTRNCPY_RETURN(&our_out, last_app, end - last_app);
+		FR_SBUFF_RETURN(json_str_escape, &our_out, vb->vb_strvalue, vb->vb_length);
 		if (include_quotes) FR_SBUFF_IN_CHAR_RETURN(&our_out, '"');
-	}
 		break;
 
 	case FR_TYPE_UINT8:
@@ -1204,6 +1225,473 @@ static struct json_object *json_attr_array_afrom_pair_list(TALLOC_CTX *ctx, fr_p
 }
 
 
+/** Print a value box in the same format as json_object_from_value_box() would produce
+ *
+ * @param[out] out	Where to write the JSON value.
+ * @param[in] data	to print.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 on error.
+ */
+static fr_slen_t json_value_box_print(fr_sbuff_t *out, fr_value_box_t const *data)
+{
+	fr_sbuff_t	our_out = FR_SBUFF(out);
+
+	if (data->enumv) {
+		fr_dict_enum_value_t *enumv;
+
+		enumv = fr_dict_enum_by_value(data->enumv, data);
+		if (enumv) {
+			FR_SBUFF_IN_CHAR_RETURN(&our_out, '"');
+			FR_SBUFF_RETURN(json_str_escape, &our_out, enumv->name, enumv->name_len);
+			FR_SBUFF_IN_CHAR_RETURN(&our_out, '"');
+			FR_SBUFF_SET_RETURN(out, &our_out);
+		}
+	}
+
+	switch (data->type) {
+	default:
+	do_string:
+	{
+		char		buffer[64];
+		fr_sbuff_t	sbuff = FR_SBUFF_IN(buffer, sizeof(buffer));
+
+		if (fr_value_box_print(&sbuff, data, NULL) <= 0) {
+			fr_strerror_printf("Failed printing %s value", fr_type_to_str(data->type));
+			return -1;
+		}
+
+		FR_SBUFF_IN_CHAR_RETURN(&our_out, '"');
+		FR_SBUFF_RETURN(json_str_escape, &our_out, buffer, fr_sbuff_used(&sbuff));
+		FR_SBUFF_IN_CHAR_RETURN(&our_out, '"');
+	}
+		break;
+
+	case FR_TYPE_STRING:
+	case FR_TYPE_OCTETS:
+		FR_SBUFF_IN_CHAR_RETURN(&our_out, '"');
+		FR_SBUFF_RETURN(json_str_escape, &our_out, data->vb_strvalue, data->vb_length);
+		FR_SBUFF_IN_CHAR_RETURN(&our_out, '"');
+		break;
+
+	case FR_TYPE_BOOL:
+		FR_SBUFF_IN_STRCPY_RETURN(&our_out, data->vb_uint8 ? "true" : "false");
+		break;
+
+	case FR_TYPE_UINT8:
+		FR_SBUFF_IN_SPRINTF_RETURN(&our_out, "%u", data->vb_uint8);
+		break;
+
+	case FR_TYPE_UINT16:
+		FR_SBUFF_IN_SPRINTF_RETURN(&our_out, "%u", data->vb_uint16);
+		break;
+
+#ifdef HAVE_JSON_OBJECT_GET_INT64
+	case FR_TYPE_UINT32:
+		FR_SBUFF_IN_SPRINTF_RETURN(&our_out, "%u", data->vb_uint32);
+		break;
+
+	case FR_TYPE_UINT64:
+		if (data->vb_uint64 > INT64_MAX) goto do_string;
+		FR_SBUFF_IN_SPRINTF_RETURN(&our_out, "%" PRIu64, data->vb_uint64);
+		break;
+#else
+	case FR_TYPE_UINT32:
+		if (data->vb_uint32 > INT32_MAX) goto do_string;
+		FR_SBUFF_IN_SPRINTF_RETURN(&our_out, "%u", data->vb_uint32);
+		break;
+#endif
+
+	case FR_TYPE_INT8:
+		FR_SBUFF_IN_SPRINTF_RETURN(&our_out, "%i", data->vb_int8);
+		break;
+
+	case FR_TYPE_INT16:
+		FR_SBUFF_IN_SPRINTF_RETURN(&our_out, "%i", data->vb_int16);
+		break;
+
+	case FR_TYPE_INT32:
+		FR_SBUFF_IN_SPRINTF_RETURN(&our_out, "%i", data->vb_int32);
+		break;
+
+#ifdef HAVE_JSON_OBJECT_GET_INT64
+	case FR_TYPE_INT64:
+		FR_SBUFF_IN_SPRINTF_RETURN(&our_out, "%" PRId64, data->vb_int64);
+		break;
+
+	case FR_TYPE_SIZE:
+		FR_SBUFF_IN_SPRINTF_RETURN(&our_out, "%" PRId64, (int64_t)data->vb_size);
+		break;
+#endif
+
+	case FR_TYPE_STRUCTURAL:
+		fr_strerror_const("Structural boxes cannot be printed as JSON values");
+		return -1;
+	}
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
+/** Print the value of a pair, applying the value formatting options
+ *
+ * Produces the same output as json_afrom_value_box() followed by json-c's
+ * stringification.
+ *
+ * @param[out] out	Where to write the JSON value.
+ * @param[in] vp	to print the value of.
+ * @param[in] format	Formatting control, must be set.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 on error.
+ */
+static fr_slen_t json_pair_value_print(fr_sbuff_t *out, fr_pair_t *vp, fr_json_format_t const *format)
+{
+	fr_value_box_t const	*vb;
+	fr_value_box_t		vb_str = FR_VALUE_BOX_INITIALISER_NULL(vb_str);
+	fr_slen_t		slen;
+
+	switch (vp->vp_type) {
+	case FR_TYPE_LEAF:
+		break;
+
+	case FR_TYPE_STRUCTURAL:
+		return fr_json_str_from_pair_list(out, &vp->vp_group, format);
+
+	default:
+		fr_strerror_printf("Invalid type %s for attribute %s", fr_type_to_str(vp->vp_type), vp->da->name);
+		return -1;
+	}
+
+	vb = &vp->data;
+
+	if (format->value.enum_as_int && unlikely(fr_pair_value_enum_box(&vb, vp) < 0)) return -1;
+
+	if (!format->value.always_string) return json_value_box_print(out, vb);
+
+	if (fr_value_box_cast(NULL, &vb_str, FR_TYPE_STRING, NULL, vb) < 0) return -1;
+	slen = json_value_box_print(out, &vb_str);
+	fr_value_box_clear(&vb_str);
+
+	return slen;
+}
+
+/** Print a pair's name, with the optional prefix, as a JSON string
+ *
+ * @param[out] out	Where to write the quoted name.
+ * @param[in] da	to print the name of.
+ * @param[in] format	Formatting control, must be set.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 the number of additional bytes we'd need.
+ */
+static fr_slen_t json_pair_name_print(fr_sbuff_t *out, fr_dict_attr_t const *da, fr_json_format_t const *format)
+{
+	fr_sbuff_t our_out = FR_SBUFF(out);
+
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '"');
+	if (format->attr.prefix) {
+		FR_SBUFF_RETURN(json_str_escape, &our_out, format->attr.prefix, strlen(format->attr.prefix));
+		FR_SBUFF_IN_CHAR_RETURN(&our_out, ':');
+	}
+	FR_SBUFF_RETURN(json_str_escape, &our_out, da->name, da->name_len);
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '"');
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
+/** Print the values of all pairs matching vp->da, starting at vp
+ *
+ * json-c groups values under the first instance of an attribute, so
+ * we do the same, and only wrap the values in an array if there's more
+ * than one of them, or we've been asked to always produce an array.
+ *
+ * @param[out] out	Where to write the value(s).
+ * @param[in] vps	the list vp is in.
+ * @param[in] vp	First instance of the attribute.
+ * @param[in] format	Formatting control, must be set.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 on error.
+ */
+static fr_slen_t json_pair_values_print(fr_sbuff_t *out, fr_pair_list_t *vps, fr_pair_t *vp,
+					fr_json_format_t const *format)
+{
+	fr_sbuff_t	our_out = FR_SBUFF(out);
+	fr_pair_t	*next = fr_pair_find_by_da(vps, vp, vp->da);
+
+	if (!next && !format->value.value_is_always_array) {
+		FR_SBUFF_RETURN(json_pair_value_print, &our_out, vp, format);
+		FR_SBUFF_SET_RETURN(out, &our_out);
+	}
+
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '[');
+	FR_SBUFF_RETURN(json_pair_value_print, &our_out, vp, format);
+	for (; next; next = fr_pair_find_by_da(vps, next, vp->da)) {
+		FR_SBUFF_IN_CHAR_RETURN(&our_out, ',');
+		FR_SBUFF_RETURN(json_pair_value_print, &our_out, next, format);
+	}
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, ']');
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
+/** Whether vp is the first instance of its attribute in the list
+ *
+ * Later instances have already been printed along with the first.
+ */
+static inline CC_HINT(always_inline)
+bool json_pair_is_first(fr_pair_list_t *vps, fr_pair_t *vp)
+{
+	return fr_pair_find_by_da(vps, NULL, vp->da) == vp;
+}
+
+/** Print a list of pairs in the "object" format, JSON_MODE_OBJECT
+ *
+ * The output is identical to json_object_afrom_pair_list() after stringification.
+ *
+ * @param[out] out	Where to write the JSON document.
+ * @param[in] vps	a list of value pairs.
+ * @param[in] format	Formatting control, must be set.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 on error.
+ */
+static fr_slen_t json_object_str_from_pair_list(fr_sbuff_t *out, fr_pair_list_t *vps, fr_json_format_t const *format)
+{
+	fr_sbuff_t	our_out = FR_SBUFF(out);
+	fr_pair_t	*vp;
+	bool		first = true;
+
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '{');
+	for (vp = fr_pair_list_head(vps);
+	     vp;
+	     vp = fr_pair_list_next(vps, vp)) {
+		if (vp->vp_raw || !json_pair_is_first(vps, vp)) continue;
+
+		if (!first) FR_SBUFF_IN_CHAR_RETURN(&our_out, ',');
+		first = false;
+
+		FR_SBUFF_RETURN(json_pair_name_print, &our_out, vp->da, format);
+		FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, ":{\"type\":\"");
+		FR_SBUFF_IN_STRCPY_RETURN(&our_out, fr_type_to_str(vp->vp_type));
+		FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\",\"value\":");
+		FR_SBUFF_RETURN(json_pair_values_print, &our_out, vps, vp, format);
+		FR_SBUFF_IN_CHAR_RETURN(&our_out, '}');
+	}
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '}');
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
+/** Print a list of pairs in the "simple object" format, JSON_MODE_OBJECT_SIMPLE
+ *
+ * The output is identical to json_smplobj_afrom_pair_list() after stringification.
+ *
+ * @param[out] out	Where to write the JSON document.
+ * @param[in] vps	a list of value pairs.
+ * @param[in] format	Formatting control, must be set.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 on error.
+ */
+static fr_slen_t json_smplobj_str_from_pair_list(fr_sbuff_t *out, fr_pair_list_t *vps, fr_json_format_t const *format)
+{
+	fr_sbuff_t	our_out = FR_SBUFF(out);
+	fr_pair_t	*vp;
+	bool		first = true;
+
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '{');
+	for (vp = fr_pair_list_head(vps);
+	     vp;
+	     vp = fr_pair_list_next(vps, vp)) {
+		if (vp->vp_raw || !json_pair_is_first(vps, vp)) continue;
+
+		if (!first) FR_SBUFF_IN_CHAR_RETURN(&our_out, ',');
+		first = false;
+
+		FR_SBUFF_RETURN(json_pair_name_print, &our_out, vp->da, format);
+		FR_SBUFF_IN_CHAR_RETURN(&our_out, ':');
+		FR_SBUFF_RETURN(json_pair_values_print, &our_out, vps, vp, format);
+	}
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '}');
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
+/** Print a list of pairs in the "array" format, JSON_MODE_ARRAY
+ *
+ * The output is identical to json_array_afrom_pair_list() after stringification.
+ *
+ * @param[out] out	Where to write the JSON document.
+ * @param[in] vps	a list of value pairs.
+ * @param[in] format	Formatting control, must be set.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 on error.
+ */
+static fr_slen_t json_array_str_from_pair_list(fr_sbuff_t *out, fr_pair_list_t *vps, fr_json_format_t const *format)
+{
+	fr_sbuff_t	our_out = FR_SBUFF(out);
+	fr_pair_t	*vp;
+	bool		first = true;
+
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '[');
+	for (vp = fr_pair_list_head(vps);
+	     vp;
+	     vp = fr_pair_list_next(vps, vp)) {
+		if (vp->vp_raw) continue;
+
+		/*
+		 *	If values are being grouped, they're all
+		 *	printed with the first instance.
+		 */
+		if (format->value.value_is_always_array && !json_pair_is_first(vps, vp)) continue;
+
+		if (!first) FR_SBUFF_IN_CHAR_RETURN(&our_out, ',');
+		first = false;
+
+		FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "{\"name\":");
+		FR_SBUFF_RETURN(json_pair_name_print, &our_out, vp->da, format);
+		FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, ",\"type\":\"");
+		FR_SBUFF_IN_STRCPY_RETURN(&our_out, fr_type_to_str(vp->vp_type));
+		FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\",\"value\":");
+		if (format->value.value_is_always_array) {
+			FR_SBUFF_RETURN(json_pair_values_print, &our_out, vps, vp, format);
+		} else {
+			FR_SBUFF_RETURN(json_pair_value_print, &our_out, vp, format);
+		}
+		FR_SBUFF_IN_CHAR_RETURN(&our_out, '}');
+	}
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, ']');
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
+/** Print a list of pairs in the "array_of_values" format, JSON_MODE_ARRAY_OF_VALUES
+ *
+ * The output is identical to json_value_array_afrom_pair_list() after stringification.
+ *
+ * @param[out] out	Where to write the JSON document.
+ * @param[in] vps	a list of value pairs.
+ * @param[in] format	Formatting control, must be set.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 on error.
+ */
+static fr_slen_t json_value_array_str_from_pair_list(fr_sbuff_t *out, fr_pair_list_t *vps,
+						     fr_json_format_t const *format)
+{
+	fr_sbuff_t	our_out = FR_SBUFF(out);
+	fr_pair_t	*vp;
+	bool		first = true;
+
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '[');
+	for (vp = fr_pair_list_head(vps);
+	     vp;
+	     vp = fr_pair_list_next(vps, vp)) {
+		if (vp->vp_raw) continue;
+
+		if (!first) FR_SBUFF_IN_CHAR_RETURN(&our_out, ',');
+		first = false;
+
+		FR_SBUFF_RETURN(json_pair_value_print, &our_out, vp, format);
+	}
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, ']');
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
+/** Print a list of pairs in the "array_of_names" format, JSON_MODE_ARRAY_OF_NAMES
+ *
+ * The output is identical to json_attr_array_afrom_pair_list() after stringification.
+ *
+ * @param[out] out	Where to write the JSON document.
+ * @param[in] vps	a list of value pairs.
+ * @param[in] format	Formatting control, must be set.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 on error.
+ */
+static fr_slen_t json_attr_array_str_from_pair_list(fr_sbuff_t *out, fr_pair_list_t *vps,
+						    fr_json_format_t const *format)
+{
+	fr_sbuff_t	our_out = FR_SBUFF(out);
+	fr_pair_t	*vp;
+	bool		first = true;
+
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '[');
+	for (vp = fr_pair_list_head(vps);
+	     vp;
+	     vp = fr_pair_list_next(vps, vp)) {
+		if (vp->vp_raw) continue;
+
+		if (!first) FR_SBUFF_IN_CHAR_RETURN(&our_out, ',');
+		first = false;
+
+		FR_SBUFF_RETURN(json_pair_name_print, &our_out, vp->da, format);
+
+		switch (vp->vp_type) {
+		case FR_TYPE_LEAF:
+			break;
+
+		case FR_TYPE_STRUCTURAL:
+			FR_SBUFF_IN_CHAR_RETURN(&our_out, ',');
+			FR_SBUFF_RETURN(json_attr_array_str_from_pair_list, &our_out, &vp->vp_group, format);
+			break;
+
+		default:
+			fr_strerror_printf("Invalid type %s for attribute %s",
+					   fr_type_to_str(vp->vp_type), vp->da->name);
+			return -1;
+		}
+	}
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, ']');
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
+/** Print a list of value pairs as JSON, without building a json-c object tree
+ *
+ * The output is identical to that of fr_json_afrom_pair_list(), but is
+ * written directly into the sbuff.  For large pair lists this avoids
+ * allocating a json_object for every attribute, value and key, only to
+ * free them again once the tree has been stringified.
+ *
+ * @param[out] out	Where to write the JSON document.
+ * @param[in] vps	a list of value pairs.
+ * @param[in] format	Formatting control, can be NULL to use default format.
+ * @return
+ *	- >= 0 the number of bytes written to out.
+ *	- < 0 on error, or if out was too small.
+ */
+fr_slen_t fr_json_str_from_pair_list(fr_sbuff_t *out, fr_pair_list_t *vps, fr_json_format_t const *format)
+{
+	if (!format) format = &default_json_format;
+
+	switch (format->output_mode) {
+	case JSON_MODE_OBJECT:
+		return json_object_str_from_pair_list(out, vps, format);
+
+	case JSON_MODE_OBJECT_SIMPLE:
+		return json_smplobj_str_from_pair_list(out, vps, format);
+
+	case JSON_MODE_ARRAY:
+		return json_array_str_from_pair_list(out, vps, format);
+
+	case JSON_MODE_ARRAY_OF_VALUES:
+		return json_value_array_str_from_pair_list(out, vps, format);
+
+	case JSON_MODE_ARRAY_OF_NAMES:
+		return json_attr_array_str_from_pair_list(out, vps, format);
+
+	default:
+		break;
+	}
+
+	fr_strerror_const("JSON format output mode is invalid");
+	return -1;
+}
+
 /** Returns a JSON string of a list of value pairs
  *
  * The result is a talloc-ed string, freeing the string is
@@ -1242,9 +1730,25 @@ char *fr_json_afrom_pair_list(TALLOC_CTX *ctx, fr_pair_list_t *vps,
 	struct json_object	*obj = NULL;
 	const char		*p;
 	char			*out;
+	fr_sbuff_t		sbuff;
+	fr_sbuff_uctx_talloc_t	tctx;
 
 	if (!format) format = &default_json_format;
 
+	/*
+	 *	Write the document out directly, which avoids
+	 *	allocating and then freeing an entire json-c
+	 *	object tree.
+	 */
+	MEM(fr_sbuff_init_talloc(ctx, &sbuff, &tctx, 1024, SIZE_MAX));
+	if ((fr_json_str_from_pair_list(&sbuff, vps, format) >= 0) &&
+	    (fr_sbuff_trim_talloc(&sbuff, SIZE_MAX) == 0)) return sbuff.buff;
+	talloc_free(sbuff.buff);
+
+	/*
+	 *	...and if that failed, fall back to building the
+	 *	document with json-c.
+	 */
 	switch (format->output_mode) {
 	case JSON_MODE_OBJECT:
 		MEM(obj = json_object_afrom_pair_list(ctx, vps, format));
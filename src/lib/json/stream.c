@@ -0,0 +1,610 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file stream.c
+ * @brief Push parser which produces a stream of JSON tokens, without building a json-c object tree.
+ *
+ * Data is fed to the parser in chunks of any size, as it's received.  Tokens
+ * which span chunks are buffered until they're complete, and are then passed
+ * to a callback.
+ *
+ * The parser only accepts strict JSON.  json-c is more lenient (comments,
+ * single quoted strings, NaN etc...), so callers should fall back to
+ * json_tokener_parse() if the parser returns an error.
+ *
+ * @copyright 2025 The FreeRADIUS Server Project
+ */
+#include <freeradius-devel/util/debug.h>
+#include "base.h"
+
+/** Maximum nesting depth, the same as json-c's default
+ */
+#define JSON_STREAM_MAX_DEPTH	32
+
+typedef enum {
+	JSON_STREAM_VALUE = 0,			//!< Expecting a value.
+	JSON_STREAM_VALUE_OR_END,		//!< After '[', expecting a value or ']'.
+	JSON_STREAM_KEY_OR_END,			//!< After '{', expecting a key or '}'.
+	JSON_STREAM_KEY,			//!< After ',' in an object, expecting a key.
+	JSON_STREAM_COLON,			//!< After a key, expecting ':'.
+	JSON_STREAM_COMMA_OR_END,		//!< After a member or element.
+	JSON_STREAM_STRING,			//!< Inside a string or key.
+	JSON_STREAM_STRING_ESCAPE,		//!< After a '\' in a string.
+	JSON_STREAM_STRING_UNICODE,		//!< Reading the hex digits of a \\uXXXX escape.
+	JSON_STREAM_NUMBER,			//!< Inside a number.
+	JSON_STREAM_LITERAL,			//!< Inside true, false or null.
+	JSON_STREAM_DONE,			//!< Top level value is complete.
+	JSON_STREAM_ERROR			//!< Parsing failed.
+} json_stream_state_t;
+
+struct fr_json_stream_s {
+	json_stream_state_t	state;		//!< What we expect next.
+
+	unsigned int		depth;		//!< Number of containers we're in.
+	bool			is_object[JSON_STREAM_MAX_DEPTH];	//!< Type of each container.
+	bool			is_key;		//!< The string we're reading is an object key.
+
+	char			*buff;		//!< Text of the current token.
+	size_t			len;		//!< Bytes used in buff.
+
+	uint32_t		unicode;	//!< Codepoint we're reading from a \\u escape.
+	unsigned int		unicode_digits;	//!< How many hex digits we've read.
+	uint32_t		high_surrogate;	//!< The first half of a surrogate pair.
+
+	size_t			offset;		//!< Of the start of the current chunk in the document.
+
+	fr_json_stream_func_t	func;		//!< Called for each token.
+	void			*uctx;		//!< Passed to func.
+};
+
+/** Allocate a new streaming JSON parser
+ *
+ * @param[in] ctx	to allocate the parser in.
+ * @param[in] func	to call for each token.
+ * @param[in] uctx	passed to func.
+ * @return
+ *	- A new parser.
+ *	- NULL on error.
+ */
+fr_json_stream_t *fr_json_stream_alloc(TALLOC_CTX *ctx, fr_json_stream_func_t func, void *uctx)
+{
+	fr_json_stream_t *js;
+
+	js = talloc_zero(ctx, fr_json_stream_t);
+	if (unlikely(!js)) return NULL;
+
+	js->buff = talloc_array(js, char, 128);
+	if (unlikely(!js->buff)) {
+		talloc_free(js);
+		return NULL;
+	}
+	js->func = func;
+	js->uctx = uctx;
+
+	return js;
+}
+
+/** Append data to the current token
+ *
+ * Always leaves space for a terminating '\0'.
+ */
+static int json_stream_append(fr_json_stream_t *js, char const *in, size_t inlen)
+{
+	size_t size = talloc_array_length(js->buff);
+
+	if ((js->len + inlen + 1) > size) {
+		char *buff;
+
+		while ((js->len + inlen + 1) > size) size *= 2;
+
+		buff = talloc_realloc(js, js->buff, char, size);
+		if (unlikely(!buff)) {
+			fr_strerror_const("Out of memory");
+			return -1;
+		}
+		js->buff = buff;
+	}
+
+	memcpy(js->buff + js->len, in, inlen);
+	js->len += inlen;
+
+	return 0;
+}
+
+/** Pass a token to the callback
+ *
+ */
+static inline CC_HINT(always_inline)
+int json_stream_emit(fr_json_stream_t *js, fr_json_stream_event_t event, char const *value, size_t len)
+{
+	if (value) js->buff[len] = '\0';
+
+	if (js->func(event, js->depth, value, len, js->uctx) < 0) {
+		if (!fr_strerror_peek()) fr_strerror_const("Parsing aborted by callback");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Update the state after a complete value
+ *
+ */
+static inline CC_HINT(always_inline)
+void json_stream_value_done(fr_json_stream_t *js)
+{
+	js->state = js->depth ? JSON_STREAM_COMMA_OR_END : JSON_STREAM_DONE;
+}
+
+/** Check a number against the JSON grammar
+ *
+ * Numbers are read by collecting any characters which can appear in one, so
+ * things like "1-2" or "1e" have to be rejected here.
+ *
+ * @return
+ *	- FR_JSON_STREAM_INT if the number has no fraction or exponent.  This
+ *	  is the same rule json-c uses to decide whether a number is an integer.
+ *	- FR_JSON_STREAM_DOUBLE if the number is valid, and isn't an integer.
+ *	- -1 if the number is malformed.
+ */
+static int json_stream_number(char const *p, size_t len)
+{
+	char const	*end = p + len;
+	int		type = FR_JSON_STREAM_INT;
+
+	if ((p < end) && (*p == '-')) p++;
+
+	/*
+	 *	No leading zeros
+	 */
+	if ((p < end) && (*p == '0')) {
+		p++;
+	} else {
+		if ((p == end) || !isdigit((uint8_t)*p)) return -1;
+		while ((p < end) && isdigit((uint8_t)*p)) p++;
+	}
+
+	if ((p < end) && (*p == '.')) {
+		p++;
+		if ((p == end) || !isdigit((uint8_t)*p)) return -1;
+		while ((p < end) && isdigit((uint8_t)*p)) p++;
+		type = FR_JSON_STREAM_DOUBLE;
+	}
+
+	if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+		p++;
+		if ((p < end) && ((*p == '+') || (*p == '-'))) p++;
+		if ((p == end) || !isdigit((uint8_t)*p)) return -1;
+		while ((p < end) && isdigit((uint8_t)*p)) p++;
+		type = FR_JSON_STREAM_DOUBLE;
+	}
+
+	if (p != end) return -1;
+
+	return type;
+}
+
+/** Emit a complete string, key, number, or literal
+ *
+ */
+static int json_stream_token_done(fr_json_stream_t *js)
+{
+	fr_json_stream_event_t	event;
+	int			type;
+
+	switch (js->state) {
+	case JSON_STREAM_STRING:
+		if (js->is_key) {
+			if (json_stream_emit(js, FR_JSON_STREAM_KEY, js->buff, js->len) < 0) return -1;
+			js->state = JSON_STREAM_COLON;
+			return 0;
+		}
+		event = FR_JSON_STREAM_STRING;
+		break;
+
+	case JSON_STREAM_NUMBER:
+		type = json_stream_number(js->buff, js->len);
+		if (type < 0) {
+			js->buff[js->len] = '\0';
+			fr_strerror_printf("Invalid number \"%s\"", js->buff);
+			return -1;
+		}
+		event = type;
+		break;
+
+	case JSON_STREAM_LITERAL:
+		if ((js->len == 4) && (memcmp(js->buff, "true", 4) == 0)) {
+			event = FR_JSON_STREAM_BOOL;
+		} else if ((js->len == 5) && (memcmp(js->buff, "false", 5) == 0)) {
+			event = FR_JSON_STREAM_BOOL;
+		} else if ((js->len == 4) && (memcmp(js->buff, "null", 4) == 0)) {
+			event = FR_JSON_STREAM_NULL;
+		} else {
+			js->buff[js->len] = '\0';
+			fr_strerror_printf("Invalid literal \"%s\"", js->buff);
+			return -1;
+		}
+		break;
+
+	default:
+		fr_assert(0);
+		return -1;
+	}
+
+	if (json_stream_emit(js, event, js->buff, js->len) < 0) return -1;
+	json_stream_value_done(js);
+
+	return 0;
+}
+
+/** Encode a codepoint from a \\u escape as UTF-8
+ *
+ */
+static int json_stream_unicode(fr_json_stream_t *js)
+{
+	uint32_t	cp = js->unicode;
+	char		utf8[4];
+	size_t		len;
+
+	if ((cp >= 0xd800) && (cp <= 0xdbff)) {
+		if (js->high_surrogate) goto invalid;
+		js->high_surrogate = cp;
+		return 0;
+	}
+
+	if ((cp >= 0xdc00) && (cp <= 0xdfff)) {
+		if (!js->high_surrogate) goto invalid;
+		cp = 0x10000 + ((js->high_surrogate - 0xd800) << 10) + (cp - 0xdc00);
+		js->high_surrogate = 0;
+	} else if (js->high_surrogate) {
+	invalid:
+		fr_strerror_const("Invalid UTF-16 surrogate pair in \\u escape");
+		return -1;
+	}
+
+	if (cp < 0x80) {
+		utf8[0] = cp;
+		len = 1;
+	} else if (cp < 0x800) {
+		utf8[0] = 0xc0 | (cp >> 6);
+		utf8[1] = 0x80 | (cp & 0x3f);
+		len = 2;
+	} else if (cp < 0x10000) {
+		utf8[0] = 0xe0 | (cp >> 12);
+		utf8[1] = 0x80 | ((cp >> 6) & 0x3f);
+		utf8[2] = 0x80 | (cp & 0x3f);
+		len = 3;
+	} else {
+		utf8[0] = 0xf0 | (cp >> 18);
+		utf8[1] = 0x80 | ((cp >> 12) & 0x3f);
+		utf8[2] = 0x80 | ((cp >> 6) & 0x3f);
+		utf8[3] = 0x80 | (cp & 0x3f);
+		len = 4;
+	}
+
+	return json_stream_append(js, utf8, len);
+}
+
+/** Feed a chunk of JSON data to the parser
+ *
+ * The callback is called for each complete token in the chunk.  Partial
+ * tokens at the end of the chunk are buffered until the next call.
+ *
+ * Once the top level value is complete, only whitespace may follow it.
+ *
+ * @param[in] js	parser to feed.
+ * @param[in] in	chunk of JSON data.
+ * @param[in] inlen	Length of the chunk.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the data was invalid, or the callback returned an error.  All
+ *	  subsequent calls will also fail.
+ */
+int fr_json_stream_parse(fr_json_stream_t *js, char const *in, size_t inlen)
+{
+	char const *p = in, *end = p + inlen;
+
+	while (p < end) {
+		char const	*q;
+		uint8_t		c = *p;
+
+		switch (js->state) {
+		case JSON_STREAM_STRING:
+			if (js->high_surrogate && (c != '\\')) goto invalid_char;
+
+			for (q = p; (q < end) && (*q != '"') && (*q != '\\') && ((uint8_t)*q >= 0x20); q++);
+			if ((q > p) && (json_stream_append(js, p, q - p) < 0)) goto error;
+			p = q;
+			if (q == end) continue;
+
+			/*
+			 *	Control characters must be escaped.
+			 */
+			if ((uint8_t)*q < 0x20) goto invalid_char;
+
+			p = q + 1;
+			if (*q == '\\') {
+				js->state = JSON_STREAM_STRING_ESCAPE;
+				continue;
+			}
+			if (js->high_surrogate) goto invalid_char;
+			if (json_stream_token_done(js) < 0) goto error;
+			continue;
+
+		case JSON_STREAM_STRING_ESCAPE:
+		{
+			char unescaped;
+
+			if (js->high_surrogate && (c != 'u')) goto invalid_char;
+
+			switch (c) {
+			case '"':
+			case '\\':
+			case '/':
+				unescaped = c;
+				break;
+
+			case 'b':
+				unescaped = '\b';
+				break;
+
+			case 'f':
+				unescaped = '\f';
+				break;
+
+			case 'n':
+				unescaped = '\n';
+				break;
+
+			case 'r':
+				unescaped = '\r';
+				break;
+
+			case 't':
+				unescaped = '\t';
+				break;
+
+			case 'u':
+				js->unicode = 0;
+				js->unicode_digits = 0;
+				js->state = JSON_STREAM_STRING_UNICODE;
+				p++;
+				continue;
+
+			default:
+				goto invalid_char;
+			}
+
+			if (json_stream_append(js, &unescaped, 1) < 0) goto error;
+			js->state = JSON_STREAM_STRING;
+			p++;
+			continue;
+		}
+
+		case JSON_STREAM_STRING_UNICODE:
+			if ((c >= '0') && (c <= '9')) {
+				js->unicode = (js->unicode << 4) | (c - '0');
+			} else if ((c >= 'a') && (c <= 'f')) {
+				js->unicode = (js->unicode << 4) | (c - 'a' + 10);
+			} else if ((c >= 'A') && (c <= 'F')) {
+				js->unicode = (js->unicode << 4) | (c - 'A' + 10);
+			} else {
+				goto invalid_char;
+			}
+			p++;
+
+			if (++js->unicode_digits < 4) continue;
+			if (json_stream_unicode(js) < 0) goto error;
+			js->state = JSON_STREAM_STRING;
+			continue;
+
+		case JSON_STREAM_NUMBER:
+			for (q = p; (q < end) && (isdigit((uint8_t)*q) || (*q == '-') || (*q == '+') ||
+						  (*q == '.') || (*q == 'e') || (*q == 'E')); q++);
+			if ((q > p) && (json_stream_append(js, p, q - p) < 0)) goto error;
+			p = q;
+			if (q == end) continue;
+			if (json_stream_token_done(js) < 0) goto error;
+			continue;	/* Terminating char is processed in the new state */
+
+		case JSON_STREAM_LITERAL:
+			for (q = p; (q < end) && islower((uint8_t)*q); q++);
+			if ((q > p) && (json_stream_append(js, p, q - p) < 0)) goto error;
+			p = q;
+			if (q == end) continue;
+			if (json_stream_token_done(js) < 0) goto error;
+			continue;
+
+		case JSON_STREAM_ERROR:
+			fr_strerror_const("Parser is in an error state");
+			return -1;
+
+		default:
+			break;
+		}
+
+		/*
+		 *	Between tokens
+		 */
+		if ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r')) {
+			p++;
+			continue;
+		}
+
+		switch (js->state) {
+		case JSON_STREAM_VALUE_OR_END:
+			if (c == ']') goto array_end;
+			FALL_THROUGH;
+
+		case JSON_STREAM_VALUE:
+			switch (c) {
+			case '{':
+			case '[':
+				if (js->depth >= JSON_STREAM_MAX_DEPTH) {
+					fr_strerror_printf("Nesting exceeds maximum depth of %u", JSON_STREAM_MAX_DEPTH);
+					goto error;
+				}
+				if (json_stream_emit(js, (c == '{') ? FR_JSON_STREAM_OBJECT_START :
+								      FR_JSON_STREAM_ARRAY_START, NULL, 0) < 0) goto error;
+				js->is_object[js->depth++] = (c == '{');
+				js->state = (c == '{') ? JSON_STREAM_KEY_OR_END : JSON_STREAM_VALUE_OR_END;
+				break;
+
+			case '"':
+				js->is_key = false;
+				js->len = 0;
+				js->state = JSON_STREAM_STRING;
+				break;
+
+			case '-':
+			case '0':
+			case '1':
+			case '2':
+			case '3':
+			case '4':
+			case '5':
+			case '6':
+			case '7':
+			case '8':
+			case '9':
+				js->len = 0;
+				js->state = JSON_STREAM_NUMBER;
+				continue;	/* Don't consume, the number state will read it */
+
+			case 't':
+			case 'f':
+			case 'n':
+				js->len = 0;
+				js->state = JSON_STREAM_LITERAL;
+				continue;
+
+			default:
+				goto invalid_char;
+			}
+			break;
+
+		case JSON_STREAM_KEY_OR_END:
+			if (c == '}') goto object_end;
+			FALL_THROUGH;
+
+		case JSON_STREAM_KEY:
+			if (c != '"') goto invalid_char;
+			js->is_key = true;
+			js->len = 0;
+			js->state = JSON_STREAM_STRING;
+			break;
+
+		case JSON_STREAM_COLON:
+			if (c != ':') goto invalid_char;
+			js->state = JSON_STREAM_VALUE;
+			break;
+
+		case JSON_STREAM_COMMA_OR_END:
+			fr_assert(js->depth > 0);
+
+			if (c == ',') {
+				js->state = js->is_object[js->depth - 1] ? JSON_STREAM_KEY : JSON_STREAM_VALUE;
+				break;
+			}
+
+			if (js->is_object[js->depth - 1]) {
+				if (c != '}') goto invalid_char;
+
+			object_end:
+				js->depth--;
+				if (json_stream_emit(js, FR_JSON_STREAM_OBJECT_END, NULL, 0) < 0) goto error;
+			} else {
+				if (c != ']') goto invalid_char;
+
+			array_end:
+				js->depth--;
+				if (json_stream_emit(js, FR_JSON_STREAM_ARRAY_END, NULL, 0) < 0) goto error;
+			}
+			json_stream_value_done(js);
+			break;
+
+		case JSON_STREAM_DONE:
+			goto invalid_char;
+
+		default:
+			fr_assert(0);
+			goto error;
+		}
+		p++;
+	}
+
+	js->offset += inlen;
+
+	return 0;
+
+invalid_char:
+	if (isprint((uint8_t)*p)) {
+		fr_strerror_printf("Unexpected character '%c' at offset %zu", *p, js->offset + (p - in));
+	} else {
+		fr_strerror_printf("Unexpected byte 0x%02x at offset %zu", (uint8_t)*p, js->offset + (p - in));
+	}
+
+error:
+	js->state = JSON_STREAM_ERROR;
+	return -1;
+}
+
+/** Signal the end of the JSON data
+ *
+ * Completes any number or literal which was the top level value, and checks
+ * that the document was complete.
+ *
+ * @param[in] js	parser to finish.
+ * @return
+ *	- 1 if a complete document was parsed.
+ *	- 0 if the data contained no document (only whitespace).
+ *	- -1 if the document was incomplete or invalid.
+ */
+int fr_json_stream_finish(fr_json_stream_t *js)
+{
+	switch (js->state) {
+	case JSON_STREAM_DONE:
+		return 1;
+
+	case JSON_STREAM_VALUE:
+		if (js->depth == 0) return 0;
+		break;
+
+	case JSON_STREAM_NUMBER:
+	case JSON_STREAM_LITERAL:
+		if (js->depth > 0) break;
+
+		if (json_stream_token_done(js) < 0) {
+			js->state = JSON_STREAM_ERROR;
+			return -1;
+		}
+		return 1;
+
+	case JSON_STREAM_ERROR:
+		fr_strerror_const("Parser is in an error state");
+		return -1;
+
+	default:
+		break;
+	}
+
+	fr_strerror_printf("Unexpected end of JSON data at offset %zu", js->offset);
+	js->state = JSON_STREAM_ERROR;
+
+	return -1;
+}
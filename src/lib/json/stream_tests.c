@@ -0,0 +1,313 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the streaming JSON parser
+ *
+ * Every document is parsed whole, split in two at every offset, and one
+ * byte at a time, so that every token is split across chunks at every
+ * possible point.
+ *
+ * @file src/lib/json/stream_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "stream.c"
+
+/** Write each token to a string, so it can be compared with what we expect
+ *
+ * Containers are written as "{0 ", values as "S1:value ", with the depth
+ * after the type.
+ */
+static int test_token(fr_json_stream_event_t event, unsigned int depth, char const *value, size_t len, void *uctx)
+{
+	char		**out = uctx;
+	static char const types[] = {
+		[FR_JSON_STREAM_OBJECT_START] = '{',
+		[FR_JSON_STREAM_OBJECT_END] = '}',
+		[FR_JSON_STREAM_ARRAY_START] = '[',
+		[FR_JSON_STREAM_ARRAY_END] = ']',
+		[FR_JSON_STREAM_KEY] = 'K',
+		[FR_JSON_STREAM_STRING] = 'S',
+		[FR_JSON_STREAM_INT] = 'I',
+		[FR_JSON_STREAM_DOUBLE] = 'D',
+		[FR_JSON_STREAM_BOOL] = 'B',
+		[FR_JSON_STREAM_NULL] = 'N'
+	};
+
+	if (!value) {
+		*out = talloc_asprintf_append_buffer(*out, "%c%u ", types[event], depth);
+	} else {
+		TEST_CHECK(value[len] == '\0');
+		*out = talloc_asprintf_append_buffer(*out, "%c%u:%.*s ", types[event], depth, (int)len, value);
+	}
+
+	return 0;
+}
+
+static int test_token_abort(fr_json_stream_event_t event, UNUSED unsigned int depth,
+			    UNUSED char const *value, UNUSED size_t len, UNUSED void *uctx)
+{
+	return (event == FR_JSON_STREAM_STRING) ? -1 : 0;
+}
+
+/** Parse a document in chunks
+ *
+ * @param[out] out	tokens which were produced.
+ * @param[in] in	document to parse.
+ * @param[in] chunk	maximum size of each chunk after the first.
+ * @param[in] split	size of the first chunk.
+ * @return the result of fr_json_stream_finish(), or -1 if parsing failed.
+ */
+static int test_parse(char **out, char const *in, size_t split, size_t chunk)
+{
+	fr_json_stream_t	*js;
+	size_t			inlen = strlen(in), used;
+	int			ret;
+
+	*out = talloc_strdup(NULL, "");
+	js = fr_json_stream_alloc(*out, test_token, out);
+	TEST_ASSERT(js != NULL);
+
+	if (split > inlen) split = inlen;
+
+	ret = fr_json_stream_parse(js, in, split);
+	for (used = split; (ret == 0) && (used < inlen); used += chunk) {
+		ret = fr_json_stream_parse(js, in + used, ((inlen - used) < chunk) ? (inlen - used) : chunk);
+	}
+	if (ret < 0) return ret;
+
+	return fr_json_stream_finish(js);
+}
+
+/** Check a document produces the expected tokens, however it's split up
+ *
+ */
+static void test_expect(char const *in, char const *expected)
+{
+	size_t	inlen = strlen(in), split;
+	char	*out;
+
+	for (split = 0; split <= inlen; split++) {
+		TEST_CHECK(test_parse(&out, in, split, inlen) == 1);
+		TEST_MSG("Parsing %s split at %zu: %s", in, split, fr_strerror());
+		TEST_CHECK_STRCMP(out, expected);
+		talloc_free(out);
+	}
+
+	TEST_CHECK(test_parse(&out, in, 1, 1) == 1);
+	TEST_MSG("Parsing %s one byte at a time: %s", in, fr_strerror());
+	TEST_CHECK_STRCMP(out, expected);
+	talloc_free(out);
+}
+
+/** Check a document is rejected, however it's split up
+ *
+ */
+static void test_reject(char const *in)
+{
+	size_t	inlen = strlen(in), split;
+	char	*out;
+
+	for (split = 0; split <= inlen; split++) {
+		TEST_CHECK(test_parse(&out, in, split, inlen) < 0);
+		TEST_MSG("Parsing %s split at %zu succeeded, produced %s", in, split, out);
+		talloc_free(out);
+	}
+
+	TEST_CHECK(test_parse(&out, in, 1, 1) < 0);
+	TEST_MSG("Parsing %s one byte at a time succeeded, produced %s", in, out);
+	talloc_free(out);
+}
+
+static void test_containers(void)
+{
+	TEST_CASE("Objects and arrays");
+	test_expect("{\"a\":\"b\",\"c\":[1,{}],\"d\":{\"e\":[]}}",
+		    "{0 K1:a S1:b K1:c [1 I2:1 {2 }2 ]1 K1:d {1 K2:e [2 ]2 }1 }0 ");
+
+	TEST_CASE("Whitespace between tokens");
+	test_expect(" \t\r\n[ 1 , \"a\" ]\n", "[0 I1:1 S1:a ]0 ");
+
+	TEST_CASE("Literals");
+	test_expect("[true,false,null]", "[0 B1:true B1:false N1:null ]0 ");
+	test_expect("null", "N0:null ");
+}
+
+static void test_strings(void)
+{
+	TEST_CASE("Simple escapes split across chunks");
+	test_expect("[\"a\\\"b\\\\c\\/d\\b\\f\\n\\r\\te\"]", "[0 S1:a\"b\\c/d\b\f\n\r\te ]0 ");
+
+	TEST_CASE("Escapes in keys");
+	test_expect("{\"a\\tb\":1}", "{0 K1:a\tb I1:1 }0 ");
+
+	TEST_CASE("\\u escapes split across chunks");
+	test_expect("\"\\u0041\\u00e9\\u20AC\"", "S0:A\xc3\xa9\xe2\x82\xac ");
+
+	TEST_CASE("Surrogate pairs split across chunks");
+	test_expect("\"\\ud83d\\ude00x\"", "S0:\xf0\x9f\x98\x80x ");
+
+	TEST_CASE("UTF-8 passes through unchanged");
+	test_expect("\"\xc3\xa9\"", "S0:\xc3\xa9 ");
+}
+
+static void test_numbers(void)
+{
+	TEST_CASE("Integers and doubles in containers");
+	test_expect("[0,-1,12345,1.5,-0.25,1e3,1E+3,2.5e-10]",
+		    "[0 I1:0 I1:-1 I1:12345 D1:1.5 D1:-0.25 D1:1e3 D1:1E+3 D1:2.5e-10 ]0 ");
+
+	TEST_CASE("Numbers terminated by the end of a container");
+	test_expect("{\"a\":123}", "{0 K1:a I1:123 }0 ");
+
+	TEST_CASE("Top level numbers are completed by fr_json_stream_finish");
+	test_expect("12345", "I0:12345 ");
+	test_expect("-1.5e10", "D0:-1.5e10 ");
+	test_expect("7 ", "I0:7 ");
+}
+
+static void test_empty(void)
+{
+	char *out;
+
+	TEST_CASE("No data");
+	TEST_CHECK(test_parse(&out, "", 0, 1) == 0);
+	talloc_free(out);
+
+	TEST_CASE("Only whitespace");
+	TEST_CHECK(test_parse(&out, " \n\t ", 1, 1) == 0);
+	talloc_free(out);
+}
+
+static void test_invalid(void)
+{
+	char depth[JSON_STREAM_MAX_DEPTH + 2];
+
+	TEST_CASE("Raw control characters in strings");
+	test_reject("\"a\tb\"");
+	test_reject("[\"a\nb\"]");
+	test_reject("{\"a\x01\":1}");
+
+	TEST_CASE("Malformed numbers");
+	test_reject("1-2");
+	test_reject("[1-2]");
+	test_reject("1e");
+	test_reject("[1e]");
+	test_reject("1e+");
+	test_reject("1.");
+	test_reject("1.e5");
+	test_reject("1.2.3");
+	test_reject("01");
+	test_reject("-");
+	test_reject("--1");
+	test_reject("+1");
+	test_reject(".5");
+
+	TEST_CASE("Trailing data after the top level value");
+	test_reject("{} x");
+	test_reject("{}{}");
+	test_reject("[1]]");
+	test_reject("1 2");
+	test_reject("true false");
+	test_reject("\"a\"b");
+	test_reject("null,");
+
+	TEST_CASE("Invalid escapes");
+	test_reject("\"\\x\"");
+	test_reject("\"\\u12g4\"");
+	test_reject("\"\\u12\"");
+
+	TEST_CASE("Unpaired surrogates");
+	test_reject("\"\\ud83d\"");
+	test_reject("\"\\ud83dx\"");
+	test_reject("\"\\ud83d\\n\"");
+	test_reject("\"\\ud83d\\ud83d\"");
+	test_reject("\"\\ude00\"");
+
+	TEST_CASE("Invalid structure");
+	test_reject("[1,]");
+	test_reject("[,1]");
+	test_reject("{\"a\"}");
+	test_reject("{\"a\":}");
+	test_reject("{\"a\":1,}");
+	test_reject("{1:2}");
+	test_reject("{'a':1}");
+	test_reject("]");
+
+	TEST_CASE("Invalid literals");
+	test_reject("tru");
+	test_reject("truex");
+	test_reject("[nul]");
+	test_reject("True");
+
+	TEST_CASE("Incomplete documents");
+	test_reject("[");
+	test_reject("{\"a\":1");
+	test_reject("\"abc");
+	test_reject("\"\\u00");
+
+	TEST_CASE("Nesting too deep");
+	memset(depth, '[', sizeof(depth) - 1);
+	depth[sizeof(depth) - 1] = '\0';
+	test_reject(depth);
+}
+
+static void test_sticky_error(void)
+{
+	fr_json_stream_t	*js;
+	char			*out = talloc_strdup(NULL, "");
+
+	js = fr_json_stream_alloc(out, test_token, &out);
+	TEST_ASSERT(js != NULL);
+
+	TEST_CASE("Errors are sticky");
+	TEST_CHECK(fr_json_stream_parse(js, "[1-", 3) == 0);
+	TEST_CHECK(fr_json_stream_parse(js, "2]", 2) < 0);
+	TEST_CHECK(fr_json_stream_parse(js, "[]", 2) < 0);
+	TEST_CHECK(fr_json_stream_finish(js) < 0);
+
+	talloc_free(out);
+}
+
+static void test_callback_abort(void)
+{
+	fr_json_stream_t *js;
+
+	js = fr_json_stream_alloc(NULL, test_token_abort, NULL);
+	TEST_ASSERT(js != NULL);
+
+	TEST_CASE("The callback can stop parsing");
+	fr_strerror_clear();
+	TEST_CHECK(fr_json_stream_parse(js, "[1,\"a\",2]", 9) < 0);
+	TEST_CHECK_STRCMP(fr_strerror(), "Parsing aborted by callback");
+
+	talloc_free(js);
+}
+
+TEST_LIST = {
+	{ "containers",		test_containers },
+	{ "strings",		test_strings },
+	{ "numbers",		test_numbers },
+	{ "empty",		test_empty },
+	{ "invalid",		test_invalid },
+	{ "sticky_error",	test_sticky_error },
+	{ "callback_abort",	test_callback_abort },
+
+	{ NULL }
+};
@@ -0,0 +1,19 @@
+#
+#  Include the library's makefile for the json-c flags.  The tests
+#  include stream.c directly, so they don't link to the library.
+#
+TARGETNAME	:=
+-include $(top_builddir)/src/lib/json/all.mk
+SUBMAKEFILES	:=
+
+ifneq "$(TARGETNAME)" ""
+  TARGET	:= stream_tests$(E)
+endif
+
+SOURCES		:= stream_tests.c
+
+TGT_LDLIBS	+= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L)
+
+TGT_INSTALLDIR	:=
@@ -63,13 +63,20 @@ static int _kafka_conf_free(fr_kafka_conf_t *kc)
 	return 0;
 }
 
+/** Find or allocate the kafka configuration handle for a section
+ *
+ * Subsections such as "tls" or "sasl" don't get their own handle, they
+ * write their properties to the handle of the nearest parent which has one.
+ * The "server" item is always parsed first, so that's the section which
+ * ends up holding the handle.
+ */
 static inline CC_HINT(always_inline)
 fr_kafka_conf_t *kafka_conf_from_cs(CONF_SECTION *cs)
 {
 	CONF_DATA const	*cd;
 	fr_kafka_conf_t	*kc;
 
-	cd = cf_data_find(cs, fr_kafka_conf_t, "conf");
+	cd = cf_data_find_in_parent(cs, fr_kafka_conf_t, "conf");
 	if (cd) {
 		kc = cf_data_value(cd);
 	} else {
@@ -845,6 +852,8 @@ static conf_parser_t const kafka_metadata_config[] = {
 	  .uctx = &(fr_kafka_conf_ctx_t){ .property = "debug", .string_sep = "," }}, \
 	{ FR_CONF_FUNC("plugin", FR_TYPE_STRING, CONF_FLAG_MULTI, kafka_config_parse, NULL), \
 	  .uctx = &(fr_kafka_conf_ctx_t){ .property = "plugin.library.paths", .string_sep = ";" }}, \
+	{ FR_CONF_FUNC("mock_brokers", FR_TYPE_UINT32, CONF_FLAG_HIDDEN, kafka_config_parse, NULL), \
+	  .uctx = &(fr_kafka_conf_ctx_t){ .property = "test.mock.num.brokers" }}, \
 	{ FR_CONF_SUBSECTION_GLOBAL("metadata", 0, kafka_metadata_config) }, \
 	{ FR_CONF_SUBSECTION_GLOBAL("version", 0, kafka_version_config) }, \
 	{ FR_CONF_SUBSECTION_GLOBAL("connection", 0, kafka_connection_config) }, \
@@ -941,7 +950,7 @@ conf_parser_t const kafka_base_consumer_config[] = {
 	 *	Toggle auto commit
 	 */
 	{ FR_CONF_FUNC("auto_commit", FR_TYPE_BOOL, 0, kafka_config_parse, kafka_config_dflt),
-	  .uctx = &(fr_kafka_conf_ctx_t){ .property = "enable_auto.commit" }},
+	  .uctx = &(fr_kafka_conf_ctx_t){ .property = "enable.auto.commit" }},
 
 	/*
 	 *	Auto commit interval
@@ -1165,6 +1174,12 @@ conf_parser_t const kafka_base_producer_config[] = {
 	{ FR_CONF_FUNC("compression_type", FR_TYPE_STRING, 0, kafka_config_parse, kafka_config_dflt),
 	  .uctx = &(fr_kafka_conf_ctx_t){ .property = "compression.type" }},
 
+	/*
+	 *	Maximum number of messages batched in one MessageSet
+	 */
+	{ FR_CONF_FUNC("batch_max_messages", FR_TYPE_UINT32, 0, kafka_config_parse, kafka_config_dflt),
+	  .uctx = &(fr_kafka_conf_ctx_t){ .property = "batch.num.messages" }},
+
 	/*
 	 *	Maximum size (in bytes) of all messages batched in one MessageSet
 	 */
@@ -1181,3 +1196,42 @@ conf_parser_t const kafka_base_producer_config[] = {
 
 	CONF_PARSER_TERMINATOR
 };
+
+/** Return a copy of the kafka configuration handle built from a section
+ *
+ * @param[in] cs	which was parsed with #kafka_base_producer_config
+ *			or #kafka_base_consumer_config.
+ * @return
+ *	- A new configuration handle, which the caller must free, or pass to rd_kafka_new().
+ *	- NULL if no configuration was parsed from the section.
+ */
+rd_kafka_conf_t *kafka_base_conf_dup(CONF_SECTION const *cs)
+{
+	CONF_DATA const	*cd;
+	fr_kafka_conf_t	*kc;
+
+	cd = cf_data_find(cs, fr_kafka_conf_t, "conf");
+	if (!cd) return NULL;
+
+	kc = cf_data_value(cd);
+	return rd_kafka_conf_dup(kc->conf);
+}
+
+/** Return a copy of the kafka topic configuration handle built from a topic section
+ *
+ * @param[in] cs	a subsection of "topic".
+ * @return
+ *	- A new topic configuration handle, which the caller must free, or pass to rd_kafka_topic_new().
+ *	- NULL if no configuration was parsed from the section.
+ */
+rd_kafka_topic_conf_t *kafka_base_topic_conf_dup(CONF_SECTION const *cs)
+{
+	CONF_DATA const		*cd;
+	fr_kafka_topic_conf_t	*ktc;
+
+	cd = cf_data_find(cs, fr_kafka_topic_conf_t, "conf");
+	if (!cd) return NULL;
+
+	ktc = cf_data_value(cd);
+	return rd_kafka_topic_conf_dup(ktc->conf);
+}
@@ -45,6 +45,10 @@ extern "C" {
 extern conf_parser_t const kafka_base_consumer_config[];
 extern conf_parser_t const kafka_base_producer_config[];
 
+rd_kafka_conf_t		*kafka_base_conf_dup(CONF_SECTION const *cs);
+
+rd_kafka_topic_conf_t	*kafka_base_topic_conf_dup(CONF_SECTION const *cs);
+
 #ifdef __cplusplus
 }
 #endif
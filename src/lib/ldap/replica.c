@@ -0,0 +1,607 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file lib/ldap/replica.c
+ * @brief Local replicas of directory subtrees, kept up to date by ldap_sync
+ *
+ * A replica is a named, process wide, set of directory entries.  It is written
+ * to by a proto_ldap_sync listener as it receives changes from the directory,
+ * and read by modules (rlm_ldap) which would otherwise have to search the
+ * directory for the same entries.
+ *
+ * Entries are the LDAPMessages received by the listener.  Readers take a
+ * reference to an entry, so that an entry being replaced or deleted remains
+ * valid until the last reader has finished with it.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+USES_APPLE_DEPRECATED_API
+
+#include <freeradius-devel/ldap/replica.h>
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/** A single directory entry held in a replica
+ *
+ */
+struct fr_ldap_replica_entry_s {
+	fr_dlist_t		entry;				//!< Entry in the list of all replica entries.
+	atomic_uint_fast32_t	refs;				//!< One for the replica, and one for each reader.
+
+	LDAPMessage		*msg;				//!< The entry, as received from the directory.
+	char			*dn;				//!< DN of the entry, as returned by the directory.
+	char			*dn_norm;			//!< Normalised DN, used for lookups.
+	char			*key;				//!< First value of the key attribute, may be NULL.
+
+	uint8_t			uuid[FR_LDAP_REPLICA_UUID_LENGTH];	//!< entryUUID of the entry.
+	bool			has_uuid;			//!< Whether uuid is valid.
+
+	uint64_t		generation;			//!< Refresh the entry was last sent or marked
+								///< present in.
+};
+
+/** A named replica
+ *
+ */
+struct fr_ldap_replica_s {
+	fr_dlist_t		entry;				//!< Entry in the global list of replicas.
+
+	char const		*name;				//!< Name the replica was registered with.
+	char const		*key_attr;			//!< Attribute entries are indexed by.
+
+	pthread_rwlock_t	lock;				//!< Protects the indexes below.
+
+	fr_hash_table_t		*by_key;			//!< Entries indexed by key_attr value.
+	fr_hash_table_t		*by_dn;				//!< Entries indexed by normalised DN.
+	fr_hash_table_t		*by_uuid;			//!< Entries indexed by entryUUID.
+	fr_dlist_head_t		all;				//!< All entries in the replica.
+
+	uint64_t		generation;			//!< Incremented each time a refresh starts.
+};
+
+static pthread_mutex_t	replica_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_dlist_head_t	replica_list;
+static bool		replica_list_init;
+
+static uint32_t replica_key_hash(void const *data)
+{
+	fr_ldap_replica_entry_t const *e = data;
+
+	return fr_hash_case_string(e->key);
+}
+
+static int8_t replica_key_cmp(void const *one, void const *two)
+{
+	fr_ldap_replica_entry_t const *a = one, *b = two;
+
+	return CMP(strcasecmp(a->key, b->key), 0);
+}
+
+static uint32_t replica_dn_hash(void const *data)
+{
+	fr_ldap_replica_entry_t const *e = data;
+
+	return fr_hash_case_string(e->dn_norm);
+}
+
+static int8_t replica_dn_cmp(void const *one, void const *two)
+{
+	fr_ldap_replica_entry_t const *a = one, *b = two;
+
+	return CMP(strcasecmp(a->dn_norm, b->dn_norm), 0);
+}
+
+static uint32_t replica_uuid_hash(void const *data)
+{
+	fr_ldap_replica_entry_t const *e = data;
+
+	return fr_hash(e->uuid, sizeof(e->uuid));
+}
+
+static int8_t replica_uuid_cmp(void const *one, void const *two)
+{
+	fr_ldap_replica_entry_t const *a = one, *b = two;
+
+	return CMP(memcmp(a->uuid, b->uuid, sizeof(a->uuid)), 0);
+}
+
+static int _replica_entry_free(fr_ldap_replica_entry_t *e)
+{
+	if (e->msg) ldap_msgfree(e->msg);
+
+	return 0;
+}
+
+/** Drop a reference to an entry, freeing it if it was the last one
+ *
+ * @param[in] e	to release.
+ */
+void fr_ldap_replica_release(fr_ldap_replica_entry_t *e)
+{
+	if (!e) return;
+
+	if (atomic_fetch_sub_explicit(&e->refs, 1, memory_order_acq_rel) == 1) talloc_free(e);
+}
+
+/** Remove an entry from all indexes, and drop the replica's reference to it
+ *
+ * Must be called with the write lock held.
+ */
+static void replica_entry_remove(fr_ldap_replica_t *replica, fr_ldap_replica_entry_t *e)
+{
+	/*
+	 *	A newer entry may have taken over the key,
+	 *	don't remove that one from the index.
+	 */
+	if (e->key && (fr_hash_table_find(replica->by_key, e) == e)) fr_hash_table_remove(replica->by_key, e);
+	if (fr_hash_table_find(replica->by_dn, e) == e) fr_hash_table_remove(replica->by_dn, e);
+	if (e->has_uuid) fr_hash_table_remove(replica->by_uuid, e);
+	fr_dlist_remove(&replica->all, e);
+
+	fr_ldap_replica_release(e);
+}
+
+static int _replica_free(fr_ldap_replica_t *replica)
+{
+	fr_ldap_replica_entry_t *e;
+
+	while ((e = fr_dlist_pop_head(&replica->all))) fr_ldap_replica_release(e);
+	pthread_rwlock_destroy(&replica->lock);
+
+	return 0;
+}
+
+static int _replica_list_free(UNUSED void *uctx)
+{
+	fr_ldap_replica_t *replica;
+
+	pthread_mutex_lock(&replica_mutex);
+	while ((replica = fr_dlist_pop_head(&replica_list))) talloc_free(replica);
+	replica_list_init = false;
+	pthread_mutex_unlock(&replica_mutex);
+
+	return 0;
+}
+
+/** Find or create a named replica
+ *
+ * The listener feeding the replica, and the modules reading from it, all call
+ * this function with the same name.  Whichever gets there first creates it.
+ *
+ * @param[in] name	of the replica.
+ * @return
+ *	- The replica.
+ *	- NULL on error.
+ */
+fr_ldap_replica_t *fr_ldap_replica_get(char const *name)
+{
+	fr_ldap_replica_t	*replica = NULL;
+	int			ret;
+
+	pthread_mutex_lock(&replica_mutex);
+	if (!replica_list_init) {
+		fr_dlist_talloc_init(&replica_list, fr_ldap_replica_t, entry);
+		fr_atexit_global(_replica_list_free, NULL);
+		replica_list_init = true;
+	}
+
+	while ((replica = fr_dlist_next(&replica_list, replica))) {
+		if (strcmp(replica->name, name) == 0) goto done;
+	}
+
+	/*
+	 *	Not parented by any module, as the replica
+	 *	is shared between the listener and modules.
+	 */
+	MEM(replica = talloc_zero(NULL, fr_ldap_replica_t));
+	replica->name = talloc_strdup(replica, name);
+	fr_dlist_talloc_init(&replica->all, fr_ldap_replica_entry_t, entry);
+
+	replica->by_key = fr_hash_table_alloc(replica, replica_key_hash, replica_key_cmp, NULL);
+	replica->by_dn = fr_hash_table_alloc(replica, replica_dn_hash, replica_dn_cmp, NULL);
+	replica->by_uuid = fr_hash_table_alloc(replica, replica_uuid_hash, replica_uuid_cmp, NULL);
+	if (!replica->by_key || !replica->by_dn || !replica->by_uuid) {
+		fr_strerror_printf("Failed allocating indexes for LDAP replica \"%s\"", name);
+	error:
+		talloc_free(replica);
+		replica = NULL;
+		goto done;
+	}
+
+	ret = pthread_rwlock_init(&replica->lock, NULL);
+	if (ret != 0) {
+		fr_strerror_printf("Failed initialising lock for LDAP replica \"%s\": %s", name, fr_syserror(ret));
+		goto error;
+	}
+	talloc_set_destructor(replica, _replica_free);
+
+	fr_dlist_insert_tail(&replica_list, replica);
+
+done:
+	pthread_mutex_unlock(&replica_mutex);
+
+	return replica;
+}
+
+/** Set the attribute the replica is indexed by
+ *
+ * @param[in] replica	to set the key for.
+ * @param[in] key_attr	Attribute whose first value is used as the key.
+ * @return
+ *	- 0 on success.
+ *	- -1 if a different key has already been set.
+ */
+int fr_ldap_replica_key_set(fr_ldap_replica_t *replica, char const *key_attr)
+{
+	int ret = 0;
+
+	pthread_rwlock_wrlock(&replica->lock);
+	if (!replica->key_attr) {
+		replica->key_attr = talloc_strdup(replica, key_attr);
+	} else if (strcasecmp(replica->key_attr, key_attr) != 0) {
+		fr_strerror_printf("LDAP replica \"%s\" is already keyed by \"%s\"", replica->name, replica->key_attr);
+		ret = -1;
+	}
+	pthread_rwlock_unlock(&replica->lock);
+
+	return ret;
+}
+
+/** Add an entry to the replica, replacing any previous version of it
+ *
+ * @param[in] replica	to update.
+ * @param[in] uuid	entryUUID of the entry, may be NULL.
+ * @param[in] msg	the entry.  Ownership passes to the replica,
+ *			regardless of whether the update succeeds.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_ldap_replica_update(fr_ldap_replica_t *replica, uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH],
+			   LDAPMessage *msg)
+{
+	LDAP			*handle = fr_ldap_handle_thread_local();
+	fr_ldap_replica_entry_t	*e, *old;
+	char			*dn;
+	struct berval		**values = NULL;
+
+	MEM(e = talloc_zero(NULL, fr_ldap_replica_entry_t));
+	e->msg = msg;
+	talloc_set_destructor(e, _replica_entry_free);
+	atomic_init(&e->refs, 1);
+
+	dn = ldap_get_dn(handle, msg);
+	if (!dn) {
+		int ldap_errno;
+
+		ldap_get_option(handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
+		fr_strerror_printf("Retrieving object DN from entry failed: %s", ldap_err2string(ldap_errno));
+	error:
+		talloc_free(e);
+		return -1;
+	}
+	e->dn = talloc_strdup(e, dn);
+	ldap_memfree(dn);
+
+	MEM(e->dn_norm = talloc_array(e, char, talloc_array_length(e->dn)));
+	fr_ldap_util_normalise_dn(e->dn_norm, e->dn);
+
+	if (uuid) {
+		memcpy(e->uuid, uuid, sizeof(e->uuid));
+		e->has_uuid = true;
+	}
+
+	pthread_rwlock_wrlock(&replica->lock);
+	e->generation = replica->generation;
+	if (replica->key_attr) values = ldap_get_values_len(handle, msg, replica->key_attr);
+	if (values) {
+		if (values[0] && (values[0]->bv_len > 0)) {
+			e->key = talloc_bstrndup(e, values[0]->bv_val, values[0]->bv_len);
+		}
+		ldap_value_free_len(values);
+	}
+
+	/*
+	 *	Remove the previous version of the entry.  A renamed
+	 *	entry keeps its UUID, so look that up first.
+	 */
+	if (e->has_uuid && (old = fr_hash_table_find(replica->by_uuid, e))) replica_entry_remove(replica, old);
+	if ((old = fr_hash_table_find(replica->by_dn, e))) replica_entry_remove(replica, old);
+
+	if ((e->has_uuid && !fr_hash_table_insert(replica->by_uuid, e)) ||
+	    !fr_hash_table_insert(replica->by_dn, e)) {
+		fr_hash_table_remove(replica->by_uuid, e);
+		pthread_rwlock_unlock(&replica->lock);
+		fr_strerror_printf("Failed indexing entry \"%s\"", e->dn);
+		goto error;
+	}
+	if (e->key) {
+		void *prev;
+
+		/*
+		 *	If two entries share a key the most recently
+		 *	updated one wins.
+		 */
+		(void) fr_hash_table_replace(&prev, replica->by_key, e);
+	}
+	fr_dlist_insert_tail(&replica->all, e);
+	pthread_rwlock_unlock(&replica->lock);
+
+	return 0;
+}
+
+/** Remove an entry from the replica
+ *
+ * @param[in] replica	to remove the entry from.
+ * @param[in] uuid	entryUUID of the entry.  May be NULL if dn is provided.
+ * @param[in] dn	DN of the entry.  May be NULL if uuid is provided.
+ */
+void fr_ldap_replica_delete(fr_ldap_replica_t *replica, uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH],
+			    char const *dn)
+{
+	fr_ldap_replica_entry_t	find = {}, *old;
+	char			*dn_norm = NULL;
+
+	if (uuid) memcpy(find.uuid, uuid, sizeof(find.uuid));
+	if (dn) {
+		MEM(dn_norm = talloc_array(NULL, char, strlen(dn) + 1));
+		fr_ldap_util_normalise_dn(dn_norm, dn);
+		find.dn_norm = dn_norm;
+	}
+
+	pthread_rwlock_wrlock(&replica->lock);
+	if (uuid && (old = fr_hash_table_find(replica->by_uuid, &find))) replica_entry_remove(replica, old);
+	if (dn && (old = fr_hash_table_find(replica->by_dn, &find))) replica_entry_remove(replica, old);
+	pthread_rwlock_unlock(&replica->lock);
+
+	talloc_free(dn_norm);
+}
+
+/** Remove all entries from the replica
+ *
+ * Used when the directory tells us our copy can't be brought up to date
+ * incrementally.  Until the refresh completes, lookups fall back to
+ * searching the directory.
+ *
+ * @param[in] replica	to flush.
+ */
+void fr_ldap_replica_flush(fr_ldap_replica_t *replica)
+{
+	fr_ldap_replica_entry_t *e;
+
+	pthread_rwlock_wrlock(&replica->lock);
+	while ((e = fr_dlist_head(&replica->all))) replica_entry_remove(replica, e);
+	pthread_rwlock_unlock(&replica->lock);
+}
+
+/** Record the start of a refresh
+ *
+ * Entries received or marked present after this call belong to the new
+ * refresh.  Any which aren't are removed by #fr_ldap_replica_refresh_present_done.
+ *
+ * @param[in] replica	being refreshed.
+ */
+void fr_ldap_replica_refresh_start(fr_ldap_replica_t *replica)
+{
+	pthread_rwlock_wrlock(&replica->lock);
+	replica->generation++;
+	pthread_rwlock_unlock(&replica->lock);
+}
+
+/** Mark an unchanged entry as still present in the directory
+ *
+ * @param[in] replica	containing the entry.
+ * @param[in] uuid	entryUUID of the entry.
+ */
+void fr_ldap_replica_present(fr_ldap_replica_t *replica, uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH])
+{
+	fr_ldap_replica_entry_t	find = {}, *e;
+
+	memcpy(find.uuid, uuid, sizeof(find.uuid));
+
+	pthread_rwlock_wrlock(&replica->lock);
+	e = fr_hash_table_find(replica->by_uuid, &find);
+	if (e) e->generation = replica->generation;
+	pthread_rwlock_unlock(&replica->lock);
+}
+
+/** Remove entries which weren't sent or marked present during the current refresh
+ *
+ * Called at the end of the RFC 4533 present phase.  The directory has now
+ * told us about every entry which matches the sync, so anything else
+ * has been deleted, or no longer matches.
+ *
+ * @param[in] replica	being refreshed.
+ * @return The number of entries removed.
+ */
+uint32_t fr_ldap_replica_refresh_present_done(fr_ldap_replica_t *replica)
+{
+	fr_ldap_replica_entry_t	*e, *next;
+	uint32_t		removed = 0;
+
+	pthread_rwlock_wrlock(&replica->lock);
+	for (e = fr_dlist_head(&replica->all); e; e = next) {
+		next = fr_dlist_next(&replica->all, e);
+		if (e->generation == replica->generation) continue;
+
+		replica_entry_remove(replica, e);
+		removed++;
+	}
+	pthread_rwlock_unlock(&replica->lock);
+
+	return removed;
+}
+
+/** Return the number of entries in the replica
+ *
+ */
+uint32_t fr_ldap_replica_num_entries(fr_ldap_replica_t *replica)
+{
+	uint32_t num;
+
+	pthread_rwlock_rdlock(&replica->lock);
+	num = fr_dlist_num_elements(&replica->all);
+	pthread_rwlock_unlock(&replica->lock);
+
+	return num;
+}
+
+/** Find an entry by the value of the key attribute
+ *
+ * The entry must be released with #fr_ldap_replica_release once the caller
+ * has finished with it.
+ *
+ * @param[in] replica	to search.
+ * @param[in] key	value of the key attribute.
+ * @return
+ *	- The entry.
+ *	- NULL if the replica contains no entry with that key.
+ */
+fr_ldap_replica_entry_t *fr_ldap_replica_acquire(fr_ldap_replica_t *replica, char const *key)
+{
+	fr_ldap_replica_entry_t	find = { .key = UNCONST(char *, key) }, *e;
+
+	pthread_rwlock_rdlock(&replica->lock);
+	e = fr_hash_table_find(replica->by_key, &find);
+	if (e) atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed);
+	pthread_rwlock_unlock(&replica->lock);
+
+	return e;
+}
+
+/** Find an entry by DN
+ *
+ * The entry must be released with #fr_ldap_replica_release once the caller
+ * has finished with it.
+ *
+ * @param[in] replica	to search.
+ * @param[in] dn	of the entry.
+ * @return
+ *	- The entry.
+ *	- NULL if the replica contains no entry with that DN.
+ */
+fr_ldap_replica_entry_t *fr_ldap_replica_acquire_by_dn(fr_ldap_replica_t *replica, char const *dn)
+{
+	fr_ldap_replica_entry_t	find = {}, *e;
+	char			*dn_norm;
+
+	MEM(dn_norm = talloc_array(NULL, char, strlen(dn) + 1));
+	fr_ldap_util_normalise_dn(dn_norm, dn);
+	find.dn_norm = dn_norm;
+
+	pthread_rwlock_rdlock(&replica->lock);
+	e = fr_hash_table_find(replica->by_dn, &find);
+	if (e) atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed);
+	pthread_rwlock_unlock(&replica->lock);
+
+	talloc_free(dn_norm);
+
+	return e;
+}
+
+/** Check whether a search would have returned an entry
+ *
+ * DNs are compared after normalisation, but without regard to the schema,
+ * so DNs which differ only in spacing are treated as different.  This
+ * errs on the side of the entry not being in scope.
+ *
+ * @param[in] e		to check.
+ * @param[in] base_dn	of the search.
+ * @param[in] scope	of the search, one of the LDAP_SCOPE_* values.
+ * @return
+ *	- true if the entry is within the scope of the search.
+ *	- false if it isn't.
+ */
+bool fr_ldap_replica_entry_in_scope(fr_ldap_replica_entry_t const *e, char const *base_dn, int scope)
+{
+	char		*base;
+	size_t		base_len, dn_len, prefix_len, i;
+	unsigned int	separators = 0;
+	bool		ret = false;
+
+	MEM(base = talloc_array(NULL, char, strlen(base_dn) + 1));
+	base_len = fr_ldap_util_normalise_dn(base, base_dn);
+	dn_len = strlen(e->dn_norm);
+
+	/*
+	 *	The entry is the base object.
+	 */
+	if ((dn_len == base_len) && (strcasecmp(e->dn_norm, base) == 0)) {
+		ret = (scope == LDAP_SCOPE_BASE) || (scope == LDAP_SCOPE_SUBTREE);
+		goto finish;
+	}
+
+	if (scope == LDAP_SCOPE_BASE) goto finish;
+
+	/*
+	 *	The entry must end with ",<base>", or anything
+	 *	is below an empty base.
+	 */
+	if (base_len > 0) {
+		if ((dn_len <= base_len + 1) || (strcasecmp(e->dn_norm + dn_len - base_len, base) != 0) ||
+		    (e->dn_norm[dn_len - base_len - 1] != ',')) goto finish;
+		prefix_len = dn_len - base_len - 1;
+	} else {
+		prefix_len = dn_len;
+	}
+
+	/*
+	 *	Count the RDNs above the base, and make sure the
+	 *	separating ',' isn't escaped.
+	 */
+	for (i = 0; i < prefix_len; i++) {
+		if (e->dn_norm[i] == '\\') {
+			if (++i >= prefix_len) goto finish;
+			continue;
+		}
+		if (e->dn_norm[i] == ',') separators++;
+	}
+
+	ret = (scope != LDAP_SCOPE_ONELEVEL) || (separators == 0);
+
+finish:
+	talloc_free(base);
+
+	return ret;
+}
+
+/** Return the LDAPMessage for an entry
+ *
+ * The message can be passed to any function expecting a search result entry.
+ */
+LDAPMessage *fr_ldap_replica_entry_msg(fr_ldap_replica_entry_t const *e)
+{
+	return e->msg;
+}
+
+/** Return the DN of an entry
+ *
+ */
+char const *fr_ldap_replica_entry_dn(fr_ldap_replica_entry_t const *e)
+{
+	return e->dn;
+}
@@ -0,0 +1,75 @@
+#pragma once
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file lib/ldap/replica.h
+ *
+ * @brief Local replicas of directory subtrees, kept up to date by ldap_sync
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(lib_ldap_replica_h, "$Id$")
+
+#include <freeradius-devel/ldap/base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FR_LDAP_REPLICA_UUID_LENGTH	16		//!< entryUUID values are always 16 bytes.
+
+typedef struct fr_ldap_replica_s fr_ldap_replica_t;
+typedef struct fr_ldap_replica_entry_s fr_ldap_replica_entry_t;
+
+fr_ldap_replica_t	*fr_ldap_replica_get(char const *name);
+
+int			fr_ldap_replica_key_set(fr_ldap_replica_t *replica, char const *key_attr);
+
+int			fr_ldap_replica_update(fr_ldap_replica_t *replica,
+					       uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH], LDAPMessage *msg);
+
+void			fr_ldap_replica_delete(fr_ldap_replica_t *replica,
+					       uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH], char const *dn);
+
+void			fr_ldap_replica_flush(fr_ldap_replica_t *replica);
+
+void			fr_ldap_replica_refresh_start(fr_ldap_replica_t *replica);
+
+void			fr_ldap_replica_present(fr_ldap_replica_t *replica,
+						uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH]);
+
+uint32_t		fr_ldap_replica_refresh_present_done(fr_ldap_replica_t *replica);
+
+uint32_t		fr_ldap_replica_num_entries(fr_ldap_replica_t *replica);
+
+fr_ldap_replica_entry_t	*fr_ldap_replica_acquire(fr_ldap_replica_t *replica, char const *key);
+
+fr_ldap_replica_entry_t	*fr_ldap_replica_acquire_by_dn(fr_ldap_replica_t *replica, char const *dn);
+
+bool			fr_ldap_replica_entry_in_scope(fr_ldap_replica_entry_t const *entry,
+						       char const *base_dn, int scope);
+
+LDAPMessage		*fr_ldap_replica_entry_msg(fr_ldap_replica_entry_t const *entry);
+
+char const		*fr_ldap_replica_entry_dn(fr_ldap_replica_entry_t const *entry);
+
+void			fr_ldap_replica_release(fr_ldap_replica_entry_t *entry);
+
+#ifdef __cplusplus
+}
+#endif
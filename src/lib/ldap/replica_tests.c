@@ -0,0 +1,398 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for local replicas of directory subtrees
+ *
+ * The entries are read from the directory used by the ldap module tests
+ * (src/tests/modules/ldap/example.com.ldif), and fed to the replica in the
+ * same way as the ldap_sync listener does.  If LDAP_TEST_SERVER isn't set,
+ * the tests do nothing.
+ *
+ * @file src/lib/ldap/replica_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/ldap/replica.h>
+#include <freeradius-devel/server/base.h>
+
+#define JOHN_DN		"uid=john,ou=people,dc=example,dc=com"
+#define PETER_DN	"uid=peter,ou=people,dc=example,dc=com"
+#define ADMINUSER_DN	"uid=adminuser,ou=people,dc=example,dc=com"
+
+static uint8_t const	john_uuid[FR_LDAP_REPLICA_UUID_LENGTH] = { 0x01 };
+static uint8_t const	peter_uuid[FR_LDAP_REPLICA_UUID_LENGTH] = { 0x02 };
+static uint8_t const	adminuser_uuid[FR_LDAP_REPLICA_UUID_LENGTH] = { 0x03 };
+
+static LDAP		*ld;
+
+static void test_init(void)
+{
+	char const	*server, *port;
+	char		uri[256];
+	int		version = LDAP_VERSION3;
+	struct berval	cred = { .bv_val = UNCONST(char *, "secret"), .bv_len = 6 };
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("replica_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	server = getenv("LDAP_TEST_SERVER");
+	if (!server) return;
+
+	port = getenv("LDAP_TEST_SERVER_PORT");
+	snprintf(uri, sizeof(uri), "ldap://%s:%s", server, port ? port : "389");
+
+	if ((ldap_initialize(&ld, uri) != LDAP_SUCCESS) ||
+	    (ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION, &version) != LDAP_OPT_SUCCESS) ||
+	    (ldap_sasl_bind_s(ld, "cn=admin,dc=example,dc=com", LDAP_SASL_SIMPLE, &cred, NULL, NULL, NULL) != LDAP_SUCCESS)) {
+		fprintf(stderr, "replica_tests: Failed connecting to %s\n", uri);
+		fr_exit_now(EXIT_FAILURE);
+	}
+}
+
+/** Read a single entry from the directory
+ *
+ * The returned message isn't part of a chain, so it can be handed to the replica.
+ */
+static LDAPMessage *test_entry(char const *dn)
+{
+	LDAPMessage	*msg = NULL, *result = NULL;
+	int		msgid;
+
+	if (ldap_search_ext(ld, dn, LDAP_SCOPE_BASE, "(objectClass=*)", NULL, 0,
+			    NULL, NULL, NULL, 0, &msgid) != LDAP_SUCCESS) return NULL;
+
+	if (ldap_result(ld, msgid, LDAP_MSG_ONE, NULL, &msg) != LDAP_RES_SEARCH_ENTRY) {
+		ldap_msgfree(msg);
+		return NULL;
+	}
+
+	/*
+	 *	Discard the search result which follows the entry.
+	 */
+	if (ldap_result(ld, msgid, LDAP_MSG_ALL, NULL, &result) > 0) ldap_msgfree(result);
+
+	return msg;
+}
+
+/** Add an entry from the directory to a replica
+ *
+ */
+static void test_update(fr_ldap_replica_t *replica, uint8_t const uuid[FR_LDAP_REPLICA_UUID_LENGTH], char const *dn)
+{
+	LDAPMessage *msg;
+
+	msg = test_entry(dn);
+	if (!TEST_CHECK(msg != NULL)) {
+		TEST_MSG("Failed reading \"%s\" from the directory", dn);
+		return;
+	}
+
+	TEST_CHECK(fr_ldap_replica_update(replica, uuid, msg) == 0);
+}
+
+/** Create an empty replica keyed by uid
+ *
+ * Each test uses its own replica, so they can be run in any order.
+ */
+static fr_ldap_replica_t *test_replica(char const *name)
+{
+	fr_ldap_replica_t *replica;
+
+	replica = fr_ldap_replica_get(name);
+	TEST_ASSERT(replica != NULL);
+	TEST_CHECK(fr_ldap_replica_key_set(replica, "uid") == 0);
+
+	fr_ldap_replica_flush(replica);
+
+	return replica;
+}
+
+/** Check whether a replica entry is the one with a given DN
+ *
+ */
+static bool test_entry_is(fr_ldap_replica_entry_t *e, char const *dn)
+{
+	return e && (strcmp(fr_ldap_replica_entry_dn(e), dn) == 0);
+}
+
+/** Entries can be found by key and by DN
+ *
+ */
+static void test_index(void)
+{
+	fr_ldap_replica_t	*replica;
+	fr_ldap_replica_entry_t	*e, *by_dn;
+
+	if (!ld) return;
+
+	replica = test_replica("index");
+	test_update(replica, john_uuid, JOHN_DN);
+	test_update(replica, peter_uuid, PETER_DN);
+	TEST_CHECK(fr_ldap_replica_num_entries(replica) == 2);
+
+	TEST_CASE("Lookup by key");
+	e = fr_ldap_replica_acquire(replica, "john");
+	TEST_CHECK(test_entry_is(e, JOHN_DN));
+
+	TEST_CASE("Key lookups are case insensitive");
+	by_dn = fr_ldap_replica_acquire(replica, "JOHN");
+	TEST_CHECK(by_dn == e);
+	fr_ldap_replica_release(by_dn);
+
+	TEST_CASE("Lookup by DN finds the same entry");
+	by_dn = fr_ldap_replica_acquire_by_dn(replica, "UID=john,ou=people,dc=example,dc=com");
+	TEST_CHECK(by_dn == e);
+	fr_ldap_replica_release(by_dn);
+	fr_ldap_replica_release(e);
+
+	TEST_CASE("Unknown keys and DNs aren't found");
+	TEST_CHECK(fr_ldap_replica_acquire(replica, "nobody") == NULL);
+	TEST_CHECK(fr_ldap_replica_acquire_by_dn(replica, "uid=nobody,ou=people,dc=example,dc=com") == NULL);
+
+	TEST_CASE("Updating an entry replaces it");
+	e = fr_ldap_replica_acquire(replica, "peter");
+	test_update(replica, peter_uuid, PETER_DN);
+	TEST_CHECK(fr_ldap_replica_num_entries(replica) == 2);
+
+	by_dn = fr_ldap_replica_acquire(replica, "peter");
+	TEST_CHECK(test_entry_is(by_dn, PETER_DN));
+	TEST_CHECK(by_dn != e);
+	fr_ldap_replica_release(by_dn);
+	fr_ldap_replica_release(e);
+
+	fr_ldap_replica_flush(replica);
+}
+
+/** Entries stay usable by readers after they've been removed from the replica
+ *
+ */
+static void test_refcount(void)
+{
+	fr_ldap_replica_t	*replica;
+	fr_ldap_replica_entry_t	*e;
+	struct berval		**values;
+
+	if (!ld) return;
+
+	replica = test_replica("refcount");
+	test_update(replica, john_uuid, JOHN_DN);
+
+	e = fr_ldap_replica_acquire(replica, "john");
+	TEST_ASSERT(e != NULL);
+
+	TEST_CASE("Deleting an entry removes it from the indexes");
+	fr_ldap_replica_delete(replica, john_uuid, NULL);
+	TEST_CHECK(fr_ldap_replica_num_entries(replica) == 0);
+	TEST_CHECK(fr_ldap_replica_acquire(replica, "john") == NULL);
+	TEST_CHECK(fr_ldap_replica_acquire_by_dn(replica, JOHN_DN) == NULL);
+
+	TEST_CASE("The reader's reference keeps the entry alive");
+	TEST_CHECK(test_entry_is(e, JOHN_DN));
+	values = ldap_get_values_len(fr_ldap_handle_thread_local(), fr_ldap_replica_entry_msg(e), "uid");
+	TEST_ASSERT(values != NULL);
+	TEST_CHECK((values[0]->bv_len == 4) && (memcmp(values[0]->bv_val, "john", 4) == 0));
+	ldap_value_free_len(values);
+
+	fr_ldap_replica_release(e);
+
+	TEST_CASE("Deleting by DN");
+	test_update(replica, john_uuid, JOHN_DN);
+	e = fr_ldap_replica_acquire(replica, "john");
+	fr_ldap_replica_delete(replica, NULL, JOHN_DN);
+	TEST_CHECK(fr_ldap_replica_acquire(replica, "john") == NULL);
+	TEST_CHECK(test_entry_is(e, JOHN_DN));
+	fr_ldap_replica_release(e);
+
+	TEST_CASE("Flushing the replica");
+	test_update(replica, john_uuid, JOHN_DN);
+	test_update(replica, peter_uuid, PETER_DN);
+	e = fr_ldap_replica_acquire(replica, "peter");
+	fr_ldap_replica_flush(replica);
+	TEST_CHECK(fr_ldap_replica_num_entries(replica) == 0);
+	TEST_CHECK(test_entry_is(e, PETER_DN));
+	fr_ldap_replica_release(e);
+
+	/*
+	 *	Releasing a NULL entry is a noop, as callers
+	 *	release whatever acquire returned.
+	 */
+	fr_ldap_replica_release(NULL);
+}
+
+/** Entries outside the base DN and scope of a search are rejected
+ *
+ */
+static void test_scope(void)
+{
+	fr_ldap_replica_t	*replica;
+	fr_ldap_replica_entry_t	*e;
+
+	if (!ld) return;
+
+	replica = test_replica("scope");
+	test_update(replica, john_uuid, JOHN_DN);
+
+	e = fr_ldap_replica_acquire(replica, "john");
+	TEST_ASSERT(e != NULL);
+
+	TEST_CASE("Entry directly below the base");
+	TEST_CHECK(fr_ldap_replica_entry_in_scope(e, "ou=people,dc=example,dc=com", LDAP_SCOPE_SUBTREE));
+	TEST_CHECK(fr_ldap_replica_entry_in_scope(e, "ou=people,dc=example,dc=com", LDAP_SCOPE_ONELEVEL));
+	TEST_CHECK(fr_ldap_replica_entry_in_scope(e, "ou=people,dc=example,dc=com", LDAP_SCOPE_CHILDREN));
+	TEST_CHECK(!fr_ldap_replica_entry_in_scope(e, "ou=people,dc=example,dc=com", LDAP_SCOPE_BASE));
+
+	TEST_CASE("Entry two levels below the base");
+	TEST_CHECK(fr_ldap_replica_entry_in_scope(e, "dc=example,dc=com", LDAP_SCOPE_SUBTREE));
+	TEST_CHECK(!fr_ldap_replica_entry_in_scope(e, "dc=example,dc=com", LDAP_SCOPE_ONELEVEL));
+
+	TEST_CASE("Entry is the base");
+	TEST_CHECK(fr_ldap_replica_entry_in_scope(e, JOHN_DN, LDAP_SCOPE_BASE));
+	TEST_CHECK(fr_ldap_replica_entry_in_scope(e, JOHN_DN, LDAP_SCOPE_SUBTREE));
+	TEST_CHECK(!fr_ldap_replica_entry_in_scope(e, JOHN_DN, LDAP_SCOPE_ONELEVEL));
+	TEST_CHECK(!fr_ldap_replica_entry_in_scope(e, JOHN_DN, LDAP_SCOPE_CHILDREN));
+
+	TEST_CASE("Entry in a different subtree");
+	TEST_CHECK(!fr_ldap_replica_entry_in_scope(e, "ou=groups,dc=example,dc=com", LDAP_SCOPE_SUBTREE));
+
+	TEST_CASE("Base which only matches part of an RDN");
+	TEST_CHECK(!fr_ldap_replica_entry_in_scope(e, "ople,dc=example,dc=com", LDAP_SCOPE_SUBTREE));
+
+	TEST_CASE("Empty base");
+	TEST_CHECK(fr_ldap_replica_entry_in_scope(e, "", LDAP_SCOPE_SUBTREE));
+
+	fr_ldap_replica_release(e);
+	fr_ldap_replica_flush(replica);
+}
+
+/** Evaluate a filter against a replica entry, as rlm_ldap does
+ *
+ */
+static bool test_filter_match(fr_ldap_replica_entry_t *e, char const *filter_str)
+{
+	fr_dlist_head_t		*filter = NULL;
+	fr_ldap_connection_t	conn = { .handle = fr_ldap_handle_thread_local() };
+	bool			ret;
+
+	if (!TEST_CHECK(fr_ldap_filter_parse(NULL, &filter, &FR_SBUFF_IN(filter_str, strlen(filter_str)),
+					     NULL, NULL) > 0)) {
+		TEST_MSG("Failed parsing filter %s", filter_str);
+		return false;
+	}
+
+	ret = fr_ldap_filter_eval(filter, &conn, fr_ldap_replica_entry_msg(e));
+	talloc_free(filter);
+
+	return ret;
+}
+
+/** Entries which don't match the user filter are rejected
+ *
+ */
+static void test_filter(void)
+{
+	fr_ldap_replica_t	*replica;
+	fr_ldap_replica_entry_t	*e;
+
+	if (!ld) return;
+
+	replica = test_replica("filter");
+	test_update(replica, john_uuid, JOHN_DN);
+
+	e = fr_ldap_replica_acquire(replica, "john");
+	TEST_ASSERT(e != NULL);
+
+	TEST_CHECK(test_filter_match(e, "(uid=john)"));
+	TEST_CHECK(test_filter_match(e, "(&(objectClass=posixAccount)(uid=john))"));
+	TEST_CHECK(test_filter_match(e, "(|(uid=peter)(uid=john))"));
+	TEST_CHECK(!test_filter_match(e, "(uid=peter)"));
+	TEST_CHECK(!test_filter_match(e, "(&(objectClass=groupOfNames)(uid=john))"));
+
+	fr_ldap_replica_release(e);
+	fr_ldap_replica_flush(replica);
+}
+
+/** Entries which weren't sent or marked present during a refresh are removed
+ *
+ */
+static void test_refresh_present(void)
+{
+	fr_ldap_replica_t	*replica;
+	fr_ldap_replica_entry_t	*e;
+
+	if (!ld) return;
+
+	replica = test_replica("present");
+	test_update(replica, john_uuid, JOHN_DN);
+	test_update(replica, peter_uuid, PETER_DN);
+	test_update(replica, adminuser_uuid, ADMINUSER_DN);
+	TEST_CHECK(fr_ldap_replica_num_entries(replica) == 3);
+
+	e = fr_ldap_replica_acquire(replica, "adminuser");
+	TEST_ASSERT(e != NULL);
+
+	/*
+	 *	john is unchanged, peter is resent, and
+	 *	adminuser is neither.
+	 */
+	fr_ldap_replica_refresh_start(replica);
+	fr_ldap_replica_present(replica, john_uuid);
+	test_update(replica, peter_uuid, PETER_DN);
+
+	TEST_CASE("Only the missing entry is removed");
+	TEST_CHECK(fr_ldap_replica_refresh_present_done(replica) == 1);
+	TEST_CHECK(fr_ldap_replica_num_entries(replica) == 2);
+	TEST_CHECK(fr_ldap_replica_acquire(replica, "adminuser") == NULL);
+	TEST_CHECK(fr_ldap_replica_acquire_by_dn(replica, ADMINUSER_DN) == NULL);
+
+	TEST_CASE("Readers can still use the removed entry");
+	TEST_CHECK(test_entry_is(e, ADMINUSER_DN));
+	fr_ldap_replica_release(e);
+
+	TEST_CASE("Present and updated entries are kept");
+	e = fr_ldap_replica_acquire(replica, "john");
+	TEST_CHECK(test_entry_is(e, JOHN_DN));
+	fr_ldap_replica_release(e);
+
+	e = fr_ldap_replica_acquire(replica, "peter");
+	TEST_CHECK(test_entry_is(e, PETER_DN));
+	fr_ldap_replica_release(e);
+
+	TEST_CASE("A refresh where nothing is present empties the replica");
+	fr_ldap_replica_refresh_start(replica);
+	TEST_CHECK(fr_ldap_replica_refresh_present_done(replica) == 2);
+	TEST_CHECK(fr_ldap_replica_num_entries(replica) == 0);
+}
+
+TEST_LIST = {
+	{ "index",		test_index },
+	{ "refcount",		test_refcount },
+	{ "scope",		test_scope },
+	{ "filter",		test_filter },
+	{ "refresh_present",	test_refresh_present },
+	{ NULL }
+};
@@ -0,0 +1,18 @@
+#
+#  Include the library's makefile for the libldap flags.
+#
+TARGETNAME	:=
+-include $(top_builddir)/src/lib/ldap/all.mk
+SUBMAKEFILES	:=
+
+ifneq "$(TARGETNAME)" ""
+  TARGET	:= replica_tests$(E)
+endif
+
+SOURCES		:= replica_tests.c
+
+TGT_LDLIBS	+= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-ldap$(L) libfreeradius-server$(L) libfreeradius-util$(L)
+
+TGT_INSTALLDIR	:=
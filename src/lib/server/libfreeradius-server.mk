@@ -31,6 +31,7 @@ SOURCES	:= \
 	pool.c \
 	rcode.c \
 	regex.c \
+	reload.c \
 	request.c \
 	request_data.c \
 	section.c \
@@ -44,6 +45,7 @@ SOURCES	:= \
 	trigger.c \
 	trunk.c \
 	users_file.c \
+	users_image.c \
 	util.c \
 	virtual_servers.c
 
@@ -45,6 +45,7 @@ RCSID("$Id$")
 #include <freeradius-devel/util/file.h>
 #include <freeradius-devel/util/hw.h>
 #include <freeradius-devel/util/perm.h>
+#include <freeradius-devel/util/regex.h>
 #include <freeradius-devel/util/sem.h>
 #include <freeradius-devel/util/token.h>
 #include <freeradius-devel/util/pair_legacy.h>
@@ -94,6 +95,9 @@ static int num_workers_dflt(CONF_PAIR **out, void *parent, CONF_SECTION *cs, fr_
 static int lib_dir_on_read(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
 
 static int talloc_pool_size_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
+#ifdef HAVE_REGEX
+static int regex_cache_size_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
+#endif
 
 static int max_request_time_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
 
@@ -165,6 +169,10 @@ static const conf_parser_t resources[] = {
 	 */
 	{ FR_CONF_OFFSET_TYPE_FLAGS("talloc_pool_size", FR_TYPE_SIZE, CONF_FLAG_HIDDEN, main_config_t, talloc_pool_size), .func = talloc_pool_size_parse },			/* DO NOT SET DEFAULT */
 	{ FR_CONF_OFFSET_FLAGS("talloc_memory_report", CONF_FLAG_HIDDEN, main_config_t, talloc_memory_report) },						/* DO NOT SET DEFAULT */
+	{ FR_CONF_OFFSET_FLAGS("talloc_pool_adaptive", CONF_FLAG_HIDDEN, main_config_t, talloc_pool_adaptive), .dflt = "no" },
+#ifdef HAVE_REGEX
+	{ FR_CONF_OFFSET("regex_cache_size", main_config_t, regex_cache_size), .dflt = "128", .func = regex_cache_size_parse },
+#endif
 	CONF_PARSER_TERMINATOR
 };
 
@@ -176,6 +184,10 @@ static const conf_parser_t thread_config[] = {
 
 	{ FR_CONF_OFFSET_TYPE_FLAGS("stats_interval", FR_TYPE_TIME_DELTA, CONF_FLAG_HIDDEN, main_config_t, stats_interval) },
 
+	{ FR_CONF_OFFSET("max_queue_time", main_config_t, max_queue_time), .dflt = "0" },
+	{ FR_CONF_OFFSET("queue_delay_target", main_config_t, queue_delay_target), .dflt = "0" },
+	{ FR_CONF_OFFSET("queue_delay_interval", main_config_t, queue_delay_interval), .dflt = "0.1" },
+
 #ifdef WITH_TLS
 	{ FR_CONF_OFFSET_TYPE_FLAGS("openssl_async_pool_init", FR_TYPE_SIZE, 0, main_config_t, openssl_async_pool_init), .dflt = "64" },
 	{ FR_CONF_OFFSET_TYPE_FLAGS("openssl_async_pool_max", FR_TYPE_SIZE, 0, main_config_t, openssl_async_pool_max), .dflt = "1024" },
@@ -343,6 +355,27 @@ static int talloc_pool_size_parse(TALLOC_CTX *ctx, void *out, void *parent,
 	return 0;
 }
 
+#ifdef HAVE_REGEX
+static int regex_cache_size_parse(TALLOC_CTX *ctx, void *out, void *parent,
+				  CONF_ITEM *ci, conf_parser_t const *rule)
+{
+	int		ret;
+	uint32_t	value;
+
+	if ((ret = cf_pair_parse_value(ctx, out, parent, ci, rule)) < 0) return ret;
+
+	memcpy(&value, out, sizeof(value));
+
+	FR_INTEGER_BOUND_CHECK("resources.regex_cache_size", value, <=, 65536);
+
+	memcpy(out, &value, sizeof(value));
+
+	regex_cache_size_set(value);
+
+	return 0;
+}
+#endif
+
 static int max_request_time_parse(TALLOC_CTX *ctx, void *out, void *parent,
 				  CONF_ITEM *ci, conf_parser_t const *rule)
 {
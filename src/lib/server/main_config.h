@@ -95,6 +95,12 @@ struct main_config_s {
 
 	size_t		talloc_pool_size;		//!< Size of pool to allocate to hold each #request_t.
 
+	bool		talloc_pool_adaptive;		//!< Size request pools from an EWMA of recent requests
+							///< on the same listener.
+
+	uint32_t	regex_cache_size;		//!< Maximum number of runtime compiled regular expressions
+							///< each thread caches.
+
 	uint32_t	max_requests;			//!< maximum number of requests outstanding
 
 	bool		write_pid;			//!< write the PID file
@@ -150,6 +156,11 @@ struct main_config_s {
 	uint32_t	max_networks;			//!< for the scheduler
 	uint32_t	max_workers;			//!< for the scheduler
 	fr_time_delta_t	stats_interval;			//!< for the scheduler
+	fr_time_delta_t	max_queue_time;			//!< Shed requests which will have waited longer than this
+							///< before being processed.
+	fr_time_delta_t	queue_delay_target;		//!< Acceptable standing queue delay for the workers.
+	fr_time_delta_t	queue_delay_interval;		//!< How long the queue delay must exceed the target
+							///< before low priority requests are shed.
 
 #ifndef NDEBUG
 	uint32_t	ins_max;			//!< max instruction count
@@ -0,0 +1,516 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file reload.c
+ * @brief Rebuild module data in the background, and publish it atomically.
+ *
+ * Modules such as rlm_files, rlm_csv and rlm_passwd build an index from a
+ * file when they're instantiated.  This API lets them rebuild that index
+ * on a dedicated thread, either when the file changes, or when an
+ * administrator asks for it via radmin.
+ *
+ * Readers never take a lock.  They load the current version with a single
+ * atomic read, and use it for the duration of a synchronous module call.
+ * When a new version is published, the old one is placed on a retired list,
+ * and is only freed once max_request_time has passed, by which point no
+ * request can still be referencing it.
+ *
+ * xlat function calls can't be instantiated once the server has started,
+ * so reloading is disabled for data which contains them, and reloaded data
+ * may not introduce them.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/command.h>
+#include <freeradius-devel/server/main_config.h>
+#include <freeradius-devel/server/reload.h>
+#include <freeradius-devel/unlang/xlat.h>
+
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/** One version of the data
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< Entry in the retired list.
+	fr_time_t		retired;		//!< When this version was replaced.
+	uint64_t		generation;		//!< Incremented each time the data is reloaded.
+	void			*data;			//!< Returned by the load callback.
+} reload_version_t;
+
+struct reload_s {
+	fr_dlist_t		entry;			//!< Entry in the list of all reload handles.
+	char const		*name;			//!< Used for logging, and radmin commands.
+	char const		*filename;		//!< File to watch for changes.  May be NULL.
+	fr_time_delta_t		interval;		//!< How often to check the file for changes.
+
+	reload_load_t		func;			//!< Builds a new version of the data.
+	void			*uctx;			//!< Passed to the load callback.
+
+	_Atomic(reload_version_t *) current;		//!< The version readers should use.
+
+	pthread_mutex_t		mutex;			//!< Protects everything below.
+	pthread_cond_t		cond;			//!< Wakes the reload thread.
+	pthread_t		thread;			//!< The reload thread.
+	bool			running;		//!< Whether the reload thread was started.
+	bool			disabled;		//!< The data contains xlats, and can't be reloaded.
+	bool			pending;		//!< A reload has been requested.
+	bool			stop;			//!< The reload thread should exit.
+
+	fr_dlist_head_t		retired;		//!< Versions which may still be in use.
+
+	struct timespec		mtime;			//!< Last modification time of the file.
+	ino_t			ino;			//!< Last inode of the file.
+	off_t			size;			//!< Last size of the file.
+};
+
+/** All reload handles, so radmin can find every handle for a module
+ *
+ * A module may have several handles, e.g. rlm_files loads its data once
+ * for each call site.
+ */
+static fr_dlist_head_t		reload_list =	/* entry is the first field of reload_t */ FR_DLIST_HEAD_INITIALISER(reload_list);
+static pthread_mutex_t		reload_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** A radmin command registered for a module name
+ *
+ * radmin commands can't be removed, so the command's ctx must outlive any
+ * individual handle.  These are only freed on exit.
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< Entry in the list of registered commands.
+	char const		*name;			//!< of the module instance.
+} reload_cmd_t;
+
+static fr_dlist_head_t		*reload_cmd_list;	//!< Protected by reload_list_mutex.
+
+static int cmd_set_module_reload(FILE *fp, FILE *fp_err, void *ctx, UNUSED fr_cmd_info_t const *info);
+
+static fr_cmd_table_t reload_cmd_table[] = {
+	{
+		.parent = "set module",
+		.add_name = true,
+		.name = "reload",
+		.func = cmd_set_module_reload,
+		.help = "Re-read the module's data files, and switch to the new data once loaded.",
+		.read_only = false,
+	},
+
+	CMD_TABLE_END
+};
+
+/** Record the current state of the watched file
+ *
+ * @return
+ *	- true if the file has changed since we last looked.
+ *	- false if the file has not changed, or can't be examined.
+ */
+static bool reload_file_changed(reload_t *rl)
+{
+	struct stat	st;
+	bool		changed;
+
+	if (!rl->filename) return false;
+
+	if (stat(rl->filename, &st) < 0) return false;
+
+	changed = (st.st_ino != rl->ino) || (st.st_size != rl->size) ||
+#ifdef __APPLE__
+		  (st.st_mtimespec.tv_sec != rl->mtime.tv_sec) || (st.st_mtimespec.tv_nsec != rl->mtime.tv_nsec);
+	rl->mtime = st.st_mtimespec;
+#else
+		  (st.st_mtim.tv_sec != rl->mtime.tv_sec) || (st.st_mtim.tv_nsec != rl->mtime.tv_nsec);
+	rl->mtime = st.st_mtim;
+#endif
+	rl->ino = st.st_ino;
+	rl->size = st.st_size;
+
+	return changed;
+}
+
+/** Free retired versions which can no longer be referenced by any request
+ *
+ * Must be called with the mutex held.
+ */
+static void reload_reap(reload_t *rl, bool all)
+{
+	reload_version_t	*v;
+	fr_time_t		now = fr_time();
+	fr_time_delta_t		grace = main_config ? main_config->max_request_time : fr_time_delta_from_sec(30);
+
+	while ((v = fr_dlist_head(&rl->retired))) {
+		if (!all && fr_time_delta_lt(fr_time_sub(now, v->retired), grace)) break;
+
+		fr_dlist_remove(&rl->retired, v);
+		talloc_free(v);
+	}
+}
+
+/** Build a new version of the data and publish it
+ *
+ * The load callback is called without the mutex held, so that radmin
+ * requests can be queued while a large file is being parsed.
+ */
+static int reload_publish(reload_t *rl)
+{
+	reload_version_t	*v, *old;
+	fr_time_t		start = fr_time();
+	bool			initial = (atomic_load_explicit(&rl->current, memory_order_relaxed) == NULL);
+	bool			prev = false;
+	size_t			num_xlat = 0;
+	int			ret;
+
+	/*
+	 *	On the initial load we're still bootstrapping, so xlats
+	 *	can be registered.  Record whether any were, as
+	 *	versions containing xlats must only be freed on the
+	 *	main thread, and any later version would need them
+	 *	registered at runtime.
+	 */
+	if (initial) {
+		num_xlat = xlat_instance_num();
+	} else {
+		prev = xlat_instance_register_disable(true);
+	}
+
+	MEM(v = talloc_zero(NULL, reload_version_t));
+	ret = rl->func(&v->data, v, rl->uctx);
+
+	if (initial) {
+		rl->disabled = (xlat_instance_num() != num_xlat);
+	} else {
+		xlat_instance_register_disable(prev);
+	}
+
+	if (ret < 0) {
+		/*
+		 *	On the initial load, the caller reports the error.
+		 */
+		if (!initial) PERROR("%s - Failed reloading data, continuing to use the previous version", rl->name);
+		talloc_free(v);
+		return -1;
+	}
+
+	pthread_mutex_lock(&rl->mutex);
+	old = atomic_load_explicit(&rl->current, memory_order_relaxed);
+	v->generation = old ? old->generation + 1 : 0;
+	atomic_store_explicit(&rl->current, v, memory_order_release);
+
+	if (old) {
+		old->retired = fr_time();
+		fr_dlist_insert_tail(&rl->retired, old);
+	}
+	reload_reap(rl, false);
+	pthread_mutex_unlock(&rl->mutex);
+
+	if (v->generation > 0) {
+		INFO("%s - Reloaded data in %pVs (generation %" PRIu64 ")", rl->name,
+		     fr_box_time_delta(fr_time_sub(fr_time(), start)), v->generation);
+	}
+
+	return 0;
+}
+
+static void *reload_thread(void *arg)
+{
+	reload_t	*rl = talloc_get_type_abort(arg, reload_t);
+
+	pthread_mutex_lock(&rl->mutex);
+	while (!rl->stop) {
+		bool		changed;
+
+		if (!rl->pending) {
+			if (fr_time_delta_ispos(rl->interval)) {
+				struct timespec	ts;
+				struct timespec	delta = fr_time_delta_to_timespec(rl->interval);
+
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_sec += delta.tv_sec;
+				ts.tv_nsec += delta.tv_nsec;
+				if (ts.tv_nsec >= NSEC) {
+					ts.tv_sec++;
+					ts.tv_nsec -= NSEC;
+				}
+
+				(void) pthread_cond_timedwait(&rl->cond, &rl->mutex, &ts);
+			} else {
+				(void) pthread_cond_wait(&rl->cond, &rl->mutex);
+			}
+			if (rl->stop) break;
+		}
+
+		changed = reload_file_changed(rl);
+		if (!rl->pending && !changed) {
+			reload_reap(rl, false);
+			continue;
+		}
+		rl->pending = false;
+		pthread_mutex_unlock(&rl->mutex);
+
+		if (changed) DEBUG("%s - File \"%s\" changed, reloading", rl->name, rl->filename);
+		(void) reload_publish(rl);
+
+		pthread_mutex_lock(&rl->mutex);
+	}
+	pthread_mutex_unlock(&rl->mutex);
+
+	return NULL;
+}
+
+static int _reload_free(reload_t *rl)
+{
+	reload_version_t *v;
+
+	pthread_mutex_lock(&reload_list_mutex);
+	if (fr_dlist_entry_in_list(&rl->entry)) fr_dlist_remove(&reload_list, rl);
+	pthread_mutex_unlock(&reload_list_mutex);
+
+	if (rl->running) {
+		pthread_mutex_lock(&rl->mutex);
+		rl->stop = true;
+		pthread_cond_signal(&rl->cond);
+		pthread_mutex_unlock(&rl->mutex);
+
+		pthread_join(rl->thread, NULL);
+	}
+
+	reload_reap(rl, true);
+
+	v = atomic_load_explicit(&rl->current, memory_order_relaxed);
+	talloc_free(v);
+
+	pthread_cond_destroy(&rl->cond);
+	pthread_mutex_destroy(&rl->mutex);
+
+	return 0;
+}
+
+static int _reload_cmd_list_free(UNUSED void *uctx)
+{
+	return talloc_free(reload_cmd_list);
+}
+
+/** Register the radmin reload command for a name, if it's not already registered
+ *
+ * Must be called with reload_list_mutex held.
+ */
+static int reload_cmd_register(char const *name)
+{
+	reload_cmd_t	*cmd = NULL;
+
+	if (!reload_cmd_list) {
+		MEM(reload_cmd_list = talloc_zero(NULL, fr_dlist_head_t));
+		fr_dlist_talloc_init(reload_cmd_list, reload_cmd_t, entry);
+		fr_atexit_global(_reload_cmd_list_free, NULL);
+	}
+
+	while ((cmd = fr_dlist_next(reload_cmd_list, cmd))) {
+		if (strcmp(cmd->name, name) == 0) return 0;
+	}
+
+	MEM(cmd = talloc_zero(reload_cmd_list, reload_cmd_t));
+	cmd->name = talloc_typed_strdup(cmd, name);
+
+	if (fr_command_register_hook(NULL, cmd->name, cmd, reload_cmd_table) < 0) {
+		talloc_free(cmd);
+		return -1;
+	}
+	fr_dlist_insert_tail(reload_cmd_list, cmd);
+
+	return 0;
+}
+
+/** Load data, and arrange for it to be rebuilt when it changes
+ *
+ * The data is loaded synchronously before this function returns, so that
+ * errors in the initial load are reported at startup.
+ *
+ * If the server is running multi-threaded, a thread is started which checks
+ * the file every interval, and rebuilds the data when the file changes, or
+ * when radmin's "set module <name> reload" command is used.  In single
+ * threaded mode, the radmin command rebuilds the data inline.
+ *
+ * If the initial load registers any xlat function calls, the data is never
+ * reloaded.  Reloads fail if the new data contains function calls.
+ *
+ * @note The returned handle must not be allocated in module instance data,
+ *	as that is protected after instantiation.  Pass NULL, and free the
+ *	handle in the module's detach callback.
+ *
+ * @param[in] ctx	to allocate the handle in.
+ * @param[in] name	of the module instance.  Used for logging and radmin.
+ * @param[in] filename	to watch.  May be NULL, in which case the data is only
+ *			rebuilt when requested via radmin.
+ * @param[in] interval	how often to check the file for changes.  If zero, the
+ *			file is not watched.
+ * @param[in] load	callback to build the data.
+ * @param[in] uctx	passed to the load callback.
+ * @return
+ *	- A new reload handle on success.
+ *	- NULL on failure.
+ */
+reload_t *reload_alloc(TALLOC_CTX *ctx, char const *name, char const *filename,
+		       fr_time_delta_t interval, reload_load_t load, void *uctx)
+{
+	reload_t	*rl;
+	int		ret;
+
+	MEM(rl = talloc_zero(ctx, reload_t));
+	rl->name = talloc_typed_strdup(rl, name);
+	if (filename) rl->filename = talloc_typed_strdup(rl, filename);
+	rl->interval = filename ? interval : fr_time_delta_wrap(0);
+	rl->func = load;
+	rl->uctx = uctx;
+	fr_dlist_talloc_init(&rl->retired, reload_version_t, entry);
+
+	pthread_mutex_init(&rl->mutex, NULL);
+	pthread_cond_init(&rl->cond, NULL);
+	talloc_set_destructor(rl, _reload_free);
+
+	(void) reload_file_changed(rl);
+
+	if (reload_publish(rl) < 0) {
+	error:
+		talloc_free(rl);
+		return NULL;
+	}
+
+	if (rl->disabled) {
+		WARN("%s - \"%s\" contains function calls, which can't be instantiated once the server "
+		     "has started.  Reloading is disabled", rl->name, rl->filename ? rl->filename : rl->name);
+		return rl;
+	}
+
+	/*
+	 *	Only the first handle for a given name registers the
+	 *	radmin command.  The command then signals all handles
+	 *	with that name.
+	 */
+	pthread_mutex_lock(&reload_list_mutex);
+	if (reload_cmd_register(rl->name) < 0) {
+		pthread_mutex_unlock(&reload_list_mutex);
+		PERROR("%s - Failed registering radmin commands", rl->name);
+		goto error;
+	}
+	fr_dlist_insert_tail(&reload_list, rl);
+	pthread_mutex_unlock(&reload_list_mutex);
+
+	/*
+	 *	talloc isn't thread safe when null tracking is
+	 *	enabled, which can only be done in single threaded
+	 *	mode.  So we only rebuild in the background when the
+	 *	server has worker threads.
+	 */
+	if (!main_config || !main_config->spawn_workers) return rl;
+
+	ret = pthread_create(&rl->thread, NULL, reload_thread, rl);
+	if (ret != 0) {
+		ERROR("%s - Failed creating reload thread: %s", rl->name, fr_syserror(ret));
+		goto error;
+	}
+	rl->running = true;
+
+	return rl;
+}
+
+/** Return the current version of the data
+ *
+ * The data remains valid for at least max_request_time after a newer
+ * version is published.  Callers should not hold on to it across yields,
+ * and should call this function again for each request.
+ */
+void *reload_data(reload_t const *rl)
+{
+	reload_version_t *v = atomic_load_explicit(&UNCONST(reload_t *, rl)->current, memory_order_acquire);
+
+	return v->data;
+}
+
+/** Request that the data be rebuilt
+ *
+ * If there's a reload thread, this returns immediately, and the data is
+ * rebuilt in the background.  Otherwise the data is rebuilt inline.
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 if reloading is disabled, or the data was rebuilt inline, and
+ *	  loading failed.
+ */
+int reload_signal(reload_t *rl)
+{
+	if (rl->disabled) {
+		fr_strerror_printf("%s - Data contains function calls, and can't be reloaded", rl->name);
+		return -1;
+	}
+
+	if (!rl->running) return reload_publish(rl);
+
+	pthread_mutex_lock(&rl->mutex);
+	rl->pending = true;
+	pthread_cond_signal(&rl->cond);
+	pthread_mutex_unlock(&rl->mutex);
+
+	return 0;
+}
+
+static int cmd_set_module_reload(FILE *fp, FILE *fp_err, void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	reload_cmd_t	*cmd = talloc_get_type_abort(ctx, reload_cmd_t);
+	reload_t	*other = NULL;
+	bool		found = false;
+	int		ret = 0;
+
+	pthread_mutex_lock(&reload_list_mutex);
+	while ((other = fr_dlist_next(&reload_list, other))) {
+		if (strcmp(other->name, cmd->name) != 0) continue;
+
+		found = true;
+
+		if (reload_signal(other) < 0) {
+			fprintf(fp_err, "Failed reloading %s - %s\n", other->name, fr_strerror());
+			ret = -1;
+			continue;
+		}
+
+		fprintf(fp, "%s %s\n", other->running ? "Scheduled reload of" : "Reloaded",
+			other->filename ? other->filename : other->name);
+	}
+	pthread_mutex_unlock(&reload_list_mutex);
+
+	if (!found) {
+		fprintf(fp_err, "No data loaded for %s\n", cmd->name);
+		return -1;
+	}
+
+	return ret;
+}
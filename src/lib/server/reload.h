@@ -0,0 +1,61 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file lib/server/reload.h
+ * @brief Rebuild module data in the background, and publish it atomically.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(reload_h, "$Id$")
+
+#include <freeradius-devel/util/time.h>
+#include <talloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct reload_s reload_t;
+
+/** Build a new version of the data
+ *
+ * Called once from #reload_alloc, and then from the reload thread whenever
+ * the watched file changes, or a reload is requested via radmin.
+ *
+ * @param[out] out	Where to write the new data.  Must be allocated in ctx.
+ * @param[in] ctx	to allocate the data in.  This is a standalone talloc
+ *			tree, and may be freed from any thread.
+ * @param[in] uctx	passed to #reload_alloc.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.  The previous version of the data remains in use.
+ */
+typedef int (*reload_load_t)(void **out, TALLOC_CTX *ctx, void *uctx);
+
+reload_t	*reload_alloc(TALLOC_CTX *ctx, char const *name, char const *filename,
+			      fr_time_delta_t interval, reload_load_t load, void *uctx);
+
+void		*reload_data(reload_t const *rl) CC_HINT(nonnull);
+
+int		reload_signal(reload_t *rl) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
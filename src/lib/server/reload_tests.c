@@ -0,0 +1,234 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for reloading module data
+ *
+ * @file src/lib/server/reload_tests.c
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/server/command.h>
+#include <freeradius-devel/server/reload.h>
+#include <freeradius-devel/util/strerror.h>
+#include <freeradius-devel/util/time.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+/** The radmin command registered by the reload API
+ *
+ */
+static void		*cmd_ctx;
+static fr_cmd_table_t	*cmd_table;
+static unsigned int	cmd_registered;
+
+static int test_register(UNUSED TALLOC_CTX *talloc_ctx, UNUSED char const *name, void *ctx, fr_cmd_table_t *table)
+{
+	cmd_ctx = ctx;
+	cmd_table = table;
+	cmd_registered++;
+
+	return 0;
+}
+
+static void test_init(void)
+{
+	fr_time_start();
+	fr_command_register_hook = test_register;
+}
+
+/** Write a passwd style file
+ *
+ */
+static void file_write(char const *filename, char const *contents)
+{
+	FILE *fp;
+
+	fp = fopen(filename, "w");
+	TEST_ASSERT(fp != NULL);
+	TEST_CHECK(fputs(contents, fp) >= 0);
+	fclose(fp);
+}
+
+/** Load the password for "bob" from a passwd style file
+ *
+ * Fails if the user isn't found, so tests can check the previous
+ * version is kept.
+ */
+static int test_load(void **out, TALLOC_CTX *ctx, void *uctx)
+{
+	char const	*filename = uctx;
+	FILE		*fp;
+	char		line[256];
+	char		*password = NULL;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		fr_strerror_printf("Failed opening %s", filename);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *p;
+
+		if (strncmp(line, "bob:", 4) != 0) continue;
+
+		p = strchr(line + 4, ':');
+		if (p) *p = '\0';
+		password = talloc_typed_strdup(ctx, line + 4);
+		break;
+	}
+	fclose(fp);
+
+	if (!password) {
+		fr_strerror_const("No entry for bob");
+		return -1;
+	}
+
+	*out = password;
+
+	return 0;
+}
+
+static char *test_filename(TALLOC_CTX *ctx, char const *name)
+{
+	return talloc_typed_asprintf(ctx, "/tmp/reload_tests_%s_%u", name, (unsigned int)getpid());
+}
+
+/** A changed file is picked up when a reload is requested
+ *
+ */
+static void test_reload_changed(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("test");
+	char		*filename = test_filename(ctx, "changed");
+	reload_t	*rl;
+
+	file_write(filename, "bob:hello:1000:1000::/home/bob:/bin/sh\n");
+
+	rl = reload_alloc(NULL, "passwd_changed", filename, fr_time_delta_from_sec(1), test_load, filename);
+	TEST_ASSERT(rl != NULL);
+	TEST_CHECK_STRCMP((char *)reload_data(rl), "hello");
+
+	file_write(filename, "alice:other:1001:1001::/home/alice:/bin/sh\n"
+			     "bob:goodbye:1000:1000::/home/bob:/bin/sh\n");
+
+	/*
+	 *	No worker threads, so the data is rebuilt inline.
+	 */
+	TEST_CHECK(reload_signal(rl) == 0);
+	TEST_CHECK_STRCMP((char *)reload_data(rl), "goodbye");
+
+	talloc_free(rl);
+	unlink(filename);
+	talloc_free(ctx);
+}
+
+/** A file which fails to load leaves the previous version in use
+ *
+ */
+static void test_reload_failed(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("test");
+	char		*filename = test_filename(ctx, "failed");
+	reload_t	*rl;
+
+	file_write(filename, "bob:hello:1000:1000::/home/bob:/bin/sh\n");
+
+	rl = reload_alloc(NULL, "passwd_failed", filename, fr_time_delta_from_sec(1), test_load, filename);
+	TEST_ASSERT(rl != NULL);
+
+	file_write(filename, "alice:other:1001:1001::/home/alice:/bin/sh\n");
+	TEST_CHECK(reload_signal(rl) < 0);
+	TEST_CHECK_STRCMP((char *)reload_data(rl), "hello");
+
+	/*
+	 *	Fixing the file makes the next reload succeed.
+	 */
+	file_write(filename, "bob:fixed:1000:1000::/home/bob:/bin/sh\n");
+	TEST_CHECK(reload_signal(rl) == 0);
+	TEST_CHECK_STRCMP((char *)reload_data(rl), "fixed");
+
+	talloc_free(rl);
+	unlink(filename);
+	talloc_free(ctx);
+}
+
+/** The radmin command outlives the handle it was registered for
+ *
+ */
+static void test_reload_command(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("test");
+	char		*file_a = test_filename(ctx, "cmd_a");
+	char		*file_b = test_filename(ctx, "cmd_b");
+	reload_t	*a, *b;
+	FILE		*fp;
+	unsigned int	registered = cmd_registered;
+
+	file_write(file_a, "bob:a1:1000:1000::/home/bob:/bin/sh\n");
+	file_write(file_b, "bob:b1:1000:1000::/home/bob:/bin/sh\n");
+
+	a = reload_alloc(NULL, "passwd_cmd", file_a, fr_time_delta_from_sec(1), test_load, file_a);
+	TEST_ASSERT(a != NULL);
+	b = reload_alloc(NULL, "passwd_cmd", file_b, fr_time_delta_from_sec(1), test_load, file_b);
+	TEST_ASSERT(b != NULL);
+
+	/*
+	 *	One command per name.
+	 */
+	TEST_CHECK(cmd_registered == registered + 1);
+	TEST_ASSERT(cmd_table && cmd_table->func);
+
+	/*
+	 *	Free the handle the command was registered with,
+	 *	the command must still reach the other one.
+	 */
+	talloc_free(a);
+
+	file_write(file_b, "bob:b2:1000:1000::/home/bob:/bin/sh\n");
+
+	fp = fopen("/dev/null", "w");
+	TEST_ASSERT(fp != NULL);
+	TEST_CHECK(cmd_table->func(fp, fp, cmd_ctx, NULL) == 0);
+	TEST_CHECK_STRCMP((char *)reload_data(b), "b2");
+
+	/*
+	 *	With no handles left, the command reports an error
+	 *	instead of touching freed memory.
+	 */
+	talloc_free(b);
+	TEST_CHECK(cmd_table->func(fp, fp, cmd_ctx, NULL) < 0);
+	fclose(fp);
+
+	unlink(file_a);
+	unlink(file_b);
+	talloc_free(ctx);
+}
+
+TEST_LIST = {
+	{ "reload_changed",	test_reload_changed },
+	{ "reload_failed",	test_reload_failed },
+	{ "reload_command",	test_reload_command },
+	{ NULL }
+};
@@ -30,6 +30,7 @@ RCSID("$Id$")
 
 #include <freeradius-devel/util/debug.h>
 #include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/math.h>
 
 static fr_dict_t const *dict_freeradius;
 
@@ -57,11 +58,97 @@ fr_dict_attr_autoload_t request_dict_attr[] = {
 	{ NULL }
 };
 
+/** Number of distinct pool sizes requests can be allocated with
+ *
+ * One for requests without a pool size hint, and one for each power of two
+ * between #REQUEST_POOL_SIZE_MIN and #REQUEST_POOL_SIZE_MAX.
+ */
+#define REQUEST_POOL_CLASSES	(1 + 9)		/* 1KiB, 2KiB ... 256KiB */
+
+/** Maximum number of requests kept in the free lists of a thread
+ *
+ */
+#define REQUEST_FREE_LIST_MAX	256
+
+/** Thread local free lists, one per pool size class
+ *
+ * Listeners with different pool size hints each draw from the list for
+ * their size class, so they don't free and reallocate each other's requests.
+ */
+typedef struct {
+	fr_dlist_head_t		pool[REQUEST_POOL_CLASSES];	//!< Free requests, by pool size class.
+	uint64_t		last_alloc[REQUEST_POOL_CLASSES];	//!< Value of allocs when a request of each
+								///< size class was last allocated.
+	uint64_t		allocs;				//!< Number of requests allocated by this thread.
+	unsigned int		num;				//!< Total number of requests in all lists.
+} request_free_list_t;
+
 /** The thread local free list
  *
  * Any entries remaining in the list will be freed when the thread is joined
  */
-static _Thread_local fr_dlist_head_t *request_free_list; /* macro */
+static _Thread_local request_free_list_t *request_free_list; /* macro */
+
+/** Round a pool size hint up so requests in the free list don't churn on small changes
+ *
+ */
+static inline CC_HINT(always_inline) size_t request_pool_size_round(size_t pool_size)
+{
+	if (!pool_size) return 0;
+	if (pool_size < REQUEST_POOL_SIZE_MIN) return REQUEST_POOL_SIZE_MIN;
+	if (pool_size > REQUEST_POOL_SIZE_MAX) return REQUEST_POOL_SIZE_MAX;
+
+	return (size_t)1 << fr_high_bit_pos(pool_size - 1);
+}
+
+/** Map a rounded pool size to the free list its requests are kept in
+ *
+ */
+static inline CC_HINT(always_inline) size_t request_pool_class(size_t pool_size)
+{
+	if (!pool_size) return 0;
+
+	return 1 + fr_high_bit_pos(pool_size) - fr_high_bit_pos(REQUEST_POOL_SIZE_MIN);
+}
+
+/** Free a request from a size class which is no longer being used
+ *
+ * Called when the free lists are full.  If a listener's pool size hint
+ * changes, the requests it left in the old size class would otherwise
+ * stay in the free list forever.
+ *
+ * @param[in] free_list	of this thread.
+ * @param[in] class	of the request being returned to the free list.
+ * @return
+ *	- true if a request was freed.
+ *	- false if every other size class was allocated from more recently.
+ */
+static bool request_free_list_evict(request_free_list_t *free_list, size_t class)
+{
+	request_t	*request;
+	size_t		i, victim = class;
+
+	for (i = 0; i < NUM_ELEMENTS(free_list->pool); i++) {
+		if (fr_dlist_empty(&free_list->pool[i])) continue;
+		if (free_list->last_alloc[i] < free_list->last_alloc[victim]) victim = i;
+	}
+	if (victim == class) return false;
+
+	request = fr_dlist_tail(&free_list->pool[victim]);
+	fr_dlist_remove(&free_list->pool[victim], request);
+	free_list->num--;
+
+	/*
+	 *	Requests in the free list have already been
+	 *	reinitialised, so there's nothing left for the
+	 *	destructor to do, and it would only put the
+	 *	request back in the free list.
+	 */
+	talloc_set_destructor(request, NULL);
+	talloc_free(request);
+
+	return true;
+}
 
 #ifndef NDEBUG
 static int _state_ctx_free(fr_pair_t *state)
@@ -245,6 +332,7 @@ static inline CC_HINT(always_inline) int request_init(char const *file, int line
 						      request_init_args_t const *args)
 {
 	fr_dict_t const *dict;
+	size_t		pool_size = request->pool_size;
 
 	/*
 	 *	Sanity checks for different requests types
@@ -287,7 +375,8 @@ static inline CC_HINT(always_inline) int request_init(char const *file, int line
 			.detachable = args && args->detachable,
 		},
 		.alloc_file = file,
-		.alloc_line = line
+		.alloc_line = line,
+		.pool_size = pool_size
 	};
 
 
@@ -403,8 +492,10 @@ static int _request_free(request_t *request)
 	 *	We keep a buffer of <active> + N requests per
 	 *	thread, to avoid spurious allocations.
 	 */
-	if (fr_dlist_num_elements(request_free_list) <= 256) {
-		fr_dlist_head_t		*free_list;
+	if ((request_free_list->num < REQUEST_FREE_LIST_MAX) ||
+	    request_free_list_evict(request_free_list, request_pool_class(request->pool_size))) {
+		request_free_list_t	*free_list;
+		size_t			pool_size = request->pool_size;
 
 		if (request->session_state_ctx) {
 			fr_assert(talloc_parent(request->session_state_ctx) != request);	/* Should never be directly parented */
@@ -419,6 +510,7 @@ static int _request_free(request_t *request)
 
 		memset(request, 0, sizeof(*request));
 		request->component = "free_list";
+		request->pool_size = pool_size;
 #ifndef NDEBUG
 		/*
 		 *	So we don't trip heap asserts
@@ -432,7 +524,8 @@ static int _request_free(request_t *request)
 		/*
 		 *	Reinsert into the free list
 		 */
-		fr_dlist_insert_head(free_list, request);
+		fr_dlist_insert_head(&free_list->pool[request_pool_class(pool_size)], request);
+		free_list->num++;
 		request_free_list = free_list;
 
 		return -1;	/* Prevent free */
@@ -463,17 +556,20 @@ really_free:
  */
 static int _request_free_list_free_on_exit(void *arg)
 {
-	fr_dlist_head_t *list = talloc_get_type_abort(arg, fr_dlist_head_t);
+	request_free_list_t	*list = talloc_get_type_abort(arg, request_free_list_t);
 	request_t		*request;
+	size_t			i;
 
 	/*
 	 *	See the destructor for why this works
 	 */
-	while ((request = fr_dlist_head(list))) if (talloc_free(request) < 0) return -1;
+	for (i = 0; i < NUM_ELEMENTS(list->pool); i++) {
+		while ((request = fr_dlist_head(&list->pool[i]))) if (talloc_free(request) < 0) return -1;
+	}
 	return talloc_free(list);
 }
 
-static inline CC_HINT(always_inline) request_t *request_alloc_pool(TALLOC_CTX *ctx)
+static inline CC_HINT(always_inline) request_t *request_alloc_pool(TALLOC_CTX *ctx, size_t pool_size)
 {
 	request_t *request;
 
@@ -494,9 +590,11 @@ static inline CC_HINT(always_inline) request_t *request_alloc_pool(TALLOC_CTX *c
 					   (UNLANG_FRAME_PRE_ALLOC * UNLANG_STACK_MAX) +	/* Stack memory */
 					   (sizeof(fr_pair_t) * 5) +		/* pair lists and root*/
 					   (sizeof(fr_packet_t) * 2) +	/* packets */
-					   128					/* extra */
+					   128 +				/* extra */
+					   pool_size				/* decoded pairs, value buffers etc... */
 					   ));
 	fr_assert(ctx != request);
+	request->pool_size = pool_size;
 
 	return request;
 }
@@ -516,34 +614,46 @@ request_t *_request_alloc(char const *file, int line, TALLOC_CTX *ctx,
 			  request_type_t type, request_init_args_t const *args)
 {
 	request_t		*request;
-	fr_dlist_head_t		*free_list;
+	request_free_list_t	*free_list;
+	fr_dlist_head_t		*pool_list;
+	size_t			pool_size = request_pool_size_round(args ? args->pool_size : 0);
 
 	/*
 	 *	Setup the free list, or return the free
 	 *	list for this thread.
 	 */
 	if (unlikely(!request_free_list)) {
-		MEM(free_list = talloc(NULL, fr_dlist_head_t));
-		fr_dlist_init(free_list, request_t, free_entry);
+		size_t i;
+
+		MEM(free_list = talloc_zero(NULL, request_free_list_t));
+		for (i = 0; i < NUM_ELEMENTS(free_list->pool); i++) fr_dlist_init(&free_list->pool[i], request_t, free_entry);
 		fr_atexit_thread_local(request_free_list, _request_free_list_free_on_exit, free_list);
 	} else {
 		free_list = request_free_list;
 	}
 
-	request = fr_dlist_head(free_list);
+	/*
+	 *	Only reuse requests whose pool was allocated
+	 *	at the size the caller asked for.
+	 */
+	pool_list = &free_list->pool[request_pool_class(pool_size)];
+	free_list->last_alloc[request_pool_class(pool_size)] = ++free_list->allocs;
+
+	request = fr_dlist_head(pool_list);
 	if (!request) {
 		/*
 		 *	Must be allocated with in the NULL ctx
 		 *	as chunk is returned to the free list.
 		 */
-		request = request_alloc_pool(NULL);
+		request = request_alloc_pool(NULL, pool_size);
 		talloc_set_destructor(request, _request_free);
 	} else {
 		/*
 		 *	Remove from the free list, as we're
 		 *	about to use it!
 		 */
-		fr_dlist_remove(free_list, request);
+		fr_dlist_remove(pool_list, request);
+		free_list->num--;
 	}
 
 	if (request_init(file, line, request, type, args) < 0) {
@@ -622,7 +732,7 @@ request_t *_request_local_alloc(char const *file, int line, TALLOC_CTX *ctx,
 {
 	request_t *request;
 
-	request = request_alloc_pool(ctx);
+	request = request_alloc_pool(ctx, request_pool_size_round(args ? args->pool_size : 0));
 	if (request_init(file, line, request, type, args) < 0) return NULL;
 
 	talloc_set_destructor(request, _request_local_free);
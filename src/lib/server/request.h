@@ -247,6 +247,10 @@ struct request_s {
 
 	fr_dlist_t		listen_entry;	//!< request's entry in the list for this listener / socket
 	fr_dlist_t		free_entry;	//!< Request's entry in the free list.
+
+	size_t			pool_size;	//!< Extra space reserved in the request's talloc pool
+						///< for pairs and value buffers.  Persists whilst the
+						///< request is in the free list.
 };				/* request_t typedef */
 
 /** Optional arguments for initialising requests
@@ -264,6 +268,12 @@ typedef struct {
 
 	bool			detachable;	//!< Request should be detachable, i.e. able to run even
 						///< if its parent exits.
+
+	size_t			pool_size;	//!< Hint for how much extra space to reserve in the
+						///< request's talloc pool for pairs and value buffers.
+						///< Hints are rounded up to a power of two, and requests
+						///< are only reused from the free list for the same size.
+						///< 0 uses the default.
 } request_init_args_t;
 
 #ifdef WITH_VERIFY_PTR
@@ -283,6 +293,9 @@ typedef struct {
 #define RAD_REQUEST_LVL_DEBUG3	(3)
 #define RAD_REQUEST_LVL_DEBUG4	(4)
 
+#define REQUEST_POOL_SIZE_MIN	(1024)		//!< Smallest non-zero value for request_init_args_t.pool_size.
+#define REQUEST_POOL_SIZE_MAX	(256 * 1024)	//!< Largest value for request_init_args_t.pool_size.
+
 #define RAD_REQUEST_OPTION_CTX	(1 << 1)
 #define RAD_REQUEST_OPTION_DETAIL (1 << 2)
 
@@ -39,6 +39,8 @@ RCSID("$Id$")
 
 static int pairlist_read_internal(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR_LIST_LIST *list,
 				  bool complain, bool v3_compat, int *order);
+static int pairlist_parse(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, int lineno,
+			  fr_sbuff_t *in, PAIR_LIST_LIST *list, bool v3_compat, int *order);
 
 static inline void line_error_marker(char const *src_file, int src_line,
 				     char const *user_file, int user_line,
@@ -239,19 +241,40 @@ int pairlist_read(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR
 	return pairlist_read_internal(ctx, dict, file, list, true, v3_compat, &order);
 }
 
+/** Read a buffer containing entries from a users file
+ *
+ * This is used to decode individual entries from a compiled users image.
+ *
+ * @param[in] ctx	to allocate entries in.
+ * @param[in] dict	to resolve attributes in.
+ * @param[in] file	the entries were originally read from.  Must remain
+ *			valid for the lifetime of the entries.
+ * @param[in] lineno	the first line of the buffer was at in the original file.
+ * @param[in] buffer	containing the entries.
+ * @param[in] len	of the buffer.
+ * @param[out] list	to append the entries to.
+ * @param[in] v3_compat	Allow v3 style enumeration names.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int pairlist_read_buffer(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, int lineno,
+			 char const *buffer, size_t len, PAIR_LIST_LIST *list, bool v3_compat)
+{
+	int		order = 0;
+
+	return pairlist_parse(ctx, dict, file, lineno, &FR_SBUFF_IN(buffer, len), list, v3_compat, &order);
+}
+
 /*
  *	Read the users file. Return a PAIR_LIST.
  */
 static int pairlist_read_internal(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR_LIST_LIST *list, bool complain, bool v3_compat, int *order)
 {
-	char			*q;
-	int			lineno		= 1;
-	map_t			*new_map, *relative_map;
 	FILE			*fp;
 	fr_sbuff_t		sbuff;
 	fr_sbuff_uctx_file_t	fctx;
-	tmpl_rules_t		lhs_rules, rhs_rules;
-	char			*filename = talloc_strdup(ctx, file);
+	int			ret;
 	char			buffer[8192];
 
 	DEBUG2("Reading file %s", file);
@@ -267,6 +290,23 @@ static int pairlist_read_internal(TALLOC_CTX *ctx, fr_dict_t const *dict, char c
 
 	fr_sbuff_init_file(&sbuff, &fctx, buffer, sizeof(buffer), fp, SIZE_MAX);
 
+	ret = pairlist_parse(ctx, dict, talloc_strdup(ctx, file), 1, &sbuff, list, v3_compat, order);
+	fclose(fp);
+
+	return ret;
+}
+
+/*
+ *	Parse entries from an sbuff, which may be backed by a file or memory.
+ */
+static int pairlist_parse(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, int lineno,
+			  fr_sbuff_t *in, PAIR_LIST_LIST *list, bool v3_compat, int *order)
+{
+	char			*q;
+	map_t			*new_map, *relative_map;
+	fr_sbuff_t		sbuff = FR_SBUFF(in);
+	tmpl_rules_t		lhs_rules, rhs_rules;
+
 	lhs_rules = (tmpl_rules_t) {
 		.attr = {
 			.dict_def = dict,
@@ -314,7 +354,6 @@ static int pairlist_read_internal(TALLOC_CTX *ctx, fr_dict_t const *dict, char c
 		if (leading_spaces) {
 	    		ERROR_MARKER(&sbuff, "Entry does not begin with a key value");
 		fail:
-			fclose(fp);
 			return -1;
 		}
 
@@ -345,7 +384,7 @@ static int pairlist_read_internal(TALLOC_CTX *ctx, fr_dict_t const *dict, char c
 		MEM(t = talloc_zero(ctx, PAIR_LIST));
 		map_list_init(&t->check);
 		map_list_init(&t->reply);
-		t->filename = filename;
+		t->filename = file;
 		t->lineno = lineno;
 		t->order = (*order)++;
 
@@ -602,8 +641,7 @@ next_reply_item:
 	 *	Else we were looking for an entry.  We didn't get one
 	 *	because we were at EOF, so that's OK.
 	 */
-
-	fclose(fp);
+	fr_sbuff_set(in, &sbuff);
 
 	return 0;
 }
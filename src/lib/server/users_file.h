@@ -55,6 +55,9 @@ typedef struct pair_list_list {
 
 int		pairlist_read(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, PAIR_LIST_LIST *list, bool v3_compat);
 
+int		pairlist_read_buffer(TALLOC_CTX *ctx, fr_dict_t const *dict, char const *file, int lineno,
+				     char const *buffer, size_t len, PAIR_LIST_LIST *list, bool v3_compat);
+
 static inline void pairlist_list_init(PAIR_LIST_LIST *list)
 {
 	fr_dlist_talloc_init(&list->head, PAIR_LIST, entry);
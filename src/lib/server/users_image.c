@@ -0,0 +1,721 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file users_image.c
+ * @brief Compiled, indexed images of users files.
+ *
+ * Parsing a users file with millions of entries means compiling millions
+ * of maps and tmpls at startup, most of which are never used.  An image
+ * instead contains a sorted index of keys, and the source text of each
+ * entry.  The image is mmapped, keys are found with a binary search, and
+ * only the entries for matching keys are parsed.
+ *
+ * The image is written in host byte order, and is not portable between
+ * architectures.  It contains no pointers, so it can be mapped anywhere.
+ *
+ * Entries which call xlat functions are flagged, so that they can be decoded
+ * when the image is loaded.  xlat function calls can't be instantiated once
+ * the server is processing requests.
+ *
+ @verbatim
+   users_image_header_t
+   users_image_key_t[num_keys]		sorted by name
+   users_image_entry_t[num_entries]	DEFAULT entries first, then grouped by key
+   uint64_t[num_files]			offsets of filenames in the string table
+   char[]				string table
+ @endverbatim
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/log.h>
+#include <freeradius-devel/server/tmpl.h>
+#include <freeradius-devel/server/users_image.h>
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define USERS_IMAGE_ENDIAN	(0x01020304)
+
+typedef struct {
+	char		magic[8];		//!< #USERS_IMAGE_MAGIC.
+	uint32_t	endian;			//!< #USERS_IMAGE_ENDIAN in host byte order.
+	uint32_t	num_keys;		//!< Number of distinct keys, not including DEFAULT.
+	uint32_t	num_entries;		//!< Number of entries, including DEFAULT.
+	uint32_t	num_default;		//!< Number of DEFAULT entries.
+	uint32_t	num_files;		//!< Number of source files.
+	uint32_t	reserved;
+	uint64_t	keys;			//!< Offset of the key index.
+	uint64_t	entries;		//!< Offset of the entry table.
+	uint64_t	files;			//!< Offset of the file table.
+	uint64_t	strings;		//!< Offset of the string table.
+	uint64_t	size;			//!< Total size of the image.
+} users_image_header_t;
+
+typedef struct {
+	uint64_t	name;			//!< Offset of the name in the string table.
+	uint32_t	name_len;		//!< Length of the name.
+	uint32_t	first;			//!< First entry for this key.
+	uint32_t	count;			//!< Number of entries for this key.
+	uint32_t	reserved;
+} users_image_key_t;
+
+#define USERS_IMAGE_ENTRY_XLAT	(1 << 0)	//!< Entry contains xlat expansions.
+
+typedef struct {
+	uint64_t	text;			//!< Offset of the source text in the string table.
+	uint32_t	text_len;		//!< Length of the source text.
+	uint32_t	order;			//!< Order the entry appeared in the original file.
+	uint32_t	lineno;			//!< Line number of the entry in the original file.
+	uint32_t	file;			//!< Index into the file table.
+	uint32_t	flags;			//!< USERS_IMAGE_ENTRY_* flags.
+	uint32_t	reserved;
+} users_image_entry_t;
+
+struct users_image_s {
+	char const			*filename;	//!< Image we mapped.
+	uint8_t const			*start;		//!< Start of the mapping.
+	size_t				len;		//!< Length of the mapping.
+
+	users_image_header_t const	*hdr;
+	users_image_key_t const		*keys;
+	users_image_entry_t const	*entries;
+	uint64_t const			*files;
+	char const			*strings;
+};
+
+/** Source file which entries were read from
+ *
+ */
+typedef struct {
+	char const	*filename;		//!< As referenced by the PAIR_LIST.
+	char		*buffer;		//!< Contents of the file.
+	size_t		len;			//!< Length of the file.
+	size_t		*lines;			//!< Offset of the start of each line.
+	size_t		num_lines;
+	uint32_t	index;			//!< In the image's file table.
+} users_image_src_t;
+
+/** Load a source file, and index the start of each line
+ *
+ */
+static users_image_src_t *users_image_src_load(TALLOC_CTX *ctx, char const *filename, uint32_t index)
+{
+	users_image_src_t	*src;
+	FILE			*fp;
+	struct stat		st;
+	size_t			i, n;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		fr_strerror_printf("Failed opening %s: %s", filename, fr_syserror(errno));
+		return NULL;
+	}
+
+	if (fstat(fileno(fp), &st) < 0) {
+		fr_strerror_printf("Failed examining %s: %s", filename, fr_syserror(errno));
+	error:
+		fclose(fp);
+		return NULL;
+	}
+
+	MEM(src = talloc_zero(ctx, users_image_src_t));
+	src->filename = filename;
+	src->index = index;
+	src->len = st.st_size;
+	MEM(src->buffer = talloc_array(src, char, src->len + 1));
+
+	if (fread(src->buffer, 1, src->len, fp) != src->len) {
+		fr_strerror_printf("Failed reading %s: %s", filename, fr_syserror(errno));
+		talloc_free(src);
+		goto error;
+	}
+	fclose(fp);
+	src->buffer[src->len] = '\0';
+
+	for (i = 0, n = 1; i < src->len; i++) if (src->buffer[i] == '\n') n++;
+
+	MEM(src->lines = talloc_array(src, size_t, n + 1));
+	src->lines[0] = 0;
+	for (i = 0, n = 1; i < src->len; i++) if (src->buffer[i] == '\n') src->lines[n++] = i + 1;
+	src->lines[n] = src->len;
+	src->num_lines = n;
+
+	return src;
+}
+
+/** Find the source text of an entry
+ *
+ * The entry is the line containing the key and check items, followed by
+ * any reply item lines.  Reply item lines begin with whitespace, and the
+ * list ends at a blank line, a comment, or a line which doesn't begin with
+ * whitespace.  This mirrors what pairlist_read() accepts.
+ */
+static int users_image_src_text(char const **text, size_t *len, users_image_src_t const *src, int lineno)
+{
+	size_t	line, end;
+
+	if ((lineno < 1) || ((size_t) lineno > src->num_lines)) {
+		fr_strerror_printf("%s[%d]: Line number out of range", src->filename, lineno);
+		return -1;
+	}
+
+	line = lineno - 1;
+	for (end = line + 1; end < src->num_lines; end++) {
+		char const *p = src->buffer + src->lines[end];
+		char const *q = src->buffer + src->lines[end + 1];
+
+		if ((p == q) || ((*p != ' ') && (*p != '\t'))) break;
+
+		while ((p < q) && ((*p == ' ') || (*p == '\t'))) p++;
+		if ((p == q) || (*p == '\n') || (*p == '#')) break;
+	}
+
+	*text = src->buffer + src->lines[line];
+	*len = src->lines[end] - src->lines[line];
+
+	return 0;
+}
+
+/** See if any map in a list, or its children, contains an xlat expansion
+ *
+ */
+static bool users_image_maps_xlat(map_list_t const *list)
+{
+	map_t const *map = NULL;
+
+	while ((map = map_list_next(list, map))) {
+		if (map->lhs && tmpl_contains_xlat(map->lhs)) return true;
+		if (map->rhs && tmpl_contains_xlat(map->rhs)) return true;
+		if (users_image_maps_xlat(&map->child)) return true;
+	}
+
+	return false;
+}
+
+static int8_t users_image_key_cmp(char const *a, size_t a_len, char const *b, size_t b_len)
+{
+	int ret;
+
+	ret = memcmp(a, b, (a_len < b_len) ? a_len : b_len);
+	if (ret != 0) return CMP(ret, 0);
+
+	return CMP(a_len, b_len);
+}
+
+/*
+ *	DEFAULT first, then by name, then by order in the file.
+ */
+static int users_image_entry_sort(void const *one, void const *two)
+{
+	PAIR_LIST const *a = *(PAIR_LIST const * const *) one;
+	PAIR_LIST const *b = *(PAIR_LIST const * const *) two;
+	bool a_default = (strcmp(a->name, "DEFAULT") == 0);
+	bool b_default = (strcmp(b->name, "DEFAULT") == 0);
+	int8_t ret;
+
+	ret = CMP(b_default, a_default);
+	if (ret != 0) return ret;
+
+	if (!a_default) {
+		ret = users_image_key_cmp(a->name, strlen(a->name), b->name, strlen(b->name));
+		if (ret != 0) return ret;
+	}
+
+	return CMP(a->order, b->order);
+}
+
+/** String table being built
+ *
+ */
+typedef struct {
+	char		*buffer;
+	size_t		used;
+} users_image_strings_t;
+
+/** Append data to the string table
+ *
+ */
+static uint64_t users_image_strings_add(users_image_strings_t *strings, char const *data, size_t len, bool terminate)
+{
+	size_t	offset = strings->used;
+	size_t	need = offset + len + terminate;
+
+	if (need > talloc_array_length(strings->buffer)) {
+		MEM(strings->buffer = talloc_realloc(NULL, strings->buffer, char, need * 2));
+	}
+	memcpy(strings->buffer + offset, data, len);
+	if (terminate) strings->buffer[offset + len] = '\0';
+	strings->used = need;
+
+	return offset;
+}
+
+/** Write a compiled image of a users file
+ *
+ * The list should have been produced by pairlist_read(), so that every
+ * entry is known to parse.  The source files are re-read to extract the
+ * text of each entry.
+ *
+ * The image is written to a temporary file, and renamed into place, so
+ * that a running server watching the image never sees a partial file.
+ *
+ * @param[in] out	Path of the image to write.
+ * @param[in] list	of entries, in file order.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int users_image_write(char const *out, PAIR_LIST_LIST const *list)
+{
+	TALLOC_CTX		*ctx;
+	PAIR_LIST const		*entry = NULL;
+	PAIR_LIST const		**sorted;
+	users_image_src_t	**srcs = NULL;
+	users_image_key_t	*keys;
+	users_image_entry_t	*entries;
+	uint64_t		*files;
+	users_image_strings_t	strings = {};
+	users_image_header_t	hdr = { .endian = USERS_IMAGE_ENDIAN };
+	size_t			num_entries, i, j;
+	char			*tmp;
+	FILE			*fp;
+	int			ret = -1;
+
+	memcpy(hdr.magic, USERS_IMAGE_MAGIC, sizeof(hdr.magic));
+
+	num_entries = fr_dlist_num_elements(&list->head);
+	if (num_entries > UINT32_MAX) {
+		fr_strerror_const("Too many entries");
+		return -1;
+	}
+
+	MEM(ctx = talloc_init_const("users_image_write"));
+	MEM(sorted = talloc_array(ctx, PAIR_LIST const *, num_entries));
+	MEM(strings.buffer = talloc_array(NULL, char, 4096));
+
+	i = 0;
+	while ((entry = fr_dlist_next(&list->head, entry))) sorted[i++] = entry;
+	qsort(sorted, num_entries, sizeof(sorted[0]), users_image_entry_sort);
+
+	MEM(keys = talloc_zero_array(ctx, users_image_key_t, num_entries));
+	MEM(entries = talloc_zero_array(ctx, users_image_entry_t, num_entries));
+
+	for (i = 0; i < num_entries; i++) {
+		users_image_src_t	*src = NULL;
+		char const		*text;
+		size_t			len;
+
+		entry = sorted[i];
+
+		/*
+		 *	Entries from the same file share the same
+		 *	filename pointer.
+		 */
+		for (j = 0; j < hdr.num_files; j++) {
+			if (srcs[j]->filename == entry->filename) {
+				src = srcs[j];
+				break;
+			}
+		}
+		if (!src) {
+			src = users_image_src_load(ctx, entry->filename, hdr.num_files);
+			if (!src) goto done;
+
+			MEM(srcs = talloc_realloc(ctx, srcs, users_image_src_t *, hdr.num_files + 1));
+			srcs[hdr.num_files++] = src;
+		}
+
+		if (users_image_src_text(&text, &len, src, entry->lineno) < 0) goto done;
+
+		entries[i] = (users_image_entry_t) {
+			.text = users_image_strings_add(&strings, text, len, false),
+			.text_len = len,
+			.order = entry->order,
+			.lineno = entry->lineno,
+			.file = src->index,
+			.flags = (users_image_maps_xlat(&entry->check) ||
+				  users_image_maps_xlat(&entry->reply)) ? USERS_IMAGE_ENTRY_XLAT : 0
+		};
+
+		if (strcmp(entry->name, "DEFAULT") == 0) {
+			hdr.num_default++;
+			continue;
+		}
+
+		/*
+		 *	Start a new key, or add to the previous one.
+		 */
+		if (hdr.num_keys > 0) {
+			users_image_key_t *prev = &keys[hdr.num_keys - 1];
+
+			if (users_image_key_cmp(strings.buffer + prev->name, prev->name_len,
+						entry->name, strlen(entry->name)) == 0) {
+				prev->count++;
+				continue;
+			}
+		}
+
+		keys[hdr.num_keys++] = (users_image_key_t) {
+			.name = users_image_strings_add(&strings, entry->name, strlen(entry->name), true),
+			.name_len = strlen(entry->name),
+			.first = i,
+			.count = 1
+		};
+	}
+
+	MEM(files = talloc_array(ctx, uint64_t, hdr.num_files));
+	for (j = 0; j < hdr.num_files; j++) {
+		files[j] = users_image_strings_add(&strings, srcs[j]->filename, strlen(srcs[j]->filename), true);
+	}
+
+	hdr.num_entries = num_entries;
+	hdr.keys = sizeof(hdr);
+	hdr.entries = hdr.keys + (hdr.num_keys * sizeof(keys[0]));
+	hdr.files = hdr.entries + (hdr.num_entries * sizeof(entries[0]));
+	hdr.strings = hdr.files + (hdr.num_files * sizeof(files[0]));
+	hdr.size = hdr.strings + strings.used;
+
+	MEM(tmp = talloc_asprintf(ctx, "%s.tmp", out));
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		fr_strerror_printf("Failed opening %s: %s", tmp, fr_syserror(errno));
+		goto done;
+	}
+
+	if ((fwrite(&hdr, sizeof(hdr), 1, fp) != 1) ||
+	    (fwrite(keys, sizeof(keys[0]), hdr.num_keys, fp) != hdr.num_keys) ||
+	    (fwrite(entries, sizeof(entries[0]), hdr.num_entries, fp) != hdr.num_entries) ||
+	    (fwrite(files, sizeof(files[0]), hdr.num_files, fp) != hdr.num_files) ||
+	    (fwrite(strings.buffer, 1, strings.used, fp) != strings.used)) {
+		fr_strerror_printf("Failed writing %s: %s", tmp, fr_syserror(errno));
+		fclose(fp);
+		unlink(tmp);
+		goto done;
+	}
+
+	if (fclose(fp) != 0) {
+		fr_strerror_printf("Failed writing %s: %s", tmp, fr_syserror(errno));
+		unlink(tmp);
+		goto done;
+	}
+
+	if (rename(tmp, out) < 0) {
+		fr_strerror_printf("Failed renaming %s to %s: %s", tmp, out, fr_syserror(errno));
+		unlink(tmp);
+		goto done;
+	}
+
+	ret = 0;
+
+done:
+	talloc_free(strings.buffer);
+	talloc_free(ctx);
+
+	return ret;
+}
+
+/** See if a file is a users image
+ *
+ * @param[in] filename	to check.
+ * @return
+ *	- true if the file starts with #USERS_IMAGE_MAGIC.
+ *	- false if the file can't be read, or is a normal users file.
+ */
+bool users_image_check(char const *filename)
+{
+	int	fd;
+	char	magic[sizeof(USERS_IMAGE_MAGIC) - 1];
+	bool	ret;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) return false;
+
+	ret = (read(fd, magic, sizeof(magic)) == sizeof(magic)) && (memcmp(magic, USERS_IMAGE_MAGIC, sizeof(magic)) == 0);
+	close(fd);
+
+	return ret;
+}
+
+static int _users_image_free(users_image_t *img)
+{
+	if (img->start) munmap(UNCONST(uint8_t *, img->start), img->len);
+
+	return 0;
+}
+
+#define IMAGE_TABLE_OK(_hdr, _offset, _num, _type) \
+	(((_offset) <= (_hdr)->size) && ((_num) <= (((_hdr)->size - (_offset)) / sizeof(_type))))
+
+/** Map a users image into memory
+ *
+ * Only the header and tables are validated here.  Individual entries are
+ * bounds checked as they're decoded.
+ *
+ * @param[in] ctx	to allocate the image handle in.  Freeing the handle
+ *			unmaps the image.
+ * @param[in] filename	of the image.
+ * @return
+ *	- The image handle on success.
+ *	- NULL on failure.
+ */
+users_image_t *users_image_open(TALLOC_CTX *ctx, char const *filename)
+{
+	users_image_t			*img;
+	users_image_header_t const	*hdr;
+	struct stat			st;
+	void				*start;
+	int				fd;
+	uint32_t			i;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fr_strerror_printf("Failed opening %s: %s", filename, fr_syserror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		fr_strerror_printf("Failed examining %s: %s", filename, fr_syserror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	if ((size_t) st.st_size < sizeof(*hdr)) {
+		fr_strerror_printf("%s is too small to be a users image", filename);
+		close(fd);
+		return NULL;
+	}
+
+	start = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (start == MAP_FAILED) {
+		fr_strerror_printf("Failed mapping %s: %s", filename, fr_syserror(errno));
+		return NULL;
+	}
+
+	MEM(img = talloc_zero(ctx, users_image_t));
+	img->filename = talloc_typed_strdup(img, filename);
+	img->start = start;
+	img->len = st.st_size;
+	talloc_set_destructor(img, _users_image_free);
+
+	hdr = img->hdr = (users_image_header_t const *) img->start;
+	if (memcmp(hdr->magic, USERS_IMAGE_MAGIC, sizeof(hdr->magic)) != 0) {
+		fr_strerror_printf("%s is not a users image, or was created by a different version of the server",
+				   filename);
+	error:
+		talloc_free(img);
+		return NULL;
+	}
+
+	if (hdr->endian != USERS_IMAGE_ENDIAN) {
+		fr_strerror_printf("%s was created on a machine with a different byte order", filename);
+		goto error;
+	}
+
+	if ((hdr->size != img->len) ||
+	    !IMAGE_TABLE_OK(hdr, hdr->keys, hdr->num_keys, users_image_key_t) ||
+	    !IMAGE_TABLE_OK(hdr, hdr->entries, hdr->num_entries, users_image_entry_t) ||
+	    !IMAGE_TABLE_OK(hdr, hdr->files, hdr->num_files, uint64_t) ||
+	    (hdr->strings > hdr->size) || (hdr->num_default > hdr->num_entries)) {
+		fr_strerror_printf("%s is truncated or corrupt", filename);
+		goto error;
+	}
+
+	img->keys = (users_image_key_t const *) (img->start + hdr->keys);
+	img->entries = (users_image_entry_t const *) (img->start + hdr->entries);
+	img->files = (uint64_t const *) (img->start + hdr->files);
+	img->strings = (char const *) (img->start + hdr->strings);
+
+	/*
+	 *	Filenames are used as-is by the parser, so they must
+	 *	be terminated.
+	 */
+	for (i = 0; i < hdr->num_files; i++) {
+		if ((img->files[i] >= (hdr->size - hdr->strings)) ||
+		    !memchr(img->strings + img->files[i], '\0', (hdr->size - hdr->strings) - img->files[i])) {
+			fr_strerror_printf("%s has a corrupt file table", filename);
+			goto error;
+		}
+	}
+
+	/*
+	 *	Index lookups are binary searches, so readahead
+	 *	doesn't help.
+	 */
+#ifdef MADV_RANDOM
+	(void) madvise(UNCONST(uint8_t *, img->start), img->len, MADV_RANDOM);
+#endif
+
+	DEBUG2("Mapped users image %s with %u keys and %u entries", filename, hdr->num_keys, hdr->num_entries);
+
+	return img;
+}
+
+/** Return the number of distinct keys in the image
+ *
+ */
+uint32_t users_image_num_keys(users_image_t const *img)
+{
+	return img->hdr->num_keys;
+}
+
+/** Parse entries from the image, and append them to a list
+ *
+ */
+static int users_image_decode_entries(TALLOC_CTX *ctx, PAIR_LIST_LIST *out, users_image_t const *img,
+				      uint32_t first, uint32_t count, fr_dict_t const *dict, bool v3_compat)
+{
+	uint32_t		i;
+	uint64_t		strings_len = img->hdr->size - img->hdr->strings;
+
+	if ((first > img->hdr->num_entries) || (count > (img->hdr->num_entries - first))) {
+	corrupt:
+		fr_strerror_printf("%s is corrupt", img->filename);
+		return -1;
+	}
+
+	for (i = first; i < (first + count); i++) {
+		users_image_entry_t const	*e = &img->entries[i];
+		PAIR_LIST_LIST			tmp;
+		PAIR_LIST			*t;
+
+		if ((e->file >= img->hdr->num_files) ||
+		    (e->text > strings_len) || (e->text_len > (strings_len - e->text))) goto corrupt;
+
+		pairlist_list_init(&tmp);
+		if (pairlist_read_buffer(ctx, dict, img->strings + img->files[e->file], e->lineno,
+					 img->strings + e->text, e->text_len, &tmp, v3_compat) < 0) return -1;
+
+		while ((t = fr_dlist_pop_head(&tmp.head))) {
+			t->order = e->order;
+			fr_dlist_insert_tail(&out->head, t);
+		}
+	}
+
+	return 0;
+}
+
+/** Decode all of the DEFAULT entries in the image
+ *
+ * @param[in] ctx	to allocate entries in.
+ * @param[out] out	list to append entries to.
+ * @param[in] img	to decode entries from.
+ * @param[in] dict	to resolve attributes in.
+ * @param[in] v3_compat	Allow v3 style enumeration names.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int users_image_decode_default(TALLOC_CTX *ctx, PAIR_LIST_LIST *out, users_image_t const *img,
+			       fr_dict_t const *dict, bool v3_compat)
+{
+	return users_image_decode_entries(ctx, out, img, 0, img->hdr->num_default, dict, v3_compat);
+}
+
+/** Decode the entries for every key which has entries containing xlat expansions
+ *
+ * Must be called when the image is loaded, before the server starts processing
+ * requests.  All of the entries for a matching key are decoded, so that the key
+ * is complete, and never needs to be decoded by #users_image_decode.
+ *
+ * @param[in] ctx	to allocate entries in.
+ * @param[out] out	list to append entries to.  Entries for the same key are
+ *			adjacent, and in file order.
+ * @param[in] img	to decode entries from.
+ * @param[in] dict	to resolve attributes in.
+ * @param[in] v3_compat	Allow v3 style enumeration names.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int users_image_decode_xlat(TALLOC_CTX *ctx, PAIR_LIST_LIST *out, users_image_t const *img,
+			    fr_dict_t const *dict, bool v3_compat)
+{
+	uint32_t	i, j;
+
+	for (i = 0; i < img->hdr->num_keys; i++) {
+		users_image_key_t const *k = &img->keys[i];
+
+		if ((k->first > img->hdr->num_entries) || (k->count > (img->hdr->num_entries - k->first))) {
+			fr_strerror_printf("%s has a corrupt key index", img->filename);
+			return -1;
+		}
+
+		for (j = k->first; j < (k->first + k->count); j++) {
+			if (!(img->entries[j].flags & USERS_IMAGE_ENTRY_XLAT)) continue;
+
+			if (users_image_decode_entries(ctx, out, img, k->first, k->count, dict, v3_compat) < 0) return -1;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/** Find a key in the image, and decode its entries
+ *
+ * @param[in] ctx	to allocate entries in.
+ * @param[out] out	list to append entries to.
+ * @param[in] img	to search.
+ * @param[in] key	to search for.
+ * @param[in] key_len	length of the key.
+ * @param[in] dict	to resolve attributes in.
+ * @param[in] v3_compat	Allow v3 style enumeration names.
+ * @return
+ *	- 1 if the key was found, and its entries were decoded.
+ *	- 0 if the key was not found.
+ *	- -1 on failure.
+ */
+int users_image_decode(TALLOC_CTX *ctx, PAIR_LIST_LIST *out, users_image_t const *img,
+		       char const *key, size_t key_len, fr_dict_t const *dict, bool v3_compat)
+{
+	uint32_t	lo = 0, hi = img->hdr->num_keys;
+	uint64_t	strings_len = img->hdr->size - img->hdr->strings;
+
+	while (lo < hi) {
+		uint32_t			mid = lo + ((hi - lo) / 2);
+		users_image_key_t const		*k = &img->keys[mid];
+		int8_t				ret;
+
+		if ((k->name > strings_len) || (k->name_len > (strings_len - k->name))) {
+			fr_strerror_printf("%s has a corrupt key index", img->filename);
+			return -1;
+		}
+
+		ret = users_image_key_cmp(key, key_len, img->strings + k->name, k->name_len);
+		if (ret == 0) {
+			if (users_image_decode_entries(ctx, out, img, k->first, k->count, dict, v3_compat) < 0) return -1;
+			return 1;
+		}
+
+		if (ret < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	return 0;
+}
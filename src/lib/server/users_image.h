@@ -0,0 +1,61 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file lib/server/users_image.h
+ * @brief Compiled, indexed images of users files.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(users_image_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/server/users_file.h>
+
+/** Magic at the start of every users image
+ *
+ * The last character is the format version.
+ */
+#define USERS_IMAGE_MAGIC	"FRUSERS2"
+
+typedef struct users_image_s users_image_t;
+
+int		users_image_write(char const *out, PAIR_LIST_LIST const *list);
+
+bool		users_image_check(char const *filename);
+
+users_image_t	*users_image_open(TALLOC_CTX *ctx, char const *filename);
+
+uint32_t	users_image_num_keys(users_image_t const *img);
+
+int		users_image_decode_default(TALLOC_CTX *ctx, PAIR_LIST_LIST *out, users_image_t const *img,
+					   fr_dict_t const *dict, bool v3_compat);
+
+int		users_image_decode_xlat(TALLOC_CTX *ctx, PAIR_LIST_LIST *out, users_image_t const *img,
+					fr_dict_t const *dict, bool v3_compat);
+
+int		users_image_decode(TALLOC_CTX *ctx, PAIR_LIST_LIST *out, users_image_t const *img,
+				   char const *key, size_t key_len, fr_dict_t const *dict, bool v3_compat);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,302 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for compiled users file images
+ *
+ * @file src/lib/server/users_image_tests.c
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/dict_test.h>
+
+#include <freeradius-devel/server/request.h>
+
+/*
+ *	Include the source, so the tests can corrupt the
+ *	on-disk structures.
+ */
+#include "users_image.c"
+
+static TALLOC_CTX	*autofree;
+static fr_dict_t	*test_dict;
+
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("users_image_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) goto error;
+
+	if (fr_dict_test_init(autofree, &test_dict, NULL) < 0) goto error;
+
+	if (request_global_init() < 0) goto error;
+}
+
+static char const users_text[] =
+	"bob\tTest-String == \"one\"\n"
+	"\tTest-Uint32 := 1\n"
+	"\n"
+	"alice\n"
+	"\tTest-Uint32 := 2\n"
+	"\n"
+	"DEFAULT\n"
+	"\tTest-Uint32 += 3\n"
+	"\n"
+	"bob\n"
+	"\tTest-Uint32 := 4,\n"
+	"\tTest-Uint8 := 5\n"
+	"\n"
+	"carol\n"
+	"\tTest-String := \"%{Test-String}\"\n";
+
+typedef struct {
+	char		*users;			//!< Source users file.
+	char		*image;			//!< Compiled image.
+} test_files_t;
+
+/** Write a users file, and compile it into an image
+ *
+ */
+static void test_files_init(test_files_t *files, TALLOC_CTX *ctx, char const *name)
+{
+	PAIR_LIST_LIST	list;
+	FILE		*fp;
+
+	files->users = talloc_typed_asprintf(ctx, "/tmp/users_image_tests_%s_%u", name, (unsigned int)getpid());
+	files->image = talloc_typed_asprintf(ctx, "%s.db", files->users);
+
+	fp = fopen(files->users, "w");
+	TEST_ASSERT(fp != NULL);
+	TEST_CHECK(fputs(users_text, fp) >= 0);
+	fclose(fp);
+
+	pairlist_list_init(&list);
+	TEST_ASSERT(pairlist_read(ctx, test_dict, files->users, &list, false) == 0);
+	TEST_CHECK(fr_dlist_num_elements(&list.head) == 5);
+
+	TEST_ASSERT(users_image_write(files->image, &list) == 0);
+}
+
+static void test_files_free(test_files_t *files)
+{
+	unlink(files->users);
+	unlink(files->image);
+}
+
+/** Modify the image on disk
+ *
+ */
+static void test_image_patch(char const *filename, off_t offset, void const *data, size_t len)
+{
+	int fd;
+
+	fd = open(filename, O_WRONLY);
+	TEST_ASSERT(fd >= 0);
+	TEST_CHECK(pwrite(fd, data, len, offset) == (ssize_t)len);
+	close(fd);
+}
+
+static void test_image_round_trip(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("test");
+	test_files_t	files;
+	users_image_t	*img;
+	PAIR_LIST_LIST	out;
+	PAIR_LIST	*entry;
+
+	test_files_init(&files, ctx, "round_trip");
+
+	TEST_CHECK(users_image_check(files.image));
+	TEST_CHECK(!users_image_check(files.users));
+
+	img = users_image_open(ctx, files.image);
+	TEST_ASSERT(img != NULL);
+	TEST_CHECK(users_image_num_keys(img) == 3);
+
+	/*
+	 *	Both "bob" entries, in file order.
+	 */
+	pairlist_list_init(&out);
+	TEST_CHECK(users_image_decode(ctx, &out, img, "bob", 3, test_dict, false) == 1);
+	TEST_ASSERT(fr_dlist_num_elements(&out.head) == 2);
+
+	entry = fr_dlist_head(&out.head);
+	TEST_CHECK_STRCMP(entry->name, "bob");
+	TEST_CHECK(entry->lineno == 1);
+	TEST_CHECK(map_list_num_elements(&entry->check) == 1);
+	TEST_CHECK(map_list_num_elements(&entry->reply) == 1);
+
+	entry = fr_dlist_next(&out.head, entry);
+	TEST_CHECK(entry->lineno == 10);
+	TEST_CHECK(map_list_num_elements(&entry->reply) == 2);
+	TEST_CHECK(entry->order > ((PAIR_LIST *)fr_dlist_head(&out.head))->order);
+
+	/*
+	 *	Missing keys, and prefixes of keys, aren't found.
+	 */
+	pairlist_list_init(&out);
+	TEST_CHECK(users_image_decode(ctx, &out, img, "dave", 4, test_dict, false) == 0);
+	TEST_CHECK(users_image_decode(ctx, &out, img, "bo", 2, test_dict, false) == 0);
+	TEST_CHECK(fr_dlist_num_elements(&out.head) == 0);
+
+	pairlist_list_init(&out);
+	TEST_CHECK(users_image_decode_default(ctx, &out, img, test_dict, false) == 0);
+	TEST_ASSERT(fr_dlist_num_elements(&out.head) == 1);
+	entry = fr_dlist_head(&out.head);
+	TEST_CHECK_STRCMP(entry->name, "DEFAULT");
+	TEST_CHECK(entry->lineno == 7);
+
+	/*
+	 *	Only "carol" contains an xlat.
+	 */
+	pairlist_list_init(&out);
+	TEST_CHECK(users_image_decode_xlat(ctx, &out, img, test_dict, false) == 0);
+	TEST_ASSERT(fr_dlist_num_elements(&out.head) == 1);
+	entry = fr_dlist_head(&out.head);
+	TEST_CHECK_STRCMP(entry->name, "carol");
+
+	talloc_free(img);
+	test_files_free(&files);
+	talloc_free(ctx);
+}
+
+static void test_image_truncated(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("test");
+	test_files_t	files;
+	struct stat	st;
+
+	test_files_init(&files, ctx, "truncated");
+	TEST_ASSERT(stat(files.image, &st) == 0);
+
+	/*
+	 *	Missing the end of the string table.
+	 */
+	TEST_CHECK(truncate(files.image, st.st_size - 1) == 0);
+	TEST_CHECK(users_image_open(ctx, files.image) == NULL);
+	TEST_MSG("Expected truncated image to be rejected");
+
+	/*
+	 *	Shorter than the header.
+	 */
+	TEST_CHECK(truncate(files.image, sizeof(users_image_header_t) - 1) == 0);
+	TEST_CHECK(users_image_open(ctx, files.image) == NULL);
+
+	test_files_free(&files);
+	talloc_free(ctx);
+}
+
+static void test_image_corrupt(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("test");
+	test_files_t		files;
+	users_image_t		*img;
+	users_image_header_t	hdr;
+	PAIR_LIST_LIST		out;
+	uint64_t		bad = UINT64_MAX / 2;
+	uint32_t		bad_count = UINT32_MAX;
+	int			fd;
+
+	test_files_init(&files, ctx, "corrupt");
+
+	fd = open(files.image, O_RDONLY);
+	TEST_ASSERT(fd >= 0);
+	TEST_ASSERT(read(fd, &hdr, sizeof(hdr)) == sizeof(hdr));
+	close(fd);
+
+	/*
+	 *	Key index pointing past the end of the image.
+	 */
+	test_image_patch(files.image, offsetof(users_image_header_t, keys), &bad, sizeof(bad));
+	TEST_CHECK(users_image_open(ctx, files.image) == NULL);
+	test_image_patch(files.image, offsetof(users_image_header_t, keys), &hdr.keys, sizeof(hdr.keys));
+
+	/*
+	 *	Entry text pointing past the end of the string table
+	 *	is only noticed when the entry is decoded.
+	 */
+	test_image_patch(files.image, hdr.entries + offsetof(users_image_entry_t, text), &bad, sizeof(bad));
+	img = users_image_open(ctx, files.image);
+	TEST_ASSERT(img != NULL);
+
+	pairlist_list_init(&out);
+	TEST_CHECK(users_image_decode_default(ctx, &out, img, test_dict, false) < 0);
+	talloc_free(img);
+
+	/*
+	 *	Key with more entries than the image has.
+	 */
+	test_files_init(&files, ctx, "corrupt");
+	test_image_patch(files.image, hdr.keys + offsetof(users_image_key_t, count), &bad_count, sizeof(bad_count));
+	img = users_image_open(ctx, files.image);
+	TEST_ASSERT(img != NULL);
+
+	pairlist_list_init(&out);
+	TEST_CHECK(users_image_decode_xlat(ctx, &out, img, test_dict, false) < 0);
+	talloc_free(img);
+
+	test_files_free(&files);
+	talloc_free(ctx);
+}
+
+static void test_image_version(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("test");
+	test_files_t	files;
+	char const	old_magic[] = "FRUSERS1";
+	uint32_t	endian = 0x04030201;
+
+	test_files_init(&files, ctx, "version");
+
+	/*
+	 *	Written by a different version.
+	 */
+	test_image_patch(files.image, 0, old_magic, sizeof(old_magic) - 1);
+	TEST_CHECK(!users_image_check(files.image));
+	TEST_CHECK(users_image_open(ctx, files.image) == NULL);
+	TEST_CHECK(strstr(fr_strerror(), "different version") != NULL);
+	TEST_MSG("Got error \"%s\"", fr_strerror());
+
+	/*
+	 *	Written on a machine with a different byte order.
+	 */
+	test_files_init(&files, ctx, "version");
+	test_image_patch(files.image, offsetof(users_image_header_t, endian), &endian, sizeof(endian));
+	TEST_CHECK(users_image_open(ctx, files.image) == NULL);
+	TEST_CHECK(strstr(fr_strerror(), "byte order") != NULL);
+	TEST_MSG("Got error \"%s\"", fr_strerror());
+
+	test_files_free(&files);
+	talloc_free(ctx);
+}
+
+TEST_LIST = {
+	{ "image_round_trip",	test_image_round_trip },
+	{ "image_truncated",	test_image_truncated },
+	{ "image_corrupt",	test_image_corrupt },
+	{ "image_version",	test_image_version },
+	{ NULL }
+};
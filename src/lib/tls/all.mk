@@ -2,6 +2,7 @@ TARGETNAME	:= libfreeradius-tls
 
 ifneq ($(OPENSSL_LIBS),)
 TARGET		:= $(TARGETNAME)$(L)
+SUBMAKEFILES	:= pairs_tests.mk
 endif
 
 SOURCES	:= \
@@ -29,10 +29,19 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 #define LOG_PREFIX "tls"
 
 #include <freeradius-devel/tls/openssl_user_macros.h>
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
 #include <freeradius-devel/util/pair.h>
 #include <freeradius-devel/server/request.h>
 #include <freeradius-devel/server/pair.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
 #include "attrs.h"
 #include "base.h"
 #include "bio.h"
@@ -40,6 +49,8 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 #include "session.h"
 #include "utils.h"
 
+#include <openssl/evp.h>
+#include <openssl/sha.h>
 #include <openssl/x509v3.h>
 #include <openssl/ssl.h>
 
@@ -106,18 +117,18 @@ static bool tls_session_pairs_from_san(fr_pair_list_t *pair_list, TALLOC_CTX *ct
 	return true;
 }
 
-/** Extract attributes from an X509 certificate
+/** Decode attributes from an X509 certificate
  *
  * @param[out] pair_list	to copy attributes to.
  * @param[in] ctx		to allocate attributes in.
  * @param[in] request		the current request.
  * @param[in] cert		to validate.
  * @return
- *	- 1 already exists.
  *	- 0 on success.
  *	- < 0 on failure.
  */
-int fr_tls_session_pairs_from_x509_cert(fr_pair_list_t *pair_list, TALLOC_CTX *ctx, request_t *request, X509 *cert)
+static int tls_session_pairs_from_x509_cert_decode(fr_pair_list_t *pair_list, TALLOC_CTX *ctx,
+						   request_t *request, X509 *cert)
 {
 	int		loc;
 	char		buff[1024];
@@ -360,4 +371,191 @@ done:
 }
 DIAG_ON(used-but-marked-unused)
 DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
+
+/** Maximum number of certificates each thread keeps decoded attributes for
+ *
+ */
+#define TLS_CERT_CACHE_SIZE	4096
+
+/** Decoded attributes for one certificate
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;				//!< Entry in the LRU list.
+	uint8_t			digest[SHA256_DIGEST_LENGTH];	//!< SHA-256 of the DER encoded certificate.
+	fr_pair_list_t		pairs;				//!< Attributes decoded from the certificate.
+} tls_cert_cache_entry_t;
+
+/** Per-thread cache of decoded certificate attributes
+ *
+ * The same device and CA certificates are presented over and over again,
+ * so decoding them once per thread saves a lot of ASN.1 parsing and
+ * allocations.
+ */
+typedef struct {
+	fr_hash_table_t		*ht;				//!< Entries by digest.
+	fr_dlist_head_t		lru;				//!< Most recently used at the head.
+	uint64_t		generation;			//!< Of the cache, see #fr_tls_session_pairs_cache_invalidate.
+	fr_tls_cert_cache_stats_t stats;			//!< Counters for the cache.
+} tls_cert_cache_t;
+
+static _Thread_local tls_cert_cache_t	*tls_cert_cache;
+
+/** Incremented whenever the cached attributes must be discarded
+ *
+ */
+static atomic_uint_fast64_t		tls_cert_cache_generation;
+
+static uint32_t tls_cert_cache_hash(void const *data)
+{
+	tls_cert_cache_entry_t const *entry = data;
+
+	return fr_hash(entry->digest, sizeof(entry->digest));
+}
+
+static int8_t tls_cert_cache_cmp(void const *one, void const *two)
+{
+	tls_cert_cache_entry_t const *a = one, *b = two;
+
+	return CMP(memcmp(a->digest, b->digest, sizeof(a->digest)), 0);
+}
+
+static int _tls_cert_cache_free(void *uctx)
+{
+	tls_cert_cache_t *cache = talloc_get_type_abort(uctx, tls_cert_cache_t);
+
+	if (cache == tls_cert_cache) tls_cert_cache = NULL;
+
+	return talloc_free(cache);
+}
+
+/** Return the thread's certificate cache, emptying it if it has been invalidated
+ *
+ */
+static tls_cert_cache_t *tls_cert_cache_get(void)
+{
+	tls_cert_cache_t	*cache = tls_cert_cache;
+	uint64_t		generation = atomic_load_explicit(&tls_cert_cache_generation, memory_order_acquire);
+
+	if (unlikely(!cache)) {
+		MEM(cache = talloc_zero(NULL, tls_cert_cache_t));
+		MEM(cache->ht = fr_hash_table_alloc(cache, tls_cert_cache_hash, tls_cert_cache_cmp, NULL));
+		fr_dlist_talloc_init(&cache->lru, tls_cert_cache_entry_t, entry);
+		cache->generation = generation;
+
+		fr_atexit_thread_local(tls_cert_cache, _tls_cert_cache_free, cache);
+		return cache;
+	}
+
+	if (unlikely(cache->generation != generation)) {
+		tls_cert_cache_entry_t *entry;
+
+		while ((entry = fr_dlist_pop_head(&cache->lru))) {
+			fr_hash_table_remove(cache->ht, entry);
+			talloc_free(entry);
+		}
+		cache->stats.entries = 0;
+		cache->generation = generation;
+	}
+
+	return cache;
+}
+
+/** Discard all cached certificate attributes
+ *
+ * The attributes depend only on the DER encoding of the certificate,
+ * which the cache is keyed by, and on the dictionaries.  Loading CA or
+ * CRL configuration doesn't change them, as whether a certificate is
+ * trusted is decided afresh for every handshake.  So this only needs
+ * to be called if the dictionaries are reloaded.
+ *
+ * Each thread empties its cache the next time it's used.
+ */
+void fr_tls_session_pairs_cache_invalidate(void)
+{
+	atomic_fetch_add_explicit(&tls_cert_cache_generation, 1, memory_order_release);
+}
+
+/** Return the counters for the calling thread's certificate cache
+ *
+ * The counters remain valid until the thread exits.
+ */
+fr_tls_cert_cache_stats_t const *fr_tls_session_pairs_cache_stats(void)
+{
+	return &tls_cert_cache_get()->stats;
+}
+
+/** Extract attributes from an X509 certificate
+ *
+ * Attributes are cached per thread, keyed by the SHA-256 digest of the
+ * certificate, so certificates which have been seen before are copied
+ * from the cache instead of being decoded again.
+ *
+ * @param[out] pair_list	to copy attributes to.
+ * @param[in] ctx		to allocate attributes in.
+ * @param[in] request		the current request.
+ * @param[in] cert		to validate.
+ * @return
+ *	- 0 on success.
+ *	- < 0 on failure.
+ */
+int fr_tls_session_pairs_from_x509_cert(fr_pair_list_t *pair_list, TALLOC_CTX *ctx, request_t *request, X509 *cert)
+{
+	tls_cert_cache_t	*cache = tls_cert_cache_get();
+	tls_cert_cache_entry_t	find, *entry;
+	unsigned int		len = sizeof(find.digest);
+	fr_pair_list_t		tmp;
+
+	if (unlikely(X509_digest(cert, EVP_sha256(), find.digest, &len) != 1)) {
+		fr_tls_log(request, "Failed calculating certificate digest");
+		return -1;
+	}
+
+	entry = fr_hash_table_find(cache->ht, &find);
+	if (entry) {
+		RDEBUG3("Using cached attributes for certificate");
+		cache->stats.hits++;
+
+		fr_dlist_remove(&cache->lru, entry);
+		fr_dlist_insert_head(&cache->lru, entry);
+
+		if (fr_pair_list_copy(ctx, pair_list, &entry->pairs) < 0) {
+			fr_tls_log(request, "Failed copying cached certificate attributes");
+			return -1;
+		}
+		return 0;
+	}
+
+	cache->stats.misses++;
+
+	fr_pair_list_init(&tmp);
+	if (tls_session_pairs_from_x509_cert_decode(&tmp, ctx, request, cert) < 0) return -1;
+
+	/*
+	 *	Evict the least recently used certificate
+	 */
+	if (fr_dlist_num_elements(&cache->lru) >= TLS_CERT_CACHE_SIZE) {
+		tls_cert_cache_entry_t *old = fr_dlist_pop_tail(&cache->lru);
+
+		fr_hash_table_remove(cache->ht, old);
+		talloc_free(old);
+		cache->stats.evictions++;
+		cache->stats.entries--;
+	}
+
+	MEM(entry = talloc_zero(cache, tls_cert_cache_entry_t));
+	memcpy(entry->digest, find.digest, sizeof(entry->digest));
+	fr_pair_list_init(&entry->pairs);
+
+	if ((fr_pair_list_copy(entry, &entry->pairs, &tmp) < 0) || !fr_hash_table_insert(cache->ht, entry)) {
+		talloc_free(entry);
+	} else {
+		fr_dlist_insert_head(&cache->lru, entry);
+		cache->stats.entries++;
+	}
+
+	fr_pair_list_append(pair_list, &tmp);
+
+	return 0;
+}
 #endif
@@ -0,0 +1,239 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the per-thread cache of decoded certificate attributes
+ *
+ * The certificates are generated at startup, and differ only in their
+ * serial number and subject.
+ *
+ * @file src/lib/tls/pairs_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/tls/base.h>
+#include <freeradius-devel/tls/session.h>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+static TALLOC_CTX	*autofree;
+static EVP_PKEY		*test_key;
+static request_t	*request;
+
+/** Create a self signed certificate
+ *
+ */
+static X509 *test_cert_alloc(long serial)
+{
+	X509		*cert;
+	X509_NAME	*name;
+	char		cn[32];
+
+	MEM(cert = X509_new());
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
+	X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+	X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+	X509_set_pubkey(cert, test_key);
+
+	snprintf(cn, sizeof(cn), "cache test %ld", serial);
+	name = X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (unsigned char const *)cn, -1, -1, 0);
+	X509_set_issuer_name(cert, name);
+
+	if (!X509_sign(cert, test_key, EVP_sha256())) {
+		X509_free(cert);
+		return NULL;
+	}
+
+	return cert;
+}
+
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("pairs_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) goto error;
+
+	if (fr_time_start() < 0) goto error;
+
+	if (!fr_dict_global_ctx_init(autofree, true, TEST_DICT_DIR)) goto error;
+
+	if (fr_openssl_init() < 0) goto error;
+
+	if (fr_tls_dict_init() < 0) goto error;
+
+	if (request_global_init() < 0) goto error;
+
+	request = request_local_alloc_external(autofree, (&(request_init_args_t){ .namespace = fr_dict_internal() }));
+	if (!request) goto error;
+
+	test_key = EVP_PKEY_Q_keygen(NULL, NULL, "EC", "P-256");
+	if (!test_key) goto error;
+}
+
+/** Get the attributes for a certificate, and return how many there were
+ *
+ */
+static unsigned int test_pairs_from_cert(X509 *cert)
+{
+	fr_pair_list_t	list;
+	unsigned int	num;
+
+	fr_pair_list_init(&list);
+	TEST_CHECK(fr_tls_session_pairs_from_x509_cert(&list, autofree, request, cert) == 0);
+
+	num = fr_pair_list_num_elements(&list);
+	fr_pair_list_free(&list);
+
+	return num;
+}
+
+/** The first lookup decodes the certificate, later ones copy the cached attributes
+ *
+ */
+static void test_cache_hit_miss(void)
+{
+	fr_tls_cert_cache_stats_t const	*stats = fr_tls_session_pairs_cache_stats();
+	fr_tls_cert_cache_stats_t	before;
+	X509				*cert, *other;
+	unsigned int			num;
+
+	fr_tls_session_pairs_cache_invalidate();
+
+	MEM(cert = test_cert_alloc(1));
+	MEM(other = test_cert_alloc(2));
+
+	TEST_CASE("A new certificate is a miss");
+	before = *stats;
+	num = test_pairs_from_cert(cert);
+	TEST_CHECK(num > 0);
+	TEST_CHECK(stats->misses == before.misses + 1);
+	TEST_CHECK(stats->hits == before.hits);
+	TEST_CHECK(stats->entries == 1);
+
+	TEST_CASE("The same certificate is a hit, and gets the same attributes");
+	TEST_CHECK(test_pairs_from_cert(cert) == num);
+	TEST_CHECK(stats->misses == before.misses + 1);
+	TEST_CHECK(stats->hits == before.hits + 1);
+	TEST_CHECK(stats->entries == 1);
+
+	TEST_CASE("A different certificate is a miss");
+	TEST_CHECK(test_pairs_from_cert(other) > 0);
+	TEST_CHECK(stats->misses == before.misses + 2);
+	TEST_CHECK(stats->hits == before.hits + 1);
+	TEST_CHECK(stats->entries == 2);
+
+	X509_free(cert);
+	X509_free(other);
+}
+
+/** When the cache is full, the least recently used certificate is evicted
+ *
+ */
+static void test_cache_lru(void)
+{
+	fr_tls_cert_cache_stats_t const	*stats = fr_tls_session_pairs_cache_stats();
+	fr_tls_cert_cache_stats_t	before;
+	X509				*first, *second, *cert;
+	long				serial;
+
+	fr_tls_session_pairs_cache_invalidate();
+
+	MEM(first = test_cert_alloc(1));
+	MEM(second = test_cert_alloc(2));
+	test_pairs_from_cert(first);
+	test_pairs_from_cert(second);
+
+	/*
+	 *	Fill the cache, touching the first certificate
+	 *	each time so that the second is the least
+	 *	recently used.
+	 */
+	before = *stats;
+	for (serial = 3; (stats->evictions == before.evictions) && (serial < 100000); serial++) {
+		MEM(cert = test_cert_alloc(serial));
+		test_pairs_from_cert(cert);
+		X509_free(cert);
+
+		test_pairs_from_cert(first);
+	}
+	TEST_CHECK(stats->evictions == before.evictions + 1);
+	TEST_MSG("Nothing was evicted after %ld certificates", serial);
+
+	TEST_CASE("The recently used certificate is still cached");
+	before = *stats;
+	test_pairs_from_cert(first);
+	TEST_CHECK(stats->hits == before.hits + 1);
+
+	TEST_CASE("The least recently used certificate was evicted");
+	test_pairs_from_cert(second);
+	TEST_CHECK(stats->misses == before.misses + 1);
+
+	X509_free(first);
+	X509_free(second);
+}
+
+/** Invalidating the cache empties it
+ *
+ */
+static void test_cache_invalidate(void)
+{
+	fr_tls_cert_cache_stats_t const	*stats = fr_tls_session_pairs_cache_stats();
+	fr_tls_cert_cache_stats_t	before;
+	X509				*cert;
+
+	MEM(cert = test_cert_alloc(1));
+	test_pairs_from_cert(cert);
+
+	before = *stats;
+	test_pairs_from_cert(cert);
+	TEST_CHECK(stats->hits == before.hits + 1);
+
+	fr_tls_session_pairs_cache_invalidate();
+
+	TEST_CASE("After invalidation, a cached certificate is a miss");
+	before = *stats;
+	test_pairs_from_cert(cert);
+	TEST_CHECK(stats->misses == before.misses + 1);
+	TEST_CHECK(stats->hits == before.hits);
+	TEST_CHECK(stats->entries == 1);
+
+	X509_free(cert);
+}
+
+TEST_LIST = {
+	{ "cache_hit_miss",	test_cache_hit_miss },
+	{ "cache_lru",		test_cache_lru },
+	{ "cache_invalidate",	test_cache_invalidate },
+	{ NULL }
+};
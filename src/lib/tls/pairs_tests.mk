@@ -0,0 +1,9 @@
+TARGET		:= pairs_tests$(E)
+SOURCES		:= pairs_tests.c
+
+SRC_CFLAGS	:= -DTEST_DICT_DIR=\"$(top_srcdir)/share/dictionary\"
+TGT_LDLIBS	:= $(LIBS) $(OPENSSL_LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(OPENSSL_FLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-tls$(L) libfreeradius-server$(L) libfreeradius-unlang$(L) libfreeradius-util$(L)
+
+TGT_INSTALLDIR	:=
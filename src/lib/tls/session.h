@@ -96,6 +96,16 @@ typedef enum {
 	FR_TLS_RESULT_SUCCESS		= 0x02		//!< Handshake round succeed.
 } fr_tls_result_t;
 
+/** Counters for the thread local cache of decoded certificate attributes
+ *
+ */
+typedef struct {
+	uint64_t	hits;			//!< Certificates whose attributes were copied from the cache.
+	uint64_t	misses;			//!< Certificates which had to be decoded.
+	uint64_t	evictions;		//!< Entries removed to make room for new ones.
+	uint32_t	entries;		//!< Number of entries currently in the cache.
+} fr_tls_cert_cache_stats_t;
+
 /** Tracks the state of a TLS session
  *
  * Currently used for RADSEC and EAP-TLS + dependents (EAP-TTLS, EAP-PEAP etc...).
@@ -305,6 +315,10 @@ void		fr_tls_session_keylog_cb(const SSL *ssl, const char *line);
 int		fr_tls_session_pairs_from_x509_cert(fr_pair_list_t *pair_list, TALLOC_CTX *ctx,
 				     		    request_t *request, X509 *cert) CC_HINT(nonnull);
 
+void		fr_tls_session_pairs_cache_invalidate(void);
+
+fr_tls_cert_cache_stats_t const *fr_tls_session_pairs_cache_stats(void);
+
 int		fr_tls_session_recv(request_t *request, fr_tls_session_t *tls_session);
 
 int 		fr_tls_session_send(request_t *request, fr_tls_session_t *tls_session);
@@ -0,0 +1,556 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/offload.c
+ * @brief Run blocking library calls in a thread pool, and yield the request until they complete.
+ *
+ * Some modules wrap libraries which only have synchronous APIs (PAM, Kerberos,
+ * crypt(), getpwnam() etc.).  Calling them directly from a worker stalls every
+ * other request on that worker until the call returns.
+ *
+ * Instead, the module copies what the call needs into a uctx, and submits a
+ * function to a bounded pool of threads owned by the module instance.  The
+ * request yields, and when the function returns, the pool thread passes the
+ * call back to the worker which submitted it, by triggering a user event in
+ * the worker's event list.  The request is then resumed in the worker.
+ *
+ * If the request is cancelled, or the call takes longer than the configured
+ * timeout, the call is abandoned.  Calls which haven't started yet are removed
+ * from the queue.  Calls which are already running can't be interrupted, so
+ * they run to completion, and their results are discarded.
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/main_config.h>
+#include <freeradius-devel/unlang/interpret.h>
+#include <freeradius-devel/unlang/offload.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <pthread.h>
+
+typedef enum {
+	UNLANG_OFFLOAD_QUEUED = 0,		//!< Waiting for a pool thread.
+	UNLANG_OFFLOAD_RUNNING,			//!< Being run by a pool thread.
+	UNLANG_OFFLOAD_DONE,			//!< Finished, waiting for the worker to pick it up.
+	UNLANG_OFFLOAD_RETURNED			//!< Picked up by the worker.
+} unlang_offload_state_t;
+
+typedef struct unlang_offload_job_s unlang_offload_job_t;
+
+/** Request side state for an offloaded call
+ *
+ * Lives in the request's frame, and so may go away before the call completes.
+ */
+typedef struct {
+	request_t		*request;	//!< The request which is waiting for the call.
+	unlang_offload_job_t	*job;		//!< The call.  NULL if it has been abandoned.
+	fr_timer_t		*ev;		//!< Fires if the call takes too long.
+	bool			timed_out;	//!< The call was abandoned because it took too long.
+} unlang_offload_rctx_t;
+
+/** A call which has been submitted to the pool
+ *
+ * Jobs are allocated in the NULL ctx, so that they can outlive the request,
+ * but they are only ever allocated and freed by the worker which submitted them.
+ */
+struct unlang_offload_job_s {
+	fr_dlist_t		entry;		//!< Entry in the pool's queue, or the worker's done list.
+	unlang_offload_thread_t	*t;		//!< Worker which submitted the call.
+	unlang_offload_rctx_t	*rctx;		//!< NULL if the request has gone away.
+
+	unlang_offload_state_t	state;		//!< Protected by the pool mutex.
+
+	unlang_offload_func_t	func;		//!< Blocking function to run.
+	module_method_t		resume;		//!< Module function to call when the request resumes.
+	void			*uctx;		//!< Passed to func and resume.
+	rlm_rcode_t		rcode;		//!< What func returned.
+};
+
+struct unlang_offload_pool_s {
+	char const		*name;		//!< Of the module instance, for logging.
+	unlang_offload_config_t	config;		//!< How many threads, how long to wait etc.
+
+	pthread_mutex_t		mutex;		//!< Protects everything below, and the state
+						///< and done lists of any thread or job using this pool.
+	pthread_cond_t		cond;		//!< Signalled when a call is queued, or on shutdown.
+
+	fr_dlist_head_t		queue;		//!< Calls waiting for a pool thread.
+
+	pthread_t		*threads;	//!< Array of pool threads.
+	uint32_t		num_threads;	//!< Number of pool threads which were started.
+	bool			shutdown;	//!< Tell the pool threads to exit.
+};
+
+struct unlang_offload_thread_s {
+	unlang_offload_pool_t	*pool;		//!< Pool calls are submitted to.
+	fr_event_list_t		*el;		//!< Worker's event list.
+	fr_event_user_t		*ev;		//!< Triggered by pool threads when there are finished calls.
+
+	fr_dlist_head_t		done;		//!< Finished calls, waiting to be picked up.
+	uint32_t		outstanding;	//!< Calls which are queued or running.
+	pthread_cond_t		drained;	//!< Signalled when outstanding reaches zero.
+};
+
+/** Main loop for pool threads
+ *
+ */
+static void *offload_thread(void *arg)
+{
+	unlang_offload_pool_t	*pool = arg;
+	unlang_offload_job_t	*job;
+	rlm_rcode_t		rcode;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		unlang_offload_thread_t *t;
+
+		while (!pool->shutdown && !(job = fr_dlist_pop_head(&pool->queue))) {
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+		}
+		if (pool->shutdown) break;
+
+		job->state = UNLANG_OFFLOAD_RUNNING;
+		pthread_mutex_unlock(&pool->mutex);
+
+		rcode = job->func(job->uctx);
+
+		pthread_mutex_lock(&pool->mutex);
+		job->rcode = rcode;
+		job->state = UNLANG_OFFLOAD_DONE;
+
+		/*
+		 *	The user event is disabled after it fires, so
+		 *	we only need to trigger it when the done list
+		 *	goes from empty to non-empty.
+		 */
+		t = job->t;
+		fr_dlist_insert_tail(&t->done, job);
+		if (fr_dlist_num_elements(&t->done) == 1) (void) fr_event_user_trigger(t->el, t->ev);
+
+		if (--t->outstanding == 0) pthread_cond_signal(&t->drained);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+/** Stop the pool threads
+ *
+ * All of the workers must have freed their offload threads by now, so
+ * there are no calls left in the queue.
+ */
+static int _offload_pool_free(unlang_offload_pool_t *pool)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&pool->mutex);
+	fr_assert(fr_dlist_num_elements(&pool->queue) == 0);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->num_threads; i++) pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->mutex);
+
+	return 0;
+}
+
+/** Allocate an offload pool for a module instance
+ *
+ * Should be called from the module's instantiate function.  The pool threads
+ * are started when the first worker calls #unlang_offload_thread_alloc, so
+ * that they are created after the server has daemonized.
+ *
+ * @param[in] ctx	to allocate the pool in.  Usually the module instance data.
+ * @param[in] name	of the module instance, for logging.
+ * @param[in] config	for the pool.
+ * @return
+ *	- A new pool on success.
+ *	- NULL on failure.
+ */
+unlang_offload_pool_t *unlang_offload_pool_alloc(TALLOC_CTX *ctx, char const *name,
+						 unlang_offload_config_t const *config)
+{
+	unlang_offload_pool_t *pool;
+
+	if (!config->max_threads) {
+		fr_strerror_const("Offload pool must have at least one thread");
+		return NULL;
+	}
+
+	pool = talloc_zero(ctx, unlang_offload_pool_t);
+	if (!pool) {
+		fr_strerror_const("Out of memory");
+		return NULL;
+	}
+
+	pool->name = talloc_strdup(pool, name);
+	pool->config = *config;
+	pool->threads = talloc_zero_array(pool, pthread_t, config->max_threads);
+	if (!pool->name || !pool->threads) {
+		fr_strerror_const("Out of memory");
+		talloc_free(pool);
+		return NULL;
+	}
+	fr_dlist_talloc_init(&pool->queue, unlang_offload_job_t, entry);
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	talloc_set_destructor(pool, _offload_pool_free);
+
+	return pool;
+}
+
+/** Remove a call from any queues, and free it
+ *
+ * If the call is still running, it's left for the worker to free when it completes.
+ */
+static void offload_abandon(unlang_offload_rctx_t *rctx)
+{
+	unlang_offload_job_t	*job = rctx->job;
+	unlang_offload_pool_t	*pool;
+
+	if (!job) return;
+
+	rctx->job = NULL;
+	job->rctx = NULL;
+
+	pool = job->t->pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	switch (job->state) {
+	case UNLANG_OFFLOAD_QUEUED:
+		fr_dlist_remove(&pool->queue, job);
+		if (--job->t->outstanding == 0) pthread_cond_signal(&job->t->drained);
+		FALL_THROUGH;
+
+	case UNLANG_OFFLOAD_RETURNED:
+		pthread_mutex_unlock(&pool->mutex);
+		talloc_free(job);
+		return;
+
+	/*
+	 *	The call can't be interrupted, so leave it
+	 *	for offload_done() to free.
+	 */
+	case UNLANG_OFFLOAD_RUNNING:
+	case UNLANG_OFFLOAD_DONE:
+		break;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/** Pick up finished calls, and resume the requests which are waiting for them
+ *
+ */
+static void offload_done(UNUSED fr_event_list_t *el, void *uctx)
+{
+	unlang_offload_thread_t	*t = talloc_get_type_abort(uctx, unlang_offload_thread_t);
+	unlang_offload_job_t	*job;
+	fr_dlist_head_t		done;
+
+	fr_dlist_talloc_init(&done, unlang_offload_job_t, entry);
+
+	pthread_mutex_lock(&t->pool->mutex);
+	fr_dlist_move(&done, &t->done);
+	pthread_mutex_unlock(&t->pool->mutex);
+
+	while ((job = fr_dlist_pop_head(&done))) {
+		unlang_offload_rctx_t *rctx = job->rctx;
+
+		job->state = UNLANG_OFFLOAD_RETURNED;
+
+		if (!rctx) {
+			talloc_free(job);
+			continue;
+		}
+
+		fr_timer_delete(&rctx->ev);
+		unlang_interpret_mark_runnable(rctx->request);
+	}
+}
+
+/** Wait for any calls this worker submitted, and free them
+ *
+ * Calls which are running can't be interrupted, so we have to block
+ * the worker until they complete.  This only happens on shutdown.
+ */
+static int _offload_thread_free(unlang_offload_thread_t *t)
+{
+	unlang_offload_pool_t	*pool = t->pool;
+	unlang_offload_job_t	*job, *next;
+	fr_dlist_head_t		abandoned;
+
+	fr_dlist_talloc_init(&abandoned, unlang_offload_job_t, entry);
+
+	pthread_mutex_lock(&pool->mutex);
+	for (job = fr_dlist_head(&pool->queue); job; job = next) {
+		next = fr_dlist_next(&pool->queue, job);
+		if (job->t != t) continue;
+
+		fr_dlist_remove(&pool->queue, job);
+		fr_dlist_insert_tail(&abandoned, job);
+		t->outstanding--;
+	}
+
+	while (t->outstanding > 0) pthread_cond_wait(&t->drained, &pool->mutex);
+
+	fr_dlist_move(&abandoned, &t->done);
+	pthread_mutex_unlock(&pool->mutex);
+
+	while ((job = fr_dlist_pop_head(&abandoned))) {
+		if (job->rctx) job->rctx->job = NULL;
+		talloc_free(job);
+	}
+
+	pthread_cond_destroy(&t->drained);
+
+	return 0;
+}
+
+/** Allocate the worker side of an offload pool
+ *
+ * Should be called from the module's thread_instantiate function.
+ *
+ * @param[in] ctx	to allocate the thread data in.  Usually the module thread instance data.
+ * @param[in] pool	allocated by #unlang_offload_pool_alloc.
+ * @param[in] el	the worker's event list.
+ * @return
+ *	- Thread specific offload data on success.
+ *	- NULL on failure.
+ */
+unlang_offload_thread_t *unlang_offload_thread_alloc(TALLOC_CTX *ctx, unlang_offload_pool_t *pool,
+						     fr_event_list_t *el)
+{
+	unlang_offload_thread_t *t;
+
+	t = talloc_zero(ctx, unlang_offload_thread_t);
+	if (!t) {
+		fr_strerror_const("Out of memory");
+		return NULL;
+	}
+
+	t->pool = pool;
+	t->el = el;
+	fr_dlist_talloc_init(&t->done, unlang_offload_job_t, entry);
+
+	if (fr_event_user_insert(t, el, &t->ev, false, offload_done, t) < 0) {
+		talloc_free(t);
+		return NULL;
+	}
+
+	pthread_cond_init(&t->drained, NULL);
+	talloc_set_destructor(t, _offload_thread_free);
+
+	/*
+	 *	talloc isn't thread safe when null tracking is
+	 *	enabled, which can only be done in single threaded
+	 *	mode.  So in that case calls are run directly by
+	 *	unlang_offload_yield(), and we don't start any threads.
+	 */
+	if (!main_config || !main_config->spawn_workers) return t;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->num_threads < pool->config.max_threads) {
+		int ret;
+
+		ret = pthread_create(&pool->threads[pool->num_threads], NULL, offload_thread, pool);
+		if (ret != 0) {
+			pthread_mutex_unlock(&pool->mutex);
+			fr_strerror_printf("%s - Failed creating offload thread: %s", pool->name, fr_syserror(ret));
+			talloc_free(t);
+			return NULL;
+		}
+		pool->num_threads++;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return t;
+}
+
+/** Call the module's resume function, or return the result of the call
+ *
+ */
+static unlang_action_t offload_complete(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+					request_t *request, unlang_offload_job_t *job)
+{
+	module_ctx_t		our_mctx = *mctx;
+	unlang_action_t		ua;
+
+	if (!job->resume) {
+		rlm_rcode_t rcode = job->rcode;
+
+		talloc_free(job);
+		RETURN_MODULE_RCODE(rcode);
+	}
+
+	our_mctx.rctx = job->uctx;
+	*p_result = job->rcode;
+
+	ua = job->resume(p_result, &our_mctx, request);
+
+	/*
+	 *	The module yielded again, and may still need
+	 *	the uctx, so keep it around as long as the request.
+	 */
+	if (ua == UNLANG_ACTION_YIELD) {
+		job->rctx = NULL;
+		talloc_steal(request, job);
+		return ua;
+	}
+
+	talloc_free(job);
+	return ua;
+}
+
+static unlang_action_t offload_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	unlang_offload_rctx_t	*rctx = talloc_get_type_abort(mctx->rctx, unlang_offload_rctx_t);
+	unlang_offload_job_t	*job = rctx->job;
+
+	if (rctx->timed_out) {
+		REDEBUG("Blocking call did not complete in time");
+		RETURN_MODULE_FAIL;
+	}
+
+	fr_assert(job && (job->state == UNLANG_OFFLOAD_RETURNED));
+	rctx->job = NULL;
+
+	return offload_complete(p_result, mctx, request, job);
+}
+
+static void offload_signal(module_ctx_t const *mctx, request_t *request, UNUSED fr_signal_t action)
+{
+	unlang_offload_rctx_t	*rctx = talloc_get_type_abort(mctx->rctx, unlang_offload_rctx_t);
+
+	RDEBUG2("Abandoning blocking call");
+
+	fr_timer_delete(&rctx->ev);
+	offload_abandon(rctx);
+}
+
+static void offload_timeout(UNUSED fr_timer_list_t *tl, UNUSED fr_time_t now, void *uctx)
+{
+	unlang_offload_rctx_t	*rctx = talloc_get_type_abort(uctx, unlang_offload_rctx_t);
+
+	offload_abandon(rctx);
+	rctx->timed_out = true;
+	unlang_interpret_mark_runnable(rctx->request);
+}
+
+static int _offload_rctx_free(unlang_offload_rctx_t *rctx)
+{
+	offload_abandon(rctx);
+
+	return 0;
+}
+
+/** Run a blocking function in the offload pool, and yield the request until it completes
+ *
+ * @note The module function which calls #unlang_offload_yield should return control
+ *	of the C stack to the unlang interpreter immediately after calling it.
+ *	A common pattern is to use ``return unlang_offload_yield(...)``.
+ *
+ * @param[out] p_result	where to write the result of the call.
+ * @param[in] mctx	of the module call which is submitting the blocking call.
+ * @param[in] request	The current request.
+ * @param[in] t		Thread specific offload data.
+ * @param[in] func	Blocking function to run.  Its return value is the result of
+ *			the module call, unless resume overrides it.
+ * @param[in] resume	Optional function to call in the worker when func has completed.
+ *			Is passed the uctx as mctx->rctx, and the result of func
+ *			in *p_result.  Not called if the call fails or times out.
+ * @param[in] uctx	Inputs and outputs for func.  Must be allocated in the NULL ctx.
+ *			The offload code takes ownership of it, and frees it once
+ *			the call is complete, and the request is done with it.
+ * @return
+ *	- UNLANG_ACTION_YIELD if the call was queued.
+ *	- UNLANG_ACTION_CALCULATE_RESULT with a result in *p_result if
+ *	  the call could not be queued, or was run synchronously.
+ */
+unlang_action_t unlang_offload_yield(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request,
+				     unlang_offload_thread_t *t,
+				     unlang_offload_func_t func, module_method_t resume, void *uctx)
+{
+	unlang_offload_pool_t	*pool = t->pool;
+	unlang_offload_job_t	*job;
+	unlang_offload_rctx_t	*rctx;
+
+	job = talloc_zero(NULL, unlang_offload_job_t);
+	if (!job) {
+		talloc_free(uctx);
+		RETURN_MODULE_FAIL;
+	}
+	*job = (unlang_offload_job_t) {
+		.t = t,
+		.func = func,
+		.resume = resume,
+		.uctx = talloc_steal(job, uctx)
+	};
+
+	/*
+	 *	No pool threads, run the call directly.
+	 */
+	if (!main_config || !main_config->spawn_workers) {
+		job->rcode = func(uctx);
+		job->state = UNLANG_OFFLOAD_RETURNED;
+
+		return offload_complete(p_result, mctx, request, job);
+	}
+
+	rctx = talloc_zero(unlang_interpret_frame_talloc_ctx(request), unlang_offload_rctx_t);
+	if (!rctx) {
+		talloc_free(job);
+		RETURN_MODULE_FAIL;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	if (fr_dlist_num_elements(&pool->queue) >= pool->config.max_queued) {
+		pthread_mutex_unlock(&pool->mutex);
+
+		REDEBUG("Too many blocking calls waiting (%u), failing request", pool->config.max_queued);
+		talloc_free(rctx);
+		talloc_free(job);
+		RETURN_MODULE_FAIL;
+	}
+	rctx->request = request;
+	rctx->job = job;
+	job->rctx = rctx;
+	fr_dlist_insert_tail(&pool->queue, job);
+	t->outstanding++;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	talloc_set_destructor(rctx, _offload_rctx_free);
+
+	if (fr_time_delta_ispos(pool->config.timeout) &&
+	    (fr_timer_in(rctx, unlang_interpret_event_list(request)->tl, &rctx->ev, pool->config.timeout,
+			 false, offload_timeout, rctx) < 0)) {
+		RPEDEBUG("Failed inserting offload timeout");
+		talloc_free(rctx);
+		RETURN_MODULE_FAIL;
+	}
+
+	return unlang_module_yield(request, offload_resume, offload_signal, ~FR_SIGNAL_CANCEL, rctx);
+}
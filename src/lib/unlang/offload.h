@@ -0,0 +1,80 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/offload.h
+ *
+ * @brief Run blocking library calls in a thread pool, and yield the request until they complete.
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/server/rcode.h>
+#include <freeradius-devel/unlang/module.h>
+#include <freeradius-devel/util/event.h>
+
+/** Tuneable parameters for an offload pool
+ */
+typedef struct {
+	uint32_t		max_threads;	//!< Number of threads to run blocking calls in.
+	uint32_t		max_queued;	//!< Maximum number of calls waiting for a thread.
+	fr_time_delta_t		timeout;	//!< How long a request waits for a call to complete.
+} unlang_offload_config_t;
+
+/** Config parser entries for an offload pool
+ *
+ * Should be used inside a subsection of the module's configuration.
+ */
+#define UNLANG_OFFLOAD_CONFIG_CONF_PARSER \
+	{ FR_CONF_OFFSET("threads", unlang_offload_config_t, max_threads), .dflt = "4" }, \
+	{ FR_CONF_OFFSET("max_queued", unlang_offload_config_t, max_queued), .dflt = "1024" }, \
+	{ FR_CONF_OFFSET("timeout", unlang_offload_config_t, timeout), .dflt = "10s" }, \
+
+typedef struct unlang_offload_pool_s unlang_offload_pool_t;
+typedef struct unlang_offload_thread_s unlang_offload_thread_t;
+
+/** A blocking function to run in the offload pool
+ *
+ * This runs in one of the pool's threads, not in the worker which submitted it.
+ * It MUST NOT access the request, or anything else owned by the worker.  Any
+ * inputs should be copied into uctx before the call is submitted, and any
+ * outputs written back to uctx.
+ *
+ * @param[in] uctx	passed to #unlang_offload_yield.
+ * @return the rcode for the module call.
+ */
+typedef rlm_rcode_t (*unlang_offload_func_t)(void *uctx);
+
+unlang_offload_pool_t	*unlang_offload_pool_alloc(TALLOC_CTX *ctx, char const *name,
+						   unlang_offload_config_t const *config) CC_HINT(nonnull(2,3));
+
+unlang_offload_thread_t	*unlang_offload_thread_alloc(TALLOC_CTX *ctx, unlang_offload_pool_t *pool,
+						     fr_event_list_t *el) CC_HINT(nonnull(2,3));
+
+unlang_action_t		unlang_offload_yield(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request,
+					     unlang_offload_thread_t *t,
+					     unlang_offload_func_t func, module_method_t resume, void *uctx)
+					     CC_HINT(nonnull(1,2,3,4,5,7));
+
+#ifdef __cplusplus
+}
+#endif
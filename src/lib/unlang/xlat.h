@@ -477,6 +477,10 @@ int		xlat_instance_unregister_func(xlat_exp_t *node);
 
 int		xlat_instance_register_func(xlat_exp_t *node);
 
+bool		xlat_instance_register_disable(bool disable);
+
+size_t		xlat_instance_num(void);
+
 int		xlat_finalize(xlat_exp_head_t *head, fr_event_list_t *runtime_el); /* xlat_instance_register() or xlat_instantiate_ephemeral() */
 
 void		xlat_instances_free(void);
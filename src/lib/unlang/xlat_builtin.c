@@ -3395,9 +3395,9 @@ static int xlat_func_subst_regex(TALLOC_CTX *ctx, fr_dcursor_t *out,
 		/*
 		*	Process the substitution
 		*/
-		if (regex_compile(NULL, &our_pattern,
-				  fr_sbuff_current(&start_m), fr_sbuff_current(&end_m) - fr_sbuff_current(&start_m),
-				  &our_flags, true, true) <= 0) {
+		if (regex_compile_cached(NULL, &our_pattern,
+					 fr_sbuff_current(&start_m), fr_sbuff_current(&end_m) - fr_sbuff_current(&start_m),
+					 &our_flags, true) <= 0) {
 			RPEDEBUG("Failed compiling regex");
 			return -1;
 		}
@@ -40,6 +40,10 @@ static fr_heap_t *xlat_inst_tree;
  */
 static _Thread_local fr_heap_t *xlat_thread_inst_tree;
 
+/** Whether the current thread may register new "permanent" xlat function calls
+ */
+static _Thread_local bool xlat_register_disabled;
+
 /** Compare two xlat instances based on node pointer
  *
  * @param[in] one      	First xlat expansion instance.
@@ -602,6 +606,12 @@ int xlat_instance_register_func(xlat_exp_t *node)
 	fr_assert(!call->id && !call->inst && !call->thread_inst);	/* Node cannot already have instance data */
 	if (!fr_cond_assert(!call->ephemeral)) return -1;		/* Can't bootstrap ephemeral calls */
 
+	if (xlat_register_disabled) {
+		fr_strerror_printf("Function %%%s() cannot be used in data which is loaded after the server has started",
+				   call->func->name);
+		return -1;
+	}
+
 	call->inst = xlat_inst_alloc(node);
 	if (unlikely(!call->inst)) return -1;
 
@@ -700,6 +710,34 @@ int xlat_finalize(xlat_exp_head_t *head, fr_event_list_t *runtime_el)
 	return xlat_instantiate_ephemeral(head, runtime_el);
 }
 
+/** Stop the calling thread from registering new "permanent" xlat function calls
+ *
+ * Once worker threads have instantiated their xlats, any new function calls
+ * would have no thread instance data.  Data which is re-parsed at runtime,
+ * e.g. by the reload API, disables registration so that function calls are
+ * rejected when they're parsed, instead of failing when they're evaluated.
+ *
+ * @param[in] disable	true to reject function calls, false to allow them.
+ * @return The previous setting.
+ */
+bool xlat_instance_register_disable(bool disable)
+{
+	bool prev = xlat_register_disabled;
+
+	xlat_register_disabled = disable;
+
+	return prev;
+}
+
+/** Return the number of registered "permanent" xlat function calls
+ *
+ * Used to determine whether parsing some data created any xlat instances.
+ */
+size_t xlat_instance_num(void)
+{
+	return xlat_inst_tree ? fr_heap_num_elements(xlat_inst_tree) : 0;
+}
+
 /** Walk over all registered instance data and free them explicitly
  *
  * This must be called before any modules or xlats are deregistered/unloaded and before
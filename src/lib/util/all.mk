@@ -6,6 +6,7 @@ SUBMAKEFILES := \
 	dlist_tests.mk \
 	edit_tests.mk \
 	heap_tests.mk \
+	histogram_tests.mk \
 	hmac_tests.mk \
 	libfreeradius-util.mk \
 	lst_tests.mk \
@@ -15,10 +16,12 @@ SUBMAKEFILES := \
 	pair_nested_tests.mk \
 	pair_tests.mk \
 	rb_tests.mk \
+	regex_tests.mk \
 	sbuff_tests.mk \
 	size_tests.mk \
 	slab_tests.mk \
 	strerror_tests.mk \
+	swiss_tests.mk \
 	time_tests.mk \
 	timer_tests.mk
 
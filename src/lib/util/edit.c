@@ -253,6 +253,12 @@ static int edit_record(fr_edit_list_t *el, fr_edit_op_t op, fr_pair_t *vp, fr_pa
 
 	fr_assert(op != FR_EDIT_CHILD); /* only used by fr_edit_alloc() */
 
+	/*
+	 *	Values are edited in place, so the pair list API
+	 *	doesn't see the change.
+	 */
+	if ((op == FR_EDIT_VALUE) || (op == FR_EDIT_CLEAR)) fr_pair_list_changed(fr_pair_parent_list(vp), vp);
+
 	/*
 	 *	When we insert a structural type, we also want to
 	 *	not track edits to it's children.  The "ignore list"
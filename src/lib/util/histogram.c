@@ -0,0 +1,264 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Log-linear histograms for recording latencies
+ *
+ * This is the same bucketing scheme as HdrHistogram.  Values smaller than
+ * 2^precision each get their own bucket.  Above that, each power of two
+ * range is split into 2^(precision - 1) linear buckets, so the width of a
+ * bucket is never more than 1/2^(precision - 1) of the values it holds.
+ *
+ * This gives a fixed relative error across the whole 64 bit range, using
+ * a fixed amount of memory, and a constant time insert.  Histograms with
+ * the same precision can be merged, so each thread can record values into
+ * its own histogram, and the results can be combined later.
+ *
+ * @file src/lib/util/histogram.c
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/histogram.h>
+#include <freeradius-devel/util/math.h>
+#include <freeradius-devel/util/strerror.h>
+
+struct fr_histogram_s {
+	uint8_t			precision;	//!< Number of significant bits in each bucket.
+	uint32_t		num_buckets;	//!< Length of the bucket array.
+
+	uint64_t		count;		//!< Number of values recorded.
+	uint64_t		min;		//!< Smallest value recorded.
+	uint64_t		max;		//!< Largest value recorded.
+	uint64_t		sum;		//!< Sum of all values recorded, for the mean.
+
+	uint64_t		buckets[];	//!< Number of values recorded in each bucket.
+};
+
+/** Return the bucket a value should be recorded in
+ *
+ */
+static inline uint32_t histogram_index(fr_histogram_t const *h, uint64_t value)
+{
+	uint8_t		exp;
+	uint64_t	sub_count = ((uint64_t)1) << h->precision;
+	uint64_t	half_count = sub_count >> 1;
+
+	if (value < sub_count) return value;
+
+	/*
+	 *	Keep the top "precision" bits of the value.  The
+	 *	leading bit is always set, so there are only half
+	 *	as many buckets in each power of two range.
+	 */
+	exp = fr_high_bit_pos(value) - 1;
+
+	return sub_count + ((exp - h->precision) * half_count) +
+		((value >> (exp - h->precision + 1)) - half_count);
+}
+
+/** Return the highest value which would be recorded in a bucket
+ *
+ */
+static inline uint64_t histogram_highest(fr_histogram_t const *h, uint32_t idx)
+{
+	uint64_t	sub_count = ((uint64_t)1) << h->precision;
+	uint64_t	half_count = sub_count >> 1;
+	uint32_t	k, shift;
+
+	if (idx < sub_count) return idx;
+
+	k = idx - sub_count;
+	shift = (k / half_count) + 1;
+
+	return ((half_count + (k % half_count)) << shift) + ((((uint64_t)1) << shift) - 1);
+}
+
+/** Allocate a new histogram
+ *
+ * @param[in] ctx		to allocate the histogram in.
+ * @param[in] precision		The number of significant bits to keep for each value.
+ *				Values are accurate to within 1/2^(precision - 1).
+ *				Memory use is roughly (66 - precision) * 2^(precision + 2) bytes.
+ * @return
+ *	- A new histogram on success.
+ *	- NULL on failure.
+ */
+fr_histogram_t *fr_histogram_alloc(TALLOC_CTX *ctx, uint8_t precision)
+{
+	fr_histogram_t	*h;
+	uint32_t	num_buckets;
+
+	if ((precision < FR_HISTOGRAM_PRECISION_MIN) || (precision > FR_HISTOGRAM_PRECISION_MAX)) {
+		fr_strerror_printf("Histogram precision must be between %u and %u",
+				   FR_HISTOGRAM_PRECISION_MIN, FR_HISTOGRAM_PRECISION_MAX);
+		return NULL;
+	}
+
+	num_buckets = (1 << precision) + ((64 - precision) * (1 << (precision - 1)));
+
+	h = talloc_zero_size(ctx, sizeof(*h) + (sizeof(h->buckets[0]) * num_buckets));
+	if (!h) {
+		fr_strerror_const("Out of memory");
+		return NULL;
+	}
+	talloc_set_name_const(h, "fr_histogram_t");
+
+	h->precision = precision;
+	h->num_buckets = num_buckets;
+	h->min = UINT64_MAX;
+
+	return h;
+}
+
+/** Record a value
+ *
+ * @param[in] h		to record the value in.
+ * @param[in] value	to record.
+ */
+void fr_histogram_add(fr_histogram_t *h, uint64_t value)
+{
+	h->buckets[histogram_index(h, value)]++;
+	h->count++;
+	h->sum += value;
+	if (value < h->min) h->min = value;
+	if (value > h->max) h->max = value;
+}
+
+/** Add all of the values recorded in one histogram to another
+ *
+ * @param[in] dst	to add the values to.
+ * @param[in] src	to add the values from.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the histograms have different precisions.
+ */
+int fr_histogram_merge(fr_histogram_t *dst, fr_histogram_t const *src)
+{
+	uint32_t i;
+
+	if (dst->precision != src->precision) {
+		fr_strerror_printf("Can't merge histograms with different precisions (%u vs %u)",
+				   dst->precision, src->precision);
+		return -1;
+	}
+
+	if (!src->count) return 0;
+
+	for (i = 0; i < src->num_buckets; i++) dst->buckets[i] += src->buckets[i];
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min) dst->min = src->min;
+	if (src->max > dst->max) dst->max = src->max;
+
+	return 0;
+}
+
+/** Remove all recorded values
+ *
+ */
+void fr_histogram_clear(fr_histogram_t *h)
+{
+	if (!h->count) return;
+
+	memset(h->buckets, 0, sizeof(h->buckets[0]) * h->num_buckets);
+	h->count = 0;
+	h->sum = 0;
+	h->min = UINT64_MAX;
+	h->max = 0;
+}
+
+/** Return the number of values recorded
+ *
+ */
+uint64_t fr_histogram_count(fr_histogram_t const *h)
+{
+	return h->count;
+}
+
+/** Return the smallest value recorded, or 0 if the histogram is empty
+ *
+ */
+uint64_t fr_histogram_min(fr_histogram_t const *h)
+{
+	if (!h->count) return 0;
+
+	return h->min;
+}
+
+/** Return the largest value recorded, or 0 if the histogram is empty
+ *
+ */
+uint64_t fr_histogram_max(fr_histogram_t const *h)
+{
+	return h->max;
+}
+
+/** Return the mean of the values recorded, or 0 if the histogram is empty
+ *
+ */
+double fr_histogram_mean(fr_histogram_t const *h)
+{
+	if (!h->count) return 0;
+
+	return (double)h->sum / h->count;
+}
+
+/** Return the value at a given percentile
+ *
+ * The result is the highest value which is in the same bucket as
+ * the value at the percentile, so it is never less than the real value,
+ * and never greater than the largest value recorded.
+ *
+ * @param[in] h			to examine.
+ * @param[in] percentile	between 0 and 100.
+ * @return
+ *	- The value at the percentile.
+ *	- 0 if the histogram is empty.
+ */
+uint64_t fr_histogram_percentile(fr_histogram_t const *h, double percentile)
+{
+	uint64_t	target, seen = 0;
+	uint32_t	i;
+
+	if (!h->count) return 0;
+
+	if (percentile <= 0) return h->min;
+	if (percentile >= 100) return h->max;
+
+	/*
+	 *	The rank of the value we want, rounding up.
+	 */
+	target = (uint64_t)((percentile / 100.0) * h->count);
+	if (((double)target * 100.0) < (percentile * h->count)) target++;
+	if (!target) target = 1;
+
+	for (i = 0; i < h->num_buckets; i++) {
+		uint64_t value;
+
+		seen += h->buckets[i];
+		if (seen < target) continue;
+
+		value = histogram_highest(h, i);
+		if (value > h->max) return h->max;
+		if (value < h->min) return h->min;
+		return value;
+	}
+
+	return h->max;
+}
@@ -0,0 +1,63 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Log-linear histograms for recording latencies
+ *
+ * @file src/lib/util/histogram.h
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+RCSIDH(histogram_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/build.h>
+#include <freeradius-devel/missing.h>
+#include <freeradius-devel/util/talloc.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FR_HISTOGRAM_PRECISION_MIN	(2)
+#define FR_HISTOGRAM_PRECISION_MAX	(16)
+#define FR_HISTOGRAM_PRECISION_DEFAULT	(7)	//!< Values are accurate to within 1/64.
+
+typedef struct fr_histogram_s fr_histogram_t;
+
+fr_histogram_t	*fr_histogram_alloc(TALLOC_CTX *ctx, uint8_t precision);
+
+void		fr_histogram_add(fr_histogram_t *h, uint64_t value) CC_HINT(nonnull);
+
+int		fr_histogram_merge(fr_histogram_t *dst, fr_histogram_t const *src) CC_HINT(nonnull);
+
+void		fr_histogram_clear(fr_histogram_t *h) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_count(fr_histogram_t const *h) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_min(fr_histogram_t const *h) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_max(fr_histogram_t const *h) CC_HINT(nonnull);
+
+double		fr_histogram_mean(fr_histogram_t const *h) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_percentile(fr_histogram_t const *h, double percentile) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
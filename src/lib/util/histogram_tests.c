@@ -0,0 +1,158 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for log-linear histograms
+ *
+ * @file src/lib/util/histogram_tests.c
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/histogram.h>
+#include <freeradius-devel/util/rand.h>
+
+static void histogram_test_basic(void)
+{
+	fr_histogram_t	*h;
+	uint64_t	i;
+
+	h = fr_histogram_alloc(NULL, FR_HISTOGRAM_PRECISION_DEFAULT);
+	TEST_CHECK(h != NULL);
+
+	TEST_CASE("empty");
+	TEST_CHECK(fr_histogram_count(h) == 0);
+	TEST_CHECK(fr_histogram_min(h) == 0);
+	TEST_CHECK(fr_histogram_max(h) == 0);
+	TEST_CHECK(fr_histogram_percentile(h, 50) == 0);
+
+	/*
+	 *	Small values each have their own bucket, so
+	 *	percentiles are exact.
+	 */
+	TEST_CASE("exact small values");
+	for (i = 1; i <= 100; i++) fr_histogram_add(h, i);
+
+	TEST_CHECK(fr_histogram_count(h) == 100);
+	TEST_CHECK(fr_histogram_min(h) == 1);
+	TEST_CHECK(fr_histogram_max(h) == 100);
+	TEST_CHECK(fr_histogram_mean(h) == 50.5);
+	TEST_CHECK_RET(fr_histogram_percentile(h, 50), 50);
+	TEST_CHECK_RET(fr_histogram_percentile(h, 99), 99);
+	TEST_CHECK_RET(fr_histogram_percentile(h, 99.9), 100);
+	TEST_CHECK_RET(fr_histogram_percentile(h, 0), 1);
+	TEST_CHECK_RET(fr_histogram_percentile(h, 100), 100);
+
+	TEST_CASE("clear");
+	fr_histogram_clear(h);
+	TEST_CHECK(fr_histogram_count(h) == 0);
+	TEST_CHECK(fr_histogram_percentile(h, 50) == 0);
+
+	TEST_CASE("extreme values");
+	fr_histogram_add(h, 0);
+	fr_histogram_add(h, UINT64_MAX);
+	TEST_CHECK(fr_histogram_min(h) == 0);
+	TEST_CHECK(fr_histogram_max(h) == UINT64_MAX);
+	TEST_CHECK_RET(fr_histogram_percentile(h, 50), 0);
+	TEST_CHECK(fr_histogram_percentile(h, 99) == UINT64_MAX);
+
+	talloc_free(h);
+
+	TEST_CASE("invalid precision");
+	TEST_CHECK(fr_histogram_alloc(NULL, 1) == NULL);
+	TEST_CHECK(fr_histogram_alloc(NULL, FR_HISTOGRAM_PRECISION_MAX + 1) == NULL);
+}
+
+/** Check the relative error of percentiles across the whole range
+ *
+ */
+static void histogram_test_error(void)
+{
+	fr_histogram_t	*h;
+	uint8_t		precision;
+
+	for (precision = FR_HISTOGRAM_PRECISION_MIN; precision <= 10; precision++) {
+		double		max_error = 1.0 / (1 << (precision - 1));
+		unsigned int	shift;
+
+		h = fr_histogram_alloc(NULL, precision);
+		TEST_CHECK(h != NULL);
+
+		for (shift = 0; shift < 64; shift++) {
+			uint64_t value = (((uint64_t)1) << shift) | (fr_rand() & ((((uint64_t)1) << shift) - 1));
+			uint64_t found;
+
+			fr_histogram_clear(h);
+
+			/*
+			 *	The smallest value is what we're looking
+			 *	for, the largest stops the result being
+			 *	clamped.
+			 */
+			fr_histogram_add(h, value);
+			fr_histogram_add(h, UINT64_MAX);
+
+			found = fr_histogram_percentile(h, 50);
+			TEST_CHECK(found >= value);
+			TEST_MSG("precision %u, value %" PRIu64 ", found %" PRIu64, precision, value, found);
+			TEST_CHECK(((double)(found - value) / value) <= max_error);
+			TEST_MSG("precision %u, value %" PRIu64 ", found %" PRIu64, precision, value, found);
+		}
+
+		talloc_free(h);
+	}
+}
+
+static void histogram_test_merge(void)
+{
+	fr_histogram_t	*a, *b, *c;
+	uint64_t	i;
+
+	a = fr_histogram_alloc(NULL, FR_HISTOGRAM_PRECISION_DEFAULT);
+	b = fr_histogram_alloc(NULL, FR_HISTOGRAM_PRECISION_DEFAULT);
+	c = fr_histogram_alloc(NULL, FR_HISTOGRAM_PRECISION_DEFAULT + 1);
+
+	for (i = 1; i <= 50; i++) fr_histogram_add(a, i);
+	for (i = 51; i <= 100; i++) fr_histogram_add(b, i);
+
+	TEST_CASE("merge");
+	TEST_CHECK(fr_histogram_merge(a, b) == 0);
+	TEST_CHECK(fr_histogram_count(a) == 100);
+	TEST_CHECK(fr_histogram_min(a) == 1);
+	TEST_CHECK(fr_histogram_max(a) == 100);
+	TEST_CHECK_RET(fr_histogram_percentile(a, 90), 90);
+
+	TEST_CASE("merge empty");
+	fr_histogram_clear(b);
+	TEST_CHECK(fr_histogram_merge(a, b) == 0);
+	TEST_CHECK(fr_histogram_count(a) == 100);
+	TEST_CHECK(fr_histogram_merge(b, a) == 0);
+	TEST_CHECK(fr_histogram_min(b) == 1);
+
+	TEST_CASE("merge different precisions fails");
+	TEST_CHECK(fr_histogram_merge(a, c) < 0);
+
+	talloc_free(a);
+	talloc_free(b);
+	talloc_free(c);
+}
+
+TEST_LIST = {
+	{ "histogram_test_basic",	histogram_test_basic },
+	{ "histogram_test_error",	histogram_test_error },
+	{ "histogram_test_merge",	histogram_test_merge },
+	{ NULL }
+};
@@ -32,6 +32,7 @@ fr_table_num_sorted_t const fr_htrie_type_table[] = {
 	{ L("auto"),		FR_HTRIE_AUTO },
 	{ L("hash"),		FR_HTRIE_HASH },
 	{ L("rb"),		FR_HTRIE_RB },
+	{ L("swiss"),		FR_HTRIE_SWISS },
 	{ L("trie"),		FR_HTRIE_TRIE },
 };
 size_t fr_htrie_type_table_len = NUM_ELEMENTS(fr_htrie_type_table);
@@ -63,6 +64,15 @@ static fr_htrie_funcs_t const default_funcs[] = {
 		FUNC(trie, remove),
 		FUNC(trie, delete),
 		FUNC(trie, num_elements)
+	},
+	[FR_HTRIE_SWISS] = {
+		.match = (fr_htrie_find_t) fr_swiss_table_find,
+		FUNC(swiss_table, find),
+		FUNC(swiss_table, insert),
+		FUNC(swiss_table, replace),
+		FUNC(swiss_table, remove),
+		FUNC(swiss_table, delete),
+		FUNC(swiss_table, num_elements)
 	}
 };
 
@@ -77,7 +87,8 @@ static fr_htrie_funcs_t const default_funcs[] = {
  *				- FR_HTRIE_HASH
  *				- FR_HTRIE_RB
  *				- FR_HTRIE_TRIE
- * @param[in] hash_data		Used by FR_HTRIE_HASH to convert the
+ *				- FR_HTRIE_SWISS
+ * @param[in] hash_data		Used by FR_HTRIE_HASH and FR_HTRIE_SWISS to convert the
  *				data into a 32bit integer used for binning.
  * @param[in] cmp_data		Used to determine exact matched.
  * @param[in] get_key		Used by the prefix trie to extract a key
@@ -121,6 +132,17 @@ fr_htrie_t *fr_htrie_alloc(TALLOC_CTX *ctx,
 		ht->funcs = default_funcs[type];
 		return ht;
 
+	case FR_HTRIE_SWISS:
+		if (!hash_data || !cmp_data) {
+			fr_strerror_const("hash_data and cmp_data must not be NULL for FR_HTRIE_SWISS");
+			return NULL;
+		}
+
+		ht->store = fr_swiss_table_alloc(ht, hash_data, cmp_data, free_data);
+		if (unlikely(!ht->store)) goto error;
+		ht->funcs = default_funcs[type];
+		return ht;
+
 	case FR_HTRIE_RB:
 		if (!cmp_data) {
 			fr_strerror_const("cmp_data must not be NULL for FR_HTRIE_RB");
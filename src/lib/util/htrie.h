@@ -29,6 +29,7 @@ extern "C" {
 
 #include <freeradius-devel/util/hash.h>
 #include <freeradius-devel/util/rb.h>
+#include <freeradius-devel/util/swiss.h>
 #include <freeradius-devel/util/trie.h>
 #include <freeradius-devel/util/types.h>
 
@@ -51,6 +52,7 @@ typedef enum {
 	FR_HTRIE_HASH,		//!< Data is stored in a hash.
 	FR_HTRIE_RB,		//!< Data is stored in a rb tree.
 	FR_HTRIE_TRIE,		//!< Data is stored in a prefix trie.
+	FR_HTRIE_SWISS,		//!< Data is stored in an open addressing hash.
 	FR_HTRIE_AUTO,		//!< Automatically choose the best type.
 				///< Must be not be passed to fr_htrie_alloc().
 				///< If the user selects this, you must
@@ -151,7 +153,7 @@ static inline fr_htrie_type_t fr_htrie_hint(fr_type_t type)
 	switch (type) {
 	case FR_TYPE_STRING:
 	case FR_TYPE_OCTETS:
-		return FR_HTRIE_HASH;
+		return FR_HTRIE_SWISS;
 
 	/* IPv4/v6 IP and prefix */
 	case FR_TYPE_IP:
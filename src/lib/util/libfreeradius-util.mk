@@ -44,6 +44,7 @@ SOURCES		:= \
 		   getaddrinfo.c \
 		   hash.c \
 		   heap.c \
+		   histogram.c \
 		   hmac_md5.c \
 		   hmac_sha1.c \
 		   htrie.c \
@@ -87,6 +88,7 @@ SOURCES		:= \
 		   strlcat.c \
 		   strlcpy.c \
 		   struct.c \
+		   swiss.c \
 		   syserror.c \
 		   table.c \
 		   talloc.c \
@@ -62,6 +62,8 @@ typedef struct {
 
 	uint8_t			*data;			//!< Packet data (body).
 	size_t			data_len;		//!< Length of packet data.
+	unsigned int		pairs_generation;	//!< Generation of the pair list after data was decoded.
+							///< If the list has changed since, it no longer matches data.
 
 	/*
 	 *	The vector should go away soon
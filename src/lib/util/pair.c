@@ -57,6 +57,112 @@ void fr_pair_list_init(fr_pair_list_t *list)
 	list->verified = true;
 #endif
 	list->is_child = false;
+	list->lazy = NULL;
+}
+
+/** Associate pairs which haven't been decoded yet with a list
+ *
+ * The pairs are decoded the first time they, or the list as a whole,
+ * are searched for or walked over, or when pairs are inserted anywhere
+ * other than at the tail of the list.  Until then #fr_pair_list_empty
+ * returns false, and the rest of the list can be used as normal.
+ *
+ * @param[in] list	to associate the pairs with.
+ * @param[in] prev	pair in the list which the undecoded pairs follow.
+ *			NULL if they go at the head of the list.
+ * @param[in] lazy	decoder state.  Must remain valid until all of the
+ *			pairs have been decoded, or the list is freed.
+ */
+void fr_pair_list_lazy_set(fr_pair_list_t *list, fr_pair_t *prev, fr_pair_list_lazy_t *lazy)
+{
+	/*
+	 *	Only one set of undecoded pairs per list.
+	 */
+	if (list->lazy) (void) fr_pair_list_lazy_decode(list, NULL);
+
+	fr_assert(!prev || fr_pair_order_list_in_list(&list->order, prev));
+
+	lazy->prev = prev;
+	list->lazy = lazy;
+}
+
+/** Set the function which reports errors decoding pairs left in their wire format
+ *
+ * Those errors are found long after the packet was received, by whatever
+ * first uses the pairs.  The caller usually ignores the error, so the
+ * owner of the list has to report it.
+ *
+ * @param[in] list	with pairs which haven't been decoded.  If there
+ *			are none, this does nothing.
+ * @param[in] error	function to call.
+ * @param[in] uctx	to pass to the function.
+ */
+void fr_pair_list_lazy_error_set(fr_pair_list_t *list, fr_pair_list_lazy_error_t error, void *uctx)
+{
+	if (!list->lazy) return;
+
+	list->lazy->error = error;
+	list->lazy->uctx = uctx;
+}
+
+/** Decode pairs which were left in their wire format
+ *
+ * Use #fr_pair_list_lazy_decode, which avoids the function call
+ * when there's nothing to decode.
+ *
+ * The decoded pairs are placed where they were in the original
+ * packet, so the order of the list is the same as if everything
+ * had been decoded up front.
+ *
+ * @param[in] list	to decode pairs for.
+ * @param[in] da	the caller is looking for.  NULL means decode everything.
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.  Any pairs which weren't decoded are lost.  The error
+ *	  is passed to the function set with #fr_pair_list_lazy_error_set.
+ */
+int _fr_pair_list_lazy_decode(fr_pair_list_t *list, fr_dict_attr_t const *da)
+{
+	fr_pair_list_lazy_t		*lazy = list->lazy;
+	fr_pair_list_t			decoded;
+	fr_pair_t			*prev, *vp;
+	fr_pair_list_lazy_error_t	error;
+	void				*uctx;
+	int				ret;
+
+	/*
+	 *	Cache these, the decoder may free the lazy state.
+	 */
+	prev = lazy->prev;
+	error = lazy->error;
+	uctx = lazy->uctx;
+
+	/*
+	 *	The list must not call the decoder again while it's
+	 *	running, or while we're moving the pairs over.
+	 */
+	list->lazy = NULL;
+
+	fr_pair_list_init(&decoded);
+	ret = lazy->func(&decoded, da, lazy);
+
+	while ((vp = fr_pair_order_list_pop_head(&decoded.order))) {
+		fr_pair_order_list_insert_after(&list->order, prev, vp);
+		prev = vp;
+	}
+
+	if (ret > 0) {
+		lazy->prev = prev;
+		list->lazy = lazy;
+		return 0;
+	}
+
+	if (ret < 0) {
+		if (error) error(uctx);
+		return -1;
+	}
+
+	return 0;
 }
 
 /** Free a fr_pair_t
@@ -676,7 +782,9 @@ unsigned int fr_pair_count_by_da(fr_pair_list_t const *list, fr_dict_attr_t cons
 
 	if (fr_pair_list_empty(list)) return 0;
 
-	while ((vp = fr_pair_list_next(list, vp))) if (da == vp->da) count++;
+	fr_pair_list_lazy_decode(list, da);
+
+	while ((vp = fr_pair_order_list_next(&list->order, vp))) if (da == vp->da) count++;
 
 	return count;
 }
@@ -698,9 +806,11 @@ fr_pair_t *fr_pair_find_by_da(fr_pair_list_t const *list, fr_pair_t const *prev,
 
 	if (fr_pair_list_empty(list)) return NULL;
 
+	fr_pair_list_lazy_decode(list, da);
+
 	PAIR_LIST_VERIFY(list);
 
-	while ((vp = fr_pair_list_next(list, vp))) if (da == vp->da) return vp;
+	while ((vp = fr_pair_order_list_next(&list->order, vp))) if (da == vp->da) return vp;
 
 	return NULL;
 }
@@ -722,9 +832,11 @@ fr_pair_t *fr_pair_find_last_by_da(fr_pair_list_t const *list, fr_pair_t const *
 
 	if (fr_pair_list_empty(list)) return NULL;
 
+	fr_pair_list_lazy_decode(list, da);
+
 	PAIR_LIST_VERIFY(list);
 
-	while ((vp = fr_pair_list_prev(list, vp))) if (da == vp->da) return vp;
+	while ((vp = fr_pair_order_list_prev(&list->order, vp))) if (da == vp->da) return vp;
 
 	return NULL;
 }
@@ -746,9 +858,11 @@ fr_pair_t *fr_pair_find_by_da_idx(fr_pair_list_t const *list, fr_dict_attr_t con
 
 	if (fr_pair_list_empty(list)) return NULL;
 
+	fr_pair_list_lazy_decode(list, da);
+
 	PAIR_LIST_VERIFY(list);
 
-	while ((vp = fr_pair_list_next(list, vp))) {
+	while ((vp = fr_pair_order_list_next(&list->order, vp))) {
 		if (da != vp->da) continue;
 
 		if (idx == 0) return vp;
@@ -964,6 +1078,28 @@ fr_pair_t *fr_pair_list_parent(fr_pair_list_t const *list)
 	return (fr_pair_t *) (UNCONST(uint8_t *, list) - offsetof(fr_pair_t, vp_group));
 }
 
+/** Record that a list has changed
+ *
+ * The generation of the list, and of every list it's nested in, is
+ * updated.  Callers which want to know whether a list has been edited
+ * since they last looked only need to check the top level list.
+ *
+ * Edits to internal attributes are ignored, as they're never encoded.
+ *
+ * @param[in] list	which has changed.  May be NULL.
+ * @param[in] vp	which was added, removed or edited.  NULL if the
+ *			whole list changed.
+ */
+void fr_pair_list_changed(fr_pair_list_t *list, fr_pair_t const *vp)
+{
+	if (vp && (vp->da->dict == fr_dict_internal())) return;
+
+	while (list) {
+		list->generation++;
+		list = fr_pair_parent_list(fr_pair_list_parent(list));
+	}
+}
+
 /** Keep attr tree and sublists synced on cursor insert
  *
  * @param[in] list	Underlying order list from the fr_pair_list_t.
@@ -983,6 +1119,7 @@ static int _pair_list_dcursor_insert(fr_dlist_head_t *list, void *to_insert, UNU
 	 *	Mark the pair as inserted into the list.
 	 */
 	fr_pair_order_list_set_head(tlist, vp);
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 
 	PAIR_VERIFY(vp);
 
@@ -1016,6 +1153,8 @@ static int _pair_list_dcursor_remove(NDEBUG_UNUSED fr_dlist_head_t *list, void *
 	parent = fr_pair_parent_list(vp);
 #endif
 
+	fr_pair_list_changed(parent, vp);
+
 	/*
 	 *	Mark the pair as removed from the list.
 	 */
@@ -1106,6 +1245,8 @@ fr_pair_t *_fr_pair_dcursor_iter_init(fr_dcursor_t *cursor, fr_pair_list_t const
 				      fr_dcursor_iter_t iter, void const *uctx,
 				      bool is_const)
 {
+	fr_pair_list_lazy_decode(list, NULL);
+
 	return _fr_dcursor_init(cursor, fr_pair_order_list_dlist_head(&list->order),
 				iter, NULL, uctx,
 				_pair_list_dcursor_insert, _pair_list_dcursor_remove, list, is_const);
@@ -1127,6 +1268,8 @@ fr_pair_t *_fr_pair_dcursor_iter_init(fr_dcursor_t *cursor, fr_pair_list_t const
 fr_pair_t *_fr_pair_dcursor_init(fr_dcursor_t *cursor, fr_pair_list_t const *list,
 				 bool is_const)
 {
+	fr_pair_list_lazy_decode(list, NULL);
+
 	return _fr_dcursor_init(cursor, fr_pair_order_list_dlist_head(&list->order),
 				NULL, NULL, NULL,
 				_pair_list_dcursor_insert, _pair_list_dcursor_remove, list, is_const);
@@ -1146,6 +1289,8 @@ fr_pair_t *_fr_pair_dcursor_by_da_init(fr_dcursor_t *cursor,
 				        fr_pair_list_t const *list, fr_dict_attr_t const *da,
 				        bool is_const)
 {
+	fr_pair_list_lazy_decode(list, da);
+
 	return _fr_dcursor_init(cursor, fr_pair_order_list_dlist_head(&list->order),
 				fr_pair_iter_next_by_da, NULL, da,
 				_pair_list_dcursor_insert, _pair_list_dcursor_remove, list, is_const);
@@ -1175,6 +1320,8 @@ fr_pair_t *_fr_pair_dcursor_by_ancestor_init(fr_dcursor_t *cursor,
 	 */
 	fr_assert(da->parent->flags.is_root);
 
+	fr_pair_list_lazy_decode(list, da);
+
 	vp = fr_pair_find_by_da(list, NULL, da);
 	if (vp) {
 		list = &vp->vp_group;
@@ -1327,7 +1474,14 @@ int fr_pair_prepend(fr_pair_list_t *list, fr_pair_t *to_add)
 		return -1;
 	}
 
+	/*
+	 *	Undecoded pairs have a fixed position in the list,
+	 *	so they need to be in it before we insert others.
+	 */
+	fr_pair_list_lazy_decode(list, NULL);
+
 	fr_pair_order_list_insert_head(&list->order, to_add);
+	fr_pair_list_changed(list, to_add);
 
 	return 0;
 }
@@ -1358,7 +1512,12 @@ int fr_pair_append(fr_pair_list_t *list, fr_pair_t *to_add)
 		return -1;
 	}
 
+	/*
+	 *	No need to decode anything, undecoded pairs are always
+	 *	inserted before any pairs appended after them.
+	 */
 	fr_pair_order_list_insert_tail(&list->order, to_add);
+	fr_pair_list_changed(list, to_add);
 
 	return 0;
 }
@@ -1391,7 +1550,14 @@ int fr_pair_insert_after(fr_pair_list_t *list, fr_pair_t *pos, fr_pair_t *to_add
 		return -1;
 	}
 
+	/*
+	 *	Undecoded pairs have a fixed position in the list,
+	 *	so they need to be in it before we insert others.
+	 */
+	fr_pair_list_lazy_decode(list, NULL);
+
 	fr_pair_order_list_insert_after(&list->order, pos, to_add);
+	fr_pair_list_changed(list, to_add);
 
 	return 0;
 }
@@ -1425,7 +1591,14 @@ int fr_pair_insert_before(fr_pair_list_t *list, fr_pair_t *pos, fr_pair_t *to_ad
 		return -1;
 	}
 
+	/*
+	 *	Undecoded pairs have a fixed position in the list,
+	 *	so they need to be in it before we insert others.
+	 */
+	fr_pair_list_lazy_decode(list, NULL);
+
 	fr_pair_order_list_insert_before(&list->order, pos, to_add);
+	fr_pair_list_changed(list, to_add);
 
 	return 0;
 }
@@ -2000,8 +2173,8 @@ int fr_pair_cmp(fr_pair_t const *a, fr_pair_t const *b)
 
 			if (!fr_cond_assert(a->vp_type == FR_TYPE_STRING)) return -1;
 
-			slen = regex_compile(NULL, &preg, a->vp_strvalue, talloc_array_length(a->vp_strvalue) - 1,
-					     NULL, false, true);
+			slen = regex_compile_cached(NULL, &preg, a->vp_strvalue, talloc_array_length(a->vp_strvalue) - 1,
+						    NULL, false);
 			if (slen <= 0) {
 				fr_strerror_printf_push("Error at offset %zd compiling regex for %s", -slen,
 							a->da->name);
@@ -2536,6 +2709,8 @@ void fr_pair_value_clear(fr_pair_t *vp)
 {
 	fr_pair_t *child;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
+
 	switch (vp->vp_type) {
 	default:
 		fr_value_box_clear_value(&vp->data);
@@ -2566,6 +2741,8 @@ int fr_pair_value_copy(fr_pair_t *dst, fr_pair_t *src)
 {
 	if (!fr_cond_assert(src->data.type != FR_TYPE_NULL)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(dst), dst);
+
 	if (dst->data.type != FR_TYPE_NULL) fr_value_box_clear_value(&dst->data);
 	fr_value_box_copy(dst, &dst->data, &src->data);
 
@@ -2608,6 +2785,8 @@ int fr_pair_value_from_str(fr_pair_t *vp, char const *value, size_t inlen,
 		break;
 	}
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
+
 	/*
 	 *	We presume that the input data is from a double quoted
 	 *	string, and needs unescaping
@@ -2640,6 +2819,7 @@ int fr_pair_value_strdup(fr_pair_t *vp, char const *src, bool tainted)
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_STRING)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);	/* Free any existing buffers */
 	ret = fr_value_box_strdup(vp, &vp->data, vp->da, src, tainted);
 	if (ret == 0) {
@@ -2662,6 +2842,7 @@ int fr_pair_value_strdup_shallow(fr_pair_t *vp, char const *src, bool tainted)
 {
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_STRING)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);
 	fr_value_box_strdup_shallow(&vp->data, vp->da, src, tainted);
 
@@ -2683,6 +2864,7 @@ int fr_pair_value_strtrim(fr_pair_t *vp)
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_STRING)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	ret = fr_value_box_strtrim(vp, &vp->data);
 	if (ret == 0) {
 		PAIR_VERIFY(vp);
@@ -2705,6 +2887,7 @@ int fr_pair_value_aprintf(fr_pair_t *vp, char const *fmt, ...)
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_STRING)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);
 	va_start(ap, fmt);
 	ret = fr_value_box_vasprintf(vp, &vp->data, vp->da, false, fmt, ap);
@@ -2736,6 +2919,7 @@ int fr_pair_value_bstr_alloc(fr_pair_t *vp, char **out, size_t size, bool tainte
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_STRING)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);	/* Free any existing buffers */
 	ret = fr_value_box_bstr_alloc(vp, out, &vp->data, vp->da, size, tainted);
 	if (ret == 0) {
@@ -2761,6 +2945,7 @@ int fr_pair_value_bstr_realloc(fr_pair_t *vp, char **out, size_t size)
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_STRING)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	ret = fr_value_box_bstr_realloc(vp, out, &vp->data, size);
 	if (ret == 0) {
 		PAIR_VERIFY(vp);
@@ -2790,6 +2975,7 @@ int fr_pair_value_bstrndup(fr_pair_t *vp, char const *src, size_t len, bool tain
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_STRING)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);
 	ret = fr_value_box_bstrndup(vp, &vp->data, vp->da, src, len, tainted);
 	if (ret == 0) {
@@ -2816,6 +3002,7 @@ int fr_pair_value_bstrdup_buffer(fr_pair_t *vp, char const *src, bool tainted)
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_STRING)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);
 	ret = fr_value_box_bstrdup_buffer(vp, &vp->data, vp->da, src, tainted);
 	if (ret == 0) {
@@ -2839,6 +3026,7 @@ int fr_pair_value_bstrndup_shallow(fr_pair_t *vp, char const *src, size_t len, b
 {
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_STRING)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);
 	fr_value_box_bstrndup_shallow(&vp->data, vp->da, src, len, tainted);
 	PAIR_VERIFY(vp);
@@ -2861,6 +3049,7 @@ int fr_pair_value_bstrdup_buffer_shallow(fr_pair_t *vp, char const *src, bool ta
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_STRING)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);
 	ret = fr_value_box_bstrdup_buffer_shallow(NULL, &vp->data, vp->da, src, tainted);
 	if (ret == 0) {
@@ -2889,6 +3078,7 @@ int fr_pair_value_mem_alloc(fr_pair_t *vp, uint8_t **out, size_t size, bool tain
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_OCTETS)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);	/* Free any existing buffers */
 	ret = fr_value_box_mem_alloc(vp, out, &vp->data, vp->da, size, tainted);
 	if (ret == 0) {
@@ -2914,6 +3104,7 @@ int fr_pair_value_mem_realloc(fr_pair_t *vp, uint8_t **out, size_t size)
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_OCTETS)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	ret = fr_value_box_mem_realloc(vp, out, &vp->data, size);
 	if (ret == 0) {
 		PAIR_VERIFY(vp);
@@ -2946,6 +3137,7 @@ int fr_pair_value_memdup(fr_pair_t *vp, uint8_t const *src, size_t len, bool tai
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_OCTETS)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear_value(&vp->data);	/* Free any existing buffers */
 	ret = fr_value_box_memdup(vp, &vp->data, vp->da, src, len, tainted);
 	if (ret == 0) PAIR_VERIFY(vp);
@@ -2970,6 +3162,7 @@ int fr_pair_value_memdup_buffer(fr_pair_t *vp, uint8_t const *src, bool tainted)
 
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_OCTETS)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);	/* Free any existing buffers */
 	ret = fr_value_box_memdup_buffer(vp, &vp->data, vp->da, src, tainted);
 	if (ret == 0) {
@@ -2993,6 +3186,7 @@ int fr_pair_value_memdup_shallow(fr_pair_t *vp, uint8_t const *src, size_t len,
 {
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_OCTETS)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);
 	fr_value_box_memdup_shallow(&vp->data, vp->da, src, len, tainted);
 	PAIR_VERIFY(vp);
@@ -3013,6 +3207,7 @@ int fr_pair_value_memdup_buffer_shallow(fr_pair_t *vp, uint8_t const *src, bool
 {
 	if (!fr_cond_assert(vp->vp_type == FR_TYPE_OCTETS)) return -1;
 
+	fr_pair_list_changed(fr_pair_parent_list(vp), vp);
 	fr_value_box_clear(&vp->data);
 	fr_value_box_memdup_buffer_shallow(NULL, &vp->data, vp->da, src, tainted);
 	PAIR_VERIFY(vp);
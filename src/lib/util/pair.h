@@ -49,15 +49,58 @@ typedef struct value_pair_s fr_pair_t;
 
 FR_TLIST_TYPES(fr_pair_order_list)
 
-typedef struct pair_list_s {
+typedef struct fr_pair_list_lazy_s fr_pair_list_lazy_t;
+
+/** Decode pairs which were left in their wire format
+ *
+ * The callback is given an empty list to add the decoded pairs to.
+ * They're then moved into the list the lazy state was associated
+ * with, at the position they had in the original packet.
+ *
+ * @param[in] list	to add the decoded pairs to.
+ * @param[in] da	the caller is looking for.  NULL means decode everything.
+ * @param[in] lazy	the state which was passed to #fr_pair_list_lazy_set.
+ * @return
+ *	- 1 if there are still pairs left to decode.
+ *	- 0 if everything has been decoded.
+ *	- <0 on error.  Any pairs which weren't decoded are lost.
+ */
+typedef int (*fr_pair_list_lazy_func_t)(fr_pair_list_t *list, fr_dict_attr_t const *da, fr_pair_list_lazy_t *lazy);
+
+/** Report a failure to decode pairs which were left in their wire format
+ *
+ * The error is on the fr_strerror stack.
+ *
+ * @param[in] uctx	which was passed to #fr_pair_list_lazy_error_set.
+ */
+typedef void (*fr_pair_list_lazy_error_t)(void *uctx);
+
+/** Pairs which haven't been decoded yet
+ *
+ * Protocol decoders embed this as the first member of their own state.
+ */
+struct fr_pair_list_lazy_s {
+	fr_pair_list_lazy_func_t	func;		//!< Called to decode the pairs.
+	fr_pair_t			*prev;		//!< Decoded pairs are inserted after this one.
+							///< NULL means at the head of the list.
+	fr_pair_list_lazy_error_t	error;		//!< Called if decoding fails.  May be NULL.
+	void				*uctx;		//!< Passed to error.
+};
+
+struct pair_list_s {
         FR_TLIST_HEAD(fr_pair_order_list)	order;			//!< Maintains the relative order of pairs in a list.
 
+	fr_pair_list_lazy_t		* _CONST lazy;			//!< Pairs which haven't been decoded yet.
+
 	bool				 _CONST is_child;		//!< is a child of a VP
 
+	unsigned int			 _CONST generation;		//!< Changes when pairs, other than internal ones, are added to,
+									///< removed from, or edited in this list or any list nested in it.
+
 #ifdef WITH_VERIFY_PTR
 	unsigned int		verified : 1;				//!< hack to avoid O(N^3) issues
 #endif
-} fr_pair_list_t;
+};
 
 /** Stores an attribute, a value and various bits of other data
  *
@@ -436,6 +479,27 @@ do { \
 /** @hidecallergraph */
 void fr_pair_list_init(fr_pair_list_t *head) CC_HINT(nonnull);
 
+void fr_pair_list_lazy_set(fr_pair_list_t *list, fr_pair_t *prev, fr_pair_list_lazy_t *lazy) CC_HINT(nonnull(1,3));
+
+void fr_pair_list_lazy_error_set(fr_pair_list_t *list, fr_pair_list_lazy_error_t error, void *uctx) CC_HINT(nonnull(1,2));
+
+int _fr_pair_list_lazy_decode(fr_pair_list_t *list, fr_dict_attr_t const *da) CC_HINT(nonnull(1));
+
+/** Decode any pairs in a list which were left in their wire format
+ *
+ * @param[in] list	to decode pairs for.
+ * @param[in] da	the caller is looking for.  NULL means decode everything.
+ * @return
+ *	- 0 on success, or if there was nothing to decode.
+ *	- -1 on error.
+ */
+static inline int fr_pair_list_lazy_decode(fr_pair_list_t const *list, fr_dict_attr_t const *da)
+{
+	if (likely(!list->lazy)) return 0;
+
+	return _fr_pair_list_lazy_decode(UNCONST(fr_pair_list_t *, list), da);
+}
+
 void fr_pair_init_null(fr_pair_t *vp) CC_HINT(nonnull);
 
 /* Allocation and management */
@@ -550,6 +614,8 @@ fr_pair_t	*fr_pair_parent(fr_pair_t const *vp);
 
 fr_pair_t	*fr_pair_list_parent(fr_pair_list_t const *list);
 
+void		fr_pair_list_changed(fr_pair_list_t *list, fr_pair_t const *vp);
+
 fr_pair_t	*fr_pair_list_iter_leaf(fr_pair_list_t *list, fr_pair_t *vp);
 
 /** Initialises a special dcursor with callbacks that will maintain the attr sublists correctly
@@ -42,6 +42,8 @@ FR_TLIST_FUNCS(fr_pair_order_list, fr_pair_t, order_entry)
  */
 _INLINE fr_pair_t *fr_pair_list_head(fr_pair_list_t const *list)
 {
+	fr_pair_list_lazy_decode(list, NULL);
+
 	return fr_pair_order_list_head(&list->order);
 }
 
@@ -55,6 +57,8 @@ _INLINE fr_pair_t *fr_pair_list_head(fr_pair_list_t const *list)
  */
 _INLINE fr_pair_t *fr_pair_list_tail(fr_pair_list_t const *list)
 {
+	fr_pair_list_lazy_decode(list, NULL);
+
 	return fr_pair_order_list_tail(&list->order);
 }
 
@@ -69,6 +73,8 @@ _INLINE fr_pair_t *fr_pair_list_tail(fr_pair_list_t const *list)
  */
 _INLINE fr_pair_t *fr_pair_list_next(fr_pair_list_t const *list, fr_pair_t const *item)
 {
+	if (!item) fr_pair_list_lazy_decode(list, NULL);
+
 	return fr_pair_order_list_next(&list->order, item);
 }
 
@@ -82,6 +88,8 @@ _INLINE fr_pair_t *fr_pair_list_next(fr_pair_list_t const *list, fr_pair_t const
  */
 _INLINE fr_pair_t *fr_pair_list_prev(fr_pair_list_t const *list, fr_pair_t const *item)
 {
+	if (!item) fr_pair_list_lazy_decode(list, NULL);
+
 	return fr_pair_order_list_prev(&list->order, item);
 }
 
@@ -103,6 +111,16 @@ _INLINE fr_pair_t *fr_pair_remove(fr_pair_list_t *list, fr_pair_t *vp)
 	list->verified = false;
 #endif
 
+	/*
+	 *	Undecoded pairs go after this one, so they now go
+	 *	after the one before it.
+	 */
+	if (unlikely(list->lazy != NULL) && (list->lazy->prev == vp)) {
+		list->lazy->prev = fr_pair_order_list_prev(&list->order, vp);
+	}
+
+	fr_pair_list_changed(list, vp);
+
 	return fr_pair_order_list_remove(&list->order, vp);
 }
 
@@ -112,10 +130,20 @@ _INLINE fr_pair_t *fr_pair_remove(fr_pair_list_t *list, fr_pair_t *vp)
  */
 _INLINE void fr_pair_list_free(fr_pair_list_t *list)
 {
+	/*
+	 *	This is called when freeing pairs with children, and
+	 *	the lists they were in may already have been freed.
+	 *	So only this list is updated.
+	 */
+	if (list->lazy || !fr_pair_order_list_empty(&list->order)) list->generation++;
+
+	list->lazy = NULL;
 	fr_pair_order_list_talloc_free(&list->order);
 }
 
 /** Is a valuepair list empty
+ *
+ * @note A list with pairs which haven't been decoded yet is never empty.
  *
  * @param[in] list to check
  * @return true if empty
@@ -124,6 +152,8 @@ _INLINE void fr_pair_list_free(fr_pair_list_t *list)
  */
 _INLINE bool fr_pair_list_empty(fr_pair_list_t const *list)
 {
+	if (list->lazy) return false;
+
 	return fr_pair_order_list_empty(&list->order);
 }
 
@@ -139,7 +169,10 @@ _INLINE bool fr_pair_list_empty(fr_pair_list_t const *list)
  */
 _INLINE void fr_pair_list_sort(fr_pair_list_t *list, fr_cmp_t cmp)
 {
+	fr_pair_list_lazy_decode(list, NULL);
+
 	fr_pair_order_list_sort(&list->order, cmp);
+	fr_pair_list_changed(list, NULL);
 }
 
 /** Get the length of a list of fr_pair_t
@@ -150,6 +183,8 @@ _INLINE void fr_pair_list_sort(fr_pair_list_t *list, fr_cmp_t cmp)
  */
 _INLINE size_t fr_pair_list_num_elements(fr_pair_list_t const *list)
 {
+	fr_pair_list_lazy_decode(list, NULL);
+
 	return fr_pair_order_list_num_elements(&list->order);
 }
 
@@ -161,6 +196,8 @@ _INLINE size_t fr_pair_list_num_elements(fr_pair_list_t const *list)
  */
 _INLINE fr_dlist_head_t *fr_pair_list_to_dlist(fr_pair_list_t const *list)
 {
+	fr_pair_list_lazy_decode(list, NULL);
+
 	return fr_pair_order_list_dlist_head(&list->order);
 }
 
@@ -184,6 +221,14 @@ _INLINE void fr_pair_list_append(fr_pair_list_t *dst, fr_pair_list_t *src)
 #ifdef WITH_VERIFY_POINTER
 	dst->verified = false;
 #endif
+	fr_pair_list_lazy_decode(dst, NULL);
+	fr_pair_list_lazy_decode(src, NULL);
+
+	if (!fr_pair_order_list_empty(&src->order)) {
+		fr_pair_list_changed(dst, NULL);
+		fr_pair_list_changed(src, NULL);
+	}
+
 	fr_pair_order_list_move(&dst->order, &src->order);
 }
 
@@ -194,5 +239,13 @@ _INLINE void fr_pair_list_append(fr_pair_list_t *dst, fr_pair_list_t *src)
  */
 _INLINE void fr_pair_list_prepend(fr_pair_list_t *dst, fr_pair_list_t *src)
 {
+	fr_pair_list_lazy_decode(dst, NULL);
+	fr_pair_list_lazy_decode(src, NULL);
+
+	if (!fr_pair_order_list_empty(&src->order)) {
+		fr_pair_list_changed(dst, NULL);
+		fr_pair_list_changed(src, NULL);
+	}
+
 	fr_pair_order_list_move_head(&dst->order, &src->order);
 }
@@ -819,6 +819,263 @@ static void test_fr_pair_list_sort(void)
 	fr_pair_list_free(&local_pairs);
 }
 
+typedef struct {
+	fr_pair_list_lazy_t	lazy;
+	unsigned int		calls;
+} test_lazy_t;
+
+/** Pretend to decode a single uint32 pair from a packet
+ *
+ */
+static int test_lazy_decode(fr_pair_list_t *list, fr_dict_attr_t const *da, fr_pair_list_lazy_t *lazy_hdr)
+{
+	test_lazy_t	*lazy = (test_lazy_t *) lazy_hdr;
+	fr_pair_t	*vp;
+
+	lazy->calls++;
+
+	if (da && (da != fr_dict_attr_test_uint32)) return 1;
+
+	TEST_CHECK(fr_pair_list_empty(list));
+
+	MEM(vp = fr_pair_afrom_da(autofree, fr_dict_attr_test_uint32));
+	vp->vp_uint32 = 42;
+	fr_pair_append(list, vp);
+
+	return 0;
+}
+
+/** Build "Test-String, <undecoded Test-Integer>, Test-Uint8"
+ *
+ */
+static void test_lazy_list(fr_pair_list_t *list, test_lazy_t *lazy, fr_pair_t **first, fr_pair_t **last)
+{
+	fr_pair_list_init(list);
+	lazy->calls = 0;
+
+	MEM(*first = fr_pair_afrom_da(autofree, fr_dict_attr_test_string));
+	fr_pair_append(list, *first);
+
+	fr_pair_list_lazy_set(list, *first, &lazy->lazy);
+
+	MEM(*last = fr_pair_afrom_da(autofree, fr_dict_attr_test_uint8));
+	fr_pair_append(list, *last);
+}
+
+static void test_fr_pair_list_lazy(void)
+{
+	fr_pair_list_t	local_pairs;
+	fr_pair_t	*vp, *first, *last;
+	test_lazy_t	lazy = { .lazy = { .func = test_lazy_decode } };
+
+	fr_pair_list_init(&local_pairs);
+
+	TEST_CASE("A list with undecoded pairs is not empty");
+	fr_pair_list_lazy_set(&local_pairs, NULL, &lazy.lazy);
+	TEST_CHECK(!fr_pair_list_empty(&local_pairs));
+	TEST_CHECK(lazy.calls == 0);
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Appending leaves the pairs undecoded");
+	test_lazy_list(&local_pairs, &lazy, &first, &last);
+	TEST_CHECK(lazy.calls == 0);
+	TEST_CHECK(local_pairs.lazy == &lazy.lazy);
+
+	TEST_CASE("Searching for other attributes leaves the pairs undecoded");
+	TEST_CHECK(fr_pair_find_by_da(&local_pairs, NULL, fr_dict_attr_test_string) == first);
+	TEST_CHECK(fr_pair_find_by_da(&local_pairs, NULL, fr_dict_attr_test_enum) == NULL);
+	TEST_CHECK(local_pairs.lazy == &lazy.lazy);
+
+	TEST_CASE("Searching for an undecoded attribute decodes it in its original position");
+	vp = fr_pair_find_by_da(&local_pairs, NULL, fr_dict_attr_test_uint32);
+	TEST_CHECK(vp != NULL);
+	TEST_CHECK(vp && (vp->vp_uint32 == 42));
+	TEST_CHECK(local_pairs.lazy == NULL);
+	TEST_CHECK(fr_pair_list_num_elements(&local_pairs) == 3);
+	TEST_CHECK(fr_pair_list_next(&local_pairs, first) == vp);
+	TEST_CHECK(fr_pair_list_next(&local_pairs, vp) == last);
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Walking over the list decodes everything");
+	test_lazy_list(&local_pairs, &lazy, &first, &last);
+	vp = fr_pair_list_head(&local_pairs);
+	TEST_CHECK(lazy.calls == 1);
+	TEST_CHECK(vp == first);
+	vp = fr_pair_list_next(&local_pairs, vp);
+	TEST_CHECK(vp && (vp->da == fr_dict_attr_test_uint32));
+	TEST_CHECK(fr_pair_list_tail(&local_pairs) == last);
+	TEST_CHECK(local_pairs.lazy == NULL);
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Undecoded pairs with no predecessor go at the head");
+	fr_pair_list_init(&local_pairs);
+	lazy.calls = 0;
+	fr_pair_list_lazy_set(&local_pairs, NULL, &lazy.lazy);
+	MEM(last = fr_pair_afrom_da(autofree, fr_dict_attr_test_uint8));
+	fr_pair_append(&local_pairs, last);
+	vp = fr_pair_list_head(&local_pairs);
+	TEST_CHECK(vp && (vp->da == fr_dict_attr_test_uint32));
+	TEST_CHECK(fr_pair_list_tail(&local_pairs) == last);
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Prepending decodes first");
+	test_lazy_list(&local_pairs, &lazy, &first, &last);
+	MEM(vp = fr_pair_afrom_da(autofree, fr_dict_attr_test_enum));
+	fr_pair_prepend(&local_pairs, vp);
+	TEST_CHECK(lazy.calls == 1);
+	TEST_CHECK(local_pairs.lazy == NULL);
+	TEST_CHECK(fr_pair_list_head(&local_pairs) == vp);
+	vp = fr_pair_list_next(&local_pairs, first);
+	TEST_CHECK(vp && (vp->da == fr_dict_attr_test_uint32));
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Inserting after a pair decodes first");
+	test_lazy_list(&local_pairs, &lazy, &first, &last);
+	MEM(vp = fr_pair_afrom_da(autofree, fr_dict_attr_test_enum));
+	fr_pair_insert_after(&local_pairs, first, vp);
+	TEST_CHECK(lazy.calls == 1);
+	TEST_CHECK(fr_pair_list_next(&local_pairs, first) == vp);
+	vp = fr_pair_list_next(&local_pairs, vp);
+	TEST_CHECK(vp && (vp->da == fr_dict_attr_test_uint32));
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Inserting before a pair decodes first");
+	test_lazy_list(&local_pairs, &lazy, &first, &last);
+	MEM(vp = fr_pair_afrom_da(autofree, fr_dict_attr_test_enum));
+	fr_pair_insert_before(&local_pairs, last, vp);
+	TEST_CHECK(lazy.calls == 1);
+	TEST_CHECK(fr_pair_list_prev(&local_pairs, last) == vp);
+	vp = fr_pair_list_prev(&local_pairs, vp);
+	TEST_CHECK(vp && (vp->da == fr_dict_attr_test_uint32));
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Replacing a pair decodes first");
+	test_lazy_list(&local_pairs, &lazy, &first, &last);
+	MEM(vp = fr_pair_afrom_da(autofree, fr_dict_attr_test_enum));
+	fr_pair_replace(&local_pairs, first, vp);
+	TEST_CHECK(lazy.calls == 1);
+	TEST_CHECK(fr_pair_list_head(&local_pairs) == vp);
+	vp = fr_pair_list_next(&local_pairs, vp);
+	TEST_CHECK(vp && (vp->da == fr_dict_attr_test_uint32));
+	TEST_CHECK(fr_pair_list_next(&local_pairs, vp) == last);
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Deleting the preceding pair moves the insertion point");
+	test_lazy_list(&local_pairs, &lazy, &first, &last);
+	fr_pair_delete(&local_pairs, first);
+	TEST_CHECK(lazy.calls == 0);
+	TEST_CHECK(local_pairs.lazy && (local_pairs.lazy->prev == NULL));
+	vp = fr_pair_list_head(&local_pairs);
+	TEST_CHECK(vp && (vp->da == fr_dict_attr_test_uint32));
+	TEST_CHECK(fr_pair_list_tail(&local_pairs) == last);
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Freeing the list discards undecoded pairs");
+	test_lazy_list(&local_pairs, &lazy, &first, &last);
+	fr_pair_list_free(&local_pairs);
+	TEST_CHECK(fr_pair_list_empty(&local_pairs));
+	TEST_CHECK(lazy.calls == 0);
+}
+
+/** Fail to decode anything
+ *
+ */
+static int test_lazy_decode_fail(UNUSED fr_pair_list_t *list, UNUSED fr_dict_attr_t const *da, fr_pair_list_lazy_t *lazy_hdr)
+{
+	test_lazy_t	*lazy = (test_lazy_t *) lazy_hdr;
+
+	lazy->calls++;
+	fr_strerror_const("Malformed attribute");
+
+	return -1;
+}
+
+static void test_lazy_error(void *uctx)
+{
+	unsigned int *errors = uctx;
+
+	TEST_CHECK(strcmp(fr_strerror_peek(), "Malformed attribute") == 0);
+	(*errors)++;
+}
+
+static void test_fr_pair_list_lazy_error(void)
+{
+	fr_pair_list_t	local_pairs;
+	fr_pair_t	*first, *last;
+	test_lazy_t	lazy = { .lazy = { .func = test_lazy_decode_fail } };
+	unsigned int	errors = 0;
+
+	TEST_CASE("Decode errors are passed to the error function");
+	test_lazy_list(&local_pairs, &lazy, &first, &last);
+	fr_pair_list_lazy_error_set(&local_pairs, test_lazy_error, &errors);
+	TEST_CHECK(fr_pair_find_by_da(&local_pairs, NULL, fr_dict_attr_test_uint32) == NULL);
+	TEST_CHECK(lazy.calls == 1);
+	TEST_CHECK(errors == 1);
+
+	TEST_CASE("The undecoded pairs are discarded, so the error is only reported once");
+	TEST_CHECK(local_pairs.lazy == NULL);
+	TEST_CHECK(fr_pair_list_num_elements(&local_pairs) == 2);
+	TEST_CHECK(errors == 1);
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Without an error function, the error is left on the stack");
+	fr_strerror_clear();
+	lazy.lazy.error = NULL;
+	test_lazy_list(&local_pairs, &lazy, &first, &last);
+	TEST_CHECK(fr_pair_list_lazy_decode(&local_pairs, NULL) < 0);
+	TEST_CHECK(strcmp(fr_strerror_peek(), "Malformed attribute") == 0);
+	fr_pair_list_free(&local_pairs);
+}
+
+static void test_fr_pair_list_generation(void)
+{
+	fr_pair_list_t	local_pairs;
+	fr_pair_t	*vp, *parent;
+	unsigned int	generation;
+	test_lazy_t	lazy = { .lazy = { .func = test_lazy_decode } };
+
+	fr_pair_list_init(&local_pairs);
+
+	TEST_CASE("Appending changes the generation");
+	generation = local_pairs.generation;
+	MEM(vp = fr_pair_afrom_da(autofree, fr_dict_attr_test_string));
+	fr_pair_append(&local_pairs, vp);
+	TEST_CHECK(local_pairs.generation != generation);
+
+	TEST_CASE("Setting a value changes the generation");
+	generation = local_pairs.generation;
+	TEST_CHECK(fr_pair_value_strdup(vp, test_string, false) == 0);
+	TEST_CHECK(local_pairs.generation != generation);
+
+	TEST_CASE("Searching doesn't change the generation");
+	generation = local_pairs.generation;
+	TEST_CHECK(fr_pair_find_by_da(&local_pairs, NULL, fr_dict_attr_test_string) == vp);
+	TEST_CHECK(local_pairs.generation == generation);
+
+	TEST_CASE("Removing changes the generation");
+	fr_pair_remove(&local_pairs, vp);
+	TEST_CHECK(local_pairs.generation != generation);
+	talloc_free(vp);
+
+	TEST_CASE("Editing a nested pair changes the generation of the top level list");
+	MEM(parent = fr_pair_afrom_da(autofree, fr_dict_attr_test_tlv));
+	fr_pair_append(&local_pairs, parent);
+	MEM(vp = fr_pair_afrom_da(parent, fr_dict_attr_test_tlv_string));
+	fr_pair_append(&parent->vp_group, vp);
+	generation = local_pairs.generation;
+	TEST_CHECK(fr_pair_value_strdup(vp, test_string, false) == 0);
+	TEST_CHECK(local_pairs.generation != generation);
+	fr_pair_list_free(&local_pairs);
+
+	TEST_CASE("Decoding lazy pairs doesn't change the generation");
+	test_lazy_list(&local_pairs, &lazy, &vp, &parent);
+	generation = local_pairs.generation;
+	TEST_CHECK(fr_pair_find_by_da(&local_pairs, NULL, fr_dict_attr_test_uint32) != NULL);
+	TEST_CHECK(lazy.calls == 1);
+	TEST_CHECK(local_pairs.generation == generation);
+	fr_pair_list_free(&local_pairs);
+}
+
 static void test_fr_pair_value_copy(void)
 {
 	fr_pair_t *vp1, *vp2;
@@ -1333,6 +1590,9 @@ TEST_LIST = {
 	{ "fr_pair_list_copy_by_da",              test_fr_pair_list_copy_by_da },
 	{ "fr_pair_list_copy_by_ancestor",        test_fr_pair_list_copy_by_ancestor },
 	{ "fr_pair_list_sort",                    test_fr_pair_list_sort },
+	{ "fr_pair_list_lazy",                    test_fr_pair_list_lazy },
+	{ "fr_pair_list_lazy_error",              test_fr_pair_list_lazy_error },
+	{ "fr_pair_list_generation",              test_fr_pair_list_generation },
 
 	/* Copy */
 	{ "fr_pair_value_copy",                   test_fr_pair_value_copy },
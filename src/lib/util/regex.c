@@ -27,6 +27,8 @@ RCSID("$Id$")
 
 #include <freeradius-devel/util/regex.h>
 #include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
 
 #if defined(HAVE_REGEX_PCRE) || (defined(HAVE_REGEX_PCRE2) && defined(PCRE2_CONFIG_JIT))
 #ifndef FR_PCRE_JIT_STACK_MIN
@@ -81,6 +83,38 @@ const fr_sbuff_escape_rules_t regex_escape_rules = {
  *	libpcre2.
  */
 
+#ifndef FR_REGEX_CACHE_SIZE
+#  define FR_REGEX_CACHE_SIZE	128
+#endif
+
+/** Number of times a cached expression must be used before we JIT it
+ *
+ * JIT compilation costs far more than a normal compilation, so it's
+ * only worth it for expressions which are evaluated repeatedly.
+ */
+#ifndef FR_REGEX_CACHE_JIT_USES
+#  define FR_REGEX_CACHE_JIT_USES	2
+#endif
+
+/** Maximum number of runtime compiled expressions each thread will cache
+ *
+ * Zero disables the cache.
+ */
+static uint32_t regex_cache_size = FR_REGEX_CACHE_SIZE;
+
+/** An entry in the thread local cache of runtime compiled expressions
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;		//!< Entry in the LRU list.
+	uint32_t		hash;		//!< Hash of the pattern and compile options.
+	uint32_t		cflags;		//!< PCRE2 compile options.
+	char const		*pattern;	//!< The expression was compiled from.
+	size_t			len;		//!< Length of the pattern.
+	uint32_t		uses;		//!< How many times the expression has been handed out.
+	regex_t			*preg;		//!< Compiled expression.  JIT'd once it's been reused.
+} fr_regex_cache_entry_t;
+
 /** Thread local storage for PCRE2
  *
  * Not all this storage is thread local, but it simplifies cleanup if
@@ -96,6 +130,9 @@ typedef struct {
 	pcre2_jit_stack		*jit_stack;	//!< Jit stack for executing jit'd patterns.
 	bool			do_jit;		//!< Whether we have runtime JIT support.
 #endif
+	fr_hash_table_t		*cache;		//!< Runtime compiled expressions, keyed by pattern and options.
+	fr_dlist_head_t		cache_lru;	//!< Cache entries, least recently used at the head.
+	fr_regex_cache_stats_t	cache_stats;	//!< Counters for the cache.
 } fr_pcre2_tls_t;
 
 /** Thread local storage for pcre2
@@ -144,6 +181,35 @@ static int _pcre2_tls_free_on_exit(void *arg)
 	return talloc_free(arg);
 }
 
+static uint32_t regex_cache_entry_hash(void const *data)
+{
+	fr_regex_cache_entry_t const *c = data;
+
+	return c->hash;
+}
+
+static int8_t regex_cache_entry_cmp(void const *one, void const *two)
+{
+	fr_regex_cache_entry_t const *a = one, *b = two;
+
+	CMP_RETURN(a, b, cflags);
+
+	return memcmp_return(a->pattern, b->pattern, a->len, b->len);
+}
+
+/** Release the cache's hold on a compiled expression
+ *
+ * If any shallow copies handed out by #regex_compile_cached are still
+ * live, the compiled expression is reparented to one of them, and is
+ * freed when the last one is freed.
+ */
+static int _regex_cache_entry_free(fr_regex_cache_entry_t *c)
+{
+	if (c->preg) talloc_unlink(c, c->preg);
+
+	return 0;
+}
+
 /** Thread local init for pcre2
  *
  */
@@ -190,6 +256,13 @@ static int fr_pcre2_tls_init(void)
 	}
 #endif
 
+	tls->cache = fr_hash_table_alloc(tls, regex_cache_entry_hash, regex_cache_entry_cmp, NULL);
+	if (!tls->cache) {
+		fr_strerror_const("Failed allocating regex cache");
+		goto error;
+	}
+	fr_dlist_talloc_init(&tls->cache_lru, fr_regex_cache_entry_t, entry);
+
 	/*
 	 *	Free on thread exit
 	 */
@@ -212,6 +285,60 @@ static int _regex_free(regex_t *preg)
 	return 0;
 }
 
+/** Convert our regex flags to PCRE2 compile options
+ *
+ * @param[in] flags		controlling matching. May be NULL.
+ * @param[in] subcaptures	Whether the expression should store subcapture data.
+ * @return PCRE2 compile options.
+ */
+static inline uint32_t regex_pcre2_cflags(fr_regex_flags_t const *flags, bool subcaptures)
+{
+	uint32_t cflags = 0;
+
+	if (flags) {
+		 /* flags->global implemented by substitution function */
+		if (flags->ignore_case) cflags |= PCRE2_CASELESS;
+		if (flags->multiline) cflags |= PCRE2_MULTILINE;
+		if (flags->dot_all) cflags |= PCRE2_DOTALL;
+		if (flags->unicode) cflags |= PCRE2_UTF;
+		if (flags->extended) cflags |= PCRE2_EXTENDED;
+	}
+
+	if (!subcaptures) cflags |= PCRE2_NO_AUTO_CAPTURE;
+
+	return cflags;
+}
+
+/** Run a compiled expression through the PCRE2 JIT, if it's available
+ *
+ * @param[in] preg	to JIT.
+ * @return
+ *	- 0 on success, or if JIT isn't available.
+ *	- -1 if JIT compilation failed.  The expression is unchanged.
+ */
+static inline int regex_jit(regex_t *preg)
+{
+#ifdef PCRE2_CONFIG_JIT
+	int ret;
+
+	if (!fr_pcre2_tls->do_jit || preg->jitd) return 0;
+
+	ret = pcre2_jit_compile(preg->compiled, PCRE2_JIT_COMPLETE);
+	if (ret < 0) {
+		PCRE2_UCHAR errbuff[128];
+
+		pcre2_get_error_message(ret, errbuff, sizeof(errbuff));
+		fr_strerror_printf("Pattern JIT failed: %s", (char *)errbuff);
+		return -1;
+	}
+
+	preg->jitd = true;
+#else
+	UNUSED_VAR(preg);
+#endif
+	return 0;
+}
+
 /** Wrapper around pcre2_compile
  *
  * Allows the rest of the code to do compilations using one function signature.
@@ -227,7 +354,8 @@ static int _regex_free(regex_t *preg)
  *				data.
  * @param[in] runtime		If false run the pattern through the PCRE JIT (if available)
  *				to convert it to machine code. This trades startup time (longer)
- *				for runtime performance (better).
+ *				for runtime performance (better).  If the JIT fails, so does
+ *				the compilation.
  * @return
  *	- >= 1 on success.
  *	- <= 0 on error. Negative value is offset of parse error.
@@ -237,7 +365,7 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 {
 	int		ret;
 	PCRE2_SIZE	offset;
-	uint32_t	cflags = 0;
+	uint32_t	cflags;
 	regex_t		*preg;
 
 	/*
@@ -255,19 +383,7 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 		return 0;
 	}
 
-	/*
-	 *	Options
-	 */
-	if (flags) {
-		 /* flags->global implemented by substitution function */
-		if (flags->ignore_case) cflags |= PCRE2_CASELESS;
-		if (flags->multiline) cflags |= PCRE2_MULTILINE;
-		if (flags->dot_all) cflags |= PCRE2_DOTALL;
-		if (flags->unicode) cflags |= PCRE2_UTF;
-		if (flags->extended) cflags |= PCRE2_EXTENDED;
-	}
-
-	if (!subcaptures) cflags |= PCRE2_NO_AUTO_CAPTURE;
+	cflags = regex_pcre2_cflags(flags, subcaptures);
 
 	preg = talloc_zero(ctx, regex_t);
 	talloc_set_destructor(preg, _regex_free);
@@ -287,26 +403,152 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 	if (!runtime) {
 		preg->precompiled = true;
 
-#ifdef PCRE2_CONFIG_JIT
 		/*
 		 *	This is expensive, so only do it for
 		 *	expressions that are going to be
 		 *	evaluated repeatedly.
 		 */
-		if (fr_pcre2_tls->do_jit) {
-			ret = pcre2_jit_compile(preg->compiled, PCRE2_JIT_COMPLETE);
-			if (ret < 0) {
-				PCRE2_UCHAR errbuff[128];
+		if (regex_jit(preg) < 0) {
+			talloc_free(preg);
+			return 0;
+		}
+	}
+
+	*out = preg;
+
+	return len;
+}
+
+/** Compile a runtime expression, reusing a previous compilation if one is available
+ *
+ * Expressions built from runtime expansions often only take on a handful of
+ * distinct values, e.g. a pattern built from the realm of the user.  Compiling,
+ * and especially JITing, costs far more than the match itself, so we keep a
+ * bounded, thread local, LRU cache of compiled expressions keyed by pattern and
+ * compile options.
+ *
+ * Expressions are JIT'd once they have been used #FR_REGEX_CACHE_JIT_USES times,
+ * so that patterns which are only seen once don't pay for JIT compilation.
+ *
+ * The expression returned is a shallow copy allocated in ctx, which holds a
+ * reference to the cached expression.  It must be freed with talloc_free, and
+ * remains valid even if the cache entry is evicted.
+ *
+ * @param[in] ctx		To allocate the returned expression in.
+ * @param[out] out		Where to write the compiled expression.
+ * @param[in] pattern		to compile.
+ * @param[in] len		of pattern.
+ * @param[in] flags		controlling matching. May be NULL.
+ * @param[in] subcaptures	Whether to compile the regular expression to store subcapture
+ *				data.
+ * @return
+ *	- >= 1 on success.
+ *	- <= 0 on error. Negative value is offset of parse error.
+ */
+ssize_t regex_compile_cached(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len,
+			     fr_regex_flags_t const *flags, bool subcaptures)
+{
+	fr_pcre2_tls_t		*tls;
+	fr_regex_cache_entry_t	find, *c;
+	regex_t			*preg;
+	ssize_t			slen;
+
+	*out = NULL;
+
+	/*
+	 *	Thread local initialisation
+	 */
+	if (unlikely(!fr_pcre2_tls) && (fr_pcre2_tls_init() < 0)) return -1;
+	tls = fr_pcre2_tls;
+
+	if (!regex_cache_size) return regex_compile(ctx, out, pattern, len, flags, subcaptures, true);
+
+	find = (fr_regex_cache_entry_t) {
+		.cflags = regex_pcre2_cflags(flags, subcaptures),
+		.pattern = pattern,
+		.len = len
+	};
+	find.hash = fr_hash_update(&find.cflags, sizeof(find.cflags), fr_hash(pattern, len));
+
+	c = fr_hash_table_find(tls->cache, &find);
+	if (c) {
+		tls->cache_stats.hits++;
+
+		fr_dlist_remove(&tls->cache_lru, c);
+		fr_dlist_insert_tail(&tls->cache_lru, c);
+	} else {
+		tls->cache_stats.misses++;
+
+		c = talloc_zero(tls, fr_regex_cache_entry_t);
+		if (unlikely(!c)) goto oom;
+		slen = regex_compile(c, &c->preg, pattern, len, flags, subcaptures, true);
+		if (slen <= 0) {
+			talloc_free(c);
+			return slen;
+		}
+		talloc_set_destructor(c, _regex_cache_entry_free);
+
+		c->pattern = talloc_bstrndup(c, pattern, len);
+		if (unlikely(!c->pattern)) {
+			talloc_free(c);
+			goto oom;
+		}
+		c->len = len;
+		c->cflags = find.cflags;
+		c->hash = find.hash;
+
+		/*
+		 *	Make room by evicting the least recently used entries.
+		 */
+		while (fr_dlist_num_elements(&tls->cache_lru) >= regex_cache_size) {
+			fr_regex_cache_entry_t *old = fr_dlist_pop_head(&tls->cache_lru);
 
-				pcre2_get_error_message(ret, errbuff, sizeof(errbuff));
-				fr_strerror_printf("Pattern JIT failed: %s", (char *)errbuff);
-				talloc_free(preg);
+			(void)fr_hash_table_remove(tls->cache, old);
+			talloc_free(old);
+			tls->cache_stats.evictions++;
+			tls->cache_stats.entries--;
+		}
 
-				return 0;
-			}
-			preg->jitd = true;
+		if (unlikely(!fr_hash_table_insert(tls->cache, c))) {
+			fr_strerror_const("Failed inserting expression into regex cache");
+			talloc_free(c);
+			return -1;
 		}
-#endif
+		fr_dlist_insert_tail(&tls->cache_lru, c);
+		tls->cache_stats.entries++;
+	}
+
+	/*
+	 *	The expression is being reused, so it's worth
+	 *	JITing.  Copies handed out earlier keep using the
+	 *	interpreter, which is still correct.
+	 *
+	 *	Unlike expressions compiled at startup, a JIT
+	 *	failure isn't an error here.  The expression has
+	 *	already been compiled, and may already be in use,
+	 *	so we carry on with the interpreter.
+	 */
+	if ((++c->uses == FR_REGEX_CACHE_JIT_USES) && (regex_jit(c->preg) < 0)) {
+		tls->cache_stats.jit_failures++;
+		fr_strerror_clear();
+	}
+
+	/*
+	 *	Hand out a shallow copy which shares the compiled
+	 *	expression.  It's marked as runtime compiled, so
+	 *	regex_sub_to_request() will steal it, and the
+	 *	reference keeps the compiled expression alive if
+	 *	the entry is evicted whilst captures are outstanding.
+	 */
+	preg = talloc(ctx, regex_t);
+	if (unlikely(!preg)) goto oom;
+	*preg = *c->preg;
+	preg->precompiled = false;
+	if (unlikely(!talloc_reference(preg, c->preg))) {
+		talloc_free(preg);
+	oom:
+		fr_strerror_const("Out of memory");
+		return -1;
 	}
 
 	*out = preg;
@@ -314,6 +556,34 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 	return len;
 }
 
+/** Set the maximum number of entries in each thread's regex cache
+ *
+ * Should be called before any worker threads are started.
+ *
+ * @param[in] size	Maximum number of entries.  0 disables the cache.
+ */
+void regex_cache_size_set(uint32_t size)
+{
+	regex_cache_size = size;
+}
+
+/** Return the counters for the calling thread's regex cache
+ *
+ * The counters are updated as the thread uses the cache, and remain
+ * valid until the thread exits, so callers can keep the pointer and
+ * read the counters later, e.g. from a stats command.
+ *
+ * @return
+ *	- The calling thread's counters.
+ *	- NULL if the thread local data couldn't be allocated.
+ */
+fr_regex_cache_stats_t const *regex_cache_stats(void)
+{
+	if (unlikely(!fr_pcre2_tls) && (fr_pcre2_tls_init() < 0)) return NULL;
+
+	return &fr_pcre2_tls->cache_stats;
+}
+
 /** Wrapper around pcre2_exec
  *
  * @param[in] preg	The compiled expression.
@@ -1290,6 +1560,28 @@ fr_regmatch_t *regex_match_data_alloc(TALLOC_CTX *ctx, uint32_t count)
  *########################################
  */
 
+#  ifndef HAVE_REGEX_PCRE2
+/** Compile a runtime expression
+ *
+ * Only libpcre2 builds cache compiled expressions.  Here we just compile
+ * the expression for one off evaluation.
+ */
+ssize_t regex_compile_cached(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len,
+			     fr_regex_flags_t const *flags, bool subcaptures)
+{
+	return regex_compile(ctx, out, pattern, len, flags, subcaptures, true);
+}
+
+void regex_cache_size_set(UNUSED uint32_t size)
+{
+}
+
+fr_regex_cache_stats_t const *regex_cache_stats(void)
+{
+	return NULL;
+}
+#  endif
+
 /** Parse a string containing one or more regex flags
  *
  * @param[out] err		May be NULL. If not NULL will be set to:
@@ -1425,7 +1717,7 @@ int fr_regex_cmp_op(fr_token_t op, fr_value_box_t const *a, fr_value_box_t const
 		lhs_len = a->vb_length;
 	}
 
-	if (regex_compile(ctx, &regex, b->vb_strvalue, b->vb_length, NULL, false, true) < 0) {
+	if (regex_compile_cached(ctx, &regex, b->vb_strvalue, b->vb_length, NULL, false) < 0) {
 		talloc_free(ctx);
 		return -1;
 	}
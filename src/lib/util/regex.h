@@ -169,6 +169,17 @@ typedef struct {
 
 #define REGEX_FLAG_BUFF_SIZE	7
 
+/** Counters for the thread local cache of runtime compiled expressions
+ *
+ */
+typedef struct {
+	uint64_t	hits;			//!< Lookups which found an existing compiled expression.
+	uint64_t	misses;			//!< Lookups which required the expression to be compiled.
+	uint64_t	evictions;		//!< Entries removed to make room for new ones.
+	uint64_t	jit_failures;		//!< Reused expressions which couldn't be JIT'd.
+	uint32_t	entries;		//!< Number of entries currently in the cache.
+} fr_regex_cache_stats_t;
+
 extern const fr_sbuff_escape_rules_t regex_escape_rules;
 
 /** Unique safefor value to prevent escaping for regexes
@@ -180,8 +191,16 @@ ssize_t		regex_flags_parse(int *err, fr_regex_flags_t *out, fr_sbuff_t *in,
 
 ssize_t		regex_flags_print(fr_sbuff_t *sbuff, fr_regex_flags_t const *flags);
 
-	ssize_t		regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len,
+ssize_t		regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len,
 			      fr_regex_flags_t const *flags, bool subcaptures, bool runtime);
+
+ssize_t		regex_compile_cached(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len,
+				     fr_regex_flags_t const *flags, bool subcaptures);
+
+void		regex_cache_size_set(uint32_t size);
+
+fr_regex_cache_stats_t const *regex_cache_stats(void);
+
 int		regex_exec(regex_t *preg, char const *subject, size_t len, fr_regmatch_t *regmatch) CC_HINT(nonnull(1,2));
 #ifdef HAVE_REGEX_PCRE2
 int		regex_substitute(TALLOC_CTX *ctx, char **out, size_t max_out, regex_t *preg, fr_regex_flags_t const *flags,
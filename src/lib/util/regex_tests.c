@@ -0,0 +1,218 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the runtime regex cache
+ *
+ * @file src/lib/util/regex_tests.c
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/regex.h>
+
+#ifdef HAVE_REGEX_PCRE2
+static regex_t *compile(TALLOC_CTX *ctx, char const *pattern, fr_regex_flags_t const *flags)
+{
+	regex_t	*preg;
+	ssize_t	slen;
+
+	slen = regex_compile_cached(ctx, &preg, pattern, strlen(pattern), flags, true);
+	TEST_CHECK_SLEN(slen, (ssize_t)strlen(pattern));
+	TEST_ASSERT(preg != NULL);
+
+	return preg;
+}
+
+static bool matches(regex_t *preg, char const *subject)
+{
+	return regex_exec(preg, subject, strlen(subject), NULL) == 1;
+}
+
+/** The same pattern and flags should share a compiled expression
+ *
+ */
+static void test_cache_hit(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("test");
+	regex_t		*a, *b, *c;
+
+	regex_cache_size_set(16);
+
+	a = compile(ctx, "^hit-[0-9]+$", NULL);
+	b = compile(ctx, "^hit-[0-9]+$", NULL);
+	TEST_CHECK(a != b);
+	TEST_CHECK(a->compiled == b->compiled);
+
+	/*
+	 *	Third use is JIT'd if the platform supports it, but
+	 *	must still match the same way.
+	 */
+	c = compile(ctx, "^hit-[0-9]+$", NULL);
+	TEST_CHECK(a->compiled == c->compiled);
+
+	TEST_CHECK(matches(a, "hit-42"));
+	TEST_CHECK(matches(b, "hit-42"));
+	TEST_CHECK(matches(c, "hit-42"));
+	TEST_CHECK(!matches(c, "hit-"));
+
+	talloc_free(ctx);
+}
+
+/** Different patterns, or the same pattern with different flags, must not share
+ *
+ */
+static void test_cache_miss(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("test");
+	regex_t			*a, *b, *c;
+	fr_regex_flags_t	icase = { .ignore_case = 1 };
+
+	regex_cache_size_set(16);
+
+	a = compile(ctx, "^miss$", NULL);
+	b = compile(ctx, "^other$", NULL);
+	c = compile(ctx, "^miss$", &icase);
+
+	TEST_CHECK(a->compiled != b->compiled);
+	TEST_CHECK(a->compiled != c->compiled);
+
+	TEST_CHECK(matches(a, "miss"));
+	TEST_CHECK(!matches(a, "MISS"));
+	TEST_CHECK(matches(c, "MISS"));
+	TEST_CHECK(!matches(b, "miss"));
+
+	talloc_free(ctx);
+}
+
+/** The least recently used entry is evicted, and copies of it remain usable
+ *
+ */
+static void test_cache_eviction(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("test");
+	regex_t		*first, *again, *p;
+	void		*compiled;
+
+	regex_cache_size_set(2);
+
+	first = compile(ctx, "^evict-a$", NULL);
+	compiled = first->compiled;
+
+	/*
+	 *	Touch "b" then "c", pushing "a" out.
+	 */
+	p = compile(ctx, "^evict-b$", NULL);
+	talloc_free(p);
+	p = compile(ctx, "^evict-c$", NULL);
+	talloc_free(p);
+
+	again = compile(ctx, "^evict-a$", NULL);
+	TEST_CHECK(again->compiled != compiled);
+
+	/*
+	 *	The copy handed out before eviction holds a
+	 *	reference to the original expression.
+	 */
+	TEST_CHECK(first->compiled == compiled);
+	TEST_CHECK(matches(first, "evict-a"));
+	TEST_CHECK(matches(again, "evict-a"));
+
+	/*
+	 *	Using "c" makes "a" the least recently used entry,
+	 *	so adding "b" evicts "a" and "c" survives.
+	 */
+	p = compile(ctx, "^evict-c$", NULL);
+	compiled = p->compiled;
+	talloc_free(p);
+	p = compile(ctx, "^evict-b$", NULL);
+	talloc_free(p);
+	p = compile(ctx, "^evict-c$", NULL);
+	TEST_CHECK(p->compiled == compiled);
+	p = compile(ctx, "^evict-a$", NULL);
+	TEST_CHECK(p->compiled != again->compiled);
+
+	talloc_free(ctx);
+	regex_cache_size_set(16);
+}
+
+/** With the cache disabled every call compiles a new expression
+ *
+ */
+static void test_cache_disabled(void)
+{
+	TALLOC_CTX	*ctx = talloc_init_const("test");
+	regex_t		*a, *b;
+
+	regex_cache_size_set(0);
+
+	a = compile(ctx, "^off$", NULL);
+	b = compile(ctx, "^off$", NULL);
+	TEST_CHECK(a->compiled != b->compiled);
+	TEST_CHECK(matches(a, "off"));
+	TEST_CHECK(matches(b, "off"));
+
+	talloc_free(ctx);
+	regex_cache_size_set(16);
+}
+
+/** Hits, misses and evictions are counted
+ *
+ */
+static void test_cache_stats(void)
+{
+	TALLOC_CTX			*ctx = talloc_init_const("test");
+	fr_regex_cache_stats_t const	*stats;
+	fr_regex_cache_stats_t		before;
+
+	regex_cache_size_set(1);
+
+	stats = regex_cache_stats();
+	TEST_ASSERT(stats != NULL);
+
+	/*
+	 *	Leave one entry in the cache, so that the
+	 *	counts below don't depend on earlier tests.
+	 */
+	talloc_free(compile(ctx, "^stats-a$", NULL));
+	before = *stats;
+	TEST_CHECK(before.entries == 1);
+
+	talloc_free(compile(ctx, "^stats-a$", NULL));
+	TEST_CHECK(stats->hits == before.hits + 1);
+	TEST_CHECK(stats->misses == before.misses);
+
+	talloc_free(compile(ctx, "^stats-b$", NULL));
+	TEST_CHECK(stats->hits == before.hits + 1);
+	TEST_CHECK(stats->misses == before.misses + 1);
+	TEST_CHECK(stats->evictions == before.evictions + 1);
+	TEST_CHECK(stats->entries == 1);
+
+	talloc_free(ctx);
+	regex_cache_size_set(16);
+}
+#endif
+
+TEST_LIST = {
+#ifdef HAVE_REGEX_PCRE2
+	{ "cache_hit",		test_cache_hit },
+	{ "cache_miss",		test_cache_miss },
+	{ "cache_eviction",	test_cache_eviction },
+	{ "cache_disabled",	test_cache_disabled },
+	{ "cache_stats",	test_cache_stats },
+#endif
+	{ NULL }
+};
@@ -0,0 +1,711 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Open addressing hash tables, with group probing
+ *
+ * This is a "swiss table", as described by the Abseil project.  Instead
+ * of chaining entries off buckets, the table is a flat array of pointers
+ * to user data, with a parallel array of one byte control words.
+ *
+ * Each control word is either EMPTY, DELETED (a tombstone), or for a slot
+ * in use, the bottom 7 bits of the hash of the data in it (H2).  The rest
+ * of the hash (H1) selects where probing starts.
+ *
+ * Lookups load a group of control words at a time (16 with SSE2, 8 with
+ * the portable SWAR implementation), and compare all of them against H2
+ * at once.  Only the slots which match are passed to the comparison
+ * function, so for a table which is working well, a lookup is one group
+ * load, and one call to the comparison function.  A lookup stops at the
+ * first group containing an EMPTY control word.
+ *
+ * The control word array has a copy of the first group appended to the
+ * end of it, so that a group can be loaded from any position without
+ * wrapping.
+ *
+ * The API mirrors #fr_hash_table_t, so the two can be used interchangeably,
+ * including via #fr_htrie_t.  The main differences are that there are no
+ * per-entry allocations, and iteration order is not stable across inserts.
+ *
+ * @file src/lib/util/swiss.c
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/swiss.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+/*
+ *	Minimum number of slots.  Must be a power of two, and greater
+ *	than SWISS_GROUP_WIDTH.
+ */
+#define SWISS_MIN_CAPACITY	(32)
+
+#define CTRL_EMPTY		(0x80)	//!< Slot has never been used.
+#define CTRL_DELETED		(0xfe)	//!< Slot used to hold data, but it was removed.
+#define CTRL_IS_FULL(_c)	(((_c) & 0x80) == 0)
+
+struct fr_swiss_table_s {
+	uint32_t		num_elements;	//!< Number of elements in the table.
+	uint32_t		capacity;	//!< Number of slots.  Always a power of 2.
+	uint32_t		mask;		//!< capacity - 1.
+	uint32_t		growth_left;	//!< How many EMPTY slots we can fill before
+						///< the table must be resized.
+
+	fr_free_t		free;		//!< Data free function.
+	fr_hash_t		hash;		//!< Hashing function.
+	fr_cmp_t		cmp;		//!< Comparison function.
+
+	char const		*type;		//!< Talloc type to check elements against.
+
+	uint8_t			*ctrl;		//!< Control words, capacity + SWISS_GROUP_WIDTH.
+	void			**slots;	//!< User data.
+};
+
+#ifdef __SSE2__
+/*
+ *	SSE2 is part of the x86_64 baseline, so this is what almost
+ *	everyone gets.  16 control words are compared per instruction.
+ */
+#  define SWISS_GROUP_WIDTH	(16)
+#  define SWISS_GROUP_SHIFT	(0)
+
+typedef __m128i swiss_group_t;
+typedef uint32_t swiss_mask_t;
+
+static inline CC_HINT(always_inline) swiss_group_t group_load(uint8_t const *ctrl)
+{
+	return _mm_loadu_si128((__m128i const *)ctrl);
+}
+
+static inline CC_HINT(always_inline) swiss_mask_t group_match(swiss_group_t g, uint8_t h2)
+{
+	return (swiss_mask_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char)h2), g));
+}
+
+static inline CC_HINT(always_inline) swiss_mask_t group_match_empty(swiss_group_t g)
+{
+	return group_match(g, CTRL_EMPTY);
+}
+
+/*
+ *	EMPTY and DELETED both have the top bit set, full slots don't.
+ */
+static inline CC_HINT(always_inline) swiss_mask_t group_match_empty_or_deleted(swiss_group_t g)
+{
+	return (swiss_mask_t)_mm_movemask_epi8(g);
+}
+
+static inline CC_HINT(always_inline) unsigned int mask_leading(swiss_mask_t m)
+{
+	return m ? (unsigned int)__builtin_clz(m) - 16 : SWISS_GROUP_WIDTH;
+}
+
+static inline CC_HINT(always_inline) unsigned int mask_trailing(swiss_mask_t m)
+{
+	return m ? (unsigned int)__builtin_ctz(m) : SWISS_GROUP_WIDTH;
+}
+
+static inline CC_HINT(always_inline) unsigned int mask_lowest(swiss_mask_t m)
+{
+	return __builtin_ctz(m);
+}
+#else
+/*
+ *	Portable implementation.  Operates on 8 control words at a time
+ *	packed into a uint64_t, with each match being indicated by the
+ *	high bit of the corresponding byte.
+ */
+#  define SWISS_GROUP_WIDTH	(8)
+#  define SWISS_GROUP_SHIFT	(3)
+
+#  define LSBS			(0x0101010101010101ULL)
+#  define MSBS			(0x8080808080808080ULL)
+
+typedef uint64_t swiss_group_t;
+typedef uint64_t swiss_mask_t;
+
+static inline CC_HINT(always_inline) swiss_group_t group_load(uint8_t const *ctrl)
+{
+	uint64_t g;
+
+	memcpy(&g, ctrl, sizeof(g));
+#  ifdef WORDS_BIGENDIAN
+	g = __builtin_bswap64(g);
+#  endif
+	return g;
+}
+
+/*
+ *	This can produce false positives for a byte directly above a
+ *	genuine match, where the control word is h2 ^ 1.  That's still
+ *	a full slot, and the comparison function filters it out.
+ */
+static inline CC_HINT(always_inline) swiss_mask_t group_match(swiss_group_t g, uint8_t h2)
+{
+	uint64_t x = g ^ (LSBS * h2);
+
+	return (x - LSBS) & ~x & MSBS;
+}
+
+/*
+ *	EMPTY is the only control word with the high bit set, and bit
+ *	1 clear, so this is exact.
+ */
+static inline CC_HINT(always_inline) swiss_mask_t group_match_empty(swiss_group_t g)
+{
+	return g & ~(g << 6) & MSBS;
+}
+
+static inline CC_HINT(always_inline) swiss_mask_t group_match_empty_or_deleted(swiss_group_t g)
+{
+	return g & MSBS;
+}
+
+static inline CC_HINT(always_inline) unsigned int mask_leading(swiss_mask_t m)
+{
+	return m ? (unsigned int)__builtin_clzll(m) >> SWISS_GROUP_SHIFT : SWISS_GROUP_WIDTH;
+}
+
+static inline CC_HINT(always_inline) unsigned int mask_trailing(swiss_mask_t m)
+{
+	return m ? (unsigned int)__builtin_ctzll(m) >> SWISS_GROUP_SHIFT : SWISS_GROUP_WIDTH;
+}
+
+static inline CC_HINT(always_inline) unsigned int mask_lowest(swiss_mask_t m)
+{
+	return (unsigned int)__builtin_ctzll(m) >> SWISS_GROUP_SHIFT;
+}
+#endif
+
+/*
+ *	The user hash functions are usually FNV, which has poor
+ *	dispersion in the low bits for short keys.  Open addressing is
+ *	much more sensitive to that than chaining, so mix the key before
+ *	splitting it into H1 and H2.
+ */
+static inline CC_HINT(always_inline) uint64_t swiss_mix(uint32_t key)
+{
+	uint64_t h = (uint64_t)key * 0x9e3779b97f4a7c15ULL;
+
+	return h ^ (h >> 32);
+}
+
+#define H1(_h)	((uint32_t)((_h) >> 7))
+#define H2(_h)	((uint8_t)((_h) & 0x7f))
+
+static inline CC_HINT(always_inline) uint32_t swiss_growth(uint32_t capacity)
+{
+	return capacity - (capacity >> 3);	/* Max load factor of 7/8 */
+}
+
+/*
+ *	Set a control word, and its copy at the end of the array
+ *	if it's in the first group.
+ */
+static inline CC_HINT(always_inline) void swiss_ctrl_set(fr_swiss_table_t *st, uint32_t i, uint8_t c)
+{
+	st->ctrl[i] = c;
+	if (i < SWISS_GROUP_WIDTH) st->ctrl[st->capacity + i] = c;
+}
+
+/*
+ *	Return the slot containing data, or -1 if there isn't one.
+ *
+ *	Groups are visited using triangular probing, which is guaranteed
+ *	to visit every group when the capacity is a power of 2.
+ */
+CC_NO_UBSAN(function) /* UBSAN: false positive - htrie call with first argument of void * trips --fsanitize=function */
+static inline CC_HINT(always_inline) int64_t swiss_find(fr_swiss_table_t *st, uint64_t h, void const *data)
+{
+	uint32_t	pos = H1(h) & st->mask;
+	uint32_t	step = 0;
+	uint8_t		h2 = H2(h);
+
+	for (;;) {
+		swiss_group_t	g = group_load(st->ctrl + pos);
+		swiss_mask_t	m;
+
+		for (m = group_match(g, h2); m; m &= m - 1) {
+			uint32_t i = (pos + mask_lowest(m)) & st->mask;
+
+			if (st->cmp(data, st->slots[i]) == 0) return i;
+		}
+
+		if (likely(group_match_empty(g) != 0)) return -1;
+
+		step += SWISS_GROUP_WIDTH;
+		if (unlikely(step > st->capacity)) return -1;	/* Only possible if the table is corrupt */
+		pos = (pos + step) & st->mask;
+	}
+}
+
+/*
+ *	Return the first EMPTY or DELETED slot in the probe sequence for h.
+ *
+ *	There's always at least one, as the load factor never exceeds 7/8.
+ */
+static inline CC_HINT(always_inline) uint32_t swiss_find_free(fr_swiss_table_t *st, uint64_t h)
+{
+	uint32_t	pos = H1(h) & st->mask;
+	uint32_t	step = 0;
+
+	for (;;) {
+		swiss_mask_t m = group_match_empty_or_deleted(group_load(st->ctrl + pos));
+
+		if (likely(m != 0)) return (pos + mask_lowest(m)) & st->mask;
+
+		step += SWISS_GROUP_WIDTH;
+		fr_assert(step <= st->capacity);
+		pos = (pos + step) & st->mask;
+	}
+}
+
+/*
+ *	Move all the data into a new set of arrays.  This also discards
+ *	any tombstones.
+ */
+CC_NO_UBSAN(function) /* UBSAN: false positive - htrie call with first argument of void * trips --fsanitize=function */
+static int swiss_resize(fr_swiss_table_t *st, uint32_t capacity)
+{
+	uint8_t		*old_ctrl = st->ctrl;
+	void		**old_slots = st->slots;
+	uint32_t	old_capacity = st->capacity;
+	uint8_t		*ctrl;
+	void		**slots;
+	uint32_t	i;
+
+	fr_assert(swiss_growth(capacity) >= st->num_elements);
+
+	ctrl = talloc_array(st, uint8_t, capacity + SWISS_GROUP_WIDTH);
+	if (unlikely(!ctrl)) {
+	oom:
+		fr_strerror_const("Out of memory");
+		return -1;
+	}
+
+	slots = talloc_array(st, void *, capacity);
+	if (unlikely(!slots)) {
+		talloc_free(ctrl);
+		goto oom;
+	}
+	memset(ctrl, CTRL_EMPTY, capacity + SWISS_GROUP_WIDTH);
+
+	st->ctrl = ctrl;
+	st->slots = slots;
+	st->capacity = capacity;
+	st->mask = capacity - 1;
+	st->growth_left = swiss_growth(capacity) - st->num_elements;
+
+	for (i = 0; i < old_capacity; i++) {
+		uint32_t	j;
+		uint64_t	h;
+
+		if (!CTRL_IS_FULL(old_ctrl[i])) continue;
+
+		h = swiss_mix(st->hash(old_slots[i]));
+		j = swiss_find_free(st, h);
+		swiss_ctrl_set(st, j, H2(h));
+		st->slots[j] = old_slots[i];
+	}
+
+	talloc_free(old_ctrl);
+	talloc_free(old_slots);
+
+	return 0;
+}
+
+/*
+ *	Find a slot to insert data with hash h, resizing the table if
+ *	there aren't any EMPTY slots left.
+ */
+static inline int swiss_slot_alloc(fr_swiss_table_t *st, uint64_t h, uint32_t *out)
+{
+	uint32_t i;
+
+	i = swiss_find_free(st, h);
+	if (unlikely((st->growth_left == 0) && (st->ctrl[i] == CTRL_EMPTY))) {
+		uint32_t capacity = st->capacity;
+
+		/*
+		 *	If a significant proportion of the slots are
+		 *	tombstones, clean them out instead of growing.
+		 */
+		if (((uint64_t)st->num_elements * 32) > ((uint64_t)capacity * 25)) {
+			if (unlikely(capacity >= (UINT32_MAX >> 1) + 1)) {
+				fr_strerror_const("Table is at its maximum size");
+				return -1;
+			}
+			capacity <<= 1;
+		}
+
+		if (unlikely(swiss_resize(st, capacity) < 0)) return -1;
+
+		i = swiss_find_free(st, h);
+	}
+
+	st->growth_left -= (st->ctrl[i] == CTRL_EMPTY);
+	swiss_ctrl_set(st, i, H2(h));
+	st->num_elements++;
+
+	*out = i;
+
+	return 0;
+}
+
+/*
+ *	Mark a slot as no longer in use.
+ *
+ *	If every window of SWISS_GROUP_WIDTH slots which covers this slot
+ *	also contains an EMPTY slot, no probe sequence can have continued
+ *	past this slot, and it can be marked EMPTY.  Otherwise it must be
+ *	marked DELETED, so that lookups keep going.
+ */
+static inline void swiss_slot_free(fr_swiss_table_t *st, uint32_t i)
+{
+	swiss_mask_t	empty_before = group_match_empty(group_load(st->ctrl + ((i - SWISS_GROUP_WIDTH) & st->mask)));
+	swiss_mask_t	empty_after = group_match_empty(group_load(st->ctrl + i));
+	bool		never_full;
+
+	never_full = empty_before && empty_after &&
+		     ((mask_trailing(empty_after) + mask_leading(empty_before)) < SWISS_GROUP_WIDTH);
+
+	swiss_ctrl_set(st, i, never_full ? CTRL_EMPTY : CTRL_DELETED);
+	st->growth_left += never_full;
+	st->slots[i] = NULL;
+	st->num_elements--;
+}
+
+static int _fr_swiss_table_free(fr_swiss_table_t *st)
+{
+	uint32_t i;
+
+	if (!st->free) return 0;
+
+	for (i = 0; i < st->capacity; i++) {
+		if (CTRL_IS_FULL(st->ctrl[i])) st->free(st->slots[i]);
+	}
+
+	return 0;
+}
+
+/** Allocate a new swiss table
+ *
+ * @param[in] ctx	to allocate the table in.
+ * @param[in] type	Talloc type of the elements, or NULL to skip type checks.
+ * @param[in] hash_func	used to hash the data.
+ * @param[in] cmp_func	used to compare data with the same hash.
+ * @param[in] free_func	called on data when it's deleted, replaced,
+ *			or when the table is freed.  May be NULL.
+ * @return
+ *	- A new swiss table on success.
+ *	- NULL on failure.
+ */
+fr_swiss_table_t *_fr_swiss_table_alloc(TALLOC_CTX *ctx,
+					char const *type,
+					fr_hash_t hash_func,
+					fr_cmp_t cmp_func,
+					fr_free_t free_func)
+{
+	fr_swiss_table_t *st;
+
+	st = talloc(ctx, fr_swiss_table_t);
+	if (unlikely(!st)) {
+		fr_strerror_const("Out of memory");
+		return NULL;
+	}
+
+	*st = (fr_swiss_table_t){
+		.type = type,
+		.free = free_func,
+		.hash = hash_func,
+		.cmp = cmp_func
+	};
+
+	if (unlikely(swiss_resize(st, SWISS_MIN_CAPACITY) < 0)) {
+		talloc_free(st);
+		return NULL;
+	}
+	talloc_set_destructor(st, _fr_swiss_table_free);
+
+	return st;
+}
+
+/** Find data in a swiss table
+ *
+ * @param[in] st	to find data in.
+ * @param[in] data	to find.  Will be passed to the
+ *			hashing function.
+ * @return
+ *	- The user data we found.
+ *	- NULL if we couldn't find any matching data.
+ */
+CC_NO_UBSAN(function) /* UBSAN: false positive - htrie call with first argument of void * trips --fsanitize=function */
+void *fr_swiss_table_find(fr_swiss_table_t *st, void const *data)
+{
+	int64_t i;
+
+	i = swiss_find(st, swiss_mix(st->hash(data)), data);
+	if (i < 0) return NULL;
+
+	return st->slots[i];
+}
+
+/** Find data in a swiss table with a pre-computed key
+ *
+ * @param[in] st	to find data in.
+ * @param[in] key	the precomputed key.
+ * @param[in] data	for matching.
+ * @return
+ *	- The user data we found.
+ *	- NULL if we couldn't find any matching data.
+ */
+void *fr_swiss_table_find_by_key(fr_swiss_table_t *st, uint32_t key, void const *data)
+{
+	int64_t i;
+
+	i = swiss_find(st, swiss_mix(key), data);
+	if (i < 0) return NULL;
+
+	return st->slots[i];
+}
+
+/** Insert data into a swiss table
+ *
+ * @param[in] st	to insert data into.
+ * @param[in] data	to insert.  Will be passed to the
+ *			hashing function.
+ * @return
+ *	- true if data was inserted.
+ *	- false if data already existed and was not inserted,
+ *	  or we failed to grow the table.
+ */
+CC_NO_UBSAN(function) /* UBSAN: false positive - htrie call with first argument of void * trips --fsanitize=function */
+bool fr_swiss_table_insert(fr_swiss_table_t *st, void const *data)
+{
+	uint64_t	h;
+	uint32_t	i;
+
+#ifndef TALLOC_GET_TYPE_ABORT_NOOP
+	if (st->type) (void)_talloc_get_type_abort(data, st->type, __location__);
+#endif
+
+	h = swiss_mix(st->hash(data));
+	if (swiss_find(st, h, data) >= 0) return false;
+
+	if (unlikely(swiss_slot_alloc(st, h, &i) < 0)) return false;
+	st->slots[i] = UNCONST(void *, data);
+
+	return true;
+}
+
+/** Replace old data with new data, OR insert if there is no old
+ *
+ * @param[out] old	data that was replaced.  If this argument
+ *			is not NULL, then the old data will not
+ *			be freed, even if a free function is
+ *			configured.
+ * @param[in] st	to insert data into.
+ * @param[in] data	to replace.  Will be passed to the
+ *			hashing function.
+ * @return
+ *	- 1 if data was replaced.
+ *	- 0 if data was inserted.
+ *	- -1 if we failed to replace data.
+ */
+CC_NO_UBSAN(function) /* UBSAN: false positive - htrie call with first argument of void * trips --fsanitize=function */
+int fr_swiss_table_replace(void **old, fr_swiss_table_t *st, void const *data)
+{
+	uint64_t	h;
+	int64_t		found;
+	uint32_t	i;
+
+#ifndef TALLOC_GET_TYPE_ABORT_NOOP
+	if (st->type) (void)_talloc_get_type_abort(data, st->type, __location__);
+#endif
+
+	h = swiss_mix(st->hash(data));
+	found = swiss_find(st, h, data);
+	if (found < 0) {
+		if (old) *old = NULL;
+		if (unlikely(swiss_slot_alloc(st, h, &i) < 0)) return -1;
+		st->slots[i] = UNCONST(void *, data);
+		return 0;
+	}
+
+	if (old) {
+		*old = st->slots[found];
+	} else if (st->free) {
+		st->free(st->slots[found]);
+	}
+	st->slots[found] = UNCONST(void *, data);
+
+	return 1;
+}
+
+/** Remove an entry from the swiss table, without freeing the data
+ *
+ * @param[in] st	to remove data from.
+ * @param[in] data	to remove.  Will be passed to the
+ *			hashing function.
+ * @return
+ *	- The user data we removed.
+ *	- NULL if we couldn't find any matching data.
+ */
+CC_NO_UBSAN(function) /* UBSAN: false positive - htrie call with first argument of void * trips --fsanitize=function */
+void *fr_swiss_table_remove(fr_swiss_table_t *st, void const *data)
+{
+	int64_t	i;
+	void	*old;
+
+	i = swiss_find(st, swiss_mix(st->hash(data)), data);
+	if (i < 0) return NULL;
+
+	old = st->slots[i];
+	swiss_slot_free(st, i);
+
+	return old;
+}
+
+/** Remove and free data (if a free function was specified)
+ *
+ * @param[in] st	to remove data from.
+ * @param[in] data	to remove/free.
+ * @return
+ *	- true if we removed data.
+ *	- false if we couldn't find any matching data.
+ */
+CC_NO_UBSAN(function) /* UBSAN: false positive - htrie call with first argument of void * trips --fsanitize=function */
+bool fr_swiss_table_delete(fr_swiss_table_t *st, void const *data)
+{
+	void *old;
+
+	old = fr_swiss_table_remove(st, data);
+	if (!old) return false;
+
+	if (st->free) st->free(old);
+
+	return true;
+}
+
+/*
+ *	Count number of elements
+ */
+CC_NO_UBSAN(function) /* UBSAN: false positive - htrie call with first argument of void * trips --fsanitize=function */
+uint32_t fr_swiss_table_num_elements(fr_swiss_table_t *st)
+{
+	return st->num_elements;
+}
+
+/** Ensure the table can hold at least num elements without being resized
+ *
+ * @param[in] st	to resize.
+ * @param[in] num	total number of elements the table should be able to hold.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_swiss_table_reserve(fr_swiss_table_t *st, uint32_t num)
+{
+	uint64_t capacity = st->capacity;
+
+	while (swiss_growth(capacity) < num) capacity <<= 1;
+
+	if (capacity == st->capacity) return 0;
+	if (unlikely(capacity > ((uint64_t)UINT32_MAX >> 1) + 1)) {
+		fr_strerror_const("Table is at its maximum size");
+		return -1;
+	}
+
+	return swiss_resize(st, (uint32_t)capacity);
+}
+
+/** Iterate over entries in a swiss table
+ *
+ * @note If the table is modified the iterator should be considered invalidated.
+ *
+ * @param[in] st	to iterate over.
+ * @param[in] iter	Pointer to an iterator struct, used to maintain
+ *			state between calls.
+ * @return
+ *	- User data.
+ *	- NULL if at the end of the table.
+ */
+void *fr_swiss_table_iter_next(fr_swiss_table_t *st, fr_swiss_iter_t *iter)
+{
+	while (iter->slot < st->capacity) {
+		uint32_t i = iter->slot++;
+
+		if (CTRL_IS_FULL(st->ctrl[i])) return st->slots[i];
+	}
+
+	return NULL;
+}
+
+/** Initialise an iterator
+ *
+ * @note If the table is modified the iterator should be considered invalidated.
+ *
+ * @param[in] st	to iterate over.
+ * @param[out] iter	to initialise.
+ * @return
+ *	- The first entry in the table.
+ *	- NULL if the table is empty.
+ */
+void *fr_swiss_table_iter_init(fr_swiss_table_t *st, fr_swiss_iter_t *iter)
+{
+	iter->slot = 0;
+
+	return fr_swiss_table_iter_next(st, iter);
+}
+
+/** Check swiss table is sane
+ *
+ */
+void fr_swiss_table_verify(fr_swiss_table_t *st)
+{
+	uint32_t	i, full = 0, empty = 0;
+
+	(void)talloc_get_type_abort(st, fr_swiss_table_t);
+
+	fr_assert(talloc_array_length(st->ctrl) == st->capacity + SWISS_GROUP_WIDTH);
+	fr_assert(talloc_array_length(st->slots) == st->capacity);
+
+	for (i = 0; i < SWISS_GROUP_WIDTH; i++) fr_assert(st->ctrl[st->capacity + i] == st->ctrl[i]);
+
+	for (i = 0; i < st->capacity; i++) {
+		if (st->ctrl[i] == CTRL_EMPTY) {
+			empty++;
+			continue;
+		}
+		if (!CTRL_IS_FULL(st->ctrl[i])) continue;
+
+		full++;
+		fr_assert(H2(swiss_mix(st->hash(st->slots[i]))) == st->ctrl[i]);
+		fr_assert(swiss_find(st, swiss_mix(st->hash(st->slots[i])), st->slots[i]) == i);
+
+#ifndef TALLOC_GET_TYPE_ABORT_NOOP
+		if (st->type) (void)_talloc_get_type_abort(st->slots[i], st->type, __location__);
+#endif
+	}
+
+	fr_assert(full == st->num_elements);
+	fr_assert(empty >= st->growth_left);
+}
@@ -0,0 +1,77 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Structures and prototypes for open addressing "swiss" hash tables
+ *
+ * @file src/lib/util/swiss.h
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+RCSIDH(swiss_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/util/hash.h>
+
+typedef struct fr_swiss_table_s fr_swiss_table_t;
+
+/** Stores the state of the current iteration operation
+ *
+ */
+typedef struct {
+	uint32_t		slot;		//!< Next slot to examine.
+} fr_swiss_iter_t;
+
+#define		fr_swiss_table_alloc(_ctx, _hash_node, _cmp_node, _free_node) \
+		_fr_swiss_table_alloc(_ctx, NULL, _hash_node, _cmp_node, _free_node)
+
+#define		fr_swiss_table_talloc_alloc(_ctx, _type, _hash_node, _cmp_node, _free_node) \
+		_fr_swiss_table_alloc(_ctx, #_type, _hash_node, _cmp_node, _free_node)
+
+fr_swiss_table_t *_fr_swiss_table_alloc(TALLOC_CTX *ctx,
+					char const *type,
+					fr_hash_t hash_node,
+					fr_cmp_t cmp_node,
+					fr_free_t free_node) CC_HINT(nonnull(3,4));
+
+void		*fr_swiss_table_find(fr_swiss_table_t *st, void const *data) CC_HINT(nonnull);
+
+void		*fr_swiss_table_find_by_key(fr_swiss_table_t *st, uint32_t key, void const *data) CC_HINT(nonnull);
+
+bool		fr_swiss_table_insert(fr_swiss_table_t *st, void const *data) CC_HINT(nonnull);
+
+int		fr_swiss_table_replace(void **old, fr_swiss_table_t *st, void const *data) CC_HINT(nonnull(2,3));
+
+void		*fr_swiss_table_remove(fr_swiss_table_t *st, void const *data) CC_HINT(nonnull);
+
+bool		fr_swiss_table_delete(fr_swiss_table_t *st, void const *data) CC_HINT(nonnull);
+
+uint32_t	fr_swiss_table_num_elements(fr_swiss_table_t *st) CC_HINT(nonnull);
+
+int		fr_swiss_table_reserve(fr_swiss_table_t *st, uint32_t num) CC_HINT(nonnull);
+
+void		*fr_swiss_table_iter_next(fr_swiss_table_t *st, fr_swiss_iter_t *iter) CC_HINT(nonnull);
+
+void		*fr_swiss_table_iter_init(fr_swiss_table_t *st, fr_swiss_iter_t *iter) CC_HINT(nonnull);
+
+void		fr_swiss_table_verify(fr_swiss_table_t *st);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,468 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for swiss tables
+ *
+ * @file src/lib/util/swiss_tests.c
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/htrie.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/swiss.h>
+#include <freeradius-devel/util/time.h>
+#include <freeradius-devel/util/value.h>
+
+typedef struct {
+	uint32_t	num;
+	char		name[24];
+	size_t		name_len;
+	bool		freed;
+} swiss_thing;
+
+static uint32_t thing_hash(void const *data)
+{
+	swiss_thing const *t = data;
+
+	return fr_hash(t->name, t->name_len);
+}
+
+static uint32_t thing_hash64(void const *data)
+{
+	swiss_thing const *t = data;
+
+	return (uint32_t)fr_hash64(t->name, t->name_len);
+}
+
+static int8_t thing_cmp(void const *one, void const *two)
+{
+	swiss_thing const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->name_len, b->name_len);
+	if (ret != 0) return ret;
+
+	ret = memcmp(a->name, b->name, a->name_len);
+	return CMP(ret, 0);
+}
+
+static void thing_free(void *data)
+{
+	swiss_thing *t = data;
+
+	t->freed = true;
+}
+
+static void populate_values(swiss_thing *values, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		values[i].num = i;
+		values[i].name_len = snprintf(values[i].name, sizeof(values[i].name), "user-%u", i);
+		values[i].freed = false;
+	}
+}
+
+static void swiss_test_basic(void)
+{
+	fr_swiss_table_t	*st;
+	swiss_thing		values[3], dup, *old;
+
+	populate_values(values, NUM_ELEMENTS(values));
+
+	st = fr_swiss_table_alloc(NULL, thing_hash, thing_cmp, thing_free);
+	TEST_CHECK(st != NULL);
+
+	TEST_CASE("insert");
+	TEST_CHECK(fr_swiss_table_insert(st, &values[0]));
+	TEST_CHECK(fr_swiss_table_insert(st, &values[1]));
+	TEST_CHECK(fr_swiss_table_num_elements(st) == 2);
+
+	TEST_CASE("duplicate insert fails");
+	dup = values[0];
+	TEST_CHECK(!fr_swiss_table_insert(st, &dup));
+	TEST_CHECK(fr_swiss_table_num_elements(st) == 2);
+
+	TEST_CASE("find");
+	TEST_CHECK(fr_swiss_table_find(st, &dup) == &values[0]);
+	TEST_CHECK(fr_swiss_table_find(st, &values[2]) == NULL);
+	TEST_CHECK(fr_swiss_table_find_by_key(st, thing_hash(&values[1]), &values[1]) == &values[1]);
+
+	TEST_CASE("replace existing");
+	TEST_CHECK(fr_swiss_table_replace((void **)&old, st, &dup) == 1);
+	TEST_CHECK(old == &values[0]);
+	TEST_CHECK(!values[0].freed);
+	TEST_CHECK(fr_swiss_table_find(st, &values[0]) == &dup);
+
+	TEST_CASE("replace inserts");
+	TEST_CHECK(fr_swiss_table_replace(NULL, st, &values[2]) == 0);
+	TEST_CHECK(fr_swiss_table_num_elements(st) == 3);
+
+	TEST_CASE("remove");
+	TEST_CHECK(fr_swiss_table_remove(st, &values[1]) == &values[1]);
+	TEST_CHECK(!values[1].freed);
+	TEST_CHECK(fr_swiss_table_remove(st, &values[1]) == NULL);
+	TEST_CHECK(fr_swiss_table_num_elements(st) == 2);
+
+	TEST_CASE("delete");
+	TEST_CHECK(fr_swiss_table_delete(st, &values[2]));
+	TEST_CHECK(values[2].freed);
+	TEST_CHECK(!fr_swiss_table_delete(st, &values[2]));
+	TEST_CHECK(fr_swiss_table_num_elements(st) == 1);
+
+	fr_swiss_table_verify(st);
+
+	TEST_CASE("free calls free_func on remaining data");
+	talloc_free(st);
+	TEST_CHECK(dup.freed);
+}
+
+/** Insert and remove random entries, checking against an array of what should be present
+ *
+ * This exercises growth, tombstones, and rehashing in place.
+ */
+static void swiss_test_churn(void)
+{
+	fr_swiss_table_t	*st;
+	swiss_thing		*values;
+	bool			*present;
+	unsigned int		i, count = 4096, expected = 0;
+	fr_fast_rand_t		rand_ctx;
+
+	rand_ctx.a = fr_rand();
+	rand_ctx.b = fr_rand();
+
+	values = talloc_array(NULL, swiss_thing, count);
+	present = talloc_zero_array(values, bool, count);
+	populate_values(values, count);
+
+	st = fr_swiss_table_alloc(values, thing_hash, thing_cmp, NULL);
+	TEST_CHECK(st != NULL);
+
+	for (i = 0; i < (count * 64); i++) {
+		unsigned int j = fr_fast_rand(&rand_ctx) % count;
+
+		if (present[j]) {
+			TEST_CHECK(fr_swiss_table_remove(st, &values[j]) == &values[j]);
+			TEST_MSG("failed removing %u", j);
+			present[j] = false;
+			expected--;
+		} else {
+			TEST_CHECK(fr_swiss_table_insert(st, &values[j]));
+			TEST_MSG("failed inserting %u", j);
+			present[j] = true;
+			expected++;
+		}
+
+		if ((i % 8192) == 0) fr_swiss_table_verify(st);
+	}
+
+	TEST_CHECK(fr_swiss_table_num_elements(st) == expected);
+	fr_swiss_table_verify(st);
+
+	for (i = 0; i < count; i++) {
+		TEST_CHECK((fr_swiss_table_find(st, &values[i]) != NULL) == present[i]);
+		TEST_MSG("presence of %u incorrect", i);
+	}
+
+	talloc_free(values);
+}
+
+static void swiss_test_iter(void)
+{
+	fr_swiss_table_t	*st;
+	swiss_thing		*values, *p;
+	fr_swiss_iter_t		iter;
+	unsigned int		i, count = 1000, seen = 0;
+	uint64_t		sum = 0;
+
+	values = talloc_array(NULL, swiss_thing, count);
+	populate_values(values, count);
+
+	st = fr_swiss_table_alloc(values, thing_hash, thing_cmp, NULL);
+	for (i = 0; i < count; i++) fr_swiss_table_insert(st, &values[i]);
+
+	for (p = fr_swiss_table_iter_init(st, &iter);
+	     p;
+	     p = fr_swiss_table_iter_next(st, &iter)) {
+		seen++;
+		sum += p->num;
+	}
+
+	TEST_CHECK(seen == count);
+	TEST_CHECK(sum == ((uint64_t)count * (count - 1)) / 2);
+
+	talloc_free(values);
+}
+
+static void swiss_test_reserve(void)
+{
+	fr_swiss_table_t	*st;
+	swiss_thing		*values;
+	unsigned int		i, count = 10000;
+
+	values = talloc_array(NULL, swiss_thing, count);
+	populate_values(values, count);
+
+	st = fr_swiss_table_alloc(values, thing_hash64, thing_cmp, NULL);
+	TEST_CHECK(fr_swiss_table_reserve(st, count) == 0);
+	for (i = 0; i < count; i++) TEST_CHECK(fr_swiss_table_insert(st, &values[i]));
+	for (i = 0; i < count; i++) TEST_CHECK(fr_swiss_table_find(st, &values[i]) == &values[i]);
+	fr_swiss_table_verify(st);
+
+	talloc_free(values);
+}
+
+static void swiss_test_htrie(void)
+{
+	fr_htrie_t		*ht;
+	swiss_thing		values[2], *old;
+
+	populate_values(values, NUM_ELEMENTS(values));
+
+	ht = fr_htrie_alloc(NULL, FR_HTRIE_SWISS, thing_hash, thing_cmp, NULL, NULL);
+	TEST_CHECK(ht != NULL);
+	TEST_CHECK(fr_table_value_by_str(fr_htrie_type_table, "swiss", FR_HTRIE_INVALID) == FR_HTRIE_SWISS);
+
+	TEST_CHECK(fr_htrie_insert(ht, &values[0]));
+	TEST_CHECK(fr_htrie_find(ht, &values[0]) == &values[0]);
+	TEST_CHECK(fr_htrie_match(ht, &values[0]) == &values[0]);
+	TEST_CHECK(fr_htrie_replace((void **)&old, ht, &values[1]) == 0);
+	TEST_CHECK(fr_htrie_num_elements(ht) == 2);
+	TEST_CHECK(fr_htrie_remove(ht, &values[0]) == &values[0]);
+	TEST_CHECK(fr_htrie_delete(ht, &values[1]));
+	TEST_CHECK(fr_htrie_num_elements(ht) == 0);
+
+	talloc_free(ht);
+}
+
+static void swiss_test_hash64(void)
+{
+	uint8_t		buff[128];
+	uint64_t	hashes[NUM_ELEMENTS(buff) + 1];
+	size_t		i, j;
+
+	for (i = 0; i < sizeof(buff); i++) buff[i] = i;
+
+	/*
+	 *	Every length takes a slightly different path,
+	 *	so make sure they're all distinct, and stable.
+	 */
+	for (i = 0; i <= sizeof(buff); i++) {
+		hashes[i] = fr_hash64(buff, i);
+		TEST_CHECK(hashes[i] == fr_hash64(buff, i));
+
+		for (j = 0; j < i; j++) {
+			TEST_CHECK(hashes[i] != hashes[j]);
+			TEST_MSG("lengths %zu and %zu collide", i, j);
+		}
+	}
+
+	/*
+	 *	Flipping any one bit should change the hash
+	 */
+	for (i = 0; i < 64 * 8; i++) {
+		uint8_t copy[64];
+
+		memcpy(copy, buff, sizeof(copy));
+		copy[i / 8] ^= (1 << (i % 8));
+		TEST_CHECK(fr_hash64(copy, sizeof(copy)) != hashes[sizeof(copy)]);
+		TEST_MSG("flipping bit %zu didn't change the hash", i);
+	}
+}
+
+/** Compare fr_hash_table_t and fr_swiss_table_t
+ *
+ */
+static void hash_cmp(unsigned int count)
+{
+	swiss_thing	*values;
+	unsigned int	i;
+
+	values = talloc_array(NULL, swiss_thing, count);
+	populate_values(values, count);
+
+	{
+		fr_hash_table_t	*ht;
+		fr_time_t	start_insert, end_insert, start_find, end_find, start_miss, end_miss, start_remove, end_remove;
+
+		ht = fr_hash_table_alloc(NULL, thing_hash, thing_cmp, NULL);
+		TEST_CHECK(ht != NULL);
+
+		start_insert = fr_time();
+		for (i = 0; i < count; i++) fr_hash_table_insert(ht, &values[i]);
+		end_insert = fr_time();
+
+		start_find = fr_time();
+		for (i = 0; i < count; i++) TEST_CHECK(fr_hash_table_find(ht, &values[i]) != NULL);
+		end_find = fr_time();
+
+		for (i = 0; i < count; i++) values[i].name[0] = 'U';	/* Make every lookup a miss */
+		start_miss = fr_time();
+		for (i = 0; i < count; i++) TEST_CHECK(fr_hash_table_find(ht, &values[i]) == NULL);
+		end_miss = fr_time();
+		for (i = 0; i < count; i++) values[i].name[0] = 'u';
+
+		start_remove = fr_time();
+		for (i = 0; i < count; i++) TEST_CHECK(fr_hash_table_remove(ht, &values[i]) != NULL);
+		end_remove = fr_time();
+
+		TEST_MSG_ALWAYS("\nhash table (fnv) size: %u\n", count);
+		TEST_MSG_ALWAYS("insert: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_insert, start_insert)) / 1000);
+		TEST_MSG_ALWAYS("find: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_find, start_find)) / 1000);
+		TEST_MSG_ALWAYS("miss: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_miss, start_miss)) / 1000);
+		TEST_MSG_ALWAYS("remove: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_remove, start_remove)) / 1000);
+
+		talloc_free(ht);
+	}
+
+#define SWISS_CMP(_hash, _name) \
+	{ \
+		fr_swiss_table_t	*st; \
+		fr_time_t		start_insert, end_insert, start_find, end_find, start_miss, end_miss, start_remove, end_remove; \
+		st = fr_swiss_table_alloc(NULL, _hash, thing_cmp, NULL); \
+		TEST_CHECK(st != NULL); \
+		start_insert = fr_time(); \
+		for (i = 0; i < count; i++) fr_swiss_table_insert(st, &values[i]); \
+		end_insert = fr_time(); \
+		start_find = fr_time(); \
+		for (i = 0; i < count; i++) TEST_CHECK(fr_swiss_table_find(st, &values[i]) != NULL); \
+		end_find = fr_time(); \
+		for (i = 0; i < count; i++) values[i].name[0] = 'U'; \
+		start_miss = fr_time(); \
+		for (i = 0; i < count; i++) TEST_CHECK(fr_swiss_table_find(st, &values[i]) == NULL); \
+		end_miss = fr_time(); \
+		for (i = 0; i < count; i++) values[i].name[0] = 'u'; \
+		start_remove = fr_time(); \
+		for (i = 0; i < count; i++) TEST_CHECK(fr_swiss_table_remove(st, &values[i]) != NULL); \
+		end_remove = fr_time(); \
+		TEST_MSG_ALWAYS("\nswiss table (" _name ") size: %u\n", count); \
+		TEST_MSG_ALWAYS("insert: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_insert, start_insert)) / 1000); \
+		TEST_MSG_ALWAYS("find: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_find, start_find)) / 1000); \
+		TEST_MSG_ALWAYS("miss: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_miss, start_miss)) / 1000); \
+		TEST_MSG_ALWAYS("remove: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_remove, start_remove)) / 1000); \
+		talloc_free(st); \
+	}
+
+	SWISS_CMP(thing_hash, "fnv")
+	SWISS_CMP(thing_hash64, "hash64")
+
+	talloc_free(values);
+}
+
+static void hash_cmp_1000(void)
+{
+	hash_cmp(1000);
+}
+
+static void hash_cmp_100000(void)
+{
+	hash_cmp(100000);
+}
+
+static void hash_cmp_1000000(void)
+{
+	hash_cmp(1000000);
+}
+
+static uint32_t box_hash_fnv(void const *data)
+{
+	fr_value_box_t const *vb = data;
+
+	return fr_hash(vb->vb_strvalue, vb->vb_length);
+}
+
+static int8_t box_cmp(void const *a, void const *b)
+{
+	return fr_value_box_cmp(a, b);
+}
+
+/** Compare string keyed htries, as used by rlm_files, rlm_csv, rlm_cache and switch
+ *
+ * The "hash" htrie uses FNV, as fr_value_box_hash() did previously.  The
+ * other uses whatever fr_htrie_hint() and fr_value_box_hash() now pick.
+ */
+static void htrie_cmp(unsigned int count)
+{
+	fr_value_box_t	*keys;
+	char		**names;
+	unsigned int	i;
+
+	keys = talloc_array(NULL, fr_value_box_t, count);
+	names = talloc_array(keys, char *, count);
+	for (i = 0; i < count; i++) {
+		names[i] = talloc_asprintf(names, "bob-%u@example.org", i);
+		fr_value_box_init(&keys[i], FR_TYPE_STRING, NULL, false);
+		fr_value_box_strdup_shallow(&keys[i], NULL, names[i], false);
+	}
+
+#define HTRIE_CMP(_type, _hash, _name) \
+	{ \
+		fr_htrie_t	*ht; \
+		fr_time_t	start_insert, end_insert, start_find, end_find, start_miss, end_miss; \
+		ht = fr_htrie_alloc(NULL, _type, _hash, box_cmp, NULL, NULL); \
+		TEST_CHECK(ht != NULL); \
+		start_insert = fr_time(); \
+		for (i = 0; i < count; i++) fr_htrie_insert(ht, &keys[i]); \
+		end_insert = fr_time(); \
+		start_find = fr_time(); \
+		for (i = 0; i < count; i++) TEST_CHECK(fr_htrie_find(ht, &keys[i]) != NULL); \
+		end_find = fr_time(); \
+		for (i = 0; i < count; i++) names[i][0] = 'B'; \
+		start_miss = fr_time(); \
+		for (i = 0; i < count; i++) TEST_CHECK(fr_htrie_find(ht, &keys[i]) == NULL); \
+		end_miss = fr_time(); \
+		for (i = 0; i < count; i++) names[i][0] = 'b'; \
+		TEST_MSG_ALWAYS("\nhtrie (" _name ") size: %u\n", count); \
+		TEST_MSG_ALWAYS("insert: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_insert, start_insert)) / 1000); \
+		TEST_MSG_ALWAYS("find: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_find, start_find)) / 1000); \
+		TEST_MSG_ALWAYS("miss: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_miss, start_miss)) / 1000); \
+		talloc_free(ht); \
+	}
+
+	HTRIE_CMP(FR_HTRIE_HASH, box_hash_fnv, "hash, fnv")
+	HTRIE_CMP(fr_htrie_hint(FR_TYPE_STRING), (fr_hash_t)fr_value_box_hash, "hint, fr_value_box_hash")
+
+	talloc_free(keys);
+}
+
+static void htrie_cmp_1000(void)
+{
+	htrie_cmp(1000);
+}
+
+static void htrie_cmp_100000(void)
+{
+	htrie_cmp(100000);
+}
+
+TEST_LIST = {
+	{ "swiss_test_basic",	swiss_test_basic },
+	{ "swiss_test_churn",	swiss_test_churn },
+	{ "swiss_test_iter",	swiss_test_iter },
+	{ "swiss_test_reserve",	swiss_test_reserve },
+	{ "swiss_test_htrie",	swiss_test_htrie },
+	{ "swiss_test_hash64",	swiss_test_hash64 },
+	{ "hash_cmp_1000",	hash_cmp_1000 },
+	{ "hash_cmp_100000",	hash_cmp_100000 },
+	{ "hash_cmp_1000000",	hash_cmp_1000000 },
+	{ "htrie_cmp_1000",	htrie_cmp_1000 },
+	{ "htrie_cmp_100000",	htrie_cmp_100000 },
+	{ NULL }
+};
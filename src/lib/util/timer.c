@@ -32,6 +32,7 @@ typedef struct fr_timer_list_s fr_timer_list_t;
 #include <freeradius-devel/util/timer.h>
 #include <freeradius-devel/util/value.h>
 #include <freeradius-devel/util/lst.h>
+#include <freeradius-devel/util/math.h>
 #include <freeradius-devel/util/rb.h>
 #include <stdbool.h>
 #include <talloc.h>
@@ -44,9 +45,41 @@ FR_DLIST_TYPEDEFS(timer, fr_timer_head_t, fr_timer_entry_t)
  */
 typedef enum {
 	TIMER_LIST_TYPE_LST = 1,			//!< Self-sorting timer list based on a left leaning skeleton tree.
-	TIMER_LIST_TYPE_ORDERED = 2			//!< Strictly ordered list of events in a dlist.
+	TIMER_LIST_TYPE_ORDERED = 2,			//!< Strictly ordered list of events in a dlist.
+	TIMER_LIST_TYPE_WHEEL = 3			//!< Hierarchical timing wheel.
 } timer_list_type_t;
 
+#define TIMER_WHEEL_BITS	6					//!< log2 of the number of slots per level.
+#define TIMER_WHEEL_SLOTS	(1 << TIMER_WHEEL_BITS)			//!< Slots per level.
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS	8					//!< Levels, giving a range of 2^48 ticks.
+
+/** A hierarchical timing wheel
+ *
+ * Time is divided into ticks of a configurable resolution.  Level 0 has one
+ * slot per tick, and each higher level has slots which cover all the slots
+ * of the level below.  A timer is placed in the lowest level where it shares
+ * all higher bits of its tick with the current tick, so inserting and
+ * removing timers is O(1).
+ *
+ * When the current tick moves into a new slot on a higher level, the timers
+ * in that slot are redistributed to the lower levels.
+ *
+ * Slots are only sorted when their head is needed, so timers within a slot
+ * still fire in order.
+ */
+typedef struct {
+	fr_time_delta_t		resolution;			//!< Length of a tick.
+	uint64_t		now;				//!< Tick all placements are relative to.
+	uint64_t		num_events;			//!< Number of timers in the wheel.
+
+	uint64_t		pending[TIMER_WHEEL_LEVELS];	//!< Bitmap of slots which contain timers.
+	uint64_t		sorted[TIMER_WHEEL_LEVELS];	//!< Bitmap of slots whose timers are in order.
+
+	fr_dlist_head_t		slot[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+	fr_dlist_head_t		overflow;			//!< Timers beyond the range of the top level.
+} timer_wheel_t;
+
 /** An event timer list
  *
  */
@@ -56,6 +89,7 @@ struct fr_timer_list_s {
 	union {
 		fr_lst_t		*lst;			//!< of timer events to be executed.
 		timer_head_t		ordered;		//!< A list of timer events to be executed.
+		timer_wheel_t		*wheel;			//!< Timing wheel of events to be executed.
 	};
 	timer_list_type_t		type;
 	bool				in_handler;	//!< Whether we're currently in a callback.
@@ -91,6 +125,10 @@ struct fr_timer_s {
 	union {
 		fr_dlist_t		ordered_entry;		//!< Entry in an ordered list of timer events.
 		fr_lst_index_t		lst_idx;	     	//!< Where to store opaque lst data, not used for ordered lists.
+		struct {
+			fr_dlist_t		wheel_entry;	//!< Entry in a timing wheel slot.
+			fr_dlist_head_t		*wheel_slot;	//!< Slot the event is currently in.
+		};
 	};
 	bool			free_on_fire;		//!< Whether to free the event when it fires.
 
@@ -179,21 +217,42 @@ typedef struct {
 
 static int timer_lst_insert_at(fr_timer_list_t *tl, fr_timer_t *ev);
 static int timer_ordered_insert_at(fr_timer_list_t *tl, fr_timer_t *ev);
+static int timer_wheel_insert_at(fr_timer_list_t *tl, fr_timer_t *ev);
 
 static int timer_lst_disarm(fr_timer_t *ev);
 static int timer_ordered_disarm(fr_timer_t *ev);
+static int timer_wheel_disarm(fr_timer_t *ev);
 
 static int timer_list_lst_run(fr_timer_list_t *tl, fr_time_t *when);
 static int timer_list_ordered_run(fr_timer_list_t *tl, fr_time_t *when);
+static int timer_list_wheel_run(fr_timer_list_t *tl, fr_time_t *when);
 
 static fr_timer_t *timer_list_lst_head(fr_timer_list_t *tl);
 static fr_timer_t *timer_list_ordered_head(fr_timer_list_t *tl);
+static fr_timer_t *timer_list_wheel_head(fr_timer_list_t *tl);
 
 static int timer_list_lst_deferred(fr_timer_list_t *tl);
 static int timer_list_ordered_deferred(fr_timer_list_t *tl);
+static int timer_list_wheel_deferred(fr_timer_list_t *tl);
+
+/** Insert deferred timer events into the timing wheel
+ *
+ * @param[in] tl	to move events in.
+ * @return
+ *	- 0 on success.
+ */
+static int timer_list_wheel_deferred(fr_timer_list_t *tl)
+{
+	fr_timer_t *ev;
+
+	while((ev = timer_pop_head(&tl->deferred))) (void)timer_wheel_insert_at(tl, ev);
+
+	return 0;
+}
 
 static uint64_t timer_list_lst_num_events(fr_timer_list_t *tl);
 static uint64_t timer_list_ordered_num_events(fr_timer_list_t *tl);
+static uint64_t timer_list_wheel_num_events(fr_timer_list_t *tl);
 
 /** Functions for performing operations on various types of timer list
  *
@@ -216,6 +275,15 @@ static timer_list_funcs_t const timer_funcs[] = {
 		.head = timer_list_ordered_head,
 		.deferred = timer_list_ordered_deferred,
 		.num_events = timer_list_ordered_num_events
+	},
+	[TIMER_LIST_TYPE_WHEEL] = {
+		.insert = timer_wheel_insert_at,
+		.disarm = timer_wheel_disarm,
+
+		.run = timer_list_wheel_run,
+		.head = timer_list_wheel_head,
+		.deferred = timer_list_wheel_deferred,
+		.num_events = timer_list_wheel_num_events
 	}
 };
 
@@ -331,6 +399,194 @@ static int timer_ordered_insert_at(fr_timer_list_t *tl, fr_timer_t *ev)
 	return 0;
 }
 
+/** Convert a time to a tick on the timing wheel
+ *
+ */
+static inline CC_HINT(always_inline) uint64_t timer_wheel_tick(timer_wheel_t const *w, fr_time_t when)
+{
+	int64_t ns = fr_time_unwrap(when);
+
+	if (ns <= 0) return 0;
+
+	return (uint64_t)ns / (uint64_t)fr_time_delta_unwrap(w->resolution);
+}
+
+/** Place an event in the correct slot, relative to the wheel's current tick
+ *
+ * @param[in] w		to place the event in.
+ * @param[in] ev	to place.
+ */
+static void timer_wheel_place(timer_wheel_t *w, fr_timer_t *ev)
+{
+	uint64_t	tick = timer_wheel_tick(w, ev->when);
+	uint8_t		level;
+	fr_timer_t	*tail;
+
+	/*
+	 *	Events in the past go in the current slot
+	 *	so they fire on the next run.
+	 */
+	if (tick < w->now) tick = w->now;
+
+	level = fr_high_bit_pos(tick ^ w->now);
+	if (level) level = (level - 1) / TIMER_WHEEL_BITS;
+
+	if (level >= TIMER_WHEEL_LEVELS) {
+		ev->wheel_slot = &w->overflow;
+	} else {
+		unsigned int	idx = (tick >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+		uint64_t	bit = ((uint64_t)1) << idx;
+
+		ev->wheel_slot = &w->slot[(level * TIMER_WHEEL_SLOTS) + idx];
+
+		/*
+		 *	Appending keeps the slot sorted, as long
+		 *	as the event isn't earlier than the tail.
+		 *	Events earlier than everything else in the
+		 *	slot, such as those clamped to the current
+		 *	tick, can go at the head instead.
+		 */
+		tail = fr_dlist_tail(ev->wheel_slot);
+		if (!tail) {
+			w->pending[level] |= bit;
+			w->sorted[level] |= bit;
+		} else if (fr_time_lt(ev->when, tail->when)) {
+			fr_timer_t *head = fr_dlist_head(ev->wheel_slot);
+
+			if ((w->sorted[level] & bit) && fr_time_lteq(ev->when, head->when)) {
+				fr_dlist_insert_head(ev->wheel_slot, ev);
+				return;
+			}
+			w->sorted[level] &= ~bit;
+		}
+	}
+
+	fr_dlist_insert_tail(ev->wheel_slot, ev);
+}
+
+/** Move all events in a list back into the wheel
+ *
+ */
+static void timer_wheel_replace(timer_wheel_t *w, fr_dlist_head_t *list)
+{
+	fr_dlist_head_t	tmp;
+	fr_timer_t	*ev;
+
+	fr_dlist_talloc_init(&tmp, fr_timer_t, wheel_entry);
+	fr_dlist_move(&tmp, list);
+
+	while ((ev = fr_dlist_pop_head(&tmp))) timer_wheel_place(w, ev);
+}
+
+/** Move the current tick forward, redistributing events as required
+ *
+ * Must not be moved past the earliest event in the wheel.
+ *
+ * @param[in] w		to advance.
+ * @param[in] tick	to advance to.
+ */
+static void timer_wheel_advance(timer_wheel_t *w, uint64_t tick)
+{
+	uint64_t	prev = w->now;
+	int		level;
+
+	if (tick <= prev) return;
+	w->now = tick;
+
+	if ((prev >> (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) != (tick >> (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS))) {
+		timer_wheel_replace(w, &w->overflow);
+	}
+
+	/*
+	 *	Working down from the top means events cascade
+	 *	all the way to the lowest level they belong in.
+	 */
+	for (level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+		unsigned int	shift = level * TIMER_WHEEL_BITS;
+		unsigned int	idx;
+		uint64_t	bit;
+
+		if ((prev >> shift) == (tick >> shift)) continue;
+
+		idx = (tick >> shift) & TIMER_WHEEL_MASK;
+		bit = ((uint64_t)1) << idx;
+		if (!(w->pending[level] & bit)) continue;
+
+		w->pending[level] &= ~bit;
+		timer_wheel_replace(w, &w->slot[(level * TIMER_WHEEL_SLOTS) + idx]);
+	}
+}
+
+/** Find the slot containing the earliest event
+ *
+ * @param[in] w		to search.
+ * @param[out] start	The first tick covered by the slot.
+ * @return
+ *	- The slot.
+ *	- NULL if all the levels are empty.
+ */
+static inline CC_HINT(always_inline) fr_dlist_head_t *timer_wheel_first(timer_wheel_t *w, uint64_t *start)
+{
+	unsigned int level;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		unsigned int	shift = level * TIMER_WHEEL_BITS;
+		unsigned int	idx;
+		uint64_t	bit;
+
+		if (!w->pending[level]) continue;
+
+		/*
+		 *	All occupied slots are ahead of the current
+		 *	tick, so the lowest one is the earliest.
+		 */
+		idx = fr_low_bit_pos(w->pending[level]) - 1;
+		bit = ((uint64_t)1) << idx;
+
+		*start = (((w->now >> shift) & ~((uint64_t)TIMER_WHEEL_MASK)) | idx) << shift;
+
+		if (!(w->sorted[level] & bit)) {
+			fr_dlist_sort(&w->slot[(level * TIMER_WHEEL_SLOTS) + idx], timer_cmp);
+			w->sorted[level] |= bit;
+		}
+
+		return &w->slot[(level * TIMER_WHEEL_SLOTS) + idx];
+	}
+
+	return NULL;
+}
+
+/** Insert an event into a timing wheel
+ *
+ * This operation is O(1).
+ *
+ * @param[in] tl	to insert the event into.
+ * @param[in] ev	to insert.
+ * @return
+ *	- 0 on success.
+ */
+static int timer_wheel_insert_at(fr_timer_list_t *tl, fr_timer_t *ev)
+{
+	timer_wheel_t *w = tl->wheel;
+
+	/*
+	 *	Nothing to redistribute, so start counting from
+	 *	the current time.  Anchoring on the event instead
+	 *	would clamp any earlier events inserted after it
+	 *	into the same slot.
+	 */
+	if (w->num_events == 0) {
+		uint64_t now = timer_wheel_tick(w, tl->pub.time());
+
+		if (now > w->now) w->now = now;
+	}
+
+	timer_wheel_place(w, ev);
+	w->num_events++;
+
+	return 0;
+}
+
 /** Remove an event from the event loop
  *
  * @param[in] ev	to free.
@@ -599,6 +855,35 @@ static int timer_ordered_disarm(fr_timer_t *ev)
 	return 0;
 }
 
+/** Remove a timer from a timing wheel, but don't free it
+ *
+ * This operation is O(1).
+ *
+ * @param[in] ev to remove.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the timer wasn't in the wheel.
+ */
+static int timer_wheel_disarm(fr_timer_t *ev)
+{
+	timer_wheel_t	*w = ev->tl->wheel;
+	fr_dlist_head_t	*slot = ev->wheel_slot;
+
+	if (unlikely(!fr_cond_assert(slot && fr_dlist_entry_in_list(&ev->wheel_entry)))) return -1;
+
+	fr_dlist_remove(slot, ev);
+	ev->wheel_slot = NULL;
+	w->num_events--;
+
+	if ((slot != &w->overflow) && fr_dlist_empty(slot)) {
+		size_t pos = slot - w->slot;
+
+		w->pending[pos / TIMER_WHEEL_SLOTS] &= ~(((uint64_t)1) << (pos & TIMER_WHEEL_MASK));
+	}
+
+	return 0;
+}
+
 /** Remove an event from the event list, but don't free the memory
  *
  * @param[in] ev	to remove from the event list.
@@ -801,6 +1086,90 @@ static int timer_list_ordered_run(fr_timer_list_t *tl, fr_time_t *when)
 	goto done;
 }
 
+/** Run all scheduled events in a timing wheel
+ *
+ * @param[in] tl	containing the timer events.
+ * @param[in] when	Process events scheduled to run before or at this time.
+ *			- Set to 0 if no more events.
+ *			- Set to the next event time if there are more events.
+ * @return
+ *	- < 0 if we failed to updated the parent list.
+ *	- 0 no timer events fired.
+ *	- >0 number of timer event fired.
+ */
+CC_NO_UBSAN(function) /* UBSAN: false positive - public vs private fr_timer_list_t trips --fsanitize=function*/
+static int timer_list_wheel_run(fr_timer_list_t *tl, fr_time_t *when)
+{
+	timer_wheel_t	*w = tl->wheel;
+	uint64_t	target = timer_wheel_tick(w, *when);
+	fr_timer_cb_t	callback;
+	void		*uctx;
+	fr_timer_t	*ev;
+	fr_dlist_head_t	*slot;
+	uint64_t	start;
+	unsigned int	fired = 0;
+
+	for (;;) {
+		slot = timer_wheel_first(w, &start);
+		if (!slot) {
+			/*
+			 *	Only far future events left, which
+			 *	may now be in range of the levels.
+			 */
+			timer_wheel_advance(w, target);
+			if (!timer_wheel_first(w, &start)) break;
+			continue;
+		}
+
+		/*
+		 *	Nothing due, but we can still move up
+		 *	to the current time.
+		 */
+		if (start > target && start > w->now) {
+			timer_wheel_advance(w, target);
+			break;
+		}
+
+		/*
+		 *	If the slot is on a higher level, moving
+		 *	to its first tick redistributes its events,
+		 *	so try again.
+		 */
+		timer_wheel_advance(w, start);
+		if (slot >= &w->slot[TIMER_WHEEL_SLOTS]) continue;
+
+		ev = talloc_get_type_abort(fr_dlist_head(slot), fr_timer_t);
+		if (fr_time_gt(ev->when, *when)) break;
+
+		callback = ev->callback;
+		memcpy(&uctx, &ev->uctx, sizeof(uctx));
+
+		CHECK_PARENT(ev);
+
+		/*
+		 *	Disarm the event before calling it.
+		 *
+		 *	This leaves the memory in place,
+		 *	but dissassociates it from the list.
+		 *
+		 *	We use the public function as it
+		 *	handles more cases.
+		 */
+		if (!fr_cond_assert(fr_timer_disarm(ev) == 0)) return -2;
+		EVENT_DEBUG("Running timer %p", ev);
+		if (ev->free_on_fire) talloc_free(ev);
+
+		callback(tl, *when, uctx);
+
+		fired++;
+	}
+
+	ev = timer_list_wheel_head(tl);
+	*when = ev ? ev->when : fr_time_wrap(0);
+
+	return fired;
+}
+
 /** Execute any pending events in the event loop
  *
  * @param[in] tl	to execute events in.
@@ -869,6 +1238,34 @@ static fr_timer_t *timer_list_ordered_head(fr_timer_list_t *tl)
 	return timer_head(&tl->ordered);
 }
 
+/** Return the head of the timing wheel
+ *
+ * @param[in] tl	to get the head of.
+ * @return
+ *	- The earliest event.
+ *	- NULL, if there's no head.
+ */
+static fr_timer_t *timer_list_wheel_head(fr_timer_list_t *tl)
+{
+	timer_wheel_t	*w = tl->wheel;
+	fr_dlist_head_t	*slot;
+	fr_timer_t	*ev, *head = NULL;
+	uint64_t	start;
+
+	slot = timer_wheel_first(w, &start);
+	if (slot) return fr_dlist_head(slot);
+
+	/*
+	 *	Only far future events left, these are rare
+	 *	enough that a linear search is fine.
+	 */
+	for (ev = fr_dlist_head(&w->overflow); ev; ev = fr_dlist_next(&w->overflow, ev)) {
+		if (!head || fr_time_lt(ev->when, head->when)) head = ev;
+	}
+
+	return head;
+}
+
 /** Insert a timer event into a the lst
  *
  * @param[in] tl	to move events in.
@@ -940,6 +1337,11 @@ static uint64_t timer_list_ordered_num_events(fr_timer_list_t *tl)
 	return timer_num_elements(&tl->ordered);
 }
 
+static uint64_t timer_list_wheel_num_events(fr_timer_list_t *tl)
+{
+	return tl->wheel->num_events;
+}
+
 /** Disable all timers in a list
  *
  */
@@ -1085,6 +1487,47 @@ fr_timer_list_t *fr_timer_list_ordered_alloc(TALLOC_CTX *ctx, fr_timer_list_t *p
 	return tl;
 }
 
+/** Allocate a new timing wheel based timer list
+ *
+ * Inserting and removing events are O(1), which makes this list suitable for
+ * large numbers of timers which are usually disarmed before they fire, such as
+ * request and retry timeouts.
+ *
+ * @param[in] ctx		to allocate the event timer list from.
+ * @param[in] parent		to insert the head timer event into.
+ * @param[in] resolution	Length of a tick on the wheel.  Events are distributed
+ *				between slots with this granularity, but still fire
+ *				at the exact time they were scheduled for.
+ */
+fr_timer_list_t *fr_timer_list_wheel_alloc(TALLOC_CTX *ctx, fr_timer_list_t *parent, fr_time_delta_t resolution)
+{
+	fr_timer_list_t	*tl;
+	size_t		i;
+
+	if (unlikely(fr_time_delta_lteq(resolution, fr_time_delta_wrap(0)))) {
+		fr_strerror_const("Timer wheel resolution must be greater than zero");
+		return NULL;
+	}
+
+	if (unlikely((tl = timer_list_alloc(ctx, parent)) == NULL)) return NULL;
+
+	tl->wheel = talloc_zero(tl, timer_wheel_t);
+	if (unlikely(tl->wheel == NULL)) {
+		fr_strerror_const("Failed allocating timer wheel");
+		talloc_free(tl);
+		return NULL;
+	}
+	tl->wheel->resolution = resolution;
+
+	for (i = 0; i < NUM_ELEMENTS(tl->wheel->slot); i++) {
+		fr_dlist_talloc_init(&tl->wheel->slot[i], fr_timer_t, wheel_entry);
+	}
+	fr_dlist_talloc_init(&tl->wheel->overflow, fr_timer_t, wheel_entry);
+	tl->type = TIMER_LIST_TYPE_WHEEL;
+
+	return tl;
+}
+
 #if defined(WITH_EVENT_DEBUG) && !defined(NDEBUG)
 static const fr_time_delta_t decades[18] = {
 	{ 1 }, { 10 }, { 100 },
@@ -1205,6 +1648,17 @@ void fr_timer_report(fr_timer_list_t *tl, fr_time_t now, void *uctx)
 			if (_event_report_process(locations, array, now, ev) < 0) goto oom;
 		}
 		break;
+
+	case TIMER_LIST_TYPE_WHEEL:
+		for (i = 0; i <= NUM_ELEMENTS(tl->wheel->slot); i++) {
+			fr_dlist_head_t *slot = (i < NUM_ELEMENTS(tl->wheel->slot)) ? &tl->wheel->slot[i] :
+										       &tl->wheel->overflow;
+
+			for (ev = fr_dlist_head(slot); ev != NULL; ev = fr_dlist_next(slot, ev)) {
+				if (_event_report_process(locations, array, now, ev) < 0) goto oom;
+			}
+		}
+		break;
 	}
 
 	pthread_mutex_lock(&print_lock);
@@ -1274,6 +1728,24 @@ void fr_timer_dump(fr_timer_list_t *tl)
 			TIMER_DUMP(ev);
 		}
 		break;
+
+	case TIMER_LIST_TYPE_WHEEL:
+	{
+		size_t i;
+
+		EVENT_DEBUG("Dumping wheel timer list");
+
+		for (i = 0; i <= NUM_ELEMENTS(tl->wheel->slot); i++) {
+			fr_dlist_head_t *slot = (i < NUM_ELEMENTS(tl->wheel->slot)) ? &tl->wheel->slot[i] :
+										       &tl->wheel->overflow;
+
+			for (ev = fr_dlist_head(slot); ev; ev = fr_dlist_next(slot, ev)) {
+				(void)talloc_get_type_abort(ev, fr_timer_t);
+				TIMER_DUMP(ev);
+			}
+		}
+	}
+		break;
 	}
 }
 #endif
@@ -107,6 +107,8 @@ fr_timer_list_t		*fr_timer_list_lst_alloc(TALLOC_CTX *ctx, fr_timer_list_t *pare
 
 fr_timer_list_t		*fr_timer_list_ordered_alloc(TALLOC_CTX *ctx, fr_timer_list_t *parent);
 
+fr_timer_list_t		*fr_timer_list_wheel_alloc(TALLOC_CTX *ctx, fr_timer_list_t *parent, fr_time_delta_t resolution);
+
 #ifdef WITH_EVENT_DEBUG
 void 			fr_timer_report(fr_timer_list_t *tl, fr_time_t now, void *uctx);
 void			fr_timer_dump(fr_timer_list_t *tl);
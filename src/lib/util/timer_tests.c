@@ -22,6 +22,7 @@
  */
 #include <freeradius-devel/util/acutest.h>
 #include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/rand.h>
 #include <freeradius-devel/util/time.h>
 #include <freeradius-devel/util/timer.h>
 
@@ -396,6 +397,340 @@ static void ordered_nested(void)
 	talloc_free(tl_outer);
 }
 
+static void wheel_basic_test(void)
+{
+	fr_timer_list_t *tl;
+
+	tl = fr_timer_list_wheel_alloc(NULL, NULL, fr_time_delta_from_msec(1));
+	TEST_CHECK(tl != NULL);
+	if (tl == NULL) return;
+
+	fr_timer_list_set_time_func(tl, basic_time);
+
+	basic_timer_list_tests(tl);
+
+	talloc_free(tl);
+}
+
+static void wheel_deferred_test(void)
+{
+	fr_timer_list_t *tl;
+
+	tl = fr_timer_list_wheel_alloc(NULL, NULL, fr_time_delta_from_msec(1));
+	TEST_CHECK(tl != NULL);
+	if (tl == NULL) return;
+
+	deferred_timer_list_tests(tl);
+
+	talloc_free(tl);
+}
+
+static void wheel_nested(void)
+{
+	fr_timer_list_t *tl_outer, *tl_inner;
+
+	tl_outer = fr_timer_list_lst_alloc(NULL, NULL);
+	TEST_CHECK(tl_outer != NULL);
+	if (tl_outer == NULL) return;
+
+	tl_inner = fr_timer_list_wheel_alloc(tl_outer, tl_outer, fr_time_delta_from_msec(1));
+	TEST_CHECK(tl_inner != NULL);
+	if (tl_inner == NULL) return;
+
+	fr_timer_list_set_time_func(tl_outer, basic_time);
+	fr_timer_list_set_time_func(tl_inner, basic_time);
+
+	nested_test(tl_outer, tl_inner);
+
+	talloc_free(tl_outer);
+}
+
+typedef struct {
+	fr_time_t	when;		//!< When the timer should fire.
+	fr_time_t	*last;		//!< When the last timer fired.
+	unsigned int	*count;		//!< How many timers have fired.
+	fr_timer_t	*ev;
+} order_uctx_t;
+
+/** Check timers fire in order, and not before they're due
+ *
+ */
+static void timer_cb_order(UNUSED fr_timer_list_t *tl, fr_time_t now, void *uctx)
+{
+	order_uctx_t *ctx = uctx;
+
+	TEST_CHECK(fr_time_lteq(ctx->when, now));
+	TEST_MSG("timer due at %"PRId64" fired at %"PRId64, fr_time_unwrap(ctx->when), fr_time_unwrap(now));
+
+	TEST_CHECK(fr_time_gteq(ctx->when, *ctx->last));
+	TEST_MSG("timer due at %"PRId64" fired after timer due at %"PRId64,
+		 fr_time_unwrap(ctx->when), fr_time_unwrap(*ctx->last));
+
+	*ctx->last = ctx->when;
+	(*ctx->count)++;
+}
+
+#define WHEEL_ORDER_SIZE 10000
+
+/** Insert timers spread over several levels of the wheel, and check they fire in order
+ *
+ */
+static void wheel_order_test(void)
+{
+	fr_timer_list_t	*tl;
+	order_uctx_t	*ctx;
+	fr_fast_rand_t	rand_ctx;
+	fr_time_t	now, last = fr_time_wrap(0);
+	unsigned int	i, count = 0, disarmed = 0;
+
+	tl = fr_timer_list_wheel_alloc(NULL, NULL, fr_time_delta_from_msec(1));
+	TEST_CHECK(tl != NULL);
+	if (tl == NULL) return;
+
+	fr_timer_list_set_time_func(tl, basic_time);
+
+	rand_ctx.a = fr_rand();
+	rand_ctx.b = fr_rand();
+
+	ctx = talloc_zero_array(tl, order_uctx_t, WHEEL_ORDER_SIZE);
+
+	/*
+	 *	Timers due between now and ~12 days from now,
+	 *	with nanosecond precision.
+	 */
+	for (i = 0; i < WHEEL_ORDER_SIZE; i++) {
+		ctx[i].when = fr_time_wrap(NSEC + ((((uint64_t)fr_fast_rand(&rand_ctx) << 32) | fr_fast_rand(&rand_ctx)) %
+						  ((uint64_t)NSEC * 86400 * 12)));
+		ctx[i].last = &last;
+		ctx[i].count = &count;
+
+		TEST_CHECK(fr_timer_at(tl, tl, &ctx[i].ev, ctx[i].when, false, timer_cb_order, &ctx[i]) == 0);
+	}
+	TEST_CHECK(fr_timer_list_num_events(tl) == WHEEL_ORDER_SIZE);
+
+	/*
+	 *	Cancel some, as would normally happen to
+	 *	request timers.
+	 */
+	for (i = 0; i < WHEEL_ORDER_SIZE; i += 7) {
+		TEST_CHECK(fr_timer_disarm(ctx[i].ev) == 0);
+		disarmed++;
+	}
+	TEST_CHECK(fr_timer_list_num_events(tl) == (WHEEL_ORDER_SIZE - disarmed));
+
+	/*
+	 *	Move time forward in irregular steps
+	 */
+	now = fr_time_wrap(0);
+	while (fr_timer_list_num_events(tl) > 0) {
+		fr_time_t when;
+
+		now = fr_time_add(now, fr_time_delta_wrap(fr_fast_rand(&rand_ctx) % ((uint64_t)NSEC * 600)));
+		when = now;
+
+		TEST_CHECK(fr_timer_list_run(tl, &when) >= 0);
+		if (fr_timer_list_num_events(tl) > 0) {
+			TEST_CHECK(fr_time_gt(when, now));
+			TEST_CHECK(fr_time_eq(when, fr_timer_list_when(tl)));
+		}
+	}
+	TEST_CHECK(count == (WHEEL_ORDER_SIZE - disarmed));
+	TEST_MSG("expected %u timers to fire, got %u", WHEEL_ORDER_SIZE - disarmed, count);
+
+	talloc_free(tl);
+}
+
+/** Insert a far timer first, then earlier ones, and check they still fire in order
+ *
+ */
+static void wheel_far_first_test(void)
+{
+	fr_timer_list_t	*tl;
+	order_uctx_t	ctx[4];
+	fr_time_t	when, last = fr_time_wrap(0);
+	unsigned int	i, count = 0;
+	static int64_t const	msec[] = { 30000, 500, 2, 250 };
+
+	tl = fr_timer_list_wheel_alloc(NULL, NULL, fr_time_delta_from_msec(1));
+	TEST_CHECK(tl != NULL);
+	if (tl == NULL) return;
+
+	fr_timer_list_set_time_func(tl, basic_time);
+	basic_set(fr_time_wrap(0));
+
+	for (i = 0; i < NUM_ELEMENTS(ctx); i++) {
+		ctx[i] = (order_uctx_t){ .when = fr_time_add(fr_time_wrap(0), fr_time_delta_from_msec(msec[i])),
+					 .last = &last, .count = &count };
+		TEST_CHECK(fr_timer_at(tl, tl, &ctx[i].ev, ctx[i].when, false, timer_cb_order, &ctx[i]) == 0);
+	}
+	TEST_CHECK(fr_time_eq(fr_timer_list_when(tl), ctx[2].when));
+
+	when = fr_time_from_sec(31);
+	TEST_CHECK(fr_timer_list_run(tl, &when) == (int)NUM_ELEMENTS(ctx));
+	TEST_CHECK(count == NUM_ELEMENTS(ctx));
+
+	talloc_free(tl);
+}
+
+static void timer_cb_noop(UNUSED fr_timer_list_t *tl, UNUSED fr_time_t now, UNUSED void *uctx)
+{
+}
+
+/** Benchmark a timer list when used for request timeouts
+ *
+ * Timers are inserted with a spread of deltas, most are disarmed before they
+ * fire, and the rest are run.
+ */
+static void timer_list_cmp(char const *name, fr_timer_list_t *tl, unsigned int count)
+{
+	fr_timer_t	**ev;
+	fr_fast_rand_t	rand_ctx;
+	fr_time_t	start_insert, end_insert, start_disarm, end_disarm, start_run, end_run, when;
+	unsigned int	i;
+
+	fr_timer_list_set_time_func(tl, basic_time);
+	basic_set(fr_time_wrap(0));
+
+	ev = talloc_zero_array(NULL, fr_timer_t *, count);
+
+	rand_ctx.a = fr_rand();
+	rand_ctx.b = fr_rand();
+
+	start_insert = fr_time();
+	for (i = 0; i < count; i++) {
+		(void)fr_timer_in(tl, tl, &ev[i],
+				  fr_time_delta_from_msec(1 + (fr_fast_rand(&rand_ctx) % 30000)),
+				  false, timer_cb_noop, NULL);
+	}
+	end_insert = fr_time();
+
+	start_disarm = fr_time();
+	for (i = 0; i < count; i++) {
+		if ((i % 10) == 0) continue;
+		(void)fr_timer_disarm(ev[i]);
+	}
+	end_disarm = fr_time();
+
+	start_run = fr_time();
+	when = fr_time_from_sec(31);
+	TEST_CHECK(fr_timer_list_run(tl, &when) == (int)((count + 9) / 10));
+	end_run = fr_time();
+
+	TEST_MSG_ALWAYS("\n%s size: %u\n", name, count);
+	TEST_MSG_ALWAYS("insert: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_insert, start_insert)) / 1000);
+	TEST_MSG_ALWAYS("disarm: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_disarm, start_disarm)) / 1000);
+	TEST_MSG_ALWAYS("run: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_run, start_run)) / 1000);
+
+	talloc_free(ev);
+}
+
+static void timer_cmp(unsigned int count)
+{
+	fr_timer_list_t *tl;
+
+	tl = fr_timer_list_lst_alloc(NULL, NULL);
+	TEST_CHECK(tl != NULL);
+	if (tl == NULL) return;
+	timer_list_cmp("lst", tl, count);
+	talloc_free(tl);
+
+	tl = fr_timer_list_wheel_alloc(NULL, NULL, fr_time_delta_from_msec(1));
+	TEST_CHECK(tl != NULL);
+	if (tl == NULL) return;
+	timer_list_cmp("wheel", tl, count);
+	talloc_free(tl);
+}
+
+static void timer_cmp_1000(void)
+{
+	timer_cmp(1000);
+}
+
+static void timer_cmp_100000(void)
+{
+	timer_cmp(100000);
+}
+
+static void timer_cmp_500000(void)
+{
+	timer_cmp(500000);
+}
+
+/** Benchmark a timer list nested in a parent list, where the first timer is the furthest out
+ *
+ * This is the usual pattern for a long idle timeout followed by a burst of
+ * request timeouts.  Every insert which changes the head of the child list
+ * updates the parent, so the cost of finding the head matters as much as the
+ * insert itself.
+ */
+static void timer_list_far_first_cmp(char const *name, fr_timer_list_t *tl_outer, fr_timer_list_t *tl,
+				     unsigned int count)
+{
+	fr_timer_t	**ev;
+	fr_timer_t	*far = NULL;
+	fr_fast_rand_t	rand_ctx;
+	fr_time_t	start_insert, end_insert, start_disarm, end_disarm, when;
+	unsigned int	i;
+
+	fr_timer_list_set_time_func(tl_outer, basic_time);
+	fr_timer_list_set_time_func(tl, basic_time);
+	basic_set(fr_time_wrap(0));
+
+	ev = talloc_zero_array(NULL, fr_timer_t *, count);
+
+	rand_ctx.a = fr_rand();
+	rand_ctx.b = fr_rand();
+
+	TEST_CHECK(fr_timer_in(tl, tl, &far, fr_time_delta_from_sec(30), false, timer_cb_noop, NULL) == 0);
+
+	start_insert = fr_time();
+	for (i = 0; i < count; i++) {
+		(void)fr_timer_in(tl, tl, &ev[i],
+				  fr_time_delta_from_msec(1 + (fr_fast_rand(&rand_ctx) % 1000)),
+				  false, timer_cb_noop, NULL);
+	}
+	end_insert = fr_time();
+
+	start_disarm = fr_time();
+	for (i = 0; i < count; i++) (void)fr_timer_disarm(ev[i]);
+	end_disarm = fr_time();
+
+	TEST_CHECK(fr_time_eq(fr_timer_list_when(tl), fr_time_from_sec(30)));
+
+	when = fr_time_from_sec(31);
+	TEST_CHECK(fr_timer_list_run(tl_outer, &when) >= 0);
+	TEST_CHECK(fr_timer_list_num_events(tl) == 0);
+
+	TEST_MSG_ALWAYS("\n%s far first size: %u\n", name, count);
+	TEST_MSG_ALWAYS("insert: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_insert, start_insert)) / 1000);
+	TEST_MSG_ALWAYS("disarm: %"PRId64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_disarm, start_disarm)) / 1000);
+
+	talloc_free(ev);
+}
+
+static void timer_far_first_cmp(void)
+{
+	fr_timer_list_t *tl_outer, *tl;
+
+	tl_outer = fr_timer_list_lst_alloc(NULL, NULL);
+	TEST_CHECK(tl_outer != NULL);
+	if (tl_outer == NULL) return;
+	tl = fr_timer_list_lst_alloc(tl_outer, tl_outer);
+	TEST_CHECK(tl != NULL);
+	if (tl == NULL) return;
+	timer_list_far_first_cmp("lst", tl_outer, tl, 100000);
+	talloc_free(tl_outer);
+
+	tl_outer = fr_timer_list_lst_alloc(NULL, NULL);
+	TEST_CHECK(tl_outer != NULL);
+	if (tl_outer == NULL) return;
+	tl = fr_timer_list_wheel_alloc(tl_outer, tl_outer, fr_time_delta_from_msec(1));
+	TEST_CHECK(tl != NULL);
+	if (tl == NULL) return;
+	timer_list_far_first_cmp("wheel", tl_outer, tl, 100000);
+	talloc_free(tl_outer);
+}
+
 TEST_LIST = {
 	{ "lst_basic",		lst_basic_test },
 	{ "ordered_basic",		ordered_basic_test },
@@ -404,5 +739,14 @@ TEST_LIST = {
 	{ "ordered_bad_inserts",	ordered_bad_inserts_test },
 	{ "lst_nested",		lst_nested },
 	{ "ordered_nested",		ordered_nested },
+	{ "wheel_basic",		wheel_basic_test },
+	{ "wheel_deferred",		wheel_deferred_test },
+	{ "wheel_nested",		wheel_nested },
+	{ "wheel_order",		wheel_order_test },
+	{ "wheel_far_first",		wheel_far_first_test },
+	{ "timer_cmp_1000",		timer_cmp_1000 },
+	{ "timer_cmp_100000",		timer_cmp_100000 },
+	{ "timer_cmp_500000",		timer_cmp_500000 },
+	{ "timer_far_first_cmp",	timer_far_first_cmp },
 	{ NULL }
 };
@@ -6299,19 +6299,26 @@ char *fr_value_box_list_aprint_secure(TALLOC_CTX *ctx, fr_value_box_list_t const
 
 /** Hash the contents of a value box
  *
+ * Variable length values are hashed with #fr_hash64, which is faster than
+ * FNV for all but the shortest strings, and disperses better in the open
+ * addressing tables #fr_htrie_hint selects for them.
  */
 uint32_t fr_value_box_hash(fr_value_box_t const *vb)
 {
+	uint64_t hash;
+
 	switch (vb->type) {
 	case FR_TYPE_FIXED_SIZE:
 		return fr_hash(fr_value_box_raw(vb, vb->type),
 			       fr_value_box_field_sizes[vb->type]);
 
 	case FR_TYPE_STRING:
-		return fr_hash(vb->vb_strvalue, vb->vb_length);
+		hash = fr_hash64(vb->vb_strvalue, vb->vb_length);
+		return (uint32_t)(hash ^ (hash >> 32));
 
 	case FR_TYPE_OCTETS:
-		return fr_hash(vb->vb_octets, vb->vb_length);
+		hash = fr_hash64(vb->vb_octets, vb->vb_length);
+		return (uint32_t)(hash ^ (hash >> 32));
 
 	default:
 		break;
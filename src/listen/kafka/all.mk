@@ -0,0 +1 @@
+SUBMAKEFILES := proto_kafka.mk proto_kafka_consumer.mk proto_kafka_consumer_tests.mk
@@ -0,0 +1,376 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file proto_kafka.c
+ * @brief Kafka master protocol handler.
+ *
+ * Messages consumed from Kafka are processed as requests.  Each message
+ * contains a list of attributes in the same text format as is used by
+ * the detail file, e.g. "User-Name = bob, Acct-Status-Type = Start".
+ * Attributes may be separated by commas or by newlines.
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/io/schedule.h>
+#include <freeradius-devel/util/pair_legacy.h>
+
+#include <freeradius-devel/server/module.h>
+#include <freeradius-devel/server/module_rlm.h>
+
+#include "proto_kafka.h"
+
+extern fr_app_t proto_kafka;
+
+static int type_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
+
+static conf_parser_t const limit_config[] = {
+	{ FR_CONF_OFFSET("initial_rtx_time", proto_kafka_t, retry_config.irt), .dflt = STRINGIFY(1) },
+	{ FR_CONF_OFFSET("max_rtx_time", proto_kafka_t, retry_config.mrt), .dflt = STRINGIFY(16) },
+
+	/*
+	 *	Retry indefinitely.  A message which is skipped is
+	 *	never processed.
+	 */
+	{ FR_CONF_OFFSET("max_rtx_count", proto_kafka_t, retry_config.mrc), .dflt = STRINGIFY(0) },
+	{ FR_CONF_OFFSET("max_rtx_duration", proto_kafka_t, retry_config.mrd), .dflt = STRINGIFY(0) },
+	{ FR_CONF_OFFSET("max_outstanding", proto_kafka_t, max_outstanding), .dflt = STRINGIFY(64) },
+	{ FR_CONF_OFFSET("max_pending", proto_kafka_t, max_pending), .dflt = STRINGIFY(4096) },
+	CONF_PARSER_TERMINATOR
+};
+
+/** How to parse a Kafka listen section
+ *
+ */
+static conf_parser_t const proto_kafka_config[] = {
+	{ FR_CONF_OFFSET_TYPE_FLAGS("type", FR_TYPE_VOID, CONF_FLAG_NOT_EMPTY | CONF_FLAG_REQUIRED, proto_kafka_t,
+			  type), .func = type_parse },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("transport", FR_TYPE_VOID, 0, proto_kafka_t, io_submodule),
+	  .func = virtual_server_listen_transport_parse, .dflt = "consumer" },
+
+	/*
+	 *	Add this as a synonym so normal humans can understand it.
+	 */
+	{ FR_CONF_OFFSET("max_entry_size", proto_kafka_t, max_packet_size) } ,
+
+	/*
+	 *	For performance tweaking.  NOT for normal humans.
+	 */
+	{ FR_CONF_OFFSET("max_packet_size", proto_kafka_t, max_packet_size) } ,
+	{ FR_CONF_OFFSET("num_messages", proto_kafka_t, num_messages) } ,
+
+	{ FR_CONF_OFFSET("priority", proto_kafka_t, priority) },
+
+	{ FR_CONF_POINTER("limit", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) limit_config },
+
+	CONF_PARSER_TERMINATOR
+};
+
+static fr_dict_t const *dict_freeradius;
+
+extern fr_dict_autoload_t proto_kafka_dict[];
+fr_dict_autoload_t proto_kafka_dict[] = {
+	{ .out = &dict_freeradius, .proto = "freeradius" },
+
+	{ NULL }
+};
+
+static fr_dict_attr_t const *attr_packet_dst_ip_address;
+static fr_dict_attr_t const *attr_packet_dst_port;
+static fr_dict_attr_t const *attr_packet_src_ip_address;
+static fr_dict_attr_t const *attr_packet_src_port;
+
+extern fr_dict_attr_autoload_t proto_kafka_dict_attr[];
+fr_dict_attr_autoload_t proto_kafka_dict_attr[] = {
+	{ .out = &attr_packet_dst_ip_address, .name = "Net.Dst.IP", .type = FR_TYPE_COMBO_IP_ADDR, .dict = &dict_freeradius },
+	{ .out = &attr_packet_dst_port, .name = "Net.Dst.Port", .type = FR_TYPE_UINT16, .dict = &dict_freeradius },
+	{ .out = &attr_packet_src_ip_address, .name = "Net.Src.IP", .type = FR_TYPE_COMBO_IP_ADDR, .dict = &dict_freeradius },
+	{ .out = &attr_packet_src_port, .name = "Net.Src.Port", .type = FR_TYPE_UINT16, .dict = &dict_freeradius },
+
+	{ NULL }
+};
+
+/** Translates the packet-type into a packet code
+ *
+ * @param[in] ctx	to allocate data in (instance of proto_kafka).
+ * @param[out] out	Where to write the type name.
+ * @param[in] parent	Base structure address.
+ * @param[in] ci	#CONF_PAIR specifying the name of the type.
+ * @param[in] rule	unused.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int type_parse(UNUSED TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, UNUSED conf_parser_t const *rule)
+{
+	proto_kafka_t			*inst = talloc_get_type_abort(parent, proto_kafka_t);
+	fr_dict_enum_value_t const	*type_enum;
+	CONF_PAIR			*cp = cf_item_to_pair(ci);
+	char const			*value = cf_pair_value(cp);
+
+	*((char const **) out) = value;
+
+	inst->dict = virtual_server_dict_by_child_ci(ci);
+	if (!inst->dict) {
+		cf_log_err(ci, "Please define 'namespace' in this virtual server");
+		return -1;
+	}
+
+	inst->attr_packet_type = fr_dict_attr_by_name(NULL, fr_dict_root(inst->dict), "Packet-Type");
+	if (!inst->attr_packet_type) {
+		cf_log_err(ci, "Failed to find 'Packet-Type' attribute");
+		return -1;
+	}
+
+	if (!value) {
+		cf_log_err(ci, "No value given for 'type'");
+		return -1;
+	}
+
+	type_enum = fr_dict_enum_by_name(inst->attr_packet_type, value, -1);
+	if (!type_enum) {
+		cf_log_err(ci, "Invalid type \"%s\"", value);
+		return -1;
+	}
+
+	inst->code = type_enum->value->vb_uint32;
+	return 0;
+}
+
+/** Decode the message, and set the request->process function
+ *
+ */
+static int mod_decode(void const *instance, request_t *request, uint8_t *const data, size_t data_len)
+{
+	proto_kafka_t const	*inst = talloc_get_type_abort_const(instance, proto_kafka_t);
+	fr_pair_t		*vp;
+	fr_pair_list_t		tmp_list;
+	fr_pair_parse_t		root, relative;
+
+	RHEXDUMP3(data, data_len, "proto_kafka decode message");
+
+	request->packet->code = inst->code;
+
+	/*
+	 *	Set default addresses
+	 */
+	request->packet->socket.fd = -1;
+	request->packet->socket.inet.src_ipaddr.af = AF_INET;
+	request->packet->socket.inet.src_ipaddr.addr.v4.s_addr = htonl(INADDR_NONE);
+	request->packet->socket.inet.dst_ipaddr = request->packet->socket.inet.src_ipaddr;
+
+	request->reply->socket.inet.src_ipaddr = request->packet->socket.inet.src_ipaddr;
+	request->reply->socket.inet.dst_ipaddr = request->packet->socket.inet.src_ipaddr;
+
+	/*
+	 *	Parse the whole message in one go.  The contents come
+	 *	from outside of the server, so they're tainted.
+	 */
+	fr_pair_list_init(&tmp_list);
+	root = (fr_pair_parse_t) {
+		.ctx = request->request_ctx,
+		.da = fr_dict_root(request->proto_dict),
+		.list = &tmp_list,
+		.allow_crlf = true,
+		.tainted = true,
+	};
+	relative = (fr_pair_parse_t) { };
+
+	if (fr_pair_list_afrom_substr(&root, &relative, &FR_SBUFF_IN((char const *) data, data_len)) < 0) {
+		RPEDEBUG("Failed parsing message");
+		fr_pair_list_free(&tmp_list);
+		return -1;
+	}
+	fr_pair_list_append(&request->request_pairs, &tmp_list);
+
+	/*
+	 *	Set the original src/dst ip/port
+	 */
+	vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_packet_src_ip_address);
+	if (vp) request->packet->socket.inet.src_ipaddr = vp->vp_ip;
+
+	vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_packet_dst_ip_address);
+	if (vp) request->packet->socket.inet.dst_ipaddr = vp->vp_ip;
+
+	vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_packet_src_port);
+	if (vp) request->packet->socket.inet.src_port = vp->vp_uint16;
+
+	vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_packet_dst_port);
+	if (vp) request->packet->socket.inet.dst_port = vp->vp_uint16;
+
+	/*
+	 *	Let the app_io take care of populating additional fields in the request
+	 */
+	return inst->app_io->decode(inst->app_io_instance, request, data, data_len);
+}
+
+static ssize_t mod_encode(UNUSED void const *instance, request_t *request, uint8_t *buffer, size_t buffer_len)
+{
+	if (buffer_len < 1) return -1;
+
+	*buffer = request->reply->code;
+	return 1;
+}
+
+static int mod_priority_set(void const *instance, UNUSED uint8_t const *buffer, UNUSED size_t buflen)
+{
+	proto_kafka_t const *inst = talloc_get_type_abort_const(instance, proto_kafka_t);
+
+	/*
+	 *	Return the configured priority.
+	 */
+	return inst->priority;
+}
+
+/** Open listen sockets/connect to external event source
+ *
+ * @param[in] instance	Ctx data for this application.
+ * @param[in] sc	to add our file descriptor to.
+ * @param[in] conf	Listen section parsed to give us instance.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_open(void *instance, fr_schedule_t *sc, CONF_SECTION *conf)
+{
+	fr_listen_t	*li;
+	proto_kafka_t 	*inst = talloc_get_type_abort(instance, proto_kafka_t);
+
+	/*
+	 *	Build the #fr_listen_t.  This describes the complete
+	 *	path, data takes from the socket to the decoder and
+	 *	back again.
+	 */
+	MEM(li = talloc_zero(inst, fr_listen_t));	/* Assigned thread steals the memory */
+	talloc_set_destructor(li, fr_io_listen_free);
+
+	li->app_io = inst->app_io;
+	li->thread_instance = talloc_zero_array(li, uint8_t, li->app_io->common.thread_inst_size);
+	talloc_set_name(li->thread_instance, "proto_%s_thread_t", inst->app_io->common.name);
+	li->app_io_instance = inst->app_io_instance;
+
+	li->app = &proto_kafka;
+	li->app_instance = instance;
+	li->server_cs = inst->server_cs;
+
+	/*
+	 *	Set configurable parameters for message ring buffer.
+	 */
+	li->default_message_size = inst->max_packet_size;
+	li->num_messages = inst->num_messages;
+
+	/*
+	 *	Connect to the brokers, and subscribe to the topics.
+	 */
+	if (inst->app_io->open(li) < 0) {
+		cf_log_err(conf, "Failed opening %s interface", inst->app_io->common.name);
+		talloc_free(li);
+		return -1;
+	}
+
+	fr_assert(li->app_io->get_name);
+	li->name = li->app_io->get_name(li);
+
+	if (!fr_schedule_listen_add(sc, li)) {
+		talloc_free(li);
+		return -1;
+	}
+
+	DEBUG("Listening on %s bound to virtual server %s",
+	      li->name, cf_section_name2(li->server_cs));
+
+	inst->listen = li;	/* Probably won't need it, but doesn't hurt */
+
+	return 0;
+}
+
+/** Instantiate the application
+ *
+ * Instantiate I/O and type submodules.
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	proto_kafka_t		*inst = talloc_get_type_abort(mctx->mi->data, proto_kafka_t);
+	CONF_SECTION		*conf = mctx->mi->conf;
+
+	/*
+	 *	The listener is inside of a virtual server.
+	 */
+	inst->server_cs = cf_item_to_section(cf_parent(conf));
+
+	if (!inst->io_submodule) {
+		cf_log_err(conf, "Virtual server for Kafka requires a 'transport' configuration");
+		return -1;
+	}
+
+	/*
+	 *	Bootstrap the I/O module
+	 */
+	inst->app_io = (fr_app_io_t const *) inst->io_submodule->exported;
+	inst->app_io_instance = inst->io_submodule->data;
+	inst->app_io_conf = inst->io_submodule->conf;
+
+	/*
+	 *	These configuration items are not printed by default,
+	 *	because normal people shouldn't be touching them.
+	 */
+	if (!inst->max_packet_size) inst->max_packet_size = inst->app_io->default_message_size;
+
+	if (!inst->num_messages) inst->num_messages = 256;
+
+	FR_INTEGER_BOUND_CHECK("num_messages", inst->num_messages, >=, 2);
+	FR_INTEGER_BOUND_CHECK("num_messages", inst->num_messages, <=, 65535);
+
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 1024);
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65536);
+
+	if (!inst->priority) inst->priority = PRIORITY_NORMAL;
+
+	FR_TIME_DELTA_BOUND_CHECK("limit.initial_rtx_time", inst->retry_config.irt, >=, fr_time_delta_from_sec(1));
+	FR_TIME_DELTA_BOUND_CHECK("limit.initial_rtx_time", inst->retry_config.irt, <=, fr_time_delta_from_sec(60));
+	FR_TIME_DELTA_BOUND_CHECK("limit.max_rtx_time", inst->retry_config.mrt, <=, fr_time_delta_from_sec(30));
+	FR_TIME_DELTA_BOUND_CHECK("limit.max_rtx_duration", inst->retry_config.mrd, <=, fr_time_delta_from_sec(86400));
+
+	FR_INTEGER_BOUND_CHECK("limit.max_outstanding", inst->max_outstanding, >=, 1);
+	FR_INTEGER_BOUND_CHECK("limit.max_outstanding", inst->max_outstanding, <=, 65536);
+
+	FR_INTEGER_BOUND_CHECK("limit.max_pending", inst->max_pending, >=, inst->max_outstanding);
+	FR_INTEGER_BOUND_CHECK("limit.max_pending", inst->max_pending, <=, 1048576);
+
+	return 0;
+}
+
+fr_app_t proto_kafka = {
+	.common = {
+		.magic			= MODULE_MAGIC_INIT,
+		.name			= "kafka",
+		.config			= proto_kafka_config,
+		.inst_size		= sizeof(proto_kafka_t),
+
+		.instantiate		= mod_instantiate,
+	},
+	.open			= mod_open,
+	.decode			= mod_decode,
+	.encode			= mod_encode,
+	.priority		= mod_priority_set
+};
@@ -0,0 +1,67 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file proto_kafka.h
+ * @brief Kafka master protocol handler.
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+RCSIDH(proto_kafka_h, "$Id$")
+
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/server/module_rlm.h>
+#include <freeradius-devel/util/retry.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	CONF_SECTION			*server_cs;			//!< server CS for this listener
+	char const			*type;				//!< packet type name
+
+	module_instance_t		*io_submodule;			//!< As provided by the transport_parse
+									///< callback.  Broken out into the
+									///< app_io_* fields below for convenience.
+
+	fr_app_io_t const		*app_io;			//!< Easy access to the app_io handle.
+	void				*app_io_instance;		//!< Easy access to the app_io instance.
+	CONF_SECTION			*app_io_conf;			//!< Easy access to the app_io's config section.
+
+	fr_dict_t const			*dict;				//!< root dictionary
+	fr_dict_attr_t const		*attr_packet_type;
+
+	uint32_t			code;				//!< packet code to use for incoming packets
+	uint32_t			max_packet_size;		//!< for message ring buffer
+	uint32_t			num_messages;			//!< for message ring buffer
+	uint32_t			priority;			//!< for packet processing, larger == higher
+
+	fr_retry_config_t		retry_config;			//!< for messages which fail processing.
+	uint32_t			max_outstanding;		//!< number of messages to process in parallel.
+	uint32_t			max_pending;			//!< number of messages whose offsets
+									//!< haven't been stored yet.
+
+	fr_listen_t			*listen;			//!< The listener structure which describes
+									//!< the I/O path.
+} proto_kafka_t;
+
+#ifdef __cplusplus
+}
+#endif
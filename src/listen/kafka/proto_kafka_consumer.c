@@ -0,0 +1,883 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file proto_kafka_consumer.c
+ * @brief Kafka consumer transport
+ *
+ * Messages are read from a consumer group, and many of them are processed
+ * in parallel.  The offset of a message is only stored once it, and every
+ * message before it in the same partition, has been processed successfully.
+ * The stored offsets are then committed by librdkafka in the background.
+ *
+ * Once a message has been processed, only its offset is kept.  The number
+ * of messages which are waiting for an earlier message to finish is limited
+ * by "max_pending", so that one slow message can't make us read the whole
+ * partition into memory.
+ *
+ * This gives "at least once" delivery.  If the server stops, messages which
+ * were being processed will be read again when it restarts.
+ *
+ * When partitions are taken away from us by a rebalance, the offsets which
+ * have been stored for them are committed before they're given up.  Messages
+ * from those partitions which are still being processed are read again by
+ * their new owner, so their offsets are discarded, and they aren't retried.
+ *
+ * librdkafka signals that messages are available by writing to a pipe,
+ * which is what the network side watches.
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/kafka/base.h>
+#include <freeradius-devel/server/client.h>
+#include <freeradius-devel/server/pair.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/misc.h>
+#include <freeradius-devel/util/rb.h>
+#include <freeradius-devel/util/retry.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include "proto_kafka.h"
+
+typedef struct {
+	CONF_SECTION			*cs;			//!< our configuration section
+
+	proto_kafka_t			*parent;		//!< The module that spawned us!
+
+	char const			**topics;		//!< names of the topics to subscribe to.
+
+	fr_client_t			*client;		//!< so the rest of the server doesn't complain
+} proto_kafka_consumer_t;
+
+typedef struct {
+	char const			*name;			//!< debug name for printing
+	proto_kafka_consumer_t const	*inst;			//!< instance data
+
+	rd_kafka_t			*rk;			//!< consumer handle.
+	int				pipe[2];		//!< librdkafka writes to this when messages arrive.
+
+	fr_event_list_t			*el;			//!< for retry timers.
+	fr_rb_tree_t			*partitions;		//!< of kafka_partition_t, for tracking offsets.
+	fr_dlist_head_t			retry;			//!< messages waiting to be processed again.
+
+	uint32_t			outstanding;		//!< number of messages being processed.
+	uint32_t			pending;		//!< number of messages whose offsets haven't been stored.
+	bool				paused;			//!< Is reading paused?
+
+	uint32_t			count;			//!< number of messages we've read.
+} proto_kafka_consumer_thread_t;
+
+/** Messages from one partition which haven't been committed
+ *
+ */
+typedef struct {
+	fr_rb_node_t			node;			//!< in the thread's partition tree.
+	char const			*topic;			//!< the partition belongs to.
+	int32_t				partition;		//!< number.
+	fr_dlist_head_t			pending;		//!< of kafka_entry_t, in offset order.
+	bool				revoked;		//!< the partition has been assigned elsewhere.
+} kafka_partition_t;
+
+typedef struct {
+	proto_kafka_consumer_thread_t	*thread;		//!< talloc_parent is SLOW!
+	kafka_partition_t		*partition;		//!< the message came from.
+	rd_kafka_message_t		*msg;			//!< from librdkafka.  Destroyed once processing finishes.
+	int64_t				offset;			//!< of the message, which we still need after that.
+
+	uint32_t			id;			//!< for debugging.
+	fr_time_t			timestamp;		//!< when we read the message.
+	bool				done;			//!< processing has finished.
+
+	fr_retry_t			retry;			//!< our retry timers
+	fr_timer_t			*ev;			//!< retry timer
+	fr_dlist_t			pending_entry;		//!< in the partition's pending list.
+	fr_dlist_t			retry_entry;		//!< in the thread's retry list.
+} kafka_entry_t;
+
+static fr_dict_t const *dict_freeradius;
+
+extern fr_dict_autoload_t proto_kafka_consumer_dict[];
+fr_dict_autoload_t proto_kafka_consumer_dict[] = {
+	{ .out = &dict_freeradius, .proto = "freeradius" },
+
+	{ NULL }
+};
+
+static fr_dict_attr_t const *attr_packet_transmit_counter;
+
+extern fr_dict_attr_autoload_t proto_kafka_consumer_dict_attr[];
+fr_dict_attr_autoload_t proto_kafka_consumer_dict_attr[] = {
+	{ .out = &attr_packet_transmit_counter, .name = "Packet-Transmit-Counter", .type = FR_TYPE_UINT32, .dict = &dict_freeradius },
+	{ NULL }
+};
+
+static fr_event_update_t pause_read[] = {
+	FR_EVENT_SUSPEND(fr_event_io_func_t, read),
+	{ 0 }
+};
+
+static fr_event_update_t resume_read[] = {
+	FR_EVENT_RESUME(fr_event_io_func_t, read),
+	{ 0 }
+};
+
+static int8_t kafka_partition_cmp(void const *one, void const *two)
+{
+	kafka_partition_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->partition, b->partition);
+	if (ret != 0) return ret;
+
+	ret = strcmp(a->topic, b->topic);
+	return CMP(ret, 0);
+}
+
+/** Make the pipe readable, so that the network side calls mod_read()
+ *
+ */
+static inline CC_HINT(always_inline) void kafka_wakeup(proto_kafka_consumer_thread_t *thread)
+{
+	if ((write(thread->pipe[1], "1", 1) < 0) && (errno != EAGAIN)) {
+		ERROR("%s - Failed writing to wakeup pipe: %s", thread->name, fr_syserror(errno));
+	}
+}
+
+static inline CC_HINT(always_inline) void kafka_wakeup_drain(proto_kafka_consumer_thread_t *thread)
+{
+	uint8_t buffer[64];
+
+	while (read(thread->pipe[0], buffer, sizeof(buffer)) > 0);
+}
+
+/** Whether we can read any more messages
+ *
+ */
+static inline CC_HINT(always_inline) bool kafka_full(proto_kafka_consumer_thread_t const *thread)
+{
+	return (thread->outstanding >= thread->inst->parent->max_outstanding) ||
+	       (thread->pending >= thread->inst->parent->max_pending);
+}
+
+static void kafka_pause(proto_kafka_consumer_thread_t *thread)
+{
+	if (thread->paused || !kafka_full(thread)) return;
+
+	(void) fr_event_filter_update(thread->el, thread->pipe[0], FR_EVENT_FILTER_IO, pause_read);
+	thread->paused = true;
+}
+
+static void kafka_resume(proto_kafka_consumer_thread_t *thread)
+{
+	if (!thread->paused || kafka_full(thread)) return;
+
+	(void) fr_event_filter_update(thread->el, thread->pipe[0], FR_EVENT_FILTER_IO, resume_read);
+	thread->paused = false;
+
+	/*
+	 *	There may be messages waiting in librdkafka's queue,
+	 *	which it's already told us about.
+	 */
+	kafka_wakeup(thread);
+}
+
+static int _kafka_entry_free(kafka_entry_t *track)
+{
+	fr_dlist_remove(&track->partition->pending, track);
+	if (fr_dlist_in_list(&track->thread->retry, track)) fr_dlist_remove(&track->thread->retry, track);
+
+	/*
+	 *	Freed by the network side without being written.
+	 */
+	if (!track->done) track->thread->outstanding--;
+	track->thread->pending--;
+
+	if (track->msg) rd_kafka_message_destroy(track->msg);
+	return 0;
+}
+
+/** Store the offset of the last message in a partition which has finished processing
+ *
+ * Messages are processed in parallel, and can finish in any order.  We
+ * can only store an offset once every message before it has also finished,
+ * otherwise a restart would skip messages which were never processed.
+ */
+static void kafka_partition_store(proto_kafka_consumer_thread_t *thread, kafka_partition_t *partition)
+{
+	kafka_entry_t			*track, *next;
+	int64_t				offset = -1;
+	rd_kafka_topic_partition_list_t	*offsets;
+	rd_kafka_resp_err_t		err;
+
+	/*
+	 *	Another consumer now owns the partition, and will
+	 *	read these messages again.  Nothing can be stored,
+	 *	so finished messages don't need to wait for earlier
+	 *	ones.
+	 */
+	if (partition->revoked) {
+		for (track = fr_dlist_head(&partition->pending); track; track = next) {
+			next = fr_dlist_next(&partition->pending, track);
+			if (track->done) talloc_free(track);
+		}
+
+		if (fr_dlist_empty(&partition->pending)) talloc_free(partition);
+		return;
+	}
+
+	while ((track = fr_dlist_head(&partition->pending)) && track->done) {
+		offset = track->offset;
+		talloc_free(track);
+	}
+
+	if (offset < 0) return;
+
+	/*
+	 *	The stored offset is the next message we want to read.
+	 */
+	offsets = rd_kafka_topic_partition_list_new(1);
+	rd_kafka_topic_partition_list_add(offsets, partition->topic, partition->partition)->offset = offset + 1;
+
+	/*
+	 *	This fails if the partition has been assigned to
+	 *	another consumer.  The messages will be processed
+	 *	again there.
+	 */
+	err = rd_kafka_offsets_store(thread->rk, offsets);
+	if (err == RD_KAFKA_RESP_ERR_NO_ERROR) err = offsets->elems[0].err;
+	if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+		DEBUG("%s - Failed storing offset %" PRId64 " for %s [%d]: %s",
+		      thread->name, offset, partition->topic, partition->partition, rd_kafka_err2str(err));
+	}
+
+	rd_kafka_topic_partition_list_destroy(offsets);
+}
+
+/** Mark a message as finished, and store any offsets which that unblocks
+ *
+ * The message is destroyed here, as it may wait a long time in the pending
+ * list for an earlier message to finish.  The entry may also be freed.
+ */
+static void kafka_entry_done(kafka_entry_t *track)
+{
+	track->done = true;
+	rd_kafka_message_destroy(track->msg);
+	track->msg = NULL;
+
+	kafka_partition_store(track->thread, track->partition);
+}
+
+/** Stop tracking partitions which have been assigned to another consumer
+ *
+ * Offsets can only be stored for partitions we own, so the stored offsets are
+ * committed now.  Messages which are waiting to be retried are abandoned, and
+ * ones which are still being processed are forgotten once they finish.
+ */
+static void kafka_partitions_revoke(proto_kafka_consumer_thread_t *thread, rd_kafka_t *rk,
+				    rd_kafka_topic_partition_list_t const *revoked)
+{
+	rd_kafka_resp_err_t	err;
+	int			i;
+
+	/*
+	 *	If the assignment was lost, e.g. because we didn't
+	 *	talk to the group coordinator in time, the partitions
+	 *	may already belong to someone else, and the commit
+	 *	would fail.
+	 */
+	if (!rd_kafka_assignment_lost(rk)) {
+		err = rd_kafka_commit(rk, NULL, 0);
+		if ((err != RD_KAFKA_RESP_ERR_NO_ERROR) && (err != RD_KAFKA_RESP_ERR__NO_OFFSET)) {
+			ERROR("%s - Failed committing offsets for revoked partitions: %s",
+			      thread->name, rd_kafka_err2str(err));
+		}
+	}
+
+	/*
+	 *	Called from rd_kafka_consumer_close(), after the
+	 *	messages have already been freed.
+	 */
+	if (!thread->partitions) return;
+
+	for (i = 0; i < revoked->cnt; i++) {
+		kafka_partition_t	*partition;
+		kafka_entry_t		*track;
+
+		partition = fr_rb_find(thread->partitions, &(kafka_partition_t){
+				.topic = revoked->elems[i].topic,
+				.partition = revoked->elems[i].partition
+			});
+		if (!partition) continue;
+
+		DEBUG("%s - Partition %s [%d] revoked with %u messages pending",
+		      thread->name, partition->topic, partition->partition,
+		      fr_dlist_num_elements(&partition->pending));
+
+		/*
+		 *	If the partition is assigned back to us,
+		 *	its messages are tracked from scratch.
+		 */
+		fr_rb_remove_by_inline_node(thread->partitions, &partition->node);
+		partition->revoked = true;
+
+		for (track = fr_dlist_head(&partition->pending); track; track = fr_dlist_next(&partition->pending, track)) {
+			if (track->done) continue;
+
+			if (fr_dlist_in_list(&thread->retry, track)) {
+				fr_dlist_remove(&thread->retry, track);
+			} else if (track->ev && fr_timer_armed(track->ev)) {
+				(void) fr_timer_delete(&track->ev);
+			} else {
+				continue;
+			}
+
+			thread->outstanding--;
+			track->done = true;
+			rd_kafka_message_destroy(track->msg);
+			track->msg = NULL;
+		}
+
+		kafka_partition_store(thread, partition);
+	}
+
+	kafka_resume(thread);
+}
+
+/** Handle partitions being assigned to, or revoked from, this consumer
+ *
+ * This is called by librdkafka from within rd_kafka_consumer_poll(), so it
+ * runs in the same thread as everything else.
+ */
+static void kafka_rebalance(rd_kafka_t *rk, rd_kafka_resp_err_t err, rd_kafka_topic_partition_list_t *partitions,
+			    void *uctx)
+{
+	proto_kafka_consumer_thread_t	*thread = talloc_get_type_abort(uctx, proto_kafka_consumer_thread_t);
+	char const			*protocol = rd_kafka_rebalance_protocol(rk);
+	bool				cooperative = protocol && (strcmp(protocol, "COOPERATIVE") == 0);
+	rd_kafka_error_t		*error = NULL;
+	rd_kafka_resp_err_t		ret = RD_KAFKA_RESP_ERR_NO_ERROR;
+
+	switch (err) {
+	case RD_KAFKA_RESP_ERR__ASSIGN_PARTITIONS:
+		DEBUG("%s - %d partitions assigned", thread->name, partitions->cnt);
+
+		if (cooperative) {
+			error = rd_kafka_incremental_assign(rk, partitions);
+		} else {
+			ret = rd_kafka_assign(rk, partitions);
+		}
+		break;
+
+	case RD_KAFKA_RESP_ERR__REVOKE_PARTITIONS:
+		DEBUG("%s - %d partitions revoked", thread->name, partitions->cnt);
+
+		kafka_partitions_revoke(thread, rk, partitions);
+
+		if (cooperative) {
+			error = rd_kafka_incremental_unassign(rk, partitions);
+		} else {
+			ret = rd_kafka_assign(rk, NULL);
+		}
+		break;
+
+	default:
+		ERROR("%s - Rebalance failed: %s", thread->name, rd_kafka_err2str(err));
+		ret = rd_kafka_assign(rk, NULL);
+		break;
+	}
+
+	if (error) {
+		ERROR("%s - Failed updating partition assignment: %s", thread->name, rd_kafka_error_string(error));
+		rd_kafka_error_destroy(error);
+	} else if (ret != RD_KAFKA_RESP_ERR_NO_ERROR) {
+		ERROR("%s - Failed updating partition assignment: %s", thread->name, rd_kafka_err2str(ret));
+	}
+}
+
+/*
+ *	All of the decoding is done by proto_kafka.c
+ */
+static int mod_decode(void const *instance, request_t *request, UNUSED uint8_t *const data, UNUSED size_t data_len)
+{
+	proto_kafka_consumer_t const	*inst = talloc_get_type_abort_const(instance, proto_kafka_consumer_t);
+	kafka_entry_t const		*track = talloc_get_type_abort_const(request->async->packet_ctx, kafka_entry_t);
+	fr_pair_t			*vp;
+
+	request->client = inst->client;
+
+	request->packet->id = track->id;
+	request->reply->id = track->id;
+	REQUEST_VERIFY(request);
+
+	MEM(pair_update_request(&vp, attr_packet_transmit_counter) >= 0);
+	vp->vp_uint32 = track->retry.count;
+
+	return 0;
+}
+
+static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time_p, uint8_t *buffer, size_t buffer_len, size_t *leftover)
+{
+	proto_kafka_consumer_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_kafka_consumer_t);
+	proto_kafka_consumer_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_kafka_consumer_thread_t);
+	rd_kafka_message_t		*msg;
+	kafka_entry_t			*track;
+	kafka_partition_t		*partition;
+	bool				drained = false;
+
+	fr_assert(*leftover == 0);
+
+	/*
+	 *	Process retries before anything else.
+	 */
+	track = fr_dlist_pop_head(&thread->retry);
+	if (track) {
+		fr_assert(buffer_len >= track->msg->len);
+		memcpy(buffer, track->msg->payload, track->msg->len);
+
+		DEBUG("%s - Retrying message %u (retransmission %u)", thread->name, track->id, track->retry.count);
+		kafka_pause(thread);
+
+		*packet_ctx = track;
+		*recv_time_p = track->timestamp;
+		return track->msg->len;
+	}
+
+	/*
+	 *	Once a socket is ready, the network side tries to read
+	 *	many packets.  So if we want to stop it from reading,
+	 *	we have to check this ourselves.
+	 */
+	if (kafka_full(thread)) {
+		kafka_pause(thread);
+		return 0;
+	}
+
+redo:
+	msg = rd_kafka_consumer_poll(thread->rk, 0);
+	if (!msg) {
+		/*
+		 *	The queue is empty.  Drain the pipe, and check
+		 *	again, in case a message arrived after we
+		 *	polled, but before we drained the pipe.
+		 */
+		if (drained) return 0;
+
+		kafka_wakeup_drain(thread);
+		drained = true;
+		goto redo;
+	}
+
+	if (msg->err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+		if (msg->err != RD_KAFKA_RESP_ERR__PARTITION_EOF) {
+			ERROR("%s - Consumer error: %s", thread->name, rd_kafka_message_errstr(msg));
+		}
+		rd_kafka_message_destroy(msg);
+		goto redo;
+	}
+
+	partition = fr_rb_find(thread->partitions, &(kafka_partition_t){
+			.topic = rd_kafka_topic_name(msg->rkt),
+			.partition = msg->partition
+		});
+	if (!partition) {
+		MEM(partition = talloc_zero(thread->partitions, kafka_partition_t));
+		partition->topic = talloc_strdup(partition, rd_kafka_topic_name(msg->rkt));
+		partition->partition = msg->partition;
+		fr_dlist_init(&partition->pending, kafka_entry_t, pending_entry);
+		fr_rb_insert(thread->partitions, partition);
+	}
+
+	/*
+	 *	Messages are returned in offset order, so appending
+	 *	them keeps the pending list sorted.
+	 */
+	MEM(track = talloc_zero(partition, kafka_entry_t));
+	track->thread = thread;
+	track->partition = partition;
+	track->msg = msg;
+	track->offset = msg->offset;
+	track->id = thread->count++;
+	track->timestamp = fr_time();
+	fr_dlist_entry_init(&track->retry_entry);
+	fr_dlist_insert_tail(&partition->pending, track);
+	talloc_set_destructor(track, _kafka_entry_free);
+	thread->pending++;
+
+	/*
+	 *	Too big, or empty?  Ignore it, but still let the
+	 *	offset advance past it.
+	 */
+	if (!msg->len || (msg->len > buffer_len) || (msg->len > inst->parent->max_packet_size)) {
+		DEBUG("%s - Ignoring message at offset %" PRId64 " of %s [%d] with size %zu",
+		      thread->name, msg->offset, partition->topic, partition->partition, msg->len);
+		kafka_entry_done(track);
+		if (kafka_full(thread)) {
+			kafka_pause(thread);
+			return 0;
+		}
+		goto redo;
+	}
+
+	memcpy(buffer, msg->payload, msg->len);
+
+	thread->outstanding++;
+
+	/*
+	 *	Pause reading until such time as we need more messages.
+	 */
+	kafka_pause(thread);
+
+	*packet_ctx = track;
+	*recv_time_p = track->timestamp;
+	return msg->len;
+}
+
+static void kafka_retry(UNUSED fr_timer_list_t *tl, UNUSED fr_time_t now, void *uctx)
+{
+	kafka_entry_t			*track = talloc_get_type_abort(uctx, kafka_entry_t);
+	proto_kafka_consumer_thread_t	*thread = track->thread;
+
+	DEBUG("%s - retrying message %u", thread->name, track->id);
+
+	fr_dlist_insert_tail(&thread->retry, track);
+
+	/*
+	 *	The message is still counted as outstanding, so we
+	 *	may be paused.  mod_read() returns retries before
+	 *	checking the limit, so it's safe to resume.
+	 */
+	if (thread->paused) {
+		(void) fr_event_filter_update(thread->el, thread->pipe[0], FR_EVENT_FILTER_IO, resume_read);
+		thread->paused = false;
+	}
+
+	kafka_wakeup(thread);
+}
+
+static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
+			 uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
+{
+	proto_kafka_consumer_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_kafka_consumer_t);
+	proto_kafka_consumer_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_kafka_consumer_thread_t);
+	kafka_entry_t			*track = talloc_get_type_abort(packet_ctx, kafka_entry_t);
+
+	if (buffer_len < 1) return -1;
+
+	fr_assert(thread->outstanding > 0);
+
+	if (!buffer[0]) {
+		/*
+		 *	The new owner of the partition will process
+		 *	the message again.
+		 */
+		if (track->partition->revoked) {
+			DEBUG("%s - message %u failed, but its partition has been revoked - not retrying",
+			      thread->name, track->id);
+			goto done;
+		}
+
+		if (fr_time_eq(track->retry.start, fr_time_wrap(0))) {
+			fr_retry_init(&track->retry, fr_time(), &inst->parent->retry_config);
+		} else {
+			fr_retry_state_t state;
+
+			state = fr_retry_next(&track->retry, fr_time());
+			if (state == FR_RETRY_MRC) {
+				ERROR("%s - message %u failed after %u retransmissions - skipping it",
+				      thread->name, track->id, track->retry.count);
+				goto done;
+			}
+
+			if (state == FR_RETRY_MRD) {
+				ERROR("%s - message %u failed after %u seconds - skipping it",
+				      thread->name, track->id,
+				      (unsigned int) fr_time_delta_to_sec(inst->parent->retry_config.mrd));
+				goto done;
+			}
+		}
+
+		DEBUG("%s - message %u failed during processing.  Will retry in %.6fs",
+		      thread->name, track->id, fr_time_delta_unwrap(track->retry.rt) / (double)NSEC);
+
+		/*
+		 *	The message is still outstanding, and blocks
+		 *	the offset for its partition until it succeeds.
+		 */
+		if (fr_timer_at(track, thread->el->tl, &track->ev,
+				track->retry.next, false, kafka_retry, track) < 0) {
+			ERROR("%s - Failed inserting retry timer", thread->name);
+			goto done;
+		}
+
+		return buffer_len;
+	}
+
+done:
+	thread->outstanding--;
+	kafka_entry_done(track);
+
+	/*
+	 *	If we need to read some more messages, let's do so.
+	 */
+	kafka_resume(thread);
+
+	return buffer_len;
+}
+
+/** Close a Kafka consumer
+ *
+ * Any offsets which have been stored are committed before the consumer
+ * leaves the group.
+ */
+static void kafka_consumer_stop(proto_kafka_consumer_thread_t *thread)
+{
+	/*
+	 *	Messages must be destroyed before the handle.
+	 */
+	TALLOC_FREE(thread->partitions);
+
+	if (thread->rk) {
+		rd_kafka_consumer_close(thread->rk);
+		rd_kafka_destroy(thread->rk);
+		thread->rk = NULL;
+	}
+
+	if (thread->pipe[0] >= 0) close(thread->pipe[0]);
+	if (thread->pipe[1] >= 0) close(thread->pipe[1]);
+	thread->pipe[0] = thread->pipe[1] = -1;
+}
+
+/** Create a consumer, and subscribe to the configured topics
+ *
+ * @param[in] thread	to initialise.  thread->inst must be set.
+ * @param[in] conf	for the consumer.  Consumed, even on error.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure, with the error in fr_strerror.
+ */
+static int kafka_consumer_start(proto_kafka_consumer_thread_t *thread, rd_kafka_conf_t *conf)
+{
+	proto_kafka_consumer_t const	*inst = thread->inst;
+	rd_kafka_topic_partition_list_t	*topics;
+	rd_kafka_resp_err_t		err;
+	char				errstr[512];
+	size_t				i;
+
+	thread->pipe[0] = thread->pipe[1] = -1;
+	fr_dlist_init(&thread->retry, kafka_entry_t, retry_entry);
+	MEM(thread->partitions = fr_rb_inline_talloc_alloc(thread, kafka_partition_t, node, kafka_partition_cmp, NULL));
+
+	/*
+	 *	We store offsets ourselves, once processing has
+	 *	finished.
+	 */
+	if (rd_kafka_conf_set(conf, "enable.auto.offset.store", "false", errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+		fr_strerror_printf("Failed configuring consumer: %s", errstr);
+		rd_kafka_conf_destroy(conf);
+		return -1;
+	}
+
+	/*
+	 *	So that offsets can be committed, and pending
+	 *	messages forgotten, when partitions are revoked.
+	 */
+	rd_kafka_conf_set_opaque(conf, thread);
+	rd_kafka_conf_set_rebalance_cb(conf, kafka_rebalance);
+
+	thread->rk = rd_kafka_new(RD_KAFKA_CONSUMER, conf, errstr, sizeof(errstr));
+	if (!thread->rk) {
+		fr_strerror_printf("Failed creating consumer: %s", errstr);
+		rd_kafka_conf_destroy(conf);
+		return -1;
+	}
+
+	/*
+	 *	Everything comes through the consumer queue, so there
+	 *	is only one thing to watch.
+	 */
+	rd_kafka_poll_set_consumer(thread->rk);
+
+	if (pipe(thread->pipe) < 0) {
+		fr_strerror_printf("Failed creating wakeup pipe: %s", fr_syserror(errno));
+	error:
+		kafka_consumer_stop(thread);
+		return -1;
+	}
+
+	if ((fr_nonblock(thread->pipe[0]) < 0) || (fr_nonblock(thread->pipe[1]) < 0)) {
+		fr_strerror_const_push("Failed setting wakeup pipe to non-blocking");
+		goto error;
+	}
+
+	{
+		rd_kafka_queue_t *queue;
+
+		queue = rd_kafka_queue_get_consumer(thread->rk);
+		rd_kafka_queue_io_event_enable(queue, thread->pipe[1], "1", 1);
+		rd_kafka_queue_destroy(queue);
+	}
+
+	topics = rd_kafka_topic_partition_list_new(talloc_array_length(inst->topics));
+	for (i = 0; i < talloc_array_length(inst->topics); i++) {
+		rd_kafka_topic_partition_list_add(topics, inst->topics[i], RD_KAFKA_PARTITION_UA);
+	}
+
+	err = rd_kafka_subscribe(thread->rk, topics);
+	rd_kafka_topic_partition_list_destroy(topics);
+	if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+		fr_strerror_printf("Failed subscribing to topics: %s", rd_kafka_err2str(err));
+		goto error;
+	}
+
+	thread->name = talloc_typed_asprintf(thread, "kafka_consumer %s", rd_kafka_name(thread->rk));
+
+	return 0;
+}
+
+/** Open a Kafka consumer
+ *
+ */
+static int mod_open(fr_listen_t *li)
+{
+	proto_kafka_consumer_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_kafka_consumer_t);
+	proto_kafka_consumer_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_kafka_consumer_thread_t);
+	rd_kafka_conf_t			*conf;
+
+	thread->inst = inst;
+
+	conf = kafka_base_conf_dup(inst->cs);
+	if (!conf) {
+		cf_log_err(inst->cs, "No kafka configuration found");
+		return -1;
+	}
+
+	if (kafka_consumer_start(thread, conf) < 0) {
+		cf_log_perr(inst->cs, "Failed opening consumer");
+		return -1;
+	}
+
+	li->fd = thread->pipe[0];
+
+	/*
+	 *	We never write to the pipe from the network side, so
+	 *	there's no need to wait for it to become writable.
+	 *
+	 *	The code in src/lib/io/network.c will call the
+	 *	mod_write() callback on any write, even if the
+	 *	listener is marked "read_only"
+	 */
+	li->no_write_callback = true;
+
+	return 0;
+}
+
+static int mod_close(fr_listen_t *li)
+{
+	kafka_consumer_stop(talloc_get_type_abort(li->thread_instance, proto_kafka_consumer_thread_t));
+
+	return 0;
+}
+
+/** Set the event list for a new IO instance
+ *
+ * @param[in] li the listener
+ * @param[in] el the event list
+ * @param[in] nr context from the network side
+ */
+static void mod_event_list_set(fr_listen_t *li, fr_event_list_t *el, UNUSED void *nr)
+{
+	proto_kafka_consumer_thread_t *thread = talloc_get_type_abort(li->thread_instance, proto_kafka_consumer_thread_t);
+
+	thread->el = el;
+}
+
+static char const *mod_name(fr_listen_t *li)
+{
+	proto_kafka_consumer_thread_t *thread = talloc_get_type_abort(li->thread_instance, proto_kafka_consumer_thread_t);
+
+	return thread->name;
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	proto_kafka_consumer_t	*inst = talloc_get_type_abort(mctx->mi->data, proto_kafka_consumer_t);
+	CONF_SECTION		*conf = mctx->mi->conf;
+	CONF_SECTION		*topics, *cs;
+	fr_client_t		*client;
+	size_t			num = 0;
+
+	inst->parent = talloc_get_type_abort(mctx->mi->parent->data, proto_kafka_t);
+	inst->cs = conf;
+
+	/*
+	 *	topic {
+	 *		<name> {
+	 *			...
+	 *		}
+	 *	}
+	 */
+	topics = cf_section_find(conf, "topic", NULL);
+	if (topics) {
+		for (cs = cf_section_first(topics); cs; cs = cf_section_next(topics, cs)) num++;
+	}
+
+	if (!num) {
+		cf_log_err(conf, "At least one topic must be configured");
+		return -1;
+	}
+
+	MEM(inst->topics = talloc_array(inst, char const *, num));
+	num = 0;
+	for (cs = cf_section_first(topics); cs; cs = cf_section_next(topics, cs)) {
+		inst->topics[num++] = cf_section_name1(cs);
+	}
+
+	MEM(client = inst->client = talloc_zero(inst, fr_client_t));
+
+	client->ipaddr.af = AF_INET;
+	client->ipaddr.addr.v4.s_addr = htonl(INADDR_NONE);
+	client->src_ipaddr = client->ipaddr;
+
+	client->longname = client->shortname = client->secret = inst->topics[0];
+	client->nas_type = talloc_strdup(client, "other");
+
+	return 0;
+}
+
+extern fr_app_io_t proto_kafka_consumer;
+fr_app_io_t proto_kafka_consumer = {
+	.common = {
+		.magic			= MODULE_MAGIC_INIT,
+		.name			= "kafka_consumer",
+		.config			= kafka_base_consumer_config,
+		.inst_size		= sizeof(proto_kafka_consumer_t),
+		.thread_inst_size	= sizeof(proto_kafka_consumer_thread_t),
+		.instantiate		= mod_instantiate
+	},
+	.default_message_size	= 65536,
+	.default_reply_size	= 32,
+
+	.open			= mod_open,
+	.close			= mod_close,
+	.read			= mod_read,
+	.decode			= mod_decode,
+	.write			= mod_write,
+	.event_list_set		= mod_event_list_set,
+	.get_name		= mod_name,
+};
@@ -0,0 +1,15 @@
+#  This needs to be cleared explicitly, as the libfreeradius-kafka.mk
+#  might not always be available, and the TARGETNAME from the previous
+#  target may stick around.
+TARGETNAME=
+-include $(top_builddir)/src/lib/kafka/all.mk
+
+ifneq "${TARGETNAME}" ""
+  TARGETNAME	:= proto_kafka_consumer
+  TARGET	:= $(TARGETNAME)$(L)
+endif
+
+SOURCES		:= proto_kafka_consumer.c
+
+SRC_CFLAGS	+= -I$(top_builddir)/lib/kafka
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-kafka$(L)
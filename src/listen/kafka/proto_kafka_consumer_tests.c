@@ -0,0 +1,480 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the Kafka consumer transport
+ *
+ * Messages are produced to librdkafka's mock cluster, and then read and
+ * "processed" by calling mod_read() and mod_write() directly, as the
+ * network side would.
+ *
+ * @file src/listen/kafka/proto_kafka_consumer_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <librdkafka/rdkafka_mock.h>
+
+/*
+ *	Include the source, so the tests can look at the
+ *	pending lists.
+ */
+#include "proto_kafka_consumer.c"
+
+static TALLOC_CTX		*autofree;
+static rd_kafka_t		*producer;		//!< which owns the mock cluster.
+static char const		*bootstraps;		//!< of the mock cluster.
+
+static void test_init(void)
+{
+	rd_kafka_conf_t		*conf;
+	rd_kafka_mock_cluster_t	*mcluster;
+	char			errstr[512];
+
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("proto_kafka_consumer_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_time_start() < 0) goto error;
+
+	/*
+	 *	The producer creates the mock cluster, and then
+	 *	uses it.
+	 */
+	conf = rd_kafka_conf_new();
+	if (rd_kafka_conf_set(conf, "test.mock.num.brokers", "1", errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+	rk_error:
+		fr_strerror_printf("%s", errstr);
+		rd_kafka_conf_destroy(conf);
+		goto error;
+	}
+
+	producer = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+	if (!producer) goto rk_error;
+
+	mcluster = rd_kafka_handle_mock_cluster(producer);
+	if (!mcluster) {
+		fr_strerror_const("Failed creating mock cluster");
+		goto error;
+	}
+	bootstraps = rd_kafka_mock_cluster_bootstraps(mcluster);
+
+	if ((rd_kafka_mock_topic_create(mcluster, "consume", 1, 1) != RD_KAFKA_RESP_ERR_NO_ERROR) ||
+	    (rd_kafka_mock_topic_create(mcluster, "commit", 1, 1) != RD_KAFKA_RESP_ERR_NO_ERROR) ||
+	    (rd_kafka_mock_topic_create(mcluster, "retry", 1, 1) != RD_KAFKA_RESP_ERR_NO_ERROR) ||
+	    (rd_kafka_mock_topic_create(mcluster, "pending", 1, 1) != RD_KAFKA_RESP_ERR_NO_ERROR) ||
+	    (rd_kafka_mock_topic_create(mcluster, "rebalance", 1, 1) != RD_KAFKA_RESP_ERR_NO_ERROR)) {
+		fr_strerror_const("Failed creating mock topics");
+		goto error;
+	}
+}
+
+/** Produce messages to a topic, and wait for them to be delivered
+ *
+ */
+static void test_produce(char const *topic, char const **values, size_t num)
+{
+	size_t i;
+
+	for (i = 0; i < num; i++) {
+		TEST_CHECK(rd_kafka_producev(producer,
+					     RD_KAFKA_V_TOPIC(topic),
+					     RD_KAFKA_V_PARTITION(0),
+					     RD_KAFKA_V_VALUE(UNCONST(char *, values[i]), strlen(values[i])),
+					     RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+					     RD_KAFKA_V_END) == RD_KAFKA_RESP_ERR_NO_ERROR);
+	}
+
+	TEST_CHECK(rd_kafka_flush(producer, 10000) == RD_KAFKA_RESP_ERR_NO_ERROR);
+}
+
+static void test_fd_read(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, UNUSED void *uctx)
+{
+}
+
+/** Create a consumer for one topic, in a group of its own
+ *
+ */
+static fr_listen_t *test_consumer_alloc(char const *topic, uint32_t max_outstanding, uint32_t max_pending)
+{
+	fr_listen_t			*li;
+	proto_kafka_t			*parent;
+	proto_kafka_consumer_t		*inst;
+	proto_kafka_consumer_thread_t	*thread;
+	rd_kafka_conf_t			*conf;
+	char				errstr[512];
+
+	MEM(li = talloc_zero(autofree, fr_listen_t));
+
+	MEM(parent = talloc_zero(li, proto_kafka_t));
+	parent->max_packet_size = 4096;
+	parent->max_outstanding = max_outstanding;
+	parent->max_pending = max_pending;
+	parent->retry_config = (fr_retry_config_t) {
+		.irt = fr_time_delta_from_msec(10),
+		.mrt = fr_time_delta_from_msec(10),
+		.mrc = 3
+	};
+
+	MEM(inst = talloc_zero(li, proto_kafka_consumer_t));
+	inst->parent = parent;
+	MEM(inst->topics = talloc_array(inst, char const *, 1));
+	inst->topics[0] = topic;
+
+	MEM(thread = talloc_zero(li, proto_kafka_consumer_thread_t));
+	thread->inst = inst;
+	MEM(thread->el = fr_event_list_alloc(thread, NULL, NULL));
+
+	li->app_io_instance = inst;
+	li->thread_instance = thread;
+
+	conf = rd_kafka_conf_new();
+	TEST_CHECK(rd_kafka_conf_set(conf, "bootstrap.servers", bootstraps, errstr, sizeof(errstr)) == RD_KAFKA_CONF_OK);
+	TEST_CHECK(rd_kafka_conf_set(conf, "group.id", topic, errstr, sizeof(errstr)) == RD_KAFKA_CONF_OK);
+	TEST_CHECK(rd_kafka_conf_set(conf, "auto.offset.reset", "earliest", errstr, sizeof(errstr)) == RD_KAFKA_CONF_OK);
+
+	if (!TEST_CHECK(kafka_consumer_start(thread, conf) == 0)) {
+		TEST_MSG("%s", fr_strerror());
+		return NULL;
+	}
+
+	/*
+	 *	So that pausing and resuming has something to act on.
+	 */
+	TEST_CHECK(fr_event_fd_insert(thread, NULL, thread->el, thread->pipe[0], test_fd_read, NULL, NULL, NULL) == 0);
+
+	return li;
+}
+
+static void test_consumer_free(fr_listen_t *li)
+{
+	proto_kafka_consumer_thread_t *thread = talloc_get_type_abort(li->thread_instance, proto_kafka_consumer_thread_t);
+
+	(void) fr_event_fd_delete(thread->el, thread->pipe[0], FR_EVENT_FILTER_IO);
+	kafka_consumer_stop(thread);
+	talloc_free(li);
+}
+
+/** Read the next message, waiting for the consumer to join the group if necessary
+ *
+ */
+static ssize_t test_read(fr_listen_t *li, kafka_entry_t **track, uint8_t *buffer, size_t buffer_len)
+{
+	void		*packet_ctx = NULL;
+	fr_time_t	recv_time;
+	size_t		leftover = 0;
+	ssize_t		slen = 0;
+	int		i;
+
+	for (i = 0; i < 1000; i++) {
+		slen = mod_read(li, &packet_ctx, &recv_time, buffer, buffer_len, &leftover);
+		if (slen != 0) break;
+		usleep(10000);
+	}
+
+	*track = packet_ctx;
+	return slen;
+}
+
+/** Finish processing a message, as the network side does when the request is done
+ *
+ */
+static void test_write(fr_listen_t *li, kafka_entry_t *track, bool success)
+{
+	uint8_t code = success ? 1 : 0;
+
+	TEST_CHECK(mod_write(li, track, fr_time(), &code, sizeof(code), 0) == sizeof(code));
+}
+
+/** Commit the stored offsets, and return what the broker has for partition 0
+ *
+ */
+static int64_t test_committed(fr_listen_t *li, char const *topic)
+{
+	proto_kafka_consumer_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_kafka_consumer_thread_t);
+	rd_kafka_topic_partition_list_t	*parts;
+	int64_t				offset;
+
+	/*
+	 *	Fails with "no offset" if nothing has been stored,
+	 *	which is fine.
+	 */
+	(void) rd_kafka_commit(thread->rk, NULL, 0);
+
+	parts = rd_kafka_topic_partition_list_new(1);
+	rd_kafka_topic_partition_list_add(parts, topic, 0);
+
+	if (rd_kafka_committed(thread->rk, parts, 10000) != RD_KAFKA_RESP_ERR_NO_ERROR) {
+		offset = -2;
+	} else {
+		offset = parts->elems[0].offset;
+	}
+	rd_kafka_topic_partition_list_destroy(parts);
+
+	return offset;
+}
+
+static void test_consume(void)
+{
+	char const			*values[] = { "one", "two", "three" };
+	fr_listen_t			*li;
+	proto_kafka_consumer_thread_t	*thread;
+	kafka_entry_t			*track[3];
+	uint8_t				buffer[4096];
+	size_t				i;
+	ssize_t				slen;
+
+	test_produce("consume", values, NUM_ELEMENTS(values));
+
+	li = test_consumer_alloc("consume", 64, 4096);
+	TEST_ASSERT(li != NULL);
+	thread = li->thread_instance;
+
+	TEST_CASE("Messages are read in order");
+	for (i = 0; i < NUM_ELEMENTS(values); i++) {
+		slen = test_read(li, &track[i], buffer, sizeof(buffer));
+		TEST_CHECK_SLEN(slen, (ssize_t)strlen(values[i]));
+		TEST_ASSERT(track[i] != NULL);
+		TEST_CHECK(memcmp(buffer, values[i], strlen(values[i])) == 0);
+		TEST_CHECK(track[i]->offset == (int64_t)i);
+		TEST_CHECK(track[i]->msg != NULL);
+	}
+	TEST_CHECK(thread->outstanding == 3);
+	TEST_CHECK(thread->pending == 3);
+
+	TEST_CASE("Finishing every message empties the pending list");
+	for (i = 0; i < NUM_ELEMENTS(values); i++) test_write(li, track[i], true);
+	TEST_CHECK(thread->outstanding == 0);
+	TEST_CHECK(thread->pending == 0);
+
+	test_consumer_free(li);
+}
+
+static void test_commit(void)
+{
+	char const			*values[] = { "one", "two", "three" };
+	fr_listen_t			*li;
+	proto_kafka_consumer_thread_t	*thread;
+	kafka_entry_t			*track[3];
+	uint8_t				buffer[4096];
+	size_t				i;
+
+	test_produce("commit", values, NUM_ELEMENTS(values));
+
+	li = test_consumer_alloc("commit", 64, 4096);
+	TEST_ASSERT(li != NULL);
+	thread = li->thread_instance;
+
+	for (i = 0; i < NUM_ELEMENTS(values); i++) {
+		TEST_CHECK(test_read(li, &track[i], buffer, sizeof(buffer)) > 0);
+		TEST_ASSERT(track[i] != NULL);
+	}
+
+	TEST_CASE("Later messages finishing first don't move the offset");
+	test_write(li, track[2], true);
+	test_write(li, track[1], true);
+	TEST_CHECK(thread->outstanding == 1);
+	TEST_CHECK(thread->pending == 3);
+	TEST_CHECK(test_committed(li, "commit") == RD_KAFKA_OFFSET_INVALID);
+
+	TEST_CASE("Finished messages are destroyed, and only their offsets are kept");
+	TEST_CHECK(track[1]->done && !track[1]->msg && (track[1]->offset == 1));
+	TEST_CHECK(track[2]->done && !track[2]->msg && (track[2]->offset == 2));
+
+	TEST_CASE("Finishing the first message commits past all of them");
+	test_write(li, track[0], true);
+	TEST_CHECK(thread->pending == 0);
+	TEST_CHECK(test_committed(li, "commit") == 3);
+
+	test_consumer_free(li);
+}
+
+static void test_retry(void)
+{
+	char const			*values[] = { "retry" };
+	fr_listen_t			*li;
+	proto_kafka_consumer_thread_t	*thread;
+	kafka_entry_t			*track, *retried;
+	uint8_t				buffer[4096];
+	fr_time_t			when;
+
+	test_produce("retry", values, NUM_ELEMENTS(values));
+
+	li = test_consumer_alloc("retry", 64, 4096);
+	TEST_ASSERT(li != NULL);
+	thread = li->thread_instance;
+
+	TEST_CHECK(test_read(li, &track, buffer, sizeof(buffer)) == 5);
+	TEST_ASSERT(track != NULL);
+
+	TEST_CASE("A failed message is kept, and blocks the offset");
+	test_write(li, track, false);
+	TEST_CHECK(!track->done);
+	TEST_CHECK(track->msg != NULL);
+	TEST_CHECK(thread->outstanding == 1);
+	TEST_CHECK(fr_dlist_num_elements(&thread->retry) == 0);
+	TEST_CHECK(test_committed(li, "retry") == RD_KAFKA_OFFSET_INVALID);
+
+	TEST_CASE("The retry timer queues the message again");
+	when = fr_time_add(fr_time(), fr_time_delta_from_sec(1));
+	TEST_CHECK(fr_timer_list_run(thread->el->tl, &when) == 1);
+	TEST_CHECK(fr_dlist_num_elements(&thread->retry) == 1);
+
+	TEST_CASE("The retry is read before anything else");
+	memset(buffer, 0, sizeof(buffer));
+	TEST_CHECK(test_read(li, &retried, buffer, sizeof(buffer)) == 5);
+	TEST_CHECK(retried == track);
+	TEST_CHECK(memcmp(buffer, "retry", 5) == 0);
+	TEST_CHECK(track->retry.count == 1);
+
+	TEST_CASE("Succeeding on the retry commits the offset");
+	test_write(li, track, true);
+	TEST_CHECK(thread->outstanding == 0);
+	TEST_CHECK(thread->pending == 0);
+	TEST_CHECK(test_committed(li, "retry") == 1);
+
+	test_consumer_free(li);
+}
+
+static void test_pending(void)
+{
+	char const			*values[] = { "zero", "one", "two", "three" };
+	fr_listen_t			*li;
+	proto_kafka_consumer_thread_t	*thread;
+	kafka_entry_t			*track[4];
+	uint8_t				buffer[4096];
+	void				*packet_ctx = NULL;
+	fr_time_t			recv_time;
+	size_t				leftover = 0;
+
+	test_produce("pending", values, NUM_ELEMENTS(values));
+
+	li = test_consumer_alloc("pending", 2, 3);
+	TEST_ASSERT(li != NULL);
+	thread = li->thread_instance;
+
+	TEST_CASE("Reading pauses at max_outstanding");
+	TEST_CHECK(test_read(li, &track[0], buffer, sizeof(buffer)) > 0);
+	TEST_CHECK(test_read(li, &track[1], buffer, sizeof(buffer)) > 0);
+	TEST_CHECK(thread->paused);
+	TEST_CHECK(mod_read(li, &packet_ctx, &recv_time, buffer, sizeof(buffer), &leftover) == 0);
+
+	TEST_CASE("Finishing a message resumes reading");
+	test_write(li, track[1], true);
+	TEST_CHECK(!thread->paused);
+	TEST_CHECK(thread->pending == 2);
+
+	TEST_CHECK(test_read(li, &track[2], buffer, sizeof(buffer)) > 0);
+	TEST_CHECK(track[2]->offset == 2);
+
+	TEST_CASE("Reading pauses at max_pending, while an earlier message is still being processed");
+	test_write(li, track[2], true);
+	TEST_CHECK(thread->outstanding == 1);
+	TEST_CHECK(thread->pending == 3);
+	TEST_CHECK(thread->paused);
+	TEST_CHECK(mod_read(li, &packet_ctx, &recv_time, buffer, sizeof(buffer), &leftover) == 0);
+
+	TEST_CASE("Finishing the earliest message resumes reading");
+	test_write(li, track[0], true);
+	TEST_CHECK(thread->pending == 0);
+	TEST_CHECK(!thread->paused);
+
+	TEST_CHECK(test_read(li, &track[3], buffer, sizeof(buffer)) > 0);
+	TEST_CHECK(track[3]->offset == 3);
+	test_write(li, track[3], true);
+
+	test_consumer_free(li);
+}
+
+static void test_rebalance(void)
+{
+	char const			*values[] = { "zero", "one", "two" };
+	fr_listen_t			*li;
+	proto_kafka_consumer_thread_t	*thread;
+	kafka_entry_t			*track[3];
+	uint8_t				buffer[4096];
+	rd_kafka_topic_partition_list_t	*revoked;
+	uint64_t			timers;
+	size_t				i;
+
+	test_produce("rebalance", values, NUM_ELEMENTS(values));
+
+	li = test_consumer_alloc("rebalance", 64, 4096);
+	TEST_ASSERT(li != NULL);
+	thread = li->thread_instance;
+
+	for (i = 0; i < NUM_ELEMENTS(values); i++) {
+		TEST_CHECK(test_read(li, &track[i], buffer, sizeof(buffer)) > 0);
+		TEST_ASSERT(track[i] != NULL);
+	}
+
+	/*
+	 *	The first message finishes, the second is waiting
+	 *	to be retried, and the third is still being
+	 *	processed.
+	 */
+	test_write(li, track[0], true);
+	test_write(li, track[1], false);
+	TEST_CHECK(thread->outstanding == 2);
+	TEST_CHECK(thread->pending == 2);
+	timers = fr_timer_list_num_events(thread->el->tl);
+
+	/*
+	 *	As librdkafka would, when another consumer joins
+	 *	the group and is given the partition.
+	 */
+	revoked = rd_kafka_topic_partition_list_new(1);
+	rd_kafka_topic_partition_list_add(revoked, "rebalance", 0);
+	kafka_rebalance(thread->rk, RD_KAFKA_RESP_ERR__REVOKE_PARTITIONS, revoked, thread);
+	rd_kafka_topic_partition_list_destroy(revoked);
+
+	TEST_CASE("The stored offset is committed when the partition is revoked");
+	TEST_CHECK(test_committed(li, "rebalance") == 1);
+
+	TEST_CASE("The partition is no longer tracked");
+	TEST_CHECK(fr_rb_num_elements(thread->partitions) == 0);
+
+	TEST_CASE("The message waiting to be retried is abandoned");
+	TEST_CHECK(thread->outstanding == 1);
+	TEST_CHECK(thread->pending == 1);
+	TEST_CHECK(fr_timer_list_num_events(thread->el->tl) == timers - 1);
+
+	TEST_CASE("The message being processed isn't retried, and its offset isn't stored");
+	test_write(li, track[2], false);
+	TEST_CHECK(thread->outstanding == 0);
+	TEST_CHECK(thread->pending == 0);
+	TEST_CHECK(test_committed(li, "rebalance") == 1);
+
+	test_consumer_free(li);
+}
+
+TEST_LIST = {
+	{ "consume",	test_consume },
+	{ "commit",	test_commit },
+	{ "retry",	test_retry },
+	{ "pending",	test_pending },
+	{ "rebalance",	test_rebalance },
+
+	{ NULL }
+};
@@ -0,0 +1,19 @@
+#
+#  As with proto_kafka_consumer.mk, libfreeradius-kafka may not be
+#  available, so clear TARGETNAME before including its makefile.
+#
+TARGETNAME=
+-include $(top_builddir)/src/lib/kafka/all.mk
+
+ifneq "${TARGETNAME}" ""
+  TARGET	:= proto_kafka_consumer_tests$(E)
+endif
+
+SOURCES		:= proto_kafka_consumer_tests.c
+
+SRC_CFLAGS	+= -I$(top_builddir)/lib/kafka
+TGT_LDLIBS	+= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-server$(L) libfreeradius-kafka$(L)
+
+TGT_INSTALLDIR	:=
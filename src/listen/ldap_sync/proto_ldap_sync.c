@@ -44,6 +44,10 @@ static conf_parser_t const ldap_sync_search_config[] = {
 	/* For persistent search directories, setting this to "no" will load the whole directory. */
 	{ FR_CONF_OFFSET("changes_only", sync_config_t, changes_only), .dflt = "yes" },
 
+	/* Keep a local copy of the entries, which rlm_ldap can search instead of the directory. */
+	{ FR_CONF_OFFSET("replica", sync_config_t, replica_name) },
+	{ FR_CONF_OFFSET("replica_key", sync_config_t, replica_key) },
+
 	CONF_PARSER_TERMINATOR
 };
 
@@ -317,6 +321,29 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		sync_conf->attrs = talloc_array(sync_conf, char const *, 1);
 		sync_conf->attrs[0] = NULL;
 
+		/*
+		 *	Replicas hold complete entries, so request all
+		 *	user attributes, and the key explicitly in case
+		 *	it's operational.
+		 */
+		if (sync_conf->replica_name) {
+			if (!sync_conf->replica_key) {
+				cf_log_err(sync_cs, "'replica_key' must be set when 'replica' is set");
+				return -1;
+			}
+
+			sync_conf->replica = fr_ldap_replica_get(sync_conf->replica_name);
+			if (!sync_conf->replica) {
+			replica_error:
+				cf_log_perr(sync_cs, "Failed configuring LDAP replica");
+				return -1;
+			}
+			if (fr_ldap_replica_key_set(sync_conf->replica, sync_conf->replica_key) < 0) goto replica_error;
+
+			ldap_sync_conf_attr_add(sync_conf, "*");
+			ldap_sync_conf_attr_add(sync_conf, sync_conf->replica_key);
+		}
+
 		if (map_list_empty(&sync_conf->entry_map)) {
 			cf_log_warn(conf, "LDAP sync specified without update map");
 			continue;
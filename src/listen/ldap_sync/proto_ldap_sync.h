@@ -25,6 +25,7 @@
  */
 #include <freeradius-devel/io/master.h>
 #include <freeradius-devel/ldap/base.h>
+#include <freeradius-devel/ldap/replica.h>
 #include <freeradius-devel/ldap/sync.h>
 
 typedef struct sync_config_s sync_config_t;
@@ -129,6 +130,10 @@ struct sync_config_s {
 
 	char const		*root_dn;		//!< The root DN for the directory.
 
+	char const		*replica_name;		//!< Name of the local replica to maintain.
+	char const		*replica_key;		//!< Attribute the replica is indexed by.
+	fr_ldap_replica_t	*replica;		//!< Local replica, updated as changes are received.
+
 	CONF_SECTION		*cs;			//!< Config section where this sync was defined.
 							//!< Used for logging.
 
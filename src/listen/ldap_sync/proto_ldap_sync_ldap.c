@@ -508,7 +508,52 @@ int ldap_sync_entry_send(sync_state_t *sync, uint8_t const uuid[SYNC_UUID_LENGTH
 
 	if (fr_dlist_insert_tail(&sync->pending, sync_packet_ctx) < 0) goto error;
 
-	ldap_msgfree(msg);
+	/*
+	 *	Keep the local replica in step with the directory.
+	 *	The replica takes ownership of the message.
+	 */
+	if (sync->config->replica) {
+		fr_ldap_replica_t *replica = sync->config->replica;
+
+		if (orig_dn && (orig_dn->bv_len > 0)) {
+			char *dn = talloc_bstrndup(NULL, orig_dn->bv_val, orig_dn->bv_len);
+
+			fr_ldap_replica_delete(replica, NULL, dn);
+			talloc_free(dn);
+		}
+
+		switch (op) {
+		/*
+		 *	Present entries are sent without attributes, they
+		 *	only tell us the entry is unchanged.
+		 */
+		case SYNC_OP_PRESENT:
+			if (uuid) fr_ldap_replica_present(replica, uuid);
+			break;
+
+		case SYNC_OP_DELETE:
+			if (msg) {
+				char *entry_dn = ldap_get_dn(fr_ldap_handle_thread_local(), msg);
+
+				fr_ldap_replica_delete(replica, uuid, entry_dn);
+				if (entry_dn) ldap_memfree(entry_dn);
+			} else {
+				fr_ldap_replica_delete(replica, uuid, NULL);
+			}
+			break;
+
+		default:
+			if (!msg) break;
+
+			if (fr_ldap_replica_update(replica, uuid, msg) < 0) {
+				PERROR("Failed updating LDAP replica");
+			}
+			msg = NULL;
+			break;
+		}
+	}
+
+	if (msg) ldap_msgfree(msg);
 
 	/*
 	 *	Send the packet and if it fails to send add a retry event
@@ -99,6 +99,12 @@ int rfc4533_sync_init(fr_ldap_connection_t *conn, size_t sync_no, proto_ldap_syn
 
 	sync = sync_state_alloc(tree, conn, inst, sync_no, config);
 
+	/*
+	 *	Entries which aren't sent during this refresh's
+	 *	present phase are removed from the replica.
+	 */
+	if (config->replica) fr_ldap_replica_refresh_start(config->replica);
+
 	/*
 	 *	Might not necessarily have a cookie
 	 */
@@ -549,6 +555,17 @@ int rfc4533_sync_intermediate(sync_state_t *sync, LDAPMessage *msg, UNUSED LDAPC
 			goto error;
 		}
 
+		/*
+		 *	Every entry still matching the sync has now been
+		 *	sent, or marked present.  Anything else in the
+		 *	replica has gone.
+		 */
+		if (sync->config->replica) {
+			uint32_t removed = fr_ldap_replica_refresh_present_done(sync->config->replica);
+
+			if (removed) DEBUG2("Removed %u entries not present in the directory from replica", removed);
+		}
+
 		if (refresh_done) sync->phase = SYNC_PHASE_DONE;
 		break;
 
@@ -778,5 +795,14 @@ int rfc4533_sync_refresh_required(sync_state_t *sync, LDAPMessage *msg, LDAPCont
 		new_cookie = true;
 	}
 
+	/*
+	 *	Changes may have been missed, so the replica can't be
+	 *	trusted until the restarted sync has refreshed it.
+	 */
+	if (sync->config->replica) {
+		DEBUG2("Flushing replica until the refresh completes");
+		fr_ldap_replica_flush(sync->config->replica);
+	}
+
 	return ldap_sync_cookie_store(sync, true);
 }
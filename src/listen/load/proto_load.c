@@ -32,6 +32,7 @@
 extern fr_app_t proto_load;
 static int type_parse(TALLOC_CTX *ctx, void *out, UNUSED void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
 static int transport_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
+static int priority_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule);
 
 /** How to parse a Load listen section
  *
@@ -53,11 +54,32 @@ static conf_parser_t const proto_load_config[] = {
 	{ FR_CONF_OFFSET("max_packet_size", proto_load_t, max_packet_size) } ,
 	{ FR_CONF_OFFSET("num_messages", proto_load_t, num_messages) } ,
 
-	{ FR_CONF_OFFSET("priority", proto_load_t, priority) },
+	{ FR_CONF_OFFSET("priority", proto_load_t, priority),
+	  .func = priority_parse, .uctx = &(cf_table_parse_ctx_t){ .table = channel_packet_priority, .len = &channel_packet_priority_len }, .dflt = "normal" },
 
 	CONF_PARSER_TERMINATOR
 };
 
+/** Parse a priority, either as one of the named priorities, or as a number
+ *
+ * @param[in] ctx	to allocate data in.
+ * @param[out] out	Where to write the priority.
+ * @param[in] parent	Base structure address.
+ * @param[in] ci	#CONF_PAIR specifying the priority.
+ * @param[in] rule	containing the table of named priorities.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int priority_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, conf_parser_t const *rule)
+{
+	char const *value = cf_pair_value(cf_item_to_pair(ci));
+
+	if (value && isdigit((uint8_t) *value)) return cf_pair_parse_value(ctx, out, parent, ci, rule);
+
+	return cf_table_parse_uint32(ctx, out, parent, ci, rule);
+}
+
 /** Translates the packet-type into a submodule name
  *
  * @param[in] ctx	to allocate data in (instance of proto_load).
@@ -264,6 +286,18 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	return fr_master_app_io.common.instantiate(MODULE_INST_CTX(inst->io.mi));
 }
 
+/** Set the priority of generated packets
+ *
+ * This lets the load generator exercise the network and worker
+ * admission control with a mix of high and low priority traffic.
+ */
+static int mod_priority_set(void const *instance, UNUSED uint8_t const *buffer, UNUSED size_t buflen)
+{
+	proto_load_t const *inst = talloc_get_type_abort_const(instance, proto_load_t);
+
+	return inst->priority;
+}
+
 fr_app_t proto_load = {
 	.common = {
 		.magic			= MODULE_MAGIC_INIT,
@@ -276,4 +310,5 @@ fr_app_t proto_load = {
 	.open			= mod_open,
 	.decode			= mod_decode,
 	.encode			= mod_encode,
+	.priority		= mod_priority_set
 };
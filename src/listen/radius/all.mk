@@ -1,4 +1,5 @@
 SUBMAKEFILES := \
 	proto_radius.mk \
 	proto_radius_udp.mk \
-	proto_radius_tcp.mk
+	proto_radius_tcp.mk \
+	proto_radius_tls.mk
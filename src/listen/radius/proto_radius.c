@@ -102,6 +102,8 @@ static conf_parser_t const proto_radius_config[] = {
 	  .uctx = &(cf_table_parse_ctx_t){ .table = fr_radius_limit_proxy_state_table, .len = &fr_radius_limit_proxy_state_table_len },
 	  .dflt = "auto" },
 
+	{ FR_CONF_OFFSET("lazy_decode", proto_radius_t, lazy_decode) } ,
+
 	CONF_PARSER_TERMINATOR
 };
 
@@ -184,6 +186,16 @@ static int transport_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *
 	return 0;
 }
 
+/** Log errors in Vendor-Specific attributes which were decoded after the packet
+ *
+ */
+static void mod_decode_lazy_error(void *uctx)
+{
+	request_t *request = talloc_get_type_abort(uctx, request_t);
+
+	RPERROR("Failed decoding Vendor-Specific attributes, some attributes will be missing");
+}
+
 /** Decode the packet
  *
  */
@@ -248,6 +260,12 @@ static int mod_decode(void const *instance, request_t *request, uint8_t *const d
 	request->packet->data = talloc_memdup(request->packet, data, data_len);
 	request->packet->data_len = data_len;
 
+	/*
+	 *	The copy lives as long as the request, so any
+	 *	Vendor-Specific attributes can be decoded from it later.
+	 */
+	if (inst->lazy_decode) decode_ctx.lazy_packet = request->packet->data;
+
 	/*
 	 *	!client->active means a fake packet defining a dynamic client - so there will
 	 *	be no secret defined yet - so can't verify.
@@ -260,6 +278,18 @@ static int mod_decode(void const *instance, request_t *request, uint8_t *const d
 	}
 	talloc_free(decode_ctx.tmp_ctx);
 
+	/*
+	 *	The pairs are decoded by whatever first uses them,
+	 *	which won't report errors, so we do.
+	 */
+	if (inst->lazy_decode) fr_pair_list_lazy_error_set(&request->request_pairs, mod_decode_lazy_error, request);
+
+	/*
+	 *	So that rlm_radius knows whether it can forward
+	 *	the packet as-is, or whether policy edited it.
+	 */
+	request->packet->pairs_generation = request->request_pairs.generation;
+
 	/*
 	 *	Set the rest of the fields.
 	 */
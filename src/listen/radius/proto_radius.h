@@ -45,4 +45,7 @@ typedef struct {
 	fr_radius_require_ma_t		require_message_authenticator;			//!< Require Message-Authenticator in all requests.
 	fr_radius_limit_proxy_state_t	limit_proxy_state;		//!< Limit Proxy-State to packets containing
 									///< Message-Authenticator.
+
+	bool				lazy_decode;			//!< Decode Vendor-Specific attributes when
+									///< they're first used.
 } proto_radius_t;
@@ -0,0 +1,9 @@
+TARGETNAME	:= proto_radius_tls
+
+ifneq "$(OPENSSL_LIBS)" ""
+TARGET		:= $(TARGETNAME)$(L)
+endif
+
+SOURCES		:= proto_radius_tls.c
+
+TGT_PREREQS	:= libfreeradius-radius$(L) libfreeradius-bio-tls$(L) libfreeradius-tls$(L)
@@ -1 +1 @@
-SUBMAKEFILES := proto_tacacs.mk proto_tacacs_tcp.mk
+SUBMAKEFILES := proto_tacacs.mk proto_tacacs_tcp.mk proto_tacacs_tls.mk
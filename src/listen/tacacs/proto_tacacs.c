@@ -304,7 +304,7 @@ static ssize_t mod_encode(UNUSED void const *instance, request_t *request, uint8
 	size_t			secretlen = 0;
 
 	/*
-	 *	@todo - RFC 8907 Section 4.4. says:
+	 *	RFC 8907 Section 4.4. says:
 	 *
 	 *	  When the session is complete, the TCP connection should be handled as follows, according to
 	 *	  whether Single Connection Mode was negotiated:
@@ -320,6 +320,8 @@ static ssize_t mod_encode(UNUSED void const *instance, request_t *request, uint8
 	 *	   accepted on the connection. If there are any sessions that have already been established,
 	 *	   then they MAY be completed. Once all active sessions are completed, then the connection
 	 *	   MUST be closed.
+	 *
+	 *	The transport does this, as it sees all of the sessions on the connection.
 	 */
 
 	/*
@@ -390,6 +392,13 @@ static ssize_t mod_encode(UNUSED void const *instance, request_t *request, uint8
 
 	RHEXDUMP3(buffer, data_len, "proto_tacacs encode packet");
 
+	/*
+	 *	The status field of the reply is obfuscated, so the
+	 *	transport uses the code to decide when a session is
+	 *	complete.  The encoder sets the status from the code.
+	 */
+	track->reply_code = request->reply->code;
+
 	return data_len;
 }
 
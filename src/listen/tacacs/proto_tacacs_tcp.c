@@ -25,12 +25,13 @@
  */
 
 #include <netdb.h>
+#include <freeradius-devel/server/main_config.h>
 #include <freeradius-devel/server/protocol.h>
 #include <freeradius-devel/util/trie.h>
 #include <freeradius-devel/io/application.h>
 #include <freeradius-devel/io/listen.h>
 #include <freeradius-devel/io/schedule.h>
-#include "proto_tacacs.h"
+#include "session.h"
 
 extern fr_app_io_t proto_tacacs_tcp;
 
@@ -42,6 +43,8 @@ typedef struct {
 
 	fr_io_address_t			*connection;		//!< for connected sockets.
 
+	proto_tacacs_sessions_t		*sessions;		//!< sessions waiting for a reply.
+
 	fr_stats_t			stats;			//!< statistics for this socket
 } proto_tacacs_tcp_thread_t;
 
@@ -58,10 +61,13 @@ typedef struct {
 	uint32_t			max_packet_size;	//!< for message ring buffer.
 	uint32_t			max_attributes;		//!< Limit maximum decodable attributes.
 
+	uint32_t			max_sessions;		//!< Maximum number of pending sessions per connection.
+
 	uint16_t			port;			//!< Port to listen on.
 
 	bool				recv_buff_is_set;	//!< Whether we were provided with a recv_buff
 	bool				dynamic_clients;	//!< whether we have dynamic clients
+	bool				single_connect;		//!< whether we allow single connection mode.
 
 	fr_client_list_t		*clients;		//!< local clients
 
@@ -89,6 +95,8 @@ static const conf_parser_t tcp_listen_config[] = {
 	{ FR_CONF_OFFSET_IS_SET("recv_buff", FR_TYPE_UINT32, 0, proto_tacacs_tcp_t, recv_buff) },
 
 	{ FR_CONF_OFFSET("dynamic_clients", proto_tacacs_tcp_t, dynamic_clients) } ,
+	{ FR_CONF_OFFSET("single_connect", proto_tacacs_tcp_t, single_connect), .dflt = "yes" } ,
+	{ FR_CONF_OFFSET("max_sessions", proto_tacacs_tcp_t, max_sessions), .dflt = "64" } ,
 	{ FR_CONF_POINTER("networks", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) networks_config },
 
 	{ FR_CONF_OFFSET("max_packet_size", proto_tacacs_tcp_t, max_packet_size), .dflt = "4096" } ,
@@ -130,6 +138,7 @@ static ssize_t mod_read(fr_listen_t *li, UNUSED void **packet_ctx, fr_time_t *re
 	ssize_t				data_size, packet_len;
 	size_t				in_buffer;
 
+redo:
 	/*
 	 *	We may have read multiple packets in the previous read.  In which case the buffer may already
 	 *	have packets remaining.  In that case, we can return packets directly from the buffer, and
@@ -149,6 +158,15 @@ static ssize_t mod_read(fr_listen_t *li, UNUSED void **packet_ctx, fr_time_t *re
 		 */
 	}
 
+	/*
+	 *	If the client has too many sessions waiting for a
+	 *	reply, then stop reading from the socket.  Packets
+	 *	which are already in the buffer are still returned
+	 *	above, as there may be no more data on the socket to
+	 *	wake us up.
+	 */
+	if (proto_tacacs_sessions_full(thread->sessions)) return 0;
+
 	/*
 	 *      Read data into the buffer.
 	 */
@@ -227,6 +245,16 @@ have_packet:
 	*leftover = in_buffer - packet_len;
 
 	*recv_time_p = fr_time();
+
+	/*
+	 *	Drop the packet from the buffer, and go look for
+	 *	another one.
+	 */
+	if (proto_tacacs_session_start(thread->sessions, buffer, *recv_time_p) < 0) {
+		if (*leftover) memmove(buffer, buffer + packet_len, *leftover);
+		goto redo;
+	}
+
 	thread->stats.total_requests++;
 
 	/*
@@ -255,10 +283,11 @@ have_packet:
 	return packet_len;
 }
 
-static ssize_t mod_write(fr_listen_t *li, UNUSED void *packet_ctx, UNUSED fr_time_t request_time,
+static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
 			 uint8_t *buffer, size_t buffer_len, size_t written)
 {
 	proto_tacacs_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tcp_thread_t);
+	fr_io_track_t			*track = talloc_get_type_abort(packet_ctx, fr_io_track_t);
 	ssize_t				data_size;
 
 	/*
@@ -278,6 +307,8 @@ static ssize_t mod_write(fr_listen_t *li, UNUSED void *packet_ctx, UNUSED fr_tim
 	 */
 	if (written == 0) {
 		thread->stats.total_responses++;
+
+		proto_tacacs_session_reply(thread->sessions, buffer);
 	}
 
 	/*
@@ -292,27 +323,7 @@ static ssize_t mod_write(fr_listen_t *li, UNUSED void *packet_ctx, UNUSED fr_tim
 	/*
 	 *	If we're supposed to close the socket, then go do that.
 	 */
-	if ((data_size + written) == buffer_len) {
-		fr_tacacs_packet_t const *pkt = (fr_tacacs_packet_t const *) buffer;
-
-		switch (pkt->hdr.type) {
-		case FR_TAC_PLUS_AUTHEN:
-			if (pkt->authen_reply.status == FR_TAC_PLUS_AUTHEN_STATUS_ERROR) goto close_it;
-			break;
-
-
-		case FR_TAC_PLUS_AUTHOR:
-			if (pkt->author_reply.status == FR_TAC_PLUS_AUTHOR_STATUS_ERROR) {
-			close_it:
-				DEBUG("Closing connection due to unrecoverable server error response");
-				return 0;
-			}
-			break;
-
-		default:
-			break;
-		}
-	}
+	if (((data_size + written) == buffer_len) && proto_tacacs_session_sent(thread->sessions, buffer, track->reply_code)) return 0;
 
 	/*
 	 *	Return the packet we wrote, plus any bytes previously
@@ -402,9 +413,23 @@ static int mod_fd_set(fr_listen_t *li, int fd)
 					     &inst->ipaddr, inst->port,
 					     inst->interface);
 
+	thread->sessions = proto_tacacs_sessions_alloc(thread, "proto_tacacs_tcp", thread->name, fd,
+						       inst->max_sessions, inst->single_connect);
+
 	return 0;
 }
 
+/** Set the event list for this socket
+ *
+ *  Connected sockets need it to pause and resume reads.
+ */
+static void mod_event_list_set(fr_listen_t *li, fr_event_list_t *el, UNUSED void *nr)
+{
+	proto_tacacs_tcp_thread_t *thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tcp_thread_t);
+
+	if (thread->sessions) thread->sessions->el = el;
+}
+
 static char const *mod_name(fr_listen_t *li)
 {
 	proto_tacacs_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tcp_thread_t);
@@ -438,6 +463,9 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 20);
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65536);
 
+	FR_INTEGER_BOUND_CHECK("max_sessions", inst->max_sessions, >=, 1);
+	FR_INTEGER_BOUND_CHECK("max_sessions", inst->max_sessions, <=, 65536);
+
 	if (!inst->port) {
 		struct servent *s;
 
@@ -530,6 +558,7 @@ fr_app_io_t proto_tacacs_tcp = {
 	.read			= mod_read,
 	.write			= mod_write,
 	.fd_set			= mod_fd_set,
+	.event_list_set		= mod_event_list_set,
 	.connection_set		= mod_connection_set,
 	.network_get		= mod_network_get,
 	.client_find		= mod_client_find,
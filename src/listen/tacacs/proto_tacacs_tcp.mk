@@ -4,6 +4,6 @@ ifneq "$(TARGETNAME)" ""
 TARGET		:= $(TARGETNAME)$(L)
 endif
 
-SOURCES		:= proto_tacacs_tcp.c
+SOURCES		:= proto_tacacs_tcp.c session.c
 
 TGT_PREREQS	:= libfreeradius-tacacs$(L)
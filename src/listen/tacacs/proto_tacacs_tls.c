@@ -0,0 +1,695 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file proto_tacacs_tls.c
+ * @brief TACACS+ handler for TLS.
+ *
+ * @copyright 2024 The FreeRADIUS server project.
+ */
+
+#include <netdb.h>
+#include <freeradius-devel/server/main_config.h>
+#include <freeradius-devel/server/protocol.h>
+#include <freeradius-devel/bio/tls.h>
+#include <freeradius-devel/tls/base.h>
+#include <freeradius-devel/util/trie.h>
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/io/schedule.h>
+#include "session.h"
+
+extern fr_app_io_t proto_tacacs_tls;
+
+#define TACACS_MAX_ATTRIBUTES 256
+
+typedef struct {
+	char const			*name;			//!< socket name
+	int				sockfd;
+
+	fr_bio_t			*tls_bio;		//!< TLS session for connected sockets.
+
+	fr_io_address_t			*connection;		//!< for connected sockets.
+
+	proto_tacacs_sessions_t		*sessions;		//!< sessions waiting for a reply.
+
+	fr_stats_t			stats;			//!< statistics for this socket
+} proto_tacacs_tls_thread_t;
+
+typedef struct {
+	CONF_SECTION			*cs;			//!< our configuration
+
+	fr_ipaddr_t			ipaddr;			//!< IP address to listen on.
+
+	char const			*interface;		//!< Interface to bind to.
+	char const			*port_name;		//!< Name of the port for getservent().
+
+	uint32_t			recv_buff;		//!< How big the kernel's receive buffer should be.
+
+	uint32_t			max_packet_size;	//!< for message ring buffer.
+	uint32_t			max_attributes;		//!< Limit maximum decodable attributes.
+
+	uint32_t			max_sessions;		//!< Maximum number of pending sessions per connection.
+
+	uint16_t			port;			//!< Port to listen on.
+
+	bool				recv_buff_is_set;	//!< Whether we were provided with a recv_buff
+	bool				dynamic_clients;	//!< whether we have dynamic clients
+	bool				single_connect;		//!< whether we allow single connection mode.
+	bool				ktls;			//!< try to use kernel TLS after the handshake.
+	bool				require_client_cert;	//!< fail the handshake if there's no client certificate.
+
+	fr_tls_conf_t			*tls_conf;		//!< TLS configuration.
+	SSL_CTX				*ssl_ctx;		//!< shared by all connections.
+
+	fr_client_list_t		*clients;		//!< local clients
+
+	fr_trie_t			*trie;			//!< for parsed networks
+	fr_ipaddr_t			*allow;			//!< allowed networks for dynamic clients
+	fr_ipaddr_t			*deny;			//!< denied networks for dynamic clients
+} proto_tacacs_tls_t;
+
+static const conf_parser_t networks_config[] = {
+	{ FR_CONF_OFFSET_TYPE_FLAGS("allow", FR_TYPE_COMBO_IP_PREFIX , CONF_FLAG_MULTI, proto_tacacs_tls_t, allow) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("deny", FR_TYPE_COMBO_IP_PREFIX , CONF_FLAG_MULTI, proto_tacacs_tls_t, deny) },
+
+	CONF_PARSER_TERMINATOR
+};
+
+static const conf_parser_t tls_listen_config[] = {
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipaddr", FR_TYPE_COMBO_IP_ADDR, 0, proto_tacacs_tls_t, ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv4addr", FR_TYPE_IPV4_ADDR, 0, proto_tacacs_tls_t, ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv6addr", FR_TYPE_IPV6_ADDR, 0, proto_tacacs_tls_t, ipaddr) },
+
+	{ FR_CONF_OFFSET("interface", proto_tacacs_tls_t, interface) },
+	{ FR_CONF_OFFSET("port_name", proto_tacacs_tls_t, port_name) },
+
+	{ FR_CONF_OFFSET("port", proto_tacacs_tls_t, port), .dflt = "300" },
+	{ FR_CONF_OFFSET_IS_SET("recv_buff", FR_TYPE_UINT32, 0, proto_tacacs_tls_t, recv_buff) },
+
+	{ FR_CONF_OFFSET("dynamic_clients", proto_tacacs_tls_t, dynamic_clients) } ,
+	{ FR_CONF_OFFSET("single_connect", proto_tacacs_tls_t, single_connect), .dflt = "yes" } ,
+	{ FR_CONF_OFFSET("max_sessions", proto_tacacs_tls_t, max_sessions), .dflt = "64" } ,
+	{ FR_CONF_OFFSET("ktls", proto_tacacs_tls_t, ktls), .dflt = "yes" },
+	{ FR_CONF_OFFSET("require_client_cert", proto_tacacs_tls_t, require_client_cert), .dflt = "yes" },
+	{ FR_CONF_POINTER("networks", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) networks_config },
+
+	{ FR_CONF_OFFSET("max_packet_size", proto_tacacs_tls_t, max_packet_size), .dflt = "4096" } ,
+	{ FR_CONF_OFFSET("max_attributes", proto_tacacs_tls_t, max_attributes), .dflt = STRINGIFY(TACACS_MAX_ATTRIBUTES) } ,
+
+	CONF_PARSER_TERMINATOR
+};
+
+static const char *packet_name[] = {
+	[FR_TAC_PLUS_AUTHEN] = "Authentication",
+	[FR_TAC_PLUS_AUTHOR] = "Authorization",
+	[FR_TAC_PLUS_ACCT] = "Accounting",
+};
+
+/** Read TACACS data from a TLS connection
+ *
+ * @param[in] li		representing a client connection.
+ * @param[in] packet_ctx	UNUSED.
+ * @param[out] recv_time_p	When we read the packet.
+ *				For some protocols we get this for free (but not here).
+ * @param[out] buffer		to read into.
+ * @param[in] buffer_len	Maximum length of the buffer.
+ * @param[in,out] leftover	If the previous read didn't yield a complete packet
+ *				we will have written how many bytes we read in leftover
+ *				and returned 0.  On the next call, we use the
+ *				value of leftover to offset the position we start
+ *				writing into the buffer.
+ *				*leftover must be subtracted from buffer_len when
+ *				calculating free space in the buffer.
+ * @return
+ *	- >0 when a packet was read successfully.
+ *	- 0 when we read a partial packet.
+ * 	- <0 on error (socket should be closed).
+ */
+static ssize_t mod_read(fr_listen_t *li, UNUSED void **packet_ctx, fr_time_t *recv_time_p,
+			uint8_t *buffer, size_t buffer_len, size_t *leftover)
+{
+	proto_tacacs_tls_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tls_thread_t);
+	ssize_t				data_size, packet_len;
+	size_t				in_buffer;
+
+redo:
+	/*
+	 *	We may have read multiple packets in the previous read.  In which case the buffer may already
+	 *	have packets remaining.  In that case, we can return packets directly from the buffer, and
+	 *	skip the read().
+	 */
+	if (*leftover >= FR_HEADER_LENGTH) {
+		packet_len = fr_tacacs_length(buffer, *leftover);
+		if (packet_len < 0) goto invalid;
+
+		if (packet_len <= ((ssize_t) *leftover)) {
+			data_size = 0;
+			goto have_packet;
+		}
+
+		/*
+		 *	Else we don't have a full packet, try to read more data from the network.
+		 */
+	}
+
+	/*
+	 *	If the client has too many sessions waiting for a
+	 *	reply, then stop reading from the socket.  Packets
+	 *	which are already in the buffer, or decrypted data
+	 *	which OpenSSL is holding, are still returned, as there
+	 *	may be no more data on the socket to wake us up.
+	 */
+	if (!SSL_pending(fr_bio_tls_ssl(thread->tls_bio)) && proto_tacacs_sessions_full(thread->sessions)) return 0;
+
+	/*
+	 *      Read data into the buffer.  The first reads also drive
+	 *      the TLS handshake, and return no data.
+	 */
+	data_size = fr_bio_read(thread->tls_bio, NULL, buffer + (*leftover), buffer_len - (*leftover));
+	if (data_size < 0) {
+		/*
+		 *	We didn't read any data leave the buffers alone.
+		 *
+		 *	i.e. if we had a partial packet in the buffer and we didn't read any data,
+		 *	then the partial packet is still left in the buffer.
+		 */
+		if (data_size == fr_bio_error(IO_WOULD_BLOCK)) return 0;
+
+		PERROR("proto_tacacs_tls got read error (%zd)", data_size);
+		return -1;
+	}
+
+	/*
+	 *	Note that we return ERROR for all bad packets, as
+	 *	there's no point in reading TACACS+ packets from a TLS
+	 *	connection which isn't sending us TACACS+ packets.
+	 */
+
+	/*
+	 *	A read of zero is either EOF, or the handshake is still
+	 *	in progress.
+	 */
+	if (!data_size) {
+		if (fr_bio_tls_info(thread->tls_bio)->eof) {
+			DEBUG2("proto_tacacs_tls - other side closed the socket.");
+			return -1;
+		}
+
+		return 0;
+	}
+
+have_packet:
+	/*
+	 *	Represents all the data we've read since we last
+	 *	decoded a complete packet.
+	 */
+	in_buffer = *leftover + data_size;
+
+	/*
+	 *	Figure out how big the complete TACACS packet should be.
+	 *	If we don't have enough data it'll likely come
+	 *	through in the next fragment.
+	 */
+	packet_len = fr_tacacs_length(buffer, in_buffer);
+	if (packet_len < 0) {
+	invalid:
+		PERROR("Invalid TACACS packet");
+		return -1;	/* Malformed, close the socket */
+	}
+
+	/*
+	 *	We don't have a complete TACACS+ packet.  Tell the
+	 *	caller that we need to read more, but record
+	 *	how much we read in leftover.
+	 */
+	if (in_buffer < (size_t) packet_len) {
+		DEBUG3("proto_tacacs_tls - Received packet fragment of %zu bytes (%zu bytes now pending)",
+		       packet_len, *leftover);
+		*leftover = in_buffer;
+		return 0;
+	}
+
+	/*
+	 *	We've read at least one packet.  Tell the caller that
+	 *	there's more data available, and return only one packet.
+	 */
+	*leftover = in_buffer - packet_len;
+
+	*recv_time_p = fr_time();
+
+	/*
+	 *	Drop the packet from the buffer, and go look for
+	 *	another one.
+	 */
+	if (proto_tacacs_session_start(thread->sessions, buffer, *recv_time_p) < 0) {
+		if (*leftover) memmove(buffer, buffer + packet_len, *leftover);
+		goto redo;
+	}
+
+	thread->stats.total_requests++;
+
+	/*
+	 *	proto_tacacs sets the priority
+	 */
+
+	/*
+	 *	Print out what we received.
+	 */
+	FR_PROTO_HEX_DUMP(buffer, packet_len, "tacacs_tls_recv");
+
+	if (DEBUG_ENABLED2) {
+		char bogus_type[4];
+		char const *type;
+
+		if (buffer[1] && buffer[1] <= FR_TAC_PLUS_ACCT) type = packet_name[buffer[1]];
+		else {
+			snprintf(bogus_type, sizeof(bogus_type), "%d", buffer[1]);
+			type = bogus_type;
+		}
+		DEBUG2("proto_tacacs_tls - Received %s seq_no %d length %zd %s",
+		       type, buffer[2],
+		       packet_len, thread->name);
+	}
+
+	return packet_len;
+}
+
+static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
+			 uint8_t *buffer, size_t buffer_len, size_t written)
+{
+	proto_tacacs_tls_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tls_thread_t);
+	fr_io_track_t			*track = talloc_get_type_abort(packet_ctx, fr_io_track_t);
+	ssize_t				data_size;
+
+	/*
+	 *	We only write TACACS packets.
+	 */
+	fr_assert(buffer_len >= sizeof(fr_tacacs_packet_hdr_t));
+	fr_assert(written < buffer_len);
+	fr_assert(buffer_len < (1 << 20)); /* shut up coverity */
+
+	if (written == 0) {
+		thread->stats.total_responses++;
+
+		proto_tacacs_session_reply(thread->sessions, buffer);
+	}
+
+	/*
+	 *	Only write replies if they're TACACS+ packets.
+	 *	sometimes we want to NOT send a reply...
+	 */
+	data_size = fr_bio_write(thread->tls_bio, NULL, buffer + written, buffer_len - written);
+	if (data_size < 0) {
+		/*
+		 *	The network side will retry the write with the
+		 *	same data when the socket becomes writable, which
+		 *	is what OpenSSL needs.
+		 */
+		if (data_size == fr_bio_error(IO_WOULD_BLOCK)) {
+			if (written) return written;
+
+			errno = EWOULDBLOCK;
+			return -1;
+		}
+
+		PERROR("proto_tacacs_tls got write error");
+		errno = EIO;
+		return -1;
+	}
+	if (!data_size) return 0;
+
+	fr_assert((size_t) data_size <= buffer_len); /* shut up coverity */
+
+	/*
+	 *	If we're supposed to close the socket, then go do that.
+	 */
+	if (((data_size + written) == buffer_len) && proto_tacacs_session_sent(thread->sessions, buffer, track->reply_code)) return 0;
+
+	/*
+	 *	Return the packet we wrote, plus any bytes previously
+	 *	left over from previous packets.
+	 */
+	/* coverity[return_overflow] */
+	return data_size + written;
+}
+
+static int mod_connection_set(fr_listen_t *li, fr_io_address_t *connection)
+{
+	proto_tacacs_tls_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tls_thread_t);
+
+	thread->connection = connection;
+
+	return 0;
+}
+
+static void mod_network_get(int *ipproto, bool *dynamic_clients, fr_trie_t const **trie, void *instance)
+{
+	proto_tacacs_tls_t *inst = talloc_get_type_abort(instance, proto_tacacs_tls_t);
+
+	*ipproto = IPPROTO_TCP;
+	*dynamic_clients = inst->dynamic_clients;
+	*trie = inst->trie;
+}
+
+/** Open a TLS listener for TACACS+
+ *
+ */
+static int mod_open(fr_listen_t *li)
+{
+	proto_tacacs_tls_t const       	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_tacacs_tls_t);
+	proto_tacacs_tls_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tls_thread_t);
+
+	int				sockfd;
+	fr_ipaddr_t			ipaddr = inst->ipaddr;
+	uint16_t			port = inst->port;
+
+	fr_assert(!thread->connection);
+
+	li->fd = sockfd = fr_socket_server_tcp(&inst->ipaddr, &port, inst->port_name, true);
+	if (sockfd < 0) {
+		PERROR("Failed opening TCP socket");
+	error:
+		return -1;
+	}
+
+	(void) fr_nonblock(sockfd);
+
+	if (fr_socket_bind(sockfd, inst->interface, &ipaddr, &port) < 0) {
+		close(sockfd);
+		PERROR("Failed binding socket");
+		goto error;
+	}
+
+	/*
+	 *	Clients tend to reconnect all at once, and each
+	 *	handshake takes a while.  Don't drop them.
+	 */
+	if (listen(sockfd, SOMAXCONN) < 0) {
+		close(sockfd);
+		PERROR("Failed listening on socket");
+		goto error;
+	}
+
+	thread->sockfd = sockfd;
+
+	fr_assert((cf_parent(inst->cs) != NULL) && (cf_parent(cf_parent(inst->cs)) != NULL));	/* listen { ... } */
+
+	thread->name = fr_app_io_socket_name(thread, &proto_tacacs_tls,
+					     NULL, 0,
+					     &inst->ipaddr, inst->port,
+					     inst->interface);
+
+	return 0;
+}
+
+
+/** Log the result of the TLS handshake.
+ *
+ */
+static void mod_tls_connected(fr_bio_t *bio)
+{
+	proto_tacacs_tls_thread_t	*thread = talloc_get_type_abort(bio->uctx, proto_tacacs_tls_thread_t);
+	fr_bio_tls_info_t const		*info = fr_bio_tls_info(bio);
+
+	DEBUG2("proto_tacacs_tls - %s negotiated %s with cipher %s, kernel TLS send %s, receive %s",
+	       thread->name, info->version, info->cipher,
+	       info->ktls_send ? "on" : "off", info->ktls_recv ? "on" : "off");
+}
+
+/** Set the file descriptor for this socket, and start the TLS session.
+ */
+static int mod_fd_set(fr_listen_t *li, int fd)
+{
+	proto_tacacs_tls_t const  *inst = talloc_get_type_abort_const(li->app_io_instance, proto_tacacs_tls_t);
+	proto_tacacs_tls_thread_t *thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tls_thread_t);
+	SSL			  *ssl;
+	int			  verify_mode = SSL_VERIFY_PEER;
+
+	thread->sockfd = fd;
+
+	thread->name = fr_app_io_socket_name(thread, &proto_tacacs_tls,
+					     &thread->connection->socket.inet.src_ipaddr, thread->connection->socket.inet.src_port,
+					     &inst->ipaddr, inst->port,
+					     inst->interface);
+
+	thread->tls_bio = fr_bio_tls_alloc(thread, inst->ssl_ctx, fd, inst->ktls,
+					   &(fr_bio_cb_funcs_t) { .connected = mod_tls_connected });
+	if (!thread->tls_bio) {
+		PERROR("Failed allocating TLS session for %s", thread->name);
+		return -1;
+	}
+	thread->tls_bio->uctx = thread;
+
+	thread->sessions = proto_tacacs_sessions_alloc(thread, "proto_tacacs_tls", thread->name, fd,
+						       inst->max_sessions, inst->single_connect);
+
+	/*
+	 *	There's no request during the handshake, so
+	 *	certificates are checked by OpenSSL alone.
+	 *	mod_instantiate() refuses configuration which
+	 *	needs more than that.
+	 */
+	ssl = fr_bio_tls_ssl(thread->tls_bio);
+	if (inst->require_client_cert) verify_mode |= SSL_VERIFY_FAIL_IF_NO_PEER_CERT;
+	SSL_set_verify(ssl, verify_mode, NULL);
+	SSL_set_ex_data(ssl, FR_TLS_EX_INDEX_CONF, UNCONST(fr_tls_conf_t *, inst->tls_conf));
+
+	return 0;
+}
+
+/** Set the event list for this socket
+ *
+ *  Connected sockets need it to pause and resume reads.
+ */
+static void mod_event_list_set(fr_listen_t *li, fr_event_list_t *el, UNUSED void *nr)
+{
+	proto_tacacs_tls_thread_t *thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tls_thread_t);
+
+	if (thread->sessions) thread->sessions->el = el;
+}
+
+static char const *mod_name(fr_listen_t *li)
+{
+	proto_tacacs_tls_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_tacacs_tls_thread_t);
+
+	return thread->name;
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	proto_tacacs_tls_t	*inst = talloc_get_type_abort(mctx->mi->data, proto_tacacs_tls_t);
+	CONF_SECTION		*conf = mctx->mi->conf;
+	size_t			num;
+	CONF_ITEM		*ci;
+	CONF_SECTION		*server_cs;
+
+	inst->cs = conf;
+
+	/*
+	 *	Complain if no "ipaddr" is set.
+	 */
+	if (inst->ipaddr.af == AF_UNSPEC) {
+		cf_log_err(conf, "No 'ipaddr' was specified in the 'tls' section");
+		return -1;
+	}
+
+	/*
+	 *	The TLS configuration is in the same section as the
+	 *	socket configuration.
+	 */
+	inst->tls_conf = fr_tls_conf_parse_server(conf);
+	if (!inst->tls_conf) {
+		cf_log_err(conf, "Failed parsing TLS configuration");
+		return -1;
+	}
+
+#ifdef PSK_MAX_IDENTITY_LEN
+	/*
+	 *	PSK lookups need a request, which doesn't exist
+	 *	during the handshake.
+	 */
+	if (inst->tls_conf->psk_identity || inst->tls_conf->psk_query) {
+		cf_log_err(conf, "PSK is not supported for TLS listeners");
+		return -1;
+	}
+#endif
+
+	/*
+	 *	Certificates are checked by OpenSSL alone, so
+	 *	anything which needs our verify callback, or a
+	 *	request to run policies in, can't be honoured.
+	 *	Refuse it, rather than silently accepting
+	 *	certificates the admin wanted to reject.
+	 */
+	if (inst->tls_conf->virtual_server) {
+		cf_log_err(conf, "'virtual_server' is not supported for TLS listeners, "
+			   "certificates can't be checked by policy");
+		return -1;
+	}
+
+	if (inst->tls_conf->verify.mode != FR_TLS_VERIFY_MODE_ALL) {
+		cf_log_err(conf, "verify { mode } must be \"all\" for TLS listeners");
+		return -1;
+	}
+
+	if (inst->tls_conf->verify.allow_expired_crl || inst->tls_conf->verify.allow_not_yet_valid_crl) {
+		cf_log_err(conf, "verify { allow_expired_crl } and verify { allow_not_yet_valid_crl } "
+			   "are not supported for TLS listeners");
+		return -1;
+	}
+
+	inst->ssl_ctx = fr_tls_ctx_alloc(inst->tls_conf, false);
+	if (!inst->ssl_ctx) {
+		cf_log_err(conf, "Failed creating TLS context");
+		return -1;
+	}
+
+	/*
+	 *	Stateful session resumption runs the "load session"
+	 *	and "store session" sections of a virtual server, which
+	 *	needs a request.  Session tickets still work.
+	 */
+	SSL_CTX_set_session_cache_mode(inst->ssl_ctx, SSL_SESS_CACHE_OFF);
+	SSL_CTX_sess_set_new_cb(inst->ssl_ctx, NULL);
+	SSL_CTX_sess_set_get_cb(inst->ssl_ctx, NULL);
+	SSL_CTX_sess_set_remove_cb(inst->ssl_ctx, NULL);
+
+#ifndef SSL_OP_ENABLE_KTLS
+	if (inst->ktls) {
+		cf_log_warn(conf, "OpenSSL was built without kernel TLS support.  Records will be encrypted by OpenSSL");
+		inst->ktls = false;
+	}
+#endif
+
+	if (inst->recv_buff_is_set) {
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, >=, 32);
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, <=, INT_MAX);
+	}
+
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 20);
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65536);
+
+	FR_INTEGER_BOUND_CHECK("max_sessions", inst->max_sessions, >=, 1);
+	FR_INTEGER_BOUND_CHECK("max_sessions", inst->max_sessions, <=, 65536);
+
+	if (!inst->port) {
+		struct servent *s;
+
+		if (!inst->port_name) {
+			cf_log_err(conf, "No 'port' was specified in the 'tls' section");
+			return -1;
+		}
+
+		s = getservbyname(inst->port_name, "tcp");
+		if (!s) {
+			cf_log_err(conf, "Unknown value for 'port_name = %s", inst->port_name);
+			return -1;
+		}
+
+		inst->port = ntohl(s->s_port);
+	}
+
+	/*
+	 *	Parse and create the trie for dynamic clients, even if
+	 *	there's no dynamic clients.
+	 */
+	num = talloc_array_length(inst->allow);
+	if (!num) {
+		if (inst->dynamic_clients) {
+			cf_log_err(conf, "The 'allow' subsection MUST contain at least one 'network' entry when 'dynamic_clients = true'.");
+			return -1;
+		}
+	} else {
+		inst->trie = fr_master_io_network(inst, inst->ipaddr.af, inst->allow, inst->deny);
+		if (!inst->trie) {
+			cf_log_perr(conf, "Failed creating list of networks");
+			return -1;
+		}
+	}
+
+	ci = cf_section_to_item(mctx->mi->parent->conf); /* listen { ... } */
+	fr_assert(ci != NULL);
+	ci = cf_parent(ci);
+	fr_assert(ci != NULL);
+
+	server_cs = cf_item_to_section(ci);
+
+	/*
+	 *	Look up local clients, if they exist.
+	 */
+	if (cf_section_find_next(server_cs, NULL, "client", CF_IDENT_ANY)) {
+		inst->clients = client_list_parse_section(server_cs, IPPROTO_TCP, false);
+		if (!inst->clients) {
+			cf_log_err(conf, "Failed creating local clients");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int mod_detach(module_detach_ctx_t const *mctx)
+{
+	proto_tacacs_tls_t	*inst = talloc_get_type_abort(mctx->mi->data, proto_tacacs_tls_t);
+
+	if (inst->ssl_ctx) SSL_CTX_free(inst->ssl_ctx);
+	inst->ssl_ctx = NULL;
+
+	return 0;
+}
+
+static fr_client_t *mod_client_find(fr_listen_t *li, fr_ipaddr_t const *ipaddr, int ipproto)
+{
+	proto_tacacs_tls_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_tacacs_tls_t);
+
+	/*
+	 *	Prefer local clients.
+	 */
+	if (inst->clients) {
+		fr_client_t *client;
+
+		client = client_find(inst->clients, ipaddr, ipproto);
+		if (client) return client;
+	}
+
+	return client_find(NULL, ipaddr, ipproto);
+}
+
+fr_app_io_t proto_tacacs_tls = {
+	.common = {
+		.magic			= MODULE_MAGIC_INIT,
+		.name			= "tacacs_tls",
+		.config			= tls_listen_config,
+		.inst_size		= sizeof(proto_tacacs_tls_t),
+		.thread_inst_size	= sizeof(proto_tacacs_tls_thread_t),
+		.instantiate		= mod_instantiate,
+		.detach			= mod_detach,
+	},
+	.default_message_size	= 4096,
+	.track_duplicates	= false,
+
+	.open			= mod_open,
+	.read			= mod_read,
+	.write			= mod_write,
+	.fd_set			= mod_fd_set,
+	.event_list_set		= mod_event_list_set,
+	.connection_set		= mod_connection_set,
+	.network_get		= mod_network_get,
+	.client_find		= mod_client_find,
+	.get_name		= mod_name,
+};
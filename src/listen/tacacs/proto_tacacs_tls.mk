@@ -0,0 +1,9 @@
+TARGETNAME	:= proto_tacacs_tls
+
+ifneq "$(OPENSSL_LIBS)" ""
+TARGET		:= $(TARGETNAME)$(L)
+endif
+
+SOURCES		:= proto_tacacs_tls.c session.c
+
+TGT_PREREQS	:= libfreeradius-tacacs$(L) libfreeradius-bio-tls$(L) libfreeradius-tls$(L)
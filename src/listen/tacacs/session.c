@@ -0,0 +1,318 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file src/listen/tacacs/session.c
+ * @brief TACACS+ session tracking for connected sockets.
+ *
+ * Tracks the sessions on a connection which are waiting for a reply,
+ * as described in RFC 8907 Section 4.3 and 4.4.  This handles single
+ * connection mode, pausing reads when a client has too many sessions
+ * pending, and closing the connection once its sessions are done.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/server/log.h>
+#include <freeradius-devel/server/main_config.h>
+
+#include "session.h"
+
+static fr_event_update_t const pause_read[] = {
+	FR_EVENT_SUSPEND(fr_event_io_func_t, read),
+	{ 0 }
+};
+
+static fr_event_update_t const resume_read[] = {
+	FR_EVENT_RESUME(fr_event_io_func_t, read),
+	{ 0 }
+};
+
+static int8_t session_cmp(void const *one, void const *two)
+{
+	proto_tacacs_session_t const *a = one, *b = two;
+
+	return CMP(a->session_id, b->session_id);
+}
+
+static void session_free(proto_tacacs_sessions_t *sessions, proto_tacacs_session_t *session)
+{
+	(void) fr_rb_remove_by_inline_node(sessions->tree, &session->node);
+	fr_dlist_remove(&sessions->pending, session);
+	talloc_free(session);
+}
+
+/** Forget sessions which will never get a reply
+ *
+ *  e.g. the request timed out, or the server decided not to respond.
+ */
+static void session_expire(proto_tacacs_sessions_t *sessions, fr_time_t now)
+{
+	proto_tacacs_session_t *session;
+
+	while ((session = fr_dlist_head(&sessions->pending)) != NULL) {
+		if (fr_time_gt(fr_time_add(session->recv_time, main_config->max_request_time), now)) break;
+
+		DEBUG3("%s - No reply was sent for session %08x on %s",
+		       sessions->log_prefix, ntohl(session->session_id), sessions->name);
+		session_free(sessions, session);
+	}
+}
+
+static void session_timer(fr_timer_list_t *tl, fr_time_t now, void *uctx);
+
+/** Stop reading from the socket, so that TCP pushes back on the client
+ *
+ *  The timer makes sure that we resume reading, even if the server
+ *  never replies to the oldest pending session.
+ */
+static void reader_pause(proto_tacacs_sessions_t *sessions)
+{
+	proto_tacacs_session_t *session = fr_dlist_head(&sessions->pending);
+
+	fr_assert(session != NULL);
+
+	if (!sessions->paused) {
+		DEBUG2("%s - %u sessions are pending on %s, pausing reads",
+		       sessions->log_prefix, fr_rb_num_elements(sessions->tree), sessions->name);
+
+		sessions->paused = true;
+		(void) fr_event_filter_update(sessions->el, sessions->sockfd, FR_EVENT_FILTER_IO, pause_read);
+	}
+
+	if (fr_timer_at(sessions, sessions->el->tl, &sessions->ev,
+			fr_time_add(session->recv_time, main_config->max_request_time),
+			false, session_timer, sessions) < 0) {
+		PERROR("%s - Failed adding timer for %s", sessions->log_prefix, sessions->name);
+	}
+}
+
+static void reader_resume(proto_tacacs_sessions_t *sessions)
+{
+	if (!sessions->paused) return;
+
+	DEBUG2("%s - Resuming reads on %s", sessions->log_prefix, sessions->name);
+
+	if (sessions->ev) (void) fr_timer_delete(&sessions->ev);
+
+	sessions->paused = false;
+	(void) fr_event_filter_update(sessions->el, sessions->sockfd, FR_EVENT_FILTER_IO, resume_read);
+}
+
+static void session_timer(UNUSED fr_timer_list_t *tl, fr_time_t now, void *uctx)
+{
+	proto_tacacs_sessions_t	*sessions = talloc_get_type_abort(uctx, proto_tacacs_sessions_t);
+
+	session_expire(sessions, now);
+
+	if (fr_rb_num_elements(sessions->tree) >= sessions->max_sessions) {
+		reader_pause(sessions);
+		return;
+	}
+
+	reader_resume(sessions);
+}
+
+/** Allocate the session tracking for a connection
+ *
+ * @param[in] ctx			to allocate in, usually the thread instance of the connection.
+ * @param[in] log_prefix		name of the transport, for debug messages.
+ * @param[in] name			of the connection.
+ * @param[in] sockfd			of the connection.
+ * @param[in] max_sessions		pause reads when this many sessions are waiting for a reply.
+ * @param[in] allow_single_connect	whether we agree to single connection mode.
+ * @return the session tracking.
+ */
+proto_tacacs_sessions_t *proto_tacacs_sessions_alloc(TALLOC_CTX *ctx, char const *log_prefix, char const *name, int sockfd,
+						     uint32_t max_sessions, bool allow_single_connect)
+{
+	proto_tacacs_sessions_t *sessions;
+
+	MEM(sessions = talloc_zero(ctx, proto_tacacs_sessions_t));
+	sessions->log_prefix = log_prefix;
+	sessions->name = name;
+	sessions->sockfd = sockfd;
+	sessions->max_sessions = max_sessions;
+	sessions->allow_single_connect = allow_single_connect;
+
+	MEM(sessions->tree = fr_rb_inline_talloc_alloc(sessions, proto_tacacs_session_t, node, session_cmp, NULL));
+	fr_dlist_talloc_init(&sessions->pending, proto_tacacs_session_t, entry);
+
+	return sessions;
+}
+
+/** See if the client has too many sessions waiting for a reply
+ *
+ *  If so, reads are paused until we reply to one of them.  Packets
+ *  which the transport has already read should still be returned, as
+ *  there may be no more data on the socket to wake us up.
+ *
+ * @return
+ *	- true if the transport should not read from the socket.
+ *	- false if it can read.
+ */
+bool proto_tacacs_sessions_full(proto_tacacs_sessions_t *sessions)
+{
+	if (!sessions->el || (fr_rb_num_elements(sessions->tree) < sessions->max_sessions)) return false;
+
+	session_expire(sessions, fr_time());
+
+	if (fr_rb_num_elements(sessions->tree) < sessions->max_sessions) return false;
+
+	reader_pause(sessions);
+	return true;
+}
+
+/** Record that a session is waiting for a reply
+ *
+ * @param[in] sessions	of the connection.
+ * @param[in] packet	which was read.
+ * @param[in] now	when the packet was read.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the packet should be discarded.
+ */
+int proto_tacacs_session_start(proto_tacacs_sessions_t *sessions, uint8_t const *packet, fr_time_t now)
+{
+	fr_tacacs_packet_t const	*pkt = (fr_tacacs_packet_t const *) packet;
+	proto_tacacs_session_t		*session;
+
+	/*
+	 *	RFC 8907 Section 4.4.  After an unrecoverable error,
+	 *	no new sessions are accepted on the connection.
+	 */
+	if (sessions->draining && (pkt->hdr.seq_no == 1)) {
+		DEBUG2("%s - Ignoring new session %08x on %s, as the connection is closing",
+		       sessions->log_prefix, ntohl(pkt->hdr.session_id), sessions->name);
+		return -1;
+	}
+
+	MEM(session = talloc_zero(sessions->tree, proto_tacacs_session_t));
+	session->session_id = pkt->hdr.session_id;
+	session->recv_time = now;
+
+	if (!fr_rb_insert(sessions->tree, session)) {
+		DEBUG2("%s - Ignoring packet for session %08x on %s, as the previous packet "
+		       "has not been replied to", sessions->log_prefix, ntohl(pkt->hdr.session_id), sessions->name);
+		talloc_free(session);
+		return -1;
+	}
+	fr_dlist_insert_tail(&sessions->pending, session);
+
+	return 0;
+}
+
+/** Update a reply before we start writing it
+ *
+ *  RFC 8907 Section 4.3.  The client asks for single connection mode
+ *  in its first packet, and the encoder copies that flag into the
+ *  reply.  Our first reply then decides the mode for the connection.
+ *
+ *  The flags aren't obfuscated, so we can change them here.
+ *
+ * @param[in] sessions	of the connection.
+ * @param[in] packet	the reply.
+ */
+void proto_tacacs_session_reply(proto_tacacs_sessions_t *sessions, uint8_t *packet)
+{
+	fr_tacacs_packet_t *pkt = (fr_tacacs_packet_t *) packet;
+
+	if (!sessions->allow_single_connect) pkt->hdr.flags &= ~FR_TAC_PLUS_SINGLE_CONNECT_FLAG;
+
+	if (sessions->replied) return;
+
+	sessions->replied = true;
+	sessions->single_connect = ((pkt->hdr.flags & FR_TAC_PLUS_SINGLE_CONNECT_FLAG) != 0);
+
+	DEBUG2("%s - Single connection mode is %s on %s",
+	       sessions->log_prefix, sessions->single_connect ? "enabled" : "disabled", sessions->name);
+}
+
+/** Record that we've written the whole of a reply
+ *
+ *  The status field of the reply is obfuscated, so we decide what
+ *  happens to the session from the code which the reply was encoded
+ *  from.
+ *
+ * @param[in] sessions	of the connection.
+ * @param[in] packet	the reply.
+ * @param[in] code	of the reply, from the request.
+ * @return
+ *	- true if the connection should be closed.
+ *	- false if it should stay open.
+ */
+bool proto_tacacs_session_sent(proto_tacacs_sessions_t *sessions, uint8_t const *packet, unsigned int code)
+{
+	fr_tacacs_packet_t const	*pkt = (fr_tacacs_packet_t const *) packet;
+	proto_tacacs_session_t		*session;
+	bool				session_complete = true;
+
+	session = fr_rb_find(sessions->tree, &(proto_tacacs_session_t){ .session_id = pkt->hdr.session_id });
+	if (session) session_free(sessions, session);	/* else already expired */
+
+	switch (code) {
+	/*
+	 *	The client continues the session.
+	 */
+	case FR_TACACS_CODE_AUTH_GETDATA:
+	case FR_TACACS_CODE_AUTH_GETUSER:
+	case FR_TACACS_CODE_AUTH_GETPASS:
+	case FR_TACACS_CODE_AUTH_RESTART:
+		session_complete = false;
+		break;
+
+	case FR_TACACS_CODE_AUTH_ERROR:
+	case FR_TACACS_CODE_AUTZ_ERROR:
+		if (!sessions->single_connect) {
+			DEBUG("Closing connection due to unrecoverable server error response");
+			return true;
+		}
+
+		/*
+		 *	RFC 8907 Section 4.4.  Finish the sessions
+		 *	which are already pending, and then close
+		 *	the connection.
+		 */
+		DEBUG("Not accepting new sessions on %s due to unrecoverable server error response",
+		      sessions->name);
+		sessions->draining = true;
+		break;
+
+	default:
+		break;
+	}
+
+	if (fr_rb_num_elements(sessions->tree) == 0) {
+		if (sessions->draining) {
+			DEBUG("Closing connection %s, as all pending sessions are done", sessions->name);
+			return true;
+		}
+
+		/*
+		 *	RFC 8907 Section 4.4.  Without single connection
+		 *	mode, there is one session per connection.
+		 */
+		if (!sessions->single_connect && session_complete) {
+			DEBUG2("%s - Closing connection %s, as the session is complete",
+			       sessions->log_prefix, sessions->name);
+			return true;
+		}
+	}
+
+	if (fr_rb_num_elements(sessions->tree) < sessions->max_sessions) reader_resume(sessions);
+
+	return false;
+}
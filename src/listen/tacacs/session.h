@@ -0,0 +1,79 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * $Id$
+ *
+ * @file src/listen/tacacs/session.h
+ * @brief TACACS+ session tracking for connected sockets.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/rb.h>
+
+#include "proto_tacacs.h"
+
+/** A session which is waiting for us to reply
+ *
+ *  Packets within a session are lock-step, so each session has at
+ *  most one packet waiting for a reply.  Sessions on one connection
+ *  are independent, and may be replied to in any order.
+ */
+typedef struct {
+	fr_rb_node_t			node;			//!< in the tree of pending sessions.
+	fr_dlist_t			entry;			//!< in the list of pending sessions, oldest first.
+
+	uint32_t			session_id;		//!< from the packet header, in network byte order.
+	fr_time_t			recv_time;		//!< when we read the packet.
+} proto_tacacs_session_t;
+
+/** The sessions on one connection
+ *
+ *  Shared by the TCP and TLS transports, which call these functions
+ *  as they read packets and write replies.
+ */
+typedef struct {
+	char const			*log_prefix;		//!< name of the transport, for debug messages.
+	char const			*name;			//!< name of the connection.
+	int				sockfd;			//!< which is paused and resumed.
+
+	fr_event_list_t			*el;			//!< for pausing and resuming reads.
+	fr_timer_t			*ev;			//!< for forgetting sessions while reads are paused.
+
+	fr_rb_tree_t			*tree;			//!< sessions waiting for a reply, by session ID.
+	fr_dlist_head_t			pending;		//!< the same sessions, oldest first.
+	uint32_t			max_sessions;		//!< stop reading when this many sessions are pending.
+
+	bool				allow_single_connect;	//!< whether we agree to single connection mode.
+	bool				replied;		//!< whether we've sent a reply on this connection.
+	bool				single_connect;		//!< whether single connection mode was negotiated.
+	bool				draining;		//!< don't accept new sessions, close once the pending ones are done.
+	bool				paused;			//!< whether reads are paused.
+} proto_tacacs_sessions_t;
+
+proto_tacacs_sessions_t *proto_tacacs_sessions_alloc(TALLOC_CTX *ctx, char const *log_prefix, char const *name, int sockfd,
+						     uint32_t max_sessions, bool allow_single_connect);
+
+bool	proto_tacacs_sessions_full(proto_tacacs_sessions_t *sessions);
+
+int	proto_tacacs_session_start(proto_tacacs_sessions_t *sessions, uint8_t const *packet, fr_time_t now);
+
+void	proto_tacacs_session_reply(proto_tacacs_sessions_t *sessions, uint8_t *packet);
+
+bool	proto_tacacs_session_sent(proto_tacacs_sessions_t *sessions, uint8_t const *packet, unsigned int code);
@@ -27,7 +27,9 @@ RCSID("$Id$")
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/server/pairmove.h>
+#include <freeradius-devel/server/reload.h>
 #include <freeradius-devel/server/users_file.h>
+#include <freeradius-devel/server/users_image.h>
 #include <freeradius-devel/util/htrie.h>
 #include <freeradius-devel/unlang/call_env.h>
 #include <freeradius-devel/unlang/function.h>
@@ -39,14 +41,32 @@ RCSID("$Id$")
 typedef struct {
 	char const	*filename;
 	bool		v3_compat;
+	fr_time_delta_t	reload_interval;
+	uint32_t	image_cache_size;
 } rlm_files_t;
 
-/**  Structure produced by custom call_env parser
+/**  One version of the parsed files data
  */
 typedef struct {
-	tmpl_t		*key_tmpl;	//!< tmpl used to evaluate lookup key.
 	fr_htrie_t	*htrie;		//!< parsed files "user" data.
 	PAIR_LIST_LIST	*def;		//!< parsed files DEFAULT data.
+
+	users_image_t	*image;		//!< Compiled image.  Entries are decoded on first use,
+					///< and added to htrie.
+	uint32_t	num_decoded;	//!< Keys decoded on first use, and added to htrie.
+	pthread_rwlock_t lock;		//!< Protects htrie when entries are decoded from the image.
+} rlm_files_users_t;
+
+/**  Structure produced by custom call_env parser
+ */
+typedef struct {
+	tmpl_t		*key_tmpl;	//!< tmpl used to evaluate lookup key.
+	reload_t	*reload;	//!< Holds the current #rlm_files_users_t.
+
+	rlm_files_t const	*inst;		//!< Instance data, for the filename.
+	fr_type_t		keytype;	//!< Data type of the key.
+	fr_dict_attr_t const	*key_enum;	//!< Attribute used to resolve enumeration names in keys.
+	fr_dict_t const		*dict;		//!< To resolve attributes in the file.
 } rlm_files_data_t;
 
 /**  Call_env structure
@@ -80,6 +100,8 @@ fr_dict_attr_autoload_t rlm_files_dict_attr[] = {
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET_FLAGS("filename", CONF_FLAG_REQUIRED | CONF_FLAG_FILE_INPUT, rlm_files_t, filename) },
 	{ FR_CONF_OFFSET("v3_compat", rlm_files_t, v3_compat) },
+	{ FR_CONF_OFFSET("reload_interval", rlm_files_t, reload_interval) },
+	{ FR_CONF_OFFSET("image_cache_size", rlm_files_t, image_cache_size), .dflt = "65536" },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -102,183 +124,191 @@ static int pairlist_to_key(uint8_t **out, size_t *outlen, void const *a)
 	return fr_value_box_to_key(out, outlen, ((PAIR_LIST_LIST const *)a)->box);
 }
 
-static int getrecv_filename(TALLOC_CTX *ctx, char const *filename, fr_htrie_t **ptree, PAIR_LIST_LIST **pdefault,
-			    fr_type_t data_type, fr_dict_attr_t const *key_enum, fr_dict_t const *dict, bool v3_compat)
+/** Sanity check an entry, and move its special items into flags
+ *
+ */
+static int files_entry_fixup(PAIR_LIST *entry, fr_htrie_type_t htype)
 {
-	int			rcode;
-	PAIR_LIST_LIST		users;
-	PAIR_LIST_LIST		search_list;	// Temporary list header used for matching in htrie
-	PAIR_LIST		*entry, *next;
-	PAIR_LIST_LIST		*user_list, *default_list;
-	fr_htrie_t		*tree;
-	fr_htrie_type_t		htype;
-	fr_value_box_t		*box;
-	map_t			*reply_head;
-
-	if (!filename) {
-		*ptree = NULL;
-		return 0;
-	}
-
-	pairlist_list_init(&users);
-	rcode = pairlist_read(ctx, dict, filename, &users, v3_compat);
-	if (rcode < 0) {
-		return -1;
-	}
-
-	htype = fr_htrie_hint(data_type);
+	map_t			*map = NULL;
+	map_t			*prev, *next_map;
+	fr_dict_attr_t const	*da;
+	map_t			*sub_head, *set_head;
+	map_t			*reply_head = NULL;
 
 	/*
-	 *	Walk through the 'users' file list
+	 *	Do various sanity checks.
 	 */
-	entry = NULL;
-	while ((entry = fr_dlist_next(&users.head, entry))) {
-		map_t *map = NULL;
-		map_t *prev, *next_map;
-		fr_dict_attr_t const *da;
-		map_t *sub_head, *set_head;
-
-		reply_head = NULL;
+	while ((map = map_list_next(&entry->check, map))) {
+		if (!tmpl_is_attr(map->lhs)) {
+			ERROR("%s[%d] Left side of check item %s is not an attribute",
+			      entry->filename, entry->lineno, map->lhs->name);
+			return -1;
+		}
 
 		/*
-		 *	Do various sanity checks.
+		 *	Disallow regexes for now.
 		 */
-		while ((map = map_list_next(&entry->check, map))) {
-			if (!tmpl_is_attr(map->lhs)) {
-				ERROR("%s[%d] Left side of check item %s is not an attribute",
-				      entry->filename, entry->lineno, map->lhs->name);
-				return -1;
-			}
+		if ((map->op == T_OP_REG_EQ) || (map->op == T_OP_REG_NE)) {
+			fr_assert(tmpl_is_regex(map->rhs));
+		}
 
-			/*
-			 *	Disallow regexes for now.
-			 */
-			if ((map->op == T_OP_REG_EQ) || (map->op == T_OP_REG_NE)) {
-				fr_assert(tmpl_is_regex(map->rhs));
-			}
+		/*
+		 *	Move assignment operations to the reply list.
+		 */
+		switch (map->op) {
+		case T_OP_EQ:
+		case T_OP_SET:
+		case T_OP_ADD_EQ:
+			prev = map_list_remove(&entry->check, map);
+			map_list_insert_after(&entry->reply, reply_head, map);
+			reply_head = map;
+			map = prev;
+			break;
+
+		default:
+			break;
+		}
+	} /* end of loop over check items */
 
-			/*
-			 *	Move assignment operations to the reply list.
-			 */
-			switch (map->op) {
-			case T_OP_EQ:
-			case T_OP_SET:
-			case T_OP_ADD_EQ:
-				prev = map_list_remove(&entry->check, map);
-				map_list_insert_after(&entry->reply, reply_head, map);
-				reply_head = map;
-				map = prev;
-				break;
+	/*
+	 *	Note that we also re-arrange any control items which are in the reply item list.
+	 */
+	sub_head = set_head = NULL;
 
-			default:
-				break;
-			}
-		} /* end of loop over check items */
+	/*
+	 *	Look for server configuration items
+	 *	in the reply list.
+	 *
+	 *	It's a common enough mistake, that it's
+	 *	worth doing.
+	 */
+	for (map = map_list_head(&entry->reply);
+	     map != NULL;
+	     map = next_map) {
+		next_map = map_list_next(&entry->reply, map);
+		if (!tmpl_is_attr(map->lhs)) {
+			ERROR("%s[%d] Left side of reply item %s is not an attribute",
+			      entry->filename, entry->lineno, map->lhs->name);
+			return -1;
+		}
+		da = tmpl_attr_tail_da(map->lhs);
 
-		/*
-		 *	Note that we also re-arrange any control items which are in the reply item list.
-		 */
-		sub_head = set_head = NULL;
+		if (fr_comparison_op[map->op] && (map->op != T_OP_LE) && (map->op != T_OP_GE)) {
+			ERROR("%s[%d] Invalid operator reply item %s %s ...",
+			      entry->filename, entry->lineno, map->lhs->name, fr_tokens[map->op]);
+			return -1;
+		}
 
 		/*
-		 *	Look for server configuration items
-		 *	in the reply list.
+		 *	Regex assignments aren't allowed.
 		 *
-		 *	It's a common enough mistake, that it's
-		 *	worth doing.
+		 *	Execs are being deprecated.
 		 */
-		for (map = map_list_head(&entry->reply);
-		     map != NULL;
-		     map = next_map) {
-			next_map = map_list_next(&entry->reply, map);
-			if (!tmpl_is_attr(map->lhs)) {
-				ERROR("%s[%d] Left side of reply item %s is not an attribute",
-				      entry->filename, entry->lineno, map->lhs->name);
+		if (tmpl_contains_regex(map->rhs) || tmpl_is_exec(map->rhs)) {
+			ERROR("%s[%d] Invalid right-hand side of assignment for attribute %s",
+			      entry->filename, entry->lineno, da->name);
+			return -1;
+		}
+
+		if (da == attr_next_shortest_prefix) {
+			if (htype != FR_HTRIE_TRIE) {
+				ERROR("%s[%d] Cannot use %s when key is not an IP / IP prefix",
+				      entry->filename, entry->lineno, da->name);
 				return -1;
 			}
-			da = tmpl_attr_tail_da(map->lhs);
 
-			if (fr_comparison_op[map->op] && (map->op != T_OP_LE) && (map->op != T_OP_GE)) {
-				ERROR("%s[%d] Invalid operator reply item %s %s ...",
-				      entry->filename, entry->lineno, map->lhs->name, fr_tokens[map->op]);
+			if (!tmpl_is_data(map->rhs) || (tmpl_value_type(map->rhs) != FR_TYPE_BOOL)) {
+				ERROR("%s[%d] Value for %s must be static boolean",
+				      entry->filename, entry->lineno, da->name);
 				return -1;
 			}
 
-			/*
-			 *	Regex assignments aren't allowed.
-			 *
-			 *	Execs are being deprecated.
-			 */
-			if (tmpl_contains_regex(map->rhs) || tmpl_is_exec(map->rhs)) {
-				ERROR("%s[%d] Invalid right-hand side of assignment for attribute %s",
+			entry->next_shortest_prefix = tmpl_value(map->rhs)->vb_bool;
+			(void) map_list_remove(&entry->reply, map);
+			continue;
+		}
+
+		/*
+		 *	Check for Fall-Through in the reply list.  If so, delete it and set the flag
+		 *	in the entry.
+		 *
+		 *	Note that we don't free "map", as the map functions usually make the "next"
+		 *	map be talloc parented from the current one.  So freeing this one will likely
+		 *	free all subsequent maps.
+		 */
+		if (da == attr_fall_through) {
+			if (!tmpl_is_data(map->rhs) || (tmpl_value_type(map->rhs) != FR_TYPE_BOOL)) {
+				ERROR("%s[%d] Value for %s must be static boolean",
 				      entry->filename, entry->lineno, da->name);
 				return -1;
 			}
 
-			if (da == attr_next_shortest_prefix) {
-				if (htype != FR_HTRIE_TRIE) {
-					ERROR("%s[%d] Cannot use %s when key is not an IP / IP prefix",
-					      entry->filename, entry->lineno, da->name);
-					return -1;
-				}
+			entry->fall_through = tmpl_value(map->rhs)->vb_bool;
+			(void) map_list_remove(&entry->reply, map);
+			continue;
+		}
 
-				if (!tmpl_is_data(map->rhs) || (tmpl_value_type(map->rhs) != FR_TYPE_BOOL)) {
-					ERROR("%s[%d] Value for %s must be static boolean",
-					      entry->filename, entry->lineno, da->name);
-					return -1;
-				}
+		/*
+		 *	Removals are applied before anything else.
+		 */
+		if (map->op == T_OP_SUB_EQ) {
+			if (sub_head == map) continue;
 
-				entry->next_shortest_prefix = tmpl_value(map->rhs)->vb_bool;
-				(void) map_list_remove(&entry->reply, map);
-				continue;
-			}
+			(void) map_list_remove(&entry->reply, map);
+			map_list_insert_after(&entry->reply, sub_head, map);
+			sub_head = map;
+			continue;
+		}
 
-			/*
-			 *	Check for Fall-Through in the reply list.  If so, delete it and set the flag
-			 *	in the entry.
-			 *
-			 *	Note that we don't free "map", as the map functions usually make the "next"
-			 *	map be talloc parented from the current one.  So freeing this one will likely
-			 *	free all subsequent maps.
-			 */
-			if (da == attr_fall_through) {
-				if (!tmpl_is_data(map->rhs) || (tmpl_value_type(map->rhs) != FR_TYPE_BOOL)) {
-					ERROR("%s[%d] Value for %s must be static boolean",
-					      entry->filename, entry->lineno, da->name);
-					return -1;
-				}
+		/*
+		 *	Over-rides are applied after deletions.
+		 */
+		if (map->op == T_OP_SET) {
+			if (set_head == map) continue;
 
-				entry->fall_through = tmpl_value(map->rhs)->vb_bool;
-				(void) map_list_remove(&entry->reply, map);
-				continue;
-			}
+			if (!set_head) set_head = sub_head;
 
-			/*
-			 *	Removals are applied before anything else.
-			 */
-			if (map->op == T_OP_SUB_EQ) {
-				if (sub_head == map) continue;
+			(void) map_list_remove(&entry->reply, map);
+			map_list_insert_after(&entry->reply, set_head, map);
+			set_head = map;
+			continue;
+		}
+	}
 
-				(void) map_list_remove(&entry->reply, map);
-				map_list_insert_after(&entry->reply, sub_head, map);
-				sub_head = map;
-				continue;
-			}
+	return 0;
+}
 
-			/*
-			 *	Over-rides are applied after deletions.
-			 */
-			if (map->op == T_OP_SET) {
-				if (set_head == map) continue;
+static int getrecv_filename(TALLOC_CTX *ctx, char const *filename, fr_htrie_t **ptree, PAIR_LIST_LIST **pdefault,
+			    fr_type_t data_type, fr_dict_attr_t const *key_enum, fr_dict_t const *dict, bool v3_compat)
+{
+	int			rcode;
+	PAIR_LIST_LIST		users;
+	PAIR_LIST_LIST		search_list;	// Temporary list header used for matching in htrie
+	PAIR_LIST		*entry, *next;
+	PAIR_LIST_LIST		*user_list, *default_list;
+	fr_htrie_t		*tree;
+	fr_htrie_type_t		htype;
+	fr_value_box_t		*box;
 
-				if (!set_head) set_head = sub_head;
+	if (!filename) {
+		*ptree = NULL;
+		return 0;
+	}
 
-				(void) map_list_remove(&entry->reply, map);
-				map_list_insert_after(&entry->reply, set_head, map);
-				set_head = map;
-				continue;
-			}
-		}
+	pairlist_list_init(&users);
+	rcode = pairlist_read(ctx, dict, filename, &users, v3_compat);
+	if (rcode < 0) {
+		return -1;
+	}
+
+	htype = fr_htrie_hint(data_type);
+
+	/*
+	 *	Walk through the 'users' file list
+	 */
+	entry = NULL;
+	while ((entry = fr_dlist_next(&users.head, entry))) {
+		if (files_entry_fixup(entry, htype) < 0) return -1;
 	}
 
 	tree = fr_htrie_alloc(ctx, htype, pairlist_hash, pairlist_cmp, pairlist_to_key, NULL);
@@ -395,6 +425,102 @@ static int getrecv_filename(TALLOC_CTX *ctx, char const *filename, fr_htrie_t **
 	return 0;
 }
 
+/** Find a key, decoding its entries from the image if they haven't been used before
+ *
+ * Decoded entries are added to the tree, so each key is only parsed once
+ * per version of the image.  Once image_cache_size keys have been decoded,
+ * entries for other keys are decoded for the current request only.
+ *
+ * Entries which contain xlats were decoded when the image was loaded, so
+ * anything decoded here must not register new xlats.
+ */
+static int files_image_find(PAIR_LIST_LIST const **out, request_t *request, rlm_files_users_t *users,
+			    rlm_files_data_t const *files_data, fr_value_box_t *key_vb)
+{
+	PAIR_LIST_LIST		my_list, *user_list, *found;
+	PAIR_LIST		*entry = NULL;
+	uint32_t		max = files_data->inst->image_cache_size;
+	bool			prev;
+	int			ret;
+
+	my_list.name = NULL;
+	my_list.box = key_vb;
+
+	pthread_rwlock_rdlock(&users->lock);
+	*out = fr_htrie_find(users->htrie, &my_list);
+	pthread_rwlock_unlock(&users->lock);
+	if (*out) return 0;
+
+	if (key_vb->type != FR_TYPE_STRING) return 0;
+
+	/*
+	 *	Parse outside of the lock.  Searching the image is
+	 *	read-only, so lookups for keys which don't exist
+	 *	don't serialise the workers.
+	 */
+	MEM(user_list = talloc_zero(NULL, PAIR_LIST_LIST));
+	pairlist_list_init(user_list);
+
+	prev = xlat_instance_register_disable(true);
+	ret = users_image_decode(user_list, user_list, users->image, key_vb->vb_strvalue, key_vb->vb_length,
+				 files_data->dict, files_data->inst->v3_compat);
+	xlat_instance_register_disable(prev);
+	if (ret <= 0) {
+		if (ret < 0) RPERROR("Failed decoding entries for key \"%pV\"", key_vb);
+		talloc_free(user_list);
+		return ret;
+	}
+
+	while ((entry = fr_dlist_next(&user_list->head, entry))) {
+		if (files_entry_fixup(entry, users->htrie->type) < 0) {
+			RERROR("Invalid entry for key \"%pV\"", key_vb);
+			talloc_free(user_list);
+			return -1;
+		}
+	}
+
+	entry = fr_dlist_head(&user_list->head);
+	user_list->name = entry->name;
+	MEM(user_list->box = fr_value_box_alloc(user_list, FR_TYPE_STRING, NULL));
+	if (fr_value_box_copy(user_list, user_list->box, key_vb) < 0) {
+		RPERROR("Failed copying key");
+		talloc_free(user_list);
+		return -1;
+	}
+
+	/*
+	 *	Another worker may have decoded the same key
+	 *	while we were parsing it.
+	 */
+	pthread_rwlock_wrlock(&users->lock);
+	found = fr_htrie_find(users->htrie, &my_list);
+	if (found) {
+		talloc_free(user_list);
+	} else if (max && (users->num_decoded >= max)) {
+		/*
+		 *	Cache is full.  Other workers may be using
+		 *	any of the cached entries, so we can't evict
+		 *	them.  Use these entries for this request only.
+		 */
+		talloc_steal(request, user_list);
+		found = user_list;
+	} else {
+		talloc_steal(users, user_list);
+		if (!fr_htrie_insert(users->htrie, user_list)) {
+			pthread_rwlock_unlock(&users->lock);
+			RPERROR("Failed inserting key \"%pV\"", key_vb);
+			talloc_free(user_list);
+			return -1;
+		}
+		found = user_list;
+		users->num_decoded++;
+	}
+	pthread_rwlock_unlock(&users->lock);
+
+	*out = found;
+	return 0;
+}
+
 /** Lookup the expanded key value in files data.
  *
  */
@@ -408,8 +534,9 @@ static unlang_action_t CC_HINT(nonnull) mod_files_resume(rlm_rcode_t *p_result,
 	uint8_t			key_buffer[16], *key;
 	size_t			keylen = 0;
 	fr_edit_list_t		*el, *child;
-	fr_htrie_t		*tree = env->data->htrie;
-	PAIR_LIST_LIST		*default_list = env->data->def;
+	rlm_files_users_t	*users = reload_data(env->data->reload);
+	fr_htrie_t		*tree = users->htrie;
+	PAIR_LIST_LIST		*default_list = users->def;
 	fr_value_box_t		*key_vb = fr_value_box_list_head(&env->values);
 
 	if (!key_vb) {
@@ -425,9 +552,16 @@ static unlang_action_t CC_HINT(nonnull) mod_files_resume(rlm_rcode_t *p_result,
 	MEM(child = fr_edit_list_alloc(request, 50, el));
 
 	if (tree) {
-		my_list.name = NULL;
-		my_list.box = key_vb;
-		user_list = fr_htrie_find(tree, &my_list);
+		if (users->image) {
+			if (files_image_find(&user_list, request, users, env->data, key_vb) < 0) {
+				talloc_free(child);
+				RETURN_MODULE_FAIL;
+			}
+		} else {
+			my_list.name = NULL;
+			my_list.box = key_vb;
+			user_list = fr_htrie_find(tree, &my_list);
+		}
 
 		trie = (tree->type == FR_HTRIE_TRIE);
 
@@ -648,6 +782,134 @@ static unlang_action_t CC_HINT(nonnull) mod_files(rlm_rcode_t *p_result, module_
 	return UNLANG_ACTION_PUSHED_CHILD;
 }
 
+static int _files_users_free(rlm_files_users_t *users)
+{
+	pthread_rwlock_destroy(&users->lock);
+	return 0;
+}
+
+/** Open a compiled image, and decode its DEFAULT entries, and any entries containing xlats
+ *
+ * All other entries are decoded by #files_image_find when their key is first used.
+ */
+static int files_image_load(rlm_files_users_t *users, rlm_files_data_t const *files_data)
+{
+	char const	*filename = files_data->inst->filename;
+	PAIR_LIST	*entry = NULL;
+	PAIR_LIST_LIST	xlat_list, *user_list_last = NULL;
+	uint32_t	num_xlat_keys = 0;
+
+	if (files_data->keytype != FR_TYPE_STRING) {
+		fr_strerror_printf("%s is a compiled image, which can only be used with string keys", filename);
+		return -1;
+	}
+
+	users->image = users_image_open(users, filename);
+	if (!users->image) return -1;
+
+	MEM(users->def = talloc_zero(users, PAIR_LIST_LIST));
+	pairlist_list_init(users->def);
+	if (users_image_decode_default(users->def, users->def, users->image,
+				       files_data->dict, files_data->inst->v3_compat) < 0) return -1;
+
+	while ((entry = fr_dlist_next(&users->def->head, entry))) {
+		if (files_entry_fixup(entry, fr_htrie_hint(FR_TYPE_STRING)) < 0) {
+			fr_strerror_printf("Failed reading %s", filename);
+			return -1;
+		}
+	}
+
+	entry = fr_dlist_head(&users->def->head);
+	if (entry) {
+		users->def->name = entry->name;
+	} else {
+		TALLOC_FREE(users->def);
+	}
+
+	users->htrie = fr_htrie_alloc(users, fr_htrie_hint(FR_TYPE_STRING),
+				      pairlist_hash, pairlist_cmp, pairlist_to_key, NULL);
+	if (!users->htrie) return -1;
+
+	/*
+	 *	Entries containing xlats must be decoded now, as
+	 *	workers can't register xlats.
+	 */
+	pairlist_list_init(&xlat_list);
+	if (users_image_decode_xlat(users, &xlat_list, users->image,
+				    files_data->dict, files_data->inst->v3_compat) < 0) return -1;
+
+	while ((entry = fr_dlist_pop_head(&xlat_list.head))) {
+		PAIR_LIST_LIST	*user_list;
+
+		if (files_entry_fixup(entry, users->htrie->type) < 0) {
+			fr_strerror_printf("Failed reading %s", filename);
+			return -1;
+		}
+
+		/*
+		 *	Entries for the same key are adjacent.
+		 */
+		if (!num_xlat_keys || (strcmp(user_list_last->name, entry->name) != 0)) {
+			MEM(user_list = talloc_zero(users, PAIR_LIST_LIST));
+			pairlist_list_init(user_list);
+			user_list->name = entry->name;
+			MEM(user_list->box = fr_value_box_alloc(user_list, FR_TYPE_STRING, NULL));
+			if (fr_value_box_bstrndup(user_list->box, user_list->box, NULL,
+						  entry->name, strlen(entry->name), false) < 0) return -1;
+
+			if (!fr_htrie_insert(users->htrie, user_list)) {
+				fr_strerror_printf("Failed inserting key %s", entry->name);
+				return -1;
+			}
+			user_list_last = user_list;
+			num_xlat_keys++;
+		}
+		fr_dlist_insert_tail(&user_list_last->head, entry);
+	}
+
+	pthread_rwlock_init(&users->lock, NULL);
+	talloc_set_destructor(users, _files_users_free);
+
+	DEBUG("%s - Loaded image with %u keys, %u containing xlats", filename,
+	      users_image_num_keys(users->image), num_xlat_keys);
+
+	return 0;
+}
+
+/** (Re)load the users file for one call site
+ *
+ */
+static int files_load(void **out, TALLOC_CTX *ctx, void *uctx)
+{
+	rlm_files_data_t const	*files_data = talloc_get_type_abort_const(uctx, rlm_files_data_t);
+	rlm_files_users_t	*users;
+
+	MEM(users = talloc_zero(ctx, rlm_files_users_t));
+
+	if (users_image_check(files_data->inst->filename)) {
+		if (files_image_load(users, files_data) < 0) return -1;
+
+		*out = users;
+		return 0;
+	}
+
+	if (getrecv_filename(users, files_data->inst->filename, &users->htrie, &users->def,
+			     files_data->keytype, files_data->key_enum, files_data->dict,
+			     files_data->inst->v3_compat) < 0) {
+		fr_strerror_printf("Failed reading %s", files_data->inst->filename);
+		return -1;
+	}
+
+	*out = users;
+	return 0;
+}
+
+static int _files_data_free(rlm_files_data_t *files_data)
+{
+	talloc_free(files_data->reload);
+	return 0;
+}
+
 /** Custom call_env parser for loading files data
  *
  */
@@ -657,8 +919,6 @@ static int call_env_parse(TALLOC_CTX *ctx, void *out, tmpl_rules_t const *t_rule
 	rlm_files_t const		*inst = talloc_get_type_abort_const(cec->mi->data, rlm_files_t);
 	CONF_PAIR const			*to_parse = cf_item_to_pair(ci);
 	rlm_files_data_t		*files_data;
-	fr_type_t			keytype;
-	fr_dict_attr_t const		*key_enum = NULL;
 
 	MEM(files_data = talloc_zero(ctx, rlm_files_data_t));
 
@@ -667,20 +927,29 @@ static int call_env_parse(TALLOC_CTX *ctx, void *out, tmpl_rules_t const *t_rule
 			      cf_pair_value_quote(to_parse), value_parse_rules_quoted[cf_pair_value_quote(to_parse)],
 			      t_rules) < 0) return -1;
 
-	keytype = tmpl_expanded_type(files_data->key_tmpl);
-	if (fr_htrie_hint(keytype) == FR_HTRIE_INVALID) {
-		cf_log_err(ci, "Invalid data type '%s' for 'files' module", fr_type_to_str(keytype));
+	files_data->keytype = tmpl_expanded_type(files_data->key_tmpl);
+	if (fr_htrie_hint(files_data->keytype) == FR_HTRIE_INVALID) {
+		cf_log_err(ci, "Invalid data type '%s' for 'files' module", fr_type_to_str(files_data->keytype));
 	error:
 		talloc_free(files_data);
 		return -1;
 	}
 
 	if (files_data->key_tmpl->type == TMPL_TYPE_ATTR) {
-		key_enum = tmpl_attr_tail_da(files_data->key_tmpl);
+		files_data->key_enum = tmpl_attr_tail_da(files_data->key_tmpl);
 	}
+	files_data->inst = inst;
+	files_data->dict = t_rules->attr.dict_def;
 
-	if (getrecv_filename(files_data, inst->filename, &files_data->htrie, &files_data->def,
-			     keytype, key_enum, t_rules->attr.dict_def, inst->v3_compat) < 0) goto error;
+	/*
+	 *	Each call site has its own copy of the data, as the
+	 *	key type may differ.  The radmin reload command for
+	 *	this module reloads all of them.
+	 */
+	files_data->reload = reload_alloc(NULL, cec->mi->name, inst->filename, inst->reload_interval,
+					  files_load, files_data);
+	if (!files_data->reload) goto error;
+	talloc_set_destructor(files_data, _files_data_free);
 
 	*(void **)out = files_data;
 	return 0;
@@ -25,27 +25,390 @@ RCSID("$Id$")
 USES_APPLE_DEPRECATED_API
 
 #include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/module_rlm.h>
+#include <freeradius-devel/unlang/call_env.h>
+#include <freeradius-devel/unlang/module.h>
 #include <freeradius-devel/kafka/base.h>
 
+/*
+ *	How long we wait for queued messages to be delivered when a
+ *	thread exits.  Anything still queued after this is discarded.
+ */
+#define KAFKA_FLUSH_TIMEOUT_MS	(5000)
+
+/** A topic which messages can be produced to
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;		//!< Entry in the tree of topics.
+	char const		*name;		//!< Name of the topic.
+	CONF_SECTION		*cs;		//!< Section holding the topic's configuration.
+	unsigned int		idx;		//!< Index into the thread's array of topic handles.
+} rlm_kafka_topic_t;
+
 typedef struct {
-	char const *foo;
+	fr_rb_tree_t		*topics;	//!< Topics which have a configuration section.
+	unsigned int		num_topics;	//!< How many topics there are.
 } rlm_kafka_t;
 
+typedef struct {
+	rd_kafka_t		*rk;		//!< Producer handle.
+	rd_kafka_queue_t	*queue;		//!< Main queue, where delivery reports are sent.
+	rd_kafka_topic_t	**topics;	//!< Topic handles, indexed by #rlm_kafka_topic_t.idx.
+
+	fr_event_list_t		*el;		//!< Event list of the worker which owns this producer.
+	fr_event_user_t		*ev;		//!< Triggered by librdkafka when there are events to serve.
+} rlm_kafka_thread_t;
+
+/** A message waiting for a delivery report
+ *
+ * These are allocated in the thread ctx, not the request, so that
+ * a cancelled request doesn't leave librdkafka with a dangling pointer.
+ */
+typedef struct {
+	request_t		*request;	//!< The request waiting for the message to be acknowledged.
+						///< NULL if the request was cancelled.
+	bool			done;		//!< Delivery report has been received.
+	rd_kafka_resp_err_t	err;		//!< Result of the delivery.
+	int32_t			partition;	//!< Partition the message was written to.
+	int64_t			offset;		//!< Offset of the message in the partition.
+} rlm_kafka_msg_t;
+
+typedef struct {
+	fr_value_box_t		topic;		//!< Which topic to produce to.
+	fr_value_box_t		key;		//!< Used to pick a partition.
+	fr_value_box_t		value;		//!< Message payload.
+	fr_value_box_t		wait;		//!< Whether to wait for the message to be acknowledged.
+} rlm_kafka_env_t;
+
+static const call_env_method_t kafka_method_env = {
+	FR_CALL_ENV_METHOD_OUT(rlm_kafka_env_t),
+	.env = (call_env_parser_t[]){
+		{ FR_CALL_ENV_SUBSECTION("message", NULL, CALL_ENV_FLAG_REQUIRED,
+			((call_env_parser_t[]) {
+				{ FR_CALL_ENV_OFFSET("topic", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT,
+						     rlm_kafka_env_t, topic) },
+				{ FR_CALL_ENV_OFFSET("key", FR_TYPE_STRING, CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_NULLABLE,
+						     rlm_kafka_env_t, key) },
+				{ FR_CALL_ENV_OFFSET("value", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT,
+						     rlm_kafka_env_t, value) },
+				{ FR_CALL_ENV_OFFSET("wait", FR_TYPE_BOOL, CALL_ENV_FLAG_NONE, rlm_kafka_env_t, wait),
+						     .pair.dflt = "yes", .pair.dflt_quote = T_BARE_WORD },
+				CALL_ENV_TERMINATOR
+			})) },
+		CALL_ENV_TERMINATOR
+	}
+};
+
+/** Called by librdkafka for each message which has been acknowledged, or has failed
+ *
+ * This is only ever called from rd_kafka_poll() or rd_kafka_flush(), so it
+ * runs in the worker which owns the producer.
+ */
+static void _kafka_delivery_report(UNUSED rd_kafka_t *rk, rd_kafka_message_t const *rkmessage, UNUSED void *opaque)
+{
+	rlm_kafka_msg_t	*msg = rkmessage->_private;
+
+	/*
+	 *	Fire and forget, the only thing we can do is complain.
+	 */
+	if (!msg) {
+		if (rkmessage->err == RD_KAFKA_RESP_ERR_NO_ERROR) return;
+
+		ERROR("Failed delivering message to topic \"%s\": %s",
+		      rd_kafka_topic_name(rkmessage->rkt), rd_kafka_err2str(rkmessage->err));
+		return;
+	}
+
+	/*
+	 *	The request gave up waiting.
+	 */
+	if (!msg->request) {
+		talloc_free(msg);
+		return;
+	}
+
+	msg->done = true;
+	msg->err = rkmessage->err;
+	msg->partition = rkmessage->partition;
+	msg->offset = rkmessage->offset;
+
+	unlang_interpret_mark_runnable(msg->request);
+}
+
+/** Called by librdkafka, from one of its threads, when the main queue becomes non-empty
+ *
+ */
+static void _kafka_queue_event(UNUSED rd_kafka_t *rk, void *uctx)
+{
+	rlm_kafka_thread_t	*t = uctx;
+
+	(void) fr_event_user_trigger(t->el, t->ev);
+}
+
+/** Serve delivery reports and any other events waiting on the main queue
+ *
+ */
+static void _kafka_events(UNUSED fr_event_list_t *el, void *uctx)
+{
+	rlm_kafka_thread_t	*t = talloc_get_type_abort(uctx, rlm_kafka_thread_t);
+
+	(void) rd_kafka_poll(t->rk, 0);
+}
+
+static unlang_action_t mod_produce_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_kafka_msg_t	*msg = talloc_get_type_abort(mctx->rctx, rlm_kafka_msg_t);
+	rlm_rcode_t	rcode = RLM_MODULE_OK;
+
+	fr_assert(msg->done);
+
+	if (msg->err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+		REDEBUG("Failed delivering message: %s", rd_kafka_err2str(msg->err));
+		rcode = RLM_MODULE_FAIL;
+	} else {
+		RDEBUG2("Message written to partition %" PRId32 " at offset %" PRId64, msg->partition, msg->offset);
+	}
+
+	talloc_free(msg);
+
+	RETURN_MODULE_RCODE(rcode);
+}
+
+static void mod_produce_signal(module_ctx_t const *mctx, request_t *request, UNUSED fr_signal_t action)
+{
+	rlm_kafka_msg_t	*msg = talloc_get_type_abort(mctx->rctx, rlm_kafka_msg_t);
+
+	if (msg->done) {
+		talloc_free(msg);
+		return;
+	}
+
+	/*
+	 *	The message can't be recalled, so let the
+	 *	delivery report free it when it arrives.
+	 */
+	RDEBUG2("No longer waiting for message to be acknowledged");
+	msg->request = NULL;
+}
+
+/** Produce a message, and optionally wait for it to be acknowledged
+ *
+ * Messages are copied into librdkafka's queue, which batches them by
+ * topic and partition, and sends them according to the producer's
+ * batching and linger settings.
+ */
+static unlang_action_t CC_HINT(nonnull) mod_produce(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_kafka_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_kafka_t);
+	rlm_kafka_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_kafka_thread_t);
+	rlm_kafka_env_t		*env = talloc_get_type_abort(mctx->env_data, rlm_kafka_env_t);
+	rlm_kafka_topic_t	*topic;
+	rlm_kafka_msg_t		*msg = NULL;
+	rd_kafka_resp_err_t	err;
+	char const		*key = NULL;
+	size_t			key_len = 0;
+
+	topic = fr_rb_find(inst->topics, &(rlm_kafka_topic_t){ .name = env->topic.vb_strvalue });
+	if (!topic) {
+		REDEBUG("No configuration found for topic \"%pV\"", &env->topic);
+		RETURN_MODULE_FAIL;
+	}
+
+	if (env->key.type == FR_TYPE_STRING) {
+		key = env->key.vb_strvalue;
+		key_len = env->key.vb_length;
+	}
+
+	if (env->wait.vb_bool) {
+		MEM(msg = talloc_zero(t, rlm_kafka_msg_t));
+		msg->request = request;
+	}
+
+	err = rd_kafka_producev(t->rk,
+				RD_KAFKA_V_RKT(t->topics[topic->idx]),
+				RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+				RD_KAFKA_V_KEY(key, key_len),
+				RD_KAFKA_V_VALUE(UNCONST(char *, env->value.vb_strvalue), env->value.vb_length),
+				RD_KAFKA_V_OPAQUE(msg),
+				RD_KAFKA_V_END);
+	if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+		REDEBUG("Failed queueing message for topic \"%s\": %s", topic->name, rd_kafka_err2str(err));
+		talloc_free(msg);
+		RETURN_MODULE_FAIL;
+	}
+
+	if (!msg) {
+		RDEBUG2("Queued message for topic \"%s\"", topic->name);
+		RETURN_MODULE_OK;
+	}
+
+	RDEBUG2("Queued message for topic \"%s\", waiting for it to be acknowledged", topic->name);
+
+	return unlang_module_yield(request, mod_produce_resume, mod_produce_signal, ~FR_SIGNAL_CANCEL, msg);
+}
+
+static int8_t kafka_topic_cmp(void const *one, void const *two)
+{
+	rlm_kafka_topic_t const *a = one, *b = two;
+
+	return CMP(strcmp(a->name, b->name), 0);
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_kafka_t	*inst = talloc_get_type_abort(mctx->mi->data, rlm_kafka_t);
+	CONF_SECTION	*conf = mctx->mi->conf;
+	CONF_SECTION	*topics = NULL, *cs;
+
+	MEM(inst->topics = fr_rb_inline_talloc_alloc(inst, rlm_kafka_topic_t, node, kafka_topic_cmp, NULL));
+
+	/*
+	 *	topic {
+	 *		<name> {
+	 *			...
+	 *		}
+	 *	}
+	 */
+	while ((topics = cf_section_find_next(conf, topics, "topic", NULL))) {
+		for (cs = cf_section_first(topics); cs; cs = cf_section_next(topics, cs)) {
+			rlm_kafka_topic_t *topic;
+
+			MEM(topic = talloc_zero(inst->topics, rlm_kafka_topic_t));
+			topic->name = cf_section_name1(cs);
+			topic->cs = cs;
+			topic->idx = inst->num_topics;
+
+			if (!fr_rb_insert(inst->topics, topic)) {
+				cf_log_err(cs, "Duplicate topic \"%s\"", topic->name);
+				return -1;
+			}
+			inst->num_topics++;
+		}
+	}
+
+	if (!inst->num_topics) {
+		cf_log_err(conf, "At least one topic must be configured");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_kafka_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_kafka_t);
+	rlm_kafka_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_kafka_thread_t);
+	unsigned int		i;
+
+	if (!t->rk) return 0;
+
+	/*
+	 *	Stop librdkafka poking our event list, we
+	 *	poll it directly from here on.
+	 */
+	if (t->queue) {
+		rd_kafka_queue_cb_event_enable(t->queue, NULL, NULL);
+		rd_kafka_queue_destroy(t->queue);
+	}
+
+	if (rd_kafka_flush(t->rk, KAFKA_FLUSH_TIMEOUT_MS) != RD_KAFKA_RESP_ERR_NO_ERROR) {
+		WARN("Discarding %i message(s) which were not delivered", rd_kafka_outq_len(t->rk));
+		rd_kafka_purge(t->rk, RD_KAFKA_PURGE_F_QUEUE | RD_KAFKA_PURGE_F_INFLIGHT);
+		(void) rd_kafka_poll(t->rk, 0);
+	}
+
+	if (t->topics) for (i = 0; i < inst->num_topics; i++) {
+		if (t->topics[i]) rd_kafka_topic_destroy(t->topics[i]);
+	}
+
+	rd_kafka_destroy(t->rk);
+	t->rk = NULL;
+
+	return 0;
+}
+
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_kafka_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_kafka_t);
+	rlm_kafka_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_kafka_thread_t);
+	rd_kafka_conf_t		*conf;
+	rlm_kafka_topic_t	*topic;
+	fr_rb_iter_inorder_t	iter;
+	char			errstr[512];
+
+	conf = kafka_base_conf_dup(mctx->mi->conf);
+	if (!conf) {
+		ERROR("No kafka configuration found");
+		return -1;
+	}
+	rd_kafka_conf_set_dr_msg_cb(conf, _kafka_delivery_report);
+
+	/*
+	 *	On success the producer takes ownership of conf.
+	 */
+	t->rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+	if (!t->rk) {
+		ERROR("Failed creating producer: %s", errstr);
+		rd_kafka_conf_destroy(conf);
+		return -1;
+	}
+
+	MEM(t->topics = talloc_zero_array(t, rd_kafka_topic_t *, inst->num_topics));
+	for (topic = fr_rb_iter_init_inorder(&iter, inst->topics);
+	     topic;
+	     topic = fr_rb_iter_next_inorder(&iter)) {
+		rd_kafka_topic_conf_t	*topic_conf = kafka_base_topic_conf_dup(topic->cs);
+
+		t->topics[topic->idx] = rd_kafka_topic_new(t->rk, topic->name, topic_conf);
+		if (!t->topics[topic->idx]) {
+			ERROR("Failed creating topic \"%s\": %s", topic->name, rd_kafka_err2str(rd_kafka_last_error()));
+			if (topic_conf) rd_kafka_topic_conf_destroy(topic_conf);
+			goto error;
+		}
+	}
+
+	t->el = mctx->el;
+	if (fr_event_user_insert(t, t->el, &t->ev, false, _kafka_events, t) < 0) {
+		PERROR("Failed inserting delivery report event");
+	error:
+		mod_thread_detach(mctx);
+		return -1;
+	}
+
+	/*
+	 *	Delivery reports are sent to the main queue.  librdkafka
+	 *	calls us when it goes from empty to non-empty, and we
+	 *	serve it from the worker's event loop.
+	 */
+	t->queue = rd_kafka_queue_get_main(t->rk);
+	rd_kafka_queue_cb_event_enable(t->queue, _kafka_queue_event, t);
+
+	return 0;
+}
+
 /*
  *	The module name should be the only globally exported symbol.
  *	That is, everything else should be 'static'.
- *
- *	If the module needs to temporarily modify it's instantiation
- *	data, the type should be changed to MODULE_TYPE_THREAD_UNSAFE.
- *	The server will then take care of ensuring that the module
- *	is single-threaded.
  */
 extern module_rlm_t rlm_kafka;
 module_rlm_t rlm_kafka = {
 	.common = {
-		.magic		= MODULE_MAGIC_INIT,
-		.name		= "kafka",
-		.inst_size	= sizeof(rlm_kafka_t),
-		.config		= kafka_base_producer_config,
+		.magic			= MODULE_MAGIC_INIT,
+		.name			= "kafka",
+		.inst_size		= sizeof(rlm_kafka_t),
+		.config			= kafka_base_producer_config,
+		.instantiate		= mod_instantiate,
+
+		.thread_inst_size	= sizeof(rlm_kafka_thread_t),
+		.thread_inst_type	= "rlm_kafka_thread_t",
+		.thread_instantiate	= mod_thread_instantiate,
+		.thread_detach		= mod_thread_detach
+	},
+	.method_group = {
+		.bindings = (module_method_binding_t[]){
+			{ .section = SECTION_NAME(CF_IDENT_ANY, CF_IDENT_ANY), .method = mod_produce, .method_env = &kafka_method_env },
+			MODULE_BINDING_TERMINATOR
+		}
 	}
 };
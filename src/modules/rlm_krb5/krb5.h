@@ -30,6 +30,7 @@ USES_APPLE_DEPRECATED_API
 #include <krb5.h>
 
 #ifdef KRB5_IS_THREAD_SAFE
+#  include <freeradius-devel/unlang/offload.h>
 #  include <freeradius-devel/util/slab.h>
 #endif
 
@@ -50,6 +51,8 @@ typedef struct {
 typedef struct {
 #ifdef KRB5_IS_THREAD_SAFE
 	fr_slab_config_t	reuse;
+	unlang_offload_config_t	offload;	//!< Thread pool configuration for credential checks.
+	unlang_offload_pool_t	*pool;		//!< Thread pool which runs credential checks.
 #else
 	rlm_krb5_handle_t	*conn;
 #endif
@@ -83,6 +86,7 @@ FR_SLAB_FUNCS(krb5, rlm_krb5_handle_t)
 typedef struct {
 	rlm_krb5_t const	*inst;
 	krb5_slab_list_t	*slab;
+	unlang_offload_thread_t	*offload;	//!< This worker's view of the offload pool.
 } rlm_krb5_thread_t;
 #endif
 
@@ -39,6 +39,11 @@ static const conf_parser_t reuse_krb5_config[] = {
 	FR_SLAB_CONFIG_CONF_PARSER
 	CONF_PARSER_TERMINATOR
 };
+
+static const conf_parser_t offload_krb5_config[] = {
+	UNLANG_OFFLOAD_CONFIG_CONF_PARSER
+	CONF_PARSER_TERMINATOR
+};
 #endif
 
 static const conf_parser_t module_config[] = {
@@ -46,6 +51,7 @@ static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("service_principal", rlm_krb5_t, service_princ) },
 #ifdef KRB5_IS_THREAD_SAFE
 	{ FR_CONF_OFFSET_SUBSECTION("reuse", 0, rlm_krb5_t, reuse, reuse_krb5_config) },
+	{ FR_CONF_OFFSET_SUBSECTION("offload", 0, rlm_krb5_t, offload, offload_krb5_config) },
 #endif
 	CONF_PARSER_TERMINATOR
 };
@@ -67,12 +73,23 @@ static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 		return -1;
 	}
 
+	if (!(t->offload = unlang_offload_thread_alloc(t, inst->pool, mctx->el))) {
+		PERROR("Failed creating offload thread data");
+		return -1;
+	}
+
 	return 0;
 }
 
 static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
 {
 	rlm_krb5_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_krb5_thread_t);
+
+	/*
+	 *	Outstanding credential checks hold handles,
+	 *	so wait for them before freeing the slab.
+	 */
+	talloc_free(t->offload);
 	talloc_free(t->slab);
 	return 0;
 }
@@ -237,7 +254,13 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	krb5_verify_init_creds_opt_set_ap_req_nofail(inst->vic_options, true);
 #endif
 
-#ifndef KRB5_IS_THREAD_SAFE
+#ifdef KRB5_IS_THREAD_SAFE
+	inst->pool = unlang_offload_pool_alloc(inst, mctx->mi->name, &inst->offload);
+	if (!inst->pool) {
+		PERROR("Failed creating offload pool");
+		return -1;
+	}
+#else
 	inst->conn = krb5_mod_conn_create(inst, inst, fr_time_delta_wrap(0));
 	if (!inst->conn) return -1;
 #endif
@@ -312,58 +335,55 @@ static rlm_rcode_t krb5_process_error(rlm_krb5_t const *inst, request_t *request
 	}
 }
 
+/** Inputs and outputs for a credential check
+ *
+ * Copied out of the request, as with a thread safe kerberos library,
+ * the check runs in the offload pool.
+ */
+typedef struct {
+	rlm_krb5_t const	*inst;		//!< Instance of rlm_krb5.
+	rlm_krb5_handle_t	*conn;		//!< Handle to use for the check.
+	krb5_principal		client;		//!< Parsed from the username.
+	char			*password;	//!< Password to check.
+#ifndef HEIMDAL_KRB5
+	krb5_creds		init_creds;	//!< TGT retrieved from the KDC.
+#endif
+	krb5_error_code		ret;		//!< Result of the check.
+} rlm_krb5_auth_t;
+
+/** Free the kerberos structures, and return the handle
+ *
+ * The uctx is always freed in the worker which allocated it.
+ */
+static int _krb5_auth_free(rlm_krb5_auth_t *auth)
+{
+	if (auth->client) krb5_free_principal(auth->conn->context, auth->client);
+#ifndef HEIMDAL_KRB5
+	krb5_free_cred_contents(auth->conn->context, &auth->init_creds);
+#endif
+
+#ifdef KRB5_IS_THREAD_SAFE
+	krb5_slab_release(auth->conn);
+#endif
+	return 0;
+}
+
 #ifdef HEIMDAL_KRB5
 
 /*
  *	Validate user/pass (Heimdal)
  */
-static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+static rlm_rcode_t krb5_auth_verify(void *uctx)
 {
-	krb5_auth_call_env_t	*env = talloc_get_type_abort(mctx->env_data, krb5_auth_call_env_t);
-	rlm_krb5_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_krb5_t);
-#  ifdef KRB5_IS_THREAD_SAFE
-	rlm_krb5_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_krb5_thread_t);
-#  endif
-	rlm_rcode_t		rcode;
+	rlm_krb5_auth_t		*auth = talloc_get_type_abort(uctx, rlm_krb5_auth_t);
+	rlm_krb5_handle_t	*conn = auth->conn;
 	krb5_error_code		ret;
-	rlm_krb5_handle_t	*conn;
-	krb5_principal		client = NULL;
-
-	/*
-	 *	Make sure the supplied password isn't empty
-	 */
-	if (env->password.vb_length == 0) {
-		REDEBUG("User-Password must not be empty");
-		RETURN_MODULE_INVALID;
-	}
-
-	/*
-	 *	Log the password
-	 */
-	if (RDEBUG_ENABLED3) {
-		RDEBUG("Login attempt with password \"%pV\"", &env->password);
-	} else {
-		RDEBUG2("Login attempt with password");
-	}
-
-#  ifdef KRB5_IS_THREAD_SAFE
-	conn = krb5_slab_reserve(t->slab);
-	if (!conn) RETURN_MODULE_FAIL;
-#  else
-	conn = inst->conn;
-#  endif
-
-	rcode = krb5_parse_user(&client, inst, request, conn->context, env);
-	if (rcode != RLM_MODULE_OK) goto cleanup;
 
 	/*
 	 *	Verify the user, using the options we set in instantiate
 	 */
-	ret = krb5_verify_user_opt(conn->context, client, env->password.vb_strvalue, &conn->options);
-	if (ret) {
-		rcode = krb5_process_error(inst, request, conn, ret);
-		goto cleanup;
-	}
+	auth->ret = krb5_verify_user_opt(conn->context, auth->client, auth->password, &conn->options);
+	if (auth->ret) return RLM_MODULE_FAIL;
 
 	/*
 	 *	krb5_verify_user_opt adds the credentials to the ccache
@@ -388,15 +408,7 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 		krb5_cc_end_seq_get(conn->context, conn->ccache, &cursor);
 	}
 
-cleanup:
-	if (client) {
-		krb5_free_principal(conn->context, client);
-	}
-
-#  ifdef KRB5_IS_THREAD_SAFE
-	krb5_slab_release(conn);
-#  endif
-	RETURN_MODULE_RCODE(rcode);
+	return RLM_MODULE_OK;
 }
 
 #else  /* HEIMDAL_KRB5 */
@@ -404,20 +416,60 @@ cleanup:
 /*
  *  Validate userid/passwd (MIT)
  */
+static rlm_rcode_t krb5_auth_verify(void *uctx)
+{
+	rlm_krb5_auth_t		*auth = talloc_get_type_abort(uctx, rlm_krb5_auth_t);
+	rlm_krb5_t const	*inst = auth->inst;
+	rlm_krb5_handle_t	*conn = auth->conn;
+
+	/*
+	 * 	Retrieve the TGT from the TGS/KDC and check we can decrypt it.
+	 */
+	auth->ret = krb5_get_init_creds_password(conn->context, &auth->init_creds, auth->client, auth->password,
+						 NULL, NULL, 0, NULL, inst->gic_options);
+	if (auth->ret) return RLM_MODULE_FAIL;
+
+	/*
+	 *	Authenticate against the service principal.
+	 */
+	auth->ret = krb5_verify_init_creds(conn->context, &auth->init_creds, inst->server, conn->keytab, NULL, inst->vic_options);
+	if (auth->ret) return RLM_MODULE_FAIL;
+
+	return RLM_MODULE_OK;
+}
+
+#endif /* MIT_KRB5 */
+
+/** Translate the result of the credential check into an rcode
+ *
+ */
+static rlm_rcode_t krb5_auth_result(request_t *request, rlm_krb5_auth_t *auth)
+{
+	if (auth->ret) return krb5_process_error(auth->inst, request, auth->conn, auth->ret);
+
+	return RLM_MODULE_OK;
+}
+
+#ifdef KRB5_IS_THREAD_SAFE
+static unlang_action_t CC_HINT(nonnull) mod_authenticate_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+								request_t *request)
+{
+	rlm_krb5_auth_t		*auth = talloc_get_type_abort(mctx->rctx, rlm_krb5_auth_t);
+
+	RETURN_MODULE_RCODE(krb5_auth_result(request, auth));
+}
+#endif
+
 static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	krb5_auth_call_env_t	*env = talloc_get_type_abort(mctx->env_data, krb5_auth_call_env_t);
 	rlm_krb5_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_krb5_t);
-#  ifdef KRB5_IS_THREAD_SAFE
+#ifdef KRB5_IS_THREAD_SAFE
 	rlm_krb5_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_krb5_thread_t);
-#  endif
+#endif
 	rlm_rcode_t		rcode;
-	krb5_error_code		ret;
-
 	rlm_krb5_handle_t	*conn;
-
-	krb5_principal		client = NULL;	/* actually a pointer value */
-	krb5_creds		init_creds;
+	rlm_krb5_auth_t		*auth;
 
 	/*
 	 *	Make sure the supplied password isn't empty
@@ -436,52 +488,52 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 		RDEBUG2("Login attempt with password");
 	}
 
-#  ifdef KRB5_IS_THREAD_SAFE
+#ifdef KRB5_IS_THREAD_SAFE
 	conn = krb5_slab_reserve(t->slab);
 	if (!conn) RETURN_MODULE_FAIL;
-#  else
+#else
 	conn = inst->conn;
-#  endif
+#endif
 
-	/*
-	 *	Zero out local storage
-	 */
-	memset(&init_creds, 0, sizeof(init_creds));
+	MEM(auth = talloc_zero(NULL, rlm_krb5_auth_t));
+	auth->inst = inst;
+	auth->conn = conn;
+	talloc_set_destructor(auth, _krb5_auth_free);
 
 	/*
 	 *	Check we have all the required VPs, and convert the username
 	 *	into a principal.
 	 */
-	rcode = krb5_parse_user(&client, inst, request, conn->context, env);
-	if (rcode != RLM_MODULE_OK) goto cleanup;
-
-	/*
-	 * 	Retrieve the TGT from the TGS/KDC and check we can decrypt it.
-	 */
-	RDEBUG2("Retrieving and decrypting TGT");
-	ret = krb5_get_init_creds_password(conn->context, &init_creds, client, UNCONST(char *, env->password.vb_strvalue),
-					   NULL, NULL, 0, NULL, inst->gic_options);
-	if (ret) {
-		rcode = krb5_process_error(inst, request, conn, ret);
-		goto cleanup;
+	rcode = krb5_parse_user(&auth->client, inst, request, conn->context, env);
+	if (rcode != RLM_MODULE_OK) {
+		talloc_free(auth);
+		RETURN_MODULE_RCODE(rcode);
 	}
+	MEM(auth->password = talloc_bstrndup(auth, env->password.vb_strvalue, env->password.vb_length));
 
-	RDEBUG2("Attempting to authenticate against service principal");
-	ret = krb5_verify_init_creds(conn->context, &init_creds, inst->server, conn->keytab, NULL, inst->vic_options);
-	if (ret) rcode = krb5_process_error(inst, request, conn, ret);
+#ifndef HEIMDAL_KRB5
+	RDEBUG2("Retrieving and decrypting TGT, and authenticating against service principal");
+#endif
 
-cleanup:
-	if (client) krb5_free_principal(conn->context, client);
-	krb5_free_cred_contents(conn->context, &init_creds);
+#ifdef KRB5_IS_THREAD_SAFE
+	/*
+	 *	The KDC may be slow, or unreachable, so the
+	 *	check runs in the offload pool.
+	 */
+	return unlang_offload_yield(p_result, mctx, request, t->offload, krb5_auth_verify, mod_authenticate_resume, auth);
+#else
+	/*
+	 *	The library isn't thread safe, so there's only one
+	 *	handle, and the check has to be run in the worker.
+	 */
+	krb5_auth_verify(auth);
+	rcode = krb5_auth_result(request, auth);
+	talloc_free(auth);
 
-#  ifdef KRB5_IS_THREAD_SAFE
-	krb5_slab_release(conn);
-#  endif
 	RETURN_MODULE_RCODE(rcode);
+#endif
 }
 
-#endif /* MIT_KRB5 */
-
 static const call_env_method_t krb5_auth_call_env = {
 	FR_CALL_ENV_METHOD_OUT(krb5_auth_call_env_t),
 	.env = (call_env_parser_t[]) {
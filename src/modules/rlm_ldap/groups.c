@@ -336,6 +336,47 @@ finish:
 	RETURN_MODULE_RCODE(rcode);
 }
 
+/** Resolve group DNs to names using entries in the group replica
+ *
+ * Stops at the first DN which isn't in the replica, so that it can be
+ * resolved with a directory search.
+ *
+ * @param[in] request		Current request.
+ * @param[in] group_ctx		The group resolution context.
+ */
+static void ldap_group_dn2name_replica(request_t *request, ldap_group_userobj_ctx_t *group_ctx)
+{
+	rlm_ldap_t const	*inst = group_ctx->inst;
+	LDAP			*handle = fr_ldap_handle_thread_local();
+
+	if (!inst->group.replica || !inst->group.obj_name_attr) return;
+
+	while (*group_ctx->dn) {
+		fr_ldap_replica_entry_t	*entry;
+		struct berval		**values;
+		fr_pair_t		*vp;
+
+		entry = fr_ldap_replica_acquire_by_dn(inst->group.replica, *group_ctx->dn);
+		if (!entry) return;
+
+		values = ldap_get_values_len(handle, fr_ldap_replica_entry_msg(entry), inst->group.obj_name_attr);
+		if (!values) {
+			fr_ldap_replica_release(entry);
+			return;
+		}
+
+		MEM(vp = fr_pair_afrom_da(group_ctx->list_ctx, inst->group.cache_da));
+		fr_pair_value_bstrndup(vp, values[0]->bv_val, values[0]->bv_len, true);
+		fr_pair_append(&group_ctx->groups, vp);
+		RDEBUG2("Group DN \"%s\" resolves to name \"%pV\" (from replica)", *group_ctx->dn, &vp->data);
+
+		ldap_value_free_len(values);
+		fr_ldap_replica_release(entry);
+
+		group_ctx->dn++;
+	}
+}
+
 /** Move user object group attributes to the control list
  *
  * @param p_result	The result of adding user object group attributes
@@ -400,8 +441,10 @@ static unlang_action_t ldap_cacheable_userobj_resolve(rlm_rcode_t *p_result, UNU
 	/*
 	 *	Are there any DN to resolve to names?
 	 *	These are resolved one at a time as most directories don't allow for
-	 *	filters on the DN.
+	 *	filters on the DN.  Any which are in the group replica
+	 *	don't need a search at all.
 	 */
+	ldap_group_dn2name_replica(request, group_ctx);
 	if (*group_ctx->dn) {
 		if (unlang_function_repeat_set(request, ldap_cacheable_userobj_resolve) < 0) RETURN_MODULE_FAIL;
 		if (unlang_function_push(request, ldap_group_dn2name_start, ldap_group_dn2name_resume,
@@ -119,6 +119,7 @@ static conf_parser_t user_config[] = {
 	{ FR_CONF_OFFSET("access_value_negate", rlm_ldap_t, user.access_value_negate), .dflt = "false" },
 	{ FR_CONF_OFFSET("access_value_suspend", rlm_ldap_t, user.access_value_suspend), .dflt = "suspended" },
 	{ FR_CONF_OFFSET_IS_SET("expect_password", FR_TYPE_BOOL, 0, rlm_ldap_t, user.expect_password) },
+	{ FR_CONF_OFFSET("replica", rlm_ldap_t, user.obj_replica) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -139,6 +140,7 @@ static conf_parser_t group_config[] = {
 	{ FR_CONF_OFFSET("group_attribute", rlm_ldap_t, group.attribute) },
 	{ FR_CONF_OFFSET("allow_dangling_group_ref", rlm_ldap_t, group.allow_dangling_refs), .dflt = "no" },
 	{ FR_CONF_OFFSET("skip_on_suspend", rlm_ldap_t, group.skip_on_suspend), .dflt = "yes"},
+	{ FR_CONF_OFFSET("replica", rlm_ldap_t, group.obj_replica) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -221,6 +223,8 @@ static const call_env_method_t authorize_method_env = {
 		{ FR_CALL_ENV_SUBSECTION("user", NULL, CALL_ENV_FLAG_REQUIRED,
 					 ((call_env_parser_t[]) {
 						USER_CALL_ENV_COMMON(ldap_autz_call_env_t),
+						{ FR_CALL_ENV_OFFSET("replica_key", FR_TYPE_STRING, CALL_ENV_FLAG_NULLABLE | CALL_ENV_FLAG_CONCAT,
+								     ldap_autz_call_env_t, user_replica_key) },
 						CALL_ENV_TERMINATOR
 					 })) },
 		{ FR_CALL_ENV_SUBSECTION("group", NULL, CALL_ENV_FLAG_NONE,
@@ -1518,6 +1522,16 @@ static unlang_action_t mod_authorize_start(UNUSED rlm_rcode_t *p_result, UNUSED
 					&autz_ctx->query);
 }
 
+/** Start LDAP authorization with a user entry found in the replica
+ *
+ * There's nothing to wait for, so go straight to processing the entry.
+ */
+static unlang_action_t mod_authorize_replica_start(rlm_rcode_t *p_result, UNUSED int *priority,
+						   UNUSED request_t *request, UNUSED void *uctx)
+{
+	RETURN_MODULE_OK;
+}
+
 #define REPEAT_MOD_AUTHORIZE_RESUME \
 	if (unlang_function_repeat_set(request, mod_authorize_resume) < 0) do { \
 		rcode = RLM_MODULE_FAIL; \
@@ -1569,7 +1583,11 @@ static unlang_action_t mod_authorize_resume(rlm_rcode_t *p_result, UNUSED int *p
 		 */
 		if (*p_result != RLM_MODULE_OK) return UNLANG_ACTION_CALCULATE_RESULT;
 
-		autz_ctx->entry = ldap_first_entry(handle, autz_ctx->query->result);
+		if (autz_ctx->replica_entry) {
+			autz_ctx->entry = fr_ldap_replica_entry_msg(autz_ctx->replica_entry);
+		} else {
+			autz_ctx->entry = ldap_first_entry(handle, autz_ctx->query->result);
+		}
 		if (!autz_ctx->entry) {
 			ldap_get_option(handle, LDAP_OPT_RESULT_CODE, &ldap_errno);
 			REDEBUG("Failed retrieving entry: %s", ldap_err2string(ldap_errno));
@@ -1835,9 +1853,67 @@ static int autz_ctx_free(ldap_autz_ctx_t *autz_ctx)
 {
 	talloc_free(autz_ctx->expanded.ctx);
 	if (autz_ctx->profile_values) ldap_value_free_len(autz_ctx->profile_values);
+	fr_ldap_replica_release(autz_ctx->replica_entry);
 	return 0;
 }
 
+/** Check a user entry found in the replica would have been returned by a directory search
+ *
+ * The entry must be within the user base_dn and scope, and must match the user filter.
+ * Filters we can't evaluate locally with certainty are treated as a mismatch, so the
+ * caller falls back to searching the directory.
+ *
+ * @param[in] request	being processed.
+ * @param[in] inst	of rlm_ldap.
+ * @param[in] call_env	containing the expanded base_dn and filter.
+ * @param[in] entry	found in the replica.
+ * @return
+ *	- true if the entry can be used.
+ *	- false if the directory should be searched instead.
+ */
+static bool ldap_replica_user_match(request_t *request, rlm_ldap_t const *inst,
+				    ldap_autz_call_env_t const *call_env, fr_ldap_replica_entry_t const *entry)
+{
+	fr_dlist_head_t		*filter = NULL;
+	fr_ldap_connection_t	conn = { .handle = fr_ldap_handle_thread_local() };
+	char const		*base_dn = "";
+	bool			ret;
+
+	if (call_env->user_base.type == FR_TYPE_STRING) base_dn = call_env->user_base.vb_strvalue;
+
+	if (!fr_ldap_replica_entry_in_scope(entry, base_dn, inst->user.obj_scope)) {
+		RDEBUG2("User object in replica is outside of base_dn \"%s\"", base_dn);
+		return false;
+	}
+
+	if (call_env->user_filter.type != FR_TYPE_STRING) return true;
+
+	/*
+	 *	A negated test matches when an attribute is missing,
+	 *	and the replica may not hold every attribute the
+	 *	directory would evaluate.  Escapes aren't decoded
+	 *	by the local evaluator, so values containing them
+	 *	can't be compared reliably either.
+	 */
+	if (strchr(call_env->user_filter.vb_strvalue, '!') || strchr(call_env->user_filter.vb_strvalue, '\\')) {
+		RDEBUG2("User filter can't be evaluated against the replica");
+		return false;
+	}
+
+	if (fr_ldap_filter_parse(NULL, &filter, &FR_SBUFF_IN(call_env->user_filter.vb_strvalue,
+							   call_env->user_filter.vb_length), NULL, NULL) < 0) {
+		RPDEBUG2("Failed parsing user filter for replica lookup");
+		return false;
+	}
+
+	ret = fr_ldap_filter_eval(filter, &conn, fr_ldap_replica_entry_msg(entry));
+	talloc_free(filter);
+
+	if (!ret) RDEBUG2("User object in replica doesn't match filter %pV", &call_env->user_filter);
+
+	return ret;
+}
+
 static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_ldap_t const 	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_ldap_t);
@@ -1897,6 +1973,47 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, mod
 	autz_ctx->call_env = call_env;
 	autz_ctx->status = LDAP_AUTZ_FIND;
 
+	/*
+	 *	If the user is in the local replica, there's no
+	 *	need to search the directory for them.  If they're
+	 *	not, the replica may not have caught up yet, so
+	 *	fall back to a normal search.  The same goes for
+	 *	entries the search itself wouldn't have returned.
+	 */
+	if (inst->user.replica && (call_env->user_replica_key.type == FR_TYPE_STRING)) {
+		autz_ctx->replica_entry = fr_ldap_replica_acquire(inst->user.replica,
+								  call_env->user_replica_key.vb_strvalue);
+		if (autz_ctx->replica_entry &&
+		    !ldap_replica_user_match(request, inst, call_env, autz_ctx->replica_entry)) {
+			fr_ldap_replica_release(autz_ctx->replica_entry);
+			autz_ctx->replica_entry = NULL;
+		}
+
+		if (autz_ctx->replica_entry) {
+			fr_pair_t	*vp;
+			char const	*dn = fr_ldap_replica_entry_dn(autz_ctx->replica_entry);
+			char		*dn_norm;
+
+			MEM(dn_norm = talloc_array(autz_ctx, char, strlen(dn) + 1));
+			fr_ldap_util_normalise_dn(dn_norm, dn);
+
+			RDEBUG2("User object found in replica at DN \"%s\"", dn_norm);
+
+			MEM(pair_update_control(&vp, attr_ldap_userdn) >= 0);
+			fr_pair_value_strdup(vp, dn_norm, false);
+			talloc_free(dn_norm);
+
+			if (unlang_function_push(request, mod_authorize_replica_start, mod_authorize_resume,
+						 mod_authorize_cancel, ~FR_SIGNAL_CANCEL, UNLANG_SUB_FRAME, autz_ctx) < 0) {
+				RETURN_MODULE_FAIL;
+			}
+
+			return UNLANG_ACTION_PUSHED_CHILD;
+		}
+
+		RDEBUG3("User not found in replica, searching the directory");
+	}
+
 	if (unlang_function_push(request, mod_authorize_start, mod_authorize_resume, mod_authorize_cancel,
 				 ~FR_SIGNAL_CANCEL, UNLANG_SUB_FRAME, autz_ctx) < 0) RETURN_MODULE_FAIL;
 
@@ -2616,6 +2733,26 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	SSS_CONTROL_BUILD(user)
 	SSS_CONTROL_BUILD(profile)
 
+	/*
+	 *	Replicas are populated by an ldap_sync listener
+	 *	with a matching "replica" name.
+	 */
+	if (inst->user.obj_replica) {
+		inst->user.replica = fr_ldap_replica_get(inst->user.obj_replica);
+		if (!inst->user.replica) {
+			cf_log_perr(conf, "Failed configuring user replica");
+			goto error;
+		}
+	}
+
+	if (inst->group.obj_replica) {
+		inst->group.replica = fr_ldap_replica_get(inst->group.obj_replica);
+		if (!inst->group.replica) {
+			cf_log_perr(conf, "Failed configuring group replica");
+			goto error;
+		}
+	}
+
 	if (inst->handle_config.tls_require_cert_str) {
 		/*
 		 *	Convert cert strictness to enumerated constants
@@ -16,6 +16,7 @@
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/ldap/base.h>
+#include <freeradius-devel/ldap/replica.h>
 
 typedef struct {
 	/*
@@ -47,6 +48,9 @@ typedef struct {
 		bool		expect_password;		//!< Allow the user to forcefully decide if a password should be
 								///< expected.  Controls whether warnings are issued.
 		bool		expect_password_is_set;		//!< Whether an expect password value was provided.
+
+		char const	*obj_replica;			//!< Name of the ldap_sync replica to look for users in.
+		fr_ldap_replica_t *replica;			//!< Replica to look for users in.
 	} user;
 
 	/*
@@ -88,6 +92,10 @@ typedef struct {
 								///< from a user object.
 
 		bool		skip_on_suspend;		//!< Don't process groups if the user is suspended.
+
+		char const	*obj_replica;			//!< Name of the ldap_sync replica to resolve group
+								///< DNs to names with.
+		fr_ldap_replica_t *replica;			//!< Replica to resolve group DNs with.
 	} group;
 
 	char const	*valuepair_attr;		//!< Generic dynamic mapping attribute, contains a RADIUS
@@ -135,6 +143,7 @@ typedef struct {
 typedef struct {
 	fr_value_box_t	user_base;			//!< Base DN in which to search for users.
 	fr_value_box_t	user_filter;			//!< Filter to use when searching for users.
+	fr_value_box_t	user_replica_key;		//!< Value to look up in the user replica.
 	fr_value_box_t 	group_base;			//!< Base DN in which to search for groups.
 	tmpl_t		*group_filter;			//!< tmpl to expand as group membership filter.
 	fr_value_box_t	default_profile;		//!< If this is set, we will search for a profile object
@@ -196,6 +205,7 @@ typedef struct {
 	fr_ldap_thread_trunk_t	*ttrunk;
 	ldap_autz_call_env_t	*call_env;
 	LDAPMessage		*entry;
+	fr_ldap_replica_entry_t	*replica_entry;		//!< User entry, if it was found in the replica.
 	ldap_autz_status_t	status;
 	struct berval		**profile_values;
 	int			value_idx;
@@ -0,0 +1 @@
+SUBMAKEFILES := rlm_mem_ippool.mk mem_ippool_tests.mk
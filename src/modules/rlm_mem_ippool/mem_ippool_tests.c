@@ -0,0 +1,416 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the mem_ippool snapshot and journal
+ *
+ * Leases are allocated, the module is stopped with or without writing a
+ * final snapshot, and then started again from the files on disk.
+ *
+ * @file src/modules/rlm_mem_ippool/mem_ippool_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+static void test_init(void);
+static void test_fini(void);
+#  define TEST_INIT  test_init()
+#  define TEST_FINI  test_fini()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <sys/stat.h>
+
+/*
+ *	Include the source, so the tests can get at the
+ *	pools and the journal.
+ */
+#include "rlm_mem_ippool.c"
+
+#define TEST_POOL_SIZE	64
+
+static TALLOC_CTX		*autofree;
+static char			test_dir[] = "/tmp/mem_ippool_tests.XXXXXX";
+static mem_ippool_pool_conf_t	test_pool_conf;
+
+/** A lease which was allocated before a restart
+ *
+ */
+typedef struct {
+	char		owner[32];
+	uint32_t	i;
+	int64_t		expires;
+} test_lease_t;
+
+/** Start the module, loading any leases which are already on disk
+ *
+ */
+static rlm_mem_ippool_t *test_start(uint32_t journal_max_records)
+{
+	rlm_mem_ippool_t	*inst;
+	mem_ippool_pool_t	*pool;
+
+	MEM(inst = talloc_zero(autofree, rlm_mem_ippool_t));
+	MEM(inst->filename = talloc_asprintf(inst, "%s/leases", test_dir));
+	inst->snapshot_interval = fr_time_delta_from_sec(300);
+	inst->journal_max_records = journal_max_records;
+
+	inst->mutable = mem_ippool_mutable_alloc();
+	pool = mem_ippool_pool_alloc(inst->mutable, "test", &test_pool_conf, TEST_POOL_SIZE,
+				     fr_time_to_sec(fr_time()));
+	TEST_ASSERT(fr_rb_insert(inst->mutable->pools, pool));
+
+	TEST_ASSERT_(mem_ippool_open(inst) == 0, "Loading leases from %s", inst->filename);
+
+	return inst;
+}
+
+/** Stop the module without writing a final snapshot, as if the server had crashed
+ *
+ */
+static void test_crash(rlm_mem_ippool_t *inst)
+{
+	mem_ippool_mutable_free(inst->mutable);
+	talloc_free(inst);
+}
+
+/** Stop the module cleanly
+ *
+ */
+static void test_stop(rlm_mem_ippool_t *inst)
+{
+	mem_ippool_close(inst);
+	mem_ippool_mutable_free(inst->mutable);
+	talloc_free(inst);
+}
+
+static mem_ippool_pool_t *test_pool(rlm_mem_ippool_t const *inst)
+{
+	return fr_rb_find(inst->mutable->pools, &(mem_ippool_pool_t){ .name = "test" });
+}
+
+/** Allocate a free lease, the same way mod_alloc does
+ *
+ */
+static void test_allocate(rlm_mem_ippool_t const *inst, test_lease_t *lease, char const *owner)
+{
+	mem_ippool_pool_t	*pool = test_pool(inst);
+	int64_t			now = fr_time_to_sec(fr_time());
+
+	strlcpy(lease->owner, owner, sizeof(lease->owner));
+
+	pthread_mutex_lock(&pool->mutex);
+	pool_expire(pool, now);
+
+	lease->i = pool->free_head;
+	TEST_CHECK(lease->i != MEM_IPPOOL_NONE);
+	if (lease->i == MEM_IPPOOL_NONE) {
+		pthread_mutex_unlock(&pool->mutex);
+		return;
+	}
+
+	lease_bind(pool, lease->i, owner, strlen(owner), now + 3600);
+	mem_ippool_journal(inst, pool, lease->i, now, false);
+	lease->expires = pool->leases[lease->i].expires;
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/** Release a lease, the same way mod_release does
+ *
+ */
+static void test_release(rlm_mem_ippool_t const *inst, test_lease_t *lease)
+{
+	mem_ippool_pool_t	*pool = test_pool(inst);
+	int64_t			now = fr_time_to_sec(fr_time());
+
+	pthread_mutex_lock(&pool->mutex);
+	lease_release(pool, lease->i, now);
+	mem_ippool_journal(inst, pool, lease->i, now, true);
+	lease->expires = pool->leases[lease->i].expires;
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/** Check a lease has the same owner and expiry time as before the restart
+ *
+ */
+static void test_check(rlm_mem_ippool_t const *inst, test_lease_t const *expected, bool in_use)
+{
+	mem_ippool_pool_t	*pool = test_pool(inst);
+	mem_ippool_lease_t	*lease;
+
+	lease = fr_hash_table_find(pool->owners, &(mem_ippool_lease_t){ .owner = UNCONST(char *, expected->owner),
+									 .owner_len = strlen(expected->owner) });
+	TEST_CHECK(lease != NULL);
+	TEST_MSG("No lease for owner %s", expected->owner);
+	if (!lease) return;
+
+	TEST_CHECK((uint32_t)(lease - pool->leases) == expected->i);
+	TEST_MSG("Owner %s has lease %u, expected %u", expected->owner, (uint32_t)(lease - pool->leases), expected->i);
+
+	TEST_CHECK(lease->expires == expected->expires);
+	TEST_MSG("Lease for %s expires at %" PRId64 ", expected %" PRId64,
+		 expected->owner, lease->expires, expected->expires);
+
+	TEST_CHECK((lease->slot != MEM_IPPOOL_FREE) == in_use);
+	TEST_MSG("Lease for %s is %s", expected->owner, in_use ? "free" : "in use");
+}
+
+/** Get the size of one of the lease files
+ *
+ * @return
+ *	- The size of the file.
+ *	- -1 if it doesn't exist.
+ */
+static off_t test_file_size(char const *suffix)
+{
+	char		path[sizeof(test_dir) + 32];
+	struct stat	st;
+
+	snprintf(path, sizeof(path), "%s/leases%s", test_dir, suffix);
+	if (stat(path, &st) < 0) return -1;
+
+	return st.st_size;
+}
+
+/** Wait for the snapshot thread to catch up
+ *
+ */
+static bool test_snapshot_wait(rlm_mem_ippool_t const *inst)
+{
+	int i;
+
+	for (i = 0; i < 500; i++) {
+		bool done;
+
+		pthread_mutex_lock(&inst->mutable->mutex);
+		done = !mem_ippool_snapshot_due(inst) && !inst->mutable->rotated;
+		pthread_mutex_unlock(&inst->mutable->mutex);
+
+		if (done) return true;
+		usleep(10000);
+	}
+
+	return false;
+}
+
+static void test_journal_replay(void)
+{
+	rlm_mem_ippool_t	*inst;
+	test_lease_t		leases[3];
+
+	TEST_CASE("Leases survive a crash before any snapshot is written");
+	inst = test_start(100000);
+	test_allocate(inst, &leases[0], "00:00:00:00:00:01");
+	test_allocate(inst, &leases[1], "00:00:00:00:00:02");
+	test_allocate(inst, &leases[2], "00:00:00:00:00:03");
+	test_release(inst, &leases[1]);
+	TEST_CHECK(test_file_size(".journal") > 0);
+	test_crash(inst);
+
+	inst = test_start(100000);
+	test_check(inst, &leases[0], true);
+	test_check(inst, &leases[1], false);
+	test_check(inst, &leases[2], true);
+
+	TEST_CASE("The journal is compacted into the snapshot on startup");
+	TEST_CHECK(test_file_size("") > 0);
+	TEST_CHECK(test_file_size(".journal") == 0);
+
+	test_stop(inst);
+}
+
+static void test_clean_stop(void)
+{
+	rlm_mem_ippool_t	*inst;
+	test_lease_t		leases[2];
+
+	TEST_CASE("Leases survive a clean restart");
+	inst = test_start(100000);
+	test_allocate(inst, &leases[0], "00:00:00:00:00:01");
+	test_allocate(inst, &leases[1], "00:00:00:00:00:02");
+	test_stop(inst);
+
+	TEST_CHECK(test_file_size(".journal") == 0);
+
+	inst = test_start(100000);
+	test_check(inst, &leases[0], true);
+	test_check(inst, &leases[1], true);
+	test_stop(inst);
+}
+
+static void test_snapshot_thread(void)
+{
+	rlm_mem_ippool_t	*inst;
+	test_lease_t		leases[32];
+	size_t			i;
+
+	TEST_CASE("Snapshots are written by the snapshot thread");
+	inst = test_start(4);
+	for (i = 0; i < NUM_ELEMENTS(leases); i++) {
+		char owner[32];
+
+		snprintf(owner, sizeof(owner), "00:00:00:00:01:%02zx", i);
+		test_allocate(inst, &leases[i], owner);
+	}
+	TEST_CHECK(test_snapshot_wait(inst));
+	TEST_MSG("Snapshot thread didn't write a snapshot");
+
+	TEST_CHECK(test_file_size("") > 0);
+	TEST_CHECK(test_file_size(".journal.old") < 0);
+
+	/*
+	 *	Some of these are only in the journal.
+	 */
+	test_release(inst, &leases[0]);
+	test_release(inst, &leases[31]);
+
+	TEST_CASE("Leases survive a crash after snapshots have been written");
+	test_crash(inst);
+
+	inst = test_start(4);
+	for (i = 0; i < NUM_ELEMENTS(leases); i++) {
+		test_check(inst, &leases[i], (i != 0) && (i != (NUM_ELEMENTS(leases) - 1)));
+	}
+	test_stop(inst);
+}
+
+static void test_interrupted_snapshot(void)
+{
+	rlm_mem_ippool_t	*inst;
+	test_lease_t		leases[4];
+
+	TEST_CASE("Leases survive a crash while a snapshot is being written");
+	inst = test_start(100000);
+	test_allocate(inst, &leases[0], "00:00:00:00:00:01");
+	test_allocate(inst, &leases[1], "00:00:00:00:00:02");
+
+	/*
+	 *	Do what the snapshot thread does before copying
+	 *	the pools, and then stop.
+	 */
+	pthread_mutex_lock(&inst->mutable->mutex);
+	TEST_CHECK(mem_ippool_journal_rotate(inst) == 0);
+	inst->mutable->rotated = true;
+	pthread_mutex_unlock(&inst->mutable->mutex);
+
+	test_allocate(inst, &leases[2], "00:00:00:00:00:03");
+	test_release(inst, &leases[0]);
+	test_allocate(inst, &leases[3], "00:00:00:00:00:04");
+	test_crash(inst);
+
+	TEST_CHECK(test_file_size(".journal.old") > 0);
+
+	inst = test_start(100000);
+	test_check(inst, &leases[0], false);
+	test_check(inst, &leases[1], true);
+	test_check(inst, &leases[2], true);
+	test_check(inst, &leases[3], true);
+
+	TEST_CASE("The old journal is removed once it's in a snapshot");
+	TEST_CHECK(test_file_size(".journal.old") < 0);
+
+	test_stop(inst);
+}
+
+/** Append text to the journal, as if another record had been written
+ *
+ */
+static void test_journal_write(rlm_mem_ippool_t const *inst, char const *text, size_t len)
+{
+	pthread_mutex_lock(&inst->mutable->mutex);
+	TEST_CHECK(write(inst->mutable->fd, text, len) == (ssize_t)len);
+	pthread_mutex_unlock(&inst->mutable->mutex);
+}
+
+static void test_long_record(void)
+{
+	rlm_mem_ippool_t	*inst;
+	test_lease_t		leases[2];
+	char			*record;
+	size_t			len;
+
+	TEST_CASE("Records after a very long record are replayed");
+	inst = test_start(100000);
+	test_allocate(inst, &leases[0], "00:00:00:00:00:01");
+
+	/*
+	 *	A record for an unknown pool is ignored, but it must
+	 *	be read in full, or the rest of the journal is lost.
+	 */
+	len = 4096;
+	MEM(record = talloc_array(autofree, char, len + 1));
+	memcpy(record, "release ", 8);
+	memset(record + 8, 'p', len - 8);
+	memcpy(record + len - 13, " 192.0.2.1 0\n", 13);
+	record[len] = '\0';
+	test_journal_write(inst, record, len);
+	talloc_free(record);
+
+	test_allocate(inst, &leases[1], "00:00:00:00:00:02");
+
+	TEST_CASE("A truncated record at the end of the journal is ignored");
+	test_journal_write(inst, "lease test 192.0.2", 18);
+	test_crash(inst);
+
+	inst = test_start(100000);
+	test_check(inst, &leases[0], true);
+	test_check(inst, &leases[1], true);
+	test_stop(inst);
+}
+
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("mem_ippool_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_time_start() < 0) goto error;
+
+	if (fr_inet_pton4(&test_pool_conf.start, "192.0.2.1", -1, false, false, false) < 0) goto error;
+	if (fr_inet_pton4(&test_pool_conf.end, "192.0.2.64", -1, false, false, false) < 0) goto error;
+
+	if (!mkdtemp(test_dir)) {
+		fr_strerror_printf("Failed creating %s: %s", test_dir, fr_syserror(errno));
+		goto error;
+	}
+}
+
+static void test_fini(void)
+{
+	char const	*suffixes[] = { "", ".tmp", ".journal", ".journal.old" };
+	size_t		i;
+
+	for (i = 0; i < NUM_ELEMENTS(suffixes); i++) {
+		char path[sizeof(test_dir) + 32];
+
+		snprintf(path, sizeof(path), "%s/leases%s", test_dir, suffixes[i]);
+		(void) unlink(path);
+	}
+	(void) rmdir(test_dir);
+}
+
+TEST_LIST = {
+	{ "journal_replay",		test_journal_replay },
+	{ "clean_stop",			test_clean_stop },
+	{ "snapshot_thread",		test_snapshot_thread },
+	{ "interrupted_snapshot",	test_interrupted_snapshot },
+	{ "long_record",		test_long_record },
+
+	{ NULL }
+};
@@ -0,0 +1,1394 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_mem_ippool.c
+ * @brief IP Allocation module with an in-memory backend.
+ *
+ * Each pool is a contiguous range of addresses, with one lease structure
+ * per address.  Free leases are kept in a list, ordered by when they
+ * were released, so that an address is reused as late as possible.
+ * Leases which are in use are kept in a timer wheel with one slot per
+ * second, and are moved back to the free list when they expire.
+ *
+ * The last owner of each lease is kept in a hash table, so that devices
+ * are given the same address again if it hasn't been reused.
+ *
+ * Allocate, renew and release are O(1), with each pool protected by its
+ * own mutex.
+ *
+ * Changes are appended to a journal.  A snapshot of all leases is written
+ * periodically by a background thread, which first moves the journal
+ * aside, then copies each pool in turn, and only writes the snapshot once
+ * no locks are held.  The old journal is removed once the snapshot is on
+ * disk.  On startup, the snapshot is loaded, and then the old journal and
+ * the journal are replayed.
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/module_rlm.h>
+
+#include <freeradius-devel/util/base16.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/nbo.h>
+
+#include <freeradius-devel/unlang/call_env.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+
+#define MEM_IPPOOL_NONE		UINT32_MAX	//!< End of a list of leases.
+#define MEM_IPPOOL_FREE		UINT32_MAX	//!< Lease is in the free list, rather than the wheel.
+#define MEM_IPPOOL_WHEEL_SIZE	4096		//!< Number of slots in the expiry wheel, one per second.
+#define MEM_IPPOOL_MAX_OWNER	253		//!< Maximum length of a lease owner identifier.
+#define MEM_IPPOOL_MAX_SIZE	(1 << 24)	//!< Maximum number of addresses in a pool.
+
+typedef enum {
+	MEM_IPPOOL_RCODE_SUCCESS = 0,
+	MEM_IPPOOL_RCODE_NOT_FOUND = -1,
+	MEM_IPPOOL_RCODE_DEVICE_MISMATCH = -2,
+	MEM_IPPOOL_RCODE_POOL_EMPTY = -3,
+	MEM_IPPOOL_RCODE_FAIL = -4
+} mem_ippool_rcode_t;
+
+/** A lease on a single address
+ *
+ * The index of the lease in the pool is the offset of the address from the
+ * start of the pool.
+ */
+typedef struct {
+	uint32_t		prev;		//!< Previous lease in the free list or wheel slot.
+	uint32_t		next;		//!< Next lease in the free list or wheel slot.
+	uint32_t		slot;		//!< Wheel slot the lease is in, or #MEM_IPPOOL_FREE.
+
+	int64_t			expires;	//!< When the lease expires, in seconds since the epoch.
+
+	char			*owner;		//!< Current, or last, owner of the lease.
+	size_t			owner_len;	//!< Length of the owner identifier.
+} mem_ippool_lease_t;
+
+/** Configuration for a pool
+ *
+ */
+typedef struct {
+	fr_ipaddr_t		start;		//!< First address in the pool.
+	fr_ipaddr_t		end;		//!< Last address in the pool.
+} mem_ippool_pool_conf_t;
+
+/** Leases for a pool
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;		//!< Entry in the tree of pools.
+	char const		*name;		//!< Name of the pool.
+	mem_ippool_pool_conf_t const *conf;	//!< Configuration for the pool.
+
+	pthread_mutex_t		mutex;		//!< Protects everything below.
+
+	uint32_t		num;		//!< Number of addresses in the pool.
+	mem_ippool_lease_t	*leases;	//!< Array of leases, one per address.
+	fr_hash_table_t		*owners;	//!< Leases by owner.
+
+	uint32_t		free_head;	//!< Lease which was released longest ago.
+	uint32_t		free_tail;	//!< Lease which was released most recently.
+
+	uint32_t		wheel[MEM_IPPOOL_WHEEL_SIZE];	//!< Leases in use, by expiry second.
+	int64_t			wheel_time;	//!< Second which the wheel has been advanced to.
+} mem_ippool_pool_t;
+
+/** State shared between all threads
+ *
+ */
+typedef struct {
+	fr_rb_tree_t		*pools;		//!< Pools by name.  Read only after instantiation.
+
+	pthread_mutex_t		mutex;		//!< Protects the journal.
+	pthread_cond_t		cond;		//!< Signalled when a snapshot is due.
+	int			fd;		//!< Journal file descriptor.
+	uint32_t		records;	//!< Records written since the last snapshot.
+	fr_time_t		last_snapshot;	//!< When the last snapshot was started.
+	bool			rotated;	//!< The old journal is needed until a snapshot is written.
+
+	pthread_t		thread;		//!< Writes snapshots in the background.
+	bool			running;	//!< The snapshot thread has been started.
+	bool			stop;		//!< Tell the snapshot thread to exit.
+} mem_ippool_mutable_t;
+
+/** rlm_mem_ippool module instance
+ *
+ */
+typedef struct {
+	char const		*filename;		//!< Snapshot file.  The journal has ".journal" appended.
+	char const		*journal_filename;	//!< Journal file.
+	char const		*journal_old_filename;	//!< Journal which is being written to a snapshot.
+
+	fr_time_delta_t		snapshot_interval;	//!< How often a snapshot is written.
+	uint32_t		journal_max_records;	//!< Write a snapshot once the journal has this many records.
+
+	mem_ippool_pool_conf_t	**pools;		//!< Pool configurations.
+
+	mem_ippool_mutable_t	*mutable;		//!< Leases and journal, shared between threads.
+} rlm_mem_ippool_t;
+
+static conf_parser_t pool_config[] = {
+	{ FR_CONF_OFFSET_TYPE_FLAGS("start", FR_TYPE_COMBO_IP_ADDR, CONF_FLAG_REQUIRED, mem_ippool_pool_conf_t, start) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("end", FR_TYPE_COMBO_IP_ADDR, CONF_FLAG_REQUIRED, mem_ippool_pool_conf_t, end) },
+	CONF_PARSER_TERMINATOR
+};
+
+static conf_parser_t module_config[] = {
+	{ FR_CONF_OFFSET("filename", rlm_mem_ippool_t, filename) },
+	{ FR_CONF_OFFSET("snapshot_interval", rlm_mem_ippool_t, snapshot_interval), .dflt = "300" },
+	{ FR_CONF_OFFSET("journal_max_records", rlm_mem_ippool_t, journal_max_records), .dflt = "100000" },
+
+	{ FR_CONF_SUBSECTION_ALLOC("pool", 0, CONF_FLAG_SUBSECTION | CONF_FLAG_MULTI,
+				   rlm_mem_ippool_t, pools, pool_config),
+				   .subcs_type = "mem_ippool_pool_conf_t", .name2 = CF_IDENT_ANY },
+	CONF_PARSER_TERMINATOR
+};
+
+/** Call environment used when calling mem_ippool allocate method.
+ *
+ */
+typedef struct {
+	fr_value_box_t	pool_name;			//!< Name of the pool we're allocating IP addresses from.
+
+	fr_value_box_t	offer_time;			//!< How long we should reserve a lease for during
+							///< the pre-allocation stage (typically responding
+							///< to DHCP discover).
+
+	fr_value_box_t	lease_time;			//!< How long an IP address should be allocated for.
+
+	fr_value_box_t	owner;				//!< Unique lease owner identifier.  Could be mac-address
+							///< or a combination of User-Name and something
+							///< unique to the device.
+
+	fr_value_box_t	requested_address;		//!< Address the device would like to be allocated.
+
+	tmpl_t		*allocated_address_attr;	//!< Attribute to populate with allocated IP.
+
+	tmpl_t		*expiry_attr;			//!< Time at which the lease will expire.
+} mem_ippool_alloc_call_env_t;
+
+/** Call environment used when calling mem_ippool update method.
+ *
+ */
+typedef struct {
+	fr_value_box_t	pool_name;			//!< Name of the pool the IP address is in.
+
+	fr_value_box_t	lease_time;			//!< How long an IP address should be allocated for.
+
+	fr_value_box_t	owner;				//!< Unique lease owner identifier.
+
+	fr_value_box_t	requested_address;		//!< Attribute to read the IP for renewal from.
+
+	tmpl_t		*allocated_address_attr;	//!< Attribute to populate with the renewed IP.
+
+	tmpl_t		*expiry_attr;			//!< Time at which the lease will expire.
+} mem_ippool_update_call_env_t;
+
+/** Call environment used when calling mem_ippool release method.
+ *
+ */
+typedef struct {
+	fr_value_box_t	pool_name;			//!< Name of the pool the IP address is in.
+
+	fr_value_box_t	owner;				//!< Unique lease owner identifier.
+
+	fr_value_box_t	requested_address;		//!< Attribute to read the IP to release from.
+} mem_ippool_release_call_env_t;
+
+static const call_env_method_t mem_ippool_alloc_method_env = {
+	FR_CALL_ENV_METHOD_OUT(mem_ippool_alloc_call_env_t),
+	.env = (call_env_parser_t[]){
+		{ FR_CALL_ENV_OFFSET("pool_name", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_BARE_WORD_ATTRIBUTE,
+				     mem_ippool_alloc_call_env_t, pool_name) },
+		{ FR_CALL_ENV_OFFSET("owner", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_BARE_WORD_ATTRIBUTE,
+				     mem_ippool_alloc_call_env_t, owner) },
+		{ FR_CALL_ENV_OFFSET("offer_time", FR_TYPE_UINT32, CALL_ENV_FLAG_NONE, mem_ippool_alloc_call_env_t, offer_time ) },
+		{ FR_CALL_ENV_OFFSET("lease_time", FR_TYPE_UINT32, CALL_ENV_FLAG_REQUIRED, mem_ippool_alloc_call_env_t, lease_time) },
+		{ FR_CALL_ENV_OFFSET("requested_address", FR_TYPE_COMBO_IP_ADDR, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_NULLABLE | CALL_ENV_FLAG_BARE_WORD_ATTRIBUTE, mem_ippool_alloc_call_env_t, requested_address ),
+				     .pair.dflt = "%{%{Requested-IP-Address} || %{Net.Src.IP}}", .pair.dflt_quote = T_DOUBLE_QUOTED_STRING },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("allocated_address_attr", FR_TYPE_VOID, CALL_ENV_FLAG_ATTRIBUTE | CALL_ENV_FLAG_REQUIRED, mem_ippool_alloc_call_env_t, allocated_address_attr) },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("expiry_attr", FR_TYPE_VOID, CALL_ENV_FLAG_ATTRIBUTE, mem_ippool_alloc_call_env_t, expiry_attr) },
+		CALL_ENV_TERMINATOR
+	}
+};
+
+static const call_env_method_t mem_ippool_update_method_env = {
+	FR_CALL_ENV_METHOD_OUT(mem_ippool_update_call_env_t),
+	.env = (call_env_parser_t[]) {
+		{ FR_CALL_ENV_OFFSET("pool_name", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_BARE_WORD_ATTRIBUTE, mem_ippool_update_call_env_t, pool_name) },
+		{ FR_CALL_ENV_OFFSET("owner", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_BARE_WORD_ATTRIBUTE, mem_ippool_update_call_env_t, owner) },
+		{ FR_CALL_ENV_OFFSET("lease_time", FR_TYPE_UINT32, CALL_ENV_FLAG_REQUIRED,  mem_ippool_update_call_env_t, lease_time) },
+		{ FR_CALL_ENV_OFFSET("requested_address", FR_TYPE_COMBO_IP_ADDR, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_NULLABLE | CALL_ENV_FLAG_BARE_WORD_ATTRIBUTE, mem_ippool_update_call_env_t, requested_address),
+				     .pair.dflt = "%{Requested-IP-Address || Net.Src.IP}", .pair.dflt_quote = T_DOUBLE_QUOTED_STRING },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("allocated_address_attr", FR_TYPE_VOID, CALL_ENV_FLAG_ATTRIBUTE | CALL_ENV_FLAG_REQUIRED, mem_ippool_update_call_env_t, allocated_address_attr) },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("expiry_attr", FR_TYPE_VOID, CALL_ENV_FLAG_ATTRIBUTE, mem_ippool_update_call_env_t, expiry_attr) },
+		CALL_ENV_TERMINATOR
+	}
+};
+
+static const call_env_method_t mem_ippool_release_method_env = {
+	FR_CALL_ENV_METHOD_OUT(mem_ippool_release_call_env_t),
+	.env = (call_env_parser_t[]) {
+		{ FR_CALL_ENV_OFFSET("pool_name", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_BARE_WORD_ATTRIBUTE, mem_ippool_release_call_env_t, pool_name) },
+		{ FR_CALL_ENV_OFFSET("owner", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_BARE_WORD_ATTRIBUTE, mem_ippool_release_call_env_t, owner) },
+		{ FR_CALL_ENV_OFFSET("requested_address", FR_TYPE_COMBO_IP_ADDR, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_NULLABLE | CALL_ENV_FLAG_BARE_WORD_ATTRIBUTE, mem_ippool_release_call_env_t, requested_address),
+				     .pair.dflt = "%{Requested-IP-Address || Net.Src.IP}", .pair.dflt_quote = T_DOUBLE_QUOTED_STRING },
+		CALL_ENV_TERMINATOR
+	}
+};
+
+static int8_t pool_cmp(void const *one, void const *two)
+{
+	mem_ippool_pool_t const *a = one, *b = two;
+
+	return CMP(strcmp(a->name, b->name), 0);
+}
+
+static uint32_t lease_owner_hash(void const *data)
+{
+	mem_ippool_lease_t const *lease = data;
+
+	return fr_hash(lease->owner, lease->owner_len);
+}
+
+static int8_t lease_owner_cmp(void const *one, void const *two)
+{
+	mem_ippool_lease_t const *a = one, *b = two;
+	int8_t ret;
+
+	ret = CMP(a->owner_len, b->owner_len);
+	if (ret != 0) return ret;
+
+	return CMP(memcmp(a->owner, b->owner, a->owner_len), 0);
+}
+
+/** Get the address at an offset from the start of the pool
+ *
+ */
+static void pool_address(fr_ipaddr_t *out, mem_ippool_pool_t const *pool, uint32_t offset)
+{
+	*out = pool->conf->start;
+
+	if (out->af == AF_INET) {
+		out->addr.v4.s_addr = htonl(ntohl(out->addr.v4.s_addr) + offset);
+	} else {
+		uint64_t hi = fr_nbo_to_uint64(out->addr.v6.s6_addr);
+		uint64_t lo = fr_nbo_to_uint64(out->addr.v6.s6_addr + 8);
+
+		lo += offset;
+		if (lo < offset) hi++;
+
+		fr_nbo_from_uint64(out->addr.v6.s6_addr, hi);
+		fr_nbo_from_uint64(out->addr.v6.s6_addr + 8, lo);
+	}
+}
+
+/** Get the offset of an address from the start of a range
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 if the address is before the start of the range, or too far after it.
+ */
+static int ipaddr_offset(uint32_t *out, fr_ipaddr_t const *start, fr_ipaddr_t const *ip)
+{
+	uint64_t diff;
+
+	if ((ip->af != start->af) || (ip->prefix != start->prefix)) return -1;
+
+	if (ip->af == AF_INET) {
+		uint32_t a = ntohl(start->addr.v4.s_addr), b = ntohl(ip->addr.v4.s_addr);
+
+		if (b < a) return -1;
+		diff = b - a;
+	} else {
+		uint64_t a_hi = fr_nbo_to_uint64(start->addr.v6.s6_addr);
+		uint64_t a_lo = fr_nbo_to_uint64(start->addr.v6.s6_addr + 8);
+		uint64_t b_hi = fr_nbo_to_uint64(ip->addr.v6.s6_addr);
+		uint64_t b_lo = fr_nbo_to_uint64(ip->addr.v6.s6_addr + 8);
+
+		if (b_hi == a_hi) {
+			if (b_lo < a_lo) return -1;
+		} else if ((b_hi != (a_hi + 1)) || (b_lo >= a_lo)) {
+			return -1;
+		}
+		diff = b_lo - a_lo;	/* Wraps correctly if b_hi == a_hi + 1 */
+	}
+
+	if (diff > UINT32_MAX) return -1;
+
+	*out = (uint32_t)diff;
+	return 0;
+}
+
+/** Find the lease for an address in a pool
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 if the address isn't in the pool.
+ */
+static int pool_lease_index(uint32_t *out, mem_ippool_pool_t const *pool, fr_ipaddr_t const *ip)
+{
+	uint32_t offset;
+
+	if ((ipaddr_offset(&offset, &pool->conf->start, ip) < 0) || (offset >= pool->num)) return -1;
+
+	*out = offset;
+	return 0;
+}
+
+/** Remove a lease from the free list, or from its wheel slot
+ *
+ */
+static void lease_unlink(mem_ippool_pool_t *pool, uint32_t i)
+{
+	mem_ippool_lease_t	*lease = &pool->leases[i];
+	uint32_t		*head = (lease->slot == MEM_IPPOOL_FREE) ? &pool->free_head : &pool->wheel[lease->slot];
+
+	if (lease->prev != MEM_IPPOOL_NONE) {
+		pool->leases[lease->prev].next = lease->next;
+	} else {
+		*head = lease->next;
+	}
+
+	if (lease->next != MEM_IPPOOL_NONE) {
+		pool->leases[lease->next].prev = lease->prev;
+	} else if (lease->slot == MEM_IPPOOL_FREE) {
+		pool->free_tail = lease->prev;
+	}
+
+	lease->prev = lease->next = MEM_IPPOOL_NONE;
+}
+
+/** Add a lease to the free list, or to the wheel slot for its expiry time
+ *
+ * Free leases are added to the tail of the free list, so that they are
+ * reused as late as possible.
+ */
+static void lease_link(mem_ippool_pool_t *pool, uint32_t i)
+{
+	mem_ippool_lease_t	*lease = &pool->leases[i];
+
+	if (lease->expires <= pool->wheel_time) {
+		lease->slot = MEM_IPPOOL_FREE;
+		lease->prev = pool->free_tail;
+		lease->next = MEM_IPPOOL_NONE;
+
+		if (pool->free_tail != MEM_IPPOOL_NONE) {
+			pool->leases[pool->free_tail].next = i;
+		} else {
+			pool->free_head = i;
+		}
+		pool->free_tail = i;
+		return;
+	}
+
+	lease->slot = lease->expires % MEM_IPPOOL_WHEEL_SIZE;
+	lease->prev = MEM_IPPOOL_NONE;
+	lease->next = pool->wheel[lease->slot];
+	if (lease->next != MEM_IPPOOL_NONE) pool->leases[lease->next].prev = i;
+	pool->wheel[lease->slot] = i;
+}
+
+/** Move leases which have expired to the free list
+ *
+ * Each slot is visited once per second.  Leases longer than the size of
+ * the wheel are skipped until the slot comes around again.
+ */
+static void pool_expire(mem_ippool_pool_t *pool, int64_t now)
+{
+	if ((now - pool->wheel_time) > MEM_IPPOOL_WHEEL_SIZE) pool->wheel_time = now - MEM_IPPOOL_WHEEL_SIZE;
+
+	while (pool->wheel_time < now) {
+		uint32_t i, next;
+
+		pool->wheel_time++;
+
+		for (i = pool->wheel[pool->wheel_time % MEM_IPPOOL_WHEEL_SIZE]; i != MEM_IPPOOL_NONE; i = next) {
+			next = pool->leases[i].next;
+
+			if (pool->leases[i].expires > pool->wheel_time) continue;
+
+			lease_unlink(pool, i);
+			lease_link(pool, i);
+		}
+	}
+}
+
+/** Set the owner and expiry time of a lease
+ *
+ * The owner is removed from any other lease it was associated with.
+ */
+static void lease_bind(mem_ippool_pool_t *pool, uint32_t i, char const *owner, size_t owner_len, int64_t expires)
+{
+	mem_ippool_lease_t	*lease = &pool->leases[i];
+
+	if (!lease->owner || (lease->owner_len != owner_len) || (memcmp(lease->owner, owner, owner_len) != 0)) {
+		mem_ippool_lease_t	*other;
+
+		if (lease->owner) {
+			fr_hash_table_remove(pool->owners, lease);
+			TALLOC_FREE(lease->owner);
+		}
+
+		other = fr_hash_table_find(pool->owners, &(mem_ippool_lease_t){ .owner = UNCONST(char *, owner),
+										.owner_len = owner_len });
+		if (other) {
+			fr_hash_table_remove(pool->owners, other);
+			TALLOC_FREE(other->owner);
+			other->owner_len = 0;
+		}
+
+		MEM(lease->owner = talloc_memdup(pool, owner, owner_len));
+		lease->owner_len = owner_len;
+		fr_hash_table_insert(pool->owners, lease);
+	}
+
+	lease_unlink(pool, i);
+	lease->expires = expires;
+	lease_link(pool, i);
+}
+
+/** Mark a lease as expired, keeping its owner
+ *
+ */
+static void lease_release(mem_ippool_pool_t *pool, uint32_t i, int64_t now)
+{
+	mem_ippool_lease_t *lease = &pool->leases[i];
+
+	lease_unlink(pool, i);
+	if (lease->expires > now) lease->expires = now;
+	lease_link(pool, i);
+}
+
+/** Check whether a snapshot is due
+ *
+ * Must be called with the journal mutex held.
+ */
+static bool mem_ippool_snapshot_due(rlm_mem_ippool_t const *inst)
+{
+	mem_ippool_mutable_t *mutable = inst->mutable;
+
+	if (mutable->records == 0) return false;
+
+	return (mutable->records >= inst->journal_max_records) ||
+	       fr_time_delta_gteq(fr_time_sub(fr_time(), mutable->last_snapshot), inst->snapshot_interval);
+}
+
+/** Print the record for a lease
+ *
+ * @return
+ *	- >0 the length of the record.
+ *	- <0 if the record didn't fit.  Nothing is printed.
+ */
+static fr_slen_t mem_ippool_lease_print(fr_sbuff_t *out, mem_ippool_pool_t const *pool, uint32_t i)
+{
+	mem_ippool_lease_t const	*lease = &pool->leases[i];
+	fr_sbuff_t			our_out = FR_SBUFF(out);
+	char				addr[FR_IPADDR_STRLEN];
+	fr_ipaddr_t			ip;
+
+	pool_address(&ip, pool, i);
+	fr_inet_ntop(addr, sizeof(addr), &ip);
+
+	FR_SBUFF_RETURN(fr_sbuff_in_sprintf, &our_out, "lease %s %s %" PRId64 " ", pool->name, addr, lease->expires);
+	FR_SBUFF_RETURN(fr_base16_encode, &our_out, &FR_DBUFF_TMP((uint8_t const *)lease->owner, lease->owner_len));
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '\n');
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
+/** Copy the leases in a pool to a buffer
+ *
+ * The pool is only locked while its leases are copied, so requests
+ * aren't held up while the snapshot is written.
+ */
+static void mem_ippool_pool_copy(fr_sbuff_t *out, mem_ippool_pool_t *pool)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	/*
+	 *	Free leases first, in the order they were released,
+	 *	then leases which are in use.
+	 */
+	for (i = pool->free_head; i != MEM_IPPOOL_NONE; i = pool->leases[i].next) {
+		if (!pool->leases[i].owner) continue;
+
+		(void) mem_ippool_lease_print(out, pool, i);
+	}
+
+	for (i = 0; i < pool->num; i++) {
+		if ((pool->leases[i].slot == MEM_IPPOOL_FREE) || !pool->leases[i].owner) continue;
+
+		(void) mem_ippool_lease_print(out, pool, i);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/** Write a snapshot of all leases
+ *
+ * Changes made after a pool was copied are in the journal, and
+ * replaying changes which are already in the snapshot is harmless.
+ *
+ * @param[in] inst	Module instance.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int mem_ippool_snapshot(rlm_mem_ippool_t const *inst)
+{
+	mem_ippool_pool_t	*pool;
+	fr_rb_iter_inorder_t	iter;
+	fr_sbuff_t		sbuff;
+	fr_sbuff_uctx_talloc_t	tctx;
+	char			*tmp;
+	FILE			*fp;
+	int			ret = -1;
+
+	MEM(tmp = talloc_asprintf(NULL, "%s.tmp", inst->filename));
+	MEM(fr_sbuff_init_talloc(tmp, &sbuff, &tctx, 4096, SIZE_MAX));
+
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		ERROR("Failed opening %s: %s", tmp, fr_syserror(errno));
+		goto finish;
+	}
+
+	/*
+	 *	The tree of pools doesn't change after
+	 *	instantiation, so it can be walked without
+	 *	holding any locks.
+	 */
+	for (pool = fr_rb_iter_init_inorder(&iter, inst->mutable->pools);
+	     pool;
+	     pool = fr_rb_iter_next_inorder(&iter)) {
+		fr_sbuff_set_to_start(&sbuff);
+		mem_ippool_pool_copy(&sbuff, pool);
+
+		if (fwrite(fr_sbuff_start(&sbuff), 1, fr_sbuff_used(&sbuff), fp) != fr_sbuff_used(&sbuff)) {
+			ERROR("Failed writing %s: %s", tmp, fr_syserror(errno));
+			fclose(fp);
+			goto finish;
+		}
+	}
+
+	if ((fflush(fp) != 0) || (fsync(fileno(fp)) < 0)) {
+		ERROR("Failed writing %s: %s", tmp, fr_syserror(errno));
+		fclose(fp);
+		goto finish;
+	}
+	fclose(fp);
+
+	if (rename(tmp, inst->filename) < 0) {
+		ERROR("Failed renaming %s to %s: %s", tmp, inst->filename, fr_syserror(errno));
+		goto finish;
+	}
+
+	/*
+	 *	Everything in the old journal is now in the snapshot.
+	 */
+	if ((unlink(inst->journal_old_filename) < 0) && (errno != ENOENT)) {
+		ERROR("Failed removing %s: %s", inst->journal_old_filename, fr_syserror(errno));
+		goto finish;
+	}
+	ret = 0;
+
+finish:
+	talloc_free(tmp);
+
+	return ret;
+}
+
+/** Move the journal aside, and start a new one
+ *
+ * Must be called with the journal mutex held.  Changes made from now on
+ * go to the new journal, and the old one is removed once a snapshot has
+ * been written.
+ */
+static int mem_ippool_journal_rotate(rlm_mem_ippool_t const *inst)
+{
+	mem_ippool_mutable_t	*mutable = inst->mutable;
+	int			fd;
+
+	if (rename(inst->journal_filename, inst->journal_old_filename) < 0) {
+		ERROR("Failed renaming %s to %s: %s",
+		      inst->journal_filename, inst->journal_old_filename, fr_syserror(errno));
+		return -1;
+	}
+
+	fd = open(inst->journal_filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		ERROR("Failed opening %s: %s", inst->journal_filename, fr_syserror(errno));
+		(void) rename(inst->journal_old_filename, inst->journal_filename);
+		return -1;
+	}
+
+	close(mutable->fd);
+	mutable->fd = fd;
+
+	return 0;
+}
+
+/** Write snapshots when they're due
+ *
+ */
+static void *mem_ippool_snapshot_thread(void *arg)
+{
+	rlm_mem_ippool_t const	*inst = arg;
+	mem_ippool_mutable_t	*mutable = inst->mutable;
+
+	pthread_mutex_lock(&mutable->mutex);
+	while (!mutable->stop) {
+		int ret;
+
+		if (mutable->records == 0) {
+			pthread_cond_wait(&mutable->cond, &mutable->mutex);
+			continue;
+		}
+
+		if (!mem_ippool_snapshot_due(inst)) {
+			struct timespec ts = { .tv_sec = time(NULL) + fr_time_delta_to_sec(inst->snapshot_interval) };
+
+			(void) pthread_cond_timedwait(&mutable->cond, &mutable->mutex, &ts);
+			continue;
+		}
+
+		/*
+		 *	If this snapshot fails, the next one is
+		 *	attempted after the same number of changes,
+		 *	or the same interval.
+		 */
+		mutable->records = 0;
+		mutable->last_snapshot = fr_time();
+
+		/*
+		 *	If the last snapshot failed, its changes are
+		 *	still in the old journal, and the current
+		 *	journal carries on from there.
+		 */
+		if (!mutable->rotated) {
+			if (mem_ippool_journal_rotate(inst) < 0) continue;
+			mutable->rotated = true;
+		}
+		pthread_mutex_unlock(&mutable->mutex);
+
+		ret = mem_ippool_snapshot(inst);
+
+		pthread_mutex_lock(&mutable->mutex);
+		if (ret == 0) mutable->rotated = false;
+	}
+	pthread_mutex_unlock(&mutable->mutex);
+
+	return NULL;
+}
+
+/** Stop the snapshot thread
+ *
+ */
+static void mem_ippool_thread_stop(mem_ippool_mutable_t *mutable)
+{
+	if (!mutable->running) return;
+
+	pthread_mutex_lock(&mutable->mutex);
+	mutable->stop = true;
+	pthread_cond_signal(&mutable->cond);
+	pthread_mutex_unlock(&mutable->mutex);
+
+	pthread_join(mutable->thread, NULL);
+	mutable->running = false;
+}
+
+/** Append a record to the journal
+ *
+ * Must be called with the pool mutex held.  Wakes up the snapshot thread
+ * if a snapshot is due.
+ */
+static void mem_ippool_journal(rlm_mem_ippool_t const *inst,
+			       mem_ippool_pool_t const *pool, uint32_t i, int64_t now, bool release)
+{
+	mem_ippool_mutable_t		*mutable = inst->mutable;
+	char				buff[FR_IPADDR_STRLEN + ((MEM_IPPOOL_MAX_OWNER * 2) + 1) + 256];
+	fr_sbuff_t			sbuff = FR_SBUFF_OUT(buff, sizeof(buff));
+	fr_slen_t			slen;
+
+	if (mutable->fd < 0) return;
+
+	if (release) {
+		char		addr[FR_IPADDR_STRLEN];
+		fr_ipaddr_t	ip;
+
+		pool_address(&ip, pool, i);
+		fr_inet_ntop(addr, sizeof(addr), &ip);
+		slen = fr_sbuff_in_sprintf(&sbuff, "release %s %s %" PRId64 "\n", pool->name, addr, now);
+	} else {
+		slen = mem_ippool_lease_print(&sbuff, pool, i);
+	}
+
+	/*
+	 *	A partial record would corrupt the record after it.
+	 */
+	if (slen <= 0) {
+		ERROR("Journal record for pool \"%s\" is too long, the change will only be saved by the next snapshot",
+		      pool->name);
+		return;
+	}
+
+	pthread_mutex_lock(&mutable->mutex);
+	if (write(mutable->fd, buff, fr_sbuff_used(&sbuff)) != (ssize_t)fr_sbuff_used(&sbuff)) {
+		ERROR("Failed writing to %s: %s", inst->journal_filename, fr_syserror(errno));
+	}
+	mutable->records++;
+	if (mem_ippool_snapshot_due(inst)) pthread_cond_signal(&mutable->cond);
+	pthread_mutex_unlock(&mutable->mutex);
+}
+
+/** Find a pool by name
+ *
+ */
+static mem_ippool_pool_t *mem_ippool_pool_find(rlm_mem_ippool_t const *inst, fr_value_box_t const *name)
+{
+	return fr_rb_find(inst->mutable->pools, &(mem_ippool_pool_t){ .name = name->vb_strvalue });
+}
+
+/** Add the allocated address, and optionally the lease time, to the request
+ *
+ */
+static int mem_ippool_reply(request_t *request, tmpl_t *ip_attr, tmpl_t *expiry_attr,
+			    fr_ipaddr_t const *ip, uint32_t expires_in)
+{
+	tmpl_t	ip_rhs;
+	map_t	ip_map = {
+			.lhs = ip_attr,
+			.op = T_OP_SET,
+			.rhs = &ip_rhs
+		};
+
+	tmpl_init_shallow(&ip_rhs, TMPL_TYPE_DATA, T_BARE_WORD, "", 0, NULL);
+	fr_value_box_ipaddr(&ip_rhs.data.literal, NULL, ip, false);
+	if (map_to_request(request, &ip_map, map_to_vp, NULL) < 0) return -1;
+
+	if (expiry_attr) {
+		tmpl_t	expiry_rhs;
+		map_t	expiry_map = {
+				.lhs = expiry_attr,
+				.op = T_OP_SET,
+				.rhs = &expiry_rhs
+			};
+
+		tmpl_init_shallow(&expiry_rhs, TMPL_TYPE_DATA, T_BARE_WORD, "", 0, NULL);
+		fr_value_box(&expiry_rhs.data.literal, expires_in, false);
+		if (map_to_request(request, &expiry_map, map_to_vp, NULL) < 0) return -1;
+	}
+
+	return 0;
+}
+
+#define CHECK_POOL_NAME \
+	if (env->pool_name.vb_length == 0) { \
+		RDEBUG2("Empty pool name.  Doing nothing"); \
+		RETURN_MODULE_NOOP; \
+	} \
+	pool = mem_ippool_pool_find(inst, &env->pool_name); \
+	if (!pool) { \
+		REDEBUG("No such pool \"%pV\"", &env->pool_name); \
+		RETURN_MODULE_FAIL; \
+	}
+
+#define CHECK_OWNER \
+	if ((env->owner.vb_length == 0) || (env->owner.vb_length > MEM_IPPOOL_MAX_OWNER)) { \
+		REDEBUG("Lease owner must be between 1 and %u bytes, got %zu bytes", \
+			MEM_IPPOOL_MAX_OWNER, env->owner.vb_length); \
+		RETURN_MODULE_FAIL; \
+	}
+
+/** Allocate a lease, preferring the one last held by the same owner
+ *
+ */
+static mem_ippool_rcode_t mem_ippool_allocate(rlm_mem_ippool_t const *inst, request_t *request,
+					      mem_ippool_pool_t *pool, mem_ippool_alloc_call_env_t *env,
+					      fr_ipaddr_t *ip, int64_t *expires, uint32_t lease_time)
+{
+	mem_ippool_lease_t	*lease;
+	int64_t			now = fr_time_to_sec(fr_time());
+	uint32_t		i;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool_expire(pool, now);
+
+	/*
+	 *	The device already has a lease, or had one which
+	 *	hasn't been given to anyone else.
+	 */
+	lease = fr_hash_table_find(pool->owners, &(mem_ippool_lease_t){ .owner = UNCONST(char *, env->owner.vb_strvalue),
+									 .owner_len = env->owner.vb_length });
+	if (lease) {
+		i = lease - pool->leases;
+
+		if ((lease->expires - now) >= lease_time) goto done;
+
+		RDEBUG2("Reusing lease previously allocated to this owner");
+		goto bind;
+	}
+
+	/*
+	 *	Give the device the address it asked for, if it's free.
+	 */
+	if (fr_box_is_ip(&env->requested_address) &&
+	    (pool_lease_index(&i, pool, &env->requested_address.vb_ip) == 0) &&
+	    (pool->leases[i].expires <= now)) {
+		RDEBUG2("Allocating requested address");
+		goto bind;
+	}
+
+	i = pool->free_head;
+	if (i == MEM_IPPOOL_NONE) {
+		pthread_mutex_unlock(&pool->mutex);
+		return MEM_IPPOOL_RCODE_POOL_EMPTY;
+	}
+
+bind:
+	lease_bind(pool, i, env->owner.vb_strvalue, env->owner.vb_length, now + lease_time);
+	mem_ippool_journal(inst, pool, i, now, false);
+
+done:
+	pool_address(ip, pool, i);
+	*expires = pool->leases[i].expires - now;
+	pthread_mutex_unlock(&pool->mutex);
+
+	return MEM_IPPOOL_RCODE_SUCCESS;
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_mem_ippool_t const		*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_mem_ippool_t);
+	mem_ippool_alloc_call_env_t	*env = talloc_get_type_abort(mctx->env_data, mem_ippool_alloc_call_env_t);
+	mem_ippool_pool_t		*pool;
+	uint32_t			lease_time;
+	fr_ipaddr_t			ip;
+	int64_t				expires;
+
+	CHECK_POOL_NAME
+	CHECK_OWNER
+
+	/*
+	 *	If offer_time is defined, it will be FR_TYPE_UINT32.
+	 *	Fall back to lease_time otherwise.
+	 */
+	lease_time = (env->offer_time.type == FR_TYPE_UINT32) ?
+			env->offer_time.vb_uint32 : env->lease_time.vb_uint32;
+
+	RDEBUG2("Allocating lease from pool \"%pV\" for owner \"%pV\", for %u seconds",
+		&env->pool_name, &env->owner, lease_time);
+
+	switch (mem_ippool_allocate(inst, request, pool, env, &ip, &expires, lease_time)) {
+	case MEM_IPPOOL_RCODE_SUCCESS:
+		RDEBUG2("IP address lease allocated");
+		if (mem_ippool_reply(request, env->allocated_address_attr, env->expiry_attr,
+				     &ip, (uint32_t)expires) < 0) RETURN_MODULE_FAIL;
+		RETURN_MODULE_UPDATED;
+
+	case MEM_IPPOOL_RCODE_POOL_EMPTY:
+		RWDEBUG("Pool contains no free addresses");
+		RETURN_MODULE_NOTFOUND;
+
+	default:
+		RETURN_MODULE_FAIL;
+	}
+}
+
+/** Find the lease for the requested address, and check it belongs to the owner
+ *
+ * On success, the pool mutex is held.
+ */
+static mem_ippool_rcode_t mem_ippool_lease_find(uint32_t *out, mem_ippool_pool_t *pool,
+						fr_value_box_t const *requested_address,
+						fr_value_box_t const *owner, int64_t now)
+{
+	mem_ippool_lease_t	*lease;
+	uint32_t		i;
+
+	if (!fr_box_is_ip(requested_address) ||
+	    (pool_lease_index(&i, pool, &requested_address->vb_ip) < 0)) return MEM_IPPOOL_RCODE_NOT_FOUND;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool_expire(pool, now);
+
+	lease = &pool->leases[i];
+	if (!lease->owner || (lease->owner_len != owner->vb_length) ||
+	    (memcmp(lease->owner, owner->vb_strvalue, owner->vb_length) != 0)) {
+		pthread_mutex_unlock(&pool->mutex);
+		return MEM_IPPOOL_RCODE_DEVICE_MISMATCH;
+	}
+
+	*out = i;
+	return MEM_IPPOOL_RCODE_SUCCESS;
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_update(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_mem_ippool_t const		*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_mem_ippool_t);
+	mem_ippool_update_call_env_t	*env = talloc_get_type_abort(mctx->env_data, mem_ippool_update_call_env_t);
+	mem_ippool_pool_t		*pool;
+	int64_t				now = fr_time_to_sec(fr_time());
+	uint32_t			i;
+
+	CHECK_POOL_NAME
+	CHECK_OWNER
+
+	RDEBUG2("Updating lease on \"%pV\" in pool \"%pV\" for owner \"%pV\", for %u seconds",
+		&env->requested_address, &env->pool_name, &env->owner, env->lease_time.vb_uint32);
+
+	switch (mem_ippool_lease_find(&i, pool, &env->requested_address, &env->owner, now)) {
+	case MEM_IPPOOL_RCODE_SUCCESS:
+		break;
+
+	/*
+	 *	It's useful to be able to identify the 'not found' case
+	 *	as we can relay to a server where the IP address might
+	 *	be found.  This extremely useful for migrations.
+	 */
+	case MEM_IPPOOL_RCODE_NOT_FOUND:
+		REDEBUG("Requested IP address \"%pV\" is not a member of the specified pool",
+			&env->requested_address);
+		RETURN_MODULE_NOTFOUND;
+
+	case MEM_IPPOOL_RCODE_DEVICE_MISMATCH:
+		REDEBUG("Requested IP address' \"%pV\" lease allocated to another device",
+			&env->requested_address);
+		RETURN_MODULE_INVALID;
+
+	default:
+		RETURN_MODULE_FAIL;
+	}
+
+	lease_bind(pool, i, env->owner.vb_strvalue, env->owner.vb_length, now + env->lease_time.vb_uint32);
+	mem_ippool_journal(inst, pool, i, now, false);
+	pthread_mutex_unlock(&pool->mutex);
+
+	RDEBUG2("Requested IP address' \"%pV\" lease updated", &env->requested_address);
+
+	if (mem_ippool_reply(request, env->allocated_address_attr, env->expiry_attr,
+			     &env->requested_address.vb_ip, env->lease_time.vb_uint32) < 0) RETURN_MODULE_FAIL;
+
+	RETURN_MODULE_UPDATED;
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_release(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_mem_ippool_t const		*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_mem_ippool_t);
+	mem_ippool_release_call_env_t	*env = talloc_get_type_abort(mctx->env_data, mem_ippool_release_call_env_t);
+	mem_ippool_pool_t		*pool;
+	int64_t				now = fr_time_to_sec(fr_time());
+	uint32_t			i;
+
+	CHECK_POOL_NAME
+	CHECK_OWNER
+
+	RDEBUG2("Releasing lease on \"%pV\" in pool \"%pV\" for owner \"%pV\"",
+		&env->requested_address, &env->pool_name, &env->owner);
+
+	switch (mem_ippool_lease_find(&i, pool, &env->requested_address, &env->owner, now)) {
+	case MEM_IPPOOL_RCODE_SUCCESS:
+		break;
+
+	case MEM_IPPOOL_RCODE_NOT_FOUND:
+		REDEBUG("Requested IP address \"%pV\" is not a member of the specified pool",
+			&env->requested_address);
+		RETURN_MODULE_NOTFOUND;
+
+	case MEM_IPPOOL_RCODE_DEVICE_MISMATCH:
+		REDEBUG("Requested IP address' \"%pV\" lease allocated to another device",
+			&env->requested_address);
+		RETURN_MODULE_INVALID;
+
+	default:
+		RETURN_MODULE_FAIL;
+	}
+
+	if (pool->leases[i].expires > now) {
+		lease_release(pool, i, now);
+		mem_ippool_journal(inst, pool, i, now, true);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	RDEBUG2("IP address \"%pV\" released", &env->requested_address);
+	RETURN_MODULE_UPDATED;
+}
+
+/** Apply one line of a snapshot or journal
+ *
+ * Lines are of the form:
+ *
+ * - lease <pool> <address> <expires> <owner (hex)>
+ * - release <pool> <address> <time>
+ */
+static int mem_ippool_load_line(rlm_mem_ippool_t const *inst, char const *filename, int lineno, char *line)
+{
+	char			*argv[6];
+	int			argc;
+	mem_ippool_pool_t	*pool;
+	fr_ipaddr_t		ip;
+	uint32_t		i;
+	int64_t			when;
+	uint8_t			owner[MEM_IPPOOL_MAX_OWNER];
+	fr_slen_t		owner_len;
+
+	argc = fr_dict_str_to_argv(line, argv, NUM_ELEMENTS(argv));
+	if (argc == 0) return 0;
+
+	if (!(((argc == 5) && (strcmp(argv[0], "lease") == 0)) ||
+	      ((argc == 4) && (strcmp(argv[0], "release") == 0)))) {
+		ERROR("%s[%d]: Invalid record", filename, lineno);
+		return -1;
+	}
+
+	pool = fr_rb_find(inst->mutable->pools, &(mem_ippool_pool_t){ .name = argv[1] });
+	if (!pool) {
+		WARN("%s[%d]: Ignoring record for unknown pool \"%s\"", filename, lineno, argv[1]);
+		return 0;
+	}
+
+	if ((fr_inet_pton(&ip, argv[2], -1, AF_UNSPEC, false, false) < 0) ||
+	    (pool_lease_index(&i, pool, &ip) < 0)) {
+		WARN("%s[%d]: Ignoring record for address \"%s\", which is not in pool \"%s\"",
+		     filename, lineno, argv[2], argv[1]);
+		return 0;
+	}
+
+	when = strtoll(argv[3], NULL, 10);
+
+	if (argc == 4) {
+		lease_release(pool, i, when);
+		return 0;
+	}
+
+	owner_len = fr_base16_decode(NULL, &FR_DBUFF_TMP(owner, sizeof(owner)),
+				     &FR_SBUFF_IN(argv[4], strlen(argv[4])), true);
+	if (owner_len <= 0) {
+		ERROR("%s[%d]: Invalid lease owner", filename, lineno);
+		return -1;
+	}
+
+	lease_bind(pool, i, (char const *)owner, (size_t)owner_len, when);
+
+	return 0;
+}
+
+static int mem_ippool_load(rlm_mem_ippool_t const *inst, char const *filename)
+{
+	FILE	*fp;
+	char	*line = NULL;
+	size_t	size = 0;
+	ssize_t	len;
+	int	lineno = 0;
+	int	ret = 0;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		if (errno == ENOENT) return 0;
+
+		ERROR("Failed opening %s: %s", filename, fr_syserror(errno));
+		return -1;
+	}
+
+	/*
+	 *	Records have no fixed maximum length, so the buffer
+	 *	grows to fit.  A fixed size buffer would split long
+	 *	records, and look like a truncated record.
+	 */
+	while ((len = getline(&line, &size, fp)) > 0) {
+		lineno++;
+
+		/*
+		 *	A partial record at the end of the journal
+		 *	means we crashed while writing it.
+		 */
+		if (line[len - 1] != '\n') {
+			WARN("%s[%d]: Ignoring truncated record", filename, lineno);
+			break;
+		}
+
+		if (mem_ippool_load_line(inst, filename, lineno, line) < 0) {
+			ret = -1;
+			break;
+		}
+	}
+
+	if ((ret == 0) && ferror(fp)) {
+		ERROR("Failed reading %s: %s", filename, fr_syserror(errno));
+		ret = -1;
+	}
+
+	free(line);
+	fclose(fp);
+
+	return ret;
+}
+
+/** Allocate the state shared between threads
+ *
+ */
+static mem_ippool_mutable_t *mem_ippool_mutable_alloc(void)
+{
+	mem_ippool_mutable_t *mutable;
+
+	MEM(mutable = talloc_zero(NULL, mem_ippool_mutable_t));
+	pthread_mutex_init(&mutable->mutex, NULL);
+	pthread_cond_init(&mutable->cond, NULL);
+	mutable->fd = -1;
+	MEM(mutable->pools = fr_rb_inline_talloc_alloc(mutable, mem_ippool_pool_t, node, pool_cmp, NULL));
+
+	return mutable;
+}
+
+/** Free the state shared between threads, without writing a snapshot
+ *
+ */
+static void mem_ippool_mutable_free(mem_ippool_mutable_t *mutable)
+{
+	mem_ippool_pool_t	*pool;
+	fr_rb_iter_inorder_t	iter;
+
+	mem_ippool_thread_stop(mutable);
+	if (mutable->fd >= 0) close(mutable->fd);
+
+	for (pool = fr_rb_iter_init_inorder(&iter, mutable->pools);
+	     pool;
+	     pool = fr_rb_iter_next_inorder(&iter)) pthread_mutex_destroy(&pool->mutex);
+
+	pthread_cond_destroy(&mutable->cond);
+	pthread_mutex_destroy(&mutable->mutex);
+	talloc_free(mutable);
+}
+
+/** Allocate a pool, with all its leases free
+ *
+ * @param[in] mutable	to allocate the pool in.
+ * @param[in] name	of the pool.
+ * @param[in] conf	for the pool.  Must outlive the pool.
+ * @param[in] num	number of addresses in the pool.
+ * @param[in] now	current time, in seconds since the epoch.
+ */
+static mem_ippool_pool_t *mem_ippool_pool_alloc(mem_ippool_mutable_t *mutable, char const *name,
+						mem_ippool_pool_conf_t const *conf, uint32_t num, int64_t now)
+{
+	mem_ippool_pool_t	*pool;
+	uint32_t		i;
+
+	MEM(pool = talloc_zero(mutable, mem_ippool_pool_t));
+	pool->name = name;
+	pool->conf = conf;
+	pool->num = num;
+	pool->wheel_time = now;
+	pthread_mutex_init(&pool->mutex, NULL);
+	MEM(pool->owners = fr_hash_table_alloc(pool, lease_owner_hash, lease_owner_cmp, NULL));
+	MEM(pool->leases = talloc_array(pool, mem_ippool_lease_t, pool->num));
+
+	/*
+	 *	All leases start out free, in address order.
+	 */
+	pool->free_head = pool->free_tail = MEM_IPPOOL_NONE;
+	for (i = 0; i < MEM_IPPOOL_WHEEL_SIZE; i++) pool->wheel[i] = MEM_IPPOOL_NONE;
+	for (i = 0; i < pool->num; i++) {
+		pool->leases[i] = (mem_ippool_lease_t) {
+			.prev = MEM_IPPOOL_NONE,
+			.next = MEM_IPPOOL_NONE,
+			.expires = 0
+		};
+		lease_link(pool, i);
+	}
+
+	return pool;
+}
+
+/** Load the leases from disk, and start writing the journal
+ *
+ * Must be called before any other threads use the pools.
+ */
+static int mem_ippool_open(rlm_mem_ippool_t *inst)
+{
+	mem_ippool_mutable_t	*mutable = inst->mutable;
+	int			ret;
+
+	MEM(inst->journal_filename = talloc_asprintf(inst, "%s.journal", inst->filename));
+	MEM(inst->journal_old_filename = talloc_asprintf(inst, "%s.old", inst->journal_filename));
+
+	/*
+	 *	Load the last snapshot, then replay the changes
+	 *	which were made after it.  If we stopped while
+	 *	writing a snapshot, the old journal has the changes
+	 *	which were made before the current journal.
+	 */
+	if (mem_ippool_load(inst, inst->filename) < 0) return -1;
+	if (mem_ippool_load(inst, inst->journal_old_filename) < 0) return -1;
+	if (mem_ippool_load(inst, inst->journal_filename) < 0) return -1;
+
+	mutable->fd = open(inst->journal_filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	if (mutable->fd < 0) {
+		ERROR("Failed opening %s: %s", inst->journal_filename, fr_syserror(errno));
+		return -1;
+	}
+
+	/*
+	 *	Compact the journals into a new snapshot.
+	 */
+	if (mem_ippool_snapshot(inst) < 0) return -1;
+
+	if (ftruncate(mutable->fd, 0) < 0) {
+		ERROR("Failed truncating %s: %s", inst->journal_filename, fr_syserror(errno));
+		return -1;
+	}
+	mutable->last_snapshot = fr_time();
+
+	ret = pthread_create(&mutable->thread, NULL, mem_ippool_snapshot_thread, inst);
+	if (ret != 0) {
+		ERROR("Failed creating snapshot thread: %s", fr_syserror(ret));
+		return -1;
+	}
+	mutable->running = true;
+
+	return 0;
+}
+
+/** Stop the snapshot thread, and write a final snapshot
+ *
+ */
+static void mem_ippool_close(rlm_mem_ippool_t const *inst)
+{
+	mem_ippool_mutable_t *mutable = inst->mutable;
+
+	mem_ippool_thread_stop(mutable);
+
+	if ((mutable->fd >= 0) && (mem_ippool_snapshot(inst) == 0) && (ftruncate(mutable->fd, 0) < 0)) {
+		ERROR("Failed truncating %s: %s", inst->journal_filename, fr_syserror(errno));
+	}
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_mem_ippool_t	*inst = talloc_get_type_abort(mctx->mi->data, rlm_mem_ippool_t);
+	CONF_SECTION		*conf = mctx->mi->conf;
+	CONF_SECTION		*cs = NULL;
+	mem_ippool_mutable_t	*mutable;
+	int64_t			now = fr_time_to_sec(fr_time());
+	size_t			i = 0;
+
+	mutable = inst->mutable = mem_ippool_mutable_alloc();
+
+	/*
+	 *	The pool configurations are in the same order as
+	 *	the pool sections.
+	 */
+	while ((cs = cf_section_find_next(conf, cs, "pool", CF_IDENT_ANY))) {
+		mem_ippool_pool_conf_t const	*pool_conf = inst->pools[i++];
+		mem_ippool_pool_t		*pool;
+		uint32_t			last;
+
+		if (!cf_section_name2(cs)) {
+			cf_log_err(cs, "pools must be declared as \"pool <name> {\"");
+			return -1;
+		}
+
+		if (cf_section_name2(cs)[strcspn(cf_section_name2(cs), " \t\r\n#")] != '\0') {
+			cf_log_err(cs, "Pool names must not contain spaces or '#'");
+			return -1;
+		}
+
+		if (((pool_conf->start.af == AF_INET) && (pool_conf->start.prefix != 32)) ||
+		    ((pool_conf->start.af == AF_INET6) && (pool_conf->start.prefix != 128))) {
+			cf_log_err(cs, "\"start\" must be a single address");
+			return -1;
+		}
+
+		if ((ipaddr_offset(&last, &pool_conf->start, &pool_conf->end) < 0) || (last >= MEM_IPPOOL_MAX_SIZE)) {
+			cf_log_err(cs, "\"end\" must be an address of the same type as \"start\", "
+				   "and at most %u addresses after it", MEM_IPPOOL_MAX_SIZE - 1);
+			return -1;
+		}
+
+		pool = mem_ippool_pool_alloc(mutable, cf_section_name2(cs), pool_conf, last + 1, now);
+		if (!fr_rb_insert(mutable->pools, pool)) {
+			cf_log_err(cs, "Duplicate pool \"%s\"", pool->name);
+			return -1;
+		}
+	}
+
+	if (!inst->filename) return 0;
+
+	if (mem_ippool_open(inst) < 0) {
+		cf_log_err(conf, "Failed loading leases from %s", inst->filename);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int mod_detach(module_detach_ctx_t const *mctx)
+{
+	rlm_mem_ippool_t	*inst = talloc_get_type_abort(mctx->mi->data, rlm_mem_ippool_t);
+
+	if (!inst->mutable) return 0;
+
+	mem_ippool_close(inst);
+	mem_ippool_mutable_free(inst->mutable);
+	inst->mutable = NULL;
+
+	return 0;
+}
+
+extern module_rlm_t rlm_mem_ippool;
+module_rlm_t rlm_mem_ippool = {
+	.common = {
+		.magic		= MODULE_MAGIC_INIT,
+		.name		= "mem_ippool",
+		.inst_size	= sizeof(rlm_mem_ippool_t),
+		.config		= module_config,
+		.instantiate	= mod_instantiate,
+		.detach		= mod_detach
+	},
+	.method_group = {
+		.bindings = (module_method_binding_t[]){
+			{ .section = SECTION_NAME("recv", "Access-Request"), .method = mod_alloc, .method_env = &mem_ippool_alloc_method_env },			/* radius */
+			{ .section = SECTION_NAME("accounting", "Start"), .method = mod_update, .method_env = &mem_ippool_update_method_env },			/* radius */
+			{ .section = SECTION_NAME("accounting", "Interim-Update"), .method = mod_update, .method_env = &mem_ippool_update_method_env },		/* radius */
+			{ .section = SECTION_NAME("accounting", "Stop"), .method = mod_release, .method_env = &mem_ippool_release_method_env },			/* radius */
+
+			{ .section = SECTION_NAME("recv", "Discover"), .method = mod_alloc, .method_env = &mem_ippool_alloc_method_env },				/* dhcpv4 */
+			{ .section = SECTION_NAME("recv", "Release"), .method = mod_release, .method_env = &mem_ippool_release_method_env }, 			/* dhcpv4 */
+			{ .section = SECTION_NAME("send", "Ack"), .method = mod_update, .method_env = &mem_ippool_update_method_env },				/* dhcpv4 */
+
+			{ .section = SECTION_NAME("recv", "Solicit"), .method = mod_alloc, .method_env = &mem_ippool_alloc_method_env },				/* dhcpv6 */
+
+			{ .section = SECTION_NAME("recv", CF_IDENT_ANY), .method = mod_update, .method_env = &mem_ippool_update_method_env },				/* generic */
+			{ .section = SECTION_NAME("send", CF_IDENT_ANY), .method = mod_alloc, .method_env = &mem_ippool_alloc_method_env },				/* generic */
+
+			{ .section = SECTION_NAME("allocate", NULL), .method = mod_alloc, .method_env = &mem_ippool_alloc_method_env },				/* verb */
+			{ .section = SECTION_NAME("update", NULL), .method = mod_update, .method_env = &mem_ippool_update_method_env },				/* verb */
+			{ .section = SECTION_NAME("renew", NULL), .method = mod_update, .method_env = &mem_ippool_update_method_env },				/* verb */
+			{ .section = SECTION_NAME("release", NULL), .method = mod_release, .method_env = &mem_ippool_release_method_env },				/* verb */
+			MODULE_BINDING_TERMINATOR
+		}
+	}
+};
@@ -0,0 +1,7 @@
+#
+#  rlm_ocsp itself is still being ported, so only the responder client
+#  and response cache are built, along with their tests.
+#
+ifneq ($(OPENSSL_LIBS),)
+SUBMAKEFILES := ocsp_cache_tests.mk
+endif
@@ -7,10 +7,13 @@ static conf_parser_t ocsp_config[] = {
 	{ FR_CONF_OFFSET("override_cert_url", fr_tls_ocsp_conf_t, override_url), .dflt = "no" },
 	{ FR_CONF_OFFSET("url", fr_tls_ocsp_conf_t, url) },
 	{ FR_CONF_OFFSET("use_nonce", fr_tls_ocsp_conf_t, use_nonce), .dflt = "yes" },
-	{ FR_CONF_OFFSET("timeout", fr_tls_ocsp_conf_t, timeout), .dflt = "yes" },
+	{ FR_CONF_OFFSET("timeout", fr_tls_ocsp_conf_t, timeout), .dflt = "0" },
 	{ FR_CONF_OFFSET("softfail", fr_tls_ocsp_conf_t, softfail), .dflt = "no" },
 	{ FR_CONF_OFFSET("verifycert", fr_tls_ocsp_conf_t, verifycert), .dflt = "yes" },
 
+	{ FR_CONF_OFFSET("cache_size", fr_tls_ocsp_conf_t, cache_size), .dflt = "0" },
+	{ FR_CONF_OFFSET("cache_refresh", fr_tls_ocsp_conf_t, cache_refresh), .dflt = "60" },
+
 	CONF_PARSER_TERMINATOR
 };
 #endif
@@ -67,6 +70,20 @@ static conf_parser_t ocsp_config[] = {
 		conf->staple.store = conf_ocsp_revocation_store(conf);
 		if (conf->staple.store == NULL) goto error;
 	}
+
+	/*
+	 *	In-memory response caches, these start a thread
+	 *	to refresh responses, so need the stores above.
+	 */
+	if (conf->ocsp.enable && conf->ocsp.cache_size) {
+		conf->ocsp.mem_cache = fr_tls_ocsp_cache_alloc(conf, &conf->ocsp);
+		if (!conf->ocsp.mem_cache) goto error;
+	}
+
+	if (conf->staple.enable && conf->staple.cache_size) {
+		conf->staple.mem_cache = fr_tls_ocsp_cache_alloc(conf, &conf->staple);
+		if (!conf->staple.mem_cache) goto error;
+	}
 #endif /*HAVE_OPENSSL_OCSP_H*/
 
 
@@ -77,6 +94,13 @@ static int _conf_server_free(
 			     fr_tls_conf_t *conf)
 {
 #ifdef HAVE_OPENSSL_OCSP_H
+	/*
+	 *	Stop the refresh threads before freeing the
+	 *	stores they verify responses with.
+	 */
+	TALLOC_FREE(conf->ocsp.mem_cache);
+	TALLOC_FREE(conf->staple.mem_cache);
+
 	if (conf->ocsp.store) X509_STORE_free(conf->ocsp.store);
 	conf->ocsp.store = NULL;
 	if (conf->staple.store) X509_STORE_free(conf->staple.store);
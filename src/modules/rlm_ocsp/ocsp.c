@@ -44,20 +44,7 @@ USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
 #include "attrs.h"
 #include "base.h"
 #include "log.h"
-
-/** Rcodes returned by the OCSP check function
- */
-typedef enum {
-	OCSP_STATUS_FAILED	= 0,
-	OCSP_STATUS_OK		= 1,
-	OCSP_STATUS_SKIPPED	= 2,
-} ocsp_status_t;
-
-/** Maximum leeway in validity period of OCSP response
- *
- * Default 5 minutes.
- */
-#define OCSP_MAX_VALIDITY_PERIOD (5 * 60)
+#include "ocsp_cache.h"
 
 DIAG_OFF(DIAG_UNKNOWN_PRAGMAS)
 DIAG_OFF(used-but-marked-unused)	/* fix spurious warnings for sk macros */
@@ -349,18 +336,15 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 	char		*host = NULL;
 	char		*port = NULL;
 	char		*path = NULL;
-	char		host_header[1024];
 	int		use_ssl = -1;
 	long		this_fudge = OCSP_MAX_VALIDITY_PERIOD, this_max_age = -1;
-	BIO		*conn = NULL, *ssl_log = NULL;
+	BIO		*ssl_log = NULL;
 	ocsp_status_t   ocsp_status = OCSP_STATUS_FAILED;
 	ocsp_status_t	status;
 	ASN1_GENERALIZEDTIME *rev, *this_update, *next_update;
 	int		reason;
-	OCSP_REQ_CTX	*ctx;
-	int		rc;
+	time_t		next = 0;
 
-	fr_time_t	start;
 	fr_pair_t	*vp;
 
 	if (conf->cache_server) {
@@ -450,6 +434,22 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 	OCSP_request_add0_id(req, certid);
 	if (conf->use_nonce) OCSP_request_add1_nonce(req, NULL, 8);
 
+	/*
+	 *	Check the in-memory cache.  Entries are refreshed in
+	 *	the background, so we should rarely need to contact
+	 *	the responder for a certificate we've seen before.
+	 */
+	if (conf->mem_cache && ocsp_cache_find(&ocsp_status, &resp, &next, conf->mem_cache, certid)) {
+		RDEBUG2("Found cached OCSP response");
+
+		MEM(pair_update_request(&vp, attr_tls_ocsp_next_update) >= 0);
+		vp->vp_uint32 = next - time(NULL);
+		RINDENT();
+		RDEBUG2("%pP", vp);
+		REXDENT();
+		goto finish;
+	}
+
 	/*
 	 *	Send OCSP Request and get OCSP Response
 	 */
@@ -491,63 +491,7 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 
 	RDEBUG2("Using responder URL \"http://%s:%s%s\"", host, port, path);
 
-	/* Check host and port length are sane, then create Host: HTTP header */
-	if ((strlen(host) + strlen(port) + 2) > sizeof(host_header)) {
-		RWDEBUG("Host and port too long");
-		goto skipped;
-	}
-	snprintf(host_header, sizeof(host_header), "%s:%s", host, port);
-
-	/* Setup BIO socket to OCSP responder */
-	conn = BIO_new_connect(host);
-	BIO_set_conn_port(conn, port);
-
-	if (conf->timeout) BIO_set_nbio(conn, 1);
-
-	rc = BIO_do_connect(conn);
-	if ((rc <= 0) && ((!conf->timeout) || !BIO_should_retry(conn))) {
-		REDEBUG("Couldn't connect to OCSP responder");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
-	ctx = OCSP_sendreq_new(conn, path, NULL, -1);
-	if (!ctx) {
-		REDEBUG("Couldn't create OCSP request");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
-	if (!OCSP_REQ_CTX_add1_header(ctx, "Host", host_header)) {
-		REDEBUG("Couldn't set Host header");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
-	if (!OCSP_REQ_CTX_set1_req(ctx, req)) {
-		REDEBUG("Couldn't add data to OCSP request");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
-	start = fr_time();
-	do {
-		rc = OCSP_sendreq_nbio(&resp, ctx);
-		if (conf->timeout) {
-			if (conf->timeout > (fr_time() - start)) break;
-		}
-	} while ((rc == -1) && BIO_should_retry(conn));
-
-	if (conf->timeout && (rc == -1) && BIO_should_retry(conn)) {
-		REDEBUG("Response timed out");
-		ocsp_status = OCSP_STATUS_SKIPPED;
-		goto finish;
-	}
-
-	OCSP_REQ_CTX_free(ctx);
-
-	if (rc == 0) {
-		REDEBUG("Couldn't get OCSP response");
+	if (ocsp_send(&resp, request, conf, host, port, path, req) < 0) {
 		FR_OPENSSL_DRAIN_ERROR_QUEUE(REDEBUG, "", ssl_log);
 		ocsp_status = OCSP_STATUS_SKIPPED;
 		goto finish;
@@ -625,7 +569,6 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 	 */
 	if (next_update) {
 		fr_time_t	now;
-		time_t		next;
 
 		/*
 		 *	Sometimes we already know what 'now' is depending
@@ -678,6 +621,15 @@ int fr_tls_ocsp_check(request_t *request, SSL *ssl,
 		break;
 	}
 
+	/*
+	 *	Only definitive answers are cached, and only if we
+	 *	know when they need refreshing.
+	 */
+	if (conf->mem_cache && (next > 0) &&
+	    ((status == V_OCSP_CERTSTATUS_GOOD) || (status == V_OCSP_CERTSTATUS_REVOKED))) {
+		ocsp_cache_insert(conf->mem_cache, certid, host, port, path, ocsp_status, resp, next);
+	}
+
 finish:
 	switch (ocsp_status) {
 	case OCSP_STATUS_OK:
@@ -754,7 +706,6 @@ finish:
 	OPENSSL_free(host);
 	OPENSSL_free(port);
 	OPENSSL_free(path);
-	BIO_free_all(conn);
 	BIO_free(ssl_log);
 
 	return ocsp_status;
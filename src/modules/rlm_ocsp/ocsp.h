@@ -1,22 +1,4 @@
-/** OCSP Configuration
- *
- */
-typedef struct {
-	bool		enable;				//!< Enable OCSP checks
-	char const	*cache_server;			//!< Virtual server to restore retrieved OCSP status.
-	bool		override_url;			//!< Always use the configured OCSP URL even if the
-							//!< certificate contains one.
-	char const	*url;
-	bool		use_nonce;
-	X509_STORE	*store;
-	uint32_t	timeout;
-	bool		softfail;
-	bool		verifycert;
-
-
-	fr_tls_cache_t	cache;				//!< Cached cache section pointers.  Means we don't have
-							///< to look them up at runtime.
-} fr_tls_ocsp_conf_t;
+#include "ocsp_cache.h"
 
 #ifdef HAVE_OPENSSL_OCSP_H
 	fr_tls_ocsp_conf_t	ocsp;			//!< Configuration for validating client certificates
@@ -0,0 +1,628 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file rlm_ocsp/ocsp_cache.c
+ * @brief Query OCSP responders, and cache their responses.
+ *
+ * This is the part of the OCSP code which doesn't depend on the TLS
+ * session or configuration code, so it can be built and tested on its
+ * own.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
+
+#define LOG_PREFIX "tls - ocsp"
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/heap.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <freeradius-devel/tls/utils.h>
+
+#include <pthread.h>
+
+#include "ocsp_cache.h"
+
+/** Send an OCSP request to a responder, and read the response
+ *
+ * @param[out] out	Where to write the response.
+ * @param[in] request	The current request.  NULL when refreshing cached
+ *			responses in the background.
+ * @param[in] conf	OCSP configuration.
+ * @param[in] host	of the responder.
+ * @param[in] port	of the responder.
+ * @param[in] path	of the responder.
+ * @param[in] req	to send.
+ * @return
+ *	- 0 on success.
+ *	- -1 if no response was received.
+ */
+int ocsp_send(OCSP_RESPONSE **out, request_t *request, fr_tls_ocsp_conf_t const *conf,
+	      char const *host, char const *port, char const *path, OCSP_REQUEST *req)
+{
+	char			host_header[1024];
+	BIO			*conn;
+	OSSL_HTTP_REQ_CTX	*ctx = NULL;
+	fr_time_t		start;
+	int			rc;
+
+	*out = NULL;
+
+	/* Check host and port length are sane, then create Host: HTTP header */
+	if ((strlen(host) + strlen(port) + 2) > sizeof(host_header)) {
+		ROPTIONAL(RWDEBUG, WARN, "Host and port too long");
+		return -1;
+	}
+	snprintf(host_header, sizeof(host_header), "%s:%s", host, port);
+
+	/* Setup BIO socket to OCSP responder */
+	conn = BIO_new_connect(host);
+	if (!conn) {
+		ROPTIONAL(REDEBUG, ERROR, "Couldn't allocate connection to OCSP responder");
+		return -1;
+	}
+	BIO_set_conn_port(conn, port);
+
+	if (fr_time_delta_ispos(conf->timeout)) BIO_set_nbio(conn, 1);
+
+	rc = BIO_do_connect(conn);
+	if ((rc <= 0) && (!fr_time_delta_ispos(conf->timeout) || !BIO_should_retry(conn))) {
+		ROPTIONAL(REDEBUG, ERROR, "Couldn't connect to OCSP responder");
+	error:
+		OSSL_HTTP_REQ_CTX_free(ctx);
+		BIO_free_all(conn);
+		return -1;
+	}
+
+	ctx = OCSP_sendreq_new(conn, path, NULL, -1);
+	if (!ctx) {
+		ROPTIONAL(REDEBUG, ERROR, "Couldn't create OCSP request");
+		goto error;
+	}
+
+	if (!OSSL_HTTP_REQ_CTX_add1_header(ctx, "Host", host_header)) {
+		ROPTIONAL(REDEBUG, ERROR, "Couldn't set Host header");
+		goto error;
+	}
+
+	if (!OSSL_HTTP_REQ_CTX_set1_req(ctx, "application/ocsp-request",
+					ASN1_ITEM_rptr(OCSP_REQUEST), (ASN1_VALUE const *)req)) {
+		ROPTIONAL(REDEBUG, ERROR, "Couldn't add data to OCSP request");
+		goto error;
+	}
+
+	start = fr_time();
+	do {
+		rc = OSSL_HTTP_REQ_CTX_nbio_d2i(ctx, (ASN1_VALUE **)out, ASN1_ITEM_rptr(OCSP_RESPONSE));
+		if (fr_time_delta_ispos(conf->timeout) &&
+		    fr_time_delta_gt(fr_time_sub(fr_time(), start), conf->timeout)) break;
+	} while ((rc == -1) && BIO_should_retry(conn));
+
+	if (fr_time_delta_ispos(conf->timeout) && (rc == -1) && BIO_should_retry(conn)) {
+		ROPTIONAL(REDEBUG, ERROR, "Response timed out");
+		goto error;
+	}
+
+	OSSL_HTTP_REQ_CTX_free(ctx);
+	BIO_free_all(conn);
+
+	if (rc != 1) {
+		ROPTIONAL(REDEBUG, ERROR, "Couldn't get OCSP response");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** A cached OCSP response
+ *
+ */
+typedef struct {
+	fr_heap_index_t		heap_id;	//!< Position in the refresh heap.
+	fr_dlist_t		lru_entry;	//!< Position in the LRU list.
+	bool			refreshing;	//!< Removed from the heap by the refresh thread.
+
+	uint8_t			*key;		//!< DER encoded OCSP_CERTID, i.e. the hashes of the
+						///< issuer's name and key, and the serial number.
+	size_t			key_len;
+
+	OCSP_CERTID		*certid;	//!< Used to build refresh requests.
+	char			*host;		//!< Responder the response was retrieved from.
+	char			*port;
+	char			*path;
+
+	ocsp_status_t		status;		//!< OCSP_STATUS_OK, or OCSP_STATUS_FAILED if revoked.
+	uint8_t			*resp;		//!< DER encoded response, for stapling.
+	size_t			resp_len;
+
+	time_t			next_update;	//!< When the response stops being valid.
+	time_t			refresh;	//!< When the refresh thread should fetch a new response.
+} ocsp_cache_entry_t;
+
+/** Shared cache of OCSP responses
+ *
+ * Lookups are done by the worker threads, and entries are refreshed by
+ * a dedicated thread before their nextUpdate time, so that handshakes
+ * rarely have to wait for the responder.
+ */
+struct fr_tls_ocsp_cache_s {
+	fr_tls_ocsp_conf_t const *conf;		//!< Responder and validation settings.
+
+	pthread_mutex_t		mutex;		//!< Protects everything below.
+	pthread_cond_t		cond;		//!< Signalled when the refresh heap changes.
+	fr_hash_table_t		*ht;		//!< Entries by key.
+	fr_heap_t		*heap;		//!< Entries by refresh time.
+	fr_dlist_head_t		lru;		//!< Entries by last use, most recent first.
+
+	pthread_t		thread;		//!< Refreshes entries in the background.
+	bool			stop;		//!< Tell the refresh thread to exit.
+};
+
+/** How long to wait before retrying a failed refresh
+ *
+ */
+#define OCSP_CACHE_RETRY_INTERVAL (30)
+
+static uint32_t ocsp_cache_hash(void const *data)
+{
+	ocsp_cache_entry_t const *entry = data;
+
+	return fr_hash(entry->key, entry->key_len);
+}
+
+static int8_t ocsp_cache_cmp(void const *one, void const *two)
+{
+	ocsp_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->key_len, b->key_len);
+	if (ret != 0) return ret;
+
+	ret = memcmp(a->key, b->key, a->key_len);
+	return CMP(ret, 0);
+}
+
+static int8_t ocsp_cache_refresh_cmp(void const *one, void const *two)
+{
+	ocsp_cache_entry_t const *a = one, *b = two;
+
+	return CMP(a->refresh, b->refresh);
+}
+
+static int _ocsp_cache_entry_free(ocsp_cache_entry_t *entry)
+{
+	OCSP_CERTID_free(entry->certid);
+	return 0;
+}
+
+static void ocsp_cache_entry_free(void *data)
+{
+	talloc_free(data);
+}
+
+/** Remove an entry from the cache and free it
+ *
+ * @note Must be called with the cache mutex held, and not for an entry
+ *	 the refresh thread is working on.
+ */
+static void ocsp_cache_entry_remove(fr_tls_ocsp_cache_t *cache, ocsp_cache_entry_t *entry)
+{
+	fr_assert(!entry->refreshing);
+
+	fr_dlist_remove(&cache->lru, entry);
+	if (fr_heap_entry_inserted(entry->heap_id)) (void) fr_heap_extract(&cache->heap, entry);
+	fr_hash_table_delete(cache->ht, entry);
+}
+
+/** Serialise a certid so it can be used as a key
+ *
+ */
+static int ocsp_cache_key(uint8_t **out, size_t *out_len, TALLOC_CTX *ctx, OCSP_CERTID *certid)
+{
+	uint8_t	*der = NULL;
+	int	len;
+
+	len = i2d_OCSP_CERTID(certid, &der);
+	if (len <= 0) return -1;
+
+	*out = talloc_memdup(ctx, der, len);
+	*out_len = len;
+	OPENSSL_free(der);
+
+	return 0;
+}
+
+/** Work out when a response should be refreshed
+ *
+ */
+static time_t ocsp_cache_refresh_time(fr_tls_ocsp_conf_t const *conf, time_t next_update, time_t now)
+{
+	time_t refresh = next_update - fr_time_delta_to_sec(conf->cache_refresh);
+
+	return (refresh < now) ? now : refresh;
+}
+
+/** Replace the response held by an entry
+ *
+ * @note Must be called with the cache mutex held.
+ */
+static int ocsp_cache_entry_update(ocsp_cache_entry_t *entry, ocsp_status_t status,
+				   OCSP_RESPONSE *resp, time_t next_update)
+{
+	uint8_t	*der = NULL;
+	int	len;
+
+	len = i2d_OCSP_RESPONSE(resp, &der);
+	if (len <= 0) return -1;
+
+	talloc_free(entry->resp);
+	entry->resp = talloc_memdup(entry, der, len);
+	entry->resp_len = len;
+	OPENSSL_free(der);
+
+	entry->status = status;
+	entry->next_update = next_update;
+
+	return 0;
+}
+
+/** Add a response to the cache, or update an existing entry
+ *
+ */
+void ocsp_cache_insert(fr_tls_ocsp_cache_t *cache, OCSP_CERTID *certid,
+			      char const *host, char const *port, char const *path,
+			      ocsp_status_t status, OCSP_RESPONSE *resp, time_t next_update)
+{
+	ocsp_cache_entry_t	*entry, *found;
+	time_t			now = time(NULL);
+
+	/*
+	 *	Built outside of the mutex.  Entries are top
+	 *	level talloc chunks, as they're allocated by
+	 *	many threads.
+	 */
+	MEM(entry = talloc_zero(NULL, ocsp_cache_entry_t));
+	talloc_set_destructor(entry, _ocsp_cache_entry_free);
+
+	if ((ocsp_cache_key(&entry->key, &entry->key_len, entry, certid) < 0) ||
+	    (ocsp_cache_entry_update(entry, status, resp, next_update) < 0)) {
+		talloc_free(entry);
+		return;
+	}
+	entry->refresh = ocsp_cache_refresh_time(cache->conf, next_update, now);
+
+	pthread_mutex_lock(&cache->mutex);
+	found = fr_hash_table_find(cache->ht, entry);
+	if (found) {
+		(void) ocsp_cache_entry_update(found, status, resp, next_update);
+		found->refresh = entry->refresh;
+
+		/*
+		 *	If the refresh thread has the entry,
+		 *	it'll put it back into the heap.
+		 */
+		if (!found->refreshing) {
+			(void) fr_heap_extract(&cache->heap, found);
+			(void) fr_heap_insert(&cache->heap, found);
+		}
+		fr_dlist_remove(&cache->lru, found);
+		fr_dlist_insert_head(&cache->lru, found);
+		pthread_mutex_unlock(&cache->mutex);
+		talloc_free(entry);
+		return;
+	}
+
+	MEM(entry->certid = OCSP_CERTID_dup(certid));
+	MEM(entry->host = talloc_strdup(entry, host));
+	MEM(entry->port = talloc_strdup(entry, port));
+	MEM(entry->path = talloc_strdup(entry, path));
+
+	/*
+	 *	Evict the least recently used entry.  The one
+	 *	being refreshed can't be freed from under the
+	 *	refresh thread, so skip it.
+	 */
+	if (fr_hash_table_num_elements(cache->ht) >= cache->conf->cache_size) {
+		ocsp_cache_entry_t *evict = fr_dlist_tail(&cache->lru);
+
+		if (evict && evict->refreshing) evict = fr_dlist_prev(&cache->lru, evict);
+		if (evict) ocsp_cache_entry_remove(cache, evict);
+	}
+
+	if (!fr_hash_table_insert(cache->ht, entry)) {
+		pthread_mutex_unlock(&cache->mutex);
+		talloc_free(entry);
+		return;
+	}
+	(void) fr_heap_insert(&cache->heap, entry);
+	fr_dlist_insert_head(&cache->lru, entry);
+	pthread_cond_signal(&cache->cond);
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/** Find a valid cached response
+ *
+ * @param[out] status		of the certificate.
+ * @param[out] resp		a copy of the cached response.  Must be freed
+ *				with OCSP_RESPONSE_free().
+ * @param[out] next_update	when the response stops being valid.
+ * @param[in] cache		to search.
+ * @param[in] certid		of the certificate being checked.
+ * @return
+ *	- true if a valid response was found.
+ *	- false if there was no valid response.
+ */
+bool ocsp_cache_find(ocsp_status_t *status, OCSP_RESPONSE **resp, time_t *next_update,
+			    fr_tls_ocsp_cache_t *cache, OCSP_CERTID *certid)
+{
+	ocsp_cache_entry_t	find, *found;
+	uint8_t			*der = NULL;
+	unsigned char const	*p;
+	int			len;
+
+	len = i2d_OCSP_CERTID(certid, &der);
+	if (len <= 0) return false;
+
+	find.key = der;
+	find.key_len = len;
+
+	pthread_mutex_lock(&cache->mutex);
+	found = fr_hash_table_find(cache->ht, &find);
+	if (!found || (found->next_update <= time(NULL))) {
+		pthread_mutex_unlock(&cache->mutex);
+		OPENSSL_free(der);
+		return false;
+	}
+
+	fr_dlist_remove(&cache->lru, found);
+	fr_dlist_insert_head(&cache->lru, found);
+
+	p = found->resp;
+	*resp = d2i_OCSP_RESPONSE(NULL, &p, found->resp_len);
+	*status = found->status;
+	*next_update = found->next_update;
+	pthread_mutex_unlock(&cache->mutex);
+
+	OPENSSL_free(der);
+
+	return (*resp != NULL);
+}
+
+/** Fetch and validate a new response for a cached entry
+ *
+ * This runs in the refresh thread, without a request, so messages go
+ * to the global log.
+ *
+ * @param[out] status		of the certificate.
+ * @param[out] out		the new response.  Must be freed with
+ *				OCSP_RESPONSE_free().
+ * @param[out] next_update	when the new response stops being valid.
+ * @param[in] conf		OCSP configuration.
+ * @param[in] certid		of the certificate to check.
+ * @param[in] host		of the responder.
+ * @param[in] port		of the responder.
+ * @param[in] path		of the responder.
+ * @return
+ *	- 0 on success.
+ *	- -1 if no usable response could be retrieved.
+ */
+int ocsp_cache_fetch(ocsp_status_t *status, OCSP_RESPONSE **out, time_t *next_update,
+		     fr_tls_ocsp_conf_t const *conf, OCSP_CERTID *certid,
+		     char const *host, char const *port, char const *path)
+{
+	request_t		*request = NULL;
+	OCSP_REQUEST		*req;
+	OCSP_RESPONSE		*resp = NULL;
+	OCSP_BASICRESP		*bresp = NULL;
+	OCSP_CERTID		*id;
+	ASN1_GENERALIZEDTIME	*rev, *this_update, *next;
+	int			cert_status, reason;
+	int			ret = -1;
+
+	MEM(req = OCSP_REQUEST_new());
+	MEM(id = OCSP_CERTID_dup(certid));
+	OCSP_request_add0_id(req, id);
+	if (conf->use_nonce) OCSP_request_add1_nonce(req, NULL, 8);
+
+	if (ocsp_send(&resp, request, conf, host, port, path, req) < 0) goto finish;
+
+	if (OCSP_response_status(resp) != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+		ERROR("Refresh failed, response status: %s", OCSP_response_status_str(OCSP_response_status(resp)));
+		goto finish;
+	}
+
+	bresp = OCSP_response_get1_basic(resp);
+	if (!bresp) goto finish;
+
+	if (conf->use_nonce && (OCSP_check_nonce(req, bresp) != 1)) {
+		ERROR("Refresh failed, response has wrong nonce value");
+		goto finish;
+	}
+
+	if (conf->verifycert && (OCSP_basic_verify(bresp, NULL, conf->store, 0) != 1)) {
+		ERROR("Refresh failed, couldn't verify OCSP basic response");
+		goto finish;
+	}
+
+	if (!OCSP_resp_find_status(bresp, certid, &cert_status, &reason, &rev, &this_update, &next) || !next ||
+	    !OCSP_check_validity(this_update, next, OCSP_MAX_VALIDITY_PERIOD, -1) ||
+	    (fr_tls_utils_asn1time_to_epoch(next_update, next) < 0)) {
+		ERROR("Refresh failed, response contains no valid status");
+		goto finish;
+	}
+
+	switch (cert_status) {
+	case V_OCSP_CERTSTATUS_GOOD:
+		*status = OCSP_STATUS_OK;
+		break;
+
+	case V_OCSP_CERTSTATUS_REVOKED:
+		*status = OCSP_STATUS_FAILED;
+		break;
+
+	default:
+		goto finish;
+	}
+
+	*out = resp;
+	resp = NULL;
+	ret = 0;
+
+finish:
+	while (ERR_get_error());	/* Don't leave errors for the workers */
+
+	OCSP_REQUEST_free(req);
+	OCSP_BASICRESP_free(bresp);
+	OCSP_RESPONSE_free(resp);
+
+	return ret;
+}
+
+/** Refresh cached responses before they expire
+ *
+ */
+static void *ocsp_cache_refresh_thread(void *arg)
+{
+	fr_tls_ocsp_cache_t	*cache = arg;
+	ocsp_cache_entry_t	*entry;
+
+	pthread_mutex_lock(&cache->mutex);
+	while (!cache->stop) {
+		ocsp_status_t	status;
+		OCSP_RESPONSE	*resp = NULL;
+		time_t		next_update, now = time(NULL);
+		int		ret;
+
+		entry = fr_heap_peek(cache->heap);
+		if (!entry) {
+			pthread_cond_wait(&cache->cond, &cache->mutex);
+			continue;
+		}
+
+		if (entry->refresh > now) {
+			struct timespec ts = { .tv_sec = entry->refresh };
+
+			(void) pthread_cond_timedwait(&cache->cond, &cache->mutex, &ts);
+			continue;
+		}
+
+		/*
+		 *	The host, port, path and certid of an entry
+		 *	never change, so they can be used without
+		 *	holding the mutex.
+		 */
+		(void) fr_heap_extract(&cache->heap, entry);
+		entry->refreshing = true;
+		pthread_mutex_unlock(&cache->mutex);
+
+		DEBUG2("Refreshing cached response from http://%s:%s%s", entry->host, entry->port, entry->path);
+		ret = ocsp_cache_fetch(&status, &resp, &next_update, cache->conf,
+				       entry->certid, entry->host, entry->port, entry->path);
+
+		pthread_mutex_lock(&cache->mutex);
+		entry->refreshing = false;
+		now = time(NULL);
+
+		if ((ret == 0) && (ocsp_cache_entry_update(entry, status, resp, next_update) == 0)) {
+			entry->refresh = ocsp_cache_refresh_time(cache->conf, next_update, now);
+		} else {
+			entry->refresh = now + OCSP_CACHE_RETRY_INTERVAL;
+		}
+		OCSP_RESPONSE_free(resp);
+
+		/*
+		 *	Couldn't get a new response before the old one
+		 *	expired, the next handshake will query the
+		 *	responder itself.
+		 */
+		if (entry->next_update <= now) {
+			ocsp_cache_entry_remove(cache, entry);
+			continue;
+		}
+
+		(void) fr_heap_insert(&cache->heap, entry);
+	}
+	pthread_mutex_unlock(&cache->mutex);
+
+	return NULL;
+}
+
+static int _ocsp_cache_free(fr_tls_ocsp_cache_t *cache)
+{
+	pthread_mutex_lock(&cache->mutex);
+	cache->stop = true;
+	pthread_cond_signal(&cache->cond);
+	pthread_mutex_unlock(&cache->mutex);
+
+	pthread_join(cache->thread, NULL);
+
+	TALLOC_FREE(cache->heap);
+	TALLOC_FREE(cache->ht);
+
+	pthread_cond_destroy(&cache->cond);
+	pthread_mutex_destroy(&cache->mutex);
+
+	return 0;
+}
+
+/** Allocate an in-memory OCSP response cache, and start its refresh thread
+ *
+ * @param[in] ctx	to allocate the cache in.
+ * @param[in] conf	OCSP configuration the cache is used with.  Must
+ *			outlive the cache.
+ * @return
+ *	- A new cache.
+ *	- NULL on failure.
+ */
+fr_tls_ocsp_cache_t *fr_tls_ocsp_cache_alloc(TALLOC_CTX *ctx, fr_tls_ocsp_conf_t const *conf)
+{
+	fr_tls_ocsp_cache_t	*cache;
+	int			ret;
+
+	MEM(cache = talloc_zero(ctx, fr_tls_ocsp_cache_t));
+	cache->conf = conf;
+
+	cache->ht = fr_hash_table_alloc(cache, ocsp_cache_hash, ocsp_cache_cmp, ocsp_cache_entry_free);
+	cache->heap = fr_heap_talloc_alloc(cache, ocsp_cache_refresh_cmp, ocsp_cache_entry_t, heap_id, 0);
+	fr_dlist_talloc_init(&cache->lru, ocsp_cache_entry_t, lru_entry);
+	if (!cache->ht || !cache->heap) {
+		talloc_free(cache);
+		return NULL;
+	}
+
+	pthread_mutex_init(&cache->mutex, NULL);
+	pthread_cond_init(&cache->cond, NULL);
+
+	ret = pthread_create(&cache->thread, NULL, ocsp_cache_refresh_thread, cache);
+	if (ret != 0) {
+		ERROR("Failed creating OCSP refresh thread: %s", fr_syserror(ret));
+		pthread_cond_destroy(&cache->cond);
+		pthread_mutex_destroy(&cache->mutex);
+		talloc_free(cache);
+		return NULL;
+	}
+	talloc_set_destructor(cache, _ocsp_cache_free);
+
+	return cache;
+}
@@ -0,0 +1,100 @@
+#pragma once
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file rlm_ocsp/ocsp_cache.h
+ * @brief Query OCSP responders, and cache their responses.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(ocsp_cache_h, "$Id$")
+
+#include <freeradius-devel/server/request.h>
+#include <freeradius-devel/server/tmpl.h>
+#include <freeradius-devel/util/time.h>
+
+#include <freeradius-devel/tls/openssl_user_macros.h>
+#include <freeradius-devel/tls/cache.h>
+#include <openssl/ocsp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Rcodes returned by the OCSP check function
+ */
+typedef enum {
+	OCSP_STATUS_FAILED	= 0,
+	OCSP_STATUS_OK		= 1,
+	OCSP_STATUS_SKIPPED	= 2,
+} ocsp_status_t;
+
+/** Maximum leeway in validity period of OCSP response
+ *
+ * Default 5 minutes.
+ */
+#define OCSP_MAX_VALIDITY_PERIOD (5 * 60)
+
+typedef struct fr_tls_ocsp_cache_s fr_tls_ocsp_cache_t;
+
+/** OCSP Configuration
+ *
+ */
+typedef struct {
+	bool		enable;				//!< Enable OCSP checks
+	char const	*cache_server;			//!< Virtual server to restore retrieved OCSP status.
+	bool		override_url;			//!< Always use the configured OCSP URL even if the
+							//!< certificate contains one.
+	char const	*url;
+	bool		use_nonce;
+	X509_STORE	*store;
+	fr_time_delta_t	timeout;			//!< How long to wait for the responder.  0 means
+							///< wait forever.
+	bool		softfail;
+	bool		verifycert;
+
+
+	fr_tls_cache_t	cache;				//!< Cached cache section pointers.  Means we don't have
+							///< to look them up at runtime.
+
+	uint32_t	cache_size;			//!< Maximum number of responses to hold in memory.
+							///< 0 disables the in-memory cache.
+	fr_time_delta_t	cache_refresh;			//!< How long before nextUpdate to fetch a new response.
+	fr_tls_ocsp_cache_t *mem_cache;			//!< Responses shared between all threads.
+} fr_tls_ocsp_conf_t;
+
+int		ocsp_send(OCSP_RESPONSE **out, request_t *request, fr_tls_ocsp_conf_t const *conf,
+			  char const *host, char const *port, char const *path, OCSP_REQUEST *req);
+
+fr_tls_ocsp_cache_t *fr_tls_ocsp_cache_alloc(TALLOC_CTX *ctx, fr_tls_ocsp_conf_t const *conf);
+
+void		ocsp_cache_insert(fr_tls_ocsp_cache_t *cache, OCSP_CERTID *certid,
+				  char const *host, char const *port, char const *path,
+				  ocsp_status_t status, OCSP_RESPONSE *resp, time_t next_update);
+
+bool		ocsp_cache_find(ocsp_status_t *status, OCSP_RESPONSE **resp, time_t *next_update,
+				fr_tls_ocsp_cache_t *cache, OCSP_CERTID *certid);
+
+int		ocsp_cache_fetch(ocsp_status_t *status, OCSP_RESPONSE **out, time_t *next_update,
+				 fr_tls_ocsp_conf_t const *conf, OCSP_CERTID *certid,
+				 char const *host, char const *port, char const *path);
+
+#ifdef __cplusplus
+}
+#endif
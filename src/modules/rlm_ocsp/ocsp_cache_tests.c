@@ -0,0 +1,582 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the OCSP responder client and response cache
+ *
+ * Responses come from a stub responder running in a thread, which
+ * answers for a CA generated at startup.
+ *
+ * @file src/modules/rlm_ocsp/ocsp_cache_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+/*
+ *	Include the source, so the tests can look at the
+ *	LRU list.
+ */
+#include "ocsp_cache.c"
+
+/** What the stub responder does with a request
+ *
+ */
+typedef enum {
+	STUB_GOOD = 0,					//!< Certificate is good.
+	STUB_REVOKED,					//!< Certificate has been revoked.
+	STUB_SILENT					//!< Read the request, never reply.
+} stub_mode_t;
+
+typedef struct {
+	int			fd;			//!< Listening socket.
+	char			port[8];		//!< Port we're listening on.
+	pthread_t		thread;
+
+	stub_mode_t		mode;			//!< Set before each test.
+	time_t			valid;			//!< How long responses are valid for.
+	int			requests;		//!< How many requests were answered.
+	pthread_mutex_t		mutex;
+} stub_responder_t;
+
+static TALLOC_CTX		*autofree;
+static EVP_PKEY			*ca_key;
+static X509			*ca_cert;
+static X509_STORE		*ca_store;
+static stub_responder_t		stub;
+
+/** Create a certificate issued by the test CA
+ *
+ * If the CA doesn't exist yet, the certificate is self signed and becomes the CA.
+ */
+static X509 *test_cert_alloc(long serial)
+{
+	X509		*cert;
+	X509_NAME	*name;
+	char		cn[32];
+
+	MEM(cert = X509_new());
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
+	X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+	X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+	X509_set_pubkey(cert, ca_key);
+
+	snprintf(cn, sizeof(cn), "ocsp test %ld", serial);
+	name = X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (unsigned char const *)cn, -1, -1, 0);
+	X509_set_issuer_name(cert, ca_cert ? X509_get_subject_name(ca_cert) : name);
+
+	if (!X509_sign(cert, ca_key, EVP_sha256())) {
+		X509_free(cert);
+		return NULL;
+	}
+
+	return cert;
+}
+
+static OCSP_CERTID *test_certid_alloc(long serial)
+{
+	X509		*cert;
+	OCSP_CERTID	*certid;
+
+	cert = test_cert_alloc(serial);
+	if (!cert) return NULL;
+
+	certid = OCSP_cert_to_id(NULL, cert, ca_cert);
+	X509_free(cert);
+
+	return certid;
+}
+
+/** Build a signed response for a certid
+ *
+ */
+static OCSP_RESPONSE *test_response_alloc(OCSP_REQUEST *req, OCSP_CERTID *certid, stub_mode_t mode, time_t valid)
+{
+	OCSP_BASICRESP	*bresp;
+	OCSP_RESPONSE	*resp;
+	ASN1_TIME	*this_update, *next_update, *rev = NULL;
+	int		status = V_OCSP_CERTSTATUS_GOOD;
+
+	MEM(bresp = OCSP_BASICRESP_new());
+	this_update = X509_gmtime_adj(NULL, -60);
+	next_update = X509_gmtime_adj(NULL, valid);
+
+	if (mode == STUB_REVOKED) {
+		status = V_OCSP_CERTSTATUS_REVOKED;
+		rev = X509_gmtime_adj(NULL, -3600);
+	}
+
+	OCSP_basic_add1_status(bresp, certid, status, OCSP_REVOKED_STATUS_KEYCOMPROMISE, rev,
+			       this_update, next_update);
+	if (req) OCSP_copy_nonce(bresp, req);
+	OCSP_basic_sign(bresp, ca_cert, ca_key, EVP_sha256(), NULL, 0);
+
+	resp = OCSP_response_create(OCSP_RESPONSE_STATUS_SUCCESSFUL, bresp);
+
+	ASN1_TIME_free(this_update);
+	ASN1_TIME_free(next_update);
+	ASN1_TIME_free(rev);
+	OCSP_BASICRESP_free(bresp);
+
+	return resp;
+}
+
+/** Read an HTTP request, returning a pointer to the body
+ *
+ */
+static uint8_t *stub_read_request(int fd, uint8_t *buff, size_t bufflen, size_t *body_len)
+{
+	size_t	used = 0;
+	char	*end, *p;
+	long	content_length;
+
+	for (;;) {
+		ssize_t slen;
+
+		if (used == bufflen) return NULL;
+
+		slen = read(fd, buff + used, bufflen - used);
+		if (slen <= 0) return NULL;
+		used += slen;
+
+		end = memmem(buff, used, "\r\n\r\n", 4);
+		if (!end) continue;
+
+		p = memmem(buff, end - (char *)buff, "Content-Length:", 15);
+		if (!p) return NULL;
+
+		content_length = strtol(p + 15, NULL, 10);
+		end += 4;
+
+		if ((size_t)((uint8_t *)end - buff) + content_length > used) continue;
+
+		*body_len = content_length;
+		return (uint8_t *)end;
+	}
+}
+
+static void *stub_responder_thread(UNUSED void *arg)
+{
+	for (;;) {
+		uint8_t			buff[8192], *body, *der = NULL;
+		unsigned char const	*p;
+		size_t			body_len;
+		int			fd, len;
+		char			header[128];
+		OCSP_REQUEST		*req;
+		OCSP_RESPONSE		*resp;
+		stub_mode_t		mode;
+		time_t			valid;
+
+		fd = accept(stub.fd, NULL, NULL);
+		if (fd < 0) break;
+
+		body = stub_read_request(fd, buff, sizeof(buff), &body_len);
+		if (!body) {
+			close(fd);
+			continue;
+		}
+
+		pthread_mutex_lock(&stub.mutex);
+		mode = stub.mode;
+		valid = stub.valid;
+		pthread_mutex_unlock(&stub.mutex);
+
+		/*
+		 *	Hold the connection open until the client
+		 *	gives up.
+		 */
+		if (mode == STUB_SILENT) {
+			while (read(fd, buff, sizeof(buff)) > 0);
+			close(fd);
+			continue;
+		}
+
+		p = body;
+		req = d2i_OCSP_REQUEST(NULL, &p, body_len);
+		if (!req) {
+			close(fd);
+			continue;
+		}
+
+		resp = test_response_alloc(req, OCSP_onereq_get0_id(OCSP_request_onereq_get0(req, 0)), mode, valid);
+		len = i2d_OCSP_RESPONSE(resp, &der);
+
+		snprintf(header, sizeof(header),
+			 "HTTP/1.0 200 OK\r\n"
+			 "Content-Type: application/ocsp-response\r\n"
+			 "Content-Length: %i\r\n\r\n", len);
+		if ((write(fd, header, strlen(header)) < 0) || (write(fd, der, len) < 0)) {
+			/* client went away */
+		}
+
+		pthread_mutex_lock(&stub.mutex);
+		stub.requests++;
+		pthread_mutex_unlock(&stub.mutex);
+
+		OPENSSL_free(der);
+		OCSP_RESPONSE_free(resp);
+		OCSP_REQUEST_free(req);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static int stub_responder_start(void)
+{
+	struct sockaddr_in	sin = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+	socklen_t		len = sizeof(sin);
+
+	stub.fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (stub.fd < 0) return -1;
+
+	if ((bind(stub.fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) ||
+	    (listen(stub.fd, 8) < 0) ||
+	    (getsockname(stub.fd, (struct sockaddr *)&sin, &len) < 0)) {
+		close(stub.fd);
+		return -1;
+	}
+	snprintf(stub.port, sizeof(stub.port), "%u", ntohs(sin.sin_port));
+
+	pthread_mutex_init(&stub.mutex, NULL);
+
+	return pthread_create(&stub.thread, NULL, stub_responder_thread, NULL);
+}
+
+static void stub_responder_set(stub_mode_t mode, time_t valid)
+{
+	pthread_mutex_lock(&stub.mutex);
+	stub.mode = mode;
+	stub.valid = valid;
+	pthread_mutex_unlock(&stub.mutex);
+}
+
+static int stub_responder_requests(void)
+{
+	int requests;
+
+	pthread_mutex_lock(&stub.mutex);
+	requests = stub.requests;
+	pthread_mutex_unlock(&stub.mutex);
+
+	return requests;
+}
+
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("ocsp_cache_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_time_start() < 0) goto error;
+
+	ca_key = EVP_PKEY_Q_keygen(NULL, NULL, "EC", "P-256");
+	if (!ca_key) goto error;
+
+	ca_cert = test_cert_alloc(1);
+	if (!ca_cert) goto error;
+
+	ca_store = X509_STORE_new();
+	if (!ca_store || !X509_STORE_add_cert(ca_store, ca_cert)) goto error;
+
+	if (stub_responder_start() != 0) goto error;
+}
+
+static void test_conf_init(fr_tls_ocsp_conf_t *conf)
+{
+	*conf = (fr_tls_ocsp_conf_t) {
+		.enable = true,
+		.use_nonce = true,
+		.verifycert = true,
+		.store = ca_store,
+		.timeout = fr_time_delta_from_sec(5),
+		.cache_size = 16,
+		.cache_refresh = fr_time_delta_from_sec(60)
+	};
+}
+
+/** A good response is fetched, verified and returned
+ *
+ * With a timeout set, requests use non-blocking I/O, and the exchange
+ * must be allowed to complete before the timeout.
+ */
+static void test_fetch_good(void)
+{
+	fr_tls_ocsp_conf_t	conf;
+	OCSP_CERTID		*certid;
+	OCSP_RESPONSE		*resp = NULL;
+	ocsp_status_t		status = OCSP_STATUS_SKIPPED;
+	time_t			next_update = 0;
+
+	test_conf_init(&conf);
+	stub_responder_set(STUB_GOOD, 3600);
+
+	TEST_ASSERT((certid = test_certid_alloc(100)) != NULL);
+
+	TEST_CHECK_RET(ocsp_cache_fetch(&status, &resp, &next_update, &conf, certid,
+					"127.0.0.1", stub.port, "/"), 0);
+	TEST_CHECK(status == OCSP_STATUS_OK);
+	TEST_CHECK(resp != NULL);
+	TEST_CHECK(next_update > time(NULL) + 3000);
+
+	/*
+	 *	Without a timeout, blocking I/O is used.
+	 */
+	OCSP_RESPONSE_free(resp);
+	resp = NULL;
+	conf.timeout = fr_time_delta_wrap(0);
+
+	TEST_CHECK_RET(ocsp_cache_fetch(&status, &resp, &next_update, &conf, certid,
+					"127.0.0.1", stub.port, "/"), 0);
+	TEST_CHECK(status == OCSP_STATUS_OK);
+
+	OCSP_RESPONSE_free(resp);
+	OCSP_CERTID_free(certid);
+}
+
+static void test_fetch_revoked(void)
+{
+	fr_tls_ocsp_conf_t	conf;
+	OCSP_CERTID		*certid;
+	OCSP_RESPONSE		*resp = NULL;
+	ocsp_status_t		status = OCSP_STATUS_SKIPPED;
+	time_t			next_update = 0;
+
+	test_conf_init(&conf);
+	stub_responder_set(STUB_REVOKED, 3600);
+
+	TEST_ASSERT((certid = test_certid_alloc(101)) != NULL);
+
+	TEST_CHECK_RET(ocsp_cache_fetch(&status, &resp, &next_update, &conf, certid,
+					"127.0.0.1", stub.port, "/"), 0);
+	TEST_CHECK(status == OCSP_STATUS_FAILED);
+
+	OCSP_RESPONSE_free(resp);
+	OCSP_CERTID_free(certid);
+}
+
+/** A responder which never answers is given up on after the timeout
+ *
+ */
+static void test_fetch_timeout(void)
+{
+	fr_tls_ocsp_conf_t	conf;
+	OCSP_CERTID		*certid;
+	OCSP_RESPONSE		*resp = NULL;
+	ocsp_status_t		status = OCSP_STATUS_SKIPPED;
+	time_t			next_update = 0;
+	fr_time_t		start;
+	fr_time_delta_t		elapsed;
+
+	test_conf_init(&conf);
+	conf.timeout = fr_time_delta_from_msec(500);
+	stub_responder_set(STUB_SILENT, 3600);
+
+	TEST_ASSERT((certid = test_certid_alloc(102)) != NULL);
+
+	start = fr_time();
+	TEST_CHECK_RET(ocsp_cache_fetch(&status, &resp, &next_update, &conf, certid,
+					"127.0.0.1", stub.port, "/"), -1);
+	elapsed = fr_time_sub(fr_time(), start);
+
+	TEST_CHECK(resp == NULL);
+	TEST_CHECK(fr_time_delta_gteq(elapsed, conf.timeout));
+	TEST_MSG("Gave up after %" PRId64 "ms", fr_time_delta_to_msec(elapsed));
+	TEST_CHECK(fr_time_delta_lt(elapsed, fr_time_delta_from_sec(5)));
+
+	OCSP_CERTID_free(certid);
+}
+
+/** Cached responses are found until they expire
+ *
+ */
+static void test_cache_find(void)
+{
+	fr_tls_ocsp_conf_t	conf;
+	fr_tls_ocsp_cache_t	*cache;
+	OCSP_CERTID		*good, *revoked, *missing;
+	OCSP_RESPONSE		*resp;
+	ocsp_status_t		status;
+	time_t			next_update, now = time(NULL);
+
+	test_conf_init(&conf);
+	TEST_ASSERT((cache = fr_tls_ocsp_cache_alloc(autofree, &conf)) != NULL);
+
+	TEST_ASSERT((good = test_certid_alloc(200)) != NULL);
+	TEST_ASSERT((revoked = test_certid_alloc(201)) != NULL);
+	TEST_ASSERT((missing = test_certid_alloc(202)) != NULL);
+
+	resp = test_response_alloc(NULL, good, STUB_GOOD, 3600);
+	ocsp_cache_insert(cache, good, "127.0.0.1", stub.port, "/", OCSP_STATUS_OK, resp, now + 3600);
+	OCSP_RESPONSE_free(resp);
+
+	resp = test_response_alloc(NULL, revoked, STUB_REVOKED, 3600);
+	ocsp_cache_insert(cache, revoked, "127.0.0.1", stub.port, "/", OCSP_STATUS_FAILED, resp, now + 3600);
+	OCSP_RESPONSE_free(resp);
+
+	resp = NULL;
+	TEST_CHECK(ocsp_cache_find(&status, &resp, &next_update, cache, good));
+	TEST_CHECK(status == OCSP_STATUS_OK);
+	TEST_CHECK(next_update == now + 3600);
+	OCSP_RESPONSE_free(resp);
+
+	resp = NULL;
+	TEST_CHECK(ocsp_cache_find(&status, &resp, &next_update, cache, revoked));
+	TEST_CHECK(status == OCSP_STATUS_FAILED);
+	OCSP_RESPONSE_free(resp);
+
+	TEST_CHECK(!ocsp_cache_find(&status, &resp, &next_update, cache, missing));
+
+	/*
+	 *	A response past its nextUpdate isn't used.
+	 */
+	resp = test_response_alloc(NULL, good, STUB_GOOD, 3600);
+	ocsp_cache_insert(cache, good, "127.0.0.1", stub.port, "/", OCSP_STATUS_OK, resp, now - 1);
+	OCSP_RESPONSE_free(resp);
+	TEST_CHECK(!ocsp_cache_find(&status, &resp, &next_update, cache, good));
+
+	OCSP_CERTID_free(good);
+	OCSP_CERTID_free(revoked);
+	OCSP_CERTID_free(missing);
+	talloc_free(cache);
+}
+
+/** When the cache is full, the least recently used entry is evicted
+ *
+ */
+static void test_cache_lru(void)
+{
+	fr_tls_ocsp_conf_t	conf;
+	fr_tls_ocsp_cache_t	*cache;
+	OCSP_CERTID		*certid[3];
+	OCSP_RESPONSE		*resp;
+	ocsp_status_t		status;
+	time_t			next_update, now = time(NULL);
+	size_t			i;
+
+	test_conf_init(&conf);
+	conf.cache_size = 2;
+	TEST_ASSERT((cache = fr_tls_ocsp_cache_alloc(autofree, &conf)) != NULL);
+
+	for (i = 0; i < NUM_ELEMENTS(certid); i++) TEST_ASSERT((certid[i] = test_certid_alloc(300 + i)) != NULL);
+
+	/*
+	 *	The first entry is refreshed last, and is the
+	 *	most recently used when the third is added.
+	 */
+	for (i = 0; i < 2; i++) {
+		resp = test_response_alloc(NULL, certid[i], STUB_GOOD, 7200 - (i * 3600));
+		ocsp_cache_insert(cache, certid[i], "127.0.0.1", stub.port, "/",
+				  OCSP_STATUS_OK, resp, now + 7200 - (i * 3600));
+		OCSP_RESPONSE_free(resp);
+	}
+
+	resp = NULL;
+	TEST_CHECK(ocsp_cache_find(&status, &resp, &next_update, cache, certid[0]));
+	OCSP_RESPONSE_free(resp);
+
+	resp = test_response_alloc(NULL, certid[2], STUB_GOOD, 3600);
+	ocsp_cache_insert(cache, certid[2], "127.0.0.1", stub.port, "/", OCSP_STATUS_OK, resp, now + 3600);
+	OCSP_RESPONSE_free(resp);
+
+	TEST_CHECK(fr_hash_table_num_elements(cache->ht) == 2);
+	TEST_CHECK(fr_dlist_num_elements(&cache->lru) == 2);
+
+	resp = NULL;
+	TEST_CHECK(ocsp_cache_find(&status, &resp, &next_update, cache, certid[0]));
+	TEST_MSG("Recently used entry was evicted");
+	OCSP_RESPONSE_free(resp);
+
+	TEST_CHECK(!ocsp_cache_find(&status, &resp, &next_update, cache, certid[1]));
+	TEST_MSG("Least recently used entry wasn't evicted");
+
+	resp = NULL;
+	TEST_CHECK(ocsp_cache_find(&status, &resp, &next_update, cache, certid[2]));
+	OCSP_RESPONSE_free(resp);
+
+	for (i = 0; i < NUM_ELEMENTS(certid); i++) OCSP_CERTID_free(certid[i]);
+	talloc_free(cache);
+}
+
+/** Entries are refreshed from the responder before they expire
+ *
+ */
+static void test_cache_refresh(void)
+{
+	fr_tls_ocsp_conf_t	conf;
+	fr_tls_ocsp_cache_t	*cache;
+	OCSP_CERTID		*certid;
+	OCSP_RESPONSE		*resp;
+	ocsp_status_t		status;
+	time_t			next_update = 0, now = time(NULL);
+	int			requests, i;
+
+	test_conf_init(&conf);
+	stub_responder_set(STUB_GOOD, 3600);
+	requests = stub_responder_requests();
+
+	TEST_ASSERT((cache = fr_tls_ocsp_cache_alloc(autofree, &conf)) != NULL);
+	TEST_ASSERT((certid = test_certid_alloc(400)) != NULL);
+
+	/*
+	 *	Due for a refresh now, as it's within
+	 *	cache_refresh of its nextUpdate.
+	 */
+	resp = test_response_alloc(NULL, certid, STUB_GOOD, 30);
+	ocsp_cache_insert(cache, certid, "127.0.0.1", stub.port, "/", OCSP_STATUS_OK, resp, now + 30);
+	OCSP_RESPONSE_free(resp);
+
+	for (i = 0; i < 50; i++) {
+		resp = NULL;
+		if (ocsp_cache_find(&status, &resp, &next_update, cache, certid)) OCSP_RESPONSE_free(resp);
+		if (next_update > now + 30) break;
+		usleep(100000);
+	}
+
+	TEST_CHECK(stub_responder_requests() > requests);
+	TEST_CHECK(next_update > now + 3000);
+	TEST_MSG("Entry wasn't refreshed, nextUpdate is %" PRId64 "s away", (int64_t)(next_update - now));
+
+	OCSP_CERTID_free(certid);
+	talloc_free(cache);
+}
+
+TEST_LIST = {
+	{ "fetch_good",		test_fetch_good },
+	{ "fetch_revoked",	test_fetch_revoked },
+	{ "fetch_timeout",	test_fetch_timeout },
+	{ "cache_find",		test_cache_find },
+	{ "cache_lru",		test_cache_lru },
+	{ "cache_refresh",	test_cache_refresh },
+
+	{ NULL }
+};
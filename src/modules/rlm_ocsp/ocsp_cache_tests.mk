@@ -0,0 +1,8 @@
+TARGET		:= ocsp_cache_tests$(E)
+SOURCES		:= ocsp_cache_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(OPENSSL_LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-tls$(L) libfreeradius-util$(L) libfreeradius-server$(L)
+
+TGT_INSTALLDIR	:=
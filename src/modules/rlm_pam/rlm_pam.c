@@ -32,6 +32,7 @@ RCSID("$Id$")
 
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/module_rlm.h>
+#include <freeradius-devel/unlang/offload.h>
 
 #include "config.h"
 
@@ -47,19 +48,54 @@ RCSID("$Id$")
 #  include <syslog.h>
 #endif
 
+#include <pthread.h>
+
 typedef struct {
-	char const *pam_auth_name;
+	char const		*pam_auth_name;
+
+	unlang_offload_config_t	offload;	//!< Thread pool configuration for PAM calls.
+	unlang_offload_pool_t	*pool;		//!< Thread pool which runs PAM calls.
 } rlm_pam_t;
 
 typedef struct {
-	request_t		*request;	//!< The current request.
+	unlang_offload_thread_t	*offload;	//!< This worker's view of the offload pool.
+} rlm_pam_thread_t;
+
+/** A message to log once the request resumes
+ *
+ */
+typedef struct {
+	bool		error;		//!< Log as an error, instead of debug.
+	char		*msg;		//!< The message.
+} rlm_pam_msg_t;
+
+typedef struct {
 	char const	*username;	//!< Username to provide to PAM when prompted.
 	char const	*password;	//!< Password to provide to PAM when prompted.
+	char const	*pam_auth;	//!< Service name to look up in pam.conf.
 	bool		error;		//!< True if pam_conv failed.
+
+	rlm_pam_msg_t	*msgs;		//!< Messages to log in the request, as the
+					///< PAM calls can't touch the request.
 } rlm_pam_data_t;
 
+/*
+ *	Many PAM modules aren't thread safe, and may be used by
+ *	several instances of this module.  One lock for the whole
+ *	process serialises the calls, so there's also only ever one
+ *	offload thread per instance.
+ */
+static pthread_mutex_t pam_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const conf_parser_t offload_config[] = {
+	{ FR_CONF_OFFSET("max_queued", unlang_offload_config_t, max_queued), .dflt = "1024" },
+	{ FR_CONF_OFFSET("timeout", unlang_offload_config_t, timeout), .dflt = "10s" },
+	CONF_PARSER_TERMINATOR
+};
+
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("pam_auth", rlm_pam_t, pam_auth_name) },
+	{ FR_CONF_OFFSET_SUBSECTION("offload", 0, rlm_pam_t, offload, offload_config) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -91,9 +127,51 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 
 	if (!inst->pam_auth_name) inst->pam_auth_name = main_config->name;
 
+	inst->offload.max_threads = 1;
+	inst->pool = unlang_offload_pool_alloc(inst, mctx->mi->name, &inst->offload);
+	if (!inst->pool) {
+		PERROR("Failed creating offload pool");
+		return -1;
+	}
+
 	return 0;
 }
 
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_pam_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_pam_t);
+	rlm_pam_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_pam_thread_t);
+
+	t->offload = unlang_offload_thread_alloc(t, inst->pool, mctx->el);
+	if (!t->offload) {
+		PERROR("Failed creating offload thread data");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Save a message to log once the request resumes
+ *
+ */
+static void pam_msg(rlm_pam_data_t *pam_config, bool error, char const *fmt, ...) CC_HINT(format (printf, 3, 4));
+static void pam_msg(rlm_pam_data_t *pam_config, bool error, char const *fmt, ...)
+{
+	va_list		ap;
+	size_t		num = talloc_array_length(pam_config->msgs);
+	rlm_pam_msg_t	*msgs;
+
+	msgs = talloc_realloc(pam_config, pam_config->msgs, rlm_pam_msg_t, num + 1);
+	if (!msgs) return;
+
+	va_start(ap, fmt);
+	msgs[num].error = error;
+	msgs[num].msg = talloc_vasprintf(msgs, fmt, ap);
+	va_end(ap);
+
+	pam_config->msgs = msgs;
+}
+
 /** Dialogue between RADIUS and PAM modules
  *
  * Uses PAM's appdata_ptr so it's thread safe, and doesn't
@@ -103,11 +181,8 @@ static int pam_conv(int num_msg, struct pam_message const **msg, struct pam_resp
 {
 	int		count;
 	struct		pam_response *reply;
-	request_t		*request;
 	rlm_pam_data_t	*pam_config = (rlm_pam_data_t *) appdata_ptr;
 
-	request = pam_config->request;
-
 #define COPY_STRING(s) ((s) ? talloc_strdup(reply, s) : NULL)
 	MEM(reply = talloc_zero_array(NULL, struct pam_response, num_msg));
 	for (count = 0; count < num_msg; count++) {
@@ -123,15 +198,15 @@ static int pam_conv(int num_msg, struct pam_message const **msg, struct pam_resp
 			break;
 
 		case PAM_TEXT_INFO:
-			RDEBUG2("%s", msg[count]->msg);
+			pam_msg(pam_config, false, "%s", msg[count]->msg);
 			break;
 
 		case PAM_ERROR_MSG:
 		default:
-			RERROR("PAM conversation failed");
+			pam_msg(pam_config, true, "PAM conversation failed");
 			/* Must be an error of some sort... */
 			for (count = 0; count < num_msg; count++) {
-				if (msg[count]->msg_style == PAM_ERROR_MSG) RERROR("%s", msg[count]->msg);
+				if (msg[count]->msg_style == PAM_ERROR_MSG) pam_msg(pam_config, true, "%s", msg[count]->msg);
 				if (reply[count].resp) {
 	  				/* could be a password, let's be sanitary */
 	  				memset(reply[count].resp, 0, strlen(reply[count].resp));
@@ -149,49 +224,48 @@ static int pam_conv(int num_msg, struct pam_message const **msg, struct pam_resp
 }
 
 /** Check the users password against the standard UNIX password table + PAM.
+ *
+ * Runs in the offload pool, as the PAM modules may block for an
+ * arbitrary amount of time.
  *
  * @note For most flexibility, passing a pamauth type to this function
  *	 allows you to have multiple authentication types (i.e. multiple
  *	 files associated with radius in /etc/pam.d).
  *
- * @param request The current request.
- * @param username User to authenticate.
- * @param passwd Password to authenticate with,
- * @param pamauth Type of PAM authentication.
+ * @param[in] uctx	#rlm_pam_data_t containing the username, password
+ *			and pamauth type.
  * @return
- *	- 0 on success.
- *	- -1 on failure.
+ *	- RLM_MODULE_OK on success.
+ *	- RLM_MODULE_REJECT on failure.
  */
-static int do_pam(request_t *request, char const *username, char const *passwd, char const *pamauth)
+static rlm_rcode_t do_pam(void *uctx)
 {
-	pam_handle_t *handle = NULL;
-	int ret;
-	rlm_pam_data_t pam_config;
-	struct pam_conv conv;
+	rlm_pam_data_t	*pam_config = talloc_get_type_abort(uctx, rlm_pam_data_t);
+	pam_handle_t	*handle = NULL;
+	int		ret;
+	struct pam_conv	conv;
 
 	/*
 	 *  Initialize the structures
 	 */
 	conv.conv = pam_conv;
-	conv.appdata_ptr = &pam_config;
-	pam_config.request = request;
-	pam_config.username = username;
-	pam_config.password = passwd;
-	pam_config.error = false;
+	conv.appdata_ptr = pam_config;
 
-	RDEBUG2("Using pamauth string \"%s\" for pam.conf lookup", pamauth);
+	pthread_mutex_lock(&pam_mutex);
 
-	ret = pam_start(pamauth, username, &conv, &handle);
+	ret = pam_start(pam_config->pam_auth, pam_config->username, &conv, &handle);
 	if (ret != PAM_SUCCESS) {
-		RERROR("pam_start failed: %s", pam_strerror(handle, ret));
-		return -1;
+		pam_msg(pam_config, true, "pam_start failed: %s", pam_strerror(handle, ret));
+	reject:
+		pthread_mutex_unlock(&pam_mutex);
+		return RLM_MODULE_REJECT;
 	}
 
 	ret = pam_authenticate(handle, 0);
 	if (ret != PAM_SUCCESS) {
-		RERROR("pam_authenticate failed: %s", pam_strerror(handle, ret));
+		pam_msg(pam_config, true, "pam_authenticate failed: %s", pam_strerror(handle, ret));
 		pam_end(handle, ret);
-		return -1;
+		goto reject;
 	}
 
 	/*
@@ -201,20 +275,44 @@ static int do_pam(request_t *request, char const *username, char const *passwd,
 #if !defined(__FreeBSD_version) || (__FreeBSD_version >= 400000)
 	ret = pam_acct_mgmt(handle, 0);
 	if (ret != PAM_SUCCESS) {
-		RERROR("pam_acct_mgmt failed: %s", pam_strerror(handle, ret));
+		pam_msg(pam_config, true, "pam_acct_mgmt failed: %s", pam_strerror(handle, ret));
 		pam_end(handle, ret);
-		return -1;
+		goto reject;
 	}
 #endif
-	RDEBUG2("Authentication succeeded");
+	pam_msg(pam_config, false, "Authentication succeeded");
 	pam_end(handle, ret);
-	return 0;
+
+	pthread_mutex_unlock(&pam_mutex);
+
+	return RLM_MODULE_OK;
+}
+
+/** Log the messages PAM gave us
+ *
+ */
+static unlang_action_t CC_HINT(nonnull) mod_authenticate_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+								request_t *request)
+{
+	rlm_pam_data_t	*pam_config = talloc_get_type_abort(mctx->rctx, rlm_pam_data_t);
+	size_t		i;
+
+	for (i = 0; i < talloc_array_length(pam_config->msgs); i++) {
+		if (pam_config->msgs[i].error) {
+			RERROR("%s", pam_config->msgs[i].msg);
+		} else {
+			RDEBUG2("%s", pam_config->msgs[i].msg);
+		}
+	}
+
+	RETURN_MODULE_RCODE(*p_result);
 }
 
 static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_pam_t const		*data = talloc_get_type_abort_const(mctx->mi->data, rlm_pam_t);
-	int			ret;
+	rlm_pam_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_pam_thread_t);
+	rlm_pam_data_t		*pam_config;
 	fr_pair_t		*pair;
 
 	char const		*pam_auth_string = data->pam_auth_name;
@@ -261,10 +359,19 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 	pair = fr_pair_find_by_da(&request->control_pairs, NULL, attr_pam_auth);
 	if (pair) pam_auth_string = pair->vp_strvalue;
 
-	ret = do_pam(request, username->vp_strvalue, password->vp_strvalue, pam_auth_string);
-	if (ret < 0) RETURN_MODULE_REJECT;
+	RDEBUG2("Using pamauth string \"%s\" for pam.conf lookup", pam_auth_string);
+
+	/*
+	 *	The PAM calls run in the offload pool, and
+	 *	the request may go away before they complete,
+	 *	so they get their own copies of everything.
+	 */
+	MEM(pam_config = talloc_zero(NULL, rlm_pam_data_t));
+	MEM(pam_config->username = talloc_bstrndup(pam_config, username->vp_strvalue, username->vp_length));
+	MEM(pam_config->password = talloc_bstrndup(pam_config, password->vp_strvalue, password->vp_length));
+	MEM(pam_config->pam_auth = talloc_strdup(pam_config, pam_auth_string));
 
-	RETURN_MODULE_OK;
+	return unlang_offload_yield(p_result, mctx, request, t->offload, do_pam, mod_authenticate_resume, pam_config);
 }
 
 extern module_rlm_t rlm_pam;
@@ -272,10 +379,11 @@ module_rlm_t rlm_pam = {
 	.common = {
 		.magic		= MODULE_MAGIC_INIT,
 		.name		= "pam",
-		.flags		= MODULE_TYPE_THREAD_UNSAFE,	/* The PAM libraries are not thread-safe */
 		.inst_size	= sizeof(rlm_pam_t),
 		.config		= module_config,
-		.instantiate	= mod_instantiate
+		.instantiate	= mod_instantiate,
+		.thread_inst_size	= sizeof(rlm_pam_thread_t),
+		.thread_instantiate	= mod_thread_instantiate
 	},
 	.method_group = {
 		.bindings = (module_method_binding_t[]){
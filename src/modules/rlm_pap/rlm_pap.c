@@ -39,6 +39,7 @@ USES_APPLE_DEPRECATED_API
 #include <freeradius-devel/util/sha1.h>
 
 #include <freeradius-devel/unlang/call_env.h>
+#include <freeradius-devel/unlang/offload.h>
 
 #include <freeradius-devel/protocol/freeradius/freeradius.internal.password.h>
 
@@ -73,12 +74,25 @@ static pthread_mutex_t fr_crypt_mutex = PTHREAD_MUTEX_INITIALIZER;
 typedef struct {
 	fr_dict_enum_value_t	*auth_type;
 	bool			normify;
+
+	unlang_offload_config_t	offload;	//!< Thread pool configuration for crypt().
+	unlang_offload_pool_t	*pool;		//!< Thread pool which runs crypt().
 } rlm_pap_t;
 
+typedef struct {
+	unlang_offload_thread_t	*offload;	//!< This worker's view of the offload pool.
+} rlm_pap_thread_t;
+
 typedef unlang_action_t (*pap_auth_func_t)(rlm_rcode_t *p_result, rlm_pap_t const *inst, request_t *request, fr_pair_t const *, fr_value_box_t const *);
 
+static const conf_parser_t offload_config[] = {
+	UNLANG_OFFLOAD_CONFIG_CONF_PARSER
+	CONF_PARSER_TERMINATOR
+};
+
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("normalise", rlm_pap_t, normify), .dflt = "yes" },
+	{ FR_CONF_OFFSET_SUBSECTION("offload", 0, rlm_pap_t, offload, offload_config) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -190,43 +204,84 @@ static unlang_action_t CC_HINT(nonnull) pap_auth_clear(rlm_rcode_t *p_result,
 }
 
 #ifdef HAVE_CRYPT
-static unlang_action_t CC_HINT(nonnull) pap_auth_crypt(rlm_rcode_t *p_result,
-						       UNUSED rlm_pap_t const *inst, request_t *request,
-						       fr_pair_t const *known_good, fr_value_box_t const *password)
+/** Inputs and outputs for a crypt() comparison
+ *
+ * Copied out of the request, as the comparison runs in the offload pool.
+ */
+typedef struct {
+	char const		*password;	//!< Cleartext password supplied by the user.
+	char const		*known_good;	//!< Crypt digest to compare it against.
+} pap_crypt_uctx_t;
+
+/** Compare a password against a crypt digest
+ *
+ * Runs in the offload pool, as crypt() can be arbitrarily slow
+ * depending on the algorithm and number of rounds in the digest.
+ */
+static rlm_rcode_t pap_crypt_offload(void *uctx)
 {
-	char	*crypt_out;
-	int	cmp = 0;
+	pap_crypt_uctx_t	*pc = talloc_get_type_abort(uctx, pap_crypt_uctx_t);
+	char			*crypt_out;
+	int			cmp = 0;
 
 #ifdef HAVE_CRYPT_R
 	struct crypt_data crypt_data = { .initialized = 0 };
 
-	crypt_out = crypt_r(password->vb_strvalue, known_good->vp_strvalue, &crypt_data);
-	if (crypt_out) cmp = strcmp(known_good->vp_strvalue, crypt_out);
+	crypt_out = crypt_r(pc->password, pc->known_good, &crypt_data);
+	if (crypt_out) cmp = strcmp(pc->known_good, crypt_out);
 #else
 	/*
 	 *	Ensure we're thread-safe, as crypt() isn't.
 	 */
 	pthread_mutex_lock(&fr_crypt_mutex);
-	crypt_out = crypt(password->vb_strvalue, known_good->vp_strvalue);
+	crypt_out = crypt(pc->password, pc->known_good);
 
 	/*
 	 *	Got something, check it within the lock.  This is
 	 *	faster than copying it to a local buffer, and the
 	 *	time spent within the lock is critical.
 	 */
-	if (crypt_out) cmp = strcmp(known_good->vp_strvalue, crypt_out);
+	if (crypt_out) cmp = strcmp(pc->known_good, crypt_out);
 	pthread_mutex_unlock(&fr_crypt_mutex);
 #endif
 
 	/*
 	 *	Error.
 	 */
-	if (!crypt_out || (cmp != 0)) {
+	if (!crypt_out || (cmp != 0)) return RLM_MODULE_REJECT;
+
+	return RLM_MODULE_OK;
+}
+
+static unlang_action_t CC_HINT(nonnull) pap_crypt_resume(rlm_rcode_t *p_result, UNUSED module_ctx_t const *mctx,
+							 request_t *request)
+{
+	switch (*p_result) {
+	case RLM_MODULE_REJECT:
 		REDEBUG("Crypt digest does not match \"known good\" digest");
-		RETURN_MODULE_REJECT;
+		REDEBUG("Password incorrect");
+		break;
+
+	case RLM_MODULE_OK:
+		RDEBUG2("User authenticated successfully");
+		break;
+
+	default:
+		break;
 	}
 
-	RETURN_MODULE_OK;
+	RETURN_MODULE_RCODE(*p_result);
+}
+
+/** Auth func for crypt passwords
+ *
+ * mod_authenticate() submits these to the offload pool directly, so this is never called.
+ */
+static unlang_action_t CC_HINT(nonnull) pap_auth_crypt(rlm_rcode_t *p_result,
+						       UNUSED rlm_pap_t const *inst, UNUSED request_t *request,
+						       UNUSED fr_pair_t const *known_good, UNUSED fr_value_box_t const *password)
+{
+	RETURN_MODULE_FAIL;
 }
 #endif
 
@@ -953,6 +1008,26 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 		RDEBUG2("Comparing with \"known-good\" %s (%zu)", known_good->da->name, known_good->vp_length);
 	}
 
+#ifdef HAVE_CRYPT
+	/*
+	 *	crypt() is slow, and blocks, so run it in the
+	 *	offload pool.  Everything it needs is copied
+	 *	into the uctx, as the request may go away
+	 *	before it completes.
+	 */
+	if (known_good->da->attr == FR_CRYPT) {
+		rlm_pap_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_pap_thread_t);
+		pap_crypt_uctx_t	*pc;
+
+		MEM(pc = talloc(NULL, pap_crypt_uctx_t));
+		MEM(pc->password = talloc_bstrndup(pc, env_data->password.vb_strvalue, env_data->password.vb_length));
+		MEM(pc->known_good = talloc_bstrndup(pc, known_good->vp_strvalue, known_good->vp_length));
+		if (ephemeral) TALLOC_FREE(known_good);
+
+		return unlang_offload_yield(p_result, mctx, request, t->offload, pap_crypt_offload, pap_crypt_resume, pc);
+	}
+#endif
+
 	/*
 	 *	Authenticate, and return.
 	 */
@@ -984,6 +1059,26 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		     mctx->mi->name);
 	}
 
+	inst->pool = unlang_offload_pool_alloc(inst, mctx->mi->name, &inst->offload);
+	if (!inst->pool) {
+		PERROR("Failed creating offload pool");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_pap_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_pap_t);
+	rlm_pap_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_pap_thread_t);
+
+	t->offload = unlang_offload_thread_alloc(t, inst->pool, mctx->el);
+	if (!t->offload) {
+		PERROR("Failed creating offload thread data");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -1062,7 +1157,9 @@ module_rlm_t rlm_pap = {
 		.onload		= mod_load,
 		.unload		= mod_unload,
 		.config		= module_config,
-		.instantiate	= mod_instantiate
+		.instantiate	= mod_instantiate,
+		.thread_inst_size	= sizeof(rlm_pap_thread_t),
+		.thread_instantiate	= mod_thread_instantiate
 	},
 	.method_group = {
 		.bindings = (module_method_binding_t[]){
@@ -27,6 +27,7 @@ RCSID("$Id$")
 
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/module_rlm.h>
+#include <freeradius-devel/server/reload.h>
 #include <freeradius-devel/util/debug.h>
 
 struct mypasswd {
@@ -140,7 +141,7 @@ static void release_hash_table(struct hashtable * ht){
 	int i;
 
 	if (!ht) return;
-	for (i = 0; i < ht->tablesize; i++)
+	if (ht->table) for (i = 0; i < ht->tablesize; i++)
 		if (ht->table[i])
 			destroy_password(ht->table[i]);
 	if (ht->fp) {
@@ -152,10 +153,15 @@ static void release_hash_table(struct hashtable * ht){
 
 static void release_ht(struct hashtable * ht){
 	if (!ht) return;
-	release_hash_table(ht);
 	talloc_free(ht);
 }
 
+static int _hash_table_free(struct hashtable *ht)
+{
+	release_hash_table(ht);
+	return 0;
+}
+
 static struct hashtable * build_hash_table (char const * file, int num_fields,
 					    int key_field, int islist, int tablesize, int ignorenis, char delimiter)
 {
@@ -170,6 +176,7 @@ static struct hashtable * build_hash_table (char const * file, int num_fields,
 
 	MEM(ht = talloc_zero(NULL, struct hashtable));
 	MEM(ht->filename = talloc_typed_strdup(ht, file));
+	talloc_set_destructor(ht, _hash_table_free);
 
 	ht->tablesize = tablesize;
 	ht->num_fields = num_fields;
@@ -355,7 +362,8 @@ int main(void){
 
 #else  /* TEST */
 typedef struct {
-	struct hashtable	*ht;
+	reload_t		*reload;	//!< Holds the current hashtable.
+	fr_time_delta_t		reload_interval;
 	struct mypasswd		*pwd_fmt;
 	char const		*filename;
 	char const		*format;
@@ -382,9 +390,30 @@ static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("allow_multiple_keys", rlm_passwd_t, allow_multiple), .dflt = "no" },
 
 	{ FR_CONF_OFFSET("hash_size", rlm_passwd_t, hash_size), .dflt = "100" },
+
+	{ FR_CONF_OFFSET("reload_interval", rlm_passwd_t, reload_interval) },
 	CONF_PARSER_TERMINATOR
 };
 
+/** (Re)build the hashtable from the passwd file
+ *
+ */
+static int mod_load(void **out, TALLOC_CTX *ctx, void *uctx)
+{
+	rlm_passwd_t const	*inst = talloc_get_type_abort_const(uctx, rlm_passwd_t);
+	struct hashtable	*ht;
+
+	ht = build_hash_table(inst->filename, inst->num_fields, inst->key_field, inst->listable,
+			      inst->hash_size, inst->ignore_nislike, *inst->delimiter);
+	if (!ht) {
+		fr_strerror_printf("Can't build hashtable from passwd file %s", inst->filename);
+		return -1;
+	}
+
+	*out = talloc_steal(ctx, ht);
+	return 0;
+}
+
 static int mod_instantiate(module_inst_ctx_t const *mctx)
 {
 	int			num_fields = 0, key_field = -1, listable = 0;
@@ -441,24 +470,14 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		return -1;
 	}
 
-	inst->ht = build_hash_table(inst->filename, num_fields, key_field, listable,
-				    inst->hash_size, inst->ignore_nislike, *inst->delimiter);
-	if (!inst->ht){
-		ERROR("Can't build hashtable from passwd file");
-		return -1;
-	}
-
 	inst->pwd_fmt = mypasswd_alloc(inst->format, num_fields, &len);
 	if (!inst->pwd_fmt){
 		ERROR("Memory allocation failed");
-		release_ht(inst->ht);
-		inst->ht = NULL;
 		return -1;
 	}
 	if (!string_to_entry(inst->format, num_fields, ':', inst->pwd_fmt , len)) {
 		ERROR("Unable to convert format entry");
-		release_ht(inst->ht);
-		inst->ht = NULL;
+		TALLOC_FREE(inst->pwd_fmt);
 		return -1;
 	}
 
@@ -473,8 +492,7 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	}
 	if (!*inst->pwd_fmt->field[key_field]) {
 		cf_log_err(conf, "key field is empty");
-		release_ht(inst->ht);
-		inst->ht = NULL;
+		TALLOC_FREE(inst->pwd_fmt);
 		return -1;
 	}
 
@@ -482,8 +500,7 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 						  inst->pwd_fmt->field[key_field], true, true);
 	if (!da) {
 		PERROR("Unable to resolve attribute");
-		release_ht(inst->ht);
-		inst->ht = NULL;
+		TALLOC_FREE(inst->pwd_fmt);
 		return -1;
 	}
 
@@ -492,6 +509,17 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	inst->key_field = key_field;
 	inst->listable = listable;
 
+	/*
+	 *	The reload handle can't live in the instance data,
+	 *	as that's protected once we return.
+	 */
+	inst->reload = reload_alloc(NULL, mctx->mi->name, inst->filename, inst->reload_interval, mod_load, inst);
+	if (!inst->reload) {
+		cf_log_perr(conf, "Failed loading passwd file");
+		TALLOC_FREE(inst->pwd_fmt);
+		return -1;
+	}
+
 	DEBUG3("num_fields: %d key_field %d(%s) listable: %s", num_fields, key_field,
 	       inst->pwd_fmt->field[key_field], listable ? "yes" : "no");
 
@@ -503,10 +531,8 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 static int mod_detach(module_detach_ctx_t const *mctx)
 {
 	rlm_passwd_t *inst = talloc_get_type_abort(mctx->mi->data, rlm_passwd_t);
-	if (inst->ht) {
-		release_ht(inst->ht);
-		inst->ht = NULL;
-	}
+
+	TALLOC_FREE(inst->reload);
 	talloc_free(inst->pwd_fmt);
 	return 0;
 }
@@ -563,6 +589,7 @@ static void result_add(TALLOC_CTX *ctx, rlm_passwd_t const *inst, request_t *req
 static unlang_action_t CC_HINT(nonnull) mod_passwd_map(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_passwd_t const	*inst = talloc_get_type_abort_const(mctx->mi->data, rlm_passwd_t);
+	struct hashtable	*ht = reload_data(inst->reload);
 
 	char			buffer[1024];
 	fr_pair_t		*key, *i;
@@ -587,14 +614,14 @@ static unlang_action_t CC_HINT(nonnull) mod_passwd_map(rlm_rcode_t *p_result, mo
 		buffer[0] = '\0';
 #endif
 		fr_pair_print_value_quoted(&FR_SBUFF_OUT(buffer, sizeof(buffer)), i, T_BARE_WORD);
-		pw = get_pw_nam(buffer, inst->ht, &last_found);
+		pw = get_pw_nam(buffer, ht, &last_found);
 		if (!pw) continue;
 
 		do {
 			result_add(request->control_ctx, inst, request, &request->control_pairs, pw, 0, "config");
 			result_add(request->reply_ctx, inst, request, &request->reply_pairs, pw, 1, "reply_items");
 			result_add(request->request_ctx, inst, request, &request->request_pairs, pw, 2, "request_items");
-		} while ((pw = get_next(buffer, inst->ht, &last_found)));
+		} while ((pw = get_next(buffer, ht, &last_found)));
 
 		found++;
 
@@ -1180,6 +1180,47 @@ static int encode(bio_handle_t *h, request_t *request, bio_request_t *u, uint8_t
 		encode_ctx.add_proxy_state = false;
 	}
 
+	/*
+	 *	Forward the packet we received, instead of encoding
+	 *	the request list.  If policy has edited the request
+	 *	since it was decoded, the packet no longer matches
+	 *	the list, and we encode the list instead.
+	 */
+	if (inst->pass_through && u->proxied && !u->status_check && !request->parent &&
+	    request->client && request->packet->data && (request->proto_dict == dict_radius) &&
+	    (request->packet->data[0] == u->code)) {
+		fr_radius_ctx_t original_ctx = {
+			.secret = request->client->secret,
+			.secret_length = talloc_array_length(request->client->secret) - 1,
+		};
+
+		if (request->request_pairs.generation != request->packet->pairs_generation) {
+			RDEBUG2("Request was edited after it was received, encoding it instead of forwarding the original packet");
+			goto encode;
+		}
+
+		packet_len = fr_radius_relay(u->packet, u->packet_len,
+					     request->packet->data, request->packet->data_len,
+					     &original_ctx, &encode_ctx);
+		if (packet_len > 0) {
+			RDEBUG3("Forwarding original packet");
+
+			if (encode_ctx.add_proxy_state) {
+				fr_pair_t	*vp;
+
+				MEM(vp = fr_pair_afrom_da(u, attr_proxy_state));
+				fr_pair_value_memdup(vp, (uint8_t const *) &inst->common_ctx.proxy_state, sizeof(inst->common_ctx.proxy_state), false);
+				fr_pair_append(&u->extra, vp);
+			}
+
+			u->packet_len = packet_len;
+			goto sign;
+		}
+
+		RDEBUG3("Original packet cannot be forwarded as-is, encoding it instead");
+	}
+
+encode:
 	/*
 	 *	Encode it, leaving room for Proxy-State if necessary.
 	 */
@@ -1239,6 +1280,7 @@ static int encode(bio_handle_t *h, request_t *request, bio_request_t *u, uint8_t
 	/*
 	 *	Now that we're done mangling the packet, sign it.
 	 */
+sign:
 	if (fr_radius_sign(u->packet, NULL, (uint8_t const *) h->ctx.radius_ctx.secret,
 			   h->ctx.radius_ctx.secret_length) < 0) {
 		RERROR("Failed signing packet");
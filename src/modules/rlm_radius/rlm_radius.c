@@ -151,6 +151,8 @@ static conf_parser_t const module_config[] = {
 
 	{ FR_CONF_OFFSET("max_attributes", rlm_radius_t, max_attributes), .dflt = STRINGIFY(RADIUS_MAX_ATTRIBUTES) },
 
+	{ FR_CONF_OFFSET("pass_through", rlm_radius_t, pass_through) },
+
 	{ FR_CONF_OFFSET("require_message_authenticator", rlm_radius_t, require_message_authenticator),
 	  .func = cf_table_parse_int,
 	  .uctx = &(cf_table_parse_ctx_t){ .table = fr_radius_require_ma_table, .len = &fr_radius_require_ma_table_len },
@@ -74,6 +74,9 @@ struct rlm_radius_s {
 							///< Controls whether Proxy-State is added to the outbound
 							///< request
 	rlm_radius_mode_t	mode;			//!< proxy, client, etc.
+	bool			pass_through;		//!< Forward the original packet when proxying,
+							///< instead of encoding it from the request list,
+							///< unless the request list has been edited.
 
 	uint32_t		max_attributes;   	//!< Maximum number of attributes to decode in response.
 
@@ -1222,6 +1222,618 @@ static int rest_decode_json(rlm_rest_t const *instance, rlm_rest_section_t const
 
 	return ret;
 }
+
+/** A value received in a streamed JSON response
+ *
+ */
+typedef struct {
+	fr_json_stream_event_t	type;		//!< Of the JSON value.
+	fr_pair_t		*vp;		//!< Created from the value.  NULL if the value was null,
+						///< or couldn't be converted.
+	char			*xlat;		//!< String value which may need expanding.  We don't know
+						///< whether do_xlat is set until the attribute is complete,
+						///< so these are converted when the response is decoded.
+} rest_json_leaf_t;
+
+/** An attribute received in a streamed JSON response
+ *
+ */
+typedef struct {
+	char			*name;		//!< As it appeared in the response.
+	tmpl_t			*dst;		//!< Where the attribute goes.  NULL if the name was invalid.
+
+	json_flags_t		flags;		//!< From the expanded form of the attribute.
+	char			*op;		//!< Operator string, only set if it was invalid.
+
+	bool			expanded;	//!< Value was in the form {"op":..., "value":...}.
+	bool			is_array;	//!< Value was an array.
+	bool			has_value;	//!< The expanded form contained a "value" key.
+	uint8_t			seen;		//!< Bitmap of keys in the expanded form.
+
+	rest_json_leaf_t	*leaves;	//!< Values, in the order they were received.
+	unsigned int		num_leaves;	//!< Number of values received.
+} rest_json_attr_t;
+
+/** Keys in the expanded form of an attribute
+ *
+ */
+typedef enum {
+	REST_JSON_FIELD_OTHER = 0,		//!< Unknown key, which is ignored.
+	REST_JSON_FIELD_OP = 0x01,		//!< "op"
+	REST_JSON_FIELD_DO_XLAT = 0x02,		//!< "do_xlat"
+	REST_JSON_FIELD_IS_JSON = 0x04,		//!< "is_json"
+	REST_JSON_FIELD_VALUE = 0x08		//!< "value"
+} rest_json_field_t;
+
+/** State for converting a JSON response into attributes as it's received
+ *
+ * Attributes are created as tokens arrive from libcurl's write callback,
+ * without building a json-c object tree.  Anything we can't process in
+ * exactly the same way as json_pair_alloc causes the stream to be abandoned,
+ * and the buffered response is decoded with rest_decode_json instead.
+ */
+typedef struct {
+	request_t		*request;	//!< Current request.
+	fr_json_stream_t	*js;		//!< Tokenizer.
+
+	rest_json_attr_t	*attrs;		//!< Attributes in the order they were received.
+	unsigned int		num_attrs;	//!< Number of attributes received.
+	unsigned int		num_leaves;	//!< Number of values received, across all attributes.
+
+	rest_json_attr_t	*attr;		//!< Attribute we're currently receiving, NULL if
+						///< it's being ignored.
+	rest_json_field_t	field;		//!< Key in the expanded form we're currently receiving.
+
+	bool			skipping;	//!< Ignoring the contents of a container.
+	unsigned int		skip_depth;	//!< Depth of the container being ignored.
+} rest_json_stream_t;
+
+/** Add a new attribute to the stream when its name is received
+ *
+ * @param[in] rs	stream state.
+ * @param[in] name	of the attribute.
+ * @param[in] len	of the name.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the response should be decoded with json-c instead.
+ */
+static int rest_json_stream_attr(rest_json_stream_t *rs, char const *name, size_t len)
+{
+	request_t		*request = rs->request;
+	rest_json_attr_t	*attr;
+	unsigned int		i;
+
+	/*
+	 *	json-c truncates keys at the first '\0', and replaces the
+	 *	value of duplicate keys.  Leave those responses to json-c,
+	 *	along with any which are so large they'd hit the attribute
+	 *	limit.
+	 */
+	if (memchr(name, '\0', len)) return -1;
+	if (rs->num_attrs >= REST_BODY_MAX_ATTRS) return -1;
+	for (i = 0; i < rs->num_attrs; i++) if (strcmp(rs->attrs[i].name, name) == 0) return -1;
+
+	if (rs->num_attrs == talloc_array_length(rs->attrs)) {
+		MEM(rs->attrs = talloc_realloc(rs, rs->attrs, rest_json_attr_t, rs->num_attrs ? (rs->num_attrs * 2) : 8));
+	}
+
+	attr = &rs->attrs[rs->num_attrs++];
+	*attr = (rest_json_attr_t){
+		.flags = {
+			.op = T_OP_SET,
+			.do_xlat = 1,
+			.is_json = 0
+		}
+	};
+	MEM(attr->name = talloc_bstrndup(rs, name, len));
+
+	if (tmpl_afrom_attr_str(rs, NULL, &attr->dst, name,
+				&(tmpl_rules_t){
+					.attr = {
+						.dict_def = request->proto_dict,
+						.list_def = request_attr_reply
+					}
+				}) <= 0) {
+		RDEBUG2("Parsing attribute \"%s\"", name);
+		RPWDEBUG("Failed parsing attribute (skipping)");
+		attr->dst = NULL;
+		rs->attr = NULL;
+		return 0;
+	}
+
+	rs->attr = attr;
+	return 0;
+}
+
+/** Convert a value to a pair as soon as it's received
+ *
+ * @param[in] rs	stream state.
+ * @param[in] event	type of the value.
+ * @param[in] value	text of the value.
+ * @param[in] len	of the value.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the response should be decoded with json-c instead.
+ */
+static int rest_json_stream_leaf(rest_json_stream_t *rs, fr_json_stream_event_t event, char const *value, size_t len)
+{
+	request_t		*request = rs->request;
+	rest_json_attr_t	*attr = rs->attr;
+	rest_json_leaf_t	*leaf;
+	fr_dict_attr_t const	*da = tmpl_attr_tail_da(attr->dst);
+	fr_value_box_t		src = FR_VALUE_BOX_INITIALISER_NULL(src);
+	fr_pair_t		*vp;
+
+	/*
+	 *	Let json-c deal with enforcing the attribute limit.
+	 */
+	if (++rs->num_leaves > REST_BODY_MAX_ATTRS) return -1;
+
+	if (attr->num_leaves == talloc_array_length(attr->leaves)) {
+		MEM(attr->leaves = talloc_realloc(rs, attr->leaves, rest_json_leaf_t,
+						  attr->num_leaves ? (attr->num_leaves * 2) : 1));
+	}
+	leaf = &attr->leaves[attr->num_leaves++];
+	*leaf = (rest_json_leaf_t){ .type = event };
+
+	switch (event) {
+	case FR_JSON_STREAM_NULL:
+		return 0;
+
+	case FR_JSON_STREAM_INT:
+	{
+		long long	num;
+		char		*end;
+
+		errno = 0;
+		num = strtoll(value, &end, 10);
+		if ((errno == ERANGE) || (*end != '\0')) return -1;
+
+		/*
+		 *	json_object_get_int() clamps to the range of an int32
+		 */
+		if (num > INT32_MAX) num = INT32_MAX;
+		if (num < INT32_MIN) num = INT32_MIN;
+		fr_value_box(&src, (int32_t)num, true);
+	}
+		break;
+
+	case FR_JSON_STREAM_DOUBLE:
+	{
+		double	num;
+		char	*end;
+
+		errno = 0;
+		num = strtod(value, &end);
+		if ((errno == ERANGE) || (*end != '\0')) return -1;
+		fr_value_box(&src, num, true);
+	}
+		break;
+
+	/*
+	 *	json_pair_alloc_leaf uses the string form of booleans
+	 */
+	case FR_JSON_STREAM_BOOL:
+		fr_value_box_bstrndup_shallow(&src, NULL, value, len, true);
+		break;
+
+	case FR_JSON_STREAM_STRING:
+		if (memchr(value, '%', len)) {
+			MEM(leaf->xlat = talloc_bstrndup(attr->leaves, value, len));
+			return 0;
+		}
+		fr_value_box_bstrndup_shallow(&src, NULL, value, len, true);
+		break;
+
+	default:
+		fr_assert(0);
+		return -1;
+	}
+
+	MEM(vp = fr_pair_afrom_da(attr->leaves, da));
+	if (fr_value_box_cast(vp, &vp->data, da->type, da, &src) < 0) {
+		RWDEBUG("Failed parsing value for attribute \"%s\" (skipping)", da->name);
+		talloc_free(vp);
+		return 0;
+	}
+	leaf->vp = vp;
+
+	return 0;
+}
+
+/** Process the members of the expanded form of an attribute
+ *
+ * @param[in] rs	stream state.
+ * @param[in] event	type of the token.
+ * @param[in] value	text of the token.
+ * @param[in] len	of the token.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the response should be decoded with json-c instead.
+ */
+static int rest_json_stream_expanded(rest_json_stream_t *rs, fr_json_stream_event_t event,
+				     char const *value, size_t len)
+{
+	rest_json_attr_t	*attr = rs->attr;
+
+	if (event == FR_JSON_STREAM_KEY) {
+		if (strcmp(value, "op") == 0) {
+			rs->field = REST_JSON_FIELD_OP;
+		} else if (strcmp(value, "do_xlat") == 0) {
+			rs->field = REST_JSON_FIELD_DO_XLAT;
+		} else if (strcmp(value, "is_json") == 0) {
+			rs->field = REST_JSON_FIELD_IS_JSON;
+		} else if (strcmp(value, "value") == 0) {
+			rs->field = REST_JSON_FIELD_VALUE;
+		} else {
+			rs->field = REST_JSON_FIELD_OTHER;
+			return 0;
+		}
+
+		if (attr->seen & rs->field) return -1;	/* json-c keeps the last value */
+		attr->seen |= rs->field;
+		return 0;
+	}
+
+	switch (rs->field) {
+	case REST_JSON_FIELD_OP:
+		if (event != FR_JSON_STREAM_STRING) return -1;
+
+		attr->flags.op = fr_table_value_by_str(fr_tokens_table, value, 0);
+		if (!attr->flags.op) MEM(attr->op = talloc_bstrndup(rs, value, len));
+		return 0;
+
+	case REST_JSON_FIELD_DO_XLAT:
+		if (event != FR_JSON_STREAM_BOOL) return -1;
+
+		attr->flags.do_xlat = (value[0] == 't');
+		return 0;
+
+	case REST_JSON_FIELD_IS_JSON:
+		if (event != FR_JSON_STREAM_BOOL) return -1;
+
+		attr->flags.is_json = (value[0] == 't');
+		return 0;
+
+	case REST_JSON_FIELD_VALUE:
+		switch (event) {
+		case FR_JSON_STREAM_ARRAY_START:
+			attr->has_value = true;
+			attr->is_array = true;
+			return 0;
+
+		case FR_JSON_STREAM_ARRAY_END:
+			return 0;
+
+		/*
+		 *	Nested attributes, or a JSON string
+		 */
+		case FR_JSON_STREAM_OBJECT_START:
+			return -1;
+
+		default:
+			attr->has_value = true;
+			return rest_json_stream_leaf(rs, event, value, len);
+		}
+
+	case REST_JSON_FIELD_OTHER:
+		break;
+	}
+
+	if ((event == FR_JSON_STREAM_OBJECT_START) || (event == FR_JSON_STREAM_ARRAY_START)) {
+		rs->skipping = true;
+		rs->skip_depth = 2;
+	}
+
+	return 0;
+}
+
+/** Called by the JSON tokenizer for each token in the response
+ *
+ * @param[in] event	Type of token.
+ * @param[in] depth	Nesting depth of the token.
+ * @param[in] value	Text of the token.
+ * @param[in] len	Length of value.
+ * @param[in] uctx	our #rest_json_stream_t.
+ * @return
+ *	- 0 to continue.
+ *	- -1 if the response should be decoded with json-c instead.
+ */
+static int rest_json_stream_token(fr_json_stream_event_t event, unsigned int depth,
+				  char const *value, size_t len, void *uctx)
+{
+	rest_json_stream_t	*rs = talloc_get_type_abort(uctx, rest_json_stream_t);
+	rest_json_attr_t	*attr = rs->attr;
+
+	if (rs->skipping) {
+		if ((depth == rs->skip_depth) &&
+		    ((event == FR_JSON_STREAM_OBJECT_END) || (event == FR_JSON_STREAM_ARRAY_END))) rs->skipping = false;
+		return 0;
+	}
+
+	switch (depth) {
+	/*
+	 *	The container must be an object.  json_pair_alloc
+	 *	produces the error for anything else.
+	 */
+	case 0:
+		if ((event == FR_JSON_STREAM_OBJECT_START) || (event == FR_JSON_STREAM_OBJECT_END)) return 0;
+		return -1;
+
+	case 1:
+		if (event == FR_JSON_STREAM_KEY) return rest_json_stream_attr(rs, value, len);
+
+		if (!attr) {
+			if ((event == FR_JSON_STREAM_OBJECT_START) || (event == FR_JSON_STREAM_ARRAY_START)) {
+				rs->skipping = true;
+				rs->skip_depth = 1;
+			}
+			return 0;
+		}
+
+		switch (event) {
+		case FR_JSON_STREAM_OBJECT_START:
+			attr->expanded = true;
+			rs->field = REST_JSON_FIELD_OTHER;
+			return 0;
+
+		case FR_JSON_STREAM_ARRAY_START:
+			attr->is_array = true;
+			return 0;
+
+		/*
+		 *	is_json means arrays are turned into JSON strings
+		 */
+		case FR_JSON_STREAM_OBJECT_END:
+			if (attr->flags.is_json && attr->is_array) return -1;
+			return 0;
+
+		case FR_JSON_STREAM_ARRAY_END:
+			return 0;
+
+		default:
+			return rest_json_stream_leaf(rs, event, value, len);
+		}
+
+	case 2:
+		if (!attr) return -1;
+		if (attr->expanded) return rest_json_stream_expanded(rs, event, value, len);
+		break;
+
+	case 3:
+		if (attr && attr->expanded && attr->is_array && (rs->field == REST_JSON_FIELD_VALUE)) break;
+		return -1;
+
+	default:
+		return -1;
+	}
+
+	/*
+	 *	Elements of a value array.  Nested values
+	 *	are left for json-c to deal with.
+	 */
+	fr_assert(attr->is_array);
+	switch (event) {
+	case FR_JSON_STREAM_OBJECT_START:
+	case FR_JSON_STREAM_ARRAY_START:
+		return -1;
+
+	case FR_JSON_STREAM_ARRAY_END:
+		return 0;
+
+	default:
+		return rest_json_stream_leaf(rs, event, value, len);
+	}
+}
+
+/** Feed a chunk of a JSON response to the streaming decoder
+ *
+ * If the response can't be streamed, the decoder is freed, and
+ * rest_response_decode will use rest_decode_json instead.
+ *
+ * @param[in] ctx	response being received.
+ * @param[in] in	chunk of the response body.
+ * @param[in] inlen	Length of the chunk.
+ */
+static void rest_json_stream_feed(rlm_rest_response_t *ctx, char const *in, size_t inlen)
+{
+	request_t		*request = ctx->request;
+	rest_json_stream_t	*rs;
+
+	/*
+	 *	First chunk, set up the decoder
+	 */
+	if (ctx->used == 0) {
+		MEM(rs = talloc_zero(NULL, rest_json_stream_t));
+		rs->request = request;
+		MEM(rs->js = fr_json_stream_alloc(rs, rest_json_stream_token, rs));
+		TALLOC_FREE(ctx->decoder);
+		ctx->decoder = rs;
+	}
+
+	/*
+	 *	We already gave up on streaming this response
+	 */
+	if (!ctx->decoder) return;
+	rs = talloc_get_type_abort(ctx->decoder, rest_json_stream_t);
+
+	if (fr_json_stream_parse(rs->js, in, inlen) < 0) {
+		RDEBUG3("Can't decode response as it's received, will decode it once complete");
+		TALLOC_FREE(ctx->decoder);
+	}
+}
+
+/** Convert a value received in a streamed response into a pair
+ *
+ * @param[in] ctx	to allocate the pair in.
+ * @param[in] request	Current request.
+ * @param[in] da	Attribute to create.
+ * @param[in] flags	controlling value expansion.
+ * @param[in] leaf	to convert.
+ * @return
+ *	- #fr_pair_t just created.
+ *	- NULL if the value should be skipped.
+ */
+static fr_pair_t *rest_json_stream_leaf_to_pair(TALLOC_CTX *ctx, request_t *request, fr_dict_attr_t const *da,
+						json_flags_t *flags, rest_json_leaf_t *leaf)
+{
+	fr_value_box_t		src = FR_VALUE_BOX_INITIALISER_NULL(src);
+	char			*expanded = NULL;
+	fr_pair_t		*vp;
+	int			ret;
+
+	switch (leaf->type) {
+	case FR_JSON_STREAM_NULL:
+		RDEBUG3("Got null value for attribute \"%s\" (skipping)", da->name);
+		return NULL;
+
+	case FR_JSON_STREAM_INT:
+		if (flags->do_xlat) RWDEBUG("Ignoring do_xlat on 'int', attribute \"%s\"", da->name);
+		break;
+
+	case FR_JSON_STREAM_DOUBLE:
+		if (flags->do_xlat) RWDEBUG("Ignoring do_xlat on 'double', attribute \"%s\"", da->name);
+		break;
+
+	case FR_JSON_STREAM_BOOL:
+		if (flags->do_xlat) RWDEBUG("Ignoring do_xlat on 'object', attribute \"%s\"", da->name);
+		break;
+
+	default:
+		break;
+	}
+
+	/*
+	 *	Converted as it was received
+	 */
+	if (!leaf->xlat) {
+		vp = leaf->vp;
+		leaf->vp = NULL;
+		if (vp) talloc_steal(ctx, vp);
+		return vp;
+	}
+
+	if (flags->do_xlat) {
+		if (xlat_aeval(request, &expanded, request, leaf->xlat, NULL, NULL) < 0) return NULL;
+		fr_value_box_bstrndup_shallow(&src, NULL, expanded, talloc_array_length(expanded) - 1, true);
+	} else {
+		fr_value_box_bstrndup_shallow(&src, NULL, leaf->xlat, talloc_array_length(leaf->xlat) - 1, true);
+	}
+
+	MEM(vp = fr_pair_afrom_da(ctx, da));
+	ret = fr_value_box_cast(vp, &vp->data, da->type, da, &src);
+	talloc_free(expanded);
+	if (ret < 0) {
+		RWDEBUG("Failed parsing value for attribute \"%s\" (skipping)", da->name);
+		talloc_free(vp);
+		return NULL;
+	}
+
+	return vp;
+}
+
+/** Adds the attributes from a streamed JSON response to the request
+ *
+ * Produces the same result as rest_decode_json, but using the attributes
+ * which were created as the response was received.
+ *
+ * @see rest_decode_json
+ * @see json_pair_alloc
+ *
+ * @param[in] request	Current request.
+ * @param[in] rs	streaming decoder state.
+ * @return
+ *	- The number of #fr_pair_t processed.
+ *	- -1 if the response couldn't be streamed, and must be decoded with
+ *	  rest_decode_json.
+ */
+static int rest_decode_json_stream(request_t *request, rest_json_stream_t *rs)
+{
+	int		max_attrs = REST_BODY_MAX_ATTRS;
+	unsigned int	i, j;
+
+	switch (fr_json_stream_finish(rs->js)) {
+	case 1:
+		break;
+
+	case 0:
+		return 0;	/* Empty response */
+
+	default:
+		return -1;
+	}
+
+	for (i = 0; i < rs->num_attrs; i++) {
+		rest_json_attr_t	*attr = &rs->attrs[i];
+		json_flags_t		flags = attr->flags;
+		request_t		*current = request;
+		fr_pair_list_t		*vps;
+		TALLOC_CTX		*ctx;
+
+		/*
+		 *	Invalid names were reported as they were received
+		 */
+		if (!attr->dst) continue;
+
+		RDEBUG2("Parsing attribute \"%s\"", attr->name);
+
+		if (tmpl_request_ptr(&current, tmpl_request(attr->dst)) < 0) {
+			RWDEBUG("Attribute name refers to outer request but not in a tunnel (skipping)");
+			continue;
+		}
+
+		vps = tmpl_list_head(current, tmpl_list(attr->dst));
+		if (!vps) {
+			RWDEBUG("List not valid in this context (skipping)");
+			continue;
+		}
+		ctx = tmpl_list_ctx(current, tmpl_list(attr->dst));
+
+		if (attr->op) {
+			RWDEBUG("Invalid operator value \"%s\" (skipping)", attr->op);
+			continue;
+		}
+
+		if (attr->expanded && !attr->has_value) {
+			RWDEBUG("Value key missing (skipping)");
+			continue;
+		}
+
+		if (attr->is_array && !attr->num_leaves) {
+			RWDEBUG("Zero length value array (skipping)");
+			continue;
+		}
+
+		for (j = 0; j < attr->num_leaves; j++) {
+			fr_pair_list_t	tmp_list;
+			fr_pair_t	*vp;
+
+			max_attrs--;
+
+			/*
+			 *  Automagically switch the op for multivalued attributes.
+			 */
+			if (((flags.op == T_OP_SET) || (flags.op == T_OP_EQ)) && (j >= 1)) {
+				flags.op = T_OP_ADD_EQ;
+			}
+
+			vp = rest_json_stream_leaf_to_pair(ctx, request, tmpl_attr_tail_da(attr->dst),
+							   &flags, &attr->leaves[j]);
+			if (!vp) continue;
+			vp->op = flags.op;
+
+			RINDENT();
+			RDEBUG2("%s:%pP", tmpl_list_name(tmpl_list(attr->dst), ""), vp);
+			REXDENT();
+
+			fr_pair_list_init(&tmp_list);
+			fr_pair_append(&tmp_list, vp);
+			radius_pairmove(current, vps, &tmp_list);
+		}
+	}
+
+	return REST_BODY_MAX_ATTRS - max_attrs;
+}
 #endif
 
 /** Processes incoming HTTP header data from libcurl.
@@ -1507,9 +2119,20 @@ static size_t rest_response_body(void *in, size_t size, size_t nmemb, void *user
 				"Forcing body to type 'invalid'", ctx->used + (end - p), ctx->section->response.max_body_in);
 			ctx->type = REST_HTTP_BODY_INVALID;
 			TALLOC_FREE(ctx->buffer);
+			TALLOC_FREE(ctx->decoder);
 			break;
 		}
 
+#ifdef HAVE_JSON
+		/*
+		 *  Create attributes as the response arrives, rather
+		 *  than parsing the whole thing with json-c at the end.
+		 *  The raw body is still kept for debugging output,
+		 *  and in case the streaming decoder gives up.
+		 */
+		if (ctx->type == REST_HTTP_BODY_JSON) rest_json_stream_feed(ctx, p, end - p);
+#endif
+
 		needed = ROUND_UP(ctx->used + (end - p), REST_BODY_ALLOC_CHUNK);
 		if (needed > ctx->alloc) {
 			MEM(ctx->buffer = talloc_bstr_realloc(NULL, ctx->buffer, needed));
@@ -1605,6 +2228,7 @@ static void rest_response_init(rlm_rest_section_t const *section,
 	ctx->code = 0;
 	ctx->header = header;
 	TALLOC_FREE(ctx->buffer);
+	TALLOC_FREE(ctx->decoder);
 }
 
 /** Extracts pointer to buffer containing response data
@@ -2105,6 +2729,11 @@ int rest_response_decode(rlm_rest_t const *instance, rlm_rest_section_t const *s
 
 #ifdef HAVE_JSON
 	case REST_HTTP_BODY_JSON:
+		if (ctx->response.decoder) {
+			ret = rest_decode_json_stream(request, ctx->response.decoder);
+			TALLOC_FREE(ctx->response.decoder);
+			if (ret >= 0) break;
+		}
 		ret = rest_decode_json(instance, section, request, randle, ctx->response.buffer, ctx->response.used);
 		break;
 #endif
@@ -34,6 +34,7 @@ RCSID("$Id$")
 #include <freeradius-devel/unlang/function.h>
 
 #include <ctype.h>
+#include <pthread.h>
 
 /*
  *	Note: When your counter spans more than 1 period (ie 3 months
@@ -53,6 +54,53 @@ RCSID("$Id$")
  *	Reset Time.
  */
 
+/** A counter value held in the cache
+ *
+ * The counter is seeded from SQL, and then updated from accounting
+ * requests seen by this server.
+ */
+typedef struct {
+	fr_rb_node_t	node;			//!< Entry in the tree of cached counters.
+	fr_dlist_t	entry;			//!< Entry in the LRU list.
+
+	char const	*key;			//!< Expanded counter key.
+	fr_time_t	period_start;		//!< Start of the reset period the counter applies to.
+	uint64_t	counter;		//!< Current value of the counter.
+
+	fr_time_t	seeded;			//!< When the counter was last read from SQL.
+	fr_time_t	last_used;		//!< When the entry was last read or updated.
+
+	fr_rb_tree_t	*sessions;		//!< Usage last seen for each session.
+} sqlcounter_cache_entry_t;
+
+/** The last usage value seen for a session
+ *
+ * Used to turn the cumulative values in accounting requests into deltas.
+ */
+typedef struct {
+	fr_rb_node_t	node;			//!< Entry in the tree of sessions.
+	char const	*id;			//!< Session identifier.
+	uint64_t	usage;			//!< Last usage value seen.
+	bool		stopped;		//!< A Stop has been seen, so later requests for
+						///< the session are retransmissions.
+} sqlcounter_cache_session_t;
+
+/** Cache state shared between all threads
+ *
+ */
+typedef struct {
+	pthread_mutex_t	mutex;
+	fr_rb_tree_t	*tree;			//!< Cached counters, by key.
+	fr_dlist_head_t	lru;			//!< Least recently used entries at the head.
+} sqlcounter_cache_t;
+
+typedef struct {
+	bool		enabled;		//!< Whether counters are cached.
+	fr_time_delta_t	lifetime;		//!< How long unused entries are kept.
+	fr_time_delta_t	reconcile_interval;	//!< How often counters are re-read from SQL.
+	uint32_t	max_entries;		//!< Maximum number of cached counters.
+} sqlcounter_cache_conf_t;
+
 /*
  *	Define a structure for our module configuration.
  *
@@ -77,8 +125,20 @@ typedef struct {
 
 	fr_time_t	reset_time;
 	fr_time_t	last_reset;
+
+	sqlcounter_cache_conf_t	cache;	//!< Counter cache configuration.
+	sqlcounter_cache_t	*mutable;	//!< Counter cache, shared between threads.
 } rlm_sqlcounter_t;
 
+static const conf_parser_t cache_config[] = {
+	{ FR_CONF_OFFSET("enable", sqlcounter_cache_conf_t, enabled), .dflt = "no" },
+	{ FR_CONF_OFFSET("lifetime", sqlcounter_cache_conf_t, lifetime), .dflt = "3600" },
+	{ FR_CONF_OFFSET("reconcile_interval", sqlcounter_cache_conf_t, reconcile_interval), .dflt = "300" },
+	{ FR_CONF_OFFSET("max_entries", sqlcounter_cache_conf_t, max_entries), .dflt = "0" },
+
+	CONF_PARSER_TERMINATOR
+};
+
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET_FLAGS("sql_module_instance", CONF_FLAG_REQUIRED, rlm_sqlcounter_t, sql_name) },
 
@@ -99,6 +159,8 @@ static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET_FLAGS("counter_name", CONF_FLAG_ATTRIBUTE | CONF_FLAG_REQUIRED, rlm_sqlcounter_t, counter_attr) },
 	{ FR_CONF_OFFSET_FLAGS("check_name", CONF_FLAG_ATTRIBUTE | CONF_FLAG_REQUIRED, rlm_sqlcounter_t, limit_attr) },
 
+	{ FR_CONF_OFFSET_SUBSECTION("cache", 0, rlm_sqlcounter_t, cache, cache_config) },
+
 	CONF_PARSER_TERMINATOR
 };
 
@@ -106,6 +168,11 @@ typedef struct {
 	xlat_exp_head_t	*query_xlat;		//!< Tokenized xlat to run query.
 	tmpl_t		*reply_attr;		//!< Attribute to write timeout to.
 	tmpl_t		*reply_msg_attr;	//!< Attribute to write reply message to.
+	fr_value_box_t	key;			//!< Expanded counter key, used to find cached counters.
+	fr_value_box_t	session_id;		//!< Identifies the session in accounting requests.
+	fr_value_box_t	usage;			//!< Cumulative usage reported for the session.
+	fr_value_box_t	status;			//!< Start, Stop, Interim-Update etc...
+	fr_value_box_t	session_time;		//!< How long the session has been running.
 } sqlcounter_call_env_t;
 
 static fr_dict_t const *dict_freeradius;
@@ -248,6 +315,143 @@ static int find_prev_reset(rlm_sqlcounter_t *inst, fr_time_t now)
 	return ret;
 }
 
+static int8_t cache_entry_cmp(void const *one, void const *two)
+{
+	sqlcounter_cache_entry_t const *a = one, *b = two;
+
+	return CMP(strcmp(a->key, b->key), 0);
+}
+
+static int8_t cache_session_cmp(void const *one, void const *two)
+{
+	sqlcounter_cache_session_t const *a = one, *b = two;
+
+	return CMP(strcmp(a->id, b->id), 0);
+}
+
+/** Remove an entry from the cache, and free it
+ *
+ * Must be called with the cache mutex held.
+ */
+static void cache_entry_free(sqlcounter_cache_t *cache, sqlcounter_cache_entry_t *entry)
+{
+	fr_rb_remove_by_inline_node(cache->tree, &entry->node);
+	fr_dlist_remove(&cache->lru, entry);
+	talloc_free(entry);
+}
+
+/** Free entries which haven't been used within the configured lifetime
+ *
+ * Must be called with the cache mutex held.
+ */
+static void cache_expire(rlm_sqlcounter_t const *inst, fr_time_t now)
+{
+	sqlcounter_cache_t		*cache = inst->mutable;
+	sqlcounter_cache_entry_t	*entry;
+
+	while ((entry = fr_dlist_head(&cache->lru)) &&
+	       fr_time_lteq(fr_time_add(entry->last_used, inst->cache.lifetime), now)) {
+		cache_entry_free(cache, entry);
+	}
+}
+
+/** Find the cache entry for a key in the current reset period
+ *
+ * Entries for previous reset periods are freed.  Must be called with
+ * the cache mutex held.
+ */
+static sqlcounter_cache_entry_t *cache_find(rlm_sqlcounter_t const *inst, fr_value_box_t const *key, fr_time_t now)
+{
+	sqlcounter_cache_t		*cache = inst->mutable;
+	sqlcounter_cache_entry_t	*entry;
+
+	cache_expire(inst, now);
+
+	entry = fr_rb_find(cache->tree, &(sqlcounter_cache_entry_t){ .key = key->vb_strvalue });
+	if (!entry) return NULL;
+
+	if (fr_time_neq(entry->period_start, inst->last_reset)) {
+		cache_entry_free(cache, entry);
+		return NULL;
+	}
+
+	entry->last_used = now;
+	fr_dlist_remove(&cache->lru, entry);
+	fr_dlist_insert_tail(&cache->lru, entry);
+
+	return entry;
+}
+
+/** Retrieve a counter from the cache
+ *
+ * @return
+ *	- true if the counter was found, and doesn't need reconciling with SQL.
+ *	- false if the counter must be read from SQL.
+ */
+static bool cache_counter_get(uint64_t *out, rlm_sqlcounter_t const *inst, fr_value_box_t const *key, fr_time_t now)
+{
+	sqlcounter_cache_entry_t	*entry;
+	bool				found = false;
+
+	pthread_mutex_lock(&inst->mutable->mutex);
+	entry = cache_find(inst, key, now);
+	if (entry && fr_time_delta_lt(fr_time_sub(now, entry->seeded), inst->cache.reconcile_interval)) {
+		*out = entry->counter;
+		found = true;
+	}
+	pthread_mutex_unlock(&inst->mutable->mutex);
+
+	return found;
+}
+
+/** Seed, or reconcile, a cached counter with the value read from SQL
+ *
+ */
+static void cache_counter_set(rlm_sqlcounter_t const *inst, fr_value_box_t const *key, uint64_t counter, fr_time_t now)
+{
+	sqlcounter_cache_t		*cache = inst->mutable;
+	sqlcounter_cache_entry_t	*entry;
+
+	pthread_mutex_lock(&cache->mutex);
+	entry = cache_find(inst, key, now);
+	if (!entry) {
+		/*
+		 *	Make room by evicting the least recently used entry.
+		 */
+		if (inst->cache.max_entries && (fr_rb_num_elements(cache->tree) >= inst->cache.max_entries)) {
+			cache_entry_free(cache, fr_dlist_head(&cache->lru));
+		}
+
+		MEM(entry = talloc_zero(cache, sqlcounter_cache_entry_t));
+		MEM(entry->key = talloc_bstrndup(entry, key->vb_strvalue, key->vb_length));
+		MEM(entry->sessions = fr_rb_inline_talloc_alloc(entry, sqlcounter_cache_session_t, node,
+								cache_session_cmp, NULL));
+		entry->period_start = inst->last_reset;
+		entry->last_used = now;
+
+		fr_rb_insert(cache->tree, entry);
+		fr_dlist_insert_tail(&cache->lru, entry);
+	}
+	entry->counter = counter;
+	entry->seeded = now;
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+/** Move to the next reset period if the current one has ended
+ *
+ */
+static void sqlcounter_period_check(rlm_sqlcounter_t *inst, fr_time_t now)
+{
+	if (fr_time_neq(inst->reset_time, fr_time_wrap(0)) &&
+	    (fr_time_lteq(inst->reset_time, now))) {
+		/*
+		 *	Re-set the next time and prev_time for this counters range
+		 */
+		inst->last_reset = inst->reset_time;
+		find_next_reset(inst, now);
+	}
+}
+
 typedef struct {
 	bool			last_success;
 	fr_value_box_list_t	result;
@@ -256,30 +460,21 @@ typedef struct {
 	fr_pair_t		*limit;
 } sqlcounter_rctx_t;
 
-/** Handle the result of calling the SQL query to retrieve the `counter` value.
+/** Compare the `counter` value with the `limit`
  *
  * Create / update the `counter` attribute in the control list
  * If `counter` > `limit`, optionally populate a reply message and return RLM_MODULE_REJECT.
  * Otherwise, optionally populate a reply attribute with the value of `limit` - `counter` and return RLM_MODULE_UPDATED.
  * If no reply attribute is set, return RLM_MODULE_OK.
  */
-static unlang_action_t mod_authorize_resume(rlm_rcode_t *p_result, UNUSED int *priority, request_t *request, void *uctx)
+static unlang_action_t sqlcounter_check(rlm_rcode_t *p_result, request_t *request, rlm_sqlcounter_t const *inst,
+					sqlcounter_call_env_t const *env, fr_pair_t *limit, uint64_t counter)
 {
-	sqlcounter_rctx_t	*rctx = talloc_get_type_abort(uctx, sqlcounter_rctx_t);
-	rlm_sqlcounter_t	*inst = rctx->inst;
-	sqlcounter_call_env_t	*env = rctx->env;
-	fr_value_box_t		*sql_result = fr_value_box_list_pop_head(&rctx->result);
-	uint64_t		counter, res;
-	fr_pair_t		*vp, *limit = rctx->limit;
+	uint64_t		res;
+	fr_pair_t		*vp;
 	int			ret;
 	char			msg[128];
 
-	if (!sql_result || (sscanf(sql_result->vb_strvalue, "%" PRIu64, &counter) != 1)) {
-		RDEBUG2("No integer found in result string \"%pV\".  May be first session, setting counter to 0",
-			sql_result);
-		counter = 0;
-	}
-
 	/*
 	 *	Add the counter to the control list
 	 */
@@ -376,6 +571,32 @@ static unlang_action_t mod_authorize_resume(rlm_rcode_t *p_result, UNUSED int *p
 	RETURN_MODULE_OK;
 }
 
+/** Handle the result of calling the SQL query to retrieve the `counter` value.
+ *
+ * If the cache is enabled, the cached counter is seeded (or reconciled) with the value.
+ */
+static unlang_action_t mod_authorize_resume(rlm_rcode_t *p_result, UNUSED int *priority, request_t *request, void *uctx)
+{
+	sqlcounter_rctx_t	*rctx = talloc_get_type_abort(uctx, sqlcounter_rctx_t);
+	rlm_sqlcounter_t	*inst = rctx->inst;
+	sqlcounter_call_env_t	*env = rctx->env;
+	fr_value_box_t		*sql_result = fr_value_box_list_pop_head(&rctx->result);
+	uint64_t		counter;
+
+	if (!sql_result || (sscanf(sql_result->vb_strvalue, "%" PRIu64, &counter) != 1)) {
+		RDEBUG2("No integer found in result string \"%pV\".  May be first session, setting counter to 0",
+			sql_result);
+		counter = 0;
+	}
+
+	if (inst->cache.enabled && (env->key.type == FR_TYPE_STRING)) {
+		RDEBUG3("Caching counter value %" PRIu64 " for \"%pV\"", counter, &env->key);
+		cache_counter_set(inst, &env->key, counter, request->packet->timestamp);
+	}
+
+	return sqlcounter_check(p_result, request, inst, env, rctx->limit, counter);
+}
+
 /** Check the value of a `counter` retrieved from an SQL query with a `limit`
  *
  * Module specific attributes containing the start / end times are created / updated,
@@ -388,19 +609,13 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, mod
 	sqlcounter_call_env_t	*env = talloc_get_type_abort(mctx->env_data, sqlcounter_call_env_t);
 	fr_pair_t		*limit, *vp;
 	sqlcounter_rctx_t	*rctx;
+	uint64_t		counter;
 
 	/*
 	 *	Before doing anything else, see if we have to reset
 	 *	the counters.
 	 */
-	if (fr_time_neq(inst->reset_time, fr_time_wrap(0)) &&
-	    (fr_time_lteq(inst->reset_time, request->packet->timestamp))) {
-		/*
-		 *	Re-set the next time and prev_time for this counters range
-		 */
-		inst->last_reset = inst->reset_time;
-		find_next_reset(inst, request->packet->timestamp);
-	}
+	sqlcounter_period_check(inst, request->packet->timestamp);
 
 	if (tmpl_find_vp(&limit, request, inst->limit_attr) < 0) {
 		RWDEBUG2("Couldn't find %s, doing nothing...", inst->limit_attr->name);
@@ -422,6 +637,16 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, mod
 	}
 	vp->vp_uint64 = fr_time_to_sec(inst->reset_time);
 
+	/*
+	 *	Skip the query if we have a recent enough value
+	 *	for the counter.
+	 */
+	if (inst->cache.enabled && (env->key.type == FR_TYPE_STRING) &&
+	    cache_counter_get(&counter, inst, &env->key, request->packet->timestamp)) {
+		RDEBUG2("Using cached counter value for \"%pV\"", &env->key);
+		return sqlcounter_check(p_result, request, inst, env, limit, counter);
+	}
+
 	MEM(rctx = talloc(unlang_interpret_frame_talloc_ctx(request), sqlcounter_rctx_t));
 	*rctx = (sqlcounter_rctx_t) {
 		.inst = inst,
@@ -441,6 +666,103 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, mod
 	return UNLANG_ACTION_PUSHED_CHILD;
 }
 
+/** Update a cached counter from an accounting request
+ *
+ * The usage reported for a session is cumulative, so the difference from the
+ * last value seen for the same session is added to the counter.
+ *
+ * The first value seen for a session may already be included in the value
+ * read from SQL, so it is only added if the session started after the counter
+ * was read.  Counters which aren't in the cache are left alone, they will be
+ * read from SQL the next time they are needed.
+ *
+ * Stopped sessions are remembered until the counter expires or is reset, so
+ * that retransmitted Stops aren't counted again.
+ */
+static unlang_action_t CC_HINT(nonnull) mod_accounting(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_sqlcounter_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_sqlcounter_t);
+	sqlcounter_call_env_t		*env = talloc_get_type_abort(mctx->env_data, sqlcounter_call_env_t);
+	sqlcounter_cache_entry_t	*entry;
+	sqlcounter_cache_session_t	*session;
+	uint64_t			usage, delta = 0, counter;
+	bool				start = false, stop = false;
+
+	if (!inst->cache.enabled) RETURN_MODULE_NOOP;
+
+	if (env->status.type == FR_TYPE_STRING) {
+		start = (strcmp(env->status.vb_strvalue, "Start") == 0);
+		stop = (strcmp(env->status.vb_strvalue, "Stop") == 0);
+	}
+
+	if ((env->key.type != FR_TYPE_STRING) || (env->session_id.type != FR_TYPE_STRING)) {
+		RDEBUG2("Missing key or session identifier, not updating cached counter");
+		RETURN_MODULE_NOOP;
+	}
+
+	/*
+	 *	Start packets usually don't include any usage.
+	 */
+	if (env->usage.type == FR_TYPE_UINT64) {
+		usage = env->usage.vb_uint64;
+	} else if (start) {
+		usage = 0;
+	} else {
+		RDEBUG2("Missing usage, not updating cached counter");
+		RETURN_MODULE_NOOP;
+	}
+
+	sqlcounter_period_check(inst, request->packet->timestamp);
+
+	pthread_mutex_lock(&inst->mutable->mutex);
+	entry = cache_find(inst, &env->key, request->packet->timestamp);
+	if (!entry) {
+		pthread_mutex_unlock(&inst->mutable->mutex);
+		RDEBUG2("No cached counter for \"%pV\"", &env->key);
+		RETURN_MODULE_NOOP;
+	}
+
+	session = fr_rb_find(entry->sessions, &(sqlcounter_cache_session_t){ .id = env->session_id.vb_strvalue });
+	if (session) {
+		if (session->stopped) {
+			pthread_mutex_unlock(&inst->mutable->mutex);
+			RDEBUG2("Session has already stopped, not updating cached counter");
+			RETURN_MODULE_NOOP;
+		}
+
+		if (usage > session->usage) delta = usage - session->usage;
+	} else {
+		/*
+		 *	The counter read from SQL can't include any usage
+		 *	from sessions which started after it was read.
+		 */
+		if (start ||
+		    ((env->session_time.type == FR_TYPE_UINT32) &&
+		     fr_time_gteq(fr_time_sub(request->packet->timestamp,
+					      fr_time_delta_from_sec(env->session_time.vb_uint32)), entry->seeded))) {
+			delta = usage;
+		}
+
+		MEM(session = talloc_zero(entry->sessions, sqlcounter_cache_session_t));
+		MEM(session->id = talloc_bstrndup(session, env->session_id.vb_strvalue, env->session_id.vb_length));
+		fr_rb_insert(entry->sessions, session);
+	}
+
+	/*
+	 *	There won't be any more usage for this session.
+	 */
+	session->stopped = stop;
+	session->usage = usage;
+
+	entry->counter += delta;
+	counter = entry->counter;
+	pthread_mutex_unlock(&inst->mutable->mutex);
+
+	RDEBUG2("Added %" PRIu64 " to cached counter for \"%pV\", now %" PRIu64, delta, &env->key, counter);
+
+	RETURN_MODULE_UPDATED;
+}
+
 /** Custom call_env parser to tokenize the SQL query xlat used for counter retrieval
  */
 static int call_env_query_parse(TALLOC_CTX *ctx, void *out, tmpl_rules_t const *t_rules, CONF_ITEM *ci,
@@ -486,6 +808,23 @@ static const call_env_method_t sqlcounter_call_env = {
 		  .pair.func = call_env_query_parse },
 		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("reply_name", FR_TYPE_VOID, CALL_ENV_FLAG_PARSE_ONLY, sqlcounter_call_env_t, reply_attr) },
 		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("reply_message_name", FR_TYPE_VOID, CALL_ENV_FLAG_PARSE_ONLY, sqlcounter_call_env_t, reply_msg_attr) },
+		{ FR_CALL_ENV_OFFSET("key", FR_TYPE_STRING, CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_NULLABLE, sqlcounter_call_env_t, key),
+		  .pair.dflt = "%{Stripped-User-Name || User-Name}", .pair.dflt_quote = T_DOUBLE_QUOTED_STRING },
+		{ FR_CALL_ENV_SUBSECTION("cache", NULL, CALL_ENV_FLAG_NONE,
+			((call_env_parser_t[]) {
+				{ FR_CALL_ENV_OFFSET("session_id", FR_TYPE_STRING, CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_NULLABLE,
+						     sqlcounter_call_env_t, session_id),
+				  .pair.dflt = "%{Acct-Unique-Session-Id || Acct-Session-Id}", .pair.dflt_quote = T_DOUBLE_QUOTED_STRING },
+				{ FR_CALL_ENV_OFFSET("usage", FR_TYPE_UINT64, CALL_ENV_FLAG_NULLABLE, sqlcounter_call_env_t, usage),
+				  .pair.dflt = "Acct-Session-Time", .pair.dflt_quote = T_BARE_WORD },
+				{ FR_CALL_ENV_OFFSET("status", FR_TYPE_STRING, CALL_ENV_FLAG_CONCAT | CALL_ENV_FLAG_NULLABLE,
+						     sqlcounter_call_env_t, status),
+				  .pair.dflt = "%{Acct-Status-Type}", .pair.dflt_quote = T_DOUBLE_QUOTED_STRING },
+				{ FR_CALL_ENV_OFFSET("session_time", FR_TYPE_UINT32, CALL_ENV_FLAG_NULLABLE,
+						     sqlcounter_call_env_t, session_time),
+				  .pair.dflt = "Acct-Session-Time", .pair.dflt_quote = T_BARE_WORD },
+				CALL_ENV_TERMINATOR
+			})) },
 		CALL_ENV_TERMINATOR
 	}
 };
@@ -536,6 +875,26 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		return -1;
 	}
 
+	if (inst->cache.enabled) {
+		MEM(inst->mutable = talloc_zero(NULL, sqlcounter_cache_t));
+		pthread_mutex_init(&inst->mutable->mutex, NULL);
+		MEM(inst->mutable->tree = fr_rb_inline_talloc_alloc(inst->mutable, sqlcounter_cache_entry_t, node,
+								    cache_entry_cmp, NULL));
+		fr_dlist_init(&inst->mutable->lru, sqlcounter_cache_entry_t, entry);
+	}
+
+	return 0;
+}
+
+static int mod_detach(module_detach_ctx_t const *mctx)
+{
+	rlm_sqlcounter_t *inst = talloc_get_type_abort(mctx->mi->data, rlm_sqlcounter_t);
+
+	if (!inst->mutable) return 0;
+
+	pthread_mutex_destroy(&inst->mutable->mutex);
+	talloc_free(inst->mutable);
+
 	return 0;
 }
 
@@ -589,9 +948,11 @@ module_rlm_t rlm_sqlcounter = {
 		.config		= module_config,
 		.bootstrap	= mod_bootstrap,
 		.instantiate	= mod_instantiate,
+		.detach		= mod_detach,
 	},
 	.method_group = {
 		.bindings = (module_method_binding_t[]){
+			{ .section = SECTION_NAME("accounting", CF_IDENT_ANY), .method = mod_accounting, .method_env = &sqlcounter_call_env },
 			{ .section = SECTION_NAME(CF_IDENT_ANY, CF_IDENT_ANY), .method = mod_authorize, .method_env = &sqlcounter_call_env },
 			MODULE_BINDING_TERMINATOR
 		}
@@ -32,9 +32,11 @@ USES_APPLE_DEPRECATED_API
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/util/perm.h>
+#include <freeradius-devel/unlang/offload.h>
 #include <freeradius-devel/unlang/xlat_func.h>
 
 #include <grp.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <sys/stat.h>
 
@@ -44,6 +46,34 @@ USES_APPLE_DEPRECATED_API
 #  include <shadow.h>
 #endif
 
+/*
+ *	getusershell() walks a global list, as does getspnam() on
+ *	systems without getspnam_r().  Every instance of the module
+ *	shares them, so the lock is process wide.
+ */
+#if defined(HAVE_GETUSERSHELL) || (defined(HAVE_GETSPNAM) && !defined(HAVE_GETSPNAM_R))
+static pthread_mutex_t unix_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+typedef struct {
+	unlang_offload_config_t	offload;	//!< Thread pool configuration for passwd lookups.
+	unlang_offload_pool_t	*pool;		//!< Thread pool which runs passwd lookups.
+} rlm_unix_t;
+
+typedef struct {
+	unlang_offload_thread_t	*offload;	//!< This worker's view of the offload pool.
+} rlm_unix_thread_t;
+
+static const conf_parser_t offload_config[] = {
+	UNLANG_OFFLOAD_CONFIG_CONF_PARSER
+	CONF_PARSER_TERMINATOR
+};
+
+static const conf_parser_t module_config[] = {
+	{ FR_CONF_OFFSET_SUBSECTION("offload", 0, rlm_unix_t, offload, offload_config) },
+	CONF_PARSER_TERMINATOR
+};
+
 static fr_dict_t const *dict_freeradius;
 static fr_dict_t const *dict_radius;
 
@@ -200,13 +230,121 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 }
 
 
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_unix_t	*inst = talloc_get_type_abort(mctx->mi->data, rlm_unix_t);
+
+	inst->pool = unlang_offload_pool_alloc(inst, mctx->mi->name, &inst->offload);
+	if (!inst->pool) {
+		PERROR("Failed creating offload pool");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_unix_t		*inst = talloc_get_type_abort(mctx->mi->data, rlm_unix_t);
+	rlm_unix_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_unix_thread_t);
+
+	t->offload = unlang_offload_thread_alloc(t, inst->pool, mctx->el);
+	if (!t->offload) {
+		PERROR("Failed creating offload thread data");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Inputs and outputs for a passwd lookup
+ *
+ * Copied out of the request, as the lookup runs in the offload pool.
+ */
+typedef struct {
+	char const	*name;			//!< User to look up.
+	time_t		now;			//!< When the request was received, for expiry checks.
+
+	char		*encrypted_pass;	//!< The user's crypted password.
+	char		*error;			//!< Why the user was rejected.
+} unix_lookup_t;
+
+#ifdef HAVE_GETSPNAM
+/** Look up a user's shadow password entry
+ *
+ * @param[in] ctx	to allocate the entry in.
+ * @param[out] out	Where to write the entry.
+ * @param[in] name	of the user.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the user has no shadow entry, or the lookup failed.
+ */
+static int unix_getspnam(TALLOC_CTX *ctx, struct spwd **out, char const *name)
+{
+#ifdef HAVE_GETSPNAM_R
+	uint8_t		*buff;
+	int		ret;
+
+	*out = NULL;
+
+	buff = talloc_array(ctx, uint8_t, sizeof(struct spwd) + 1024);
+	if (!buff) return -1;
+
+	/*
+	 *	Grow the string buffer until the entry fits.
+	 */
+	while ((ret = getspnam_r(name, (struct spwd *)buff, (char *)(buff + sizeof(struct spwd)),
+				 talloc_array_length(buff) - sizeof(struct spwd), out)) == ERANGE) {
+		uint8_t *tmp;
+
+		tmp = talloc_realloc(ctx, buff, uint8_t, talloc_array_length(buff) * 2);
+		if (!tmp) {
+			talloc_free(buff);
+			return -1;
+		}
+		buff = tmp;
+	}
+
+	if ((ret != 0) || !*out) {
+		talloc_free(buff);
+		*out = NULL;
+		return -1;
+	}
+
+	return 0;
+#else
+	struct spwd	*spwd, *copy = NULL;
+
+	pthread_mutex_lock(&unix_mutex);
+	spwd = getspnam(name);
+	if (spwd && spwd->sp_pwdp) {
+		copy = talloc(ctx, struct spwd);
+		if (copy) {
+			*copy = *spwd;
+			copy->sp_namp = NULL;
+			copy->sp_pwdp = talloc_strdup(copy, spwd->sp_pwdp);
+			if (!copy->sp_pwdp) TALLOC_FREE(copy);
+		}
+	}
+	pthread_mutex_unlock(&unix_mutex);
+
+	*out = copy;
+
+	return copy ? 0 : -1;
+#endif
+}
+#endif	/* HAVE_GETSPNAM */
+
 /*
- *	Pull the users password from where-ever, and add it to
- *	the given vp list.
+ *	Pull the users password from where-ever.
+ *
+ *	Runs in the offload pool, as the lookups may go
+ *	to NIS, LDAP, etc. via NSS.
  */
-static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, UNUSED module_ctx_t const *mctx, request_t *request)
+static rlm_rcode_t unix_lookup_offload(void *uctx)
 {
-	char const	*name;
+	unix_lookup_t	*lookup = talloc_get_type_abort(uctx, unix_lookup_t);
+	char const	*name = lookup->name;
 	char const	*encrypted_pass;
 #ifdef HAVE_GETSPNAM
 	struct spwd	*spwd = NULL;
@@ -214,22 +352,20 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, UNU
 	struct passwd	*pwd;
 #ifdef HAVE_GETUSERSHELL
 	char		*shell;
+	bool		valid_shell;
 #endif
-	fr_pair_t	*vp;
-	fr_pair_t	*username;
+
+	encrypted_pass = NULL;
 
 	/*
-	 *	We can only authenticate user requests which HAVE
-	 *	a User-Name attribute.
+	 *	The lookups run in several threads, so we use
+	 *	the reentrant versions.
 	 */
-	username = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_name);
-	if (!username) RETURN_MODULE_NOOP;
-
-	name = username->vp_strvalue;
-	encrypted_pass = NULL;
+	if (fr_perm_getpwnam(lookup, &pwd, name) < 0) {
+		if (errno == 0) return RLM_MODULE_NOTFOUND;
 
-	if ((pwd = getpwnam(name)) == NULL) {
-		RETURN_MODULE_NOTFOUND;
+		lookup->error = talloc_asprintf(lookup, "[%s]: %s", name, fr_strerror());
+		return RLM_MODULE_FAIL;
 	}
 	encrypted_pass = pwd->pw_passwd;
 
@@ -244,9 +380,7 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, UNU
 	 *	stand right now.
 	 */
 	if ((!encrypted_pass) || (strlen(encrypted_pass) < 10)) {
-		if ((spwd = getspnam(name)) == NULL) {
-			RETURN_MODULE_NOTFOUND;
-		}
+		if (unix_getspnam(lookup, &spwd, name) < 0) return RLM_MODULE_NOTFOUND;
 		encrypted_pass = spwd->sp_pwdp;
 	}
 #endif	/* HAVE_GETSPNAM */
@@ -256,8 +390,8 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, UNU
 	 *	Users with a particular shell are denied access
 	 */
 	if (strcmp(pwd->pw_shell, DENY_SHELL) == 0) {
-		REDEBUG("Invalid shell", name);
-		RETURN_MODULE_REJECT;
+		lookup->error = talloc_asprintf(lookup, "[%s]: invalid shell", name);
+		return RLM_MODULE_REJECT;
 	}
 #endif
 
@@ -266,16 +400,20 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, UNU
 	 *	Check /etc/shells for a valid shell. If that file
 	 *	contains /RADIUSD/ANY/SHELL then any shell will do.
 	 */
+	pthread_mutex_lock(&unix_mutex);
 	while ((shell = getusershell()) != NULL) {
 		if (strcmp(shell, pwd->pw_shell) == 0 ||
 		    strcmp(shell, "/RADIUSD/ANY/SHELL") == 0) {
 			break;
 		}
 	}
+	valid_shell = (shell != NULL);
 	endusershell();
-	if (!shell) {
-		REDEBUG("[%s]: invalid shell [%s]", name, pwd->pw_shell);
-		RETURN_MODULE_REJECT;
+	pthread_mutex_unlock(&unix_mutex);
+
+	if (!valid_shell) {
+		lookup->error = talloc_asprintf(lookup, "[%s]: invalid shell [%s]", name, pwd->pw_shell);
+		return RLM_MODULE_REJECT;
 	}
 #endif
 
@@ -284,17 +422,17 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, UNU
 	 *      Check if password has expired.
 	 */
 	if (spwd && spwd->sp_lstchg > 0 && spwd->sp_max >= 0 &&
-	    (fr_time_to_sec(request->packet->timestamp) / 86400) > (spwd->sp_lstchg + spwd->sp_max)) {
-		REDEBUG("[%s]: password has expired", name);
-		RETURN_MODULE_REJECT;
+	    (lookup->now / 86400) > (spwd->sp_lstchg + spwd->sp_max)) {
+		lookup->error = talloc_asprintf(lookup, "[%s]: password has expired", name);
+		return RLM_MODULE_REJECT;
 	}
 	/*
 	 *      Check if account has expired.
 	 */
 	if (spwd && spwd->sp_expire > 0 &&
-	    (fr_time_to_sec(request->packet->timestamp) / 86400) > spwd->sp_expire) {
-		REDEBUG("[%s]: account has expired", name);
-		RETURN_MODULE_REJECT;
+	    (lookup->now / 86400) > spwd->sp_expire) {
+		lookup->error = talloc_asprintf(lookup, "[%s]: account has expired", name);
+		return RLM_MODULE_REJECT;
 	}
 #endif
 
@@ -303,9 +441,9 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, UNU
 	 *	Check if password has expired.
 	 */
 	if ((pwd->pw_expire > 0) &&
-	    (fr_time_to_sec(request->packet->timestamp) > pwd->pw_expire)) {
-		REDEBUG("[%s]: password has expired", name);
-		RETURN_MODULE_REJECT;
+	    (lookup->now > pwd->pw_expire)) {
+		lookup->error = talloc_asprintf(lookup, "[%s]: password has expired", name);
+		return RLM_MODULE_REJECT;
 	}
 #endif
 
@@ -314,15 +452,53 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, UNU
 	 *
 	 *	FIXME: Maybe add Auth-Type := Accept?
 	 */
-	if (encrypted_pass[0] == 0)
-		RETURN_MODULE_NOOP;
+	if (encrypted_pass[0] == 0) return RLM_MODULE_NOOP;
+
+	lookup->encrypted_pass = talloc_strdup(lookup, encrypted_pass);
+	if (!lookup->encrypted_pass) return RLM_MODULE_FAIL;
+
+	return RLM_MODULE_UPDATED;
+}
+
+/*
+ *	Add the users password to the control list.
+ */
+static unlang_action_t CC_HINT(nonnull) mod_authorize_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+							     request_t *request)
+{
+	unix_lookup_t	*lookup = talloc_get_type_abort(mctx->rctx, unix_lookup_t);
+	fr_pair_t	*vp;
+
+	if (lookup->error) REDEBUG("%s", lookup->error);
+
+	if (*p_result != RLM_MODULE_UPDATED) RETURN_MODULE_RCODE(*p_result);
 
 	MEM(pair_update_control(&vp, attr_crypt_password) >= 0);
-	fr_pair_value_strdup(vp, encrypted_pass, false);
+	fr_pair_value_strdup(vp, lookup->encrypted_pass, false);
 
 	RETURN_MODULE_UPDATED;
 }
 
+static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_unix_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_unix_thread_t);
+	unix_lookup_t		*lookup;
+	fr_pair_t		*username;
+
+	/*
+	 *	We can only authenticate user requests which HAVE
+	 *	a User-Name attribute.
+	 */
+	username = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_name);
+	if (!username) RETURN_MODULE_NOOP;
+
+	MEM(lookup = talloc_zero(NULL, unix_lookup_t));
+	MEM(lookup->name = talloc_bstrndup(lookup, username->vp_strvalue, username->vp_length));
+	lookup->now = fr_time_to_sec(request->packet->timestamp);
+
+	return unlang_offload_yield(p_result, mctx, request, t->offload, unix_lookup_offload, mod_authorize_resume, lookup);
+}
+
 
 /* globally exported name */
 extern module_rlm_t rlm_unix;
@@ -330,8 +506,12 @@ module_rlm_t rlm_unix = {
 	.common = {
 		.magic		= MODULE_MAGIC_INIT,
 		.name		= "unix",
-		.flags		= MODULE_TYPE_THREAD_UNSAFE,
-		.bootstrap	= mod_bootstrap
+		.inst_size	= sizeof(rlm_unix_t),
+		.config		= module_config,
+		.bootstrap	= mod_bootstrap,
+		.instantiate	= mod_instantiate,
+		.thread_inst_size	= sizeof(rlm_unix_thread_t),
+		.thread_instantiate	= mod_thread_instantiate
 	},
 	.method_group = {
 		.bindings = (module_method_binding_t[]){
@@ -35,54 +35,93 @@ RCSID("$Id$")
 #include "rlm_winbind.h"
 #include "auth_wbclient_pap.h"
 
-/** PAP authentication direct to winbind via Samba's libwbclient library
+/** Return the winbind context to the slab
+ *
+ * The uctx is always freed in the worker which allocated it.
+ */
+static int _winbind_auth_free(winbind_auth_t *auth)
+{
+	if (auth->wbctx) winbind_slab_release(auth->wbctx);
+
+	return 0;
+}
+
+/** Copy the authentication parameters out of the request
  *
  * @param[in] request The current request
  * @param[in] env The call_env for the current winbind authentication
  * @param[in] t The module thread instance data.
  *
  * @return
- *	- 0	Success
- *	- -1	Authentication failure
- *	- -648	Password expired
- *
+ *	- The authentication parameters, allocated in the NULL ctx.
+ *	- NULL if no winbind context was available.
  */
-int do_auth_wbclient_pap(request_t *request, winbind_auth_call_env_t *env, rlm_winbind_thread_t *t)
+winbind_auth_t *winbind_auth_alloc(request_t *request, winbind_auth_call_env_t *env, rlm_winbind_thread_t *t)
 {
-	int				ret = -1;
-	winbind_ctx_t			*wbctx;
-	struct wbcContext		*wb_ctx;
-	struct wbcAuthUserParams	authparams;
-	wbcErr				err;
-	struct wbcAuthUserInfo		*info = NULL;
-	struct wbcAuthErrorInfo		*error = NULL;
-
-	/*
-	 * Clear the auth parameters - this is important, as
-	 * there are options that will cause wbcAuthenticateUserEx
-	 * to bomb out if not zero.
-	 */
-	memset(&authparams, 0, sizeof(authparams));
+	winbind_auth_t	*auth;
 
 	/*
 	 * username must be set for this function to be called
 	 */
 	fr_assert(env->username.type == FR_TYPE_STRING);
 
-	authparams.account_name = env->username.vb_strvalue;
+	MEM(auth = talloc_zero(NULL, winbind_auth_t));
+	MEM(auth->account_name = talloc_bstrndup(auth, env->username.vb_strvalue, env->username.vb_length));
+	MEM(auth->password = talloc_bstrndup(auth, env->password.vb_strvalue, env->password.vb_length));
 
 	if (env->domain.type == FR_TYPE_STRING) {
-		authparams.domain_name = env->domain.vb_strvalue;
+		MEM(auth->domain_name = talloc_bstrndup(auth, env->domain.vb_strvalue, env->domain.vb_length));
 	} else {
 		RWDEBUG2("No domain specified; authentication may fail because of this");
 	}
 
+	auth->wbctx = winbind_slab_reserve(t->slab);
+	if (!auth->wbctx) {
+		RERROR("Unable to get winbind context");
+		talloc_free(auth);
+		return NULL;
+	}
+	talloc_set_destructor(auth, _winbind_auth_free);
+
+	RDEBUG2("Sending authentication request user='%s' domain='%s'", auth->account_name,
+								      auth->domain_name);
+
+	return auth;
+}
+
+/** PAP authentication direct to winbind via Samba's libwbclient library
+ *
+ * Runs in the offload pool, as winbindd may take a long time to
+ * respond if the domain controllers are slow.
+ *
+ * @param[in] uctx The #winbind_auth_t allocated by #winbind_auth_alloc.
+ *
+ * @return
+ *	- RLM_MODULE_OK	Success
+ *	- RLM_MODULE_REJECT Authentication failure
+ */
+rlm_rcode_t do_auth_wbclient_pap(void *uctx)
+{
+	winbind_auth_t			*auth = talloc_get_type_abort(uctx, winbind_auth_t);
+	struct wbcAuthUserParams	authparams;
+	struct wbcAuthUserInfo		*info = NULL;
+	struct wbcAuthErrorInfo		*error = NULL;
+
+	/*
+	 * Clear the auth parameters - this is important, as
+	 * there are options that will cause wbcAuthenticateUserEx
+	 * to bomb out if not zero.
+	 */
+	memset(&authparams, 0, sizeof(authparams));
+
+	authparams.account_name = auth->account_name;
+	authparams.domain_name = auth->domain_name;
 
 	/*
 	 * Build the wbcAuthUserParams structure with what we know
 	 */
 	authparams.level = WBC_AUTH_USER_LEVEL_PLAIN;
-	authparams.password.plaintext = env->password.vb_strvalue;
+	authparams.password.plaintext = auth->password;
 
 	/*
 	 * Parameters documented as part of the MSV1_0_SUBAUTH_LOGON structure
@@ -95,25 +134,43 @@ int do_auth_wbclient_pap(request_t *request, winbind_auth_call_env_t *env, rlm_w
 	/*
 	 * Send auth request across to winbind
 	 */
-	wbctx = winbind_slab_reserve(t->slab);
-	if (!wbctx) {
-		RERROR("Unable to get winbind context");
-		goto done;
+	auth->err = wbcCtxAuthenticateUserEx(auth->wbctx->ctx, &authparams, &info, &error);
+
+	/*
+	 * Keep what we need to report the error, as the request
+	 * can't be logged to from here.
+	 */
+	if (error) {
+		auth->have_error = true;
+		auth->nt_status = error->nt_status;
+		if (error->display_string) auth->display_string = talloc_strdup(auth, error->display_string);
 	}
-	wb_ctx = wbctx->ctx;
 
-	RDEBUG2("Sending authentication request user='%s' domain='%s'", authparams.account_name,
-									authparams.domain_name);
+	if (info) wbcFreeMemory(info);
+	if (error) wbcFreeMemory(error);
 
-	err = wbcCtxAuthenticateUserEx(wb_ctx, &authparams, &info, &error);
+	return (auth->err == WBC_ERR_SUCCESS) ? RLM_MODULE_OK : RLM_MODULE_REJECT;
+}
 
-	winbind_slab_release(wbctx);
+/** Log the result of the authentication
+ *
+ * @param[in] request The current request
+ * @param[in] auth The #winbind_auth_t which was passed to #do_auth_wbclient_pap.
+ *
+ * @return
+ *	- 0	Success
+ *	- -1	Authentication failure
+ *	- -648	Password expired
+ */
+int winbind_auth_result(request_t *request, winbind_auth_t *auth)
+{
+	int	ret = -1;
 
 	/*
 	 * Try and give some useful feedback on what happened. There are only
 	 * a few errors that can actually be returned from wbcCtxAuthenticateUserEx.
 	 */
-	switch (err) {
+	switch (auth->err) {
 	case WBC_ERR_SUCCESS:
 		ret = 0;
 		RDEBUG2("Authenticated successfully");
@@ -130,7 +187,7 @@ int do_auth_wbclient_pap(request_t *request, winbind_auth_call_env_t *env, rlm_w
 		break;
 
 	case WBC_ERR_AUTH_ERROR:
-		if (!error) {
+		if (!auth->have_error) {
 			REDEBUG2("Authentication failed");
 			break;
 		}
@@ -138,18 +195,18 @@ int do_auth_wbclient_pap(request_t *request, winbind_auth_call_env_t *env, rlm_w
 		/*
 		 * The password needs to be changed, set ret appropriately.
 		 */
-		if (error->nt_status == NT_STATUS_PASSWORD_EXPIRED ||
-		    error->nt_status == NT_STATUS_PASSWORD_MUST_CHANGE) {
+		if (auth->nt_status == NT_STATUS_PASSWORD_EXPIRED ||
+		    auth->nt_status == NT_STATUS_PASSWORD_MUST_CHANGE) {
 			ret = -648;
 		}
 
 		/*
 		 * Return the NT_STATUS human readable error string, if there is one.
 		 */
-		if (error->display_string) {
-			REDEBUG2("%s [0x%X]", error->display_string, error->nt_status);
+		if (auth->display_string) {
+			REDEBUG2("%s [0x%X]", auth->display_string, auth->nt_status);
 		} else {
-			REDEBUG2("Unknown authentication failure [0x%X]", error->nt_status);
+			REDEBUG2("Unknown authentication failure [0x%X]", auth->nt_status);
 		}
 		break;
 
@@ -160,19 +217,13 @@ int do_auth_wbclient_pap(request_t *request, winbind_auth_call_env_t *env, rlm_w
 		 *   WBC_ERR_NO_MEMORY
 		 * neither of which are particularly likely.
 		 */
-		if (error && error->display_string) {
-			REDEBUG2("Failed authenticating user: %s (%s)", error->display_string, wbcErrorString(err));
+		if (auth->display_string) {
+			REDEBUG2("Failed authenticating user: %s (%s)", auth->display_string, wbcErrorString(auth->err));
 		} else {
-			REDEBUG2("Failed authenticating user: Winbind error (%s)", wbcErrorString(err));
+			REDEBUG2("Failed authenticating user: Winbind error (%s)", wbcErrorString(auth->err));
 		}
 		break;
 	}
 
-
-done:
-	if (info) wbcFreeMemory(info);
-	if (error) wbcFreeMemory(error);
-
 	return ret;
 }
-
@@ -4,4 +4,24 @@
 
 RCSIDH(auth_wbclient_h, "$Id$")
 
-int do_auth_wbclient_pap(request_t *request, winbind_auth_call_env_t *env, rlm_winbind_thread_t *t);
+/** Inputs and outputs for a winbind authentication
+ *
+ * Copied out of the request, as the authentication runs in the offload pool.
+ */
+typedef struct {
+	char const	*account_name;		//!< User to authenticate.
+	char const	*domain_name;		//!< Domain of the user, or NULL.
+	char const	*password;		//!< Cleartext password.
+	winbind_ctx_t	*wbctx;			//!< Reserved from the worker's slab.
+
+	wbcErr		err;			//!< Result of the authentication.
+	bool		have_error;		//!< Winbind returned extra error information.
+	uint32_t	nt_status;		//!< NT_STATUS code from the error information.
+	char		*display_string;	//!< Human readable error string, or NULL.
+} winbind_auth_t;
+
+winbind_auth_t *winbind_auth_alloc(request_t *request, winbind_auth_call_env_t *env, rlm_winbind_thread_t *t);
+
+rlm_rcode_t do_auth_wbclient_pap(void *uctx);
+
+int winbind_auth_result(request_t *request, winbind_auth_t *auth);
@@ -47,9 +47,15 @@ static conf_parser_t reuse_winbind_config[] = {
 	CONF_PARSER_TERMINATOR
 };
 
+static conf_parser_t offload_winbind_config[] = {
+	UNLANG_OFFLOAD_CONFIG_CONF_PARSER
+	CONF_PARSER_TERMINATOR
+};
+
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_POINTER("group", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) group_config },
 	{ FR_CONF_OFFSET_SUBSECTION("reuse", 0, rlm_winbind_t, reuse, reuse_winbind_config) },
+	{ FR_CONF_OFFSET_SUBSECTION("offload", 0, rlm_winbind_t, offload, offload_winbind_config) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -315,6 +321,12 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		     mctx->mi->name);
 	}
 
+	inst->pool = unlang_offload_pool_alloc(inst, mctx->mi->name, &inst->offload);
+	if (!inst->pool) {
+		PERROR("Failed creating offload pool");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -355,6 +367,28 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, mod
 }
 
 
+/** Report the result of the winbind authentication
+ *
+ * Return OK if successful. No need for many debug outputs or
+ * errors as winbind_auth_result() is chatty enough.
+ *
+ * @param[out] p_result		The result of the module call.
+ * @param[in] mctx		Module instance data, with the #winbind_auth_t as rctx.
+ * @param[in] request		The current request
+ */
+static unlang_action_t CC_HINT(nonnull) mod_authenticate_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+								request_t *request)
+{
+	winbind_auth_t		*auth = talloc_get_type_abort(mctx->rctx, winbind_auth_t);
+
+	if (winbind_auth_result(request, auth) == 0) {
+		RDEBUG2("User authenticated successfully using winbind");
+		RETURN_MODULE_OK;
+	}
+
+	RETURN_MODULE_REJECT;
+}
+
 /** Authenticate the user via libwbclient and winbind
  *
  * @param[out] p_result		The result of the module call.
@@ -365,6 +399,7 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 {
 	winbind_auth_call_env_t	*env = talloc_get_type_abort(mctx->env_data, winbind_auth_call_env_t);
 	rlm_winbind_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_winbind_thread_t);
+	winbind_auth_t		*auth;
 
 	/*
 	 *	Make sure the supplied password isn't empty
@@ -383,17 +418,11 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 		RDEBUG2("Login attempt with password");
 	}
 
-	/*
-	 *	Authenticate and return OK if successful. No need for
-	 *	many debug outputs or errors as the auth function is
-	 *	chatty enough.
-	 */
-	if (do_auth_wbclient_pap(request, env, t) == 0) {
-		RDEBUG2("User authenticated successfully using winbind");
-		RETURN_MODULE_OK;
-	}
+	auth = winbind_auth_alloc(request, env, t);
+	if (!auth) RETURN_MODULE_REJECT;
 
-	RETURN_MODULE_REJECT;
+	return unlang_offload_yield(p_result, mctx, request, t->offload, do_auth_wbclient_pap,
+				    mod_authenticate_resume, auth);
 }
 
 static const call_env_method_t winbind_autz_method_env = {
@@ -535,12 +564,24 @@ static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 		return -1;
 	}
 
+	if (!(t->offload = unlang_offload_thread_alloc(t, inst->pool, mctx->el))) {
+		PERROR("Failed creating offload thread data");
+		return -1;
+	}
+
 	return 0;
 }
 
 static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
 {
 	rlm_winbind_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_winbind_thread_t);
+
+	/*
+	 *	Outstanding authentications hold winbind
+	 *	contexts, so wait for them before freeing
+	 *	the slab.
+	 */
+	talloc_free(t->offload);
 	talloc_free(t->slab);
 	return 0;
 }
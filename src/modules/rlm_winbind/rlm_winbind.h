@@ -3,6 +3,7 @@
 
 #include "config.h"
 #include <wbclient.h>
+#include <freeradius-devel/unlang/offload.h>
 #include <freeradius-devel/util/slab.h>
 
 /*
@@ -14,6 +15,9 @@ typedef struct {
 	/* group config */
 	bool			group_add_domain;
 	fr_slab_config_t	reuse;
+
+	unlang_offload_config_t	offload;	//!< Thread pool configuration for authentication.
+	unlang_offload_pool_t	*pool;		//!< Thread pool which runs authentication.
 } rlm_winbind_t;
 
 typedef struct {
@@ -26,6 +30,7 @@ FR_SLAB_FUNCS(winbind, winbind_ctx_t)
 typedef struct {
 	rlm_winbind_t const	*inst;		//!< Instance of rlm_winbind
 	winbind_slab_list_t	*slab;		//!< Slab list for winbind handles.
+	unlang_offload_thread_t	*offload;	//!< This worker's view of the offload pool.
 } rlm_winbind_thread_t;
 
 typedef struct {
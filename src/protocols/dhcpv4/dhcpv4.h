@@ -213,6 +213,16 @@ int		fr_dhcpv4_raw_packet_send(int sockfd, struct sockaddr_ll *p_ll,
 
 fr_packet_t	*fr_dhcpv4_raw_packet_recv(int sockfd, struct sockaddr_ll *p_ll,
 						  fr_packet_t *request, fr_pair_list_t *list);
+
+typedef struct fr_dhcpv4_raw_ring_s fr_dhcpv4_raw_ring_t;
+
+fr_dhcpv4_raw_ring_t *fr_dhcpv4_raw_ring_alloc(TALLOC_CTX *ctx, struct sockaddr_ll *p_ll, int iface_index);
+
+int		fr_dhcpv4_raw_ring_fd(fr_dhcpv4_raw_ring_t const *ring);
+
+int		fr_dhcpv4_raw_ring_send(fr_dhcpv4_raw_ring_t *ring, fr_packet_t *packet, fr_pair_list_t *list);
+
+fr_packet_t	*fr_dhcpv4_raw_ring_recv(fr_dhcpv4_raw_ring_t *ring, fr_packet_t *request, fr_pair_list_t *list);
 #endif
 
 /*
@@ -33,6 +33,7 @@
 #include <freeradius-devel/util/udpfromto.h>
 
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 
 #ifdef HAVE_SYS_SOCKET_H
 #endif
@@ -41,6 +42,7 @@
 
 #ifdef HAVE_LINUX_IF_PACKET_H
 #  include <linux/if_ether.h>
+#  include <linux/filter.h>
 #endif
 
 #include <net/if_arp.h>
@@ -88,30 +90,34 @@ int fr_dhcpv4_raw_socket_open(struct sockaddr_ll *link_layer, int ifindex)
 	return fd;
 }
 
-/** Create the requisite L2/L3 headers, and write a DHCPv4 packet to a raw socket
+/** Create the requisite L2/L3 headers, and write them and a DHCPv4 packet to a buffer
  *
- * @param[in] sockfd		to write to.
- * @param[in] link_layer	information, as returned by fr_dhcpv4_raw_socket_open.
+ * @param[out] frame		to write the ethernet frame to.
+ * @param[in] frame_len		size of the frame buffer.
  * @param[in] packet		to write.
- * @param[in] list		to send.
+ * @param[in] list		to take the Client-Hardware-Address from.
  * @return
- *	- 0 on success.
- *	- -1 on failure.
+ *	- >0 the length of the frame.
+ *	- -1 if the frame buffer is too small.
  */
-int fr_dhcpv4_raw_packet_send(int sockfd, struct sockaddr_ll *link_layer,
-			      fr_packet_t *packet, fr_pair_list_t *list)
+static ssize_t raw_packet_build(uint8_t *frame, size_t frame_len, fr_packet_t *packet, fr_pair_list_t *list)
 {
-	uint8_t			dhcp_packet[1518] = { 0 };
-	ethernet_header_t	*eth_hdr = (ethernet_header_t *)dhcp_packet;
-	ip_header_t		*ip_hdr = (ip_header_t *)(dhcp_packet + ETH_HDR_SIZE);
-	udp_header_t		*udp_hdr = (udp_header_t *) (dhcp_packet + ETH_HDR_SIZE + IP_HDR_SIZE);
-	dhcp_packet_t		*dhcp = (dhcp_packet_t *)(dhcp_packet + ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE);
+	ethernet_header_t	*eth_hdr = (ethernet_header_t *)frame;
+	ip_header_t		*ip_hdr = (ip_header_t *)(frame + ETH_HDR_SIZE);
+	udp_header_t		*udp_hdr = (udp_header_t *) (frame + ETH_HDR_SIZE + IP_HDR_SIZE);
+	dhcp_packet_t		*dhcp = (dhcp_packet_t *)(frame + ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE);
 
 	uint16_t		l4_len = (UDP_HDR_SIZE + packet->data_len);
 	fr_pair_t		*vp;
+	uint8_t			dhmac[ETH_ADDR_LEN] = { 0 };
+
+	if ((ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE + packet->data_len) > frame_len) {
+		fr_strerror_printf("DHCP packet is too large (%zu > %zu)",
+				   packet->data_len, frame_len - (ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE));
+		return -1;
+	}
 
 	/* set ethernet source address to our MAC address (Client-Hardware-Address). */
-	uint8_t dhmac[ETH_ADDR_LEN] = { 0 };
 	if ((vp = fr_pair_find_by_da(list, NULL, attr_dhcp_client_hardware_address))) {
 		if (vp->vp_type == FR_TYPE_ETHERNET) memcpy(dhmac, vp->vp_ether, sizeof(vp->vp_ether));
 	}
@@ -152,66 +158,70 @@ int fr_dhcpv4_raw_packet_send(int sockfd, struct sockaddr_ll *link_layer,
 	memcpy(dhcp, packet->data, packet->data_len);
 
 	/* UDP checksum is done here */
-	udp_hdr->checksum = fr_udp_checksum((uint8_t const *)(dhcp_packet + ETH_HDR_SIZE + IP_HDR_SIZE),
+	udp_hdr->checksum = fr_udp_checksum((uint8_t const *)(frame + ETH_HDR_SIZE + IP_HDR_SIZE),
 					    l4_len, udp_hdr->checksum,
 					    packet->socket.inet.src_ipaddr.addr.v4, packet->socket.inet.dst_ipaddr.addr.v4);
 
-	return sendto(sockfd, dhcp_packet, (ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE + packet->data_len),
+	return ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE + packet->data_len;
+}
+
+/** Create the requisite L2/L3 headers, and write a DHCPv4 packet to a raw socket
+ *
+ * @param[in] sockfd		to write to.
+ * @param[in] link_layer	information, as returned by fr_dhcpv4_raw_socket_open.
+ * @param[in] packet		to write.
+ * @param[in] list		to send.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_dhcpv4_raw_packet_send(int sockfd, struct sockaddr_ll *link_layer,
+			      fr_packet_t *packet, fr_pair_list_t *list)
+{
+	uint8_t			dhcp_packet[1518] = { 0 };
+	ssize_t			frame_len;
+
+	frame_len = raw_packet_build(dhcp_packet, sizeof(dhcp_packet), packet, list);
+	if (frame_len < 0) return -1;
+
+	return sendto(sockfd, dhcp_packet, frame_len,
 		      0, (struct sockaddr *) link_layer, sizeof(struct sockaddr_ll));
 }
 
-/*
- *	For a client, receive a DHCP packet from a raw packet
- *	socket. Make sure it matches the ongoing request.
+/** Check a received ethernet frame is a DHCP reply matching the ongoing request
  *
- *	FIXME: split this into two, recv_raw_packet, and verify(packet, original)
+ * On success packet->data points into the frame, so the frame must
+ * outlive any use of the packet data.
+ *
+ * @param[in] packet		to populate.  Freed if the frame is discarded.
+ * @param[in] raw_packet	the ethernet frame.
+ * @param[in] data_len		length of the ethernet frame.
+ * @param[in] request		we're expecting a reply to.
+ * @param[in] list		of attributes in the request.
+ * @return
+ *	- The populated packet.
+ *	- NULL if the frame was discarded.
  */
-fr_packet_t *fr_dhcpv4_raw_packet_recv(int sockfd, struct sockaddr_ll *link_layer,
-					     fr_packet_t *request, fr_pair_list_t *list)
+static fr_packet_t *raw_packet_parse(fr_packet_t *packet, uint8_t const *raw_packet, ssize_t data_len,
+				     fr_packet_t *request, fr_pair_list_t *list)
 {
 	fr_pair_t		*vp;
-	fr_packet_t		*packet;
-	dhcp_packet_t		*dhcp_data;
 	uint8_t const		*code;
 	uint32_t		magic, xid;
-	ssize_t			data_len;
 
-	uint8_t			*raw_packet;
-	ethernet_header_t	*eth_hdr;
-	ip_header_t		*ip_hdr;
-	udp_header_t		*udp_hdr;
-	dhcp_packet_t		*dhcp_hdr;
-	uint16_t		udp_src_port;
-	uint16_t		udp_dst_port;
+	ethernet_header_t const	*eth_hdr;
+	ip_header_t const	*ip_hdr;
+	udp_header_t const	*udp_hdr;
+	dhcp_packet_t const	*dhcp_hdr;
 	size_t			dhcp_data_len;
-	socklen_t		sock_len;
 	uint8_t			data_offset;
 
-	packet = fr_packet_alloc(NULL, false);
-	if (!packet) {
-		fr_strerror_const("Failed allocating packet");
-		return NULL;
-	}
-
-	raw_packet = talloc_zero_array(packet, uint8_t, MAX_PACKET_SIZE);
-	if (!raw_packet) {
-		fr_strerror_const("Out of memory");
-		fr_packet_free(&packet);
-		return NULL;
-	}
-
-	packet->socket.fd = sockfd;
-
-	/* a packet was received (but maybe it is not for us) */
-	sock_len = sizeof(struct sockaddr_ll);
-	data_len = recvfrom(sockfd, raw_packet, MAX_PACKET_SIZE, 0, (struct sockaddr *)link_layer, &sock_len);
-
 	data_offset = ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE; /* DHCP data after Ethernet, IP, UDP */
 
 	if (data_len <= data_offset) DISCARD_RP("Payload (%d) smaller than required for layers 2+3+4", (int)data_len);
 
 	/* map raw packet to packet header of the different layers (Ethernet, IP, UDP) */
-	eth_hdr = (ethernet_header_t *)raw_packet;
+	eth_hdr = (ethernet_header_t const *)raw_packet;
 
 	/*
 	 *	Check Ethernet layer data (L2)
@@ -235,7 +245,7 @@ fr_packet_t *fr_dhcpv4_raw_packet_recv(int sockfd, struct sockaddr_ll *link_laye
 	/*
 	 *	Ethernet is OK.  Now look at IP.
 	 */
-	ip_hdr = (ip_header_t *)(raw_packet + ETH_HDR_SIZE);
+	ip_hdr = (ip_header_t const *)(raw_packet + ETH_HDR_SIZE);
 
 	/*
 	 *	Check IPv4 layer data (L3)
@@ -251,13 +261,7 @@ fr_packet_t *fr_dhcpv4_raw_packet_recv(int sockfd, struct sockaddr_ll *link_laye
 	/*
 	 *	Now check UDP.
 	 */
-	udp_hdr = (udp_header_t *)(raw_packet + ETH_HDR_SIZE + IP_HDR_SIZE);
-
-	/*
-	 *	Check UDP layer data (L4)
-	 */
-	udp_src_port = ntohs(udp_hdr->src);
-	udp_dst_port = ntohs(udp_hdr->dst);
+	udp_hdr = (udp_header_t const *)(raw_packet + ETH_HDR_SIZE + IP_HDR_SIZE);
 
 	/*
 	 *	Check DHCP layer data
@@ -269,7 +273,7 @@ fr_packet_t *fr_dhcpv4_raw_packet_recv(int sockfd, struct sockaddr_ll *link_laye
 	if (dhcp_data_len > MAX_PACKET_SIZE) DISCARD_RP("DHCP packet is too large (%zu > %i)",
 							dhcp_data_len, MAX_PACKET_SIZE);
 
-	dhcp_hdr = (dhcp_packet_t *)(raw_packet + ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE);
+	dhcp_hdr = (dhcp_packet_t const *)(raw_packet + data_offset);
 
 	if (dhcp_hdr->htype != 1) DISCARD_RP("DHCP hardware type (%d) != Ethernet (1)", dhcp_hdr->htype);
 	if (dhcp_hdr->hlen != 6) DISCARD_RP("DHCP hardware address length (%d) != 6", dhcp_hdr->hlen);
@@ -288,21 +292,8 @@ fr_packet_t *fr_dhcpv4_raw_packet_recv(int sockfd, struct sockaddr_ll *link_laye
 
 	/*
 	 *	all checks ok! this is a DHCP reply we're interested in.
-	 *
-	 * 	dhcp_data is present to avoid what appears to coverity
-	 * 	to be a cast from a less aligned type to a more aligned
-	 * 	type in the fr_dhcpv4_packet_get_option() call, even though
-	 * 	talloc_memdup() returns a pointer aligned to TALLOC_ALIGN
-	 * 	bytes.
 	 */
-	packet->data_len = dhcp_data_len;
-	dhcp_data = talloc_memdup(packet, raw_packet + data_offset, dhcp_data_len);
-	packet->data = (uint8_t *) dhcp_data;
-	TALLOC_FREE(raw_packet);
-	packet->id = xid;
-
-	code = fr_dhcpv4_packet_get_option((dhcp_packet_t const *)dhcp_data,
-					   packet->data_len, attr_dhcp_message_type);
+	code = fr_dhcpv4_packet_get_option(dhcp_hdr, dhcp_data_len, attr_dhcp_message_type);
 	if (!code) {
 		fr_strerror_const("No message-type option was found in the packet");
 		fr_packet_free(&packet);
@@ -315,10 +306,13 @@ fr_packet_t *fr_dhcpv4_raw_packet_recv(int sockfd, struct sockaddr_ll *link_laye
 		return NULL;
 	}
 
+	packet->data = UNCONST(uint8_t *, raw_packet + data_offset);
+	packet->data_len = dhcp_data_len;
+	packet->id = xid;
 	packet->code = code[2];
 
-	packet->socket.inet.src_port = udp_src_port;
-	packet->socket.inet.dst_port = udp_dst_port;
+	packet->socket.inet.src_port = ntohs(udp_hdr->src);
+	packet->socket.inet.dst_port = ntohs(udp_hdr->dst);
 
 	packet->socket.inet.src_ipaddr.af = AF_INET;
 	packet->socket.inet.src_ipaddr.addr.v4.s_addr = ip_hdr->ip_src.s_addr;
@@ -327,4 +321,402 @@ fr_packet_t *fr_dhcpv4_raw_packet_recv(int sockfd, struct sockaddr_ll *link_laye
 
 	return packet;
 }
+
+/*
+ *	For a client, receive a DHCP packet from a raw packet
+ *	socket. Make sure it matches the ongoing request.
+ */
+fr_packet_t *fr_dhcpv4_raw_packet_recv(int sockfd, struct sockaddr_ll *link_layer,
+					     fr_packet_t *request, fr_pair_list_t *list)
+{
+	fr_packet_t		*packet;
+	uint8_t			*raw_packet;
+	ssize_t			data_len;
+	socklen_t		sock_len;
+
+	packet = fr_packet_alloc(NULL, false);
+	if (!packet) {
+		fr_strerror_const("Failed allocating packet");
+		return NULL;
+	}
+
+	raw_packet = talloc_zero_array(packet, uint8_t, MAX_PACKET_SIZE);
+	if (!raw_packet) {
+		fr_strerror_const("Out of memory");
+		fr_packet_free(&packet);
+		return NULL;
+	}
+
+	packet->socket.fd = sockfd;
+
+	/* a packet was received (but maybe it is not for us) */
+	sock_len = sizeof(struct sockaddr_ll);
+	data_len = recvfrom(sockfd, raw_packet, MAX_PACKET_SIZE, 0, (struct sockaddr *)link_layer, &sock_len);
+
+	packet = raw_packet_parse(packet, raw_packet, data_len, request, list);
+	if (!packet) return NULL;
+
+	/*
+	 * 	The copy is present to avoid what appears to coverity
+	 * 	to be a cast from a less aligned type to a more aligned
+	 * 	type in the fr_dhcpv4_packet_get_option() call, even though
+	 * 	talloc_memdup() returns a pointer aligned to TALLOC_ALIGN
+	 * 	bytes.
+	 */
+	packet->data = talloc_memdup(packet, packet->data, packet->data_len);
+	TALLOC_FREE(raw_packet);
+
+	return packet;
+}
+
+#ifdef TPACKET3_HDRLEN
+/*
+ *	Ring geometry.  The RX ring is made of blocks which the kernel
+ *	fills with as many frames as will fit, and hands to us either
+ *	when full, or when the retire timeout expires.  The TX ring is
+ *	a flat array of fixed size frames.
+ */
+#define RAW_RING_BLOCK_SIZE	(1 << 16)
+#define RAW_RING_FRAME_SIZE	(1 << 11)
+#define RAW_RING_RX_BLOCKS	64
+#define RAW_RING_TX_BLOCKS	4
+#define RAW_RING_RETIRE_MS	10
+
+/** Offset of frame data in a TX ring slot
+ *
+ * The kernel reads frame data from directly after the aligned
+ * tpacket3_hdr, unless PACKET_TX_HAS_OFF is set.
+ */
+#define RAW_RING_TX_DATA_OFFSET	TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+/** A PF_PACKET socket with memory mapped RX and TX rings
+ *
+ */
+struct fr_dhcpv4_raw_ring_s {
+	int			fd;			//!< PF_PACKET socket.
+	struct sockaddr_ll	*link_layer;		//!< Passed to sendto() when flushing the TX ring.
+
+	uint8_t			*map;			//!< Start of the mmapped region.
+	size_t			map_len;		//!< Length of the mmapped region.
+
+	struct tpacket_req3	rx_req;			//!< RX ring geometry.
+	uint32_t		rx_block;		//!< Current RX block.
+	uint32_t		rx_pkts_left;		//!< Frames left to process in the current block.
+	struct tpacket3_hdr	*rx_frame;		//!< Next frame to process in the current block.
+	bool			rx_release;		//!< Current block should be handed back to the kernel.
+
+	uint8_t			*tx;			//!< Start of the TX ring, or NULL if there isn't one.
+	struct tpacket_req3	tx_req;			//!< TX ring geometry.
+	uint32_t		tx_frame;		//!< Next TX frame to use.
+};
+
+/** Kernel filter which only accepts non-fragmented IPv4 UDP packets to or from port 67 or 68
+ *
+ * Equivalent to "ip and udp and not ip[6:2] & 0x1fff != 0 and (port 67 or port 68)".
+ */
+static struct sock_filter const raw_ring_filter[] = {
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),			/* ethertype */
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_TYPE_IP, 0, 11),
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),			/* IP protocol */
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 9),
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),			/* fragment offset */
+	BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 7, 0),
+	BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, ETH_HDR_SIZE),	/* IP header length */
+	BPF_STMT(BPF_LD | BPF_H | BPF_IND, ETH_HDR_SIZE),	/* UDP source port */
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 67, 5, 0),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 68, 4, 0),
+	BPF_STMT(BPF_LD | BPF_H | BPF_IND, ETH_HDR_SIZE + 2),	/* UDP destination port */
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 67, 2, 0),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 68, 1, 0),
+	BPF_STMT(BPF_RET | BPF_K, 0),				/* drop */
+	BPF_STMT(BPF_RET | BPF_K, 0x40000),			/* accept */
+};
+
+static int _raw_ring_free(fr_dhcpv4_raw_ring_t *ring)
+{
+	if (ring->map) munmap(ring->map, ring->map_len);
+	if (ring->fd >= 0) close(ring->fd);
+
+	return 0;
+}
+
+/** Open a PF_PACKET socket with memory mapped RX and TX rings
+ *
+ * A kernel filter is attached so that only DHCP traffic is copied into
+ * the RX ring.  If the kernel doesn't support a TPACKET_V3 TX ring,
+ * packets are sent with sendto() instead.
+ *
+ * @param[in] ctx		to allocate the ring in.
+ * @param[out] link_layer	A sockaddr_ll struct to populate.  Must remain valid
+ *				for the lifetime of the ring.
+ * @param[in] ifindex		of the interface we're binding to.
+ * @return
+ *	- A new ring.
+ *	- NULL on error.
+ */
+fr_dhcpv4_raw_ring_t *fr_dhcpv4_raw_ring_alloc(TALLOC_CTX *ctx, struct sockaddr_ll *link_layer, int ifindex)
+{
+	fr_dhcpv4_raw_ring_t	*ring;
+	int			version = TPACKET_V3;
+	struct sock_fprog	fprog = {
+					.len = NUM_ELEMENTS(raw_ring_filter),
+					.filter = UNCONST(struct sock_filter *, raw_ring_filter)
+				};
+	size_t			rx_len, tx_len = 0;
+
+	ring = talloc_zero(ctx, fr_dhcpv4_raw_ring_t);
+	if (!ring) {
+		fr_strerror_const("Out of memory");
+		return NULL;
+	}
+	ring->fd = -1;
+	ring->link_layer = link_layer;
+	talloc_set_destructor(ring, _raw_ring_free);
+
+	/*
+	 *	Open the socket without a protocol, so nothing is
+	 *	queued before the filter is attached.
+	 */
+	ring->fd = socket(PF_PACKET, SOCK_RAW, 0);
+	if (ring->fd < 0) {
+		fr_strerror_printf("Cannot open socket: %s", fr_syserror(errno));
+	error:
+		talloc_free(ring);
+		return NULL;
+	}
+
+	if (setsockopt(ring->fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0) {
+		fr_strerror_printf("Cannot attach DHCP filter: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+		fr_strerror_printf("Cannot set TPACKET_V3: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	ring->rx_req = (struct tpacket_req3) {
+		.tp_block_size = RAW_RING_BLOCK_SIZE,
+		.tp_block_nr = RAW_RING_RX_BLOCKS,
+		.tp_frame_size = RAW_RING_FRAME_SIZE,
+		.tp_frame_nr = (RAW_RING_BLOCK_SIZE / RAW_RING_FRAME_SIZE) * RAW_RING_RX_BLOCKS,
+		.tp_retire_blk_tov = RAW_RING_RETIRE_MS
+	};
+	if (setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &ring->rx_req, sizeof(ring->rx_req)) < 0) {
+		fr_strerror_printf("Cannot create RX ring: %s", fr_syserror(errno));
+		goto error;
+	}
+	rx_len = (size_t)ring->rx_req.tp_block_size * ring->rx_req.tp_block_nr;
+
+	/*
+	 *	TPACKET_V3 TX rings need Linux >= 4.11.  Without one
+	 *	we fall back to sendto().
+	 */
+	ring->tx_req = (struct tpacket_req3) {
+		.tp_block_size = RAW_RING_BLOCK_SIZE,
+		.tp_block_nr = RAW_RING_TX_BLOCKS,
+		.tp_frame_size = RAW_RING_FRAME_SIZE,
+		.tp_frame_nr = (RAW_RING_BLOCK_SIZE / RAW_RING_FRAME_SIZE) * RAW_RING_TX_BLOCKS
+	};
+	if (setsockopt(ring->fd, SOL_PACKET, PACKET_TX_RING, &ring->tx_req, sizeof(ring->tx_req)) == 0) {
+		tx_len = (size_t)ring->tx_req.tp_block_size * ring->tx_req.tp_block_nr;
+	}
+
+	ring->map_len = rx_len + tx_len;
+	ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, ring->fd, 0);
+	if (ring->map == MAP_FAILED) {
+		/*
+		 *	MAP_LOCKED fails without CAP_IPC_LOCK
+		 *	or a large enough RLIMIT_MEMLOCK.
+		 */
+		ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+		if (ring->map == MAP_FAILED) {
+			ring->map = NULL;
+			fr_strerror_printf("Cannot map packet rings: %s", fr_syserror(errno));
+			goto error;
+		}
+	}
+	if (tx_len) ring->tx = ring->map + rx_len;
+
+	/* Set link layer parameters */
+	memset(link_layer, 0, sizeof(struct sockaddr_ll));
+
+	link_layer->sll_family = AF_PACKET;
+	link_layer->sll_protocol = htons(ETH_P_IP);
+	link_layer->sll_ifindex = ifindex;
+	link_layer->sll_hatype = ARPHRD_ETHER;
+	link_layer->sll_pkttype = PACKET_OTHERHOST;
+	link_layer->sll_halen = 6;
+
+	if (bind(ring->fd, (struct sockaddr *)link_layer, sizeof(struct sockaddr_ll)) < 0) {
+		fr_strerror_printf("Cannot bind raw socket: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	return ring;
+}
+
+/** Return the file descriptor of a ring, for use with select/poll/kevent
+ *
+ */
+int fr_dhcpv4_raw_ring_fd(fr_dhcpv4_raw_ring_t const *ring)
+{
+	return ring->fd;
+}
+
+/** Write a DHCPv4 packet directly into the TX ring, and ask the kernel to send it
+ *
+ * @param[in] ring		to write to.
+ * @param[in] packet		to write.
+ * @param[in] list		to take the Client-Hardware-Address from.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_dhcpv4_raw_ring_send(fr_dhcpv4_raw_ring_t *ring, fr_packet_t *packet, fr_pair_list_t *list)
+{
+	struct tpacket3_hdr	*hdr;
+	ssize_t			frame_len;
+
+	if (!ring->tx) return fr_dhcpv4_raw_packet_send(ring->fd, ring->link_layer, packet, list);
+
+	hdr = (struct tpacket3_hdr *)(ring->tx + ((size_t)ring->tx_frame * ring->tx_req.tp_frame_size));
+
+	/*
+	 *	All frames in use.  The kernel hasn't caught up with
+	 *	the previous sends.
+	 */
+	if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+		fr_strerror_const("TX ring full");
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	frame_len = raw_packet_build((uint8_t *)hdr + RAW_RING_TX_DATA_OFFSET,
+				     ring->tx_req.tp_frame_size - RAW_RING_TX_DATA_OFFSET, packet, list);
+	if (frame_len < 0) return -1;
+
+	hdr->tp_len = frame_len;
+	hdr->tp_next_offset = 0;
+	__atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+	ring->tx_frame = (ring->tx_frame + 1) % ring->tx_req.tp_frame_nr;
+
+	if (sendto(ring->fd, NULL, 0, 0, (struct sockaddr *)ring->link_layer, sizeof(struct sockaddr_ll)) < 0) {
+		fr_strerror_printf("Failed flushing TX ring: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Return the header of an RX block
+ *
+ */
+static inline struct tpacket_block_desc *raw_ring_block(fr_dhcpv4_raw_ring_t *ring, uint32_t block)
+{
+	return (struct tpacket_block_desc *)(ring->map + ((size_t)block * ring->rx_req.tp_block_size));
+}
+
+/** Receive the next DHCP reply matching the ongoing request from the RX ring
+ *
+ * The returned packet's data points directly into the ring, and is only
+ * valid until the next call to this function, or until the ring is freed.
+ * Callers that need the data for longer must copy it.
+ *
+ * @param[in] ring		to read from.
+ * @param[in] request		we're expecting a reply to.
+ * @param[in] list		of attributes in the request.
+ * @return
+ *	- A reply packet.
+ *	- NULL if there are no more matching frames available.
+ */
+fr_packet_t *fr_dhcpv4_raw_ring_recv(fr_dhcpv4_raw_ring_t *ring, fr_packet_t *request, fr_pair_list_t *list)
+{
+	struct tpacket_block_desc	*block;
+	struct tpacket3_hdr		*frame;
+	fr_packet_t			*packet;
+
+	for (;;) {
+		block = raw_ring_block(ring, ring->rx_block);
+
+		/*
+		 *	We're done with the current block, which
+		 *	includes the data of the last packet we
+		 *	returned.  Give it back to the kernel.
+		 */
+		if (ring->rx_release) {
+			__atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+			ring->rx_release = false;
+			ring->rx_block = (ring->rx_block + 1) % ring->rx_req.tp_block_nr;
+			continue;
+		}
+
+		/*
+		 *	Start a new block, if the kernel has given
+		 *	it to us.
+		 */
+		if (!ring->rx_frame) {
+			if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+				return NULL;
+			}
+
+			ring->rx_pkts_left = block->hdr.bh1.num_pkts;
+			ring->rx_frame = (struct tpacket3_hdr *)((uint8_t *)block + block->hdr.bh1.offset_to_first_pkt);
+		}
+
+		if (ring->rx_pkts_left == 0) {
+			ring->rx_frame = NULL;
+			ring->rx_release = true;
+			continue;
+		}
+
+		frame = ring->rx_frame;
+		ring->rx_pkts_left--;
+		ring->rx_frame = (struct tpacket3_hdr *)((uint8_t *)frame + frame->tp_next_offset);
+
+		packet = fr_packet_alloc(NULL, false);
+		if (!packet) {
+			fr_strerror_const("Failed allocating packet");
+			return NULL;
+		}
+		packet->socket.fd = ring->fd;
+
+		/*
+		 *	The kernel aligns the network header on
+		 *	a 16 byte boundary, so the DHCP header
+		 *	is naturally aligned.
+		 */
+		packet = raw_packet_parse(packet, (uint8_t const *)frame + frame->tp_mac, frame->tp_snaplen,
+					  request, list);
+		if (packet) return packet;
+	}
+}
+#else
+fr_dhcpv4_raw_ring_t *fr_dhcpv4_raw_ring_alloc(UNUSED TALLOC_CTX *ctx, UNUSED struct sockaddr_ll *link_layer,
+					       UNUSED int ifindex)
+{
+	fr_strerror_const("TPACKET_V3 is not supported on this system");
+	return NULL;
+}
+
+int fr_dhcpv4_raw_ring_fd(UNUSED fr_dhcpv4_raw_ring_t const *ring)
+{
+	return -1;
+}
+
+int fr_dhcpv4_raw_ring_send(UNUSED fr_dhcpv4_raw_ring_t *ring, UNUSED fr_packet_t *packet,
+			    UNUSED fr_pair_list_t *list)
+{
+	fr_strerror_const("TPACKET_V3 is not supported on this system");
+	return -1;
+}
+
+fr_packet_t *fr_dhcpv4_raw_ring_recv(UNUSED fr_dhcpv4_raw_ring_t *ring, UNUSED fr_packet_t *request,
+				     UNUSED fr_pair_list_t *list)
+{
+	fr_strerror_const("TPACKET_V3 is not supported on this system");
+	return NULL;
+}
+#endif	/* TPACKET3_HDRLEN */
 #endif
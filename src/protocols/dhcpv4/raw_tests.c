@@ -0,0 +1,218 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for DHCPv4 raw socket and packet ring I/O
+ *
+ * @file src/protocols/dhcpv4/raw_tests.c
+ *
+ * @copyright 2025 The FreeRADIUS server project
+ */
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include "raw.c"
+
+#include <net/if.h>
+#include <poll.h>
+
+#define TEST_XID	0x12345678
+
+static TALLOC_CTX	*autofree;
+
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("raw_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_dict_global_ctx_init(autofree, true, TEST_DICT_DIR) == NULL) goto error;
+	if (fr_dhcpv4_global_init() < 0) goto error;
+}
+
+#ifdef HAVE_LINUX_IF_PACKET_H
+/** Build a minimal DHCP-Discover, sent from port 68 to port 67
+ *
+ */
+static fr_packet_t *discover_alloc(TALLOC_CTX *ctx, uint32_t xid)
+{
+	fr_packet_t	*packet;
+	dhcp_packet_t	*dhcp;
+
+	packet = fr_packet_alloc(ctx, false);
+	packet->data_len = 300;
+	packet->data = talloc_zero_array(packet, uint8_t, packet->data_len);
+	packet->id = xid;
+
+	dhcp = (dhcp_packet_t *)packet->data;
+	dhcp->opcode = 1;
+	dhcp->htype = 1;
+	dhcp->hlen = 6;
+	dhcp->xid = htonl(xid);
+	dhcp->option_format = htonl(DHCP_OPTION_MAGIC_NUMBER);
+	dhcp->options[0] = FR_MESSAGE_TYPE;
+	dhcp->options[1] = 1;
+	dhcp->options[2] = FR_DHCP_DISCOVER;
+	dhcp->options[3] = 255;
+
+	packet->socket.inet.src_ipaddr.af = AF_INET;
+	packet->socket.inet.src_ipaddr.addr.v4.s_addr = htonl(INADDR_ANY);
+	packet->socket.inet.dst_ipaddr.af = AF_INET;
+	packet->socket.inet.dst_ipaddr.addr.v4.s_addr = htonl(INADDR_BROADCAST);
+	packet->socket.inet.src_port = 68;
+	packet->socket.inet.dst_port = 67;
+
+	return packet;
+}
+
+/** A frame built for sending is accepted by the receive checks
+ *
+ */
+static void test_build_parse(void)
+{
+	fr_packet_t	*request, *packet;
+	fr_pair_list_t	list;
+	uint8_t		frame[1518];
+	ssize_t		frame_len;
+
+	fr_pair_list_init(&list);
+	request = discover_alloc(autofree, TEST_XID);
+
+	frame_len = raw_packet_build(frame, sizeof(frame), request, &list);
+	TEST_CHECK(frame_len == (ssize_t)(ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE + request->data_len));
+
+	packet = raw_packet_parse(fr_packet_alloc(autofree, false), frame, frame_len, request, &list);
+	TEST_ASSERT(packet != NULL);
+
+	TEST_CHECK(packet->data_len == request->data_len);
+	TEST_CHECK(memcmp(packet->data, request->data, request->data_len) == 0);
+	TEST_CHECK(packet->id == TEST_XID);
+	TEST_CHECK(packet->code == FR_DHCP_DISCOVER);
+	TEST_CHECK(packet->socket.inet.src_port == 68);
+	TEST_CHECK(packet->socket.inet.dst_port == 67);
+	TEST_CHECK(packet->socket.inet.dst_ipaddr.addr.v4.s_addr == htonl(INADDR_BROADCAST));
+
+	talloc_free(packet);
+	talloc_free(request);
+}
+
+/** Frames which aren't replies to the request are discarded
+ *
+ */
+static void test_parse_discard(void)
+{
+	fr_packet_t	*request, *other;
+	fr_pair_list_t	list;
+	uint8_t		frame[1518];
+	ssize_t		frame_len;
+
+	fr_pair_list_init(&list);
+	request = discover_alloc(autofree, TEST_XID);
+
+	/*
+	 *	Wrong transaction ID
+	 */
+	other = discover_alloc(autofree, TEST_XID + 1);
+	frame_len = raw_packet_build(frame, sizeof(frame), other, &list);
+	TEST_CHECK(raw_packet_parse(fr_packet_alloc(autofree, false), frame, frame_len, request, &list) == NULL);
+	talloc_free(other);
+
+	/*
+	 *	Truncated
+	 */
+	frame_len = raw_packet_build(frame, sizeof(frame), request, &list);
+	TEST_CHECK(raw_packet_parse(fr_packet_alloc(autofree, false), frame,
+				    ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE + MIN_PACKET_SIZE - 1,
+				    request, &list) == NULL);
+
+	/*
+	 *	Not IP
+	 */
+	frame[12] = 0x86;
+	frame[13] = 0xdd;
+	TEST_CHECK(raw_packet_parse(fr_packet_alloc(autofree, false), frame, frame_len, request, &list) == NULL);
+
+	/*
+	 *	Doesn't fit in the frame
+	 */
+	TEST_CHECK(raw_packet_build(frame, ETH_HDR_SIZE + IP_HDR_SIZE + UDP_HDR_SIZE + request->data_len - 1,
+				    request, &list) < 0);
+
+	talloc_free(request);
+}
+
+#  ifdef TPACKET3_HDRLEN
+/** Send a packet through the TX ring on the loopback interface, and receive it through the RX ring
+ *
+ * Needs CAP_NET_RAW, so it's skipped if the ring can't be created.
+ */
+static void test_ring_loopback(void)
+{
+	fr_dhcpv4_raw_ring_t	*ring;
+	struct sockaddr_ll	ll;
+	fr_packet_t		*request, *reply = NULL;
+	fr_pair_list_t		list;
+	struct pollfd		pfd;
+	int			ifindex, i;
+
+	ifindex = if_nametoindex("lo");
+	TEST_ASSERT(ifindex > 0);
+
+	ring = fr_dhcpv4_raw_ring_alloc(autofree, &ll, ifindex);
+	if (!ring) {
+		TEST_MSG_ALWAYS("Skipping, can't create packet ring: %s", fr_strerror());
+		return;
+	}
+
+	fr_pair_list_init(&list);
+	request = discover_alloc(ring, TEST_XID);
+
+	TEST_CHECK(fr_dhcpv4_raw_ring_send(ring, request, &list) == 0);
+	TEST_MSG("send failed: %s", fr_strerror());
+
+	pfd = (struct pollfd) { .fd = fr_dhcpv4_raw_ring_fd(ring), .events = POLLIN };
+	for (i = 0; (i < 20) && !reply; i++) {
+		if (poll(&pfd, 1, 100) < 0) break;
+		reply = fr_dhcpv4_raw_ring_recv(ring, request, &list);
+	}
+	TEST_ASSERT(reply != NULL);
+
+	TEST_CHECK(reply->id == TEST_XID);
+	TEST_CHECK(reply->code == FR_DHCP_DISCOVER);
+	TEST_CHECK(reply->data_len == request->data_len);
+	TEST_CHECK(memcmp(reply->data, request->data, request->data_len) == 0);
+
+	fr_packet_free(&reply);
+	talloc_free(ring);
+}
+#  endif
+#endif
+
+TEST_LIST = {
+#ifdef HAVE_LINUX_IF_PACKET_H
+	{ "build_parse",		test_build_parse },
+	{ "parse_discard",		test_parse_discard },
+#  ifdef TPACKET3_HDRLEN
+	{ "ring_loopback",		test_ring_loopback },
+#  endif
+#endif
+	{ NULL }
+};
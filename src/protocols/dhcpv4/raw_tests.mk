@@ -0,0 +1,9 @@
+TARGET		:= raw_tests$(E)
+SOURCES		:= raw_tests.c
+
+SRC_CFLAGS	:= -I$(top_builddir)/src -DNO_ASSERT -DTEST_DICT_DIR=\"$(top_srcdir)/share/dictionary\"
+TGT_LDLIBS	:= $(LIBS) $(PCAP_LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(PCAP_LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-dhcpv4$(L)
+
+TGT_INSTALLDIR	:=
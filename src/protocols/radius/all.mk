@@ -1 +1 @@
-SUBMAKEFILES := libfreeradius-radius.mk libfreeradius-radius-bio.mk
+SUBMAKEFILES := libfreeradius-radius.mk libfreeradius-radius-bio.mk lazy_decode_perf_test.mk
@@ -1083,12 +1083,153 @@ ssize_t fr_radius_encode(fr_dbuff_t *dbuff, fr_pair_list_t *vps, fr_radius_encod
 	return fr_dbuff_set(dbuff, &work_dbuff);
 }
 
+/** Vendor-Specific attributes which haven't been decoded yet
+ *
+ */
+typedef struct {
+	fr_pair_list_lazy_t	lazy;			//!< Must be first.
+
+	TALLOC_CTX		*ctx;			//!< To allocate the pairs in.
+	uint8_t const		*packet;		//!< Copy of the packet to decode from.
+	uint8_t const		*end;			//!< End of the packet.
+
+	fr_radius_ctx_t		common;			//!< With our own copy of the secret.
+	uint8_t			request_authenticator[RADIUS_AUTH_VECTOR_LENGTH];
+	uint8_t			request_code;
+	bool			tunnel_password_zeros;
+
+	unsigned int		num;			//!< Number of Vendor-Specific attributes.
+	uint16_t		offset[];		//!< Of each Vendor-Specific attribute in the packet.
+} fr_radius_lazy_t;
+
+/** Decode the Vendor-Specific attributes which were skipped by fr_radius_decode()
+ *
+ * All of them are decoded at once, as they all go into the same
+ * Vendor-Specific group.
+ */
+static int radius_lazy_decode(fr_pair_list_t *list, fr_dict_attr_t const *da, fr_pair_list_lazy_t *lazy_hdr)
+{
+	fr_radius_lazy_t	*lazy = talloc_get_type_abort(lazy_hdr, fr_radius_lazy_t);
+	fr_radius_decode_ctx_t	decode_ctx;
+	uint8_t const		*attr, *next = NULL;
+	unsigned int		i;
+	int			ret = 0;
+
+	/*
+	 *	Nothing we have can match attributes which aren't
+	 *	Vendor-Specific, or children of it.
+	 */
+	if (da && !da->flags.is_root) {
+		while (!da->parent->flags.is_root) da = da->parent;
+
+		if (da != attr_vendor_specific) return 1;
+	}
+
+	decode_ctx = (fr_radius_decode_ctx_t) {
+		.common = &lazy->common,
+		.request_authenticator = lazy->request_authenticator,
+		.tmp_ctx = talloc(lazy, uint8_t),
+		.end = lazy->end,
+		.request_code = lazy->request_code,
+		.tunnel_password_zeros = lazy->tunnel_password_zeros,
+	};
+	if (!decode_ctx.tmp_ctx) {
+		fr_strerror_const("Out of memory");
+		talloc_free(lazy);
+		return -1;
+	}
+
+	for (i = 0; i < lazy->num; i++) {
+		ssize_t slen;
+
+		attr = lazy->packet + lazy->offset[i];
+
+		/*
+		 *	Continued WiMAX attributes are decoded along
+		 *	with the first one.
+		 */
+		if (attr < next) continue;
+
+		slen = fr_radius_decode_pair(lazy->ctx, list, attr, (lazy->end - attr), &decode_ctx);
+		if (slen < 0) {
+			ret = -1;
+			break;
+		}
+
+		next = attr + slen;
+		talloc_free_children(decode_ctx.tmp_ctx);
+	}
+
+	talloc_free(decode_ctx.tags);
+	talloc_free(lazy);
+
+	return ret;
+}
+
+/** Record where the Vendor-Specific attributes are, so that they can be decoded later
+ *
+ * @return
+ *	- 0 on success.  out is NULL if there are no Vendor-Specific attributes.
+ *	- -1 on failure.
+ */
+static int radius_lazy_alloc(fr_radius_lazy_t **out, TALLOC_CTX *ctx, uint8_t const *packet, size_t packet_len,
+			     fr_radius_decode_ctx_t const *decode_ctx)
+{
+	fr_radius_lazy_t	*lazy;
+	uint8_t const		*attr, *end;
+	unsigned int		num = 0;
+
+	attr = packet + RADIUS_HEADER_LENGTH;
+	end = packet + packet_len;
+
+	while (attr < end) {
+		if (attr[0] == FR_VENDOR_SPECIFIC) num++;
+		attr += attr[1];
+	}
+	*out = NULL;
+	if (!num) return 0;
+
+	lazy = talloc_zero_size(ctx, sizeof(*lazy) + (sizeof(lazy->offset[0]) * num));
+	if (!lazy) {
+	oom:
+		fr_strerror_const("Out of memory");
+		return -1;
+	}
+	talloc_set_name_const(lazy, "fr_radius_lazy_t");
+
+	lazy->lazy.func = radius_lazy_decode;
+	lazy->ctx = ctx;
+	lazy->packet = decode_ctx->lazy_packet;
+	lazy->end = lazy->packet + packet_len;
+
+	/*
+	 *	The caller's secret and decode context may be gone
+	 *	by the time the attributes are used.
+	 */
+	lazy->common = *decode_ctx->common;
+	if (lazy->common.secret) {
+		lazy->common.secret = talloc_memdup(lazy, lazy->common.secret, lazy->common.secret_length + 1);
+		if (!lazy->common.secret) {
+			talloc_free(lazy);
+			goto oom;
+		}
+	}
+	memcpy(lazy->request_authenticator, decode_ctx->request_authenticator, sizeof(lazy->request_authenticator));
+	lazy->request_code = decode_ctx->request_code;
+	lazy->tunnel_password_zeros = decode_ctx->tunnel_password_zeros;
+
+	*out = lazy;
+	return 0;
+}
+
 ssize_t	fr_radius_decode(TALLOC_CTX *ctx, fr_pair_list_t *out,
 			 uint8_t *packet, size_t packet_len,
 			 fr_radius_decode_ctx_t *decode_ctx)
 {
 	ssize_t			slen;
 	uint8_t const		*attr, *end;
+	fr_radius_lazy_t	*lazy = NULL;
+	fr_pair_t		*lazy_prev = NULL;
 	static const uint8_t   	zeros[RADIUS_AUTH_VECTOR_LENGTH] = {};
 
 	if (!decode_ctx->request_authenticator) {
@@ -1158,19 +1299,42 @@ ssize_t	fr_radius_decode(TALLOC_CTX *ctx, fr_pair_list_t *out,
 	attr = packet + 20;
 	end = packet + packet_len;
 
+	/*
+	 *	Vendor-Specific attributes are often the bulk of the
+	 *	packet, and are often never looked at.  Leave them
+	 *	until something asks for them.
+	 */
+	if (decode_ctx->lazy_packet &&
+	    (radius_lazy_alloc(&lazy, ctx, packet, packet_len, decode_ctx) < 0)) return -1;
+
 	/*
 	 *	The caller MUST have called fr_radius_ok() first.  If
 	 *	he doesn't, all hell breaks loose.
 	 */
 	while (attr < end) {
+		if (lazy && (attr[0] == FR_VENDOR_SPECIFIC)) {
+			/*
+			 *	The Vendor-Specific group goes where the
+			 *	first Vendor-Specific attribute was.
+			 */
+			if (!lazy->num) lazy_prev = fr_pair_list_tail(out);
+			lazy->offset[lazy->num++] = attr - packet;
+			attr += attr[1];
+			continue;
+		}
+
 		slen = fr_radius_decode_pair(ctx, out, attr, (end - attr), decode_ctx);
-		if (slen < 0) return slen;
+		if (slen < 0) {
+			talloc_free(lazy);
+			return slen;
+		}
 
 		/*
 		 *	If slen is larger than the room in the packet,
 		 *	all kinds of bad things happen.
 		 */
 		 if (!fr_cond_assert(slen <= (end - attr))) {
+			 talloc_free(lazy);
 			 return -slen;
 		 }
 
@@ -1178,6 +1342,8 @@ ssize_t	fr_radius_decode(TALLOC_CTX *ctx, fr_pair_list_t *out,
 		talloc_free_children(decode_ctx->tmp_ctx);
 	}
 
+	if (lazy) fr_pair_list_lazy_set(out, lazy_prev, &lazy->lazy);
+
 	/*
 	 *	We've parsed the whole packet, return that.
 	 */
@@ -1209,6 +1375,253 @@ ssize_t	fr_radius_decode_simple(TALLOC_CTX *ctx, fr_pair_list_t *out,
 	return rcode;
 }
 
+/** Re-encrypt a User-Password for a new shared secret and Request Authenticator
+ *
+ * Each block is decrypted with the old key stream, and encrypted with
+ * the new one, without the plaintext being kept anywhere.
+ */
+static void relay_password(uint8_t *out, uint8_t const *in, size_t len,
+			   fr_radius_ctx_t const *from, uint8_t const *from_vector,
+			   fr_radius_ctx_t const *to, uint8_t const *to_vector)
+{
+	fr_md5_ctx_t	*md5_from, *md5_to, *md5_ctx;
+	uint8_t		from_digest[AUTH_PASS_LEN], to_digest[AUTH_PASS_LEN];
+	uint8_t const	*from_prev = from_vector, *to_prev = to_vector;
+	size_t		i, n;
+
+	md5_from = fr_md5_ctx_alloc_from_list();
+	md5_to = fr_md5_ctx_alloc_from_list();
+	md5_ctx = fr_md5_ctx_alloc_from_list();
+
+	fr_md5_update(md5_from, (uint8_t const *) from->secret, from->secret_length);
+	fr_md5_update(md5_to, (uint8_t const *) to->secret, to->secret_length);
+
+	for (n = 0; n < len; n += AUTH_PASS_LEN) {
+		fr_md5_ctx_copy(md5_ctx, md5_from);
+		fr_md5_update(md5_ctx, from_prev, AUTH_PASS_LEN);
+		fr_md5_final(from_digest, md5_ctx);
+
+		fr_md5_ctx_copy(md5_ctx, md5_to);
+		fr_md5_update(md5_ctx, to_prev, AUTH_PASS_LEN);
+		fr_md5_final(to_digest, md5_ctx);
+
+		for (i = 0; i < AUTH_PASS_LEN; i++) out[n + i] = in[n + i] ^ from_digest[i] ^ to_digest[i];
+
+		from_prev = in + n;
+		to_prev = out + n;
+	}
+
+	fr_md5_ctx_free_from_list(&md5_ctx);
+	fr_md5_ctx_free_from_list(&md5_to);
+	fr_md5_ctx_free_from_list(&md5_from);
+}
+
+/** Check that a Vendor-Specific attribute can be copied as-is
+ *
+ * Only RFC format vendors are checked.  Anything else is re-encoded,
+ * as we'd need to decode it to find out if it contains encrypted
+ * attributes.
+ */
+static bool relay_vsa_ok(uint8_t const *attr)
+{
+	fr_dict_attr_t const	*vendor_da, *da;
+	fr_dict_vendor_t const	*dv;
+	uint8_t const		*p, *end;
+	uint32_t		pen;
+
+	if (attr[1] < 6) return false;
+
+	pen = fr_nbo_to_uint32(attr + 2);
+
+	/*
+	 *	Unknown vendors can't have encrypted attributes.
+	 */
+	vendor_da = fr_dict_attr_child_by_num(attr_vendor_specific, pen);
+	if (!vendor_da) return true;
+
+	dv = fr_dict_vendor_by_num(dict_radius, pen);
+	if (!dv || dv->continuation || (dv->type != 1) || (dv->length != 1)) return false;
+
+	p = attr + 6;
+	end = attr + attr[1];
+
+	while (p < end) {
+		if (((end - p) < 2) || (p[1] < 2) || ((p + p[1]) > end)) return false;
+
+		da = fr_dict_attr_child_by_num(vendor_da, p[0]);
+		if (da && fr_radius_flag_encrypted(da)) return false;
+
+		p += p[1];
+	}
+
+	return true;
+}
+
+/** Copy a request to a new packet for proxying, without decoding it
+ *
+ * The attributes are copied as-is.  The ID and Request Authenticator
+ * are replaced, and User-Password is re-encrypted for the new shared
+ * secret.  Message-Authenticator is zeroed, and is added to
+ * Access-Request packets sent over insecure transports.  CHAP-Challenge
+ * is added if the CHAP-Password relied on the original Request
+ * Authenticator.  Proxy-State is added if packet_ctx->add_proxy_state
+ * is set.
+ *
+ * The caller must then sign the packet with fr_radius_sign().
+ *
+ * @param[out] out		Where to write the new packet.
+ * @param[in] outlen		Length of the output buffer.
+ * @param[in] original		packet.  Must have been checked with fr_radius_ok().
+ * @param[in] original_len	Length of the original packet.
+ * @param[in] original_ctx	The shared secret of the original packet.
+ * @param[in] packet_ctx	The shared secret, ID, etc. of the new packet.
+ * @return
+ *	- >0 the length of the new packet.
+ *	- 0 if the packet contains attributes which can't be copied, or
+ *	  doesn't fit.  It should be encoded from its pairs instead.
+ */
+ssize_t fr_radius_relay(uint8_t *out, size_t outlen,
+			uint8_t const *original, size_t original_len,
+			fr_radius_ctx_t const *original_ctx, fr_radius_encode_ctx_t *packet_ctx)
+{
+	uint8_t const		*attr, *end;
+	uint8_t			*p;
+	uint8_t			code = original[0];
+	bool			seen_message_authenticator = false;
+	bool			chap_password = false, chap_challenge = false;
+	size_t			i, need;
+
+	switch (code) {
+	case FR_RADIUS_CODE_ACCESS_REQUEST:
+	case FR_RADIUS_CODE_ACCOUNTING_REQUEST:
+	case FR_RADIUS_CODE_COA_REQUEST:
+	case FR_RADIUS_CODE_DISCONNECT_REQUEST:
+		break;
+
+	default:
+		return 0;
+	}
+
+	/*
+	 *	Leave room for Message-Authenticator, CHAP-Challenge
+	 *	and Proxy-State.
+	 */
+	need = original_len + 18 + 18 + 2 + sizeof(packet_ctx->common->proxy_state);
+	if ((need > outlen) || (need > 65535)) return 0;
+
+	out[0] = code;
+	out[1] = packet_ctx->id;
+
+	if (code == FR_RADIUS_CODE_ACCESS_REQUEST) {
+		for (i = 0; i < RADIUS_AUTH_VECTOR_LENGTH; i++) out[4 + i] = fr_fast_rand(&packet_ctx->rand_ctx);
+	} else {
+		memset(out + 4, 0, RADIUS_AUTH_VECTOR_LENGTH);
+	}
+
+	p = out + RADIUS_HEADER_LENGTH;
+
+	/*
+	 *	Same as the encoder, put it first.
+	 */
+	if ((code == FR_RADIUS_CODE_ACCESS_REQUEST) && !packet_ctx->common->secure_transport) {
+		p[0] = FR_MESSAGE_AUTHENTICATOR;
+		p[1] = 18;
+		memset(p + 2, 0, RADIUS_AUTH_VECTOR_LENGTH);
+		p += 18;
+		seen_message_authenticator = true;
+	}
+
+	attr = original + RADIUS_HEADER_LENGTH;
+	end = original + original_len;
+
+	while (attr < end) {
+		fr_dict_attr_t const *da;
+
+		switch (attr[0]) {
+		case FR_USER_PASSWORD:
+			if ((code != FR_RADIUS_CODE_ACCESS_REQUEST) ||
+			    (attr[1] == 2) || (((attr[1] - 2) % AUTH_PASS_LEN) != 0)) return 0;
+
+			p[0] = attr[0];
+			p[1] = attr[1];
+			relay_password(p + 2, attr + 2, attr[1] - 2,
+				       original_ctx, original + 4, packet_ctx->common, out + 4);
+			p += attr[1];
+			attr += attr[1];
+			continue;
+
+		case FR_MESSAGE_AUTHENTICATOR:
+			if (attr[1] != 18) return 0;
+
+			if (!seen_message_authenticator) {
+				p[0] = FR_MESSAGE_AUTHENTICATOR;
+				p[1] = 18;
+				memset(p + 2, 0, RADIUS_AUTH_VECTOR_LENGTH);
+				p += 18;
+				seen_message_authenticator = true;
+			}
+			attr += attr[1];
+			continue;
+
+		case FR_CHAP_PASSWORD:
+			chap_password = true;
+			break;
+
+		case FR_CHAP_CHALLENGE:
+			chap_challenge = true;
+			break;
+
+		case FR_VENDOR_SPECIFIC:
+			if (!relay_vsa_ok(attr)) return 0;
+			break;
+
+		default:
+			da = fr_dict_attr_child_by_num(fr_dict_root(dict_radius), attr[0]);
+			if (!da) break;
+
+			if (fr_radius_flag_encrypted(da)) return 0;
+
+			/*
+			 *	Extended attributes can contain
+			 *	encrypted ones, too.
+			 */
+			if (fr_radius_flag_extended(da)) {
+				if ((attr[1] < 3) || (attr[2] == FR_VENDOR_SPECIFIC)) return 0;
+
+				da = fr_dict_attr_child_by_num(da, attr[2]);
+				if (da && fr_radius_flag_encrypted(da)) return 0;
+			}
+			break;
+		}
+
+		memcpy(p, attr, attr[1]);
+		p += attr[1];
+		attr += attr[1];
+	}
+
+	/*
+	 *	The home server can only check CHAP-Password against
+	 *	the original Request Authenticator.
+	 */
+	if (chap_password && !chap_challenge) {
+		p[0] = FR_CHAP_CHALLENGE;
+		p[1] = 2 + RADIUS_AUTH_VECTOR_LENGTH;
+		memcpy(p + 2, original + 4, RADIUS_AUTH_VECTOR_LENGTH);
+		p += p[1];
+	}
+
+	if (packet_ctx->add_proxy_state) {
+		p[0] = FR_PROXY_STATE;
+		p[1] = 2 + sizeof(packet_ctx->common->proxy_state);
+		fr_nbo_from_uint64(p + 2, packet_ctx->common->proxy_state);
+		p += p[1];
+	}
+
+	fr_nbo_from_uint16(out + 2, p - out);
+
+	return p - out;
+}
+
 int fr_radius_global_init(void)
 {
 	if (instance_count > 0) {
@@ -2223,6 +2223,45 @@ static ssize_t fr_radius_decode_proto(TALLOC_CTX *ctx, fr_pair_list_t *out,
 	return fr_radius_decode(ctx, out, UNCONST(uint8_t *, data), packet_len, test_ctx);
 }
 
+/** Verify and decode a packet relayed by radius_tp_relay_proto, using the home server's secret
+ *
+ * Message-Authenticator is checked, and then removed, as its value
+ * depends on the random Request Authenticator.
+ */
+static ssize_t fr_radius_relay_decode_proto(TALLOC_CTX *ctx, fr_pair_list_t *out,
+					    uint8_t const *data, size_t data_len, void *proto_ctx)
+{
+	fr_radius_decode_ctx_t	*test_ctx = talloc_get_type_abort(proto_ctx, fr_radius_decode_ctx_t);
+	fr_radius_ctx_t		home = {
+					.secret = "homesecret",
+					.secret_length = sizeof("homesecret") - 1,
+				};
+	fr_radius_decode_ctx_t	decode_ctx;
+	fr_radius_decode_fail_t	reason;
+	size_t			packet_len = data_len;
+	ssize_t			slen;
+
+	if (!fr_radius_ok(data, &packet_len, 200, false, &reason)) {
+		fr_strerror_printf("Packet failed verification - %s", reason_name[reason]);
+		return -1;
+	}
+
+	decode_ctx = (fr_radius_decode_ctx_t) {
+		.common = &home,
+		.tmp_ctx = test_ctx->tmp_ctx,
+		.end = data + packet_len,
+		.verify = true,
+		.require_message_authenticator = (data[0] == FR_RADIUS_CODE_ACCESS_REQUEST),
+	};
+
+	slen = fr_radius_decode(ctx, out, UNCONST(uint8_t *, data), packet_len, &decode_ctx);
+	if (slen < 0) return slen;
+
+	fr_pair_delete_by_da(out, attr_message_authenticator);
+
+	return slen;
+}
+
 static ssize_t decode_pair(TALLOC_CTX *ctx, fr_pair_list_t *out, NDEBUG_UNUSED fr_dict_attr_t const *parent,
 			   uint8_t const *data, size_t data_len, void *decode_ctx)
 {
@@ -2249,3 +2288,9 @@ fr_test_point_proto_decode_t radius_tp_decode_proto = {
 	.test_ctx	= decode_test_ctx,
 	.func		= fr_radius_decode_proto
 };
+
+extern fr_test_point_proto_decode_t radius_tp_relay_decode_proto;
+fr_test_point_proto_decode_t radius_tp_relay_decode_proto = {
+	.test_ctx	= decode_test_ctx,
+	.func		= fr_radius_relay_decode_proto
+};
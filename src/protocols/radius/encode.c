@@ -1771,6 +1771,50 @@ static ssize_t fr_radius_encode_proto(TALLOC_CTX *ctx, fr_pair_list_t *vps, uint
 	return slen;
 }
 
+/** Encode a request with the NAS's secret, and relay it to a home server with a different secret
+ *
+ * The output should be decoded with radius_tp_relay_decode_proto,
+ * which uses the home server's secret.
+ */
+static ssize_t fr_radius_relay_proto(TALLOC_CTX *ctx, fr_pair_list_t *vps, uint8_t *data, size_t data_len, void *proto_ctx)
+{
+	fr_radius_encode_ctx_t	*packet_ctx = talloc_get_type_abort(proto_ctx, fr_radius_encode_ctx_t);
+	fr_radius_ctx_t const	*nas = packet_ctx->common;
+	fr_radius_ctx_t		home = {
+					.secret = "homesecret",
+					.secret_length = sizeof("homesecret") - 1,
+				};
+	uint8_t			*original;
+	ssize_t			slen;
+
+	original = talloc_array(ctx, uint8_t, data_len);
+	if (!original) {
+		fr_strerror_const("Out of memory");
+		return -1;
+	}
+
+	slen = fr_radius_encode_proto(ctx, vps, original, data_len, proto_ctx);
+	if (slen <= 0) {
+	done:
+		talloc_free(original);
+		return slen;
+	}
+
+	packet_ctx->common = &home;
+	packet_ctx->id = original[1] + 1;
+
+	slen = fr_radius_relay(data, data_len, original, slen, nas, packet_ctx);
+	packet_ctx->common = nas;
+	if (slen == 0) {
+		fr_strerror_const("Packet must be re-encoded");
+		slen = -1;
+		goto done;
+	}
+
+	if (fr_radius_sign(data, NULL, (uint8_t const *) home.secret, home.secret_length) < 0) slen = -1;
+	goto done;
+}
+
 /*
  *	No one else should be using this.
  */
@@ -1792,3 +1836,9 @@ fr_test_point_proto_encode_t radius_tp_encode_proto = {
 	.test_ctx	= encode_test_ctx,
 	.func		= fr_radius_encode_proto
 };
+
+extern fr_test_point_proto_encode_t radius_tp_relay_proto;
+fr_test_point_proto_encode_t radius_tp_relay_proto = {
+	.test_ctx	= encode_test_ctx,
+	.func		= fr_radius_relay_proto
+};
@@ -0,0 +1,253 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Measure the time and memory used decoding RADIUS packets, with and without lazy decoding
+ *
+ * The packet is an interim Accounting-Request, with a mix of standard
+ * attributes and Cisco-AVPair attributes, as sent by a BNG.
+ *
+ * This isn't run by "make test".  Run it by hand, and compare the
+ * per_sec and bytes numbers from each test.
+ *
+ * @file src/protocols/radius/lazy_decode_perf_test.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+static void test_init(void);
+#  define TEST_INIT  test_init()
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/util/time.h>
+
+#define PERF_REPS	100000
+#define PERF_VSAS	24
+
+static TALLOC_CTX		*autofree;
+static uint8_t			packet[RADIUS_MAX_PACKET_SIZE];
+static size_t			packet_len;
+
+static fr_radius_ctx_t		common_ctx = {
+	.secret = "testing123",
+	.secret_length = 10,
+};
+
+static fr_dict_t const *dict_radius;
+
+static fr_dict_autoload_t lazy_decode_dict[] = {
+	{ .out = &dict_radius, .proto = "radius" },
+	{ NULL }
+};
+
+static fr_dict_attr_t const *attr_user_name;
+static fr_dict_attr_t const *attr_cisco_avpair;
+
+static fr_dict_attr_autoload_t lazy_decode_dict_attr[] = {
+	{ .out = &attr_user_name, .name = "User-Name", .type = FR_TYPE_STRING, .dict = &dict_radius },
+	{ .out = &attr_cisco_avpair, .name = "Vendor-Specific.Cisco.AVPair", .type = FR_TYPE_STRING, .dict = &dict_radius },
+	{ NULL }
+};
+
+/** Add an attribute to the end of the packet
+ *
+ */
+static void packet_attr_add(uint8_t type, void const *data, size_t len)
+{
+	uint8_t *p = packet + packet_len;
+
+	p[0] = type;
+	p[1] = 2 + len;
+	memcpy(p + 2, data, len);
+
+	packet_len += p[1];
+}
+
+/** Add a Cisco-AVPair to the end of the packet
+ *
+ */
+static void packet_avpair_add(char const *value)
+{
+	uint8_t	vsa[RADIUS_MAX_STRING_LENGTH];
+	size_t	len = strlen(value);
+
+	vsa[0] = 0;
+	vsa[1] = 0;
+	vsa[2] = 0;
+	vsa[3] = 9;		/* Cisco */
+	vsa[4] = 1;		/* AVPair */
+	vsa[5] = 2 + len;
+	memcpy(vsa + 6, value, len);
+
+	packet_attr_add(FR_VENDOR_SPECIFIC, vsa, 6 + len);
+}
+
+static void packet_uint32_add(uint8_t type, uint32_t value)
+{
+	uint8_t data[4];
+
+	fr_nbo_from_uint32(data, value);
+	packet_attr_add(type, data, sizeof(data));
+}
+
+static void test_init(void)
+{
+	char		buffer[64];
+	unsigned int	i;
+
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("lazy_decode_perf_test");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_time_start() < 0) goto error;
+
+	if (fr_dict_global_ctx_init(autofree, true, TEST_DICT_DIR) == NULL) goto error;
+	if (fr_radius_global_init() < 0) goto error;
+
+	if (fr_dict_autoload(lazy_decode_dict) < 0) goto error;
+	if (fr_dict_attr_autoload(lazy_decode_dict_attr) < 0) goto error;
+
+	/*
+	 *	Accounting-Request, with a zero authenticator, as we
+	 *	don't verify it.
+	 */
+	packet[0] = FR_RADIUS_CODE_ACCOUNTING_REQUEST;
+	packet[1] = 1;
+	packet_len = RADIUS_HEADER_LENGTH;
+
+	packet_attr_add(FR_USER_NAME, "bob@example.com", 15);
+	packet_uint32_add(FR_NAS_IP_ADDRESS, 0xc0000201);
+	packet_uint32_add(FR_NAS_PORT, 1234);
+	packet_uint32_add(FR_ACCT_STATUS_TYPE, 3);	/* Interim-Update */
+	packet_attr_add(FR_ACCT_SESSION_ID, "0a1b2c3d4e5f", 12);
+	packet_uint32_add(FR_FRAMED_IP_ADDRESS, 0xc6336401);
+	packet_attr_add(FR_CALLING_STATION_ID, "00-11-22-33-44-55", 17);
+
+	for (i = 0; i < PERF_VSAS; i++) {
+		snprintf(buffer, sizeof(buffer), "subscriber:accounting-list=service-%u", i);
+		packet_avpair_add(buffer);
+	}
+
+	packet_uint32_add(FR_ACCT_INPUT_OCTETS, 123456789);
+	packet_uint32_add(FR_ACCT_OUTPUT_OCTETS, 987654321);
+	packet_uint32_add(FR_ACCT_SESSION_TIME, 3600);
+	packet_uint32_add(FR_EVENT_TIMESTAMP, 1700000000);
+
+	fr_nbo_from_uint16(packet + 2, packet_len);
+}
+
+/** Decode the packet PERF_REPS times, optionally looking for an attribute after each decode
+ *
+ */
+static void do_test_decode(bool lazy, fr_dict_attr_t const *find)
+{
+	fr_time_t	start, end;
+	fr_time_delta_t	used = fr_time_delta_wrap(0);
+	size_t		bytes = 0;
+	unsigned int	i;
+
+	for (i = 0; i < PERF_REPS; i++) {
+		TALLOC_CTX		*ctx;
+		fr_pair_list_t		list;
+		fr_radius_decode_ctx_t	decode_ctx;
+		ssize_t			slen;
+
+		ctx = talloc_new(NULL);
+		fr_pair_list_init(&list);
+
+		decode_ctx = (fr_radius_decode_ctx_t) {
+			.common = &common_ctx,
+			.tmp_ctx = talloc(ctx, uint8_t),
+			.end = packet + packet_len,
+			.lazy_packet = lazy ? packet : NULL,
+		};
+
+		start = fr_time();
+		slen = fr_radius_decode(ctx, &list, packet, packet_len, &decode_ctx);
+		if (find) TEST_CHECK(fr_pair_find_by_da_nested(&list, NULL, find) != NULL);
+		end = fr_time();
+
+		if (!TEST_CHECK(slen >= 0)) {
+			TEST_MSG("Failed decoding packet: %s", fr_strerror());
+			talloc_free(ctx);
+			return;
+		}
+
+		used = fr_time_delta_add(used, fr_time_sub(end, start));
+		bytes += talloc_total_size(ctx);
+
+		talloc_free(ctx);
+	}
+
+	TEST_MSG_ALWAYS("repetitions=%u", PERF_REPS);
+	TEST_MSG_ALWAYS("packet_len=%zu", packet_len);
+	TEST_MSG_ALWAYS("used=%"PRId64, fr_time_delta_unwrap(used));
+	TEST_MSG_ALWAYS("per_sec=%0.0lf", PERF_REPS / (fr_time_delta_unwrap(used) / (double)NSEC));
+	TEST_MSG_ALWAYS("bytes_per_packet=%zu", bytes / PERF_REPS);
+}
+
+/** Decode everything up front
+ *
+ */
+static void test_decode_eager(void)
+{
+	do_test_decode(false, NULL);
+}
+
+/** Decode everything up front, then look for User-Name
+ *
+ */
+static void test_decode_eager_find(void)
+{
+	do_test_decode(false, attr_user_name);
+}
+
+/** Skip the Vendor-Specific attributes
+ *
+ */
+static void test_decode_lazy(void)
+{
+	do_test_decode(true, NULL);
+}
+
+/** Skip the Vendor-Specific attributes, then look for User-Name, which doesn't decode them
+ *
+ */
+static void test_decode_lazy_find(void)
+{
+	do_test_decode(true, attr_user_name);
+}
+
+/** Skip the Vendor-Specific attributes, then look for one, which decodes them all
+ *
+ */
+static void test_decode_lazy_find_vsa(void)
+{
+	do_test_decode(true, attr_cisco_avpair);
+}
+
+TEST_LIST = {
+	{ "decode_eager",		test_decode_eager },
+	{ "decode_eager_find",		test_decode_eager_find },
+	{ "decode_lazy",		test_decode_lazy },
+	{ "decode_lazy_find",		test_decode_lazy_find },
+	{ "decode_lazy_find_vsa",	test_decode_lazy_find_vsa },
+	{ NULL }
+};
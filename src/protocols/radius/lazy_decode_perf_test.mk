@@ -0,0 +1,8 @@
+TARGET		:= lazy_decode_perf_test$(E)
+SOURCES		:= lazy_decode_perf_test.c
+
+SRC_CFLAGS	:= -I$(top_builddir)/src -DNO_ASSERT -DTEST_DICT_DIR=\"$(top_srcdir)/share/dictionary\"
+TGT_LDLIBS	:= $(LIBS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-radius$(L)
+
+TGT_INSTALLDIR	:=
@@ -139,6 +139,10 @@ typedef struct {
 	fr_radius_tag_ctx_t    	**tags;			//!< for decoding tagged attributes
 	fr_pair_list_t		*tag_root;		//!< Where to insert tag attributes.
 	TALLOC_CTX		*tag_root_ctx;		//!< Where to allocate new tag attributes.
+
+	uint8_t const		*lazy_packet;		//!< Copy of the packet which outlives the decoded pairs.
+							///< If set, Vendor-Specific attributes are decoded from
+							///< it when they're first used.
 } fr_radius_decode_ctx_t;
 
 typedef enum {
@@ -245,6 +249,10 @@ ssize_t		fr_radius_decode_simple(TALLOC_CTX *ctx, fr_pair_list_t *out,
 					uint8_t *packet, size_t packet_len,
 					uint8_t const *vector, char const *secret) CC_HINT(nonnull(1,2,3,6));
 
+ssize_t		fr_radius_relay(uint8_t *out, size_t outlen,
+				uint8_t const *original, size_t original_len,
+				fr_radius_ctx_t const *original_ctx, fr_radius_encode_ctx_t *packet_ctx) CC_HINT(nonnull);
+
 int		fr_radius_global_init(void);
 
 void		fr_radius_global_free(void);
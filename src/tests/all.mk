@@ -62,6 +62,7 @@ test: \
 		test.radmin	\
 		test.eap	\
 		test.tacacs	\
+		test.tls	\
 		test.vmps	\
 		test.ldap_sync	\
 		| build.raddb
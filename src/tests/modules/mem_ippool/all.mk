@@ -0,0 +1,3 @@
+#
+#  Test the "mem_ippool" module
+#
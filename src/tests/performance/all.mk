@@ -0,0 +1,90 @@
+#
+#	Performance benchmarks.
+#
+#	Each scenario is sent to the server at a fixed rate by
+#	radclient-ng, and the throughput and latency are written to a
+#	JSON file.  The results are then checked against a baseline
+#	from a previous run, and the test fails if they have regressed.
+#
+#	These tests are not run by "make test".  Use:
+#
+#		make test.performance
+#		make test.performance.baseline
+#
+
+#
+#	Test name
+#
+TEST  := test.performance
+FILES := $(subst $(DIR)/,,$(wildcard $(DIR)/*.txt))
+
+$(eval $(call TEST_BOOTSTRAP))
+
+#
+#	Benchmark settings.  Baselines are only useful if they were
+#	recorded on the same machine, with the same settings.
+#
+PERF_RATE      ?= 5000
+PERF_DURATION  ?= 10
+PERF_THREADS   ?= 2
+PERF_SOCKETS   ?= 4
+PERF_TOLERANCE ?= 10
+PERF_BASELINE  ?= $(BUILD_DIR)/tests/performance-baseline
+PERF_OUTPUT    := $(OUTPUT)
+
+#
+#  Generic rules to start / stop the radius service.
+#
+CLIENT := radclient-ng
+include src/tests/radiusd.mk
+$(eval $(call RADIUSD_SERVICE,benchmark,$(OUTPUT)))
+
+$(OUTPUT)/auth_proxy.txt: $(BUILD_DIR)/lib/local/rlm_radius.la
+$(OUTPUT)/auth_eap_md5.txt: $(BUILD_DIR)/lib/local/rlm_eap.la $(BUILD_DIR)/lib/local/rlm_eap_md5.la
+$(OUTPUT)/auth_cache.txt: $(BUILD_DIR)/lib/local/rlm_cache.la $(BUILD_DIR)/lib/local/rlm_cache_rbtree.la
+$(OUTPUT)/acct_sqlite.txt: $(BUILD_DIR)/lib/local/rlm_sql.la $(BUILD_DIR)/lib/local/rlm_sql_sqlite.la
+
+#
+#	Run each scenario, and compare the results with the baseline.
+#	The ARGV in a scenario comes after the defaults, so it can
+#	override them.
+#
+$(OUTPUT)/%.txt: $(DIR)/%.txt $(DIR)/compare $(BUILD_DIR)/bin/local/radclient-ng $(BUILD_DIR)/lib/local/proto_radius.la | $(TEST).radiusd_kill $(TEST).radiusd_start
+	$(eval TYPE     := $(shell echo $(notdir $<) | cut -f1 -d '_'))
+	$(eval ARGV     := $(shell grep "#.*ARGV:" $< | cut -f2 -d ':'))
+	$(eval RESULTS  := $(patsubst %.txt,%.json,$@))
+	$(eval PERF_RUN := $(TEST_BIN)/radclient-ng -L $(PERF_RATE) -l $(PERF_DURATION) -j $(PERF_THREADS) -N $(PERF_SOCKETS) $(ARGV) -O $(RESULTS) -f $< -d src/tests/performance/config -D share/dictionary 127.0.0.1:$(performance_port) $(TYPE) $(SECRET))
+
+	${Q}echo "PERFORMANCE-TEST INPUT=$(notdir $<) RATE=$(PERF_RATE) DURATION=$(PERF_DURATION)"
+	${Q}[ -f $(dir $@)/radiusd.pid ] || exit 1
+	${Q}if ! $(PERF_RUN) > $(patsubst %.txt,%.log,$@) 2>&1; then \
+		echo "FAILED";                                                      \
+		cat $(patsubst %.txt,%.log,$@);                                     \
+		echo "RADIUSD:     $(RADIUSD_RUN)";                                 \
+		echo "RADCLIENT:   $(PERF_RUN)";                                    \
+		$(MAKE) --no-print-directory test.performance.radiusd_kill;         \
+		exit 1;                                                             \
+	fi
+	${Q}if ! src/tests/performance/compare $(RESULTS) $(PERF_BASELINE)/$(notdir $(RESULTS)) $(PERF_TOLERANCE); then \
+		echo "PERFORMANCE-TEST FAILED $@";                                  \
+		echo "Results:  $(RESULTS)";                                        \
+		echo "Baseline: $(PERF_BASELINE)/$(notdir $(RESULTS))";             \
+		$(MAKE) --no-print-directory test.performance.radiusd_kill;         \
+		exit 1;                                                             \
+	fi
+	${Q}touch $@
+
+.NO_PARALLEL: $(TEST)
+$(TEST):
+	${Q}$(MAKE) --no-print-directory $@.radiusd_stop
+	@touch $(BUILD_DIR)/tests/$@
+
+#
+#	Save the results of the last run as the new baseline.
+#
+.PHONY: $(TEST).baseline
+$(TEST).baseline:
+	${Q}[ -n "$$(ls $(PERF_OUTPUT)/*.json 2>/dev/null)" ] || { echo "No results, run 'make test.performance' first"; exit 1; }
+	${Q}mkdir -p $(PERF_BASELINE)
+	${Q}cp $(PERF_OUTPUT)/*.json $(PERF_BASELINE)/
+	@echo "Saved baseline in $(PERF_BASELINE)"
@@ -46,6 +46,7 @@ $(OUTPUT)/%.txt: $(DIR)/%.txt $(TEST_BIN_DIR)/radsniff $(PCAP_IN)
 	$(eval CMD_TEST := $(patsubst %.txt,%.cmd,$<))
 	$(eval EXPECTED := $<)
 	$(eval ARGV     := $(shell grep "^#.*ARGV:" $< | cut -f2 -d ':'))
+	$(eval COMPARE  := $(shell grep "^#.*COMPARE:" $< | cut -f2 -d ':'))
 
 	${Q}echo "RADSNIFF-TEST INPUT=$(TARGET) ARGV=\"$(ARGV)\""
 #
@@ -58,7 +59,27 @@ $(OUTPUT)/%.txt: $(DIR)/%.txt $(TEST_BIN_DIR)/radsniff $(PCAP_IN)
 		rm -f $@;										      \
 		exit 1;                                                                                       \
 	fi
-	${Q}if [ -e "$(EXPECTED)" ]; then                                                                     \
+#
+#	Tests with a "COMPARE:" line check the output against a second run
+#	of radsniff over the same capture, instead of fixed output.  This
+#	is used to check the analysis threads (-j) produce the same
+#	results as the single threaded mode.
+#
+	${Q}if [ -n "$(strip $(COMPARE))" ]; then                                                              \
+		if ! TZ='UTC' $(TEST_BIN)/radsniff $(COMPARE) -I $(PCAP_IN) -D share/dictionary 1> $(FOUND).ref; then \
+			echo "FAILED";                                                                        \
+			echo "RADSNIFF: TZ='UTC' $(TEST_BIN)/radsniff $(COMPARE) -I $(PCAP_IN) -D share/dictionary"; \
+			rm -f $@;									      \
+			exit 1;                                                                               \
+		fi;                                                                                           \
+		if ! [ -s $(FOUND).ref ] || ! cmp $(FOUND).ref $(FOUND); then                                 \
+			echo "RADSNIFF FAILED $@";                                                            \
+			echo "ERROR: Output of \"$(ARGV)\" differs from \"$(COMPARE)\" (or is empty)";       \
+			diff $(FOUND).ref $(FOUND);                                                           \
+			rm -f $@;									      \
+			exit 1;                                                                               \
+		fi;                                                                                           \
+	elif [ -e "$(EXPECTED)" ]; then                                                                       \
 		grep -v "^#" $(EXPECTED) > $(EXPECTED).simple || true;                                           \
 		sed -i.bak -e '$${/Executing: /d;}' $(FOUND);                                                 \
 		if ! cmp $(EXPECTED).simple $(FOUND); then                                                       \
@@ -33,9 +33,13 @@ TACACS_RADIUS_LOG := $(TACACS_BUILD_DIR)/radiusd.log
 TACACS_GDB_LOG    := $(TACACS_BUILD_DIR)/gdb.log
 
 #
-#	Local TACACS+ client
+#	Local TACACS+ clients
 #
-TACCLIENT := scripts/tacacs/tacacs_client
+#	The session_* tests send several sessions over one connection,
+#	which tacacs_client can't do.
+#
+TACCLIENT   := scripts/tacacs/tacacs_client
+TACSESSIONS := scripts/tacacs/tacacs_sessions
 
 #
 #  Generic rules to start / stop the radius service.
@@ -52,15 +56,16 @@ $(OUTPUT)/%: $(DIR)/% $(BUILD_DIR)/lib/libfreeradius-tacacs.la $(BUILD_DIR)/lib/
 	$(eval EXPECTED := $(patsubst %.txt,%.out,$<))
 	$(eval FOUND    := $(patsubst %.txt,%.out,$@))
 	$(eval ARGV     := $(shell grep "#.*ARGV:" $< | cut -f2 -d ':'))
+	$(eval CLIENT_RUN := $(if $(filter session_%,$(TARGET)),$(TACSESSIONS) -k $(SECRET) -p $(tacacs_port) -H localhost,$(TACCLIENT) --return-0-if-failed -v -k $(SECRET) -p $(tacacs_port) -H localhost -r 192.168.69.1 -P pegapilha/0 --timeout 2))
 	${Q}echo "TACACS-TEST INPUT=$(TARGET) TACACS_ARGV=\"$(ARGV)\""
 	${Q}[ -f $(dir $@)/radiusd.pid ] || exit 1
-	${Q}if ! $(TACCLIENT) --return-0-if-failed -v -k $(SECRET) -p $(tacacs_port) -H localhost -r 192.168.69.1 -P pegapilha/0 --timeout 2 $(ARGV) 1> $(FOUND) 2>&1; then \
+	${Q}if ! $(CLIENT_RUN) $(ARGV) 1> $(FOUND) 2>&1; then \
 		echo "FAILED";                                              \
 		cat $(FOUND);                                               \
 		rm -f $(BUILD_DIR)/tests/test.tacacs;                       \
 		$(MAKE) --no-print-directory test.tacacs.radiusd_kill;      \
 		echo "RADIUSD:   $(RADIUSD_RUN)";                           \
-		echo "TACCLIENT: $(TACCLIENT) --return-0-if-failed -v -k $(SECRET) -p $(tacacs_port) -H localhost -r 192.168.69.1 -P pegapilha/0 --timeout 2 $(ARGV)"; \
+		echo "TACCLIENT: $(CLIENT_RUN) $(ARGV)"; \
 		exit 1;                                                     \
 	fi
 #
@@ -71,7 +76,7 @@ $(OUTPUT)/%: $(DIR)/% $(BUILD_DIR)/lib/libfreeradius-tacacs.la $(BUILD_DIR)/lib/
 	${Q}if [ -e "$(EXPECTED)" ] && ! cmp -s $(FOUND) $(EXPECTED); then  \
 		echo "TACCLIENT FAILED $@";                                 \
 		echo "RADIUSD:   $(RADIUSD_RUN)";                           \
-		echo "TACCLIENT: $(TACCLIENT) --return-0-if-failed -v -k $(SECRET) -p $(tacacs_port) -H localhost -r 192.168.69.1 -P pegapilha/0 --timeout 2 $(ARGV)"; \
+		echo "TACCLIENT: $(CLIENT_RUN) $(ARGV)"; \
 		echo "ERROR: File $(FOUND) is not the same as $(EXPECTED)"; \
 		echo "If you did some update on the proto_tacacs code, please be sure to update the unit tests."; \
 		echo "e.g: $(EXPECTED)";                                    \
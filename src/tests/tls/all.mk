@@ -0,0 +1,136 @@
+#
+#	Tests for the TLS transports of proto_radius and proto_tacacs.
+#
+#	Neither radclient nor tacacs_client can speak TLS, so each
+#	test runs socat as a bridge.  The client talks TCP to socat,
+#	and socat does the TLS handshake with the server, using the
+#	test certificates in raddb/certs.
+#
+SOCAT := $(shell which socat 2>/dev/null)
+
+-include $(BUILD_DIR)/tests/tacacs/depends.mk
+
+ifneq "$(SOCAT)" ""
+#
+#	Test name
+#
+TEST  := test.tls
+FILES := $(subst $(DIR)/,,$(wildcard $(DIR)/*.txt))
+
+ifneq "$(WITH_TACACS)" "yes"
+FILES := $(filter-out tacacs_%,$(FILES))
+endif
+
+$(eval $(call TEST_BOOTSTRAP))
+
+#
+#	Config settings
+#
+TLS_CERT_DIR := $(top_srcdir)/raddb/certs/rsa
+TACCLIENT    := scripts/tacacs/tacacs_client
+
+#
+#	The port socat listens on.  This is well away from the ports
+#	which are given to the radiusd instances.
+#
+TLS_BRIDGE_PORT := $(shell echo $$(($(PORT)+1000)))
+
+#
+#  Generic rules to start / stop the radius service.
+#
+#  We need one server for each protocol, as each listener gets the
+#  port from TEST_PORT.
+#
+include src/tests/radiusd.mk
+
+TEST := test.tls.radius
+$(eval $(call RADIUSD_SERVICE,radius,$(OUTPUT)/radius))
+
+TEST := test.tls.tacacs
+$(eval $(call RADIUSD_SERVICE,tacacs,$(OUTPUT)/tacacs))
+
+#  Reset
+TEST := test.tls
+
+$(OUTPUT)/radius $(OUTPUT)/tacacs:
+	${Q}mkdir -p $@
+
+#
+#	socat won't prompt for the key password, so give it a
+#	decrypted copy of the client key.
+#
+$(OUTPUT)/client.key: $(top_srcdir)/raddb/certs/ecc/ocsp.pem | $(OUTPUT)
+	${Q}openssl pkey -in $(TLS_CERT_DIR)/client.key -passin pass:whatever -out $@
+
+#
+#	Start the bridge to the server on port ${1}.  ${2} is the output
+#	directory, which has the decrypted key, and gets the socat pid.
+#
+#	The server certificate is for radius.example.org, so we check
+#	that name, and not the IP address we connect to.
+#
+define TLS_BRIDGE
+$(SOCAT) TCP-LISTEN:$(TLS_BRIDGE_PORT),bind=127.0.0.1,reuseaddr \
+	OPENSSL:127.0.0.1:${1},cert=$(TLS_CERT_DIR)/client.crt,key=${2}client.key,cafile=$(TLS_CERT_DIR)/ca.pem,commonname=radius.example.org & \
+	echo $$! > ${2}socat.pid; \
+	sleep 1
+endef
+
+#
+#	Send the packet through the bridge with radclient, and check the
+#	reply code, which is given by a "REPLY:" comment in the test file.
+#
+$(OUTPUT)/radius_%: $(DIR)/radius_% $(OUTPUT)/client.key $(BUILD_DIR)/bin/local/radclient $(BUILD_DIR)/lib/local/proto_radius_tls.la | $(TEST).radius.radiusd_kill $(TEST).radius.radiusd_start
+	$(eval TARGET   := $(notdir $<))
+	$(eval FOUND    := $(patsubst %.txt,%.out,$@))
+	$(eval REPLY    := $(shell grep "#.*REPLY:" $< | cut -f2 -d ':'))
+	${Q}echo "TLS-TEST INPUT=$(TARGET)"
+	${Q}[ -f $(dir $@)radius/radiusd.pid ] || exit 1
+	${Q}$(call TLS_BRIDGE,$(tls.radius_port),$(dir $@)); \
+	$(TEST_BIN)/radclient -P tcp -x -f $< -d src/tests/radclient/config -D share/dictionary 127.0.0.1:$(TLS_BRIDGE_PORT) auth radsec 1> $(FOUND) 2>&1; \
+	kill `cat $(dir $@)socat.pid` >/dev/null 2>&1; \
+	if ! grep -q "^Received $(strip $(REPLY)) " $(FOUND); then \
+		echo "TLS FAILED $@";                                       \
+		echo "ERROR: Expected $(strip $(REPLY)), got:";             \
+		cat $(FOUND);                                               \
+		rm -f $(BUILD_DIR)/tests/test.tls;                          \
+		$(MAKE) --no-print-directory test.tls.radius.radiusd_kill;  \
+		exit 1;                                                     \
+	fi
+	${Q}touch $@
+
+#
+#	Run tacacs_client through the bridge, and compare its output with
+#	what we expect.
+#
+$(OUTPUT)/tacacs_%: $(DIR)/tacacs_% $(OUTPUT)/client.key $(BUILD_DIR)/lib/local/proto_tacacs_tls.la | $(TEST).tacacs.radiusd_kill $(TEST).tacacs.radiusd_start
+	$(eval TARGET   := $(notdir $<))
+	$(eval EXPECTED := $(patsubst %.txt,%.out,$<))
+	$(eval FOUND    := $(patsubst %.txt,%.out,$@))
+	$(eval ARGV     := $(shell grep "#.*ARGV:" $< | cut -f2 -d ':'))
+	${Q}echo "TLS-TEST INPUT=$(TARGET) TACACS_ARGV=\"$(ARGV)\""
+	${Q}[ -f $(dir $@)tacacs/radiusd.pid ] || exit 1
+	${Q}$(call TLS_BRIDGE,$(tls.tacacs_port),$(dir $@)); \
+	$(TACCLIENT) --return-0-if-failed -v -k $(SECRET) -p $(TLS_BRIDGE_PORT) -H 127.0.0.1 -r 192.168.69.1 -P pegapilha/0 --timeout 2 $(ARGV) 1> $(FOUND) 2>&1; \
+	kill `cat $(dir $@)socat.pid` >/dev/null 2>&1; \
+	if ! cmp -s $(FOUND) $(EXPECTED); then                              \
+		echo "TLS FAILED $@";                                       \
+		echo "ERROR: File $(FOUND) is not the same as $(EXPECTED)"; \
+		diff $(EXPECTED) $(FOUND);                                  \
+		rm -f $(BUILD_DIR)/tests/test.tls;                          \
+		$(MAKE) --no-print-directory test.tls.tacacs.radiusd_kill;  \
+		exit 1;                                                     \
+	fi
+	${Q}touch $@
+
+.NO_PARALLEL: $(TEST)
+$(TEST):
+	${Q}$(MAKE) --no-print-directory $@.radius.radiusd_stop $@.tacacs.radiusd_stop
+	@touch $(BUILD_DIR)/tests/$@
+
+else
+.PHONY: test.tls
+test.tls:
+	${Q}echo "WARNING: 'test.tls' requires 'socat'"
+	${Q}echo "Skipping 'test.tls'"
+endif